@@ -40,6 +40,7 @@
 #include <linux/mm.h>
 #include <linux/kexec.h>
 #include <linux/crash_dump.h>
+#include <linux/perf_event.h>
 
 #include <asm/boot.h>
 #include <asm/fixmap.h>
@@ -482,6 +483,7 @@ void __init arm64_memblock_init(void)
 	high_memory = __va(memblock_end_of_DRAM() - 1) + 1;
 
 	dma_contiguous_reserve(arm64_dma_phys_limit);
+	perf_aux_cma_reserve();
 
 	memblock_allow_resize();
 }
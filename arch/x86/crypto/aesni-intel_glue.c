@@ -791,6 +791,21 @@ static int generic_gcmaes_set_authsize(struct crypto_aead *tfm,
 	return 0;
 }
 
+/*
+ * Lowmem is mapped linearly, so the rest of a lowmem sg entry, such as a
+ * multi-page skb frag, can be processed in one go rather than a page at a
+ * time.
+ */
+static unsigned int gcmaes_sg_clamp(struct scatter_walk *walk,
+				    unsigned long left)
+{
+	if (PageHighMem(sg_page(walk->sg)))
+		return scatterwalk_clamp(walk, left);
+
+	return min_t(unsigned long, left,
+		     walk->sg->offset + walk->sg->length - walk->offset);
+}
+
 static int gcmaes_crypt_by_sg(bool enc, struct aead_request *req,
 			      unsigned int assoclen, u8 *hash_subkey,
 			      u8 *iv, void *aes_ctx)
@@ -844,8 +859,8 @@ static int gcmaes_crypt_by_sg(bool enc, struct aead_request *req,
 		while (left) {
 			src = scatterwalk_map(&src_sg_walk);
 			dst = scatterwalk_map(&dst_sg_walk);
-			srclen = scatterwalk_clamp(&src_sg_walk, left);
-			dstlen = scatterwalk_clamp(&dst_sg_walk, left);
+			srclen = gcmaes_sg_clamp(&src_sg_walk, left);
+			dstlen = gcmaes_sg_clamp(&dst_sg_walk, left);
 			len = min(srclen, dstlen);
 			if (len) {
 				if (enc)
@@ -867,7 +882,7 @@ static int gcmaes_crypt_by_sg(bool enc, struct aead_request *req,
 	} else {
 		while (left) {
 			dst = src = scatterwalk_map(&src_sg_walk);
-			len = scatterwalk_clamp(&src_sg_walk, left);
+			len = gcmaes_sg_clamp(&src_sg_walk, left);
 			if (len) {
 				if (enc)
 					aesni_gcm_enc_update(aes_ctx, &data,
@@ -915,7 +930,6 @@ static int gcmaes_crypt_by_sg(bool enc, struct aead_request *req,
 static int gcmaes_encrypt(struct aead_request *req, unsigned int assoclen,
 			  u8 *hash_subkey, u8 *iv, void *aes_ctx)
 {
-	u8 one_entry_in_sg = 0;
 	u8 *src, *dst, *assoc;
 	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
 	unsigned long auth_tag_len = crypto_aead_authsize(tfm);
@@ -929,31 +943,27 @@ static int gcmaes_encrypt(struct aead_request *req, unsigned int assoclen,
 		return gcmaes_crypt_by_sg(true, req, assoclen, hash_subkey, iv,
 					  aes_ctx);
 	}
-	if (sg_is_last(req->src) &&
-	    (!PageHighMem(sg_page(req->src)) ||
-	    req->src->offset + req->src->length <= PAGE_SIZE) &&
-	    sg_is_last(req->dst) &&
-	    (!PageHighMem(sg_page(req->dst)) ||
-	    req->dst->offset + req->dst->length <= PAGE_SIZE)) {
-		one_entry_in_sg = 1;
-		scatterwalk_start(&src_sg_walk, req->src);
-		assoc = scatterwalk_map(&src_sg_walk);
-		src = assoc + req->assoclen;
-		dst = src;
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_start(&dst_sg_walk, req->dst);
-			dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
-		}
-	} else {
-		/* Allocate memory for src, dst, assoc */
-		assoc = kmalloc(req->cryptlen + auth_tag_len + req->assoclen,
-			GFP_ATOMIC);
-		if (unlikely(!assoc))
-			return -ENOMEM;
-		scatterwalk_map_and_copy(assoc, req->src, 0,
-					 req->assoclen + req->cryptlen, 0);
-		src = assoc + req->assoclen;
-		dst = src;
+	/*
+	 * The AVX routines need linear buffers.  Rather than bouncing
+	 * fragmented requests through a copy, walk them with the update
+	 * routines.
+	 */
+	if (!sg_is_last(req->src) ||
+	    (PageHighMem(sg_page(req->src)) &&
+	    req->src->offset + req->src->length > PAGE_SIZE) ||
+	    !sg_is_last(req->dst) ||
+	    (PageHighMem(sg_page(req->dst)) &&
+	    req->dst->offset + req->dst->length > PAGE_SIZE))
+		return gcmaes_crypt_by_sg(true, req, assoclen, hash_subkey, iv,
+					  aes_ctx);
+
+	scatterwalk_start(&src_sg_walk, req->src);
+	assoc = scatterwalk_map(&src_sg_walk);
+	src = assoc + req->assoclen;
+	dst = src;
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_start(&dst_sg_walk, req->dst);
+		dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
 	}
 
 	kernel_fpu_begin();
@@ -962,29 +972,22 @@ static int gcmaes_encrypt(struct aead_request *req, unsigned int assoclen,
 			  dst + req->cryptlen, auth_tag_len);
 	kernel_fpu_end();
 
-	/* The authTag (aka the Integrity Check Value) needs to be written
-	 * back to the packet. */
-	if (one_entry_in_sg) {
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_unmap(dst - req->assoclen);
-			scatterwalk_advance(&dst_sg_walk, req->dst->length);
-			scatterwalk_done(&dst_sg_walk, 1, 0);
-		}
-		scatterwalk_unmap(assoc);
-		scatterwalk_advance(&src_sg_walk, req->src->length);
-		scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
-	} else {
-		scatterwalk_map_and_copy(dst, req->dst, req->assoclen,
-					 req->cryptlen + auth_tag_len, 1);
-		kfree(assoc);
+	/* The authTag (aka the Integrity Check Value) was written
+	 * straight into the packet. */
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_unmap(dst - req->assoclen);
+		scatterwalk_advance(&dst_sg_walk, req->dst->length);
+		scatterwalk_done(&dst_sg_walk, 1, 0);
 	}
+	scatterwalk_unmap(assoc);
+	scatterwalk_advance(&src_sg_walk, req->src->length);
+	scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
 	return 0;
 }
 
 static int gcmaes_decrypt(struct aead_request *req, unsigned int assoclen,
 			  u8 *hash_subkey, u8 *iv, void *aes_ctx)
 {
-	u8 one_entry_in_sg = 0;
 	u8 *src, *dst, *assoc;
 	unsigned long tempCipherLen = 0;
 	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
@@ -1003,33 +1006,25 @@ static int gcmaes_decrypt(struct aead_request *req, unsigned int assoclen,
 	}
 	tempCipherLen = (unsigned long)(req->cryptlen - auth_tag_len);
 
-	if (sg_is_last(req->src) &&
-	    (!PageHighMem(sg_page(req->src)) ||
-	    req->src->offset + req->src->length <= PAGE_SIZE) &&
-	    sg_is_last(req->dst) && req->dst->length &&
-	    (!PageHighMem(sg_page(req->dst)) ||
-	    req->dst->offset + req->dst->length <= PAGE_SIZE)) {
-		one_entry_in_sg = 1;
-		scatterwalk_start(&src_sg_walk, req->src);
-		assoc = scatterwalk_map(&src_sg_walk);
-		src = assoc + req->assoclen;
-		dst = src;
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_start(&dst_sg_walk, req->dst);
-			dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
-		}
-	} else {
-		/* Allocate memory for src, dst, assoc */
-		assoc = kmalloc(req->cryptlen + req->assoclen, GFP_ATOMIC);
-		if (!assoc)
-			return -ENOMEM;
-		scatterwalk_map_and_copy(assoc, req->src, 0,
-					 req->assoclen + req->cryptlen, 0);
-		src = assoc + req->assoclen;
-		dst = src;
+	/* See gcmaes_encrypt() */
+	if (!sg_is_last(req->src) ||
+	    (PageHighMem(sg_page(req->src)) &&
+	    req->src->offset + req->src->length > PAGE_SIZE) ||
+	    !sg_is_last(req->dst) || !req->dst->length ||
+	    (PageHighMem(sg_page(req->dst)) &&
+	    req->dst->offset + req->dst->length > PAGE_SIZE))
+		return gcmaes_crypt_by_sg(false, req, assoclen, hash_subkey,
+					  iv, aes_ctx);
+
+	scatterwalk_start(&src_sg_walk, req->src);
+	assoc = scatterwalk_map(&src_sg_walk);
+	src = assoc + req->assoclen;
+	dst = src;
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_start(&dst_sg_walk, req->dst);
+		dst = scatterwalk_map(&dst_sg_walk) + req->assoclen;
 	}
 
-
 	kernel_fpu_begin();
 	aesni_gcm_dec_tfm(aes_ctx, &data, dst, src, tempCipherLen, iv,
 			  hash_subkey, assoc, assoclen,
@@ -1040,20 +1035,14 @@ static int gcmaes_decrypt(struct aead_request *req, unsigned int assoclen,
 	retval = crypto_memneq(src + tempCipherLen, authTag, auth_tag_len) ?
 		-EBADMSG : 0;
 
-	if (one_entry_in_sg) {
-		if (unlikely(req->src != req->dst)) {
-			scatterwalk_unmap(dst - req->assoclen);
-			scatterwalk_advance(&dst_sg_walk, req->dst->length);
-			scatterwalk_done(&dst_sg_walk, 1, 0);
-		}
-		scatterwalk_unmap(assoc);
-		scatterwalk_advance(&src_sg_walk, req->src->length);
-		scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
-	} else {
-		scatterwalk_map_and_copy(dst, req->dst, req->assoclen,
-					 tempCipherLen, 1);
-		kfree(assoc);
+	if (unlikely(req->src != req->dst)) {
+		scatterwalk_unmap(dst - req->assoclen);
+		scatterwalk_advance(&dst_sg_walk, req->dst->length);
+		scatterwalk_done(&dst_sg_walk, 1, 0);
 	}
+	scatterwalk_unmap(assoc);
+	scatterwalk_advance(&src_sg_walk, req->src->length);
+	scatterwalk_done(&src_sg_walk, req->src == req->dst, 0);
 	return retval;
 
 }
@@ -14,8 +14,12 @@
 #include <linux/if_vlan.h>
 #include <linux/bpf.h>
 
+#include <linux/memory.h>
+
 #include <asm/set_memory.h>
 #include <asm/nospec-branch.h>
+#include <asm/text-patching.h>
+#include <asm/nops.h>
 
 static u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
 {
@@ -408,6 +412,81 @@ static void emit_mov_reg(u8 **pprog, bool is64, u32 dst_reg, u32 src_reg)
 	*pprog = prog;
 }
 
+#define X86_PATCH_SIZE 5
+
+static int emit_call(u8 **pprog, void *func, void *ip)
+{
+	u8 *prog = *pprog;
+	int cnt = 0;
+	s64 offset;
+
+	offset = func - (ip + X86_PATCH_SIZE);
+	if (!is_simm32(offset)) {
+		pr_err("Target call %p is out of range\n", func);
+		return -EINVAL;
+	}
+	EMIT1_off32(0xE8, offset);
+	*pprog = prog;
+	return 0;
+}
+
+int bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
+		       void *old_addr, void *new_addr)
+{
+	const u8 *nop_insn = ideal_nops[NOP_ATOMIC5];
+	u8 old_insn[X86_PATCH_SIZE] = {};
+	u8 new_insn[X86_PATCH_SIZE] = {};
+	u8 *prog;
+	int ret;
+
+	if (!core_kernel_text((unsigned long)ip))
+		/* trampolines for module functions aren't supported */
+		return -EINVAL;
+
+	if (old_addr) {
+		prog = old_insn;
+		ret = emit_call(&prog, old_addr, ip);
+		if (ret)
+			return ret;
+	}
+	if (new_addr) {
+		prog = new_insn;
+		ret = emit_call(&prog, new_addr, ip);
+		if (ret)
+			return ret;
+	}
+
+	/* While the int3 of text_poke_bp() is in place, a cpu hitting the
+	 * site skips the instruction, as if it still were the nop.
+	 */
+	ret = -EBUSY;
+	mutex_lock(&text_mutex);
+	switch (t) {
+	case BPF_MOD_NOP_TO_CALL:
+		if (memcmp(ip, nop_insn, X86_PATCH_SIZE))
+			goto out;
+		text_poke_bp(ip, new_insn, X86_PATCH_SIZE,
+			     ip + X86_PATCH_SIZE);
+		break;
+	case BPF_MOD_CALL_TO_CALL:
+		if (memcmp(ip, old_insn, X86_PATCH_SIZE))
+			goto out;
+		text_poke_bp(ip, new_insn, X86_PATCH_SIZE,
+			     ip + X86_PATCH_SIZE);
+		break;
+	case BPF_MOD_CALL_TO_NOP:
+		if (memcmp(ip, old_insn, X86_PATCH_SIZE))
+			goto out;
+		text_poke_bp(ip, nop_insn, X86_PATCH_SIZE,
+			     ip + X86_PATCH_SIZE);
+		break;
+	}
+	ret = 0;
+out:
+	mutex_unlock(&text_mutex);
+	return ret;
+}
+
 static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 		  int oldproglen, struct jit_context *ctx)
 {
@@ -459,6 +538,18 @@ static int do_jit(struct bpf_prog *bpf_prog, int *addrs, u8 *image,
 			break;
 
 		case BPF_ALU64 | BPF_MOV | BPF_X:
+			if (insn->off == BPF_ADDR_PERCPU) {
+				/* mov dst, src */
+				EMIT_mov(dst_reg, src_reg);
+#ifdef CONFIG_SMP
+				/* add dst, gs:[this_cpu_off] */
+				EMIT2(0x65, is_ereg(dst_reg) ? 0x4C : 0x48);
+				EMIT3(0x03, add_2reg(0x04, 0, dst_reg), 0x25);
+				EMIT((u32)(unsigned long)&this_cpu_off, 4);
+#endif
+				break;
+			}
+			/* fall through */
 		case BPF_ALU | BPF_MOV | BPF_X:
 			emit_mov_reg(&prog,
 				     BPF_CLASS(insn->code) == BPF_ALU64,
@@ -1052,6 +1143,162 @@ xadd:			if (is_imm8(insn->off))
 	return proglen;
 }
 
+#ifdef CONFIG_BPF_SYSCALL
+/* x86-64 registers carrying the arguments of a kernel function */
+static const u8 tramp_arg_regs[BPF_MAX_TRAMP_ARGS] = {
+	7,	/* RDI */
+	6,	/* RSI */
+	2,	/* RDX */
+	1,	/* RCX */
+	8,	/* R8 */
+	9,	/* R9 */
+};
+
+/* mov [rbp + off], reg or mov reg, [rbp + off] */
+static void emit_rbp_xfer(u8 **pprog, u8 opcode, u8 reg, int off)
+{
+	u8 *prog = *pprog;
+	int cnt = 0;
+
+	EMIT4(reg >= 8 ? 0x4C : 0x48, opcode, 0x45 | (reg & 7) << 3,
+	      (u8)off);
+	*pprog = prog;
+}
+
+static void save_regs(u8 **pprog, int nr_args, int stack_size)
+{
+	int i;
+
+	for (i = 0; i < nr_args; i++)
+		emit_rbp_xfer(pprog, 0x89, tramp_arg_regs[i],
+			      -(stack_size - i * 8));
+}
+
+static void restore_regs(u8 **pprog, int nr_args, int stack_size)
+{
+	int i;
+
+	for (i = 0; i < nr_args; i++)
+		emit_rbp_xfer(pprog, 0x8B, tramp_arg_regs[i],
+			      -(stack_size - i * 8));
+}
+
+static int invoke_bpf(u8 **pprog, struct bpf_prog *p, int stack_size)
+{
+	u8 *prog = *pprog, *jmp_insn;
+	int cnt = 0;
+
+	if (emit_call(&prog, __bpf_prog_enter, prog))
+		return -EINVAL;
+	/* test eax, eax; je skip */
+	EMIT2(0x85, 0xC0);
+	jmp_insn = prog;
+	EMIT2_off32(0x0F, X86_JE + 0x10, 0);
+
+	/* arg1: lea rdi, [rbp - stack_size] */
+	EMIT4(0x48, 0x8D, 0x7D, (u8)-stack_size);
+	/* arg2: insnsi for the interpreter */
+	if (!p->jited)
+		emit_mov_imm64(&prog, BPF_REG_2, (long) p->insnsi >> 32,
+			       (u32) (long) p->insnsi);
+	if (emit_call(&prog, p->bpf_func, prog))
+		return -EINVAL;
+
+	/* skip: */
+	*(s32 *)(jmp_insn + 2) = prog - (jmp_insn + 6);
+	if (emit_call(&prog, __bpf_prog_exit, prog))
+		return -EINVAL;
+
+	*pprog = prog;
+	return 0;
+}
+
+/* The trampoline is called from the patched fentry call site of the
+ * traced function, so on entry the stack holds the return address into
+ * the function body and, above it, the one into the function's caller:
+ *
+ *   push rbp
+ *   mov rbp, rsp
+ *   sub rsp, stack_size
+ *   mov [rbp - stack_size + i * 8], <arg i>	for each argument
+ *   <run the fentry programs with ctx = rbp - stack_size>
+ *   restore the arguments, call the function body,
+ *   mov [rbp - 8], rax				with fexit programs
+ *   <run the fexit programs with ctx = rbp - stack_size>
+ *   restore the arguments, or the return value into rax
+ *   leave
+ *   add rsp, 8				with fexit programs
+ *   ret
+ */
+int arch_prepare_bpf_trampoline(void *image, u32 nr_args, u32 flags,
+				struct bpf_prog **fentry_progs, int fentry_cnt,
+				struct bpf_prog **fexit_progs, int fexit_cnt,
+				void *orig_call)
+{
+	int i, cnt = 0, stack_size = nr_args * 8;
+	u8 *prog;
+
+	if (nr_args > BPF_MAX_TRAMP_ARGS)
+		return -ENOTSUPP;
+
+	if ((flags & BPF_TRAMP_F_RESTORE_REGS) &&
+	    (flags & BPF_TRAMP_F_SKIP_FRAME))
+		return -EINVAL;
+
+	if (flags & BPF_TRAMP_F_CALL_ORIG)
+		/* room for the return value of orig_call */
+		stack_size += 8;
+
+	if (flags & BPF_TRAMP_F_SKIP_FRAME)
+		/* skip the patched call and call the body directly */
+		orig_call += X86_PATCH_SIZE;
+
+	prog = image;
+
+	EMIT1(0x55);		 /* push rbp */
+	EMIT3(0x48, 0x89, 0xE5); /* mov rbp, rsp */
+	if (stack_size)
+		EMIT4(0x48, 0x83, 0xEC, stack_size); /* sub rsp, stack_size */
+
+	save_regs(&prog, nr_args, stack_size);
+
+	for (i = 0; i < fentry_cnt; i++)
+		if (invoke_bpf(&prog, fentry_progs[i], stack_size))
+			return -EINVAL;
+
+	if (flags & BPF_TRAMP_F_CALL_ORIG) {
+		if (fentry_cnt)
+			restore_regs(&prog, nr_args, stack_size);
+		if (emit_call(&prog, orig_call, prog))
+			return -EINVAL;
+		/* mov [rbp - 8], rax */
+		emit_rbp_xfer(&prog, 0x89, 0, -8);
+	}
+
+	for (i = 0; i < fexit_cnt; i++)
+		if (invoke_bpf(&prog, fexit_progs[i], stack_size))
+			return -EINVAL;
+
+	if (flags & BPF_TRAMP_F_RESTORE_REGS)
+		restore_regs(&prog, nr_args, stack_size);
+
+	if (flags & BPF_TRAMP_F_CALL_ORIG)
+		/* mov rax, [rbp - 8] */
+		emit_rbp_xfer(&prog, 0x8B, 0, -8);
+
+	EMIT1(0xC9); /* leave */
+	if (flags & BPF_TRAMP_F_SKIP_FRAME)
+		/* add rsp, 8: return straight to the parent */
+		EMIT4(0x48, 0x83, 0xC4, 8);
+	EMIT1(0xC3); /* ret */
+
+	/* the other half of the page may hold the live image */
+	if (WARN_ON_ONCE(prog - (u8 *)image > PAGE_SIZE / 2))
+		return -EFAULT;
+	return 0;
+}
+#endif /* CONFIG_BPF_SYSCALL */
+
 struct x64_jit_data {
 	struct bpf_binary_header *header;
 	int *addrs;
@@ -1192,3 +1439,13 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 					   tmp : orig_prog);
 	return prog;
 }
+
+bool bpf_jit_supports_percpu_insn(void)
+{
+	return true;
+}
+
+bool bpf_jit_supports_image_sharing(void)
+{
+	return true;
+}
@@ -1165,6 +1165,8 @@ int blk_init_allocated_queue(struct request_queue *q)
 	if (blk_init_rl(&q->root_rl, q, GFP_KERNEL))
 		goto out_exit_flush_rq;
 
+	blk_stat_enable_hist(q);
+
 	INIT_WORK(&q->timeout_work, blk_timeout_work);
 	q->queue_flags		|= QUEUE_FLAG_DEFAULT;
 
@@ -2008,6 +2010,9 @@ static blk_qc_t blk_queue_bio(struct request_queue *q, struct bio *bio)
 	if (!bio_integrity_prep(bio))
 		return BLK_QC_T_NONE;
 
+	blk_iolatency_throttle(q, bio);
+	blk_iocost_throttle(q, bio);
+
 	if (op_is_flush(bio->bi_opf)) {
 		spin_lock_irq(q->queue_lock);
 		where = ELEVATOR_INSERT_FLUSH;
@@ -2291,6 +2296,14 @@ generic_make_request_checks(struct bio *bio)
 		}
 	}
 
+	/*
+	 * Nobody is going to poll a queue that can't be, so don't let the
+	 * bio or the clones a stacking driver makes of it look polled to a
+	 * queue that would only reap them through polling.
+	 */
+	if (!test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
+		bio->bi_opf &= ~REQ_HIPRI;
+
 	switch (bio_op(bio)) {
 	case REQ_OP_DISCARD:
 		if (!blk_queue_discard(q))
@@ -3593,6 +3606,8 @@ void blk_start_plug(struct blk_plug *plug)
 	INIT_LIST_HEAD(&plug->list);
 	INIT_LIST_HEAD(&plug->mq_list);
 	INIT_LIST_HEAD(&plug->cb_list);
+	plug->tag_hctx = NULL;
+	plug->cached_tags = 0;
 	/*
 	 * Store ordering should not be needed here, since a potential
 	 * preempt will imply a full memory barrier
@@ -3685,6 +3700,9 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	if (!list_empty(&plug->mq_list))
 		blk_mq_flush_plug_list(plug, from_schedule);
 
+	if (plug->tag_hctx)
+		blk_mq_put_plug_tags(plug);
+
 	if (list_empty(&plug->list))
 		return;
 
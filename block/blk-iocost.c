@@ -0,0 +1,514 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Block cost model based proportional cgroup I/O controller
+ *
+ * Every bio is given a cost in device time by a linear model of the
+ * device: a per-I/O cost, which depends on whether the bio is sequential to
+ * the previous one of its group, plus a per-page cost.  The model is set up
+ * from the sequential and random IOPS and the bandwidth of the device, for
+ * reads and writes, with io.cost.model on the root cgroup.
+ *
+ * Each active group has a virtual time, which the cost of its bios advances
+ * scaled by the share its io.cost.weight gives it of the weights of all the
+ * active groups.  A group can run ahead of the wall clock by a small margin
+ * only: a bio that pushes it further out sleeps at issue until the clock
+ * catches up.  Nothing is scheduled or reordered, so the cost of the
+ * controller is a few atomic operations per bio.  A group that stops
+ * issuing drops out of the active set after a period, and the group left
+ * alone on a device is never held up.
+ *
+ * The groups of a device are treated as a flat set, the hierarchy isn't
+ * taken into account when the shares are computed.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/blk-cgroup.h>
+#include <linux/hrtimer.h>
+#include "blk.h"
+
+/* how far a group can run ahead of the clock without waiting */
+#define IOC_MARGIN_NSEC		(2 * NSEC_PER_MSEC)
+/* a group that hasn't issued for this long is no longer active */
+#define IOC_PERIOD_NSEC		(50 * NSEC_PER_MSEC)
+
+enum {
+	I_MODEL_RBPS,
+	I_MODEL_RSEQIOPS,
+	I_MODEL_RRANDIOPS,
+	I_MODEL_WBPS,
+	I_MODEL_WSEQIOPS,
+	I_MODEL_WRANDIOPS,
+	NR_I_MODEL,
+};
+
+static const char * const ioc_model_names[NR_I_MODEL] = {
+	[I_MODEL_RBPS]		= "rbps",
+	[I_MODEL_RSEQIOPS]	= "rseqiops",
+	[I_MODEL_RRANDIOPS]	= "rrandiops",
+	[I_MODEL_WBPS]		= "wbps",
+	[I_MODEL_WSEQIOPS]	= "wseqiops",
+	[I_MODEL_WRANDIOPS]	= "wrandiops",
+};
+
+/* a middle of the road SSD, to start from */
+static const u64 ioc_model_dfl[NR_I_MODEL] = {
+	[I_MODEL_RBPS]		= 488636629,
+	[I_MODEL_RSEQIOPS]	= 8932,
+	[I_MODEL_RRANDIOPS]	= 8518,
+	[I_MODEL_WBPS]		= 427891549,
+	[I_MODEL_WSEQIOPS]	= 28755,
+	[I_MODEL_WRANDIOPS]	= 21940,
+};
+
+static struct blkcg_policy blkcg_policy_iocost;
+
+struct ioc {
+	struct request_queue *q;
+	bool enabled;
+	u64 model[NR_I_MODEL];
+
+	/* costs derived from the model, in nsecs, indexed by READ/WRITE */
+	u64 seq_cost[2];
+	u64 rand_cost[2];
+	u64 page_cost[2];
+
+	/* protects the fields below and the active state of the groups */
+	spinlock_t lock;
+	unsigned int weight_sum;
+	struct list_head active_iocgs;
+	struct timer_list timer;
+};
+
+struct ioc_gq {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+	struct ioc *ioc;
+
+	atomic64_t vtime;
+	sector_t cursor;
+	u64 last_issue;
+
+	bool active;
+	bool offline;
+	/* the weight accounted in ioc->weight_sum while active */
+	unsigned int weight;
+	struct list_head active_list;
+};
+
+struct ioc_cgrp {
+	/* must be the first member */
+	struct blkcg_policy_data cpd;
+	unsigned int weight;
+};
+
+static inline struct ioc_gq *pd_to_iocg(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct ioc_gq, pd) : NULL;
+}
+
+static inline struct ioc_gq *blkg_to_iocg(struct blkcg_gq *blkg)
+{
+	return pd_to_iocg(blkg_to_pd(blkg, &blkcg_policy_iocost));
+}
+
+static inline struct ioc_cgrp *blkcg_to_iocc(struct blkcg *blkcg)
+{
+	return container_of(blkcg_to_cpd(blkcg, &blkcg_policy_iocost),
+			    struct ioc_cgrp, cpd);
+}
+
+static void ioc_refresh_costs(struct ioc *ioc)
+{
+	int rw;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		const u64 *model = rw == READ ? &ioc->model[I_MODEL_RBPS] :
+						&ioc->model[I_MODEL_WBPS];
+		u64 page, seq, rand;
+
+		page = div64_u64(NSEC_PER_SEC * PAGE_SIZE, model[0]);
+		seq = div64_u64(NSEC_PER_SEC, model[1]);
+		rand = div64_u64(NSEC_PER_SEC, model[2]);
+
+		/* the IOPS were measured with one page per I/O */
+		ioc->page_cost[rw] = page;
+		ioc->seq_cost[rw] = seq > page ? seq - page : 0;
+		ioc->rand_cost[rw] = rand > page ? rand - page : 0;
+	}
+}
+
+static void ioc_arm_timer(struct ioc *ioc)
+{
+	if (!timer_pending(&ioc->timer))
+		mod_timer(&ioc->timer,
+			  jiffies + nsecs_to_jiffies(IOC_PERIOD_NSEC));
+}
+
+static void iocg_activate(struct ioc *ioc, struct ioc_gq *iocg, u64 now)
+{
+	struct ioc_cgrp *iocc = blkcg_to_iocc(iocg->pd.blkg->blkcg);
+
+	spin_lock_irq(&ioc->lock);
+	if (!iocg->active && !iocg->offline) {
+		iocg->weight = iocc->weight;
+		ioc->weight_sum += iocg->weight;
+		list_add(&iocg->active_list, &ioc->active_iocgs);
+		/* whatever was left over from the last time is forgotten */
+		atomic64_set(&iocg->vtime, now);
+		WRITE_ONCE(iocg->active, true);
+		ioc_arm_timer(ioc);
+	}
+	spin_unlock_irq(&ioc->lock);
+}
+
+static void iocg_deactivate(struct ioc *ioc, struct ioc_gq *iocg)
+{
+	lockdep_assert_held(&ioc->lock);
+
+	list_del_init(&iocg->active_list);
+	ioc->weight_sum -= iocg->weight;
+	WRITE_ONCE(iocg->active, false);
+}
+
+static u64 ioc_bio_cost(struct ioc *ioc, struct ioc_gq *iocg,
+			struct bio *bio)
+{
+	int rw = op_is_write(bio_op(bio)) ? WRITE : READ;
+	u64 pages = DIV_ROUND_UP(bio->bi_iter.bi_size, PAGE_SIZE);
+	u64 cost;
+
+	if (bio->bi_iter.bi_sector == READ_ONCE(iocg->cursor))
+		cost = ioc->seq_cost[rw];
+	else
+		cost = ioc->rand_cost[rw];
+	WRITE_ONCE(iocg->cursor, bio_end_sector(bio));
+
+	return cost + pages * ioc->page_cost[rw];
+}
+
+/*
+ * Called for each bio before a request is allocated for it, without the
+ * queue lock held.  Charges the bio to its group and might sleep until the
+ * group is back within its share.
+ */
+void blk_iocost_throttle(struct request_queue *q, struct bio *bio)
+{
+	struct ioc *ioc = q->blkioc;
+	struct blkcg_gq *blkg;
+	struct ioc_gq *iocg;
+	unsigned int weight_sum;
+	u64 now, cost, vtime;
+	ktime_t timeout;
+	s64 delay;
+
+	if (!ioc || !READ_ONCE(ioc->enabled))
+		return;
+	if (bio_op(bio) != REQ_OP_READ && bio_op(bio) != REQ_OP_WRITE)
+		return;
+
+	rcu_read_lock();
+	blkg = blkg_lookup(bio_blkcg(bio), q) ?: q->root_blkg;
+	iocg = blkg_to_iocg(blkg);
+	if (!iocg) {
+		rcu_read_unlock();
+		return;
+	}
+
+	now = ktime_get_ns();
+	if (!READ_ONCE(iocg->active))
+		iocg_activate(ioc, iocg, now);
+	WRITE_ONCE(iocg->last_issue, now);
+
+	/* a group that was idle doesn't get to bank its share */
+	vtime = atomic64_read(&iocg->vtime);
+	if ((s64)(vtime - now) < 0)
+		atomic64_cmpxchg(&iocg->vtime, vtime, now);
+
+	weight_sum = READ_ONCE(ioc->weight_sum);
+	cost = div_u64(ioc_bio_cost(ioc, iocg, bio) * weight_sum,
+		       iocg->weight);
+	vtime = atomic64_add_return(cost, &iocg->vtime);
+	delay = vtime - now - IOC_MARGIN_NSEC;
+
+	/* alone on the device, there is nobody to share with */
+	if (delay > 0 && iocg->weight >= weight_sum) {
+		atomic64_sub(delay, &iocg->vtime);
+		delay = 0;
+	}
+	rcu_read_unlock();
+
+	/*
+	 * Metadata can be needed to make progress by anybody, don't hold it
+	 * up behind the share of a low weight group.
+	 */
+	if (delay <= 0 || (bio->bi_opf & (REQ_META | REQ_NOWAIT)))
+		return;
+
+	timeout = ns_to_ktime(delay);
+	__set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&timeout, HRTIMER_MODE_REL);
+}
+
+static void ioc_timer_fn(struct timer_list *t)
+{
+	struct ioc *ioc = from_timer(ioc, t, timer);
+	struct ioc_gq *iocg, *tmp;
+	unsigned int weight_sum = 0;
+	u64 now = ktime_get_ns();
+
+	spin_lock_irq(&ioc->lock);
+
+	list_for_each_entry_safe(iocg, tmp, &ioc->active_iocgs, active_list) {
+		u64 idle = now - READ_ONCE(iocg->last_issue);
+
+		/* idle, and nobody waiting on the share of the group */
+		if (idle > IOC_PERIOD_NSEC &&
+		    (s64)(atomic64_read(&iocg->vtime) - now) <= 0) {
+			iocg_deactivate(ioc, iocg);
+			continue;
+		}
+
+		/* pick up weight changes */
+		iocg->weight = blkcg_to_iocc(iocg->pd.blkg->blkcg)->weight;
+		weight_sum += iocg->weight;
+	}
+	WRITE_ONCE(ioc->weight_sum, weight_sum);
+
+	if (!list_empty(&ioc->active_iocgs))
+		ioc_arm_timer(ioc);
+
+	spin_unlock_irq(&ioc->lock);
+}
+
+static struct blkcg_policy_data *ioc_cpd_alloc(gfp_t gfp)
+{
+	struct ioc_cgrp *iocc;
+
+	iocc = kzalloc(sizeof(*iocc), gfp);
+	if (!iocc)
+		return NULL;
+	return &iocc->cpd;
+}
+
+static void ioc_cpd_init(struct blkcg_policy_data *cpd)
+{
+	container_of(cpd, struct ioc_cgrp, cpd)->weight = CGROUP_WEIGHT_DFL;
+}
+
+static void ioc_cpd_free(struct blkcg_policy_data *cpd)
+{
+	kfree(container_of(cpd, struct ioc_cgrp, cpd));
+}
+
+static struct blkg_policy_data *ioc_pd_alloc(gfp_t gfp, int node)
+{
+	struct ioc_gq *iocg;
+
+	iocg = kzalloc_node(sizeof(*iocg), gfp, node);
+	if (!iocg)
+		return NULL;
+	return &iocg->pd;
+}
+
+static void ioc_pd_init(struct blkg_policy_data *pd)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+
+	iocg->ioc = pd->blkg->q->blkioc;
+	atomic64_set(&iocg->vtime, 0);
+	INIT_LIST_HEAD(&iocg->active_list);
+}
+
+static void ioc_pd_offline(struct blkg_policy_data *pd)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+	struct ioc *ioc = iocg->ioc;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	if (iocg->active)
+		iocg_deactivate(ioc, iocg);
+	iocg->offline = true;
+	spin_unlock_irqrestore(&ioc->lock, flags);
+}
+
+static void ioc_pd_free(struct blkg_policy_data *pd)
+{
+	kfree(pd_to_iocg(pd));
+}
+
+static u64 ioc_weight_read(struct cgroup_subsys_state *css,
+			   struct cftype *cft)
+{
+	return blkcg_to_iocc(css_to_blkcg(css))->weight;
+}
+
+static int ioc_weight_write(struct cgroup_subsys_state *css,
+			    struct cftype *cft, u64 val)
+{
+	if (val < CGROUP_WEIGHT_MIN || val > CGROUP_WEIGHT_MAX)
+		return -ERANGE;
+
+	/* the active groups pick it up at the end of the period */
+	WRITE_ONCE(blkcg_to_iocc(css_to_blkcg(css))->weight, val);
+	return 0;
+}
+
+static u64 ioc_model_prfill(struct seq_file *sf, struct blkg_policy_data *pd,
+			    int off)
+{
+	struct ioc *ioc = pd_to_iocg(pd)->ioc;
+	const char *dname = blkg_dev_name(pd->blkg);
+	int i;
+
+	if (!dname)
+		return 0;
+
+	seq_printf(sf, "%s enable=%d", dname, ioc->enabled);
+	for (i = 0; i < NR_I_MODEL; i++)
+		seq_printf(sf, " %s=%llu", ioc_model_names[i], ioc->model[i]);
+	seq_putc(sf, '\n');
+	return 0;
+}
+
+static int ioc_model_show(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), ioc_model_prfill,
+			  &blkcg_policy_iocost, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t ioc_model_write(struct kernfs_open_file *of, char *buf,
+			       size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	u64 model[NR_I_MODEL];
+	struct ioc *ioc;
+	bool enable;
+	char *p, *tok;
+	int ret, i;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iocost, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ioc = ctx.blkg->q->blkioc;
+	enable = ioc->enabled;
+	memcpy(model, ioc->model, sizeof(model));
+	p = strim(ctx.body);
+
+	ret = -EINVAL;
+	while ((tok = strsep(&p, " "))) {
+		char key[16];
+		char val[21];	/* 18446744073709551616 */
+		u64 v;
+
+		if (!*tok)
+			continue;
+
+		if (sscanf(tok, "%15[^=]=%20s", key, val) != 2)
+			goto out_finish;
+		if (kstrtou64(val, 10, &v))
+			goto out_finish;
+
+		if (!strcmp(key, "enable")) {
+			enable = v;
+			continue;
+		}
+		for (i = 0; i < NR_I_MODEL; i++)
+			if (!strcmp(key, ioc_model_names[i]))
+				break;
+		if (i == NR_I_MODEL || !v)
+			goto out_finish;
+		model[i] = v;
+	}
+
+	spin_lock_irq(&ioc->lock);
+	memcpy(ioc->model, model, sizeof(model));
+	ioc_refresh_costs(ioc);
+	WRITE_ONCE(ioc->enabled, enable);
+	spin_unlock_irq(&ioc->lock);
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static struct cftype ioc_files[] = {
+	{
+		.name = "cost.weight",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = ioc_weight_read,
+		.write_u64 = ioc_weight_write,
+	},
+	{
+		.name = "cost.model",
+		.flags = CFTYPE_ONLY_ON_ROOT,
+		.seq_show = ioc_model_show,
+		.write = ioc_model_write,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iocost = {
+	.dfl_cftypes		= ioc_files,
+	.cpd_alloc_fn		= ioc_cpd_alloc,
+	.cpd_init_fn		= ioc_cpd_init,
+	.cpd_free_fn		= ioc_cpd_free,
+	.pd_alloc_fn		= ioc_pd_alloc,
+	.pd_init_fn		= ioc_pd_init,
+	.pd_offline_fn		= ioc_pd_offline,
+	.pd_free_fn		= ioc_pd_free,
+};
+
+int blk_iocost_init(struct request_queue *q)
+{
+	struct ioc *ioc;
+	int ret;
+
+	ioc = kzalloc_node(sizeof(*ioc), GFP_KERNEL, q->node);
+	if (!ioc)
+		return -ENOMEM;
+
+	ioc->q = q;
+	memcpy(ioc->model, ioc_model_dfl, sizeof(ioc->model));
+	ioc_refresh_costs(ioc);
+	spin_lock_init(&ioc->lock);
+	INIT_LIST_HEAD(&ioc->active_iocgs);
+	timer_setup(&ioc->timer, ioc_timer_fn, 0);
+	q->blkioc = ioc;
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iocost);
+	if (ret) {
+		q->blkioc = NULL;
+		kfree(ioc);
+	}
+	return ret;
+}
+
+void blk_iocost_exit(struct request_queue *q)
+{
+	struct ioc *ioc = q->blkioc;
+
+	del_timer_sync(&ioc->timer);
+	blkcg_deactivate_policy(q, &blkcg_policy_iocost);
+	q->blkioc = NULL;
+	kfree(ioc);
+}
+
+static int __init ioc_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iocost);
+}
+
+static void __exit ioc_exit(void)
+{
+	blkcg_policy_unregister(&blkcg_policy_iocost);
+}
+
+module_init(ioc_init);
+module_exit(ioc_exit);
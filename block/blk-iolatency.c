@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Block latency target based cgroup I/O controller
+ *
+ * A cgroup can ask for a completion latency target on a device with
+ * io.latency, "MAJ:MIN target=<usecs>".  The latency of the bios of the
+ * groups that have a target is sampled over a window.  When a group misses
+ * its target over a window, the queue depth of every group with a looser
+ * target, or with no target at all, is halved.  Once all the targets are
+ * met again, the throttled groups get their depth back a step per window,
+ * until they are no longer limited.
+ *
+ * The groups of a device are treated as a flat set: the target of a group
+ * does not depend on its place in the hierarchy, and the root group is
+ * never throttled.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/blk-cgroup.h>
+#include "blk.h"
+#include "blk-stat.h"
+
+/* length of the sampling window */
+#define IOLAT_WIN_NSEC		(100 * NSEC_PER_MSEC)
+/* a group isn't judged on fewer completions than this in a window */
+#define IOLAT_MIN_SAMPLES	4
+
+static struct blkcg_policy blkcg_policy_iolatency;
+
+struct blk_iolatency {
+	struct request_queue *q;
+	struct timer_list timer;
+};
+
+struct iolatency_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	/* the latency target, 0 when the group has none */
+	u64 min_lat_nsec;
+	struct blk_rq_stat __percpu *stats;
+
+	atomic_t inflight;
+	/* queue depth the group is held to, UINT_MAX when not throttled */
+	unsigned int max_depth;
+	wait_queue_head_t wait;
+};
+
+static inline struct iolatency_grp *pd_to_lat(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolatency_grp, pd) : NULL;
+}
+
+static inline struct iolatency_grp *blkg_to_lat(struct blkcg_gq *blkg)
+{
+	return pd_to_lat(blkg_to_pd(blkg, &blkcg_policy_iolatency));
+}
+
+static inline void iolat_arm_timer(struct blk_iolatency *blkiolat)
+{
+	if (!timer_pending(&blkiolat->timer))
+		mod_timer(&blkiolat->timer,
+			  jiffies + nsecs_to_jiffies(IOLAT_WIN_NSEC));
+}
+
+/* Take an inflight slot if the group is below its depth */
+static bool iolat_inflight_inc(struct iolatency_grp *iolat)
+{
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+	int cur;
+
+	if (depth == UINT_MAX) {
+		atomic_inc(&iolat->inflight);
+		return true;
+	}
+
+	for (;;) {
+		cur = atomic_read(&iolat->inflight);
+		if (cur >= depth)
+			return false;
+		if (atomic_cmpxchg(&iolat->inflight, cur, cur + 1) == cur)
+			return true;
+	}
+}
+
+static void iolat_wait(struct iolatency_grp *iolat)
+{
+	DEFINE_WAIT(wait);
+
+	for (;;) {
+		prepare_to_wait_exclusive(&iolat->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (iolat_inflight_inc(iolat))
+			break;
+		io_schedule();
+	}
+	finish_wait(&iolat->wait, &wait);
+}
+
+/*
+ * Called for each bio before a request is allocated for it, without the
+ * queue lock held.  Might sleep while the group of the bio is over its
+ * depth.
+ */
+void blk_iolatency_throttle(struct request_queue *q, struct bio *bio)
+{
+	struct iolatency_grp *iolat;
+	struct blkcg_gq *blkg;
+	struct blkcg *blkcg;
+
+	if (!q->blkiolat || bio_flagged(bio, BIO_TRACKED))
+		return;
+
+	rcu_read_lock();
+	blkcg = bio_blkcg(bio);
+	blkg = blkg_lookup(blkcg, q);
+	if (unlikely(!blkg)) {
+		spin_lock_irq(q->queue_lock);
+		blkg = blkg_lookup_create(blkcg, q);
+		if (IS_ERR(blkg))
+			blkg = NULL;
+		spin_unlock_irq(q->queue_lock);
+	}
+	iolat = blkg_to_lat(blkg);
+	if (!iolat || blkg == q->root_blkg)
+		goto out_unlock;
+
+	/* the completion side has to find the same group */
+	bio_associate_blkcg(bio, &blkcg->css);
+	bio_issue_init(&bio->bi_issue, bio_sectors(bio));
+	bio_set_flag(bio, BIO_TRACKED);
+
+	/*
+	 * Metadata can be needed to make progress by anybody, don't hold it
+	 * up behind the depth of a low priority group.
+	 */
+	if (bio->bi_opf & (REQ_META | REQ_NOWAIT)) {
+		atomic_inc(&iolat->inflight);
+		goto out_unlock;
+	}
+	if (iolat_inflight_inc(iolat))
+		goto out_unlock;
+
+	blkg_get(blkg);
+	rcu_read_unlock();
+
+	iolat_wait(iolat);
+	blkg_put(blkg);
+	return;
+
+out_unlock:
+	rcu_read_unlock();
+}
+
+void __blk_iolatency_done_bio(struct bio *bio)
+{
+	struct request_queue *q = bio->bi_disk->queue;
+	struct iolatency_grp *iolat;
+	struct blkcg_gq *blkg;
+
+	bio_clear_flag(bio, BIO_TRACKED);
+
+	rcu_read_lock();
+	blkg = blkg_lookup(bio_blkcg(bio), q);
+	iolat = blkg_to_lat(blkg);
+	if (!iolat)
+		goto out;
+
+	if (atomic_dec_if_positive(&iolat->inflight) >= 0 &&
+	    waitqueue_active(&iolat->wait))
+		wake_up(&iolat->wait);
+
+	if (READ_ONCE(iolat->min_lat_nsec) && !bio->bi_status) {
+		u64 now = __bio_issue_time(ktime_get_ns());
+		u64 issue = bio_issue_time(&bio->bi_issue);
+		struct blk_rq_stat *stat;
+
+		stat = get_cpu_ptr(iolat->stats);
+		blk_rq_stat_add(stat, now >= issue ? now - issue : 0);
+		put_cpu_ptr(iolat->stats);
+		iolat_arm_timer(q->blkiolat);
+	}
+out:
+	rcu_read_unlock();
+}
+
+static void iolat_scale_down(struct iolatency_grp *iolat,
+			     struct request_queue *q)
+{
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+
+	if (depth == UINT_MAX)
+		depth = q->nr_requests;
+	WRITE_ONCE(iolat->max_depth, max(depth / 2, 1U));
+}
+
+static bool iolat_scale_up(struct iolatency_grp *iolat,
+			   struct request_queue *q)
+{
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+
+	if (depth == UINT_MAX)
+		return false;
+
+	depth += max(q->nr_requests / 16, 1UL);
+	if (depth >= q->nr_requests)
+		depth = UINT_MAX;
+	WRITE_ONCE(iolat->max_depth, depth);
+	wake_up_all(&iolat->wait);
+	return depth != UINT_MAX;
+}
+
+static void blkiolatency_timer_fn(struct timer_list *t)
+{
+	struct blk_iolatency *blkiolat = from_timer(blkiolat, t, timer);
+	struct request_queue *q = blkiolat->q;
+	/* the tightest target missed in the window */
+	u64 missed = U64_MAX;
+	bool rearm = false;
+	struct blkcg_gq *blkg;
+
+	spin_lock_irq(q->queue_lock);
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolatency_grp *iolat = blkg_to_lat(blkg);
+		struct blk_rq_stat stat;
+		int cpu;
+
+		if (!iolat || !iolat->min_lat_nsec)
+			continue;
+
+		blk_rq_stat_init(&stat);
+		for_each_possible_cpu(cpu) {
+			struct blk_rq_stat *s = per_cpu_ptr(iolat->stats, cpu);
+
+			blk_rq_stat_sum(&stat, s);
+			blk_rq_stat_init(s);
+		}
+
+		if (stat.nr_samples >= IOLAT_MIN_SAMPLES &&
+		    stat.mean > iolat->min_lat_nsec)
+			missed = min(missed, iolat->min_lat_nsec);
+	}
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolatency_grp *iolat = blkg_to_lat(blkg);
+
+		if (!iolat || blkg == q->root_blkg)
+			continue;
+
+		if (missed == U64_MAX) {
+			rearm |= iolat_scale_up(iolat, q);
+			continue;
+		}
+
+		/* groups with the same or a tighter target are protected */
+		if (iolat->min_lat_nsec && iolat->min_lat_nsec <= missed)
+			continue;
+		iolat_scale_down(iolat, q);
+		rearm = true;
+	}
+
+	spin_unlock_irq(q->queue_lock);
+
+	/* keep going until the throttled groups have their depth back */
+	if (rearm)
+		iolat_arm_timer(blkiolat);
+}
+
+static struct blkg_policy_data *iolatency_pd_alloc(gfp_t gfp, int node)
+{
+	struct iolatency_grp *iolat;
+	int cpu;
+
+	iolat = kzalloc_node(sizeof(*iolat), gfp, node);
+	if (!iolat)
+		return NULL;
+
+	iolat->stats = __alloc_percpu_gfp(sizeof(struct blk_rq_stat),
+				__alignof__(struct blk_rq_stat), gfp);
+	if (!iolat->stats) {
+		kfree(iolat);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu)
+		blk_rq_stat_init(per_cpu_ptr(iolat->stats, cpu));
+
+	return &iolat->pd;
+}
+
+static void iolatency_pd_init(struct blkg_policy_data *pd)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+
+	atomic_set(&iolat->inflight, 0);
+	iolat->max_depth = UINT_MAX;
+	init_waitqueue_head(&iolat->wait);
+}
+
+static void iolatency_pd_offline(struct blkg_policy_data *pd)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+
+	/* don't leave anybody waiting on a group that goes away */
+	WRITE_ONCE(iolat->max_depth, UINT_MAX);
+	wake_up_all(&iolat->wait);
+}
+
+static void iolatency_pd_free(struct blkg_policy_data *pd)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+
+	free_percpu(iolat->stats);
+	kfree(iolat);
+}
+
+static u64 iolatency_prfill_limit(struct seq_file *sf,
+				  struct blkg_policy_data *pd, int off)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+	const char *dname = blkg_dev_name(pd->blkg);
+
+	if (!dname || !iolat->min_lat_nsec)
+		return 0;
+
+	seq_printf(sf, "%s target=%llu\n", dname,
+		   div_u64(iolat->min_lat_nsec, NSEC_PER_USEC));
+	return 0;
+}
+
+static int iolatency_print_limit(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)),
+			  iolatency_prfill_limit, &blkcg_policy_iolatency,
+			  seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t iolatency_set_limit(struct kernfs_open_file *of, char *buf,
+				   size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct iolatency_grp *iolat;
+	u64 lat_val;
+	char *p, *tok;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
+	if (ret)
+		return ret;
+
+	iolat = blkg_to_lat(ctx.blkg);
+	lat_val = iolat->min_lat_nsec;
+	p = strim(ctx.body);
+
+	ret = -EINVAL;
+	while ((tok = strsep(&p, " "))) {
+		char key[16];
+		char val[21];	/* 18446744073709551616 */
+
+		if (!*tok)
+			continue;
+
+		if (sscanf(tok, "%15[^=]=%20s", key, val) != 2)
+			goto out_finish;
+		if (strcmp(key, "target"))
+			goto out_finish;
+
+		if (!strcmp(val, "max"))
+			lat_val = 0;
+		else if (!kstrtou64(val, 10, &lat_val))
+			lat_val *= NSEC_PER_USEC;
+		else
+			goto out_finish;
+	}
+
+	WRITE_ONCE(iolat->min_lat_nsec, lat_val);
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static struct cftype iolatency_files[] = {
+	{
+		.name = "latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolatency_print_limit,
+		.write = iolatency_set_limit,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolatency = {
+	.dfl_cftypes		= iolatency_files,
+	.pd_alloc_fn		= iolatency_pd_alloc,
+	.pd_init_fn		= iolatency_pd_init,
+	.pd_offline_fn		= iolatency_pd_offline,
+	.pd_free_fn		= iolatency_pd_free,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct blk_iolatency *blkiolat;
+	int ret;
+
+	blkiolat = kzalloc_node(sizeof(*blkiolat), GFP_KERNEL, q->node);
+	if (!blkiolat)
+		return -ENOMEM;
+
+	blkiolat->q = q;
+	timer_setup(&blkiolat->timer, blkiolatency_timer_fn, 0);
+	q->blkiolat = blkiolat;
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolatency);
+	if (ret) {
+		q->blkiolat = NULL;
+		kfree(blkiolat);
+	}
+	return ret;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	struct blk_iolatency *blkiolat = q->blkiolat;
+
+	del_timer_sync(&blkiolat->timer);
+	blkcg_deactivate_policy(q, &blkcg_policy_iolatency);
+	q->blkiolat = NULL;
+	kfree(blkiolat);
+}
+
+static int __init iolatency_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolatency);
+}
+
+static void __exit iolatency_exit(void)
+{
+	blkcg_policy_unregister(&blkcg_policy_iolatency);
+}
+
+module_init(iolatency_init);
+module_exit(iolatency_exit);
@@ -827,6 +827,10 @@ bool blk_rq_merge_ok(struct request *rq, struct bio *bio)
 	if (rq->write_hint != bio->bi_write_hint)
 		return false;
 
+	/* polled requests may go where only their submitter reaps them */
+	if ((rq->cmd_flags ^ bio->bi_opf) & REQ_HIPRI)
+		return false;
+
 	return true;
 }
 
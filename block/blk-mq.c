@@ -335,6 +335,66 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	return rq;
 }
 
+/*
+ * A plugged submitter takes its driver tags from the bitmap a batch at a
+ * time, which costs one atomic for the lot, and keeps the spare ones in
+ * the plug until it is flushed.  The spares hold a queue reference so the
+ * queue can't be frozen under them.  This is skipped whenever the tag
+ * allocation is anything but a plain driver tag from an unshared set, and
+ * for small tag sets where holding a batch back would starve others.
+ */
+#define BLK_MQ_PLUG_TAG_BATCH	8
+
+static unsigned int blk_mq_get_plug_tag(struct blk_mq_alloc_data *data)
+{
+	struct blk_plug *plug = current->plug;
+	struct blk_mq_hw_ctx *hctx = data->hctx;
+	struct blk_mq_tags *tags = hctx->tags;
+	struct sbitmap_queue *bt = &tags->bitmap_tags;
+	unsigned int batch, tag;
+
+	if (!plug || data->shallow_depth ||
+	    (data->flags & (BLK_MQ_REQ_INTERNAL | BLK_MQ_REQ_RESERVED)) ||
+	    (hctx->flags & BLK_MQ_F_TAG_SHARED))
+		return BLK_MQ_TAG_FAIL;
+
+	if (!plug->tag_hctx) {
+		batch = min_t(unsigned int, BLK_MQ_PLUG_TAG_BATCH,
+			      tags->nr_tags / 16);
+		if (batch < 2)
+			return BLK_MQ_TAG_FAIL;
+		plug->cached_tags = __sbitmap_queue_get_batch(bt, batch,
+							&plug->tag_offset);
+		if (!plug->cached_tags)
+			return BLK_MQ_TAG_FAIL;
+		plug->tag_hctx = hctx;
+		blk_queue_enter_live(data->q);
+	} else if (plug->tag_hctx != hctx) {
+		return BLK_MQ_TAG_FAIL;
+	}
+
+	tag = __ffs(plug->cached_tags);
+	plug->cached_tags &= ~(1UL << tag);
+	if (!plug->cached_tags) {
+		plug->tag_hctx = NULL;
+		blk_queue_exit(data->q);
+	}
+	return plug->tag_offset + tag + tags->nr_reserved_tags;
+}
+
+/* Give back the tags a plug allocated but didn't use */
+void blk_mq_put_plug_tags(struct blk_plug *plug)
+{
+	struct blk_mq_hw_ctx *hctx = plug->tag_hctx;
+	struct sbitmap_queue *bt = &hctx->tags->bitmap_tags;
+	unsigned int cpu = raw_smp_processor_id();
+
+	sbitmap_queue_clear_batch(bt, plug->tag_offset, plug->cached_tags, cpu);
+	plug->cached_tags = 0;
+	plug->tag_hctx = NULL;
+	blk_queue_exit(hctx->queue);
+}
+
 static struct request *blk_mq_get_request(struct request_queue *q,
 		struct bio *bio, unsigned int op,
 		struct blk_mq_alloc_data *data)
@@ -368,7 +428,9 @@ static struct request *blk_mq_get_request(struct request_queue *q,
 			e->type->ops.mq.limit_depth(op, data);
 	}
 
-	tag = blk_mq_get_tag(data);
+	tag = blk_mq_get_plug_tag(data);
+	if (tag == BLK_MQ_TAG_FAIL)
+		tag = blk_mq_get_tag(data);
 	if (tag == BLK_MQ_TAG_FAIL) {
 		if (put_ctx_on_error) {
 			blk_mq_put_ctx(data->ctx);
@@ -465,12 +527,13 @@ struct request *blk_mq_alloc_request_hctx(struct request_queue *q,
 }
 EXPORT_SYMBOL_GPL(blk_mq_alloc_request_hctx);
 
-void blk_mq_free_request(struct request *rq)
+/* All of freeing a request but the restart and the queue reference */
+static void __blk_mq_free_request(struct request *rq,
+				  struct blk_mq_hw_ctx *hctx)
 {
 	struct request_queue *q = rq->q;
 	struct elevator_queue *e = q->elevator;
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
-	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, ctx->cpu);
 	const int sched_tag = rq->internal_tag;
 
 	if (rq->rq_flags & RQF_ELVPRIV) {
@@ -499,6 +562,14 @@ void blk_mq_free_request(struct request *rq)
 		blk_mq_put_tag(hctx, hctx->tags, ctx, rq->tag);
 	if (sched_tag != -1)
 		blk_mq_put_tag(hctx, hctx->sched_tags, ctx, sched_tag);
+}
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, rq->mq_ctx->cpu);
+
+	__blk_mq_free_request(rq, hctx);
 	blk_mq_sched_restart(hctx);
 	blk_queue_exit(q);
 }
@@ -534,6 +605,56 @@ void blk_mq_end_request(struct request *rq, blk_status_t error)
 }
 EXPORT_SYMBOL(blk_mq_end_request);
 
+static void blk_mq_end_batch_hctx(struct blk_mq_hw_ctx *hctx,
+				  unsigned int nr)
+{
+	blk_mq_sched_restart(hctx);
+	percpu_ref_put_many(&hctx->queue->q_usage_counter, nr);
+}
+
+/**
+ * blk_mq_end_request_batch - successfully end the requests of a batch
+ * @list:	requests put there by blk_mq_add_to_batch()
+ *
+ * Description:
+ *	Ends all I/O on each request of @list, as blk_mq_end_request()
+ *	would with no error.  The completion time is read once for the
+ *	whole batch, and the scheduler restart and the queue references
+ *	are done once for each run of requests of the same hardware queue.
+ **/
+void blk_mq_end_request_batch(struct list_head *list)
+{
+	struct blk_mq_hw_ctx *hctx, *last_hctx = NULL;
+	struct request *rq, *next;
+	unsigned int nr = 0;
+	u64 now = ktime_get_ns();
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		list_del_init(&rq->queuelist);
+		if (blk_update_request(rq, BLK_STS_OK, blk_rq_bytes(rq)))
+			BUG();
+
+		if (rq->rq_flags & RQF_STATS) {
+			blk_mq_poll_stats_start(rq->q);
+			blk_stat_add(rq, now);
+		}
+		blk_account_io_done(rq, now);
+
+		hctx = blk_mq_map_queue(rq->q, rq->mq_ctx->cpu);
+		if (hctx != last_hctx) {
+			if (last_hctx)
+				blk_mq_end_batch_hctx(last_hctx, nr);
+			last_hctx = hctx;
+			nr = 0;
+		}
+		__blk_mq_free_request(rq, hctx);
+		nr++;
+	}
+	if (last_hctx)
+		blk_mq_end_batch_hctx(last_hctx, nr);
+}
+EXPORT_SYMBOL(blk_mq_end_request_batch);
+
 static void __blk_mq_complete_request_remote(void *data)
 {
 	struct request *rq = data;
@@ -541,10 +662,22 @@ static void __blk_mq_complete_request_remote(void *data)
 	rq->q->softirq_done_fn(rq);
 }
 
+/* Whether @rq can be completed on @cpu rather than on its submitter's */
+static bool blk_mq_complete_local(struct request *rq, int cpu)
+{
+	struct request_queue *q = rq->q;
+	int rq_cpu = rq->mq_ctx->cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags))
+		return true;
+	if (cpu == rq_cpu || !cpu_online(rq_cpu))
+		return true;
+	return !test_bit(QUEUE_FLAG_SAME_FORCE, &q->queue_flags) &&
+		cpus_share_cache(cpu, rq_cpu);
+}
+
 static void __blk_mq_complete_request(struct request *rq)
 {
-	struct blk_mq_ctx *ctx = rq->mq_ctx;
-	bool shared = false;
 	int cpu;
 
 	WARN_ON_ONCE(blk_mq_rq_state(rq) != MQ_RQ_IN_FLIGHT);
@@ -553,20 +686,12 @@ static void __blk_mq_complete_request(struct request *rq)
 	if (rq->internal_tag != -1)
 		blk_mq_sched_completed_request(rq);
 
-	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags)) {
-		rq->q->softirq_done_fn(rq);
-		return;
-	}
-
 	cpu = get_cpu();
-	if (!test_bit(QUEUE_FLAG_SAME_FORCE, &rq->q->queue_flags))
-		shared = cpus_share_cache(cpu, ctx->cpu);
-
-	if (cpu != ctx->cpu && !shared && cpu_online(ctx->cpu)) {
+	if (!blk_mq_complete_local(rq, cpu)) {
 		rq->csd.func = __blk_mq_complete_request_remote;
 		rq->csd.info = rq;
 		rq->csd.flags = 0;
-		smp_call_function_single_async(ctx->cpu, &rq->csd);
+		smp_call_function_single_async(rq->mq_ctx->cpu, &rq->csd);
 	} else {
 		rq->q->softirq_done_fn(rq);
 	}
@@ -658,6 +783,44 @@ void blk_mq_complete_request(struct request *rq)
 }
 EXPORT_SYMBOL(blk_mq_complete_request);
 
+/**
+ * blk_mq_add_to_batch - end I/O on a request as part of a batch
+ * @rq:		the request being processed
+ * @list:	the batch
+ *
+ * Description:
+ *	Does what blk_mq_complete_request() does, except that instead of
+ *	being handed to ->complete() @rq is put on @list.  Once it is done
+ *	with its completion queue, the driver finishes each request of
+ *	@list the way its ->complete() would and then ends them all with
+ *	blk_mq_end_request_batch(), which is only fit for requests that
+ *	succeeded.  Returns false, leaving @rq alone, for a request that
+ *	has to go through blk_mq_complete_request() instead.
+ **/
+bool blk_mq_add_to_batch(struct request *rq, struct list_head *list)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, rq->mq_ctx->cpu);
+	int srcu_idx;
+
+	if (rq->end_io || rq->internal_tag != -1 || blk_bidi_rq(rq) ||
+	    test_bit(QUEUE_FLAG_FAIL_IO, &q->queue_flags))
+		return false;
+	if (!blk_mq_complete_local(rq, raw_smp_processor_id()))
+		return false;
+
+	/* Same as blk_mq_complete_request() against the timeout code */
+	hctx_lock(hctx, &srcu_idx);
+	if (blk_mq_rq_aborted_gstate(rq) != rq->gstate) {
+		WARN_ON_ONCE(blk_mq_rq_state(rq) != MQ_RQ_IN_FLIGHT);
+		blk_mq_rq_update_state(rq, MQ_RQ_COMPLETE);
+		list_add_tail(&rq->queuelist, list);
+	}
+	hctx_unlock(hctx, srcu_idx);
+	return true;
+}
+EXPORT_SYMBOL(blk_mq_add_to_batch);
+
 int blk_mq_request_started(struct request *rq)
 {
 	return blk_mq_rq_state(rq) != MQ_RQ_IDLE;
@@ -1868,6 +2031,9 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	if (blk_mq_sched_bio_merge(q, bio))
 		return BLK_QC_T_NONE;
 
+	blk_iolatency_throttle(q, bio);
+	blk_iocost_throttle(q, bio);
+
 	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
 
 	trace_block_getrq(q, bio, bio->bi_opf);
@@ -2633,6 +2799,8 @@ struct request_queue *blk_mq_init_allocated_queue(struct blk_mq_tag_set *set,
 	if (!q->poll_cb)
 		goto err_exit;
 
+	blk_stat_enable_hist(q);
+
 	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
 	if (!q->queue_ctx)
 		goto err_exit;
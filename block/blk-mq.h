@@ -54,6 +54,7 @@ bool blk_mq_get_driver_tag(struct request *rq, struct blk_mq_hw_ctx **hctx,
 				bool wait);
 struct request *blk_mq_dequeue_from_ctx(struct blk_mq_hw_ctx *hctx,
 					struct blk_mq_ctx *start);
+void blk_mq_put_plug_tags(struct blk_plug *plug);
 
 /*
  * Internal helpers for allocating/freeing the request map
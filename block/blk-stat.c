@@ -11,13 +11,36 @@
 #include "blk-mq.h"
 #include "blk.h"
 
+/*
+ * Latency histograms, by queue time (from allocation of the request) and
+ * device time (from dispatch to the driver), for each type of operation.
+ * Bucket 0 is for latencies under 1us, each following bucket is for
+ * latencies up to twice as long as the previous one, and the last one is
+ * for everything over that.
+ */
+enum {
+	BLK_STAT_HIST_READ,
+	BLK_STAT_HIST_WRITE,
+	BLK_STAT_HIST_DISCARD,
+	BLK_STAT_HIST_FLUSH,
+	BLK_STAT_HIST_NR_OPS,
+};
+
+#define BLK_STAT_HIST_BUCKETS	24
+
+struct blk_stat_hist {
+	unsigned long buckets[BLK_STAT_HIST_NR_TIMES][BLK_STAT_HIST_NR_OPS]
+			     [BLK_STAT_HIST_BUCKETS];
+};
+
 struct blk_queue_stats {
 	struct list_head callbacks;
 	spinlock_t lock;
 	bool enable_accounting;
+	struct blk_stat_hist __percpu *hist;
 };
 
-static void blk_stat_init(struct blk_rq_stat *stat)
+void blk_rq_stat_init(struct blk_rq_stat *stat)
 {
 	stat->min = -1ULL;
 	stat->max = stat->nr_samples = stat->mean = 0;
@@ -25,7 +48,7 @@ static void blk_stat_init(struct blk_rq_stat *stat)
 }
 
 /* src is a per-cpu stat, mean isn't initialized */
-static void blk_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
+void blk_rq_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
 {
 	if (!src->nr_samples)
 		return;
@@ -39,7 +62,7 @@ static void blk_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
 	dst->nr_samples += src->nr_samples;
 }
 
-static void __blk_stat_add(struct blk_rq_stat *stat, u64 value)
+void blk_rq_stat_add(struct blk_rq_stat *stat, u64 value)
 {
 	stat->min = min(stat->min, value);
 	stat->max = max(stat->max, value);
@@ -47,6 +70,51 @@ static void __blk_stat_add(struct blk_rq_stat *stat, u64 value)
 	stat->nr_samples++;
 }
 
+static unsigned int blk_stat_hist_bucket(u64 nsecs)
+{
+	if (nsecs < 1024)
+		return 0;
+	return min_t(unsigned int, ilog2(nsecs) - 9,
+		     BLK_STAT_HIST_BUCKETS - 1);
+}
+
+static void blk_stat_add_hist(struct request *rq, u64 now, u64 value)
+{
+	struct blk_stat_hist __percpu *hist = rq->q->stats->hist;
+	u64 queue_time;
+	int op;
+
+	if (!hist)
+		return;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		op = BLK_STAT_HIST_READ;
+		break;
+	case REQ_OP_WRITE:
+		op = BLK_STAT_HIST_WRITE;
+		break;
+	case REQ_OP_DISCARD:
+	case REQ_OP_SECURE_ERASE:
+		op = BLK_STAT_HIST_DISCARD;
+		break;
+	case REQ_OP_FLUSH:
+		op = BLK_STAT_HIST_FLUSH;
+		break;
+	default:
+		return;
+	}
+
+	queue_time = value;
+	if (rq->start_time_ns && now >= rq->start_time_ns)
+		queue_time = now - rq->start_time_ns;
+
+	this_cpu_inc(hist->buckets[BLK_STAT_HIST_QUEUE][op]
+				  [blk_stat_hist_bucket(queue_time)]);
+	this_cpu_inc(hist->buckets[BLK_STAT_HIST_DEVICE][op]
+				  [blk_stat_hist_bucket(value)]);
+}
+
 void blk_stat_add(struct request *rq, u64 now)
 {
 	struct request_queue *q = rq->q;
@@ -58,6 +126,7 @@ void blk_stat_add(struct request *rq, u64 now)
 	value = (now >= rq->io_start_time_ns) ? now - rq->io_start_time_ns : 0;
 
 	blk_throtl_stat_add(rq, value);
+	blk_stat_add_hist(rq, now, value);
 
 	rcu_read_lock();
 	list_for_each_entry_rcu(cb, &q->stats->callbacks, list) {
@@ -69,7 +138,7 @@ void blk_stat_add(struct request *rq, u64 now)
 			continue;
 
 		stat = &get_cpu_ptr(cb->cpu_stat)[bucket];
-		__blk_stat_add(stat, value);
+		blk_rq_stat_add(stat, value);
 		put_cpu_ptr(cb->cpu_stat);
 	}
 	rcu_read_unlock();
@@ -82,15 +151,15 @@ static void blk_stat_timer_fn(struct timer_list *t)
 	int cpu;
 
 	for (bucket = 0; bucket < cb->buckets; bucket++)
-		blk_stat_init(&cb->stat[bucket]);
+		blk_rq_stat_init(&cb->stat[bucket]);
 
 	for_each_online_cpu(cpu) {
 		struct blk_rq_stat *cpu_stat;
 
 		cpu_stat = per_cpu_ptr(cb->cpu_stat, cpu);
 		for (bucket = 0; bucket < cb->buckets; bucket++) {
-			blk_stat_sum(&cb->stat[bucket], &cpu_stat[bucket]);
-			blk_stat_init(&cpu_stat[bucket]);
+			blk_rq_stat_sum(&cb->stat[bucket], &cpu_stat[bucket]);
+			blk_rq_stat_init(&cpu_stat[bucket]);
 		}
 	}
 
@@ -143,7 +212,7 @@ void blk_stat_add_callback(struct request_queue *q,
 
 		cpu_stat = per_cpu_ptr(cb->cpu_stat, cpu);
 		for (bucket = 0; bucket < cb->buckets; bucket++)
-			blk_stat_init(&cpu_stat[bucket]);
+			blk_rq_stat_init(&cpu_stat[bucket]);
 	}
 
 	spin_lock(&q->stats->lock);
@@ -191,6 +260,52 @@ void blk_stat_enable_accounting(struct request_queue *q)
 	spin_unlock(&q->stats->lock);
 }
 
+/*
+ * Set up the latency histograms of a request based queue.  They need the
+ * dispatch time of every request, so this turns on accounting for good.
+ * The histograms are only informational, the queue works without them.
+ */
+void blk_stat_enable_hist(struct request_queue *q)
+{
+	q->stats->hist = alloc_percpu(struct blk_stat_hist);
+	if (q->stats->hist)
+		blk_stat_enable_accounting(q);
+}
+
+ssize_t blk_stat_hist_show(struct request_queue *q, char *page, int time)
+{
+	static const char *const op_names[BLK_STAT_HIST_NR_OPS] = {
+		[BLK_STAT_HIST_READ]	= "read",
+		[BLK_STAT_HIST_WRITE]	= "write",
+		[BLK_STAT_HIST_DISCARD]	= "discard",
+		[BLK_STAT_HIST_FLUSH]	= "flush",
+	};
+	struct blk_stat_hist __percpu *hist = q->stats->hist;
+	ssize_t ret = 0;
+	int op, b, cpu;
+
+	if (!hist)
+		return 0;
+
+	for (op = 0; op < BLK_STAT_HIST_NR_OPS; op++) {
+		unsigned long sum[BLK_STAT_HIST_BUCKETS] = { };
+
+		for_each_possible_cpu(cpu) {
+			unsigned long *buckets;
+
+			buckets = per_cpu_ptr(hist, cpu)->buckets[time][op];
+			for (b = 0; b < BLK_STAT_HIST_BUCKETS; b++)
+				sum[b] += buckets[b];
+		}
+
+		ret += sprintf(page + ret, "%s", op_names[op]);
+		for (b = 0; b < BLK_STAT_HIST_BUCKETS; b++)
+			ret += sprintf(page + ret, " %lu", sum[b]);
+		ret += sprintf(page + ret, "\n");
+	}
+	return ret;
+}
+
 struct blk_queue_stats *blk_alloc_queue_stats(void)
 {
 	struct blk_queue_stats *stats;
@@ -202,6 +317,7 @@ struct blk_queue_stats *blk_alloc_queue_stats(void)
 	INIT_LIST_HEAD(&stats->callbacks);
 	spin_lock_init(&stats->lock);
 	stats->enable_accounting = false;
+	stats->hist = NULL;
 
 	return stats;
 }
@@ -213,5 +329,6 @@ void blk_free_queue_stats(struct blk_queue_stats *stats)
 
 	WARN_ON(!list_empty(&stats->callbacks));
 
+	free_percpu(stats->hist);
 	kfree(stats);
 }
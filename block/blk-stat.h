@@ -65,6 +65,16 @@ struct blk_stat_callback {
 struct blk_queue_stats *blk_alloc_queue_stats(void);
 void blk_free_queue_stats(struct blk_queue_stats *);
 
+/* which time blk_stat_hist_show() shows the histograms of */
+enum {
+	BLK_STAT_HIST_QUEUE,
+	BLK_STAT_HIST_DEVICE,
+	BLK_STAT_HIST_NR_TIMES,
+};
+
+void blk_stat_enable_hist(struct request_queue *q);
+ssize_t blk_stat_hist_show(struct request_queue *q, char *page, int time);
+
 void blk_stat_add(struct request *rq, u64 now);
 
 /* record time/size info in request but not add a callback */
@@ -159,4 +169,8 @@ static inline void blk_stat_activate_msecs(struct blk_stat_callback *cb,
 	mod_timer(&cb->timer, jiffies + msecs_to_jiffies(msecs));
 }
 
+void blk_rq_stat_init(struct blk_rq_stat *);
+void blk_rq_stat_sum(struct blk_rq_stat *, struct blk_rq_stat *);
+void blk_rq_stat_add(struct blk_rq_stat *, u64);
+
 #endif
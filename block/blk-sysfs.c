@@ -420,6 +420,16 @@ static ssize_t queue_poll_store(struct request_queue *q, const char *page,
 	return ret;
 }
 
+static ssize_t queue_lat_hist_queue_show(struct request_queue *q, char *page)
+{
+	return blk_stat_hist_show(q, page, BLK_STAT_HIST_QUEUE);
+}
+
+static ssize_t queue_lat_hist_device_show(struct request_queue *q, char *page)
+{
+	return blk_stat_hist_show(q, page, BLK_STAT_HIST_DEVICE);
+}
+
 static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
 {
 	if (!q->rq_wb)
@@ -680,6 +690,16 @@ static struct queue_sysfs_entry queue_wb_lat_entry = {
 	.store = queue_wb_lat_store,
 };
 
+static struct queue_sysfs_entry queue_lat_hist_queue_entry = {
+	.attr = {.name = "latency_hist_queue", .mode = S_IRUGO },
+	.show = queue_lat_hist_queue_show,
+};
+
+static struct queue_sysfs_entry queue_lat_hist_device_entry = {
+	.attr = {.name = "latency_hist_device", .mode = S_IRUGO },
+	.show = queue_lat_hist_device_show,
+};
+
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 static struct queue_sysfs_entry throtl_sample_time_entry = {
 	.attr = {.name = "throttle_sample_time", .mode = S_IRUGO | S_IWUSR },
@@ -722,6 +742,8 @@ static struct attribute *default_attrs[] = {
 	&queue_dax_entry.attr,
 	&queue_wb_lat_entry.attr,
 	&queue_poll_delay_entry.attr,
+	&queue_lat_hist_queue_entry.attr,
+	&queue_lat_hist_device_entry.attr,
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 	&throtl_sample_time_entry.attr,
 #endif
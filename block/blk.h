@@ -394,6 +394,36 @@ static inline void blk_throtl_bio_endio(struct bio *bio) { }
 static inline void blk_throtl_stat_add(struct request *rq, u64 time) { }
 #endif
 
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+extern void blk_iolatency_throttle(struct request_queue *q, struct bio *bio);
+extern void __blk_iolatency_done_bio(struct bio *bio);
+
+static inline void blk_iolatency_done_bio(struct bio *bio)
+{
+	if (bio_flagged(bio, BIO_TRACKED))
+		__blk_iolatency_done_bio(bio);
+}
+#else
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+static inline void blk_iolatency_throttle(struct request_queue *q,
+					  struct bio *bio) { }
+static inline void blk_iolatency_done_bio(struct bio *bio) { }
+#endif
+
+#ifdef CONFIG_BLK_CGROUP_IOCOST
+extern int blk_iocost_init(struct request_queue *q);
+extern void blk_iocost_exit(struct request_queue *q);
+extern void blk_iocost_throttle(struct request_queue *q, struct bio *bio);
+#else
+static inline int blk_iocost_init(struct request_queue *q) { return 0; }
+static inline void blk_iocost_exit(struct request_queue *q) { }
+static inline void blk_iocost_throttle(struct request_queue *q,
+				       struct bio *bio) { }
+#endif
+
 #ifdef CONFIG_BOUNCE
 extern int init_emergency_isa_pool(void);
 extern void blk_queue_bounce(struct request_queue *q, struct bio **bio);
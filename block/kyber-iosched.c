@@ -72,10 +72,31 @@ static const unsigned int kyber_batch_size[] = {
 	[KYBER_OTHER] = 8,
 };
 
+/*
+ * Completion latencies are recorded in histograms of buckets of a quarter
+ * of the target latency of the domain, up to twice the target. The last
+ * bucket is for everything over that.
+ */
+#define KYBER_LATENCY_SHIFT 2
+#define KYBER_LATENCY_BUCKETS ((2 << KYBER_LATENCY_SHIFT) + 1)
+
+struct kyber_cpu_latency {
+	atomic_t buckets[KYBER_NUM_DOMAINS][KYBER_LATENCY_BUCKETS];
+};
+
 struct kyber_queue_data {
 	struct request_queue *q;
 
-	struct blk_stat_callback *cb;
+	/*
+	 * Each CPU records the latencies of the requests it completes, so the
+	 * histograms of a hardware queue are those of the CPUs mapped to it.
+	 * The timer folds them into the histograms of the whole device.
+	 */
+	struct kyber_cpu_latency __percpu *cpu_latency;
+	struct timer_list timer;
+	unsigned int latency_buckets[KYBER_NUM_DOMAINS][KYBER_LATENCY_BUCKETS];
+	/* what was made of the last window, for debugfs */
+	int domain_status[KYBER_NUM_DOMAINS];
 
 	/*
 	 * The device is divided into multiple scheduling domains based on the
@@ -130,20 +151,56 @@ enum {
 #define IS_GOOD(status) ((status) > 0)
 #define IS_BAD(status) ((status) < 0)
 
-static int kyber_lat_status(struct blk_stat_callback *cb,
-			    unsigned int sched_domain, u64 target)
+static atomic_t *kyber_cpu_buckets(struct kyber_queue_data *kqd, int cpu,
+				   unsigned int sched_domain)
+{
+	return per_cpu_ptr(kqd->cpu_latency, cpu)->buckets[sched_domain];
+}
+
+static u64 kyber_domain_target(struct kyber_queue_data *kqd,
+			       unsigned int sched_domain)
+{
+	/* Other requests are measured against the write target. */
+	if (sched_domain == KYBER_READ)
+		return kqd->read_lat_nsec;
+	return kqd->write_lat_nsec;
+}
+
+static unsigned int kyber_domain_samples(struct kyber_queue_data *kqd,
+					 unsigned int sched_domain)
+{
+	unsigned int bucket, samples = 0;
+
+	for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS; bucket++)
+		samples += kqd->latency_buckets[sched_domain][bucket];
+	return samples;
+}
+
+/*
+ * Grade a domain by the bucket its 90th percentile latency falls in.
+ */
+static int kyber_lat_status(struct kyber_queue_data *kqd,
+			    unsigned int sched_domain)
 {
-	u64 latency;
+	unsigned int *buckets = kqd->latency_buckets[sched_domain];
+	unsigned int bucket, samples;
 
-	if (!cb->stat[sched_domain].nr_samples)
+	samples = kyber_domain_samples(kqd, sched_domain);
+	if (!samples)
 		return NONE;
 
-	latency = cb->stat[sched_domain].mean;
-	if (latency >= 2 * target)
+	samples = DIV_ROUND_UP(samples * 90, 100);
+	for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS - 1; bucket++) {
+		if (buckets[bucket] >= samples)
+			break;
+		samples -= buckets[bucket];
+	}
+
+	if (bucket >= 2 << KYBER_LATENCY_SHIFT)
 		return AWFUL;
-	else if (latency > target)
+	else if (bucket >= 1 << KYBER_LATENCY_SHIFT)
 		return BAD;
-	else if (latency <= target / 2)
+	else if (bucket < 1 << (KYBER_LATENCY_SHIFT - 1))
 		return GREAT;
 	else /* (latency <= target) */
 		return GOOD;
@@ -252,27 +309,37 @@ static void kyber_adjust_other_depth(struct kyber_queue_data *kqd,
  * Apply heuristics for limiting queue depths based on gathered latency
  * statistics.
  */
-static void kyber_stat_timer_fn(struct blk_stat_callback *cb)
+static void kyber_timer_fn(struct timer_list *t)
 {
-	struct kyber_queue_data *kqd = cb->data;
+	struct kyber_queue_data *kqd = from_timer(kqd, t, timer);
+	unsigned int sched_domain, b;
 	int read_status, write_status;
+	int cpu;
+
+	memset(kqd->latency_buckets, 0, sizeof(kqd->latency_buckets));
+	for_each_possible_cpu(cpu) {
+		for (sched_domain = 0; sched_domain < KYBER_NUM_DOMAINS;
+		     sched_domain++) {
+			atomic_t *buckets;
+
+			buckets = kyber_cpu_buckets(kqd, cpu, sched_domain);
+			for (b = 0; b < KYBER_LATENCY_BUCKETS; b++)
+				kqd->latency_buckets[sched_domain][b] +=
+					atomic_xchg(&buckets[b], 0);
+		}
+	}
 
-	read_status = kyber_lat_status(cb, KYBER_READ, kqd->read_lat_nsec);
-	write_status = kyber_lat_status(cb, KYBER_SYNC_WRITE, kqd->write_lat_nsec);
+	read_status = kyber_lat_status(kqd, KYBER_READ);
+	write_status = kyber_lat_status(kqd, KYBER_SYNC_WRITE);
 
 	kyber_adjust_rw_depth(kqd, KYBER_READ, read_status, write_status);
 	kyber_adjust_rw_depth(kqd, KYBER_SYNC_WRITE, write_status, read_status);
 	kyber_adjust_other_depth(kqd, read_status, write_status,
-				 cb->stat[KYBER_OTHER].nr_samples != 0);
+				 kyber_domain_samples(kqd, KYBER_OTHER) != 0);
 
-	/*
-	 * Continue monitoring latencies if we aren't hitting the targets or
-	 * we're still throttling other requests.
-	 */
-	if (!blk_stat_is_active(kqd->cb) &&
-	    ((IS_BAD(read_status) || IS_BAD(write_status) ||
-	      kqd->domain_tokens[KYBER_OTHER].sb.depth < kyber_depth[KYBER_OTHER])))
-		blk_stat_activate_msecs(kqd->cb, 100);
+	kqd->domain_status[KYBER_READ] = read_status;
+	kqd->domain_status[KYBER_SYNC_WRITE] = write_status;
+	kqd->domain_status[KYBER_OTHER] = NONE;
 }
 
 static unsigned int kyber_sched_tags_shift(struct kyber_queue_data *kqd)
@@ -292,16 +359,18 @@ static struct kyber_queue_data *kyber_queue_data_alloc(struct request_queue *q)
 	int ret = -ENOMEM;
 	int i;
 
-	kqd = kmalloc_node(sizeof(*kqd), GFP_KERNEL, q->node);
+	kqd = kzalloc_node(sizeof(*kqd), GFP_KERNEL, q->node);
 	if (!kqd)
 		goto err;
 	kqd->q = q;
 
-	kqd->cb = blk_stat_alloc_callback(kyber_stat_timer_fn, rq_sched_domain,
-					  KYBER_NUM_DOMAINS, kqd);
-	if (!kqd->cb)
+	kqd->cpu_latency = alloc_percpu_gfp(struct kyber_cpu_latency,
+					    GFP_KERNEL | __GFP_ZERO);
+	if (!kqd->cpu_latency)
 		goto err_kqd;
 
+	timer_setup(&kqd->timer, kyber_timer_fn, 0);
+
 	/*
 	 * The maximum number of tokens for any scheduling domain is at least
 	 * the queue depth of a single hardware queue. If the hardware doesn't
@@ -318,7 +387,7 @@ static struct kyber_queue_data *kyber_queue_data_alloc(struct request_queue *q)
 		if (ret) {
 			while (--i >= 0)
 				sbitmap_queue_free(&kqd->domain_tokens[i]);
-			goto err_cb;
+			goto err_buckets;
 		}
 		sbitmap_queue_resize(&kqd->domain_tokens[i], kyber_depth[i]);
 	}
@@ -331,8 +400,8 @@ static struct kyber_queue_data *kyber_queue_data_alloc(struct request_queue *q)
 
 	return kqd;
 
-err_cb:
-	blk_stat_free_callback(kqd->cb);
+err_buckets:
+	free_percpu(kqd->cpu_latency);
 err_kqd:
 	kfree(kqd);
 err:
@@ -354,25 +423,24 @@ static int kyber_init_sched(struct request_queue *q, struct elevator_type *e)
 		return PTR_ERR(kqd);
 	}
 
+	blk_stat_enable_accounting(q);
+
 	eq->elevator_data = kqd;
 	q->elevator = eq;
 
-	blk_stat_add_callback(q, kqd->cb);
-
 	return 0;
 }
 
 static void kyber_exit_sched(struct elevator_queue *e)
 {
 	struct kyber_queue_data *kqd = e->elevator_data;
-	struct request_queue *q = kqd->q;
 	int i;
 
-	blk_stat_remove_callback(q, kqd->cb);
+	del_timer_sync(&kqd->timer);
 
 	for (i = 0; i < KYBER_NUM_DOMAINS; i++)
 		sbitmap_queue_free(&kqd->domain_tokens[i]);
-	blk_stat_free_callback(kqd->cb);
+	free_percpu(kqd->cpu_latency);
 	kfree(kqd);
 }
 
@@ -465,37 +533,28 @@ static void kyber_completed_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
 	struct kyber_queue_data *kqd = q->elevator->elevator_data;
-	unsigned int sched_domain;
-	u64 now, latency, target;
-
-	/*
-	 * Check if this request met our latency goal. If not, quickly gather
-	 * some statistics and start throttling.
-	 */
-	sched_domain = rq_sched_domain(rq);
-	switch (sched_domain) {
-	case KYBER_READ:
-		target = kqd->read_lat_nsec;
-		break;
-	case KYBER_SYNC_WRITE:
-		target = kqd->write_lat_nsec;
-		break;
-	default:
-		return;
-	}
-
-	/* If we are already monitoring latencies, don't check again. */
-	if (blk_stat_is_active(kqd->cb))
-		return;
+	struct kyber_cpu_latency *cpu_latency;
+	unsigned int sched_domain, bucket;
+	u64 now, latency, divisor;
 
 	now = ktime_get_ns();
-	if (now < rq->io_start_time_ns)
+	if (!rq->io_start_time_ns || now < rq->io_start_time_ns)
 		return;
 
+	sched_domain = rq_sched_domain(rq);
 	latency = now - rq->io_start_time_ns;
-
-	if (latency > target)
-		blk_stat_activate_msecs(kqd->cb, 10);
+	divisor = max_t(u64, kyber_domain_target(kqd, sched_domain) >>
+			KYBER_LATENCY_SHIFT, 1);
+	bucket = min_t(u64, div64_u64(latency ? latency - 1 : 0, divisor),
+		       KYBER_LATENCY_BUCKETS - 1);
+
+	cpu_latency = get_cpu_ptr(kqd->cpu_latency);
+	atomic_inc(&cpu_latency->buckets[sched_domain][bucket]);
+	put_cpu_ptr(kqd->cpu_latency);
+
+	/* Look at the latencies every 100ms as long as there is I/O. */
+	if (!timer_pending(&kqd->timer))
+		mod_timer(&kqd->timer, jiffies + HZ / 10);
 }
 
 static void kyber_flush_busy_ctxs(struct kyber_hctx_data *khd,
@@ -771,25 +830,88 @@ static int kyber_async_depth_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static const char *const kyber_domain_names[] = {
+	[KYBER_READ] = "READ",
+	[KYBER_SYNC_WRITE] = "SYNC_WRITE",
+	[KYBER_OTHER] = "OTHER",
+};
+
+static const char *kyber_status_name(int status)
+{
+	switch (status) {
+	case GREAT:
+		return "GREAT";
+	case GOOD:
+		return "GOOD";
+	case BAD:
+		return "BAD";
+	case AWFUL:
+		return "AWFUL";
+	default:
+		return "NONE";
+	}
+}
+
+/*
+ * The histograms of the last window, with the verdict on the domain and
+ * the depth it left the domain at.
+ */
+static int kyber_latency_show(void *data, struct seq_file *m)
+{
+	struct request_queue *q = data;
+	struct kyber_queue_data *kqd = q->elevator->elevator_data;
+	unsigned int sched_domain, bucket;
+
+	for (sched_domain = 0; sched_domain < KYBER_NUM_DOMAINS;
+	     sched_domain++) {
+		seq_printf(m, "%s status=%s depth=%u buckets",
+			   kyber_domain_names[sched_domain],
+			   kyber_status_name(kqd->domain_status[sched_domain]),
+			   kqd->domain_tokens[sched_domain].sb.depth);
+		for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS; bucket++)
+			seq_printf(m, " %u",
+				   kqd->latency_buckets[sched_domain][bucket]);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+/* The histograms of the CPUs of the hardware queue in the current window */
+static int kyber_hctx_latency_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	struct kyber_queue_data *kqd = hctx->queue->elevator->elevator_data;
+	unsigned int domain, b, i;
+	struct blk_mq_ctx *ctx;
+
+	for (domain = 0; domain < KYBER_NUM_DOMAINS; domain++) {
+		unsigned int samples[KYBER_LATENCY_BUCKETS] = {};
+
+		hctx_for_each_ctx(hctx, ctx, i) {
+			atomic_t *buckets = kyber_cpu_buckets(kqd, ctx->cpu,
+							      domain);
+
+			for (b = 0; b < KYBER_LATENCY_BUCKETS; b++)
+				samples[b] += atomic_read(&buckets[b]);
+		}
+
+		seq_puts(m, kyber_domain_names[domain]);
+		for (b = 0; b < KYBER_LATENCY_BUCKETS; b++)
+			seq_printf(m, " %u", samples[b]);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
 static int kyber_cur_domain_show(void *data, struct seq_file *m)
 {
 	struct blk_mq_hw_ctx *hctx = data;
 	struct kyber_hctx_data *khd = hctx->sched_data;
 
-	switch (khd->cur_domain) {
-	case KYBER_READ:
-		seq_puts(m, "READ\n");
-		break;
-	case KYBER_SYNC_WRITE:
-		seq_puts(m, "SYNC_WRITE\n");
-		break;
-	case KYBER_OTHER:
-		seq_puts(m, "OTHER\n");
-		break;
-	default:
+	if (khd->cur_domain < KYBER_NUM_DOMAINS)
+		seq_printf(m, "%s\n", kyber_domain_names[khd->cur_domain]);
+	else
 		seq_printf(m, "%u\n", khd->cur_domain);
-		break;
-	}
 	return 0;
 }
 
@@ -809,6 +931,7 @@ static const struct blk_mq_debugfs_attr kyber_queue_debugfs_attrs[] = {
 	KYBER_QUEUE_DOMAIN_ATTRS(sync_write),
 	KYBER_QUEUE_DOMAIN_ATTRS(other),
 	{"async_depth", 0400, kyber_async_depth_show},
+	{"latency", 0400, kyber_latency_show},
 	{},
 };
 #undef KYBER_QUEUE_DOMAIN_ATTRS
@@ -822,6 +945,7 @@ static const struct blk_mq_debugfs_attr kyber_hctx_debugfs_attrs[] = {
 	KYBER_HCTX_DOMAIN_ATTRS(other),
 	{"cur_domain", 0400, kyber_cur_domain_show},
 	{"batching", 0400, kyber_batching_show},
+	{"latency", 0400, kyber_hctx_latency_show},
 	{},
 };
 #undef KYBER_HCTX_DOMAIN_ATTRS
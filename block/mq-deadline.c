@@ -61,6 +61,15 @@ struct deadline_data {
 	spinlock_t lock;
 	spinlock_t zone_lock;
 	struct list_head dispatch;
+
+	/*
+	 * Inserted requests are batched up on these lists, under their own
+	 * lock, and only moved to the lists above by the dispatcher. This
+	 * keeps insertions from contending on dd->lock with dispatching.
+	 */
+	spinlock_t insert_lock;
+	struct list_head at_head;
+	struct list_head at_tail;
 };
 
 static inline struct rb_root *
@@ -263,6 +272,43 @@ deadline_next_request(struct deadline_data *dd, int data_dir)
 	return rq;
 }
 
+static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
+			      bool at_head);
+
+/*
+ * Move the requests batched up by dd_insert_requests() to the sort, fifo
+ * and dispatch lists.
+ */
+static void dd_do_insert(struct blk_mq_hw_ctx *hctx, struct deadline_data *dd)
+{
+	LIST_HEAD(at_head);
+	LIST_HEAD(at_tail);
+	struct request *rq;
+
+	lockdep_assert_held(&dd->lock);
+
+	if (list_empty_careful(&dd->at_head) &&
+	    list_empty_careful(&dd->at_tail))
+		return;
+
+	spin_lock(&dd->insert_lock);
+	list_splice_init(&dd->at_head, &at_head);
+	list_splice_init(&dd->at_tail, &at_tail);
+	spin_unlock(&dd->insert_lock);
+
+	while (!list_empty(&at_head)) {
+		rq = list_first_entry(&at_head, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		dd_insert_request(hctx, rq, true);
+	}
+
+	while (!list_empty(&at_tail)) {
+		rq = list_first_entry(&at_tail, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		dd_insert_request(hctx, rq, false);
+	}
+}
+
 /*
  * deadline_dispatch_requests selects the best request according to
  * read/write expire, fifo_batch, etc
@@ -383,6 +429,7 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	struct request *rq;
 
 	spin_lock(&dd->lock);
+	dd_do_insert(hctx, dd);
 	rq = __dd_dispatch_request(dd);
 	spin_unlock(&dd->lock);
 
@@ -395,6 +442,8 @@ static void dd_exit_queue(struct elevator_queue *e)
 
 	BUG_ON(!list_empty(&dd->fifo_list[READ]));
 	BUG_ON(!list_empty(&dd->fifo_list[WRITE]));
+	BUG_ON(!list_empty(&dd->at_head));
+	BUG_ON(!list_empty(&dd->at_tail));
 
 	kfree(dd);
 }
@@ -430,6 +479,9 @@ static int dd_init_queue(struct request_queue *q, struct elevator_type *e)
 	spin_lock_init(&dd->lock);
 	spin_lock_init(&dd->zone_lock);
 	INIT_LIST_HEAD(&dd->dispatch);
+	spin_lock_init(&dd->insert_lock);
+	INIT_LIST_HEAD(&dd->at_head);
+	INIT_LIST_HEAD(&dd->at_tail);
 
 	q->elevator = eq;
 	return 0;
@@ -466,6 +518,7 @@ static bool dd_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
 	bool ret;
 
 	spin_lock(&dd->lock);
+	dd_do_insert(hctx, dd);
 	ret = blk_mq_sched_try_merge(q, bio, &free);
 	spin_unlock(&dd->lock);
 
@@ -518,21 +571,22 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 	}
 }
 
+/*
+ * Only queue the requests up, the dispatcher or the next bio merge moves
+ * them to the scheduler's lists under dd->lock.
+ */
 static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 			       struct list_head *list, bool at_head)
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
 
-	spin_lock(&dd->lock);
-	while (!list_empty(list)) {
-		struct request *rq;
-
-		rq = list_first_entry(list, struct request, queuelist);
-		list_del_init(&rq->queuelist);
-		dd_insert_request(hctx, rq, at_head);
-	}
-	spin_unlock(&dd->lock);
+	spin_lock(&dd->insert_lock);
+	if (at_head)
+		list_splice_tail_init(list, &dd->at_head);
+	else
+		list_splice_tail_init(list, &dd->at_tail);
+	spin_unlock(&dd->insert_lock);
 }
 
 /*
@@ -569,6 +623,8 @@ static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
 
 	return !list_empty_careful(&dd->dispatch) ||
+		!list_empty_careful(&dd->at_head) ||
+		!list_empty_careful(&dd->at_tail) ||
 		!list_empty_careful(&dd->fifo_list[0]) ||
 		!list_empty_careful(&dd->fifo_list[1]);
 }
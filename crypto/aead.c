@@ -87,6 +87,72 @@ int crypto_aead_setauthsize(struct crypto_aead *tfm, unsigned int authsize)
 }
 EXPORT_SYMBOL_GPL(crypto_aead_setauthsize);
 
+static bool crypto_aead_batchable(struct crypto_aead *aead,
+				  struct aead_request *req, bool enc)
+{
+	if (crypto_aead_reqtfm(req) != aead)
+		return false;
+
+	return enc || req->cryptlen >= crypto_aead_authsize(aead);
+}
+
+/*
+ * Hand runs of requests on the same transformation to the algorithm's
+ * batch operation, at most max_batch at a time.  Runs of one request,
+ * algorithms without batch support and requests that fail the checks of
+ * the single request path take that path.
+ */
+static void crypto_aead_batch(struct aead_request **reqs, int *errs,
+			      unsigned int nr, bool enc)
+{
+	unsigned int i, n;
+
+	for (i = 0; i < nr; i += n) {
+		struct crypto_aead *aead = crypto_aead_reqtfm(reqs[i]);
+		struct aead_alg *alg = crypto_aead_alg(aead);
+
+		n = 1;
+		if (crypto_aead_batchable(aead, reqs[i], enc)) {
+			while (i + n < nr && n < alg->max_batch &&
+			       crypto_aead_batchable(aead, reqs[i + n], enc))
+				n++;
+		}
+
+		if (n == 1) {
+			errs[i] = enc ? crypto_aead_encrypt(reqs[i]) :
+					crypto_aead_decrypt(reqs[i]);
+			continue;
+		}
+
+		if (crypto_aead_get_flags(aead) & CRYPTO_TFM_NEED_KEY) {
+			unsigned int j;
+
+			for (j = 0; j < n; j++)
+				errs[i + j] = -ENOKEY;
+			continue;
+		}
+
+		if (enc)
+			alg->encrypt_batch(reqs + i, errs + i, n);
+		else
+			alg->decrypt_batch(reqs + i, errs + i, n);
+	}
+}
+
+void crypto_aead_encrypt_batch(struct aead_request **reqs, int *errs,
+			       unsigned int nr)
+{
+	crypto_aead_batch(reqs, errs, nr, true);
+}
+EXPORT_SYMBOL_GPL(crypto_aead_encrypt_batch);
+
+void crypto_aead_decrypt_batch(struct aead_request **reqs, int *errs,
+			       unsigned int nr)
+{
+	crypto_aead_batch(reqs, errs, nr, false);
+}
+EXPORT_SYMBOL_GPL(crypto_aead_decrypt_batch);
+
 static void crypto_aead_exit_tfm(struct crypto_tfm *tfm)
 {
 	struct crypto_aead *aead = __crypto_aead_cast(tfm);
@@ -153,6 +219,7 @@ static void crypto_aead_show(struct seq_file *m, struct crypto_alg *alg)
 	seq_printf(m, "blocksize    : %u\n", alg->cra_blocksize);
 	seq_printf(m, "ivsize       : %u\n", aead->ivsize);
 	seq_printf(m, "maxauthsize  : %u\n", aead->maxauthsize);
+	seq_printf(m, "max_batch    : %u\n", aead->max_batch ?: 1);
 	seq_printf(m, "geniv        : <none>\n");
 }
 
@@ -363,6 +430,12 @@ static int aead_prepare_alg(struct aead_alg *alg)
 	if (!alg->chunksize)
 		alg->chunksize = base->cra_blocksize;
 
+	if (!alg->encrypt_batch != !alg->decrypt_batch ||
+	    (alg->encrypt_batch && alg->max_batch < 2))
+		return -EINVAL;
+	if (!alg->encrypt_batch)
+		alg->max_batch = 1;
+
 	base->cra_type = &crypto_aead_type;
 	base->cra_flags &= ~CRYPTO_ALG_TYPE_MASK;
 	base->cra_flags |= CRYPTO_ALG_TYPE_AEAD;
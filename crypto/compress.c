@@ -33,12 +33,24 @@ static int crypto_decompress(struct crypto_tfm *tfm,
 	                                                   dlen);
 }
 
+static int crypto_setdict(struct crypto_tfm *tfm, const u8 *dict,
+			  unsigned int len)
+{
+	struct compress_alg *calg = &tfm->__crt_alg->cra_compress;
+
+	if (!calg->coa_setdict)
+		return -ENOSYS;
+
+	return calg->coa_setdict(tfm, dict, len);
+}
+
 int crypto_init_compress_ops(struct crypto_tfm *tfm)
 {
 	struct compress_tfm *ops = &tfm->crt_compress;
 
 	ops->cot_compress = crypto_compress;
 	ops->cot_decompress = crypto_decompress;
+	ops->cot_setdict = crypto_setdict;
 
 	return 0;
 }
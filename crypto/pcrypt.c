@@ -28,6 +28,7 @@
 #include <linux/notifier.h>
 #include <linux/kobject.h>
 #include <linux/cpu.h>
+#include <linux/topology.h>
 #include <crypto/pcrypt.h>
 
 struct padata_pcrypt {
@@ -86,6 +87,14 @@ static int pcrypt_do_parallel(struct padata_priv *padata, unsigned int *cb_cpu,
 	if (!cpumask_weight(cpumask->mask))
 			goto out;
 
+	/* Stay on the node of the tfm's callback cpu if possible */
+	i = cpumask_any_and(cpumask_of_node(cpu_to_node(cpu)), cpumask->mask);
+	if (i < nr_cpu_ids) {
+		cpu = i;
+		*cb_cpu = cpu;
+		goto out;
+	}
+
 	cpu_index = cpu % cpumask_weight(cpumask->mask);
 
 	cpu = cpumask_first(cpumask->mask);
@@ -219,20 +228,41 @@ static int pcrypt_aead_decrypt(struct aead_request *req)
 	return err;
 }
 
+/*
+ * Spread the callback cpus of the tfms over the online cpus of the node
+ * the tfm is allocated on, so that the completions of a tfm stay on the
+ * node of its user.
+ */
+static unsigned int pcrypt_tfm_cb_cpu(struct pcrypt_instance_ctx *ictx)
+{
+	const struct cpumask *mask = cpumask_of_node(numa_node_id());
+	unsigned int cpu, nr = 0, cpu_index;
+
+	if (!cpumask_intersects(mask, cpu_online_mask))
+		mask = cpu_online_mask;
+
+	for_each_cpu_and(cpu, mask, cpu_online_mask)
+		nr++;
+	if (!nr)
+		return cpumask_first(cpu_online_mask);
+
+	cpu_index = (unsigned int)atomic_inc_return(&ictx->tfm_count) % nr;
+	for_each_cpu_and(cpu, mask, cpu_online_mask) {
+		if (!cpu_index--)
+			return cpu;
+	}
+
+	return cpumask_first(cpu_online_mask);
+}
+
 static int pcrypt_aead_init_tfm(struct crypto_aead *tfm)
 {
-	int cpu, cpu_index;
 	struct aead_instance *inst = aead_alg_instance(tfm);
 	struct pcrypt_instance_ctx *ictx = aead_instance_ctx(inst);
 	struct pcrypt_aead_ctx *ctx = crypto_aead_ctx(tfm);
 	struct crypto_aead *cipher;
 
-	cpu_index = (unsigned int)atomic_inc_return(&ictx->tfm_count) %
-		    cpumask_weight(cpu_online_mask);
-
-	ctx->cb_cpu = cpumask_first(cpu_online_mask);
-	for (cpu = 0; cpu < cpu_index; cpu++)
-		ctx->cb_cpu = cpumask_next(ctx->cb_cpu, cpu_online_mask);
+	ctx->cb_cpu = pcrypt_tfm_cb_cpu(ictx);
 
 	cipher = crypto_spawn_aead(&ictx->spawn);
 
@@ -18,6 +18,9 @@
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/net.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/zstd.h>
 #include <crypto/internal/scompress.h>
@@ -25,11 +28,56 @@
 
 #define ZSTD_DEF_LEVEL	3
 
+/*
+ * The compression and decompression contexts are large (over a megabyte
+ * for compression), so they are kept in pools shared by all zstd
+ * transforms rather than owned by one.  Each transform adds one context of
+ * each kind to the pools when it is set up and takes one back when it is
+ * torn down, so a caller working on a transform always finds a context
+ * free and never has to allocate one in the (possibly atomic) compression
+ * path.  Each CPU caches the context it used last, which keeps a CPU on
+ * the same, cache hot, context and off the pool lock.
+ */
+struct zstd_wksp {
+	struct list_head	list;
+	void			*mem;
+	union {
+		ZSTD_CCtx	*cctx;
+		ZSTD_DCtx	*dctx;
+	};
+};
+
+struct zstd_pool {
+	spinlock_t			lock;
+	struct list_head		idle;
+	struct zstd_wksp * __percpu	*cached;
+};
+
+static DEFINE_PER_CPU(struct zstd_wksp *, zstd_cached_cctx);
+static DEFINE_PER_CPU(struct zstd_wksp *, zstd_cached_dctx);
+
+static struct zstd_pool zstd_cpool = {
+	.lock	= __SPIN_LOCK_UNLOCKED(zstd_cpool.lock),
+	.idle	= LIST_HEAD_INIT(zstd_cpool.idle),
+	.cached	= &zstd_cached_cctx,
+};
+
+static struct zstd_pool zstd_dpool = {
+	.lock	= __SPIN_LOCK_UNLOCKED(zstd_dpool.lock),
+	.idle	= LIST_HEAD_INIT(zstd_dpool.idle),
+	.cached	= &zstd_cached_dctx,
+};
+
+/*
+ * A trained dictionary, digested once when it is set on a transform and
+ * used for every block compressed or decompressed through it.
+ */
 struct zstd_ctx {
-	ZSTD_CCtx *cctx;
-	ZSTD_DCtx *dctx;
-	void *cwksp;
-	void *dwksp;
+	void *dict;
+	ZSTD_CDict *cdict;
+	ZSTD_DDict *ddict;
+	void *cdict_wksp;
+	void *ddict_wksp;
 };
 
 static ZSTD_parameters zstd_params(void)
@@ -37,65 +85,123 @@ static ZSTD_parameters zstd_params(void)
 	return ZSTD_getParams(ZSTD_DEF_LEVEL, 0, 0);
 }
 
-static int zstd_comp_init(struct zstd_ctx *ctx)
+static struct zstd_wksp *zstd_get_wksp(struct zstd_pool *pool)
 {
-	int ret = 0;
-	const ZSTD_parameters params = zstd_params();
-	const size_t wksp_size = ZSTD_CCtxWorkspaceBound(params.cParams);
-
-	ctx->cwksp = vzalloc(wksp_size);
-	if (!ctx->cwksp) {
-		ret = -ENOMEM;
-		goto out;
+	struct zstd_wksp *ws;
+	unsigned long flags;
+	int cpu;
+
+	ws = this_cpu_xchg(*pool->cached, NULL);
+	if (ws)
+		return ws;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	ws = list_first_entry_or_null(&pool->idle, struct zstd_wksp, list);
+	if (ws)
+		list_del(&ws->list);
+	spin_unlock_irqrestore(&pool->lock, flags);
+	if (ws)
+		return ws;
+
+	/* All idle contexts are cached by other CPUs, take one of those */
+	for_each_possible_cpu(cpu) {
+		ws = xchg(per_cpu_ptr(pool->cached, cpu), NULL);
+		if (ws)
+			break;
 	}
 
-	ctx->cctx = ZSTD_initCCtx(ctx->cwksp, wksp_size);
-	if (!ctx->cctx) {
-		ret = -EINVAL;
-		goto out_free;
-	}
-out:
-	return ret;
-out_free:
-	vfree(ctx->cwksp);
-	goto out;
+	return ws;
 }
 
-static int zstd_decomp_init(struct zstd_ctx *ctx)
+static void zstd_put_wksp(struct zstd_pool *pool, struct zstd_wksp *ws)
+{
+	unsigned long flags;
+
+	if (!this_cpu_cmpxchg(*pool->cached, NULL, ws))
+		return;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	list_add(&ws->list, &pool->idle);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+static int zstd_pool_grow(struct zstd_pool *pool, size_t wksp_size,
+			  bool compress)
 {
-	int ret = 0;
-	const size_t wksp_size = ZSTD_DCtxWorkspaceBound();
+	struct zstd_wksp *ws;
 
-	ctx->dwksp = vzalloc(wksp_size);
-	if (!ctx->dwksp) {
-		ret = -ENOMEM;
-		goto out;
+	ws = kzalloc(sizeof(*ws), GFP_KERNEL);
+	if (!ws)
+		return -ENOMEM;
+
+	ws->mem = vzalloc(wksp_size);
+	if (!ws->mem) {
+		kfree(ws);
+		return -ENOMEM;
 	}
 
-	ctx->dctx = ZSTD_initDCtx(ctx->dwksp, wksp_size);
-	if (!ctx->dctx) {
-		ret = -EINVAL;
-		goto out_free;
+	if (compress)
+		ws->cctx = ZSTD_initCCtx(ws->mem, wksp_size);
+	else
+		ws->dctx = ZSTD_initDCtx(ws->mem, wksp_size);
+	if (compress ? !ws->cctx : !ws->dctx) {
+		vfree(ws->mem);
+		kfree(ws);
+		return -EINVAL;
 	}
-out:
-	return ret;
-out_free:
-	vfree(ctx->dwksp);
-	goto out;
+
+	zstd_put_wksp(pool, ws);
+	return 0;
+}
+
+static void zstd_pool_shrink(struct zstd_pool *pool)
+{
+	struct zstd_wksp *ws;
+
+	/*
+	 * The transform going away doesn't hold a context, so one is idle.
+	 * It may be in flight between two other users for a moment though.
+	 */
+	while (!(ws = zstd_get_wksp(pool)))
+		cpu_relax();
+
+	vfree(ws->mem);
+	kfree(ws);
+}
+
+static int zstd_comp_init(struct zstd_ctx *ctx)
+{
+	const ZSTD_parameters params = zstd_params();
+
+	return zstd_pool_grow(&zstd_cpool,
+			      ZSTD_CCtxWorkspaceBound(params.cParams), true);
+}
+
+static int zstd_decomp_init(struct zstd_ctx *ctx)
+{
+	return zstd_pool_grow(&zstd_dpool, ZSTD_DCtxWorkspaceBound(), false);
+}
+
+static void zstd_dict_free(struct zstd_ctx *ctx)
+{
+	vfree(ctx->cdict_wksp);
+	vfree(ctx->ddict_wksp);
+	vfree(ctx->dict);
+	ctx->cdict_wksp = NULL;
+	ctx->ddict_wksp = NULL;
+	ctx->dict = NULL;
+	ctx->cdict = NULL;
+	ctx->ddict = NULL;
 }
 
 static void zstd_comp_exit(struct zstd_ctx *ctx)
 {
-	vfree(ctx->cwksp);
-	ctx->cwksp = NULL;
-	ctx->cctx = NULL;
+	zstd_pool_shrink(&zstd_cpool);
 }
 
 static void zstd_decomp_exit(struct zstd_ctx *ctx)
 {
-	vfree(ctx->dwksp);
-	ctx->dwksp = NULL;
-	ctx->dctx = NULL;
+	zstd_pool_shrink(&zstd_dpool);
 }
 
 static int __zstd_init(void *ctx)
@@ -140,6 +246,7 @@ static void __zstd_exit(void *ctx)
 {
 	zstd_comp_exit(ctx);
 	zstd_decomp_exit(ctx);
+	zstd_dict_free(ctx);
 }
 
 static void zstd_free_ctx(struct crypto_scomp *tfm, void *ctx)
@@ -155,14 +262,65 @@ static void zstd_exit(struct crypto_tfm *tfm)
 	__zstd_exit(ctx);
 }
 
+/*
+ * Small blocks such as zram's 4K pages carry too little history to
+ * compress well on their own.  A dictionary trained on similar data
+ * (zstd --train) supplies it.  Whatever was compressed with a dictionary
+ * must be decompressed with the same one.
+ */
+static int zstd_setdict(struct crypto_tfm *tfm, const u8 *dict,
+			unsigned int len)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	const ZSTD_parameters params = ZSTD_getParams(ZSTD_DEF_LEVEL, 0, len);
+	size_t cwksp_size = ZSTD_CDictWorkspaceBound(params.cParams);
+	size_t dwksp_size = ZSTD_DDictWorkspaceBound();
+
+	zstd_dict_free(ctx);
+	if (!len)
+		return 0;
+
+	ctx->dict = vmalloc(len);
+	ctx->cdict_wksp = vzalloc(cwksp_size);
+	ctx->ddict_wksp = vzalloc(dwksp_size);
+	if (!ctx->dict || !ctx->cdict_wksp || !ctx->ddict_wksp) {
+		zstd_dict_free(ctx);
+		return -ENOMEM;
+	}
+	memcpy(ctx->dict, dict, len);
+
+	ctx->cdict = ZSTD_initCDict(ctx->dict, len, params, ctx->cdict_wksp,
+				    cwksp_size);
+	ctx->ddict = ZSTD_initDDict(ctx->dict, len, ctx->ddict_wksp,
+				    dwksp_size);
+	if (!ctx->cdict || !ctx->ddict) {
+		zstd_dict_free(ctx);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int __zstd_compress(const u8 *src, unsigned int slen,
 			   u8 *dst, unsigned int *dlen, void *ctx)
 {
 	size_t out_len;
 	struct zstd_ctx *zctx = ctx;
+	struct zstd_wksp *ws;
 	const ZSTD_parameters params = zstd_params();
 
-	out_len = ZSTD_compressCCtx(zctx->cctx, dst, *dlen, src, slen, params);
+	ws = zstd_get_wksp(&zstd_cpool);
+	if (WARN_ON_ONCE(!ws))
+		return -ENOMEM;
+
+	if (zctx->cdict)
+		out_len = ZSTD_compress_usingCDict(ws->cctx, dst, *dlen,
+						   src, slen, zctx->cdict);
+	else
+		out_len = ZSTD_compressCCtx(ws->cctx, dst, *dlen, src, slen,
+					    params);
+	zstd_put_wksp(&zstd_cpool, ws);
+
 	if (ZSTD_isError(out_len))
 		return -EINVAL;
 	*dlen = out_len;
@@ -189,8 +347,19 @@ static int __zstd_decompress(const u8 *src, unsigned int slen,
 {
 	size_t out_len;
 	struct zstd_ctx *zctx = ctx;
+	struct zstd_wksp *ws;
+
+	ws = zstd_get_wksp(&zstd_dpool);
+	if (WARN_ON_ONCE(!ws))
+		return -ENOMEM;
+
+	if (zctx->ddict)
+		out_len = ZSTD_decompress_usingDDict(ws->dctx, dst, *dlen,
+						     src, slen, zctx->ddict);
+	else
+		out_len = ZSTD_decompressDCtx(ws->dctx, dst, *dlen, src, slen);
+	zstd_put_wksp(&zstd_dpool, ws);
 
-	out_len = ZSTD_decompressDCtx(zctx->dctx, dst, *dlen, src, slen);
 	if (ZSTD_isError(out_len))
 		return -EINVAL;
 	*dlen = out_len;
@@ -221,7 +390,8 @@ static struct crypto_alg alg = {
 	.cra_exit		= zstd_exit,
 	.cra_u			= { .compress = {
 	.coa_compress		= zstd_compress,
-	.coa_decompress		= zstd_decompress } }
+	.coa_decompress		= zstd_decompress,
+	.coa_setdict		= zstd_setdict } }
 };
 
 static struct scomp_alg scomp = {
@@ -28,6 +28,7 @@
 #include <linux/list.h>
 #include <linux/fs.h>
 #include <linux/async.h>
+#include <linux/initrd.h>
 #include <linux/pm.h>
 #include <linux/suspend.h>
 #include <linux/syscore_ops.h>
@@ -306,6 +307,7 @@ fw_get_filesystem_firmware(struct device *device, struct fw_priv *fw_priv)
 	if (!path)
 		return -ENOMEM;
 
+	wait_for_initramfs();
 	for (i = 0; i < ARRAY_SIZE(fw_path); i++) {
 		/* skip the unset customized path */
 		if (!fw_path[i][0])
@@ -19,6 +19,7 @@
 #include <linux/device.h>
 #include <linux/swap.h>
 #include <linux/slab.h>
+#include <linux/migrate.h>
 
 static struct bus_type node_subsys = {
 	.name = "node",
@@ -125,6 +126,8 @@ static ssize_t node_read_meminfo(struct device *dev,
 		       "Node %d AnonHugePages:  %8lu kB\n"
 		       "Node %d ShmemHugePages: %8lu kB\n"
 		       "Node %d ShmemPmdMapped: %8lu kB\n"
+		       "Node %d FileHugePages:  %8lu kB\n"
+		       "Node %d FilePmdMapped:  %8lu kB\n"
 #endif
 			,
 		       nid, K(node_page_state(pgdat, NR_FILE_DIRTY)),
@@ -148,6 +151,10 @@ static ssize_t node_read_meminfo(struct device *dev,
 		       nid, K(node_page_state(pgdat, NR_SHMEM_THPS) *
 				       HPAGE_PMD_NR),
 		       nid, K(node_page_state(pgdat, NR_SHMEM_PMDMAPPED) *
+				       HPAGE_PMD_NR),
+		       nid, K(node_page_state(pgdat, NR_FILE_THPS) *
+				       HPAGE_PMD_NR),
+		       nid, K(node_page_state(pgdat, NR_FILE_PMDMAPPED) *
 				       HPAGE_PMD_NR));
 #else
 		       nid, K(node_page_state(pgdat, NR_SLAB_UNRECLAIMABLE)));
@@ -228,6 +235,32 @@ static ssize_t node_read_distance(struct device *dev,
 }
 static DEVICE_ATTR(distance, S_IRUGO, node_read_distance, NULL);
 
+#ifdef CONFIG_MIGRATION
+/* The slower node that reclaim migrates cold pages to, -1 for none */
+static ssize_t node_read_demotion_target(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", next_demotion_node(dev->id));
+}
+
+static ssize_t node_write_demotion_target(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t count)
+{
+	int target;
+	int err;
+
+	err = kstrtoint(buf, 10, &target);
+	if (err)
+		return err;
+
+	err = set_demotion_target(dev->id, target);
+	return err ? err : count;
+}
+static DEVICE_ATTR(demotion_target, S_IRUGO | S_IWUSR,
+		   node_read_demotion_target, node_write_demotion_target);
+#endif
+
 static struct attribute *node_dev_attrs[] = {
 	&dev_attr_cpumap.attr,
 	&dev_attr_cpulist.attr,
@@ -235,6 +268,9 @@ static struct attribute *node_dev_attrs[] = {
 	&dev_attr_numastat.attr,
 	&dev_attr_distance.attr,
 	&dev_attr_vmstat.attr,
+#ifdef CONFIG_MIGRATION
+	&dev_attr_demotion_target.attr,
+#endif
 	NULL
 };
 ATTRIBUTE_GROUPS(node_dev);
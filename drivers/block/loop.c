@@ -85,6 +85,7 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static int max_workers;
 
 static int transfer_xor(struct loop_device *lo, int cmd,
 			struct page *raw_page, unsigned raw_off,
@@ -559,8 +560,6 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 	cmd->iocb.ki_filp = file;
 	cmd->iocb.ki_complete = lo_rw_aio_complete;
 	cmd->iocb.ki_flags = IOCB_DIRECT;
-	if (cmd->css)
-		kthread_associate_blkcg(cmd->css);
 
 	if (rw == WRITE)
 		ret = call_write_iter(file, &cmd->iocb, &iter);
@@ -568,7 +567,6 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 		ret = call_read_iter(file, &cmd->iocb, &iter);
 
 	lo_rw_aio_do_completion(cmd);
-	kthread_associate_blkcg(NULL);
 
 	if (ret != -EIOCBQUEUED)
 		cmd->iocb.ki_complete(&cmd->iocb, ret, 0);
@@ -854,24 +852,25 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
-}
-
-static int loop_kthread_worker_fn(void *worker_ptr)
-{
-	current->flags |= PF_LESS_THROTTLE;
-	return kthread_worker_fn(worker_ptr);
+	destroy_workqueue(lo->workqueue);
+	lo->workqueue = NULL;
 }
 
+/*
+ * Commands are handled by up to max_workers high priority workers per
+ * device, one per online CPU by default, so that buffered I/O to the
+ * backing file is no longer serialized behind a single thread.
+ */
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	int active = max_workers > 0 ? max_workers : num_online_cpus();
+
+	lo->workqueue = alloc_workqueue("loop%d",
+					WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM,
+					min(active, WQ_UNBOUND_MAX_ACTIVE),
+					lo->lo_number);
+	if (!lo->workqueue)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
 	return 0;
 }
 
@@ -1681,6 +1680,8 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(max_workers, int, S_IRUGO);
+MODULE_PARM_DESC(max_workers, "Maximum number of requests handled in parallel per loop device (default: number of online CPUs)");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1747,13 +1748,13 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 
 	/* always use the first bio's css */
 #ifdef CONFIG_BLK_CGROUP
-	if (cmd->use_aio && rq->bio && rq->bio->bi_css) {
+	if (rq->bio && rq->bio->bi_css) {
 		cmd->css = rq->bio->bi_css;
 		css_get(cmd->css);
 	} else
 #endif
 		cmd->css = NULL;
-	kthread_queue_work(&lo->worker, &cmd->work);
+	queue_work(lo->workqueue, &cmd->work);
 
 	return BLK_STS_OK;
 }
@@ -1779,12 +1780,31 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 	}
 }
 
-static void loop_queue_work(struct kthread_work *work)
+static void loop_queue_work(struct work_struct *work)
 {
 	struct loop_cmd *cmd =
 		container_of(work, struct loop_cmd, work);
+	struct cgroup_subsys_state *css = cmd->css;
+	unsigned int pflags = current->flags;
+	bool use_aio = cmd->use_aio;
+
+	/*
+	 * Charge the I/O to the backing file, buffered or not, to the cgroup
+	 * that issued the request.  The aio completion drops the css ref.
+	 * Nothing in cmd may be touched once the request completes.
+	 */
+	current->flags |= PF_LESS_THROTTLE;
+	if (css)
+		kthread_associate_blkcg(css);
 
 	loop_handle_cmd(cmd);
+
+	if (css) {
+		kthread_associate_blkcg(NULL);
+		if (!use_aio)
+			css_put(css);
+	}
+	current_restore_flags(pflags, PF_LESS_THROTTLE);
 }
 
 static int loop_init_request(struct blk_mq_tag_set *set, struct request *rq,
@@ -1792,7 +1812,7 @@ static int loop_init_request(struct blk_mq_tag_set *set, struct request *rq,
 {
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 
-	kthread_init_work(&cmd->work, loop_queue_work);
+	INIT_WORK(&cmd->work, loop_queue_work);
 	return 0;
 }
 
@@ -2217,13 +2217,23 @@ static int rbd_img_fill_from_bvecs(struct rbd_img_request *img_req,
 
 static void rbd_img_request_submit(struct rbd_img_request *img_request)
 {
+	struct ceph_osd_client *osdc =
+			&img_request->rbd_dev->rbd_client->client->osdc;
 	struct rbd_obj_request *obj_request;
 
 	dout("%s: img %p\n", __func__, img_request);
 
+	/* One hold of the osdc lock for all the object requests */
 	rbd_img_request_get(img_request);
-	for_each_obj_request(img_request, obj_request)
-		rbd_obj_request_submit(obj_request);
+	ceph_osdc_batch_begin(osdc);
+	for_each_obj_request(img_request, obj_request) {
+		dout("%s %p object_no %016llx %llu~%llu osd_req %p\n",
+		     __func__, obj_request, obj_request->ex.oe_objno,
+		     obj_request->ex.oe_off, obj_request->ex.oe_len,
+		     obj_request->osd_req);
+		ceph_osdc_batch_submit(obj_request->osd_req);
+	}
+	ceph_osdc_batch_end(osdc);
 
 	rbd_img_request_put(img_request);
 }
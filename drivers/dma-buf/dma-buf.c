@@ -599,6 +599,10 @@ void dma_buf_detach(struct dma_buf *dmabuf, struct dma_buf_attachment *attach)
 
 	mutex_lock(&dmabuf->lock);
 	list_del(&attach->node);
+	if (attach->sgt) {
+		WARN_ON(attach->map_count);
+		dmabuf->ops->unmap_dma_buf(attach, attach->sgt, attach->dir);
+	}
 	if (dmabuf->ops->detach)
 		dmabuf->ops->detach(dmabuf, attach);
 
@@ -607,6 +611,45 @@ void dma_buf_detach(struct dma_buf *dmabuf, struct dma_buf_attachment *attach)
 }
 EXPORT_SYMBOL_GPL(dma_buf_detach);
 
+static struct sg_table *dma_buf_map_cached(struct dma_buf_attachment *attach,
+					   enum dma_data_direction direction)
+{
+	struct dma_buf *dmabuf = attach->dmabuf;
+	struct sg_table *sg_table;
+
+	mutex_lock(&dmabuf->lock);
+
+	sg_table = attach->sgt;
+	if (sg_table && !attach->sgt_stale && attach->dir == direction) {
+		attach->map_count++;
+		goto out;
+	}
+
+	/* Replace an unused mapping for another direction */
+	if (sg_table && !attach->map_count) {
+		dmabuf->ops->unmap_dma_buf(attach, sg_table, attach->dir);
+		attach->sgt = NULL;
+	}
+
+	sg_table = dmabuf->ops->map_dma_buf(attach, direction);
+	if (!sg_table)
+		sg_table = ERR_PTR(-ENOMEM);
+
+	/*
+	 * While the cached mapping is still in use the new one is not cached,
+	 * dma_buf_unmap_attachment() hands it straight back to the exporter.
+	 */
+	if (!IS_ERR(sg_table) && !attach->sgt) {
+		attach->sgt = sg_table;
+		attach->dir = direction;
+		attach->sgt_stale = false;
+		attach->map_count = 1;
+	}
+out:
+	mutex_unlock(&dmabuf->lock);
+	return sg_table;
+}
+
 /**
  * dma_buf_map_attachment - Returns the scatterlist table of the attachment;
  * mapped into _device_ address space. Is a wrapper for map_dma_buf() of the
@@ -621,6 +664,10 @@ EXPORT_SYMBOL_GPL(dma_buf_detach);
  * the underlying backing storage is pinned for as long as a mapping exists,
  * therefore users/importers should not hold onto a mapping for undue amounts of
  * time.
+ *
+ * If the exporter sets &dma_buf_ops.cache_sgt_mapping the mapping outlives
+ * dma_buf_unmap_attachment() and is returned again by later calls for the
+ * same direction.
  */
 struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
 					enum dma_data_direction direction)
@@ -632,6 +679,9 @@ struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
 	if (WARN_ON(!attach || !attach->dmabuf))
 		return ERR_PTR(-EINVAL);
 
+	if (attach->dmabuf->ops->cache_sgt_mapping)
+		return dma_buf_map_cached(attach, direction);
+
 	sg_table = attach->dmabuf->ops->map_dma_buf(attach, direction);
 	if (!sg_table)
 		sg_table = ERR_PTR(-ENOMEM);
@@ -654,16 +704,64 @@ void dma_buf_unmap_attachment(struct dma_buf_attachment *attach,
 				struct sg_table *sg_table,
 				enum dma_data_direction direction)
 {
+	struct dma_buf *dmabuf;
+
 	might_sleep();
 
 	if (WARN_ON(!attach || !attach->dmabuf || !sg_table))
 		return;
 
-	attach->dmabuf->ops->unmap_dma_buf(attach, sg_table,
-						direction);
+	dmabuf = attach->dmabuf;
+	if (!dmabuf->ops->cache_sgt_mapping) {
+		dmabuf->ops->unmap_dma_buf(attach, sg_table, direction);
+		return;
+	}
+
+	mutex_lock(&dmabuf->lock);
+	if (sg_table != attach->sgt) {
+		dmabuf->ops->unmap_dma_buf(attach, sg_table, direction);
+	} else if (!--attach->map_count && attach->sgt_stale) {
+		dmabuf->ops->unmap_dma_buf(attach, sg_table, attach->dir);
+		attach->sgt = NULL;
+	}
+	mutex_unlock(&dmabuf->lock);
 }
 EXPORT_SYMBOL_GPL(dma_buf_unmap_attachment);
 
+/**
+ * dma_buf_invalidate_mappings - drop the cached mappings of a buffer
+ * @dmabuf:	[in]	buffer whose mappings are no longer valid
+ *
+ * Called by exporters setting &dma_buf_ops.cache_sgt_mapping before they move
+ * or otherwise change the backing storage.  Unused cached mappings are torn
+ * down right away.  Mappings still in use are released on their last
+ * dma_buf_unmap_attachment(), and their importers are told through
+ * &dma_buf_attachment.invalidate.  Later dma_buf_map_attachment() calls ask
+ * the exporter for a new mapping.
+ */
+void dma_buf_invalidate_mappings(struct dma_buf *dmabuf)
+{
+	struct dma_buf_attachment *attach;
+
+	mutex_lock(&dmabuf->lock);
+	list_for_each_entry(attach, &dmabuf->attachments, node) {
+		if (!attach->sgt)
+			continue;
+
+		if (attach->map_count) {
+			attach->sgt_stale = true;
+			if (attach->invalidate)
+				attach->invalidate(attach);
+			continue;
+		}
+
+		dmabuf->ops->unmap_dma_buf(attach, attach->sgt, attach->dir);
+		attach->sgt = NULL;
+	}
+	mutex_unlock(&dmabuf->lock);
+}
+EXPORT_SYMBOL_GPL(dma_buf_invalidate_mappings);
+
 /**
  * DOC: cpu access
  *
@@ -1122,7 +1220,10 @@ static int dma_buf_debug_show(struct seq_file *s, void *unused)
 		attach_count = 0;
 
 		list_for_each_entry(attach_obj, &buf_obj->attachments, node) {
-			seq_printf(s, "\t%s\n", dev_name(attach_obj->dev));
+			seq_printf(s, "\t%s%s%s\n", dev_name(attach_obj->dev),
+				   attach_obj->sgt ? " (mapping cached)" : "",
+				   attach_obj->explicit_sync ?
+				   " (explicit sync)" : "");
 			attach_count++;
 		}
 
@@ -40,9 +40,11 @@ static void drm_sched_wakeup(struct drm_gpu_scheduler *sched);
 static void drm_sched_process_job(struct dma_fence *f, struct dma_fence_cb *cb);
 
 /* Initialize a given run queue struct */
-static void drm_sched_rq_init(struct drm_sched_rq *rq)
+static void drm_sched_rq_init(struct drm_gpu_scheduler *sched,
+			      struct drm_sched_rq *rq)
 {
 	spin_lock_init(&rq->lock);
+	rq->sched = sched;
 	INIT_LIST_HEAD(&rq->entities);
 	rq->current_entity = NULL;
 }
@@ -160,7 +162,8 @@ EXPORT_SYMBOL(drm_sched_entity_init);
 static bool drm_sched_entity_is_initialized(struct drm_gpu_scheduler *sched,
 					    struct drm_sched_entity *entity)
 {
-	return entity->sched == sched &&
+	/* Entities that can move may no longer be on the scheduler given */
+	return (entity->sched == sched || entity->num_rq_list > 1) &&
 		entity->rq != NULL;
 }
 
@@ -224,6 +227,7 @@ void drm_sched_entity_do_release(struct drm_gpu_scheduler *sched,
 {
 	if (!drm_sched_entity_is_initialized(sched, entity))
 		return;
+	sched = entity->sched;
 	/**
 	 * The client will not queue more IBs during this fini, consume existing
 	 * queued IBs or discard them on SIGKILL
@@ -248,6 +252,7 @@ EXPORT_SYMBOL(drm_sched_entity_do_release);
 void drm_sched_entity_cleanup(struct drm_gpu_scheduler *sched,
 			   struct drm_sched_entity *entity)
 {
+	sched = entity->sched;
 	if (entity->fini_status) {
 		struct drm_sched_job *job;
 		int r;
@@ -266,6 +271,7 @@ void drm_sched_entity_cleanup(struct drm_gpu_scheduler *sched,
 
 		while ((job = to_drm_sched_job(spsc_queue_pop(&entity->job_queue)))) {
 			struct drm_sched_fence *s_fence = job->s_fence;
+			atomic_dec(&job->sched->num_jobs);
 			drm_sched_fence_scheduled(s_fence);
 			dma_fence_set_error(&s_fence->finished, -ESRCH);
 			r = dma_fence_add_callback(entity->last_scheduled, &job->finish_cb,
@@ -319,13 +325,90 @@ void drm_sched_entity_set_rq(struct drm_sched_entity *entity,
 		drm_sched_rq_remove_entity(entity->rq, entity);
 
 	entity->rq = rq;
-	if (rq)
+	if (rq) {
+		entity->sched = rq->sched;
 		drm_sched_rq_add_entity(rq, entity);
+	}
 
 	spin_unlock(&entity->rq_lock);
 }
 EXPORT_SYMBOL(drm_sched_entity_set_rq);
 
+/**
+ * Let an entity move between the run queues of identical rings
+ *
+ * @entity	The pointer to a valid scheduler entity
+ * @rq_list	Run queues, of the same priority, the entity may use
+ * @num_rq_list	Number of entries in @rq_list
+ *
+ * At job submission boundaries the entity then moves to the run queue
+ * whose scheduler has the fewest unfinished jobs.  @rq_list must stay
+ * valid for the lifetime of the entity.
+ */
+void drm_sched_entity_set_rq_list(struct drm_sched_entity *entity,
+				  struct drm_sched_rq **rq_list,
+				  unsigned int num_rq_list)
+{
+	spin_lock(&entity->rq_lock);
+	entity->rq_list = rq_list;
+	entity->num_rq_list = num_rq_list;
+	spin_unlock(&entity->rq_lock);
+}
+EXPORT_SYMBOL(drm_sched_entity_set_rq_list);
+
+/**
+ * Move an entity to the least loaded of its run queues
+ *
+ * @entity	The pointer to a valid scheduler entity
+ *
+ * Only done once everything the entity queued so far has finished, so
+ * that its jobs still execute in submission order.
+ */
+static void drm_sched_entity_select_rq(struct drm_sched_entity *entity)
+{
+	struct drm_sched_rq *rq = entity->rq, *best;
+	struct dma_fence *fence;
+	unsigned int i;
+	int jobs, min_jobs;
+
+	if (!rq || spsc_queue_count(&entity->job_queue))
+		return;
+
+	fence = READ_ONCE(entity->last_scheduled);
+	if (fence && !dma_fence_is_signaled(fence))
+		return;
+
+	/* Stay put unless another ring is strictly less busy */
+	best = rq;
+	min_jobs = atomic_read(&rq->sched->num_jobs);
+	for (i = 0; i < entity->num_rq_list; i++) {
+		rq = entity->rq_list[i];
+		jobs = atomic_read(&rq->sched->num_jobs);
+		if (jobs < min_jobs) {
+			min_jobs = jobs;
+			best = rq;
+		}
+	}
+
+	drm_sched_entity_set_rq(entity, best);
+}
+
+/**
+ * Read the latency accounting of an entity
+ *
+ * @entity	The pointer to a valid scheduler entity
+ * @stats	Filled in with the counters
+ */
+void drm_sched_entity_get_stats(struct drm_sched_entity *entity,
+				struct drm_sched_entity_stats *stats)
+{
+	stats->jobs = atomic64_read(&entity->stat_jobs);
+	stats->wait_ns = atomic64_read(&entity->stat_wait_ns);
+	stats->last_submit = READ_ONCE(entity->last_submit);
+	stats->last_run = READ_ONCE(entity->last_run);
+}
+EXPORT_SYMBOL(drm_sched_entity_get_stats);
+
 bool drm_sched_dependency_optimized(struct dma_fence* fence,
 				    struct drm_sched_entity *entity)
 {
@@ -423,6 +506,10 @@ void drm_sched_entity_push_job(struct drm_sched_job *sched_job,
 
 	trace_drm_sched_job(sched_job, entity);
 
+	sched_job->s_fence->submitted = ktime_get();
+	WRITE_ONCE(entity->last_submit, sched_job->s_fence->submitted);
+	atomic_inc(&sched->num_jobs);
+
 	spin_lock(&entity->queue_lock);
 	first = spsc_queue_push(&entity->job_queue, &sched_job->queue_node);
 
@@ -599,6 +686,12 @@ int drm_sched_job_init(struct drm_sched_job *job,
 		       struct drm_sched_entity *entity,
 		       void *owner)
 {
+	/* The entity may move to a less busy ring between jobs */
+	if (entity->num_rq_list > 1) {
+		drm_sched_entity_select_rq(entity);
+		sched = entity->sched;
+	}
+
 	job->sched = sched;
 	job->entity = entity;
 	job->s_priority = entity->rq - sched->sched_rq;
@@ -663,6 +756,7 @@ static void drm_sched_process_job(struct dma_fence *f, struct dma_fence_cb *cb)
 
 	dma_fence_get(&s_fence->finished);
 	atomic_dec(&sched->hw_rq_count);
+	atomic_dec(&sched->num_jobs);
 	drm_sched_fence_finished(s_fence);
 
 	trace_drm_sched_process_job(s_fence);
@@ -714,6 +808,12 @@ static int drm_sched_main(void *param)
 		fence = sched->ops->run_job(sched_job);
 		drm_sched_fence_scheduled(s_fence);
 
+		WRITE_ONCE(entity->last_run, s_fence->scheduled.timestamp);
+		atomic64_inc(&entity->stat_jobs);
+		atomic64_add(ktime_to_ns(ktime_sub(s_fence->scheduled.timestamp,
+						   s_fence->submitted)),
+			     &entity->stat_wait_ns);
+
 		if (fence) {
 			s_fence->parent = dma_fence_get(fence);
 			r = dma_fence_add_callback(fence, &s_fence->cb,
@@ -757,13 +857,14 @@ int drm_sched_init(struct drm_gpu_scheduler *sched,
 	sched->timeout = timeout;
 	sched->hang_limit = hang_limit;
 	for (i = DRM_SCHED_PRIORITY_MIN; i < DRM_SCHED_PRIORITY_MAX; i++)
-		drm_sched_rq_init(&sched->sched_rq[i]);
+		drm_sched_rq_init(sched, &sched->sched_rq[i]);
 
 	init_waitqueue_head(&sched->wake_up_worker);
 	init_waitqueue_head(&sched->job_scheduled);
 	INIT_LIST_HEAD(&sched->ring_mirror_list);
 	spin_lock_init(&sched->job_list_lock);
 	atomic_set(&sched->hw_rq_count, 0);
+	atomic_set(&sched->num_jobs, 0);
 	atomic64_set(&sched->job_id_count, 0);
 
 	/* Each scheduler will run on a seperate kernel thread */
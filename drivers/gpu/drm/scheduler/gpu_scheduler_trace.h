@@ -66,12 +66,23 @@ TRACE_EVENT(drm_sched_process_job,
 	    TP_ARGS(fence),
 	    TP_STRUCT__entry(
 		    __field(struct dma_fence *, fence)
+		    __field(const char *, name)
+		    __field(s64, wait_ns)
+		    __field(s64, run_ns)
 		    ),
 
 	    TP_fast_assign(
 		    __entry->fence = &fence->finished;
+		    __entry->name = fence->sched->name;
+		    __entry->wait_ns = ktime_to_ns(ktime_sub(
+			    fence->scheduled.timestamp, fence->submitted));
+		    __entry->run_ns = ktime_to_ns(ktime_sub(
+			    fence->finished.timestamp,
+			    fence->scheduled.timestamp));
 		    ),
-	    TP_printk("fence=%p signaled", __entry->fence)
+	    TP_printk("fence=%p signaled, ring=%s, queued %lld ns, ran %lld ns",
+		      __entry->fence, __entry->name,
+		      __entry->wait_ns, __entry->run_ns)
 );
 
 #endif
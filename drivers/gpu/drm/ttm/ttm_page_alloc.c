@@ -29,6 +29,7 @@
  * - Pool collects resently freed pages for reuse
  * - Use page->lru to keep a free list
  * - doesn't track currently in use pages
+ * - one set of pools per NUMA node, pages go back to the pool of their node
  */
 
 #define pr_fmt(fmt) "[TTM] " fmt
@@ -71,6 +72,9 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @nhits: Number of allocations served from the pool.
+ * @nmisses: Number of allocations the pool could not serve.
+ * @nid: Node the pool allocates its pages from.
  */
 struct ttm_page_pool {
 	spinlock_t		lock;
@@ -81,7 +85,10 @@ struct ttm_page_pool {
 	char			*name;
 	unsigned long		nfrees;
 	unsigned long		nrefills;
+	unsigned long		nhits;
+	unsigned long		nmisses;
 	unsigned int		order;
+	int			nid;
 };
 
 /**
@@ -109,24 +116,26 @@ struct ttm_pool_opts {
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
  *
- * @pools: All pool objects in use.
+ * @nodes: The pool objects of each node, indexed by node id.
  **/
 struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
 
-	union {
-		struct ttm_page_pool	pools[NUM_POOLS];
-		struct {
-			struct ttm_page_pool	wc_pool;
-			struct ttm_page_pool	uc_pool;
-			struct ttm_page_pool	wc_pool_dma32;
-			struct ttm_page_pool	uc_pool_dma32;
-			struct ttm_page_pool	wc_pool_huge;
-			struct ttm_page_pool	uc_pool_huge;
-		} ;
-	};
+	struct ttm_node_pools {
+		union {
+			struct ttm_page_pool	pools[NUM_POOLS];
+			struct {
+				struct ttm_page_pool	wc_pool;
+				struct ttm_page_pool	uc_pool;
+				struct ttm_page_pool	wc_pool_dma32;
+				struct ttm_page_pool	uc_pool_dma32;
+				struct ttm_page_pool	wc_pool_huge;
+				struct ttm_page_pool	uc_pool_huge;
+			} ;
+		};
+	}			*nodes;
 };
 
 static struct attribute ttm_page_pool_max = {
@@ -153,6 +162,7 @@ static void ttm_pool_kobj_release(struct kobject *kobj)
 {
 	struct ttm_pool_manager *m =
 		container_of(kobj, struct ttm_pool_manager, kobj);
+	kfree(m->nodes);
 	kfree(m);
 }
 
@@ -270,7 +280,7 @@ static int set_pages_array_uc(struct page **pages, int addrinarray)
 
 /**
  * Select the right pool or requested caching state and ttm flags. */
-static struct ttm_page_pool *ttm_get_pool(int flags, bool huge,
+static struct ttm_page_pool *ttm_get_pool(int nid, int flags, bool huge,
 					  enum ttm_caching_state cstate)
 {
 	int pool_index;
@@ -292,7 +302,16 @@ static struct ttm_page_pool *ttm_get_pool(int flags, bool huge,
 		pool_index |= 0x4;
 	}
 
-	return &_manager->pools[pool_index];
+	return &_manager->nodes[nid].pools[pool_index];
+}
+
+/*
+ * The pool limits apply to all nodes together, so split them between
+ * the nodes that can put pages into the pools.
+ */
+static unsigned ttm_pool_max_size(void)
+{
+	return DIV_ROUND_UP(_manager->options.max_size, nr_online_nodes);
 }
 
 /* set memory back to wb and free the pages. */
@@ -447,7 +466,9 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 		if (shrink_pages == 0)
 			break;
 
-		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		/* Pages are only pooled on their own node */
+		pool = &_manager->nodes[sc->nid].pools[(i + pool_offset) %
+						       NUM_POOLS];
 		page_nr = (1 << pool->order);
 		/* OK to use static buffer since global mutex is held. */
 		nr_free_pool = roundup(nr_free, page_nr) >> pool->order;
@@ -470,7 +491,7 @@ ttm_pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 	struct ttm_page_pool *pool;
 
 	for (i = 0; i < NUM_POOLS; ++i) {
-		pool = &_manager->pools[i];
+		pool = &_manager->nodes[sc->nid].pools[i];
 		count += (pool->npages << pool->order);
 	}
 
@@ -482,6 +503,7 @@ static int ttm_pool_mm_shrink_init(struct ttm_pool_manager *manager)
 	manager->mm_shrink.count_objects = ttm_pool_shrink_count;
 	manager->mm_shrink.scan_objects = ttm_pool_shrink_scan;
 	manager->mm_shrink.seeks = 1;
+	manager->mm_shrink.flags = SHRINKER_NUMA_AWARE;
 	return register_shrinker(&manager->mm_shrink);
 }
 
@@ -529,6 +551,28 @@ static void ttm_handle_caching_state_failure(struct list_head *pages,
 	}
 }
 
+/*
+ * Hand out single pages from @batch, refilling it from the bulk page
+ * allocator so that big refills don't go through the page allocator
+ * one page at a time.
+ */
+static struct page *ttm_alloc_batched_page(struct list_head *batch,
+					   gfp_t gfp_flags, int nid,
+					   unsigned count)
+{
+	struct page *p;
+
+	if (list_empty(batch))
+		alloc_pages_bulk_list(gfp_flags, nid,
+				      min_t(unsigned, count, NUM_PAGES_TO_ALLOC),
+				      batch);
+
+	p = list_first_entry_or_null(batch, struct page, lru);
+	if (p)
+		list_del(&p->lru);
+	return p;
+}
+
 /**
  * Allocate new pages with correct caching.
  *
@@ -537,10 +581,11 @@ static void ttm_handle_caching_state_failure(struct list_head *pages,
  */
 static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 			       int ttm_flags, enum ttm_caching_state cstate,
-			       unsigned count, unsigned order)
+			       unsigned count, unsigned order, int nid)
 {
 	struct page **caching_array;
-	struct page *p;
+	struct page *p, *tmp;
+	LIST_HEAD(batch);
 	int r = 0;
 	unsigned i, j, cpages;
 	unsigned npages = 1 << order;
@@ -555,7 +600,11 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 	}
 
 	for (i = 0, cpages = 0; i < count; ++i) {
-		p = alloc_pages(gfp_flags, order);
+		if (order)
+			p = alloc_pages_node(nid, gfp_flags, order);
+		else
+			p = ttm_alloc_batched_page(&batch, gfp_flags, nid,
+						   count - i);
 
 		if (!p) {
 			pr_debug("Unable to get page %u\n", i);
@@ -609,6 +658,9 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 					caching_array, cpages);
 	}
 out:
+	/* Only left over when changing the caching failed */
+	list_for_each_entry_safe(p, tmp, &batch, lru)
+		__free_page(p);
 	kfree(caching_array);
 
 	return r;
@@ -650,7 +702,7 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
 
 		INIT_LIST_HEAD(&new_pages);
 		r = ttm_alloc_new_pages(&new_pages, pool->gfp_flags, ttm_flags,
-					cstate, alloc_size, 0);
+					cstate, alloc_size, 0, pool->nid);
 		spin_lock_irqsave(&pool->lock, *irq_flags);
 
 		if (!r) {
@@ -695,8 +747,11 @@ static int ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 	if (count >= pool->npages) {
 		/* take all pages from the pool */
 		list_splice_init(&pool->list, pages);
+		pool->nhits += pool->npages;
 		count -= pool->npages;
 		pool->npages = 0;
+		if (count)
+			pool->nmisses++;
 		goto out;
 	}
 	/* find the last pages to include for requested number of pages. Split
@@ -716,6 +771,7 @@ static int ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 	}
 	/* Cut 'count' number of pages from the pool */
 	list_cut_position(pages, &pool->list, p);
+	pool->nhits += count;
 	pool->npages -= count;
 	count = 0;
 out:
@@ -748,20 +804,32 @@ static int ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 		 * multiple requests in parallel.
 		 **/
 		r = ttm_alloc_new_pages(pages, gfp_flags, ttm_flags, cstate,
-					count, order);
+					count, order, pool->nid);
 	}
 
 	return r;
 }
 
+/* Free pages from @pool until it is back within @max_size */
+static void ttm_pool_trim(struct ttm_page_pool *pool, unsigned max_size,
+			  unsigned min_free)
+{
+	unsigned long irq_flags;
+	unsigned npages = 0;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	if (pool->npages > max_size)
+		npages = max(pool->npages - max_size, min_free);
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	if (npages)
+		ttm_page_pool_free(pool, npages, false);
+}
+
 /* Put all pages in pages list to correct pool to wait for reuse */
 static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			  enum ttm_caching_state cstate)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, false, cstate);
-#ifdef CONFIG_TRANSPARENT_HUGEPAGE
-	struct ttm_page_pool *huge = ttm_get_pool(flags, true, cstate);
-#endif
+	struct ttm_page_pool *pool = ttm_get_pool(0, flags, false, cstate);
 	unsigned long irq_flags;
 	unsigned i;
 
@@ -803,13 +871,18 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 		return;
 	}
 
+	/*
+	 * Every page goes back to the pools of its own node.  Consecutive
+	 * pages mostly come from the same node, so only switch locks when
+	 * the node changes.
+	 */
 	i = 0;
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
-	if (huge) {
-		unsigned max_size, n2free;
+	if (ttm_get_pool(0, flags, true, cstate)) {
+		struct ttm_page_pool *huge = NULL;
 
-		spin_lock_irqsave(&huge->lock, irq_flags);
 		while (i < npages) {
+			struct ttm_page_pool *node_huge;
 			struct page *p = pages[i];
 			unsigned j;
 
@@ -823,6 +896,19 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			if (j != HPAGE_PMD_NR)
 				break;
 
+			node_huge = ttm_get_pool(page_to_nid(pages[i]), flags,
+						 true, cstate);
+			if (node_huge != huge) {
+				if (huge) {
+					spin_unlock_irqrestore(&huge->lock,
+							       irq_flags);
+					ttm_pool_trim(huge, ttm_pool_max_size() /
+						      HPAGE_PMD_NR, 0);
+				}
+				huge = node_huge;
+				spin_lock_irqsave(&huge->lock, irq_flags);
+			}
+
 			list_add_tail(&pages[i]->lru, &huge->list);
 
 			for (j = 0; j < HPAGE_PMD_NR; ++j)
@@ -831,41 +917,51 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 		}
 
 		/* Check that we don't go over the pool limit */
-		max_size = _manager->options.max_size;
-		max_size /= HPAGE_PMD_NR;
-		if (huge->npages > max_size)
-			n2free = huge->npages - max_size;
-		else
-			n2free = 0;
-		spin_unlock_irqrestore(&huge->lock, irq_flags);
-		if (n2free)
-			ttm_page_pool_free(huge, n2free, false);
+		if (huge) {
+			spin_unlock_irqrestore(&huge->lock, irq_flags);
+			ttm_pool_trim(huge, ttm_pool_max_size() / HPAGE_PMD_NR,
+				      0);
+		}
 	}
 #endif
 
-	spin_lock_irqsave(&pool->lock, irq_flags);
+	pool = NULL;
 	while (i < npages) {
-		if (pages[i]) {
-			if (page_count(pages[i]) != 1)
-				pr_err("Erroneous page count. Leaking pages.\n");
-			list_add_tail(&pages[i]->lru, &pool->list);
-			pages[i] = NULL;
-			pool->npages++;
+		struct ttm_page_pool *node_pool;
+
+		if (!pages[i]) {
+			++i;
+			continue;
+		}
+
+		if (page_count(pages[i]) != 1)
+			pr_err("Erroneous page count. Leaking pages.\n");
+
+		node_pool = ttm_get_pool(page_to_nid(pages[i]), flags, false,
+					 cstate);
+		if (node_pool != pool) {
+			if (pool) {
+				spin_unlock_irqrestore(&pool->lock, irq_flags);
+				ttm_pool_trim(pool, ttm_pool_max_size(),
+					      NUM_PAGES_TO_ALLOC);
+			}
+			pool = node_pool;
+			spin_lock_irqsave(&pool->lock, irq_flags);
 		}
+
+		list_add_tail(&pages[i]->lru, &pool->list);
+		pages[i] = NULL;
+		pool->npages++;
 		++i;
 	}
-	/* Check that we don't go over the pool limit */
-	npages = 0;
-	if (pool->npages > _manager->options.max_size) {
-		npages = pool->npages - _manager->options.max_size;
-		/* free at least NUM_PAGES_TO_ALLOC number of pages
-		 * to reduce calls to set_memory_wb */
-		if (npages < NUM_PAGES_TO_ALLOC)
-			npages = NUM_PAGES_TO_ALLOC;
+	/*
+	 * Check that we don't go over the pool limit, freeing at least
+	 * NUM_PAGES_TO_ALLOC pages to reduce calls to set_memory_wb.
+	 */
+	if (pool) {
+		spin_unlock_irqrestore(&pool->lock, irq_flags);
+		ttm_pool_trim(pool, ttm_pool_max_size(), NUM_PAGES_TO_ALLOC);
 	}
-	spin_unlock_irqrestore(&pool->lock, irq_flags);
-	if (npages)
-		ttm_page_pool_free(pool, npages, false);
 }
 
 /*
@@ -875,9 +971,11 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 			 enum ttm_caching_state cstate)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, false, cstate);
+	/* Serve from, and refill, the pools of the node we run on */
+	int nid = numa_mem_id();
+	struct ttm_page_pool *pool = ttm_get_pool(nid, flags, false, cstate);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
-	struct ttm_page_pool *huge = ttm_get_pool(flags, true, cstate);
+	struct ttm_page_pool *huge = ttm_get_pool(nid, flags, true, cstate);
 #endif
 	struct list_head plist;
 	struct page *p = NULL;
@@ -989,7 +1087,7 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 }
 
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
-		char *name, unsigned int order)
+		char *name, unsigned int order, int nid)
 {
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
@@ -998,11 +1096,38 @@ static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
 	pool->gfp_flags = flags;
 	pool->name = name;
 	pool->order = order;
+	pool->nid = nid;
+}
+
+static void ttm_node_pools_init(struct ttm_node_pools *np, unsigned order,
+				int nid)
+{
+	ttm_page_pool_init_locked(&np->wc_pool, GFP_HIGHUSER, "wc", 0, nid);
+
+	ttm_page_pool_init_locked(&np->uc_pool, GFP_HIGHUSER, "uc", 0, nid);
+
+	ttm_page_pool_init_locked(&np->wc_pool_dma32,
+				  GFP_USER | GFP_DMA32, "wc dma", 0, nid);
+
+	ttm_page_pool_init_locked(&np->uc_pool_dma32,
+				  GFP_USER | GFP_DMA32, "uc dma", 0, nid);
+
+	ttm_page_pool_init_locked(&np->wc_pool_huge,
+				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
+				   __GFP_KSWAPD_RECLAIM) &
+				  ~(__GFP_MOVABLE | __GFP_COMP),
+				  "wc huge", order, nid);
+
+	ttm_page_pool_init_locked(&np->uc_pool_huge,
+				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
+				   __GFP_KSWAPD_RECLAIM) &
+				  ~(__GFP_MOVABLE | __GFP_COMP)
+				  , "uc huge", order, nid);
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 {
-	int ret;
+	int ret, nid;
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	unsigned order = HPAGE_PMD_ORDER;
 #else
@@ -1017,27 +1142,16 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 	if (!_manager)
 		return -ENOMEM;
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, "wc", 0);
-
-	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER, "uc", 0);
-
-	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "wc dma", 0);
-
-	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "uc dma", 0);
-
-	ttm_page_pool_init_locked(&_manager->wc_pool_huge,
-				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
-				   __GFP_KSWAPD_RECLAIM) &
-				  ~(__GFP_MOVABLE | __GFP_COMP),
-				  "wc huge", order);
+	_manager->nodes = kcalloc(nr_node_ids, sizeof(*_manager->nodes),
+				  GFP_KERNEL);
+	if (!_manager->nodes) {
+		kfree(_manager);
+		_manager = NULL;
+		return -ENOMEM;
+	}
 
-	ttm_page_pool_init_locked(&_manager->uc_pool_huge,
-				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
-				   __GFP_KSWAPD_RECLAIM) &
-				  ~(__GFP_MOVABLE | __GFP_COMP)
-				  , "uc huge", order);
+	for_each_node(nid)
+		ttm_node_pools_init(&_manager->nodes[nid], order, nid);
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
@@ -1061,14 +1175,16 @@ int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 
 void ttm_page_alloc_fini(void)
 {
-	int i;
+	int i, nid;
 
 	pr_info("Finalizing pool allocator\n");
 	ttm_pool_mm_shrink_fini(_manager);
 
 	/* OK to use static buffer since global mutex is no longer used. */
-	for (i = 0; i < NUM_POOLS; ++i)
-		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES, true);
+	for_each_node(nid)
+		for (i = 0; i < NUM_POOLS; ++i)
+			ttm_page_pool_free(&_manager->nodes[nid].pools[i],
+					   FREE_ALL_PAGES, true);
 
 	kobject_put(&_manager->kobj);
 	_manager = NULL;
@@ -1219,19 +1335,24 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
 	struct ttm_page_pool *p;
 	unsigned i;
-	char *h[] = {"pool", "refills", "pages freed", "size"};
+	int nid;
+	char *h[] = {"node", "pool", "refills", "pages freed", "size",
+		     "hits", "misses"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
 		return 0;
 	}
-	seq_printf(m, "%7s %12s %13s %8s\n",
-			h[0], h[1], h[2], h[3]);
-	for (i = 0; i < NUM_POOLS; ++i) {
-		p = &_manager->pools[i];
-
-		seq_printf(m, "%7s %12ld %13ld %8d\n",
-				p->name, p->nrefills,
-				p->nfrees, p->npages);
+	seq_printf(m, "%4s %7s %12s %13s %8s %12s %12s\n",
+			h[0], h[1], h[2], h[3], h[4], h[5], h[6]);
+	for_each_node(nid) {
+		for (i = 0; i < NUM_POOLS; ++i) {
+			p = &_manager->nodes[nid].pools[i];
+
+			seq_printf(m, "%4d %7s %12ld %13ld %8d %12ld %12ld\n",
+					nid, p->name, p->nrefills,
+					p->nfrees, p->npages,
+					p->nhits, p->nmisses);
+		}
 	}
 	return 0;
 }
@@ -141,7 +141,84 @@ static DECLARE_UVERBS_NAMED_METHOD(UVERBS_METHOD_DM_MR_REG,
 			     UVERBS_ATTR_TYPE(u32),
 			     UA_FLAGS(UVERBS_ATTR_SPEC_F_MANDATORY)));
 
+static int UVERBS_HANDLER(UVERBS_METHOD_ADVISE_MR)(struct ib_device *ib_dev,
+						   struct ib_uverbs_file *file,
+						   struct uverbs_attr_bundle *attrs)
+{
+	const struct uverbs_attr *attr;
+	struct ib_uverbs_sge __user *usge;
+	struct ib_uverbs_sge sge;
+	struct ib_sge *sg_list;
+	struct ib_pd *pd;
+	u32 advice, flags, num_sge, i;
+	int ret;
+
+	if (!ib_dev->advise_mr)
+		return -EOPNOTSUPP;
+
+	ret = uverbs_copy_from(&advice, attrs, UVERBS_ATTR_ADVISE_MR_ADVICE);
+	if (ret)
+		return ret;
+
+	if (advice > IB_UVERBS_ADVISE_MR_ADVICE_PREFETCH_WRITE)
+		return -EINVAL;
+
+	ret = uverbs_copy_from(&flags, attrs, UVERBS_ATTR_ADVISE_MR_FLAGS);
+	if (ret)
+		return ret;
+
+	if (flags & ~IB_UVERBS_ADVISE_MR_FLAG_FLUSH)
+		return -EINVAL;
+
+	pd = uverbs_attr_get_obj(attrs, UVERBS_ATTR_ADVISE_MR_PD_HANDLE);
+
+	attr = uverbs_attr_get(attrs, UVERBS_ATTR_ADVISE_MR_SGE_LIST);
+	if (IS_ERR(attr))
+		return PTR_ERR(attr);
+
+	if (attr->ptr_attr.len % sizeof(sge))
+		return -EINVAL;
+
+	num_sge = attr->ptr_attr.len / sizeof(sge);
+	sg_list = kcalloc(num_sge, sizeof(*sg_list), GFP_KERNEL);
+	if (!sg_list)
+		return -ENOMEM;
+
+	usge = u64_to_user_ptr(attr->ptr_attr.data);
+	for (i = 0; i < num_sge; i++) {
+		if (copy_from_user(&sge, &usge[i], sizeof(sge))) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		sg_list[i].addr = sge.addr;
+		sg_list[i].length = sge.length;
+		sg_list[i].lkey = sge.lkey;
+	}
+
+	ret = pd->device->advise_mr(pd, advice, flags, sg_list, num_sge, attrs);
+out:
+	kfree(sg_list);
+	return ret;
+}
+
+static DECLARE_UVERBS_NAMED_METHOD(UVERBS_METHOD_ADVISE_MR,
+	&UVERBS_ATTR_IDR(UVERBS_ATTR_ADVISE_MR_PD_HANDLE, UVERBS_OBJECT_PD,
+			 UVERBS_ACCESS_READ,
+			 UA_FLAGS(UVERBS_ATTR_SPEC_F_MANDATORY)),
+	&UVERBS_ATTR_PTR_IN(UVERBS_ATTR_ADVISE_MR_ADVICE,
+			    UVERBS_ATTR_TYPE(u32),
+			    UA_FLAGS(UVERBS_ATTR_SPEC_F_MANDATORY)),
+	&UVERBS_ATTR_PTR_IN(UVERBS_ATTR_ADVISE_MR_FLAGS,
+			    UVERBS_ATTR_TYPE(u32),
+			    UA_FLAGS(UVERBS_ATTR_SPEC_F_MANDATORY)),
+	&UVERBS_ATTR_PTR_IN(UVERBS_ATTR_ADVISE_MR_SGE_LIST,
+			    UVERBS_ATTR_SIZE(sizeof(struct ib_uverbs_sge),
+					     U16_MAX),
+			    UA_FLAGS(UVERBS_ATTR_SPEC_F_MANDATORY)));
+
 DECLARE_UVERBS_NAMED_OBJECT(UVERBS_OBJECT_MR,
 			    /* 1 is used in order to free the MR after all the MWs */
 			    &UVERBS_TYPE_ALLOC_IDR(1, uverbs_free_mr),
-			    &UVERBS_METHOD(UVERBS_METHOD_DM_MR_REG));
+			    &UVERBS_METHOD(UVERBS_METHOD_DM_MR_REG),
+			    &UVERBS_METHOD(UVERBS_METHOD_ADVISE_MR));
@@ -43,6 +43,9 @@
  * a pagefault. */
 #define MMU_NOTIFIER_TIMEOUT 1000
 
+/* Map pages read only even if the MR is writable */
+#define MLX5_PF_FLAGS_DOWNGRADE BIT(0)
+
 #define MLX5_IMR_MTT_BITS (30 - PAGE_SHIFT)
 #define MLX5_IMR_MTT_SHIFT (MLX5_IMR_MTT_BITS + PAGE_SHIFT)
 #define MLX5_IMR_MTT_ENTRIES BIT_ULL(MLX5_IMR_MTT_BITS)
@@ -495,7 +498,8 @@ void mlx5_ib_free_implicit_mr(struct mlx5_ib_mr *imr)
 }
 
 static int pagefault_mr(struct mlx5_ib_dev *dev, struct mlx5_ib_mr *mr,
-			u64 io_virt, size_t bcnt, u32 *bytes_mapped)
+			u64 io_virt, size_t bcnt, u32 *bytes_mapped,
+			u32 flags)
 {
 	u64 access_mask = ODP_READ_ALLOWED_BIT;
 	int npages = 0, page_shift, np;
@@ -523,7 +527,7 @@ static int pagefault_mr(struct mlx5_ib_dev *dev, struct mlx5_ib_mr *mr,
 	page_mask = ~(BIT(page_shift) - 1);
 	start_idx = (io_virt - (mr->mmkey.iova & page_mask)) >> page_shift;
 
-	if (mr->umem->writable)
+	if (mr->umem->writable && !(flags & MLX5_PF_FLAGS_DOWNGRADE))
 		access_mask |= ODP_WRITE_ALLOWED_BIT;
 
 	current_seq = READ_ONCE(odp->notifiers_seq);
@@ -663,7 +667,7 @@ static int pagefault_single_data_segment(struct mlx5_ib_dev *dev,
 			goto srcu_unlock;
 		}
 
-		ret = pagefault_mr(dev, mr, io_virt, bcnt, bytes_mapped);
+		ret = pagefault_mr(dev, mr, io_virt, bcnt, bytes_mapped, 0);
 		if (ret < 0)
 			goto srcu_unlock;
 
@@ -1203,10 +1207,76 @@ void mlx5_odp_init_mr_cache_entry(struct mlx5_cache_ent *ent)
 	}
 }
 
+/*
+ * Fault in a range of an ODP MR before the HCA touches it, so that a large
+ * region does not take one page fault per page once traffic starts.
+ */
+static int prefetch_mr(struct mlx5_ib_dev *dev, struct ib_pd *pd,
+		       struct ib_sge *sge, u32 pf_flags)
+{
+	struct mlx5_core_mkey *mmkey;
+	struct mlx5_ib_mr *mr;
+	int tries = 3, ret;
+
+	mmkey = __mlx5_mr_lookup(dev->mdev, mlx5_base_mkey(sge->lkey));
+	if (!mmkey || mmkey->key != sge->lkey || mmkey->type != MLX5_MKEY_MR)
+		return -EINVAL;
+
+	mr = container_of(mmkey, struct mlx5_ib_mr, mmkey);
+	if (!mr->live || mr->ibmr.pd != pd)
+		return -EINVAL;
+
+	/* Pinned MRs are always mapped, nothing to do */
+	if (!mr->umem || !mr->umem->odp_data)
+		return 0;
+
+	if (!(pf_flags & MLX5_PF_FLAGS_DOWNGRADE) && !mr->umem->writable)
+		return -EPERM;
+
+	/* pagefault_mr() waits for racing invalidations before -EAGAIN */
+	do {
+		ret = pagefault_mr(dev, mr, sge->addr, sge->length, NULL,
+				   pf_flags);
+	} while (ret == -EAGAIN && --tries);
+
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * All prefetches complete before returning, so IB_UVERBS_ADVISE_MR_FLAG_FLUSH
+ * is implied.
+ */
+int mlx5_ib_advise_mr(struct ib_pd *pd,
+		      enum ib_uverbs_advise_mr_advice advice, u32 flags,
+		      struct ib_sge *sg_list, u32 num_sge,
+		      struct uverbs_attr_bundle *attrs)
+{
+	struct mlx5_ib_dev *dev = to_mdev(pd->device);
+	u32 pf_flags = 0;
+	int srcu_key, ret = 0;
+	u32 i;
+
+	if (advice == IB_UVERBS_ADVISE_MR_ADVICE_PREFETCH)
+		pf_flags |= MLX5_PF_FLAGS_DOWNGRADE;
+
+	srcu_key = srcu_read_lock(&dev->mr_srcu);
+	for (i = 0; i < num_sge && !ret; i++) {
+		ret = prefetch_mr(dev, pd, &sg_list[i], pf_flags);
+		if (!ret && fatal_signal_pending(current))
+			ret = -EINTR;
+	}
+	srcu_read_unlock(&dev->mr_srcu, srcu_key);
+
+	return ret;
+}
+
 int mlx5_ib_odp_init_one(struct mlx5_ib_dev *dev)
 {
 	int ret;
 
+	if (dev->odp_caps.general_caps & IB_ODP_SUPPORT)
+		dev->ib_dev.advise_mr = mlx5_ib_advise_mr;
+
 	if (dev->odp_caps.general_caps & IB_ODP_SUPPORT_IMPLICIT) {
 		ret = mlx5_cmd_null_mkey(dev->mdev, &dev->null_mkey);
 		if (ret) {
@@ -35,6 +35,9 @@
 
 #include "ipoib.h"
 
+/* Pairs of completion vectors handed out to child interfaces so far */
+static atomic_t ipoib_child_vec = ATOMIC_INIT(0);
+
 int ipoib_mcast_attach(struct net_device *dev, struct ib_device *hca,
 		       union ib_gid *mgid, u16 mlid, int set_qkey, u32 qkey)
 {
@@ -171,7 +174,16 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 		if (ret != -ENOSYS)
 			return -ENODEV;
 
+	/*
+	 * Each interface gets its own pair of completion vectors, so that the
+	 * NAPI contexts of the parent and child (P_Key) interfaces sharing an
+	 * HCA run on different CPUs rather than all on those of the port.
+	 */
 	req_vec = (priv->port - 1) * 2;
+	if (priv->parent)
+		req_vec = rdma_end_port(priv->ca) * 2 +
+			  (unsigned int)atomic_fetch_add(2, &ipoib_child_vec) %
+			  priv->ca->num_comp_vectors;
 
 	cq_attr.cqe = size;
 	cq_attr.comp_vector = req_vec % priv->ca->num_comp_vectors;
@@ -705,6 +705,7 @@ static void search_free(struct closure *cl)
 	if (s->iop.bio)
 		bio_put(s->iop.bio);
 
+	atomic_dec(&s->d->c->search_inflight);
 	bio_complete(s);
 	closure_debug_destroy(cl);
 	mempool_free(s, s->d->c->search);
@@ -716,6 +717,7 @@ static inline struct search *search_alloc(struct bio *bio,
 	struct search *s;
 
 	s = mempool_alloc(d->c->search, GFP_NOIO);
+	atomic_inc(&d->c->search_inflight);
 
 	closure_init(&s->cl, NULL);
 	do_bio_hook(s, bio, request_endio);
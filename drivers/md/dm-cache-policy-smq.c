@@ -13,6 +13,8 @@
 #include <linux/jiffies.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
 #include <linux/vmalloc.h>
 #include <linux/math64.h>
 
@@ -574,6 +576,12 @@ struct smq_hash_table {
 	struct entry_space *es;
 	unsigned long long hash_bits;
 	unsigned *buckets;
+
+	/*
+	 * Bumped around every change to the chains, so that lookups may
+	 * walk them without holding the policy lock (see h_peek()).
+	 */
+	seqcount_t seq;
 };
 
 /*
@@ -585,6 +593,7 @@ static int h_init(struct smq_hash_table *ht, struct entry_space *es, unsigned nr
 	unsigned i, nr_buckets;
 
 	ht->es = es;
+	seqcount_init(&ht->seq);
 	nr_buckets = roundup_pow_of_two(max(nr_entries / 4u, 16u));
 	ht->hash_bits = __ffs(nr_buckets);
 
@@ -615,8 +624,10 @@ static struct entry *h_next(struct smq_hash_table *ht, struct entry *e)
 
 static void __h_insert(struct smq_hash_table *ht, unsigned bucket, struct entry *e)
 {
+	write_seqcount_begin(&ht->seq);
 	e->hash_next = ht->buckets[bucket];
-	ht->buckets[bucket] = to_index(ht->es, e);
+	WRITE_ONCE(ht->buckets[bucket], to_index(ht->es, e));
+	write_seqcount_end(&ht->seq);
 }
 
 static void h_insert(struct smq_hash_table *ht, struct entry *e)
@@ -644,10 +655,12 @@ static struct entry *__h_lookup(struct smq_hash_table *ht, unsigned h, dm_oblock
 static void __h_unlink(struct smq_hash_table *ht, unsigned h,
 		       struct entry *e, struct entry *prev)
 {
+	write_seqcount_begin(&ht->seq);
 	if (prev)
 		prev->hash_next = e->hash_next;
 	else
-		ht->buckets[h] = e->hash_next;
+		WRITE_ONCE(ht->buckets[h], e->hash_next);
+	write_seqcount_end(&ht->seq);
 }
 
 /*
@@ -671,6 +684,39 @@ static struct entry *h_lookup(struct smq_hash_table *ht, dm_oblock_t oblock)
 	return e;
 }
 
+/*
+ * Lookup without the policy lock.  The bucket is left in its current
+ * order.  Entries live in a single array for the lifetime of the policy,
+ * so following a chain that is being changed underneath us can't fault;
+ * the sequence count tells us whether what we found can be trusted.
+ * Long chains aren't worth chasing locklessly, we give up and let the
+ * caller take the lock instead.
+ */
+#define H_PEEK_MAX_DEPTH 16u
+
+static struct entry *h_peek(struct smq_hash_table *ht, dm_oblock_t oblock)
+{
+	struct entry *e;
+	unsigned seq, depth = 0;
+	unsigned h = hash_64(from_oblock(oblock), ht->hash_bits);
+
+	seq = raw_seqcount_begin(&ht->seq);
+	for (e = to_entry(ht->es, READ_ONCE(ht->buckets[h])); e; e = h_next(ht, e)) {
+		if (e->oblock == oblock)
+			break;
+
+		if (++depth >= H_PEEK_MAX_DEPTH) {
+			e = NULL;
+			break;
+		}
+	}
+
+	if (read_seqcount_retry(&ht->seq, seq))
+		return NULL;
+
+	return e;
+}
+
 static void h_remove(struct smq_hash_table *ht, struct entry *e)
 {
 	unsigned h = hash_64(from_oblock(e->oblock), ht->hash_bits);
@@ -791,6 +837,23 @@ static struct entry *get_entry(struct entry_alloc *ea, unsigned index)
 #define HOTSPOT_UPDATE_PERIOD (HZ)
 #define CACHE_UPDATE_PERIOD (60ul * HZ)
 
+/*
+ * Cache hits found without the policy lock are logged per cpu, and the
+ * queue updates they imply are applied later in a batch.
+ */
+#define HIT_LOG_SIZE 64u
+
+struct hit_log_entry {
+	unsigned index;
+	dm_oblock_t oblock;
+};
+
+struct hit_log {
+	spinlock_t lock;
+	unsigned nr;
+	struct hit_log_entry hits[HIT_LOG_SIZE];
+};
+
 struct smq_policy {
 	struct dm_cache_policy policy;
 
@@ -854,6 +917,8 @@ struct smq_policy {
 
 	struct background_tracker *bg_work;
 
+	struct hit_log __percpu *hit_logs;
+
 	bool migrations_allowed;
 };
 
@@ -1351,6 +1416,7 @@ static void smq_destroy(struct dm_cache_policy *p)
 {
 	struct smq_policy *mq = to_smq_policy(p);
 
+	free_percpu(mq->hit_logs);
 	btracker_destroy(mq->bg_work);
 	h_exit(&mq->hotspot_table);
 	h_exit(&mq->table);
@@ -1397,6 +1463,81 @@ static int __lookup(struct smq_policy *mq, dm_oblock_t oblock, dm_cblock_t *cblo
 	}
 }
 
+/*
+ * Replays the hits in a log, as __lookup() would have done had it found
+ * them.  Entries that have been freed or remapped since are skipped.
+ * Called with both the log lock and the policy lock held.
+ */
+static void __apply_hit_log(struct smq_policy *mq, struct hit_log *log)
+{
+	unsigned i;
+	struct entry *e;
+
+	for (i = 0; i < log->nr; i++) {
+		e = __get_entry(&mq->es, log->hits[i].index);
+		if (!e->allocated || e->oblock != log->hits[i].oblock)
+			continue;
+
+		stats_level_accessed(&mq->cache_stats, e->level);
+		requeue(mq, e);
+	}
+
+	log->nr = 0;
+}
+
+static void apply_hit_logs(struct smq_policy *mq)
+{
+	int cpu;
+	unsigned long flags;
+	struct hit_log *log;
+
+	for_each_possible_cpu(cpu) {
+		log = per_cpu_ptr(mq->hit_logs, cpu);
+		if (!READ_ONCE(log->nr))
+			continue;
+
+		spin_lock_irqsave(&log->lock, flags);
+		spin_lock(&mq->lock);
+		__apply_hit_log(mq, log);
+		spin_unlock(&mq->lock);
+		spin_unlock_irqrestore(&log->lock, flags);
+	}
+}
+
+/*
+ * The hit path.  A block that is already in the cache is found without
+ * the policy lock, and its queue update is deferred to the hit log.
+ * Misses, and anything we're unsure about, go through __lookup() as
+ * before, so promotion decisions are unaffected.
+ */
+static bool lookup_hit(struct smq_policy *mq, dm_oblock_t oblock, dm_cblock_t *cblock)
+{
+	unsigned long flags;
+	struct hit_log *log;
+	struct entry *e;
+
+	e = h_peek(&mq->table, oblock);
+	if (!e)
+		return false;
+
+	*cblock = infer_cblock(mq, e);
+
+	local_irq_save(flags);
+	log = this_cpu_ptr(mq->hit_logs);
+	spin_lock(&log->lock);
+	log->hits[log->nr].index = to_index(&mq->es, e);
+	log->hits[log->nr].oblock = oblock;
+	if (++log->nr == HIT_LOG_SIZE) {
+		spin_lock(&mq->lock);
+		__apply_hit_log(mq, log);
+		spin_unlock(&mq->lock);
+	}
+	spin_unlock(&log->lock);
+	local_irq_restore(flags);
+
+	return true;
+}
+
 static int smq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t *cblock,
 		      int data_dir, bool fast_copy,
 		      bool *background_work)
@@ -1405,6 +1546,11 @@ static int smq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	if (lookup_hit(mq, oblock, cblock)) {
+		*background_work = false;
+		return 0;
+	}
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = __lookup(mq, oblock, cblock,
 		     data_dir, fast_copy,
@@ -1424,6 +1570,9 @@ static int smq_lookup_with_work(struct dm_cache_policy *p,
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	if (lookup_hit(mq, oblock, cblock))
+		return 0;
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = __lookup(mq, oblock, cblock, data_dir, fast_copy, work, &background_queued);
 	spin_unlock_irqrestore(&mq->lock, flags);
@@ -1438,6 +1587,11 @@ static int smq_get_background_work(struct dm_cache_policy *p, bool idle,
 	unsigned long flags;
 	struct smq_policy *mq = to_smq_policy(p);
 
+	/*
+	 * Writeback and demotion choices should see recent hits.
+	 */
+	apply_hit_logs(mq);
+
 	spin_lock_irqsave(&mq->lock, flags);
 	r = btracker_issue(mq->bg_work, result);
 	if (r == -ENODATA) {
@@ -1618,6 +1772,8 @@ static void smq_tick(struct dm_cache_policy *p, bool can_block)
 	struct smq_policy *mq = to_smq_policy(p);
 	unsigned long flags;
 
+	apply_hit_logs(mq);
+
 	spin_lock_irqsave(&mq->lock, flags);
 	mq->tick++;
 	update_sentinels(mq);
@@ -1723,6 +1879,7 @@ static struct dm_cache_policy *__smq_create(dm_cblock_t cache_size,
 					    bool migrations_allowed)
 {
 	unsigned i;
+	int cpu;
 	unsigned nr_sentinels_per_queue = 2u * NR_CACHE_LEVELS;
 	unsigned total_sentinels = 2u * nr_sentinels_per_queue;
 	struct smq_policy *mq = kzalloc(sizeof(*mq), GFP_KERNEL);
@@ -1806,10 +1963,23 @@ static struct dm_cache_policy *__smq_create(dm_cblock_t cache_size,
 	if (!mq->bg_work)
 		goto bad_btracker;
 
+	mq->hit_logs = alloc_percpu(struct hit_log);
+	if (!mq->hit_logs)
+		goto bad_hit_logs;
+
+	for_each_possible_cpu(cpu) {
+		struct hit_log *log = per_cpu_ptr(mq->hit_logs, cpu);
+
+		spin_lock_init(&log->lock);
+		log->nr = 0;
+	}
+
 	mq->migrations_allowed = migrations_allowed;
 
 	return &mq->policy;
 
+bad_hit_logs:
+	btracker_destroy(mq->bg_work);
 bad_btracker:
 	h_exit(&mq->hotspot_table);
 bad_alloc_hotspot_table:
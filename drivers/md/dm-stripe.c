@@ -462,6 +462,15 @@ static void stripe_io_hints(struct dm_target *ti,
 
 	blk_limits_io_min(limits, chunk_size);
 	blk_limits_io_opt(limits, chunk_size * sc->stripes);
+
+	/*
+	 * Expose the stripe boundary to whoever builds bios for us, so they
+	 * come sized to a chunk instead of being split on the way down.
+	 */
+	if (sc->chunk_size_shift >= 0 &&
+	    !(ti->begin & (sc->chunk_size - 1)))
+		limits->chunk_sectors = min_not_zero(limits->chunk_sectors,
+						     sc->chunk_size);
 }
 
 static struct target_type stripe_target = {
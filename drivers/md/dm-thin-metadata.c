@@ -12,6 +12,8 @@
 
 #include <linux/list.h>
 #include <linux/device-mapper.h>
+#include <linux/hash.h>
+#include <linux/seqlock.h>
 #include <linux/workqueue.h>
 
 /*--------------------------------------------------------------------------
@@ -203,6 +205,21 @@ struct dm_pool_metadata {
 	__u8 metadata_space_map_root[SPACE_MAP_ROOT_SIZE];
 };
 
+/*
+ * Each thin device keeps a small direct mapped cache of the mappings it
+ * has looked up recently, so that hits don't need to take root_lock or
+ * walk the btree.  Entries hold the packed (data block, time) value, the
+ * sharing is worked out at lookup time as for a btree hit.
+ */
+#define MAPPING_CACHE_BITS 7
+#define MAPPING_CACHE_SIZE (1u << MAPPING_CACHE_BITS)
+#define MAPPING_CACHE_INVALID ((dm_block_t) -1)
+
+struct mapping_cache_entry {
+	dm_block_t block;
+	__le64 value;
+};
+
 struct dm_thin_device {
 	struct list_head list;
 	struct dm_pool_metadata *pmd;
@@ -215,6 +232,14 @@ struct dm_thin_device {
 	uint64_t transaction_id;
 	uint32_t creation_time;
 	uint32_t snapshotted_time;
+
+	/*
+	 * Readers of the cache take no other lock.  Writers either hold
+	 * root_lock for write, or for read when populating after a btree
+	 * lookup, so the mappings can't change underneath them.
+	 */
+	seqlock_t cache_lock;
+	struct mapping_cache_entry cache[MAPPING_CACHE_SIZE];
 };
 
 /*----------------------------------------------------------------
@@ -898,6 +923,66 @@ int dm_pool_metadata_close(struct dm_pool_metadata *pmd)
 	return 0;
 }
 
+static struct mapping_cache_entry *__cache_slot(struct dm_thin_device *td,
+					       dm_block_t block)
+{
+	return td->cache + hash_64(block, MAPPING_CACHE_BITS);
+}
+
+static void __cache_init(struct dm_thin_device *td)
+{
+	unsigned i;
+
+	seqlock_init(&td->cache_lock);
+	for (i = 0; i < MAPPING_CACHE_SIZE; i++)
+		td->cache[i].block = MAPPING_CACHE_INVALID;
+}
+
+static bool cache_lookup(struct dm_thin_device *td, dm_block_t block, __le64 *value)
+{
+	unsigned seq;
+	bool hit;
+	struct mapping_cache_entry *ce = __cache_slot(td, block);
+
+	do {
+		seq = read_seqbegin(&td->cache_lock);
+		hit = (ce->block == block);
+		*value = ce->value;
+	} while (read_seqretry(&td->cache_lock, seq));
+
+	return hit;
+}
+
+static void cache_insert(struct dm_thin_device *td, dm_block_t block, __le64 value)
+{
+	struct mapping_cache_entry *ce = __cache_slot(td, block);
+
+	write_seqlock(&td->cache_lock);
+	ce->block = block;
+	ce->value = value;
+	write_sequnlock(&td->cache_lock);
+}
+
+static void cache_remove_range(struct dm_thin_device *td, dm_block_t begin, dm_block_t end)
+{
+	unsigned i;
+
+	write_seqlock(&td->cache_lock);
+	if (end - begin == 1)
+		__cache_slot(td, begin)->block = MAPPING_CACHE_INVALID;
+	else {
+		for (i = 0; i < MAPPING_CACHE_SIZE; i++)
+			if (td->cache[i].block >= begin && td->cache[i].block < end)
+				td->cache[i].block = MAPPING_CACHE_INVALID;
+	}
+	write_sequnlock(&td->cache_lock);
+}
+
+static void cache_clear(struct dm_thin_device *td)
+{
+	cache_remove_range(td, 0, MAPPING_CACHE_INVALID);
+}
+
 /*
  * __open_device: Returns @td corresponding to device with id @dev,
  * creating it if @create is set and incrementing @td->open_count.
@@ -960,6 +1045,7 @@ static int __open_device(struct dm_pool_metadata *pmd,
 	(*td)->transaction_id = le64_to_cpu(details_le.transaction_id);
 	(*td)->creation_time = le32_to_cpu(details_le.creation_time);
 	(*td)->snapshotted_time = le32_to_cpu(details_le.snapshotted_time);
+	__cache_init(*td);
 
 	list_add(&(*td)->list, &pmd->thin_devices);
 
@@ -1425,8 +1511,10 @@ static int __find_block(struct dm_thin_device *td, dm_block_t block,
 		info = &pmd->nb_info;
 
 	r = dm_btree_lookup(info, pmd->root, keys, &value);
-	if (!r)
+	if (!r) {
+		cache_insert(td, block, value);
 		unpack_lookup_result(td, value, result);
+	}
 
 	return r;
 }
@@ -1435,8 +1523,14 @@ int dm_thin_find_block(struct dm_thin_device *td, dm_block_t block,
 		       int can_issue_io, struct dm_thin_lookup_result *result)
 {
 	int r;
+	__le64 value;
 	struct dm_pool_metadata *pmd = td->pmd;
 
+	if (!pmd->fail_io && cache_lookup(td, block, &value)) {
+		unpack_lookup_result(td, value, result);
+		return 0;
+	}
+
 	down_read(&pmd->root_lock);
 	if (pmd->fail_io) {
 		up_read(&pmd->root_lock);
@@ -1545,6 +1639,8 @@ static int __insert(struct dm_thin_device *td, dm_block_t block,
 	if (r)
 		return r;
 
+	cache_insert(td, block, value);
+
 	td->changed = 1;
 	if (inserted)
 		td->mapped_blocks++;
@@ -1571,6 +1667,8 @@ static int __remove(struct dm_thin_device *td, dm_block_t block)
 	struct dm_pool_metadata *pmd = td->pmd;
 	dm_block_t keys[2] = { td->id, block };
 
+	cache_remove_range(td, block, block + 1);
+
 	r = dm_btree_remove(&pmd->info, pmd->root, keys, &pmd->root);
 	if (r)
 		return r;
@@ -1590,6 +1688,8 @@ static int __remove_range(struct dm_thin_device *td, dm_block_t begin, dm_block_
 	__le64 value;
 	dm_block_t mapping_root;
 
+	cache_remove_range(td, begin, end);
+
 	/*
 	 * Find the mapping tree
 	 */
@@ -1785,8 +1885,14 @@ static void __set_abort_with_changes_flags(struct dm_pool_metadata *pmd)
 {
 	struct dm_thin_device *td;
 
-	list_for_each_entry(td, &pmd->thin_devices, list)
+	list_for_each_entry(td, &pmd->thin_devices, list) {
 		td->aborted_with_changes = td->changed;
+
+		/*
+		 * The mappings are about to be rolled back.
+		 */
+		cache_clear(td);
+	}
 }
 
 int dm_pool_abort_metadata(struct dm_pool_metadata *pmd)
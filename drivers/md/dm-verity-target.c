@@ -33,8 +33,23 @@
 #define DM_VERITY_OPT_RESTART		"restart_on_corruption"
 #define DM_VERITY_OPT_IGN_ZEROES	"ignore_zero_blocks"
 #define DM_VERITY_OPT_AT_MOST_ONCE	"check_at_most_once"
+#define DM_VERITY_OPT_COMPLETION	"try_verify_in_completion"
 
-#define DM_VERITY_OPTS_MAX		(2 + DM_VERITY_OPTS_FEC)
+#define DM_VERITY_OPTS_MAX		(4 + DM_VERITY_OPTS_FEC)
+
+/*
+ * Reads of up to this many data blocks may be verified directly from bio
+ * completion if "try_verify_in_completion" is set.
+ */
+#define DM_VERITY_COMPLETION_MAX_BLOCKS	4
+
+/*
+ * Number of data blocks hashed concurrently when the hash implementation
+ * is asynchronous, and the scatterlist size for each of them (salt plus
+ * up to three bio segments).
+ */
+#define DM_VERITY_HASH_BATCH		16
+#define DM_VERITY_BATCH_SG		4
 
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
@@ -108,15 +123,14 @@ static int verity_hash_update(struct dm_verity *v, struct ahash_request *req,
 /*
  * Wrapper for crypto_ahash_init, which handles verity salting.
  */
-static int verity_hash_init(struct dm_verity *v, struct ahash_request *req,
-				struct crypto_wait *wait)
+static int __verity_hash_init(struct dm_verity *v, struct crypto_ahash *tfm,
+			      struct ahash_request *req, u32 flags,
+			      struct crypto_wait *wait)
 {
 	int r;
 
-	ahash_request_set_tfm(req, v->tfm);
-	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
-					CRYPTO_TFM_REQ_MAY_BACKLOG,
-					crypto_req_done, (void *)wait);
+	ahash_request_set_tfm(req, tfm);
+	ahash_request_set_callback(req, flags, crypto_req_done, (void *)wait);
 	crypto_init_wait(wait);
 
 	r = crypto_wait_req(crypto_ahash_init(req), wait);
@@ -132,6 +146,13 @@ static int verity_hash_init(struct dm_verity *v, struct ahash_request *req,
 	return r;
 }
 
+static int verity_hash_init(struct dm_verity *v, struct ahash_request *req,
+			    struct crypto_wait *wait)
+{
+	return __verity_hash_init(v, v->tfm, req, CRYPTO_TFM_REQ_MAY_SLEEP |
+				  CRYPTO_TFM_REQ_MAY_BACKLOG, wait);
+}
+
 static int verity_hash_final(struct dm_verity *v, struct ahash_request *req,
 			     u8 *digest, struct crypto_wait *wait)
 {
@@ -445,6 +466,231 @@ static inline void verity_bv_skip_block(struct dm_verity *v,
 	bio_advance_iter(bio, iter, 1 << v->data_dev_block_bits);
 }
 
+/*
+ * Check the digest computed for a data block against the expected one.
+ * On mismatch, try to correct the block with FEC before reporting it.
+ */
+static int verity_check_data_block(struct dm_verity *v, struct dm_verity_io *io,
+				   sector_t cur_block, struct bvec_iter *start)
+{
+	if (likely(memcmp(verity_io_real_digest(v, io),
+			  verity_io_want_digest(v, io), v->digest_size) == 0)) {
+		if (v->validated_blocks)
+			set_bit(cur_block, v->validated_blocks);
+		return 0;
+	}
+
+	if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+			      cur_block, NULL, start) == 0)
+		return 0;
+
+	if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA, cur_block))
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Hashing one block at a time and waiting for each result leaves an
+ * asynchronous (e.g. multi-buffer) hash implementation with a single
+ * request to work on.  For those, the data blocks of an io are hashed in
+ * batches of up to DM_VERITY_HASH_BATCH concurrent requests.
+ */
+struct verity_batch;
+
+struct verity_batch_slot {
+	struct verity_batch *batch;
+	sector_t block;
+	struct bvec_iter start;
+	int err;
+	struct scatterlist sg[DM_VERITY_BATCH_SG];
+	/*
+	 * Followed by u8 want_digest[v->digest_size],
+	 * u8 real_digest[v->digest_size] and the hash request.
+	 */
+};
+
+struct verity_batch {
+	atomic_t pending;
+	struct completion done;
+	unsigned nr;
+	unsigned max;
+	size_t slot_size;
+};
+
+static size_t verity_batch_req_offset(struct dm_verity *v)
+{
+	return ALIGN(sizeof(struct verity_batch_slot) + v->digest_size * 2,
+		     CRYPTO_MINALIGN);
+}
+
+static struct verity_batch_slot *verity_batch_slot(struct verity_batch *batch,
+						   unsigned i)
+{
+	return (void *)batch + ALIGN(sizeof(*batch), CRYPTO_MINALIGN) +
+		i * batch->slot_size;
+}
+
+static u8 *verity_slot_want_digest(struct dm_verity *v,
+				   struct verity_batch_slot *slot)
+{
+	return (u8 *)(slot + 1);
+}
+
+static u8 *verity_slot_real_digest(struct dm_verity *v,
+				   struct verity_batch_slot *slot)
+{
+	return (u8 *)(slot + 1) + v->digest_size;
+}
+
+static struct ahash_request *verity_slot_req(struct dm_verity *v,
+					     struct verity_batch_slot *slot)
+{
+	return (void *)slot + verity_batch_req_offset(v);
+}
+
+static struct verity_batch *verity_alloc_batch(struct dm_verity *v,
+					       unsigned n_blocks)
+{
+	struct verity_batch *batch;
+	unsigned max = min_t(unsigned, n_blocks, DM_VERITY_HASH_BATCH);
+	size_t slot_size = ALIGN(verity_batch_req_offset(v) + v->ahash_reqsize,
+				 CRYPTO_MINALIGN);
+
+	batch = kmalloc(ALIGN(sizeof(*batch), CRYPTO_MINALIGN) + max * slot_size,
+			GFP_NOIO | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
+	if (!batch)
+		return NULL;
+
+	atomic_set(&batch->pending, 1);
+	init_completion(&batch->done);
+	batch->nr = 0;
+	batch->max = max;
+	batch->slot_size = slot_size;
+
+	return batch;
+}
+
+static void verity_batch_done(struct crypto_async_request *areq, int err)
+{
+	struct verity_batch_slot *slot = areq->data;
+	struct verity_batch *batch = slot->batch;
+
+	/* a backlogged request was started, it will complete later */
+	if (err == -EINPROGRESS)
+		return;
+
+	slot->err = err;
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+/*
+ * Start hashing the data block at io->iter.  Returns false, without
+ * consuming the block, if it is spread over too many bio segments; the
+ * caller then hashes it synchronously.
+ */
+static bool verity_batch_submit(struct dm_verity *v, struct dm_verity_io *io,
+				struct verity_batch *batch, sector_t cur_block)
+{
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	struct verity_batch_slot *slot = verity_batch_slot(batch, batch->nr);
+	struct ahash_request *req = verity_slot_req(v, slot);
+	unsigned int todo = 1 << v->data_dev_block_bits;
+	unsigned int data_sg = DM_VERITY_BATCH_SG - !!v->salt_size;
+	struct bvec_iter iter = io->iter;
+	struct scatterlist *sg = slot->sg;
+	int r;
+
+	sg_init_table(slot->sg, DM_VERITY_BATCH_SG);
+
+	if (v->salt_size && v->version >= 1)
+		sg_set_buf(sg++, v->salt, v->salt_size);
+
+	do {
+		struct bio_vec bv = bio_iter_iovec(bio, iter);
+		unsigned int len = min(bv.bv_len, todo);
+
+		if (!data_sg--)
+			return false;
+
+		sg_set_page(sg++, bv.bv_page, len, bv.bv_offset);
+		bio_advance_iter(bio, &iter, len);
+		todo -= len;
+	} while (todo);
+
+	if (v->salt_size && !v->version)
+		sg_set_buf(sg++, v->salt, v->salt_size);
+	sg_mark_end(sg - 1);
+
+	slot->batch = batch;
+	slot->block = cur_block;
+	slot->start = io->iter;
+	slot->err = 0;
+	memcpy(verity_slot_want_digest(v, slot), verity_io_want_digest(v, io),
+	       v->digest_size);
+
+	io->iter = iter;
+	batch->nr++;
+	atomic_inc(&batch->pending);
+
+	ahash_request_set_tfm(req, v->tfm);
+	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
+					CRYPTO_TFM_REQ_MAY_BACKLOG,
+				   verity_batch_done, slot);
+	ahash_request_set_crypt(req, slot->sg, verity_slot_real_digest(v, slot),
+				(1 << v->data_dev_block_bits) + v->salt_size);
+
+	r = crypto_ahash_digest(req);
+	if (r != -EINPROGRESS && r != -EBUSY)
+		verity_batch_done(&req->base, r);
+
+	return true;
+}
+
+static void verity_batch_wait(struct verity_batch *batch)
+{
+	if (!atomic_dec_and_test(&batch->pending))
+		wait_for_completion(&batch->done);
+
+	batch->nr = 0;
+	atomic_set(&batch->pending, 1);
+	reinit_completion(&batch->done);
+}
+
+/*
+ * Wait for the hashes in flight and check them in block order.
+ */
+static int verity_batch_flush(struct dm_verity *v, struct dm_verity_io *io,
+			      struct verity_batch *batch)
+{
+	unsigned i, nr = batch->nr;
+	int r;
+
+	verity_batch_wait(batch);
+
+	for (i = 0; i < nr; i++) {
+		struct verity_batch_slot *slot = verity_batch_slot(batch, i);
+
+		if (unlikely(slot->err < 0)) {
+			DMERR("verity_batch_flush crypto op failed: %d",
+			      slot->err);
+			return slot->err;
+		}
+
+		memcpy(verity_io_real_digest(v, io),
+		       verity_slot_real_digest(v, slot), v->digest_size);
+		memcpy(verity_io_want_digest(v, io),
+		       verity_slot_want_digest(v, slot), v->digest_size);
+
+		r = verity_check_data_block(v, io, slot->block, &slot->start);
+		if (unlikely(r < 0))
+			return r;
+	}
+
+	return 0;
+}
+
 /*
  * Verify one "dm_verity_io" structure.
  */
@@ -452,12 +698,16 @@ static int verity_verify_io(struct dm_verity_io *io)
 {
 	bool is_zero;
 	struct dm_verity *v = io->v;
+	struct verity_batch *batch = NULL;
 	struct bvec_iter start;
 	unsigned b;
 	struct crypto_wait wait;
+	int r = 0;
+
+	if (v->tfm_async && io->n_blocks > 1)
+		batch = verity_alloc_batch(v, io->n_blocks);
 
 	for (b = 0; b < io->n_blocks; b++) {
-		int r;
 		sector_t cur_block = io->block + b;
 		struct ahash_request *req = verity_io_hash_req(v, io);
 
@@ -471,7 +721,7 @@ static int verity_verify_io(struct dm_verity_io *io)
 					  verity_io_want_digest(v, io),
 					  &is_zero);
 		if (unlikely(r < 0))
-			return r;
+			goto out;
 
 		if (is_zero) {
 			/*
@@ -481,40 +731,159 @@ static int verity_verify_io(struct dm_verity_io *io)
 			r = verity_for_bv_block(v, io, &io->iter,
 						verity_bv_zero);
 			if (unlikely(r < 0))
-				return r;
+				goto out;
+
+			continue;
+		}
+
+		if (batch && verity_batch_submit(v, io, batch, cur_block)) {
+			if (batch->nr < batch->max)
+				continue;
+
+			r = verity_batch_flush(v, io, batch);
+			if (unlikely(r < 0))
+				goto out_free;
 
 			continue;
 		}
 
 		r = verity_hash_init(v, req, &wait);
 		if (unlikely(r < 0))
-			return r;
+			goto out;
 
 		start = io->iter;
 		r = verity_for_io_block(v, io, &io->iter, &wait);
 		if (unlikely(r < 0))
-			return r;
+			goto out;
 
 		r = verity_hash_final(v, req, verity_io_real_digest(v, io),
 					&wait);
 		if (unlikely(r < 0))
-			return r;
+			goto out;
+
+		r = verity_check_data_block(v, io, cur_block, &start);
+		if (unlikely(r < 0))
+			goto out;
+	}
+
+out:
+	if (batch) {
+		if (unlikely(r < 0))
+			verity_batch_wait(batch);
+		else
+			r = verity_batch_flush(v, io, batch);
+	}
+out_free:
+	kfree(batch);
+	return r;
+}
+
+/*
+ * Look up the digest of a data block without doing any I/O: only a hash
+ * block that is cached and already verified is used.
+ */
+static bool verity_get_cached_digest(struct dm_verity *v, sector_t block,
+				     u8 *digest)
+{
+	struct dm_buffer *buf;
+	struct buffer_aux *aux;
+	sector_t hash_block;
+	unsigned offset;
+	bool found = false;
+	u8 *data;
+
+	if (unlikely(!v->levels)) {
+		memcpy(digest, v->root_digest, v->digest_size);
+		return true;
+	}
+
+	verity_hash_at_level(v, block, 0, &hash_block, &offset);
+
+	data = dm_bufio_get(v->bufio, hash_block, &buf);
+	if (IS_ERR_OR_NULL(data))
+		return false;
+
+	aux = dm_bufio_get_aux_data(buf);
+	if (aux->hash_verified) {
+		memcpy(digest, data + offset, v->digest_size);
+		found = true;
+	}
+
+	dm_bufio_release(buf);
+	return found;
+}
 
-		if (likely(memcmp(verity_io_real_digest(v, io),
-				  verity_io_want_digest(v, io), v->digest_size) == 0)) {
-			if (v->validated_blocks)
-				set_bit(cur_block, v->validated_blocks);
+/*
+ * Called from verity_map() for "try_verify_in_completion": fetch the
+ * expected digests of a small read up front, so that verity_end_io() only
+ * has to hash the data and can skip the trip through kverityd.
+ */
+static bool verity_prepare_completion(struct dm_verity *v,
+				      struct dm_verity_io *io)
+{
+	unsigned b;
+
+	if (io->n_blocks > DM_VERITY_COMPLETION_MAX_BLOCKS)
+		return false;
+
+	for (b = 0; b < io->n_blocks; b++) {
+		sector_t cur_block = io->block + b;
+		u8 *digest = verity_io_completion_digest(v, io, b);
+
+		if (v->validated_blocks &&
+		    test_bit(cur_block, v->validated_blocks))
 			continue;
-		}
-		else if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block, NULL, &start) == 0)
+
+		if (!verity_get_cached_digest(v, cur_block, digest))
+			return false;
+
+		/* zero blocks have to be filled in, leave that to kverityd */
+		if (v->zero_digest &&
+		    !memcmp(v->zero_digest, digest, v->digest_size))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Verify a small read from bio completion, using the synchronous tfm and
+ * a request that must not sleep.  Returns false if the io has to be
+ * verified by kverityd instead, which also handles any corruption.
+ */
+static bool verity_verify_io_in_completion(struct dm_verity_io *io)
+{
+	struct dm_verity *v = io->v;
+	struct ahash_request *req = verity_io_hash_req(v, io);
+	struct bvec_iter iter = io->iter;
+	struct crypto_wait wait;
+	unsigned b;
+
+	for (b = 0; b < io->n_blocks; b++) {
+		sector_t cur_block = io->block + b;
+
+		if (v->validated_blocks &&
+		    likely(test_bit(cur_block, v->validated_blocks))) {
+			verity_bv_skip_block(v, io, &iter);
 			continue;
-		else if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block))
-			return -EIO;
+		}
+
+		if (__verity_hash_init(v, v->completion_tfm, req, 0, &wait) < 0 ||
+		    verity_for_io_block(v, io, &iter, &wait) < 0 ||
+		    verity_hash_final(v, req, verity_io_real_digest(v, io),
+				      &wait) < 0)
+			return false;
+
+		if (memcmp(verity_io_real_digest(v, io),
+			   verity_io_completion_digest(v, io, b),
+			   v->digest_size))
+			return false;
+
+		if (v->validated_blocks)
+			set_bit(cur_block, v->validated_blocks);
 	}
 
-	return 0;
+	return true;
 }
 
 /*
@@ -549,6 +918,12 @@ static void verity_end_io(struct bio *bio)
 		return;
 	}
 
+	if (io->verify_in_completion && !bio->bi_status &&
+	    verity_verify_io_in_completion(io)) {
+		verity_finish_io(io, BLK_STS_OK);
+		return;
+	}
+
 	INIT_WORK(&io->work, verity_work);
 	queue_work(io->v->verify_wq, &io->work);
 }
@@ -558,18 +933,16 @@ static void verity_end_io(struct bio *bio)
  * The root buffer is not prefetched, it is assumed that it will be cached
  * all the time.
  */
-static void verity_prefetch_io(struct work_struct *work)
+static void verity_prefetch_blocks(struct dm_verity *v, sector_t block,
+				   unsigned n_blocks)
 {
-	struct dm_verity_prefetch_work *pw =
-		container_of(work, struct dm_verity_prefetch_work, work);
-	struct dm_verity *v = pw->v;
 	int i;
 
 	for (i = v->levels - 2; i >= 0; i--) {
 		sector_t hash_block_start;
 		sector_t hash_block_end;
-		verity_hash_at_level(v, pw->block, i, &hash_block_start, NULL);
-		verity_hash_at_level(v, pw->block + pw->n_blocks - 1, i, &hash_block_end, NULL);
+		verity_hash_at_level(v, block, i, &hash_block_start, NULL);
+		verity_hash_at_level(v, block + n_blocks - 1, i, &hash_block_end, NULL);
 		if (!i) {
 			unsigned cluster = READ_ONCE(dm_verity_prefetch_cluster);
 
@@ -589,7 +962,14 @@ static void verity_prefetch_io(struct work_struct *work)
 		dm_bufio_prefetch(v->bufio, hash_block_start,
 				  hash_block_end - hash_block_start + 1);
 	}
+}
 
+static void verity_prefetch_io(struct work_struct *work)
+{
+	struct dm_verity_prefetch_work *pw =
+		container_of(work, struct dm_verity_prefetch_work, work);
+
+	verity_prefetch_blocks(pw->v, pw->block, pw->n_blocks);
 	kfree(pw);
 }
 
@@ -649,7 +1029,18 @@ static int verity_map(struct dm_target *ti, struct bio *bio)
 
 	verity_fec_init_io(io);
 
-	verity_submit_prefetch(v, io);
+	io->verify_in_completion = v->completion_tfm &&
+		verity_prepare_completion(v, io);
+
+	/*
+	 * Nobody waits for readahead, so the hash blocks it needs can be
+	 * read from here: they are then submitted together with the data
+	 * instead of after a trip through kverityd.
+	 */
+	if (bio->bi_opf & REQ_RAHEAD)
+		verity_prefetch_blocks(v, io->block, io->n_blocks);
+	else
+		verity_submit_prefetch(v, io);
 
 	generic_make_request(bio);
 
@@ -698,6 +1089,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			args++;
 		if (v->validated_blocks)
 			args++;
+		if (v->completion_tfm)
+			args++;
 		if (!args)
 			return;
 		DMEMIT(" %u", args);
@@ -718,6 +1111,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			DMEMIT(" " DM_VERITY_OPT_IGN_ZEROES);
 		if (v->validated_blocks)
 			DMEMIT(" " DM_VERITY_OPT_AT_MOST_ONCE);
+		if (v->completion_tfm)
+			DMEMIT(" " DM_VERITY_OPT_COMPLETION);
 		sz = verity_fec_status_table(v, sz, result, maxlen);
 		break;
 	}
@@ -771,6 +1166,9 @@ static void verity_dtr(struct dm_target *ti)
 	kfree(v->root_digest);
 	kfree(v->zero_digest);
 
+	if (v->completion_tfm && v->completion_tfm != v->tfm)
+		crypto_free_ahash(v->completion_tfm);
+
 	if (v->tfm)
 		crypto_free_ahash(v->tfm);
 
@@ -807,6 +1205,36 @@ static int verity_alloc_most_once(struct dm_verity *v)
 	return 0;
 }
 
+static int verity_alloc_completion_tfm(struct dm_verity *v)
+{
+	struct dm_target *ti = v->ti;
+	struct crypto_ahash *tfm;
+
+	if (v->completion_tfm)
+		return 0;
+
+	if (!v->tfm_async) {
+		v->completion_tfm = v->tfm;
+		return 0;
+	}
+
+	/*
+	 * Bio completion can't wait for an asynchronous hash, so use a
+	 * synchronous implementation of the same algorithm there.
+	 */
+	tfm = crypto_alloc_ahash(v->alg_name, 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(tfm)) {
+		ti->error = "Cannot allocate synchronous hash function";
+		return PTR_ERR(tfm);
+	}
+
+	v->completion_tfm = tfm;
+	v->ahash_reqsize = max_t(unsigned int, v->ahash_reqsize,
+				 sizeof(struct ahash_request) +
+				 crypto_ahash_reqsize(tfm));
+	return 0;
+}
+
 static int verity_alloc_zero_digest(struct dm_verity *v)
 {
 	int r = -ENOMEM;
@@ -882,6 +1310,12 @@ static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v)
 				return r;
 			continue;
 
+		} else if (!strcasecmp(arg_name, DM_VERITY_OPT_COMPLETION)) {
+			r = verity_alloc_completion_tfm(v);
+			if (r)
+				return r;
+			continue;
+
 		} else if (verity_is_fec_opt_arg(arg_name)) {
 			r = verity_fec_parse_opt_args(as, v, &argc, arg_name);
 			if (r)
@@ -1023,6 +1457,8 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 		v->tfm = NULL;
 		goto bad;
 	}
+	v->tfm_async = crypto_ahash_tfm(v->tfm)->__crt_alg->cra_flags &
+		       CRYPTO_ALG_ASYNC;
 	v->digest_size = crypto_ahash_digestsize(v->tfm);
 	if ((1 << v->hash_dev_block_bits) < v->digest_size * 2) {
 		ti->error = "Digest size too big";
@@ -1131,6 +1567,9 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 
 	ti->per_io_data_size = sizeof(struct dm_verity_io) +
 				v->ahash_reqsize + v->digest_size * 2;
+	if (v->completion_tfm)
+		ti->per_io_data_size += v->digest_size *
+					DM_VERITY_COMPLETION_MAX_BLOCKS;
 
 	r = verity_fec_ctr(v);
 	if (r)
@@ -1149,7 +1588,7 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 
 static struct target_type verity_target = {
 	.name		= "verity",
-	.version	= {1, 4, 0},
+	.version	= {1, 5, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
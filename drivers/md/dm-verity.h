@@ -38,6 +38,7 @@ struct dm_verity {
 	struct dm_bufio_client *bufio;
 	char *alg_name;
 	struct crypto_ahash *tfm;
+	struct crypto_ahash *completion_tfm; /* sync tfm for bio completion */
 	u8 *root_digest;	/* digest of the root block */
 	u8 *salt;		/* salt: its size is salt_size */
 	u8 *zero_digest;	/* digest for a zero block */
@@ -51,6 +52,7 @@ struct dm_verity {
 	unsigned char hash_per_block_bits;	/* log2(hashes in hash block) */
 	unsigned char levels;	/* the number of tree levels */
 	unsigned char version;
+	bool tfm_async;		/* tfm may complete requests asynchronously */
 	unsigned digest_size;	/* digest size for the current hash algorithm */
 	unsigned int ahash_reqsize;/* the size of temporary space for crypto */
 	int hash_failed;	/* set to 1 if hash of any block failed */
@@ -77,6 +79,9 @@ struct dm_verity_io {
 
 	struct bvec_iter iter;
 
+	/* want digests were looked up at map time, see verity_map() */
+	bool verify_in_completion;
+
 	struct work_struct work;
 
 	/*
@@ -88,6 +93,10 @@ struct dm_verity_io {
 	 *
 	 * To access them use: verity_io_hash_req(), verity_io_real_digest()
 	 * and verity_io_want_digest().
+	 *
+	 * If try_verify_in_completion is enabled, they are followed by
+	 * DM_VERITY_COMPLETION_MAX_BLOCKS digests, accessed with
+	 * verity_io_completion_digest().
 	 */
 };
 
@@ -109,6 +118,13 @@ static inline u8 *verity_io_want_digest(struct dm_verity *v,
 	return (u8 *)(io + 1) + v->ahash_reqsize + v->digest_size;
 }
 
+static inline u8 *verity_io_completion_digest(struct dm_verity *v,
+					      struct dm_verity_io *io,
+					      unsigned b)
+{
+	return (u8 *)(io + 1) + v->ahash_reqsize + v->digest_size * (2 + b);
+}
+
 static inline u8 *verity_io_digest_end(struct dm_verity *v,
 				       struct dm_verity_io *io)
 {
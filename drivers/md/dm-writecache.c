@@ -10,6 +10,7 @@
 #include <linux/init.h>
 #include <linux/vmalloc.h>
 #include <linux/kthread.h>
+#include <linux/list_sort.h>
 #include <linux/swait.h>
 #include <linux/dm-io.h>
 #include <linux/dm-kcopyd.h>
@@ -484,6 +485,7 @@ static void ssd_commit_flushed(struct dm_writecache *wc)
 {
 	struct dm_io_region region;
 	struct dm_io_request req;
+	struct blk_plug plug;
 	struct io_notify endio = {
 		wc,
 		COMPLETION_INITIALIZER_ONSTACK(endio.c),
@@ -492,6 +494,8 @@ static void ssd_commit_flushed(struct dm_writecache *wc)
 	unsigned bitmap_bits = wc->dirty_bitmap_size * BITS_PER_LONG;
 	unsigned i = 0;
 
+	/* let the dirty regions go out to the cache device as one batch */
+	blk_start_plug(&plug);
 	while (1) {
 		unsigned j;
 		i = find_next_bit(wc->dirty_bitmap, bitmap_bits, i);
@@ -521,6 +525,7 @@ static void ssd_commit_flushed(struct dm_writecache *wc)
 	        (void) dm_io(&req, 1, &region, NULL);
 		i = j;
 	}
+	blk_finish_plug(&plug);
 
 	writecache_notify_io(0, &endio);
 	wait_for_completion_io(&endio.c);
@@ -1474,6 +1479,47 @@ static void __writeback_throttle(struct dm_writecache *wc, struct writeback_list
 	cond_resched();
 }
 
+/*
+ * The writeback list is consumed from its tail. Sort it by descending
+ * origin sector, so that the origin device sees ascending writes. Runs
+ * collected separately may then be adjacent on the origin device.
+ *
+ * Sectors in the list are unique (see writecache_writeback), so the
+ * entries of each run stay together and its head still comes first.
+ */
+static int writeback_sector_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct dm_writecache *wc = priv;
+	uint64_t s1 = read_original_sector(wc, container_of(a, struct wc_entry, lru));
+	uint64_t s2 = read_original_sector(wc, container_of(b, struct wc_entry, lru));
+
+	if (s1 > s2)
+		return -1;
+	return s1 < s2;
+}
+
+/*
+ * Count the entries at the tail of the sorted list that are contiguous on
+ * the origin device and can be written back with a single bio.
+ */
+static unsigned writeback_contiguous_pmem(struct dm_writecache *wc, struct writeback_list *wbl)
+{
+	struct wc_entry *e, *f;
+	unsigned n = 1;
+
+	e = container_of(wbl->list.prev, struct wc_entry, lru);
+	while (n < BIO_MAX_PAGES && e->lru.prev != &wbl->list) {
+		f = container_of(e->lru.prev, struct wc_entry, lru);
+		if (read_original_sector(wc, f) !=
+		    read_original_sector(wc, e) + (wc->block_size >> SECTOR_SHIFT))
+			break;
+		n++;
+		e = f;
+	}
+
+	return n;
+}
+
 static void __writecache_writeback_pmem(struct dm_writecache *wc, struct writeback_list *wbl)
 {
 	struct wc_entry *e, *f;
@@ -1482,12 +1528,12 @@ static void __writecache_writeback_pmem(struct dm_writecache *wc, struct writeba
 	unsigned max_pages;
 
 	while (wbl->size) {
+		max_pages = writeback_contiguous_pmem(wc, wbl);
+
 		wbl->size--;
 		e = container_of(wbl->list.prev, struct wc_entry, lru);
 		list_del(&e->lru);
 
-		max_pages = e->wc_list_contiguous;
-
 		bio = bio_alloc_bioset(GFP_NOIO, max_pages, wc->bio_set);
 		wb = container_of(bio, struct writeback_struct, bio);
 		wb->wc = wc;
@@ -1693,6 +1739,8 @@ static void writecache_writeback(struct work_struct *work)
 
 	wc_unlock(wc);
 
+	list_sort(wc, &wbl.list, writeback_sector_cmp);
+
 	blk_start_plug(&plug);
 
 	if (WC_MODE_PMEM(wc))
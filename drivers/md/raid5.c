@@ -5557,13 +5557,103 @@ static void make_discard_request(struct mddev *mddev, struct bio *bi)
 	bio_endio(bi);
 }
 
+/*
+ * Without a reshape in progress, a request is walked one stripe at a
+ * time rather than one chunk at a time: all the data blocks of a stripe
+ * that the bio covers are visited one after the other.  They can then be
+ * added under a single stripe reference, and the stripe becomes a full
+ * stripe write (and so can be batched with its neighbours) as soon as
+ * possible.
+ *
+ * A stripe is identified by its chunk row and its offset within the
+ * chunk; its data blocks are chunk_sectors apart in the logical space.
+ */
+struct stripe_walk {
+	sector_t first;
+	sector_t last;
+	unsigned int chunk_sectors;
+	int data_disks;
+};
+
+/*
+ * Returns the lowest logical sector in the stripe at (@row, @offset), or
+ * the first stripe after it, that lies within the request.
+ */
+static sector_t stripe_walk_find(struct stripe_walk *walk,
+				 sector_t row, unsigned int offset)
+{
+	sector_t row_sectors = (sector_t)walk->chunk_sectors * walk->data_disks;
+	sector_t sector;
+	unsigned int j;
+
+	for (;;) {
+		if (offset == walk->chunk_sectors) {
+			row += row_sectors;
+			offset = 0;
+		}
+		if (row + offset >= walk->last)
+			return walk->last;
+		if (row + offset >= walk->first)
+			return row + offset;
+
+		j = DIV_ROUND_UP((unsigned int)(walk->first - row - offset),
+				 walk->chunk_sectors);
+		sector = row + (sector_t)j * walk->chunk_sectors + offset;
+		if (j < walk->data_disks && sector < walk->last)
+			return sector;
+
+		offset += STRIPE_SECTORS;
+	}
+}
+
+static sector_t stripe_walk_first(struct stripe_walk *walk)
+{
+	sector_t row = walk->first;
+
+	sector_div(row, walk->chunk_sectors * walk->data_disks);
+	return stripe_walk_find(walk,
+				row * walk->chunk_sectors * walk->data_disks, 0);
+}
+
+static sector_t stripe_walk_next(struct stripe_walk *walk, sector_t sector)
+{
+	unsigned int row_sectors = walk->chunk_sectors * walk->data_disks;
+	sector_t row = sector;
+	unsigned int offset = sector_div(row, row_sectors);
+
+	/* next data block of the same stripe */
+	if (offset / walk->chunk_sectors + 1 < walk->data_disks &&
+	    sector + walk->chunk_sectors < walk->last)
+		return sector + walk->chunk_sectors;
+
+	return stripe_walk_find(walk, row * row_sectors,
+				offset % walk->chunk_sectors + STRIPE_SECTORS);
+}
+
+static void make_request_release_stripe(struct mddev *mddev,
+					struct stripe_head *sh, struct bio *bi)
+{
+	struct r5conf *conf = mddev->private;
+
+	set_bit(STRIPE_HANDLE, &sh->state);
+	clear_bit(STRIPE_DELAYED, &sh->state);
+	if ((!sh->batch_head || sh == sh->batch_head) &&
+	    (bi->bi_opf & REQ_SYNC) &&
+	    !test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
+		atomic_inc(&conf->preread_active_stripes);
+	release_stripe_plug(mddev, sh);
+}
+
 static bool raid5_make_request(struct mddev *mddev, struct bio * bi)
 {
 	struct r5conf *conf = mddev->private;
 	int dd_idx;
 	sector_t new_sector;
 	sector_t logical_sector, last_sector;
-	struct stripe_head *sh;
+	struct stripe_head *sh, *cur_sh = NULL;
+	struct stripe_walk walk;
+	bool stripe_order;
+	int cur_seq = 0;
 	const int rw = bio_data_dir(bi);
 	DEFINE_WAIT(w);
 	bool do_prepare;
@@ -5610,8 +5700,25 @@ static bool raid5_make_request(struct mddev *mddev, struct bio * bi)
 	last_sector = bio_end_sector(bi);
 	bi->bi_next = NULL;
 
+	/*
+	 * The walk only decides the order in which sectors are visited, so
+	 * it stays valid even if a reshape starts while we're in the loop.
+	 */
+	stripe_order = conf->reshape_progress == MaxSector &&
+		last_sector - logical_sector > STRIPE_SECTORS;
+	if (stripe_order) {
+		walk.first = logical_sector;
+		walk.last = last_sector;
+		walk.chunk_sectors = conf->chunk_sectors;
+		walk.data_disks = conf->raid_disks - conf->max_degraded;
+		logical_sector = stripe_walk_first(&walk);
+	}
+
 	prepare_to_wait(&conf->wait_for_overlap, &w, TASK_UNINTERRUPTIBLE);
-	for (;logical_sector < last_sector; logical_sector += STRIPE_SECTORS) {
+	for (; logical_sector < last_sector;
+	     logical_sector = stripe_order ?
+		stripe_walk_next(&walk, logical_sector) :
+		logical_sector + STRIPE_SECTORS) {
 		int previous;
 		int seq;
 
@@ -5623,6 +5730,11 @@ static bool raid5_make_request(struct mddev *mddev, struct bio * bi)
 			prepare_to_wait(&conf->wait_for_overlap, &w,
 				TASK_UNINTERRUPTIBLE);
 		if (unlikely(conf->reshape_progress != MaxSector)) {
+			/* never sleep holding a stripe */
+			if (cur_sh) {
+				make_request_release_stripe(mddev, cur_sh, bi);
+				cur_sh = NULL;
+			}
 			/* spinlock is needed as reshape_progress may be
 			 * 64bit on a 32bit platform, and so it might be
 			 * possible to see a half-updated value
@@ -5656,9 +5768,34 @@ static bool raid5_make_request(struct mddev *mddev, struct bio * bi)
 			(unsigned long long)new_sector,
 			(unsigned long long)logical_sector);
 
-		sh = raid5_get_active_stripe(conf, new_sector, previous,
-				       (bi->bi_opf & REQ_RAHEAD), 0);
-		if (sh) {
+		/*
+		 * The previous data block may have been in the same stripe,
+		 * in which case we still hold it.
+		 */
+		if (cur_sh && (previous || cur_seq != seq ||
+			       cur_sh->sector != new_sector)) {
+			make_request_release_stripe(mddev, cur_sh, bi);
+			cur_sh = NULL;
+		}
+
+		if (cur_sh)
+			sh = cur_sh;
+		else
+			sh = raid5_get_active_stripe(conf, new_sector, previous,
+					(bi->bi_opf & REQ_RAHEAD), 0);
+		if (sh && sh == cur_sh) {
+			cur_sh = NULL;
+			if (test_bit(STRIPE_EXPANDING, &sh->state) ||
+			    !add_stripe_bio(sh, bi, dd_idx, rw, previous)) {
+				make_request_release_stripe(mddev, sh, bi);
+				md_wakeup_thread(mddev->thread);
+				schedule();
+				do_prepare = true;
+				goto retry;
+			}
+			cur_sh = sh;
+			cur_seq = seq;
+		} else if (sh) {
 			if (unlikely(previous)) {
 				/* expansion might have moved on while waiting for a
 				 * stripe, so we must do the range check again.
@@ -5709,19 +5846,19 @@ static bool raid5_make_request(struct mddev *mddev, struct bio * bi)
 				do_flush = false;
 			}
 
-			set_bit(STRIPE_HANDLE, &sh->state);
-			clear_bit(STRIPE_DELAYED, &sh->state);
-			if ((!sh->batch_head || sh == sh->batch_head) &&
-			    (bi->bi_opf & REQ_SYNC) &&
-			    !test_and_set_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
-				atomic_inc(&conf->preread_active_stripes);
-			release_stripe_plug(mddev, sh);
+			if (stripe_order && !previous) {
+				cur_sh = sh;
+				cur_seq = seq;
+			} else
+				make_request_release_stripe(mddev, sh, bi);
 		} else {
 			/* cannot get stripe for read-ahead, just give-up */
 			bi->bi_status = BLK_STS_IOERR;
 			break;
 		}
 	}
+	if (cur_sh)
+		make_request_release_stripe(mddev, cur_sh, bi);
 	finish_wait(&conf->wait_for_overlap, &w);
 
 	if (rw == WRITE)
@@ -27,6 +27,7 @@
 #include <linux/list.h>
 #include <linux/hyperv.h>
 #include <linux/rndis.h>
+#include <net/xdp.h>
 
 /* RSS related */
 #define OID_GEN_RECEIVE_SCALE_CAPABILITIES 0x00010203  /* query only */
@@ -210,6 +211,12 @@ int netvsc_recv_callback(struct net_device *net,
 void netvsc_channel_cb(void *context);
 int netvsc_poll(struct napi_struct *napi, int budget);
 
+u32 netvsc_run_xdp(struct net_device *ndev, struct netvsc_channel *nvchan,
+		   struct xdp_buff *xdp, void *data, u32 len);
+void netvsc_xdp_set(struct netvsc_device *nvdev, struct bpf_prog *prog);
+int netvsc_vf_setxdp(struct net_device *vf_netdev, struct bpf_prog *prog);
+int netvsc_bpf(struct net_device *dev, struct netdev_bpf *bpf);
+
 void rndis_set_subchannel(struct work_struct *w);
 int rndis_filter_open(struct netvsc_device *nvdev);
 int rndis_filter_close(struct netvsc_device *nvdev);
@@ -800,6 +807,14 @@ struct nvsp_message {
 #define NETVSC_MTU 65535
 #define NETVSC_MTU_MIN ETH_MIN_MTU
 
+/* Headroom left in front of a frame copied out for XDP */
+#define NETVSC_XDP_HDRM 256
+/* Largest frame that fits one page along with the XDP headroom and the
+ * skb_shared_info that build_skb() puts at the end of it.
+ */
+#define NETVSC_XDP_MAX_FRAME (PAGE_SIZE - NETVSC_XDP_HDRM - \
+			      SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+
 /* Max buffer sizes allowed by a host */
 #define NETVSC_RECEIVE_BUFFER_SIZE		(1024 * 1024 * 31) /* 31MB */
 #define NETVSC_RECEIVE_BUFFER_SIZE_LEGACY	(1024 * 1024 * 15) /* 15MB */
@@ -857,6 +872,7 @@ struct netvsc_stats {
 	u64 bytes;
 	u64 broadcast;
 	u64 multicast;
+	u64 xdp_drop;
 	struct u64_stats_sync syncp;
 };
 
@@ -931,6 +947,9 @@ struct net_device_context {
 	u32 vf_alloc;
 	/* Serial number of the VF to team with */
 	u32 vf_serial;
+
+	/* XDP program attached to the device, protected by RTNL */
+	struct bpf_prog *xdp_prog;
 };
 
 /* Per channel data */
@@ -943,6 +962,10 @@ struct netvsc_channel {
 	struct multi_recv_comp mrc;
 	atomic_t queue_sends;
 
+	struct bpf_prog __rcu *bpf_prog;
+	struct xdp_rxq_info xdp_rxq;
+	bool xdp_flush;
+
 	struct netvsc_stats tx_stats;
 	struct netvsc_stats rx_stats;
 };
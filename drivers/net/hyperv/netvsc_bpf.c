@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XDP support for the Hyper-V synthetic network device.
+ *
+ * The receive buffer is shared with the host and has to be returned
+ * through a receive completion, so frames are copied into a private
+ * page before the program runs.  On XDP_PASS and XDP_TX that same page
+ * becomes the skb head, so the frame is still copied only once.
+ */
+#include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/skbuff.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/rtnetlink.h>
+#include <net/xdp.h>
+#include <trace/events/xdp.h>
+
+#include "hyperv_net.h"
+
+u32 netvsc_run_xdp(struct net_device *ndev, struct netvsc_channel *nvchan,
+		   struct xdp_buff *xdp, void *data, u32 len)
+{
+	struct page *page = NULL;
+	struct bpf_prog *prog;
+	u32 act = XDP_PASS;
+
+	xdp->data_hard_start = NULL;
+
+	rcu_read_lock();
+	prog = rcu_dereference(nvchan->bpf_prog);
+	if (!prog)
+		goto out;
+
+	/* The MTU is limited while a program is attached */
+	if (unlikely(len > NETVSC_XDP_MAX_FRAME)) {
+		act = XDP_DROP;
+		goto out;
+	}
+
+	page = alloc_page(GFP_ATOMIC);
+	if (!page) {
+		act = XDP_DROP;
+		goto out;
+	}
+
+	xdp->data_hard_start = page_address(page);
+	xdp->data = xdp->data_hard_start + NETVSC_XDP_HDRM;
+	xdp_set_data_meta_invalid(xdp);
+	xdp->data_end = xdp->data + len;
+	xdp->rxq = &nvchan->xdp_rxq;
+	xdp->handle = 0;
+
+	memcpy(xdp->data, data, len);
+
+	act = bpf_prog_run_xdp(prog, xdp);
+
+	switch (act) {
+	case XDP_PASS:
+	case XDP_TX:
+	case XDP_DROP:
+		break;
+
+	case XDP_REDIRECT:
+		if (!xdp_do_redirect(ndev, xdp, prog)) {
+			/* The page now belongs to the redirect target */
+			nvchan->xdp_flush = true;
+			page = NULL;
+			break;
+		}
+		trace_xdp_exception(ndev, prog, act);
+		act = XDP_DROP;
+		break;
+
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_ABORTED:
+		trace_xdp_exception(ndev, prog, act);
+		act = XDP_DROP;
+		break;
+	}
+
+out:
+	rcu_read_unlock();
+
+	if (act != XDP_PASS && act != XDP_TX) {
+		if (page)
+			__free_page(page);
+		xdp->data_hard_start = NULL;
+	}
+
+	return act;
+}
+
+/* Publish @prog to every channel of @nvdev.  The channels do not hold
+ * references of their own: the one owned by the net_device_context is
+ * only dropped after the pointers are replaced, and bpf_prog_put()
+ * defers the free past an RCU grace period.
+ */
+void netvsc_xdp_set(struct netvsc_device *nvdev, struct bpf_prog *prog)
+{
+	int i;
+
+	for (i = 0; i < VRSS_CHANNEL_MAX; i++)
+		rcu_assign_pointer(nvdev->chan_table[i].bpf_prog, prog);
+}
+
+int netvsc_vf_setxdp(struct net_device *vf_netdev, struct bpf_prog *prog)
+{
+	struct netdev_bpf xdp;
+	bpf_op_t ndo_bpf;
+	int ret;
+
+	ASSERT_RTNL();
+
+	if (!vf_netdev)
+		return 0;
+
+	ndo_bpf = vf_netdev->netdev_ops->ndo_bpf;
+	if (!ndo_bpf)
+		return 0;
+
+	if (prog) {
+		prog = bpf_prog_inc(prog);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	memset(&xdp, 0, sizeof(xdp));
+	xdp.command = XDP_SETUP_PROG;
+	xdp.prog = prog;
+
+	ret = ndo_bpf(vf_netdev, &xdp);
+	if (ret && prog)
+		bpf_prog_put(prog);
+
+	return ret;
+}
+
+static int netvsc_xdp_setup(struct net_device *dev, struct bpf_prog *prog,
+			    struct netlink_ext_ack *extack)
+{
+	struct net_device_context *ndev_ctx = netdev_priv(dev);
+	struct netvsc_device *nvdev = rtnl_dereference(ndev_ctx->nvdev);
+	struct net_device *vf_netdev = rtnl_dereference(ndev_ctx->vf_netdev);
+	struct bpf_prog *old_prog;
+	int ret;
+
+	if (prog) {
+		if (!nvdev || nvdev->destroy)
+			return -ENODEV;
+
+		if (dev->mtu + ETH_HLEN > NETVSC_XDP_MAX_FRAME) {
+			netdev_err(dev, "XDP: mtu %u too large\n", dev->mtu);
+			NL_SET_ERR_MSG_MOD(extack, "XDP: mtu too large");
+			return -EOPNOTSUPP;
+		}
+	}
+
+	/* Traffic moves to the VF once it is up, so it runs the program too */
+	ret = netvsc_vf_setxdp(vf_netdev, prog);
+	if (ret && prog) {
+		netdev_err(dev, "XDP: setting prog on VF failed: %d\n", ret);
+		NL_SET_ERR_MSG_MOD(extack, "XDP: setting prog on VF failed");
+		return ret;
+	}
+
+	old_prog = ndev_ctx->xdp_prog;
+	ndev_ctx->xdp_prog = prog;
+
+	if (nvdev)
+		netvsc_xdp_set(nvdev, prog);
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+int netvsc_bpf(struct net_device *dev, struct netdev_bpf *bpf)
+{
+	struct net_device_context *ndev_ctx = netdev_priv(dev);
+
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		return netvsc_xdp_setup(dev, bpf->prog, bpf->extack);
+	case XDP_QUERY_PROG:
+		bpf->prog_id = ndev_ctx->xdp_prog ?
+			       ndev_ctx->xdp_prog->aux->id : 0;
+		bpf->prog_attached = bpf->prog_id ? XDP_ATTACHED_DRV :
+						    XDP_ATTACHED_NONE;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
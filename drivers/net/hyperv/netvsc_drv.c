@@ -35,6 +35,7 @@
 #include <linux/slab.h>
 #include <linux/rtnetlink.h>
 #include <linux/netpoll.h>
+#include <linux/bpf.h>
 
 #include <net/arp.h>
 #include <net/route.h>
@@ -506,7 +507,8 @@ static int netvsc_vf_xmit(struct net_device *net, struct net_device *vf_netdev,
 	return rc;
 }
 
-static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
+static int netvsc_xmit(struct sk_buff *skb, struct net_device *net,
+		       bool xdp_tx)
 {
 	struct net_device_context *net_device_ctx = netdev_priv(net);
 	struct hv_netvsc_packet *packet = NULL;
@@ -520,10 +522,11 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 
 	/* if VF is present and up then redirect packets
 	 * already called with rcu_read_lock_bh
+	 * XDP_TX goes back out the synthetic path it arrived on
 	 */
 	vf_netdev = rcu_dereference_bh(net_device_ctx->vf_netdev);
 	if (vf_netdev && netif_running(vf_netdev) &&
-	    !netpoll_tx_running(net))
+	    !netpoll_tx_running(net) && !xdp_tx)
 		return netvsc_vf_xmit(net, vf_netdev, skb);
 
 	/* We will atmost need two pages to describe the rndis
@@ -696,6 +699,36 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 	goto drop;
 }
 
+static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
+{
+	return netvsc_xmit(skb, net, false);
+}
+
+/* Send a frame the XDP program bounced with XDP_TX.  This runs from the
+ * receive NAPI context, so take the queue lock the stack would hold.
+ */
+static void netvsc_xdp_xmit(struct sk_buff *skb, struct net_device *ndev,
+			    u16 q_idx)
+{
+	struct netdev_queue *txq;
+	int rc = NETDEV_TX_BUSY;
+
+	skb_set_queue_mapping(skb, q_idx);
+	__skb_push(skb, ETH_HLEN);
+
+	txq = netdev_get_tx_queue(ndev, q_idx);
+	__netif_tx_lock(txq, smp_processor_id());
+	if (!netif_xmit_frozen_or_stopped(txq))
+		rc = netvsc_xmit(skb, ndev, true);
+	__netif_tx_unlock(txq);
+
+	if (dev_xmit_complete(rc))
+		return;
+
+	dev_kfree_skb_any(skb);
+	ndev->stats.tx_dropped++;
+}
+
 /*
  * netvsc_linkstatus_callback - Link up/down notification
  */
@@ -740,21 +773,34 @@ void netvsc_linkstatus_callback(struct net_device *net,
 
 static struct sk_buff *netvsc_alloc_recv_skb(struct net_device *net,
 					     struct napi_struct *napi,
+					     struct xdp_buff *xdp,
 					     const struct ndis_tcp_ip_checksum_info *csum_info,
 					     const struct ndis_pkt_8021q_info *vlan,
 					     void *data, u32 buflen)
 {
 	struct sk_buff *skb;
 
-	skb = napi_alloc_skb(napi, buflen);
-	if (!skb)
-		return skb;
+	if (xdp->data_hard_start) {
+		/* XDP already copied the frame out, build the skb around it */
+		skb = build_skb(xdp->data_hard_start, PAGE_SIZE);
+		if (!skb) {
+			__free_page(virt_to_page(xdp->data_hard_start));
+			return NULL;
+		}
 
-	/*
-	 * Copy to skb. This copy is needed here since the memory pointed by
-	 * hv_netvsc_packet cannot be deallocated
-	 */
-	skb_put_data(skb, data, buflen);
+		skb_reserve(skb, xdp->data - xdp->data_hard_start);
+		skb_put(skb, xdp->data_end - xdp->data);
+	} else {
+		skb = napi_alloc_skb(napi, buflen);
+		if (!skb)
+			return skb;
+
+		/*
+		 * Copy to skb. This copy is needed here since the memory
+		 * pointed by hv_netvsc_packet cannot be deallocated
+		 */
+		skb_put_data(skb, data, buflen);
+	}
 
 	skb->protocol = eth_type_trans(skb, net);
 
@@ -795,14 +841,32 @@ int netvsc_recv_callback(struct net_device *net,
 	struct net_device_context *net_device_ctx = netdev_priv(net);
 	u16 q_idx = channel->offermsg.offer.sub_channel_index;
 	struct netvsc_channel *nvchan = &net_device->chan_table[q_idx];
+	struct netvsc_stats *rx_stats = &nvchan->rx_stats;
+	struct xdp_buff xdp;
 	struct sk_buff *skb;
-	struct netvsc_stats *rx_stats;
+	u32 act;
 
 	if (net->reg_state != NETREG_REGISTERED)
 		return NVSP_STAT_FAIL;
 
+	act = netvsc_run_xdp(net, nvchan, &xdp, data, len);
+
+	if (act != XDP_PASS && act != XDP_TX) {
+		if (act == XDP_DROP) {
+			u64_stats_update_begin(&rx_stats->syncp);
+			rx_stats->xdp_drop++;
+			u64_stats_update_end(&rx_stats->syncp);
+		}
+
+		/* The frame was consumed, the receive buffer can go back */
+		return NVSP_STAT_SUCCESS;
+	}
+
+	if (xdp.data_hard_start)
+		len = xdp.data_end - xdp.data;
+
 	/* Allocate a skb - TODO direct I/O to pages? */
-	skb = netvsc_alloc_recv_skb(net, &nvchan->napi,
+	skb = netvsc_alloc_recv_skb(net, &nvchan->napi, &xdp,
 				    csum_info, vlan, data, len);
 	if (unlikely(!skb)) {
 		++net_device_ctx->eth_stats.rx_no_memory;
@@ -810,6 +874,11 @@ int netvsc_recv_callback(struct net_device *net,
 		return NVSP_STAT_FAIL;
 	}
 
+	if (act == XDP_TX) {
+		netvsc_xdp_xmit(skb, net, q_idx);
+		return NVSP_STAT_SUCCESS;
+	}
+
 	skb_record_rx_queue(skb, q_idx);
 
 	/*
@@ -817,7 +886,6 @@ int netvsc_recv_callback(struct net_device *net,
 	 * on the synthetic device because modifying the VF device
 	 * statistics will not work correctly.
 	 */
-	rx_stats = &nvchan->rx_stats;
 	u64_stats_update_begin(&rx_stats->syncp);
 	rx_stats->packets++;
 	rx_stats->bytes += len;
@@ -1033,6 +1101,11 @@ static int netvsc_change_mtu(struct net_device *ndev, int mtu)
 	if (!nvdev || nvdev->destroy)
 		return -ENODEV;
 
+	if (ndevctx->xdp_prog && mtu + ETH_HLEN > NETVSC_XDP_MAX_FRAME) {
+		netdev_err(ndev, "XDP: mtu %d too large\n", mtu);
+		return -EOPNOTSUPP;
+	}
+
 	/* Change MTU of underlying VF netdev first. */
 	if (vf_netdev) {
 		ret = dev_set_mtu(vf_netdev, mtu);
@@ -1210,8 +1283,8 @@ static const struct {
 #define NETVSC_GLOBAL_STATS_LEN	ARRAY_SIZE(netvsc_stats)
 #define NETVSC_VF_STATS_LEN	ARRAY_SIZE(vf_stats)
 
-/* 4 statistics per queue (rx/tx packets/bytes) */
-#define NETVSC_QUEUE_STATS_LEN(dev) ((dev)->num_chn * 4)
+/* 5 statistics per queue (rx/tx packets/bytes, rx xdp_drop) */
+#define NETVSC_QUEUE_STATS_LEN(dev) ((dev)->num_chn * 5)
 
 static int netvsc_get_sset_count(struct net_device *dev, int string_set)
 {
@@ -1240,7 +1313,7 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 	const struct netvsc_stats *qstats;
 	struct netvsc_vf_pcpu_stats sum;
 	unsigned int start;
-	u64 packets, bytes;
+	u64 packets, bytes, xdp_drop;
 	int i, j;
 
 	if (!nvdev)
@@ -1269,9 +1342,11 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 			start = u64_stats_fetch_begin_irq(&qstats->syncp);
 			packets = qstats->packets;
 			bytes = qstats->bytes;
+			xdp_drop = qstats->xdp_drop;
 		} while (u64_stats_fetch_retry_irq(&qstats->syncp, start));
 		data[i++] = packets;
 		data[i++] = bytes;
+		data[i++] = xdp_drop;
 	}
 }
 
@@ -1306,6 +1381,8 @@ static void netvsc_get_strings(struct net_device *dev, u32 stringset, u8 *data)
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "rx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
+			sprintf(p, "rx_queue_%u_xdp_drop", i);
+			p += ETH_GSTRING_LEN;
 		}
 
 		break;
@@ -1664,6 +1741,7 @@ static const struct net_device_ops device_ops = {
 	.ndo_set_mac_address =		netvsc_set_mac_addr,
 	.ndo_select_queue =		netvsc_select_queue,
 	.ndo_get_stats64 =		netvsc_get_stats64,
+	.ndo_bpf =			netvsc_bpf,
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller =		netvsc_poll_controller,
 #endif
@@ -1882,6 +1960,7 @@ static int netvsc_vf_join(struct net_device *vf_netdev,
 static void __netvsc_vf_setup(struct net_device *ndev,
 			      struct net_device *vf_netdev)
 {
+	struct net_device_context *ndev_ctx = netdev_priv(ndev);
 	int ret;
 
 	/* Align MTU of VF with master */
@@ -1890,6 +1969,12 @@ static void __netvsc_vf_setup(struct net_device *ndev,
 		netdev_warn(vf_netdev,
 			    "unable to change mtu to %u\n", ndev->mtu);
 
+	/* Hand the synthetic device's XDP program to the VF */
+	ret = netvsc_vf_setxdp(vf_netdev, ndev_ctx->xdp_prog);
+	if (ret)
+		netdev_warn(vf_netdev,
+			    "unable to set XDP program: %d\n", ret);
+
 	/* set multicast etc flags on VF */
 	dev_change_flags(vf_netdev, ndev->flags | IFF_SLAVE);
 
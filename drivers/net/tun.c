@@ -1284,34 +1284,45 @@ static const struct net_device_ops tun_netdev_ops = {
 	.ndo_get_stats64	= tun_net_get_stats64,
 };
 
-static int tun_xdp_xmit(struct net_device *dev, struct xdp_frame *frame)
+static int tun_xdp_xmit(struct net_device *dev, int n,
+			struct xdp_frame **frames)
 {
 	struct tun_struct *tun = netdev_priv(dev);
 	struct tun_file *tfile;
 	u32 numqueues;
-	int ret = 0;
+	int drops = 0;
+	int i;
 
 	rcu_read_lock();
 
 	numqueues = READ_ONCE(tun->numqueues);
 	if (!numqueues) {
-		ret = -ENOSPC;
-		goto out;
+		rcu_read_unlock();
+		return -ENXIO; /* Caller will free/return all frames */
 	}
 
 	tfile = rcu_dereference(tun->tfiles[smp_processor_id() %
 					    numqueues]);
-	/* Encode the XDP flag into lowest bit for consumer to differ
-	 * XDP buffer from sk_buff.
-	 */
-	if (ptr_ring_produce(&tfile->tx_ring, tun_xdp_to_ptr(frame))) {
-		this_cpu_inc(tun->pcpu_stats->tx_dropped);
-		ret = -ENOSPC;
+
+	/* One producer lock round trip for the whole bulk */
+	spin_lock(&tfile->tx_ring.producer_lock);
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdp = frames[i];
+		/* Encode the XDP flag into lowest bit for consumer to differ
+		 * XDP buffer from sk_buff.
+		 */
+		void *frame = tun_xdp_to_ptr(xdp);
+
+		if (__ptr_ring_produce(&tfile->tx_ring, frame)) {
+			this_cpu_inc(tun->pcpu_stats->tx_dropped);
+			xdp_return_frame(xdp);
+			drops++;
+		}
 	}
+	spin_unlock(&tfile->tx_ring.producer_lock);
 
-out:
 	rcu_read_unlock();
-	return ret;
+	return n - drops;
 }
 
 static int tun_xdp_tx(struct net_device *dev, struct xdp_buff *xdp)
@@ -1321,7 +1332,7 @@ static int tun_xdp_tx(struct net_device *dev, struct xdp_buff *xdp)
 	if (unlikely(!frame))
 		return -EOVERFLOW;
 
-	return tun_xdp_xmit(dev, frame);
+	return tun_xdp_xmit(dev, 1, &frame);
 }
 
 static void tun_xdp_flush(struct net_device *dev)
@@ -1682,7 +1693,7 @@ static struct sk_buff *tun_build_skb(struct tun_struct *tun,
 		case XDP_TX:
 			get_page(alloc_frag->page);
 			alloc_frag->offset += buflen;
-			if (tun_xdp_tx(tun->dev, &xdp))
+			if (tun_xdp_tx(tun->dev, &xdp) < 0)
 				goto err_redirect;
 			tun_xdp_flush(tun->dev);
 			rcu_read_unlock();
@@ -2381,18 +2392,162 @@ static void tun_sock_write_space(struct sock *sk)
 	kill_fasync(&tfile->fasync, SIGIO, POLL_OUT);
 }
 
+#define TUN_XDP_FLUSH_REDIRECT	0x1
+#define TUN_XDP_FLUSH_TX	0x2
+
+/* Receive one packet of a TUN_MSG_PTR batch. The xdp_buff was built by
+ * vhost-net in a page fragment we now own, with a struct tun_xdp_hdr at
+ * data_hard_start. Called with bh disabled and under rcu_read_lock().
+ */
+static int tun_xdp_one(struct tun_struct *tun, struct tun_file *tfile,
+		       struct xdp_buff *xdp, int *flush)
+{
+	struct tun_xdp_hdr *hdr = xdp->data_hard_start;
+	struct virtio_net_hdr *gso = &hdr->gso;
+	struct tun_pcpu_stats *stats;
+	struct bpf_prog *xdp_prog;
+	struct sk_buff *skb;
+	bool skb_xdp = false;
+	u32 rxhash = 0;
+	int err = 0;
+	u32 act;
+
+	if (unlikely(!(tun->dev->flags & IFF_UP))) {
+		err = -EIO;
+		goto drop;
+	}
+
+	xdp_prog = rcu_dereference(tun->xdp_prog);
+	if (xdp_prog) {
+		/* Leave gso packets to generic XDP, as tun_build_skb() does */
+		if (gso->gso_type) {
+			skb_xdp = true;
+			goto build;
+		}
+
+		xdp_set_data_meta_invalid(xdp);
+		xdp->rxq = &tfile->xdp_rxq;
+		act = bpf_prog_run_xdp(xdp_prog, xdp);
+
+		switch (act) {
+		case XDP_REDIRECT:
+			err = xdp_do_redirect(tun->dev, xdp, xdp_prog);
+			if (err)
+				goto drop;
+			*flush |= TUN_XDP_FLUSH_REDIRECT;
+			return 0;
+		case XDP_TX:
+			err = tun_xdp_tx(tun->dev, xdp);
+			if (err < 0)
+				goto drop;
+			*flush |= TUN_XDP_FLUSH_TX;
+			return 0;
+		case XDP_PASS:
+			break;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			/* fall through */
+		case XDP_ABORTED:
+			trace_xdp_exception(tun->dev, xdp_prog, act);
+			/* fall through */
+		case XDP_DROP:
+			goto drop;
+		}
+	}
+
+build:
+	skb = build_skb(xdp->data_hard_start, hdr->buflen);
+	if (!skb) {
+		err = -ENOMEM;
+		goto drop;
+	}
+
+	skb_reserve(skb, xdp->data - xdp->data_hard_start);
+	skb_put(skb, xdp->data_end - xdp->data);
+
+	if (virtio_net_hdr_to_skb(skb, gso, tun_is_little_endian(tun))) {
+		this_cpu_inc(tun->pcpu_stats->rx_frame_errors);
+		kfree_skb(skb);
+		return -EINVAL;
+	}
+
+	skb->protocol = eth_type_trans(skb, tun->dev);
+	skb_reset_network_header(skb);
+	skb_probe_transport_header(skb, 0);
+
+	if (skb_xdp) {
+		err = do_xdp_generic(xdp_prog, skb);
+		if (err != XDP_PASS)
+			return 0;
+	}
+
+	if (!rcu_access_pointer(tun->steering_prog) && tun->numqueues > 1 &&
+	    !tfile->detached)
+		rxhash = __skb_get_hash_symmetric(skb);
+
+	stats = get_cpu_ptr(tun->pcpu_stats);
+	u64_stats_update_begin(&stats->syncp);
+	stats->rx_packets++;
+	stats->rx_bytes += skb->len;
+	u64_stats_update_end(&stats->syncp);
+	put_cpu_ptr(stats);
+
+	netif_receive_skb(skb);
+
+	if (rxhash)
+		tun_flow_update(tun, rxhash, tfile);
+
+	return 0;
+
+drop:
+	this_cpu_inc(tun->pcpu_stats->rx_dropped);
+	put_page(virt_to_head_page(xdp->data));
+	return err;
+}
+
 static int tun_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 {
 	int ret;
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = tun_get(tfile);
+	struct tun_msg_ctl *ctl = m->msg_control;
+	struct xdp_buff *xdp = NULL;
+	int flush = 0;
+	int i;
 
-	if (!tun)
+	if (ctl && ctl->type == TUN_MSG_PTR)
+		xdp = ctl->ptr;
+
+	if (!tun) {
+		/* A batch is always consumed, even on error */
+		for (i = 0; xdp && i < ctl->num; i++)
+			put_page(virt_to_head_page(xdp[i].data));
 		return -EBADFD;
+	}
 
-	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
+	if (xdp) {
+		local_bh_disable();
+		rcu_read_lock();
+
+		for (i = 0; i < ctl->num; i++)
+			tun_xdp_one(tun, tfile, &xdp[i], &flush);
+
+		if (flush & TUN_XDP_FLUSH_REDIRECT)
+			xdp_do_flush_map();
+		if (flush & TUN_XDP_FLUSH_TX)
+			tun_xdp_flush(tun->dev);
+
+		rcu_read_unlock();
+		local_bh_enable();
+
+		ret = total_len;
+		goto out;
+	}
+
+	ret = tun_get_user(tun, tfile, ctl ? ctl->ptr : NULL, &m->msg_iter,
 			   m->msg_flags & MSG_DONTWAIT,
 			   m->msg_flags & MSG_MORE);
+out:
 	tun_put(tun);
 	return ret;
 }
@@ -30,6 +30,7 @@
 #include <linux/cpu.h>
 #include <linux/average.h>
 #include <linux/filter.h>
+#include <linux/net_dim.h>
 #include <net/route.h>
 #include <net/xdp.h>
 
@@ -99,6 +100,12 @@ static const struct virtnet_stat_desc virtnet_rq_stats_desc[] = {
 #define VIRTNET_SQ_STATS_LEN	ARRAY_SIZE(virtnet_sq_stats_desc)
 #define VIRTNET_RQ_STATS_LEN	ARRAY_SIZE(virtnet_rq_stats_desc)
 
+/* Notification coalescing parameters last accepted by the device */
+struct virtnet_interrupt_coalesce {
+	u32 max_packets;
+	u32 max_usecs;
+};
+
 /* Internal representation of a send virtqueue */
 struct send_queue {
 	/* Virtqueue associated with this send _queue */
@@ -113,6 +120,13 @@ struct send_queue {
 	struct virtnet_sq_stats stats;
 
 	struct napi_struct napi;
+
+	/* Number of TX notifications, sampled by net_dim */
+	u16 calls;
+
+	struct net_dim dim;
+
+	struct virtnet_interrupt_coalesce intr_coal;
 };
 
 /* Internal representation of a receive virtqueue */
@@ -126,6 +140,13 @@ struct receive_queue {
 
 	struct virtnet_rq_stats stats;
 
+	/* Number of RX notifications, sampled by net_dim */
+	u16 calls;
+
+	struct net_dim dim;
+
+	struct virtnet_interrupt_coalesce intr_coal;
+
 	/* Chain pages by the private ptr. */
 	struct page *pages;
 
@@ -156,6 +177,9 @@ struct control_buf {
 	u8 allmulti;
 	__virtio16 vid;
 	__virtio64 offloads;
+	struct virtio_net_ctrl_coal_tx coal_tx;
+	struct virtio_net_ctrl_coal_rx coal_rx;
+	struct virtio_net_ctrl_coal_vq coal_vq;
 };
 
 struct virtnet_info {
@@ -209,6 +233,14 @@ struct virtnet_info {
 	u8 duplex;
 	u32 speed;
 
+	/* Device-wide notification coalescing, see VIRTIO_NET_F_NOTF_COAL */
+	struct virtnet_interrupt_coalesce intr_coal_tx;
+	struct virtnet_interrupt_coalesce intr_coal_rx;
+
+	/* Adaptive coalescing driven by net_dim, protected by rtnl */
+	bool rx_dim_enabled;
+	bool tx_dim_enabled;
+
 	unsigned long guest_offloads;
 };
 
@@ -308,6 +340,8 @@ static void skb_xmit_done(struct virtqueue *vq)
 	/* Suppress further interrupts. */
 	virtqueue_disable_cb(vq);
 
+	vi->sq[vq2txq(vq)].calls++;
+
 	if (napi->weight)
 		virtqueue_napi_schedule(napi, vq);
 	else
@@ -459,11 +493,15 @@ static int __virtnet_xdp_xmit(struct virtnet_info *vi,
 	return 0;
 }
 
-static int virtnet_xdp_xmit(struct net_device *dev, struct xdp_frame *xdpf)
+static int virtnet_xdp_xmit(struct net_device *dev,
+			    int n, struct xdp_frame **frames)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
 	struct receive_queue *rq = vi->rq;
 	struct bpf_prog *xdp_prog;
+	int drops = 0;
+	int err;
+	int i;
 
 	/* Only allow ndo_xdp_xmit if XDP is loaded on dev, as this
 	 * indicate XDP resources have been successfully allocated.
@@ -472,7 +510,17 @@ static int virtnet_xdp_xmit(struct net_device *dev, struct xdp_frame *xdpf)
 	if (!xdp_prog)
 		return -ENXIO;
 
-	return __virtnet_xdp_xmit(vi, xdpf);
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdpf = frames[i];
+
+		err = __virtnet_xdp_xmit(vi, xdpf);
+		if (err) {
+			xdp_return_frame(xdpf);
+			drops++;
+		}
+	}
+
+	return n - drops;
 }
 
 static unsigned int virtnet_get_headroom(struct virtnet_info *vi)
@@ -1137,6 +1185,7 @@ static void skb_recv_done(struct virtqueue *rvq)
 	struct virtnet_info *vi = rvq->vdev->priv;
 	struct receive_queue *rq = &vi->rq[vq2rxq(rvq)];
 
+	rq->calls++;
 	virtqueue_napi_schedule(&rq->napi, rvq);
 }
 
@@ -1281,6 +1330,20 @@ static void virtnet_poll_cleantx(struct receive_queue *rq)
 		netif_tx_wake_queue(txq);
 }
 
+static void virtnet_rx_dim_update(struct virtnet_info *vi,
+				  struct receive_queue *rq)
+{
+	struct net_dim_sample cur_sample;
+
+	if (!READ_ONCE(vi->rx_dim_enabled))
+		return;
+
+	/* The stats are only written from this NAPI context. */
+	net_dim_sample(rq->calls, rq->stats.packets, rq->stats.bytes,
+		       &cur_sample);
+	net_dim(&rq->dim, cur_sample);
+}
+
 static int virtnet_poll(struct napi_struct *napi, int budget)
 {
 	struct receive_queue *rq =
@@ -1295,8 +1358,10 @@ static int virtnet_poll(struct napi_struct *napi, int budget)
 	received = virtnet_receive(rq, budget, &xdp_xmit);
 
 	/* Out of packets? */
-	if (received < budget)
+	if (received < budget) {
 		virtqueue_napi_complete(napi, rq->vq, received);
+		virtnet_rx_dim_update(vi, rq);
+	}
 
 	if (xdp_xmit) {
 		qp = vi->curr_queue_pairs - vi->xdp_queue_pairs +
@@ -1343,6 +1408,7 @@ static int virtnet_poll_tx(struct napi_struct *napi, int budget)
 	struct send_queue *sq = container_of(napi, struct send_queue, napi);
 	struct virtnet_info *vi = sq->vq->vdev->priv;
 	struct netdev_queue *txq = netdev_get_tx_queue(vi->dev, vq2txq(sq->vq));
+	struct net_dim_sample cur_sample;
 
 	__netif_tx_lock(txq, raw_smp_processor_id());
 	free_old_xmit_skbs(sq);
@@ -1350,6 +1416,12 @@ static int virtnet_poll_tx(struct napi_struct *napi, int budget)
 
 	virtqueue_napi_complete(napi, sq->vq, 0);
 
+	if (READ_ONCE(vi->tx_dim_enabled)) {
+		net_dim_sample(sq->calls, sq->stats.packets, sq->stats.bytes,
+			       &cur_sample);
+		net_dim(&sq->dim, cur_sample);
+	}
+
 	if (sq->vq->num_free >= 2 + MAX_SKB_FRAGS)
 		netif_tx_wake_queue(txq);
 
@@ -1663,6 +1735,8 @@ static int virtnet_close(struct net_device *dev)
 		xdp_rxq_info_unreg(&vi->rq[i].xdp_rxq);
 		napi_disable(&vi->rq[i].napi);
 		virtnet_napi_tx_disable(&vi->sq[i].napi);
+		cancel_work_sync(&vi->rq[i].dim.work);
+		cancel_work_sync(&vi->sq[i].dim.work);
 	}
 
 	return 0;
@@ -2090,6 +2164,180 @@ static void virtnet_update_settings(struct virtnet_info *vi)
 		vi->duplex = duplex;
 }
 
+static int virtnet_send_coal_vq_cmd(struct virtnet_info *vi, u16 vqn,
+				    struct virtnet_interrupt_coalesce *coal,
+				    u32 max_usecs, u32 max_packets)
+{
+	struct scatterlist sg;
+
+	vi->ctrl->coal_vq.vqn = cpu_to_le16(vqn);
+	vi->ctrl->coal_vq.coal.max_usecs = cpu_to_le32(max_usecs);
+	vi->ctrl->coal_vq.coal.max_packets = cpu_to_le32(max_packets);
+	sg_init_one(&sg, &vi->ctrl->coal_vq, sizeof(vi->ctrl->coal_vq));
+
+	if (!virtnet_send_command(vi, VIRTIO_NET_CTRL_NOTF_COAL,
+				  VIRTIO_NET_CTRL_NOTF_COAL_VQ_SET, &sg))
+		return -EINVAL;
+
+	coal->max_usecs = max_usecs;
+	coal->max_packets = max_packets;
+	return 0;
+}
+
+static void virtnet_rx_dim_work(struct work_struct *work)
+{
+	struct net_dim *dim = container_of(work, struct net_dim, work);
+	struct receive_queue *rq = container_of(dim, struct receive_queue, dim);
+	struct virtnet_info *vi = rq->vq->vdev->priv;
+	struct net_dim_cq_moder update;
+
+	/* virtnet_close() cancels us with rtnl held, so do not block on it */
+	if (!rtnl_trylock()) {
+		schedule_work(&dim->work);
+		return;
+	}
+
+	update = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	if (vi->rx_dim_enabled &&
+	    (update.usec != rq->intr_coal.max_usecs ||
+	     update.pkts != rq->intr_coal.max_packets))
+		virtnet_send_coal_vq_cmd(vi, rxq2vq(vq2rxq(rq->vq)),
+					 &rq->intr_coal, update.usec,
+					 update.pkts);
+
+	dim->state = NET_DIM_START_MEASURE;
+	rtnl_unlock();
+}
+
+static void virtnet_tx_dim_work(struct work_struct *work)
+{
+	struct net_dim *dim = container_of(work, struct net_dim, work);
+	struct send_queue *sq = container_of(dim, struct send_queue, dim);
+	struct virtnet_info *vi = sq->vq->vdev->priv;
+	struct net_dim_cq_moder update;
+
+	if (!rtnl_trylock()) {
+		schedule_work(&dim->work);
+		return;
+	}
+
+	update = net_dim_get_tx_moderation(dim->mode, dim->profile_ix);
+	if (vi->tx_dim_enabled &&
+	    (update.usec != sq->intr_coal.max_usecs ||
+	     update.pkts != sq->intr_coal.max_packets))
+		virtnet_send_coal_vq_cmd(vi, txq2vq(vq2txq(sq->vq)),
+					 &sq->intr_coal, update.usec,
+					 update.pkts);
+
+	dim->state = NET_DIM_START_MEASURE;
+	rtnl_unlock();
+}
+
+static int virtnet_send_tx_coal_cmd(struct virtnet_info *vi,
+				    struct ethtool_coalesce *ec)
+{
+	struct scatterlist sg;
+	int i;
+
+	vi->ctrl->coal_tx.tx_usecs = cpu_to_le32(ec->tx_coalesce_usecs);
+	vi->ctrl->coal_tx.tx_max_packets =
+		cpu_to_le32(ec->tx_max_coalesced_frames);
+	sg_init_one(&sg, &vi->ctrl->coal_tx, sizeof(vi->ctrl->coal_tx));
+
+	if (!virtnet_send_command(vi, VIRTIO_NET_CTRL_NOTF_COAL,
+				  VIRTIO_NET_CTRL_NOTF_COAL_TX_SET, &sg))
+		return -EINVAL;
+
+	vi->intr_coal_tx.max_usecs = ec->tx_coalesce_usecs;
+	vi->intr_coal_tx.max_packets = ec->tx_max_coalesced_frames;
+	for (i = 0; i < vi->max_queue_pairs; i++)
+		vi->sq[i].intr_coal = vi->intr_coal_tx;
+
+	return 0;
+}
+
+static int virtnet_send_rx_coal_cmd(struct virtnet_info *vi,
+				    struct ethtool_coalesce *ec)
+{
+	struct scatterlist sg;
+	int i;
+
+	vi->ctrl->coal_rx.rx_usecs = cpu_to_le32(ec->rx_coalesce_usecs);
+	vi->ctrl->coal_rx.rx_max_packets =
+		cpu_to_le32(ec->rx_max_coalesced_frames);
+	sg_init_one(&sg, &vi->ctrl->coal_rx, sizeof(vi->ctrl->coal_rx));
+
+	if (!virtnet_send_command(vi, VIRTIO_NET_CTRL_NOTF_COAL,
+				  VIRTIO_NET_CTRL_NOTF_COAL_RX_SET, &sg))
+		return -EINVAL;
+
+	vi->intr_coal_rx.max_usecs = ec->rx_coalesce_usecs;
+	vi->intr_coal_rx.max_packets = ec->rx_max_coalesced_frames;
+	for (i = 0; i < vi->max_queue_pairs; i++)
+		vi->rq[i].intr_coal = vi->intr_coal_rx;
+
+	return 0;
+}
+
+static int virtnet_set_coalesce(struct net_device *dev,
+				struct ethtool_coalesce *ec)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	int err;
+
+	if (!virtio_has_feature(vi->vdev, VIRTIO_NET_F_NOTF_COAL))
+		return -EOPNOTSUPP;
+
+	/* net_dim retunes each queue on its own, and TX samples are only
+	 * taken from the TX NAPI handler.
+	 */
+	if ((ec->use_adaptive_rx_coalesce || ec->use_adaptive_tx_coalesce) &&
+	    !virtio_has_feature(vi->vdev, VIRTIO_NET_F_VQ_NOTF_COAL))
+		return -EOPNOTSUPP;
+	if (ec->use_adaptive_tx_coalesce && !napi_tx)
+		return -EOPNOTSUPP;
+
+	if (!ec->use_adaptive_tx_coalesce &&
+	    (vi->tx_dim_enabled ||
+	     ec->tx_coalesce_usecs != vi->intr_coal_tx.max_usecs ||
+	     ec->tx_max_coalesced_frames != vi->intr_coal_tx.max_packets)) {
+		err = virtnet_send_tx_coal_cmd(vi, ec);
+		if (err)
+			return err;
+	}
+	WRITE_ONCE(vi->tx_dim_enabled, ec->use_adaptive_tx_coalesce);
+
+	if (!ec->use_adaptive_rx_coalesce &&
+	    (vi->rx_dim_enabled ||
+	     ec->rx_coalesce_usecs != vi->intr_coal_rx.max_usecs ||
+	     ec->rx_max_coalesced_frames != vi->intr_coal_rx.max_packets)) {
+		err = virtnet_send_rx_coal_cmd(vi, ec);
+		if (err)
+			return err;
+	}
+	WRITE_ONCE(vi->rx_dim_enabled, ec->use_adaptive_rx_coalesce);
+
+	return 0;
+}
+
+static int virtnet_get_coalesce(struct net_device *dev,
+				struct ethtool_coalesce *ec)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+
+	if (!virtio_has_feature(vi->vdev, VIRTIO_NET_F_NOTF_COAL))
+		return -EOPNOTSUPP;
+
+	ec->rx_coalesce_usecs = vi->intr_coal_rx.max_usecs;
+	ec->rx_max_coalesced_frames = vi->intr_coal_rx.max_packets;
+	ec->tx_coalesce_usecs = vi->intr_coal_tx.max_usecs;
+	ec->tx_max_coalesced_frames = vi->intr_coal_tx.max_packets;
+	ec->use_adaptive_rx_coalesce = vi->rx_dim_enabled;
+	ec->use_adaptive_tx_coalesce = vi->tx_dim_enabled;
+
+	return 0;
+}
+
 static const struct ethtool_ops virtnet_ethtool_ops = {
 	.get_drvinfo = virtnet_get_drvinfo,
 	.get_link = ethtool_op_get_link,
@@ -2102,6 +2350,8 @@ static const struct ethtool_ops virtnet_ethtool_ops = {
 	.get_ts_info = ethtool_op_get_ts_info,
 	.get_link_ksettings = virtnet_get_link_ksettings,
 	.set_link_ksettings = virtnet_set_link_ksettings,
+	.get_coalesce = virtnet_get_coalesce,
+	.set_coalesce = virtnet_set_coalesce,
 };
 
 static void virtnet_freeze_down(struct virtio_device *vdev)
@@ -2120,6 +2370,8 @@ static void virtnet_freeze_down(struct virtio_device *vdev)
 		for (i = 0; i < vi->max_queue_pairs; i++) {
 			napi_disable(&vi->rq[i].napi);
 			virtnet_napi_tx_disable(&vi->sq[i].napi);
+			cancel_work_sync(&vi->rq[i].dim.work);
+			cancel_work_sync(&vi->sq[i].dim.work);
 		}
 	}
 }
@@ -2598,6 +2850,11 @@ static int virtnet_alloc_queues(struct virtnet_info *vi)
 
 		u64_stats_init(&vi->rq[i].stats.syncp);
 		u64_stats_init(&vi->sq[i].stats.syncp);
+
+		INIT_WORK(&vi->rq[i].dim.work, virtnet_rx_dim_work);
+		vi->rq[i].dim.mode = NET_DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+		INIT_WORK(&vi->sq[i].dim.work, virtnet_tx_dim_work);
+		vi->sq[i].dim.mode = NET_DIM_CQ_PERIOD_MODE_START_FROM_EQE;
 	}
 
 	return 0;
@@ -2693,6 +2950,10 @@ static bool virtnet_validate_features(struct virtio_device *vdev)
 			     "VIRTIO_NET_F_CTRL_VQ") ||
 	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_MQ, "VIRTIO_NET_F_CTRL_VQ") ||
 	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_CTRL_MAC_ADDR,
+			     "VIRTIO_NET_F_CTRL_VQ") ||
+	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_NOTF_COAL,
+			     "VIRTIO_NET_F_CTRL_VQ") ||
+	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_VQ_NOTF_COAL,
 			     "VIRTIO_NET_F_CTRL_VQ"))) {
 		return false;
 	}
@@ -2998,7 +3259,8 @@ static struct virtio_device_id id_table[] = {
 	VIRTIO_NET_F_GUEST_ANNOUNCE, VIRTIO_NET_F_MQ, \
 	VIRTIO_NET_F_CTRL_MAC_ADDR, \
 	VIRTIO_NET_F_MTU, VIRTIO_NET_F_CTRL_GUEST_OFFLOADS, \
-	VIRTIO_NET_F_SPEED_DUPLEX
+	VIRTIO_NET_F_SPEED_DUPLEX, VIRTIO_NET_F_NOTF_COAL, \
+	VIRTIO_NET_F_VQ_NOTF_COAL
 
 static unsigned int features[] = {
 	VIRTNET_FEATURES,
@@ -43,7 +43,11 @@
 #include <linux/moduleparam.h>
 #include <linux/mm.h>
 #include <linux/slab.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 #include <net/ip.h>
+#include <net/xdp.h>
+#include <trace/events/xdp.h>
 
 #include <xen/xen.h>
 #include <xen/xenbus.h>
@@ -63,6 +67,11 @@ module_param_named(max_queues, xennet_max_queues, uint, 0644);
 MODULE_PARM_DESC(max_queues,
 		 "Maximum number of queues per virtual interface");
 
+static bool xennet_persistent_grants = true;
+module_param_named(persistent_grants, xennet_persistent_grants, bool, 0444);
+MODULE_PARM_DESC(persistent_grants,
+		 "Keep rx buffers granted to the backend and copy frames out");
+
 static const struct ethtool_ops xennet_ethtool_ops;
 
 struct netfront_cb {
@@ -73,6 +82,12 @@ struct netfront_cb {
 
 #define RX_COPY_THRESHOLD 256
 
+/* Largest frame XDP can handle: it is copied into a single page behind
+ * XDP_PACKET_HEADROOM, with room for build_skb()'s skb_shared_info.
+ */
+#define XENNET_XDP_MAX_FRAME (PAGE_SIZE - XDP_PACKET_HEADROOM - \
+			      SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+
 #define GRANT_INVALID_REF	0
 
 #define NET_TX_RING_SIZE __CONST_RING_SIZE(xen_netif_tx, XEN_PAGE_SIZE)
@@ -144,6 +159,16 @@ struct netfront_queue {
 	struct sk_buff *rx_skbs[NET_RX_RING_SIZE];
 	grant_ref_t gref_rx_head;
 	grant_ref_t grant_rx_ref[NET_RX_RING_SIZE];
+	/*
+	 * With persistent grants each rx slot keeps its page granted for
+	 * the lifetime of the ring, and rx_skbs[] is unused: frames are
+	 * copied out of the page, which is then posted again.
+	 */
+	struct page *grant_rx_page[NET_RX_RING_SIZE];
+
+	struct bpf_prog __rcu *xdp_prog;
+	struct xdp_rxq_info xdp_rxq;
+	bool xdp_flush;
 };
 
 struct netfront_info {
@@ -160,6 +185,9 @@ struct netfront_info {
 	struct netfront_stats __percpu *tx_stats;
 
 	atomic_t rx_gso_checksum_fixup;
+
+	/* XDP program published to every queue, protected by RTNL */
+	struct bpf_prog *xdp_prog;
 };
 
 struct netfront_rx_info {
@@ -280,6 +308,29 @@ static struct sk_buff *xennet_alloc_one_rx_buffer(struct netfront_queue *queue)
 }
 
 
+static int xennet_grant_rx_page(struct netfront_queue *queue,
+				unsigned short id)
+{
+	struct page *page;
+	grant_ref_t ref;
+
+	page = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
+	if (!page)
+		return -ENOMEM;
+
+	ref = gnttab_claim_grant_reference(&queue->gref_rx_head);
+	WARN_ON_ONCE(IS_ERR_VALUE((unsigned long)(int)ref));
+	gnttab_page_grant_foreign_access_ref_one(ref,
+						 queue->info->xbdev->otherend_id,
+						 page,
+						 0);
+
+	queue->grant_rx_page[id] = page;
+	queue->grant_rx_ref[id] = ref;
+
+	return 0;
+}
+
 static void xennet_alloc_rx_buffers(struct netfront_queue *queue)
 {
 	RING_IDX req_prod = queue->rx.req_prod_pvt;
@@ -298,6 +349,21 @@ static void xennet_alloc_rx_buffers(struct netfront_queue *queue)
 		struct page *page;
 		struct xen_netif_rx_request *req;
 
+		if (xennet_persistent_grants) {
+			/* Slots are only reposted once their data was copied */
+			id = xennet_rxidx(req_prod);
+			if (!queue->grant_rx_page[id] &&
+			    xennet_grant_rx_page(queue, id)) {
+				err = -ENOMEM;
+				break;
+			}
+
+			req = RING_GET_REQUEST(&queue->rx, req_prod);
+			req->id = id;
+			req->gref = queue->grant_rx_ref[id];
+			continue;
+		}
+
 		skb = xennet_alloc_one_rx_buffer(queue);
 		if (!skb) {
 			err = -ENOMEM;
@@ -771,9 +837,12 @@ static int xennet_get_extras(struct netfront_queue *queue,
 			       sizeof(*extra));
 		}
 
-		skb = xennet_get_rx_skb(queue, cons);
-		ref = xennet_get_rx_ref(queue, cons);
-		xennet_move_rx_slot(queue, skb, ref);
+		/* Persistent slots are reposted by xennet_alloc_rx_buffers() */
+		if (!xennet_persistent_grants) {
+			skb = xennet_get_rx_skb(queue, cons);
+			ref = xennet_get_rx_ref(queue, cons);
+			xennet_move_rx_slot(queue, skb, ref);
+		}
 	} while (extra->flags & XEN_NETIF_EXTRA_FLAG_MORE);
 
 	queue->rx.rsp_cons = cons;
@@ -920,6 +989,263 @@ static RING_IDX xennet_fill_frags(struct netfront_queue *queue,
 	return cons;
 }
 
+/*
+ * Run the XDP program on a copy of the frame.  On XDP_PASS and XDP_TX
+ * the copy is left in xdp->data_hard_start for the caller.
+ */
+static u32 xennet_run_xdp(struct netfront_queue *queue, struct bpf_prog *prog,
+			  struct xdp_buff *xdp, void *data, u32 len)
+{
+	struct net_device *dev = queue->info->netdev;
+	struct page *page;
+	u32 act;
+
+	xdp->data_hard_start = NULL;
+
+	if (unlikely(len > XENNET_XDP_MAX_FRAME))
+		return XDP_DROP;
+
+	page = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
+	if (unlikely(!page))
+		return XDP_DROP;
+
+	xdp->data_hard_start = page_address(page);
+	xdp->data = xdp->data_hard_start + XDP_PACKET_HEADROOM;
+	xdp_set_data_meta_invalid(xdp);
+	xdp->data_end = xdp->data + len;
+	xdp->rxq = &queue->xdp_rxq;
+	xdp->handle = 0;
+
+	memcpy(xdp->data, data, len);
+
+	act = bpf_prog_run_xdp(prog, xdp);
+
+	switch (act) {
+	case XDP_PASS:
+	case XDP_TX:
+		return act;
+
+	case XDP_DROP:
+		break;
+
+	case XDP_REDIRECT:
+		if (!xdp_do_redirect(dev, xdp, prog)) {
+			/* The page now belongs to the redirect target */
+			queue->xdp_flush = true;
+			xdp->data_hard_start = NULL;
+			return act;
+		}
+		trace_xdp_exception(dev, prog, act);
+		break;
+
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_ABORTED:
+		trace_xdp_exception(dev, prog, act);
+		break;
+	}
+
+	__free_page(page);
+	xdp->data_hard_start = NULL;
+
+	return XDP_DROP;
+}
+
+/* Returns the skb to pass up, or NULL if XDP consumed the frame */
+static struct sk_buff *xennet_xdp_frame(struct netfront_queue *queue,
+					struct bpf_prog *prog,
+					void *data, u32 len)
+{
+	struct net_device *dev = queue->info->netdev;
+	struct netdev_queue *txq;
+	struct xdp_buff xdp;
+	struct sk_buff *skb;
+	u32 act;
+
+	act = xennet_run_xdp(queue, prog, &xdp, data, len);
+	if (act != XDP_PASS && act != XDP_TX)
+		return NULL;
+
+	skb = build_skb(xdp.data_hard_start, PAGE_SIZE);
+	if (unlikely(!skb)) {
+		__free_page(virt_to_page(xdp.data_hard_start));
+		return NULL;
+	}
+
+	skb_reserve(skb, xdp.data - xdp.data_hard_start);
+	skb_put(skb, xdp.data_end - xdp.data);
+
+	if (act == XDP_PASS)
+		return skb;
+
+	/* XDP_TX: send it back out the queue it arrived on */
+	skb_set_queue_mapping(skb, queue->id);
+	txq = netdev_get_tx_queue(dev, queue->id);
+
+	__netif_tx_lock(txq, smp_processor_id());
+	if (!netif_xmit_frozen_or_stopped(txq)) {
+		xennet_start_xmit(skb, dev);
+	} else {
+		dev_kfree_skb_any(skb);
+		dev->stats.tx_dropped++;
+	}
+	__netif_tx_unlock(txq);
+
+	return NULL;
+}
+
+static int xennet_copy_rx_slot(struct sk_buff *skb, void *data,
+			       unsigned int len)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned int copy;
+	struct page *page;
+
+	/* Fill the linear area first, so small frames need no page */
+	if (!shinfo->nr_frags) {
+		copy = min_t(unsigned int, len, skb_tailroom(skb));
+		skb_put_data(skb, data, copy);
+		data += copy;
+		len -= copy;
+	}
+
+	if (!len)
+		return 0;
+
+	if (shinfo->nr_frags == MAX_SKB_FRAGS)
+		return -E2BIG;
+
+	page = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
+	if (unlikely(!page))
+		return -ENOMEM;
+
+	memcpy(page_address(page), data, len);
+	skb_add_rx_frag(skb, shinfo->nr_frags, page, 0, len, PAGE_SIZE);
+
+	return 0;
+}
+
+/*
+ * Persistent grant counterpart of xennet_get_responses(): copy one frame
+ * out of its rx slots into a fresh skb.  The slots keep their grants and
+ * are posted again by xennet_alloc_rx_buffers().  *pskb is left NULL if
+ * XDP consumed the frame.
+ */
+static int xennet_copy_responses(struct netfront_queue *queue,
+				 struct netfront_rx_info *rinfo, RING_IDX rp,
+				 struct sk_buff **pskb)
+{
+	struct xen_netif_rx_response *rx = &rinfo->rx;
+	struct xen_netif_extra_info *extras = rinfo->extras;
+	struct device *dev = &queue->info->netdev->dev;
+	RING_IDX ri = queue->rx.rsp_cons;
+	RING_IDX cons = ri;
+	int max = MAX_SKB_FRAGS + (rx->status <= RX_COPY_THRESHOLD);
+	struct sk_buff *skb = NULL;
+	struct bpf_prog *prog;
+	int slots = 1;
+	int err = 0;
+	void *data;
+
+	*pskb = NULL;
+
+	if (rx->flags & XEN_NETRXF_extra_info) {
+		err = xennet_get_extras(queue, extras, rp);
+		cons = queue->rx.rsp_cons;
+	}
+
+	rcu_read_lock();
+	prog = rcu_dereference(queue->xdp_prog);
+
+	for (;;) {
+		if (unlikely(rx->status < 0 ||
+			     rx->offset + rx->status > XEN_PAGE_SIZE)) {
+			if (net_ratelimit())
+				dev_warn(dev, "rx->offset: %u, size: %d\n",
+					 rx->offset, rx->status);
+			err = -EINVAL;
+			goto next;
+		}
+
+		if (err)
+			goto next;
+
+		data = page_address(queue->grant_rx_page[xennet_rxidx(ri)]) +
+		       rx->offset;
+
+		if (prog) {
+			/* XDP only sees frames that fit in a single slot */
+			if (rx->flags & XEN_NETRXF_more_data)
+				err = -E2BIG;
+			else
+				skb = xennet_xdp_frame(queue, prog, data,
+						       rx->status);
+			goto next;
+		}
+
+		if (!skb) {
+			skb = napi_alloc_skb(&queue->napi, RX_COPY_THRESHOLD);
+			if (unlikely(!skb)) {
+				err = -ENOMEM;
+				goto next;
+			}
+		}
+
+		err = xennet_copy_rx_slot(skb, data, rx->status);
+
+next:
+		if (!(rx->flags & XEN_NETRXF_more_data))
+			break;
+
+		if (cons + slots == rp) {
+			if (net_ratelimit())
+				dev_warn(dev, "Need more slots\n");
+			err = -ENOENT;
+			break;
+		}
+
+		ri = cons + slots;
+		rx = RING_GET_RESPONSE(&queue->rx, ri);
+		slots++;
+	}
+
+	rcu_read_unlock();
+
+	if (unlikely(slots > max)) {
+		if (net_ratelimit())
+			dev_warn(dev, "Too many slots\n");
+		err = -E2BIG;
+	}
+
+	queue->rx.rsp_cons = cons + slots;
+
+	if (unlikely(err) || !skb)
+		goto out;
+
+	if (extras[XEN_NETIF_EXTRA_TYPE_GSO - 1].type) {
+		err = xennet_set_skb_gso(skb,
+					 &extras[XEN_NETIF_EXTRA_TYPE_GSO - 1]);
+		if (unlikely(err))
+			goto out;
+	}
+
+	/* The headers were already copied into the linear area */
+	NETFRONT_SKB_CB(skb)->pull_to = skb_headlen(skb);
+
+	if (rinfo->rx.flags & XEN_NETRXF_csum_blank)
+		skb->ip_summed = CHECKSUM_PARTIAL;
+	else if (rinfo->rx.flags & XEN_NETRXF_data_validated)
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+	*pskb = skb;
+	return 0;
+
+out:
+	kfree_skb(skb);
+	return err;
+}
+
 static int checksum_setup(struct net_device *dev, struct sk_buff *skb)
 {
 	bool recalculate_partial_csum = false;
@@ -1010,6 +1336,20 @@ static int xennet_poll(struct napi_struct *napi, int budget)
 		memcpy(rx, RING_GET_RESPONSE(&queue->rx, i), sizeof(*rx));
 		memset(extras, 0, sizeof(rinfo.extras));
 
+		if (xennet_persistent_grants) {
+			err = xennet_copy_responses(queue, &rinfo, rp, &skb);
+			i = queue->rx.rsp_cons;
+			if (unlikely(err)) {
+				dev->stats.rx_errors++;
+				continue;
+			}
+
+			if (skb)
+				__skb_queue_tail(&rxq, skb);
+			work_done++;
+			continue;
+		}
+
 		err = xennet_get_responses(queue, &rinfo, rp, &tmpq);
 
 		if (unlikely(err)) {
@@ -1058,6 +1398,12 @@ static int xennet_poll(struct napi_struct *napi, int budget)
 
 	__skb_queue_purge(&errq);
 
+	/* One flush for everything XDP redirected during this poll */
+	if (queue->xdp_flush) {
+		queue->xdp_flush = false;
+		xdp_do_flush_map();
+	}
+
 	work_done -= handle_incoming_queue(queue, &rxq);
 
 	xennet_alloc_rx_buffers(queue);
@@ -1079,10 +1425,13 @@ static int xennet_poll(struct napi_struct *napi, int budget)
 
 static int xennet_change_mtu(struct net_device *dev, int mtu)
 {
+	struct netfront_info *np = netdev_priv(dev);
 	int max = xennet_can_sg(dev) ? XEN_NETIF_MAX_TX_SIZE : ETH_DATA_LEN;
 
 	if (mtu > max)
 		return -EINVAL;
+	if (np->xdp_prog && mtu + ETH_HLEN > XENNET_XDP_MAX_FRAME)
+		return -EINVAL;
 	dev->mtu = mtu;
 	return 0;
 }
@@ -1153,6 +1502,16 @@ static void xennet_release_rx_bufs(struct netfront_queue *queue)
 		struct sk_buff *skb;
 		struct page *page;
 
+		page = queue->grant_rx_page[id];
+		if (page) {
+			/* This frees the page as a side-effect */
+			gnttab_end_foreign_access(queue->grant_rx_ref[id], 0,
+					(unsigned long)page_address(page));
+			queue->grant_rx_page[id] = NULL;
+			queue->grant_rx_ref[id] = GRANT_INVALID_REF;
+			continue;
+		}
+
 		skb = queue->rx_skbs[id];
 		if (!skb)
 			continue;
@@ -1256,6 +1615,54 @@ static void xennet_poll_controller(struct net_device *dev)
 }
 #endif
 
+static int xennet_xdp_set(struct net_device *dev, struct bpf_prog *prog,
+			  struct netlink_ext_ack *extack)
+{
+	struct netfront_info *np = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+	unsigned int i;
+
+	if (prog && !xennet_persistent_grants) {
+		NL_SET_ERR_MSG_MOD(extack, "XDP requires persistent_grants");
+		return -EOPNOTSUPP;
+	}
+
+	if (prog && dev->mtu + ETH_HLEN > XENNET_XDP_MAX_FRAME) {
+		NL_SET_ERR_MSG_MOD(extack, "MTU too large to enable XDP");
+		netdev_warn(dev, "XDP requires MTU less than %lu\n",
+			    XENNET_XDP_MAX_FRAME - ETH_HLEN);
+		return -EINVAL;
+	}
+
+	old_prog = np->xdp_prog;
+	np->xdp_prog = prog;
+
+	/* The queues only borrow the reference held by np */
+	for (i = 0; np->queues && i < dev->real_num_tx_queues; i++)
+		rcu_assign_pointer(np->queues[i].xdp_prog, prog);
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+static int xennet_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct netfront_info *np = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return xennet_xdp_set(dev, xdp->prog, xdp->extack);
+	case XDP_QUERY_PROG:
+		xdp->prog_id = np->xdp_prog ? np->xdp_prog->aux->id : 0;
+		xdp->prog_attached = !!xdp->prog_id;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops xennet_netdev_ops = {
 	.ndo_open            = xennet_open,
 	.ndo_stop            = xennet_close,
@@ -1267,6 +1674,7 @@ static const struct net_device_ops xennet_netdev_ops = {
 	.ndo_fix_features    = xennet_fix_features,
 	.ndo_set_features    = xennet_set_features,
 	.ndo_select_queue    = xennet_select_queue,
+	.ndo_bpf             = xennet_xdp,
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller = xennet_poll_controller,
 #endif
@@ -1618,6 +2026,7 @@ static int xennet_init_queue(struct netfront_queue *queue)
 	for (i = 0; i < NET_RX_RING_SIZE; i++) {
 		queue->rx_skbs[i] = NULL;
 		queue->grant_rx_ref[i] = GRANT_INVALID_REF;
+		queue->grant_rx_page[i] = NULL;
 	}
 
 	/* A grant for every tx ring slot */
@@ -1736,6 +2145,7 @@ static void xennet_destroy_queues(struct netfront_info *info)
 		if (netif_running(info->netdev))
 			napi_disable(&queue->napi);
 		netif_napi_del(&queue->napi);
+		xdp_rxq_info_unreg(&queue->xdp_rxq);
 	}
 
 	kfree(info->queues);
@@ -1767,6 +2177,24 @@ static int xennet_create_queues(struct netfront_info *info,
 			break;
 		}
 
+		ret = xdp_rxq_info_reg(&queue->xdp_rxq, info->netdev, i);
+		if (!ret) {
+			ret = xdp_rxq_info_reg_mem_model(&queue->xdp_rxq,
+							 MEM_TYPE_PAGE_SHARED,
+							 NULL);
+			if (ret < 0)
+				xdp_rxq_info_unreg(&queue->xdp_rxq);
+		}
+		if (ret < 0) {
+			dev_warn(&info->xbdev->dev,
+				 "only created %d queues\n", i);
+			gnttab_free_grant_references(queue->gref_tx_head);
+			gnttab_free_grant_references(queue->gref_rx_head);
+			*num_queues = i;
+			break;
+		}
+		RCU_INIT_POINTER(queue->xdp_prog, info->xdp_prog);
+
 		netif_napi_add(queue->info->netdev, &queue->napi,
 			       xennet_poll, 64);
 		if (netif_running(info->netdev))
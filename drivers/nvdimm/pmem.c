@@ -32,11 +32,16 @@
 #include <linux/dax.h>
 #include <linux/nd.h>
 #include <linux/backing-dev.h>
+#include <linux/dmaengine.h>
 #include "pmem.h"
 #include "pfn.h"
 #include "nd.h"
 #include "nd-core.h"
 
+static unsigned int dma_threshold;
+module_param(dma_threshold, uint, 0444);
+MODULE_PARM_DESC(dma_threshold, "Offload bio copies of at least this many bytes to a DMA engine (0 = never)");
+
 static struct device *to_dev(struct pmem_device *pmem)
 {
 	/*
@@ -169,6 +174,176 @@ static blk_status_t pmem_do_bvec(struct pmem_device *pmem, struct page *page,
 #define REQ_FLUSH REQ_PREFLUSH
 #endif
 
+struct pmem_dma_io {
+	struct bio		*bio;
+	struct request_queue	*q;
+	/* one per queued descriptor, plus one held by the submitter */
+	atomic_t		pending;
+	blk_status_t		status;
+	bool			do_acct;
+	unsigned long		start;
+};
+
+static void pmem_dma_io_put(struct pmem_dma_io *io)
+{
+	struct bio *bio = io->bio;
+
+	if (!atomic_dec_and_test(&io->pending))
+		return;
+
+	if (io->status)
+		bio->bi_status = io->status;
+	if (io->do_acct)
+		nd_iostat_end(bio, io->start);
+	bio_endio(bio);
+	percpu_ref_put(&io->q->q_usage_counter);
+	kfree(io);
+}
+
+static void pmem_dma_callback(void *arg, const struct dmaengine_result *res)
+{
+	struct pmem_dma_io *io = arg;
+
+	if (res && res->result != DMA_TRANS_NOERROR)
+		io->status = BLK_STS_IOERR;
+	pmem_dma_io_put(io);
+}
+
+static dma_cookie_t pmem_dma_bvec(struct pmem_device *pmem,
+		struct pmem_dma_io *io, struct bio_vec *bvec, bool is_write,
+		sector_t sector, unsigned long flags)
+{
+	struct dma_chan *chan = pmem->dma_chan;
+	struct device *dev = chan->device->dev;
+	phys_addr_t pmem_phys = pmem->phys_addr + sector * 512 +
+		pmem->data_offset;
+	struct page *pmem_page = pfn_to_page(PHYS_PFN(pmem_phys));
+	unsigned int pmem_pg_off = offset_in_page(pmem_phys);
+	unsigned int len = bvec->bv_len;
+	struct dmaengine_unmap_data *unmap;
+	struct dma_async_tx_descriptor *tx;
+	dma_cookie_t cookie = -ENOMEM;
+
+	unmap = dmaengine_get_unmap_data(dev, 2, GFP_NOIO);
+	if (!unmap)
+		return -ENOMEM;
+	unmap->len = len;
+
+	/* addr[0] is the source, addr[1] the destination */
+	if (is_write)
+		unmap->addr[0] = dma_map_page(dev, bvec->bv_page,
+				bvec->bv_offset, len, DMA_TO_DEVICE);
+	else
+		unmap->addr[0] = dma_map_page(dev, pmem_page, pmem_pg_off,
+				len, DMA_TO_DEVICE);
+	if (dma_mapping_error(dev, unmap->addr[0]))
+		goto out;
+	unmap->to_cnt = 1;
+
+	if (is_write)
+		unmap->addr[1] = dma_map_page(dev, pmem_page, pmem_pg_off,
+				len, DMA_FROM_DEVICE);
+	else
+		unmap->addr[1] = dma_map_page(dev, bvec->bv_page,
+				bvec->bv_offset, len, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dev, unmap->addr[1]))
+		goto out;
+	unmap->from_cnt = 1;
+
+	tx = dmaengine_prep_dma_memcpy(chan, unmap->addr[1], unmap->addr[0],
+			len, flags);
+	if (!tx)
+		goto out;
+
+	dma_set_unmap(tx, unmap);
+	tx->callback_result = pmem_dma_callback;
+	tx->callback_param = io;
+	atomic_inc(&io->pending);
+	cookie = dmaengine_submit(tx);
+	if (dma_submit_error(cookie))
+		atomic_dec(&io->pending);
+out:
+	dmaengine_unmap_put(unmap);
+	return cookie;
+}
+
+/*
+ * Hand the copies of a large bio to the DMA engine and complete it from
+ * the descriptor callbacks, so the submitting CPU is not spent moving the
+ * data.  Only the last descriptor raises an interrupt, the engine's
+ * cleanup runs the callbacks of everything before it in the same pass.
+ *
+ * Returns false if the bio must be handled synchronously by the caller.
+ */
+static bool pmem_dma_submit(struct pmem_device *pmem, struct bio *bio)
+{
+	bool is_write = op_is_write(bio_op(bio)), fallback = false;
+	struct request_queue *q = pmem->disk->queue;
+	struct dma_chan *chan = pmem->dma_chan;
+	dma_cookie_t cookie, last = -EINVAL;
+	struct pmem_dma_io *io;
+	struct bio_vec bvec;
+	struct bvec_iter iter;
+	unsigned long flags;
+	blk_status_t rc;
+
+	if (!chan || bio->bi_iter.bi_size < dma_threshold)
+		return false;
+
+	/*
+	 * FUA has to be flushed after the data has landed, and poisoned
+	 * ranges need the read_pmem()/pmem_clear_poison() handling.
+	 */
+	if ((bio->bi_opf & REQ_FUA) || unlikely(is_bad_pmem(&pmem->bb,
+			bio->bi_iter.bi_sector, bio->bi_iter.bi_size)))
+		return false;
+
+	io = kmalloc(sizeof(*io), GFP_NOIO);
+	if (!io)
+		return false;
+	io->bio = bio;
+	io->q = q;
+	io->status = BLK_STS_OK;
+	atomic_set(&io->pending, 1);
+
+	/* keeps blk_cleanup_queue() waiting until the descriptors are done */
+	percpu_ref_get(&q->q_usage_counter);
+	io->do_acct = nd_iostat_start(bio, &io->start);
+
+	bio_for_each_segment(bvec, bio, iter) {
+		if (!fallback) {
+			flags = DMA_CTRL_ACK;
+			if (iter.bi_size == bvec.bv_len)
+				flags |= DMA_PREP_INTERRUPT;
+			cookie = pmem_dma_bvec(pmem, io, &bvec, is_write,
+					iter.bi_sector, flags);
+			if (!dma_submit_error(cookie)) {
+				last = cookie;
+				continue;
+			}
+			/* out of descriptors, copy the rest on the CPU */
+			fallback = true;
+		}
+
+		rc = pmem_do_bvec(pmem, bvec.bv_page, bvec.bv_len,
+				bvec.bv_offset, is_write, iter.bi_sector);
+		if (rc) {
+			io->status = rc;
+			break;
+		}
+	}
+
+	if (!dma_submit_error(last)) {
+		dma_async_issue_pending(chan);
+		/* the last descriptor queued did not ask for an interrupt */
+		if (fallback)
+			dma_sync_wait(chan, last);
+	}
+
+	pmem_dma_io_put(io);
+	return true;
+}
+
 static blk_qc_t pmem_make_request(struct request_queue *q, struct bio *bio)
 {
 	blk_status_t rc = 0;
@@ -182,6 +357,9 @@ static blk_qc_t pmem_make_request(struct request_queue *q, struct bio *bio)
 	if (bio->bi_opf & REQ_FLUSH)
 		nvdimm_flush(nd_region);
 
+	if (pmem_dma_submit(pmem, bio))
+		return BLK_QC_T_NONE;
+
 	do_acct = nd_iostat_start(bio, &start);
 	bio_for_each_segment(bvec, bio, iter) {
 		rc = pmem_do_bvec(pmem, bvec.bv_page, bvec.bv_len,
@@ -284,6 +462,31 @@ static void pmem_freeze_queue(void *q)
 	blk_freeze_queue_start(q);
 }
 
+static void pmem_release_dma(void *chan)
+{
+	dma_release_channel(chan);
+}
+
+static void pmem_setup_dma(struct device *dev, struct pmem_device *pmem)
+{
+	struct dma_chan *chan;
+	dma_cap_mask_t mask;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_MEMCPY, mask);
+	chan = dma_request_channel(mask, NULL, NULL);
+	if (!chan) {
+		dev_dbg(dev, "no memcpy channel, copies stay on the cpu\n");
+		return;
+	}
+
+	if (devm_add_action_or_reset(dev, pmem_release_dma, chan))
+		return;
+	pmem->dma_chan = chan;
+	dev_info(dev, "copies of %u bytes or more offloaded to %s\n",
+			dma_threshold, dma_chan_name(chan));
+}
+
 static void pmem_release_disk(void *__pmem)
 {
 	struct pmem_device *pmem = __pmem;
@@ -343,6 +546,14 @@ static int pmem_attach_disk(struct device *dev,
 		return -EBUSY;
 	}
 
+	/*
+	 * The engine addresses pmem through struct pages, so only offload
+	 * for PFN_MAP namespaces.  The channel is released after the queue
+	 * has been cleaned up and the in-flight descriptors have completed.
+	 */
+	if (dma_threshold && (is_nd_pfn(dev) || pmem_should_map_pages(dev)))
+		pmem_setup_dma(dev, pmem);
+
 	q = blk_alloc_queue_node(GFP_KERNEL, dev_to_node(dev), NULL);
 	if (!q)
 		return -ENOMEM;
@@ -6,6 +6,8 @@
 #include <linux/pfn_t.h>
 #include <linux/fs.h>
 
+struct dma_chan;
+
 /* this definition is in it's own header for tools/testing/nvdimm to consume */
 struct pmem_device {
 	/* One contiguous memory region per device */
@@ -23,6 +25,8 @@ struct pmem_device {
 	struct dax_device	*dax_dev;
 	struct gendisk		*disk;
 	struct dev_pagemap	pgmap;
+	/* memcpy channel for large bios, see pmem_dma_submit() */
+	struct dma_chan		*dma_chan;
 };
 
 long __pmem_direct_access(struct pmem_device *pmem, pgoff_t pgoff,
@@ -226,6 +226,8 @@ void nvme_complete_rq(struct request *req)
 
 	trace_nvme_complete_rq(req);
 
+	nvme_mpath_end_request(req);
+
 	if (unlikely(status != BLK_STS_OK && nvme_req_needs_retry(req))) {
 		if (nvme_req_needs_failover(req, status)) {
 			nvme_failover_req(req);
@@ -242,6 +244,25 @@ void nvme_complete_rq(struct request *req)
 }
 EXPORT_SYMBOL_GPL(nvme_complete_rq);
 
+/*
+ * End the successful requests gathered by nvme_end_request_batch(), @unmap
+ * doing for each what the transport's ->complete() does before calling
+ * nvme_complete_rq().
+ */
+void nvme_complete_batch(struct list_head *list,
+			 void (*unmap)(struct request *req))
+{
+	struct request *req;
+
+	list_for_each_entry(req, list, queuelist) {
+		unmap(req);
+		trace_nvme_complete_rq(req);
+		nvme_mpath_end_request(req);
+	}
+	blk_mq_end_request_batch(list);
+}
+EXPORT_SYMBOL_GPL(nvme_complete_batch);
+
 void nvme_cancel_request(struct request *req, void *data, bool reserved)
 {
 	if (!blk_mq_request_started(req))
@@ -646,10 +667,12 @@ blk_status_t nvme_setup_cmd(struct nvme_ns *ns, struct request *req,
 	}
 
 	cmd->common.command_id = req->tag;
-	if (ns)
+	if (ns) {
+		nvme_mpath_start_request(req);
 		trace_nvme_setup_nvm_cmd(req->q->id, cmd);
-	else
+	} else {
 		trace_nvme_setup_admin_cmd(cmd);
+	}
 	return ret;
 }
 EXPORT_SYMBOL_GPL(nvme_setup_cmd);
@@ -2121,6 +2144,9 @@ static struct attribute *nvme_subsys_attrs[] = {
 	&subsys_attr_serial.attr,
 	&subsys_attr_firmware_rev.attr,
 	&subsys_attr_subsysnqn.attr,
+#ifdef CONFIG_NVME_MULTIPATH
+	&subsys_attr_iopolicy.attr,
+#endif
 	NULL,
 };
 
@@ -2635,12 +2661,47 @@ static ssize_t nsid_show(struct device *dev, struct device_attribute *attr,
 }
 static DEVICE_ATTR_RO(nsid);
 
+#ifdef CONFIG_NVME_MULTIPATH
+static ssize_t mpath_inflight_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_ns *ns = dev_to_disk(dev)->private_data;
+
+	return sprintf(buf, "%d\n", atomic_read(&ns->nr_active));
+}
+static DEVICE_ATTR_RO(mpath_inflight);
+
+static ssize_t mpath_ios_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_ns *ns = dev_to_disk(dev)->private_data;
+
+	return sprintf(buf, "%lu\n", atomic_long_read(&ns->nr_ios));
+}
+static DEVICE_ATTR_RO(mpath_ios);
+
+static ssize_t mpath_service_time_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_ns *ns = dev_to_disk(dev)->private_data;
+
+	return sprintf(buf, "%llu\n",
+		div_u64(READ_ONCE(ns->service_time), NSEC_PER_USEC));
+}
+static DEVICE_ATTR_RO(mpath_service_time);
+#endif
+
 static struct attribute *nvme_ns_id_attrs[] = {
 	&dev_attr_wwid.attr,
 	&dev_attr_uuid.attr,
 	&dev_attr_nguid.attr,
 	&dev_attr_eui.attr,
 	&dev_attr_nsid.attr,
+#ifdef CONFIG_NVME_MULTIPATH
+	&dev_attr_mpath_inflight.attr,
+	&dev_attr_mpath_ios.attr,
+	&dev_attr_mpath_service_time.attr,
+#endif
 	NULL,
 };
 
@@ -2663,6 +2724,18 @@ static umode_t nvme_ns_id_attrs_are_visible(struct kobject *kobj,
 		if (!memchr_inv(ids->eui64, 0, sizeof(ids->eui64)))
 			return 0;
 	}
+#ifdef CONFIG_NVME_MULTIPATH
+	if (a == &dev_attr_mpath_inflight.attr ||
+	    a == &dev_attr_mpath_ios.attr ||
+	    a == &dev_attr_mpath_service_time.attr) {
+		struct gendisk *disk = dev_to_disk(dev);
+
+		/* only the paths below a multipath node have these */
+		if (disk->fops != &nvme_fops ||
+		    !((struct nvme_ns *)disk->private_data)->head->disk)
+			return 0;
+	}
+#endif
 	return a->mode;
 }
 
@@ -88,15 +88,170 @@ static struct nvme_ns *__nvme_find_path(struct nvme_ns_head *head)
 	return NULL;
 }
 
+/*
+ * Use the first live path after the current one, wrapping around.  This is
+ * done as two bounded walks so that a current path that has just been
+ * unlinked can't make us loop.
+ */
+static struct nvme_ns *nvme_round_robin_path(struct nvme_ns_head *head,
+		struct nvme_ns *old)
+{
+	struct nvme_ns *ns, *found = NULL;
+	bool after_old = false;
+
+	if (unlikely(!old))
+		return __nvme_find_path(head);
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (ns == old) {
+			after_old = true;
+			continue;
+		}
+		if (after_old && ns->ctrl->state == NVME_CTRL_LIVE) {
+			found = ns;
+			goto out;
+		}
+	}
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (ns == old)
+			break;
+		if (ns->ctrl->state == NVME_CTRL_LIVE) {
+			found = ns;
+			goto out;
+		}
+	}
+
+	if (old->ctrl->state == NVME_CTRL_LIVE)
+		return old;
+	return NULL;
+out:
+	rcu_assign_pointer(head->current_path, found);
+	return found;
+}
+
+/*
+ * Pick the live path with the fewest requests in flight, or, for the
+ * service-time policy, the one the queued requests are expected to get
+ * through fastest given its recent completion latency, like
+ * dm-queue-length and dm-service-time do.
+ */
+static struct nvme_ns *nvme_least_loaded_path(struct nvme_ns_head *head,
+		struct nvme_ns *old, bool service_time)
+{
+	struct nvme_ns *ns, *found = NULL;
+	u64 load, min_load = U64_MAX;
+
+	list_for_each_entry_rcu(ns, &head->list, siblings) {
+		if (ns->ctrl->state != NVME_CTRL_LIVE)
+			continue;
+
+		load = atomic_read(&ns->nr_active);
+		if (service_time)
+			load = (load + 1) * READ_ONCE(ns->service_time);
+		if (load < min_load) {
+			min_load = load;
+			found = ns;
+		}
+	}
+
+	if (found && found != old)
+		rcu_assign_pointer(head->current_path, found);
+	return found;
+}
+
 inline struct nvme_ns *nvme_find_path(struct nvme_ns_head *head)
 {
 	struct nvme_ns *ns = srcu_dereference(head->current_path, &head->srcu);
 
+	switch (READ_ONCE(head->subsys->iopolicy)) {
+	case NVME_IOPOLICY_RR:
+		return nvme_round_robin_path(head, ns);
+	case NVME_IOPOLICY_QD:
+		return nvme_least_loaded_path(head, ns, false);
+	case NVME_IOPOLICY_ST:
+		return nvme_least_loaded_path(head, ns, true);
+	default:
+		break;
+	}
+
 	if (unlikely(!ns || ns->ctrl->state != NVME_CTRL_LIVE))
 		ns = __nvme_find_path(head);
 	return ns;
 }
 
+void nvme_mpath_start_request(struct request *rq)
+{
+	struct nvme_ns *ns = rq->q->queuedata;
+
+	if (!(rq->cmd_flags & REQ_NVME_MPATH) ||
+	    (nvme_req(rq)->flags & NVME_MPATH_IO_STATS))
+		return;
+
+	nvme_req(rq)->flags |= NVME_MPATH_IO_STATS;
+	nvme_req(rq)->start_time = ktime_get_ns();
+	atomic_inc(&ns->nr_active);
+	atomic_long_inc(&ns->nr_ios);
+}
+
+void nvme_mpath_end_request(struct request *rq)
+{
+	struct nvme_ns *ns = rq->q->queuedata;
+	u64 stime, avg;
+
+	if (!(nvme_req(rq)->flags & NVME_MPATH_IO_STATS))
+		return;
+
+	nvme_req(rq)->flags &= ~NVME_MPATH_IO_STATS;
+	atomic_dec(&ns->nr_active);
+
+	/*
+	 * Each sample weighs 1/8 in the average.  Concurrent completions may
+	 * lose an update, which is fine for a load hint.
+	 */
+	stime = ktime_get_ns() - nvme_req(rq)->start_time;
+	avg = READ_ONCE(ns->service_time);
+	WRITE_ONCE(ns->service_time, avg - (avg >> 3) + (stime >> 3));
+}
+
+static const char *nvme_iopolicy_names[] = {
+	[NVME_IOPOLICY_FAILOVER]	= "failover",
+	[NVME_IOPOLICY_RR]		= "round-robin",
+	[NVME_IOPOLICY_QD]		= "queue-depth",
+	[NVME_IOPOLICY_ST]		= "service-time",
+};
+
+static ssize_t nvme_subsys_iopolicy_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct nvme_subsystem *subsys =
+		container_of(dev, struct nvme_subsystem, dev);
+
+	return sprintf(buf, "%s\n",
+			nvme_iopolicy_names[READ_ONCE(subsys->iopolicy)]);
+}
+
+static ssize_t nvme_subsys_iopolicy_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct nvme_subsystem *subsys =
+		container_of(dev, struct nvme_subsystem, dev);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nvme_iopolicy_names); i++) {
+		if (sysfs_streq(buf, nvme_iopolicy_names[i])) {
+			WRITE_ONCE(subsys->iopolicy, i);
+			return count;
+		}
+	}
+
+	return -EINVAL;
+}
+
+struct device_attribute subsys_attr_iopolicy =
+	__ATTR(iopolicy, S_IRUGO | S_IWUSR,
+	       nvme_subsys_iopolicy_show, nvme_subsys_iopolicy_store);
+
 static blk_qc_t nvme_ns_head_make_request(struct request_queue *q,
 		struct bio *bio)
 {
@@ -101,6 +101,9 @@ struct nvme_request {
 	u8			retries;
 	u8			flags;
 	u16			status;
+#ifdef CONFIG_NVME_MULTIPATH
+	u64			start_time;
+#endif
 };
 
 /*
@@ -111,6 +114,7 @@ struct nvme_request {
 enum {
 	NVME_REQ_CANCELLED		= (1 << 0),
 	NVME_REQ_USERCMD		= (1 << 1),
+	NVME_MPATH_IO_STATS		= (1 << 2),
 };
 
 static inline struct nvme_request *nvme_req(struct request *req)
@@ -213,6 +217,13 @@ struct nvme_ctrl {
 	struct nvmf_ctrl_options *opts;
 };
 
+enum nvme_iopolicy {
+	NVME_IOPOLICY_FAILOVER,
+	NVME_IOPOLICY_RR,
+	NVME_IOPOLICY_QD,
+	NVME_IOPOLICY_ST,
+};
+
 struct nvme_subsystem {
 	int			instance;
 	struct device		dev;
@@ -232,6 +243,9 @@ struct nvme_subsystem {
 	u8			cmic;
 	u16			vendor_id;
 	struct ida		ns_ida;
+#ifdef CONFIG_NVME_MULTIPATH
+	enum nvme_iopolicy	iopolicy;
+#endif
 };
 
 /*
@@ -303,6 +317,12 @@ struct nvme_ns {
 	struct nvme_fault_inject fault_inject;
 #endif
 
+#ifdef CONFIG_NVME_MULTIPATH
+	/* per-path statistics, feeding the load based I/O policies */
+	atomic_t nr_active;
+	atomic_long_t nr_ios;
+	u64 service_time;	/* moving average, in ns */
+#endif
 };
 
 struct nvme_ctrl_ops {
@@ -373,6 +393,23 @@ static inline void nvme_end_request(struct request *req, __le16 status,
 	blk_mq_complete_request(req);
 }
 
+/*
+ * Like nvme_end_request(), but a request that succeeded goes on @list, for
+ * the driver to end along with the rest of its completion queue through
+ * nvme_complete_batch().
+ */
+static inline void nvme_end_request_batch(struct request *req, __le16 status,
+		union nvme_result result, struct list_head *list)
+{
+	struct nvme_request *rq = nvme_req(req);
+
+	rq->status = le16_to_cpu(status) >> 1;
+	rq->result = result;
+	nvme_should_fail(req);
+	if (rq->status || !blk_mq_add_to_batch(req, list))
+		blk_mq_complete_request(req);
+}
+
 static inline void nvme_get_ctrl(struct nvme_ctrl *ctrl)
 {
 	get_device(ctrl->device);
@@ -384,6 +421,8 @@ static inline void nvme_put_ctrl(struct nvme_ctrl *ctrl)
 }
 
 void nvme_complete_rq(struct request *req);
+void nvme_complete_batch(struct list_head *list,
+			 void (*unmap)(struct request *req));
 void nvme_cancel_request(struct request *req, void *data, bool reserved);
 bool nvme_change_ctrl_state(struct nvme_ctrl *ctrl,
 		enum nvme_ctrl_state new_state);
@@ -467,6 +506,11 @@ static inline void nvme_mpath_check_last_path(struct nvme_ns *ns)
 		kblockd_schedule_work(&head->requeue_work);
 }
 
+void nvme_mpath_start_request(struct request *rq);
+void nvme_mpath_end_request(struct request *rq);
+
+extern struct device_attribute subsys_attr_iopolicy;
+
 #else
 /*
  * Without the multipath code enabled, multiple controller per subsystems are
@@ -506,6 +550,12 @@ static inline void nvme_mpath_clear_current_path(struct nvme_ns *ns)
 static inline void nvme_mpath_check_last_path(struct nvme_ns *ns)
 {
 }
+static inline void nvme_mpath_start_request(struct request *rq)
+{
+}
+static inline void nvme_mpath_end_request(struct request *rq)
+{
+}
 #endif /* CONFIG_NVME_MULTIPATH */
 
 #ifdef CONFIG_NVM
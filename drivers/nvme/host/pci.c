@@ -50,6 +50,11 @@ module_param(max_host_mem_size_mb, uint, 0444);
 MODULE_PARM_DESC(max_host_mem_size_mb,
 	"Maximum Host Memory Buffer (HMB) size per controller (in MiB)");
 
+static bool poll_queues;
+module_param(poll_queues, bool, 0444);
+MODULE_PARM_DESC(poll_queues,
+	"give each I/O queue an interrupt-less twin for polled I/O");
+
 static unsigned int sgl_threshold = SZ_32K;
 module_param(sgl_threshold, uint, 0644);
 MODULE_PARM_DESC(sgl_threshold,
@@ -84,6 +89,7 @@ struct nvme_dev {
 	struct dma_pool *prp_small_pool;
 	unsigned online_queues;
 	unsigned max_qid;
+	unsigned int nr_poll_queues;
 	unsigned int num_vecs;
 	int q_depth;
 	u32 db_stride;
@@ -163,6 +169,7 @@ struct nvme_queue {
 	u16 last_cq_head;
 	u16 qid;
 	u8 cq_phase;
+	bool polled;
 	u32 *dbbuf_sq_db;
 	u32 *dbbuf_cq_db;
 	u32 *dbbuf_sq_ei;
@@ -385,14 +392,39 @@ static void nvme_admin_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_i
 	nvmeq->tags = NULL;
 }
 
+/*
+ * With poll_queues, the I/O queues with an interrupt come first and each
+ * of them has a polled twin nvme_irq_io_queues() qids further, that the
+ * REQ_HIPRI requests of its hctx go to.  The twins share the tags of their
+ * hctx, and are only ever reaped through ->poll().
+ */
+static inline unsigned int nvme_irq_io_queues(struct nvme_dev *dev)
+{
+	return dev->max_qid - dev->nr_poll_queues;
+}
+
+static struct nvme_queue *nvme_poll_queue(struct nvme_queue *nvmeq)
+{
+	struct nvme_dev *dev = nvmeq->dev;
+	unsigned int qid = nvmeq->qid + nvme_irq_io_queues(dev);
+
+	if (!nvmeq->qid || nvmeq->qid > dev->nr_poll_queues ||
+	    qid >= dev->online_queues)
+		return nvmeq;
+	return &dev->queues[qid];
+}
+
 static int nvme_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 			  unsigned int hctx_idx)
 {
 	struct nvme_dev *dev = data;
 	struct nvme_queue *nvmeq = &dev->queues[hctx_idx + 1];
+	unsigned int poll_qid = hctx_idx + 1 + nvme_irq_io_queues(dev);
 
 	if (!nvmeq->tags)
 		nvmeq->tags = &dev->tagset.tags[hctx_idx];
+	if (hctx_idx < dev->nr_poll_queues && poll_qid < dev->ctrl.queue_count)
+		dev->queues[poll_qid].tags = nvmeq->tags;
 
 	WARN_ON(dev->tagset.tags[hctx_idx] != hctx->tags);
 	hctx->driver_data = nvmeq;
@@ -870,9 +902,13 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	struct nvme_queue *nvmeq = hctx->driver_data;
 	struct nvme_dev *dev = nvmeq->dev;
 	struct request *req = bd->rq;
+	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 	struct nvme_command cmnd;
 	blk_status_t ret;
 
+	if (req->cmd_flags & REQ_HIPRI)
+		nvmeq = nvme_poll_queue(nvmeq);
+
 	/*
 	 * We should not need to do this, but we're still using this to
 	 * ensure we can drain requests on a dying queue.
@@ -887,6 +923,7 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	ret = nvme_init_iod(req, dev);
 	if (ret)
 		goto out_free_cmd;
+	iod->nvmeq = nvmeq;
 
 	if (blk_rq_nr_phys_segments(req)) {
 		ret = nvme_map_data(dev, req, &cmnd);
@@ -907,11 +944,16 @@ static blk_status_t nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return ret;
 }
 
-static void nvme_pci_complete_rq(struct request *req)
+static void nvme_pci_unmap_rq(struct request *req)
 {
 	struct nvme_iod *iod = blk_mq_rq_to_pdu(req);
 
 	nvme_unmap_data(iod->nvmeq->dev, req);
+}
+
+static void nvme_pci_complete_rq(struct request *req)
+{
+	nvme_pci_unmap_rq(req);
 	nvme_complete_rq(req);
 }
 
@@ -933,7 +975,8 @@ static inline void nvme_ring_cq_doorbell(struct nvme_queue *nvmeq)
 	}
 }
 
-static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
+static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx,
+				   struct list_head *list)
 {
 	volatile struct nvme_completion *cqe = &nvmeq->cqes[idx];
 	struct request *req;
@@ -959,16 +1002,20 @@ static inline void nvme_handle_cqe(struct nvme_queue *nvmeq, u16 idx)
 	}
 
 	req = blk_mq_tag_to_rq(*nvmeq->tags, cqe->command_id);
-	nvme_end_request(req, cqe->status, cqe->result);
+	nvme_end_request_batch(req, cqe->status, cqe->result, list);
 }
 
 static void nvme_complete_cqes(struct nvme_queue *nvmeq, u16 start, u16 end)
 {
+	LIST_HEAD(list);
+
 	while (start != end) {
-		nvme_handle_cqe(nvmeq, start);
+		nvme_handle_cqe(nvmeq, start, &list);
 		if (++start == nvmeq->q_depth)
 			start = 0;
 	}
+	if (!list_empty(&list))
+		nvme_complete_batch(&list, nvme_pci_unmap_rq);
 }
 
 static inline void nvme_update_cq_head(struct nvme_queue *nvmeq)
@@ -1044,7 +1091,7 @@ static int __nvme_poll(struct nvme_queue *nvmeq, unsigned int tag)
 
 static int nvme_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
 {
-	struct nvme_queue *nvmeq = hctx->driver_data;
+	struct nvme_queue *nvmeq = nvme_poll_queue(hctx->driver_data);
 
 	return __nvme_poll(nvmeq, tag);
 }
@@ -1079,7 +1126,10 @@ static int adapter_alloc_cq(struct nvme_dev *dev, u16 qid,
 						struct nvme_queue *nvmeq)
 {
 	struct nvme_command c;
-	int flags = NVME_QUEUE_PHYS_CONTIG | NVME_CQ_IRQ_ENABLED;
+	int flags = NVME_QUEUE_PHYS_CONTIG;
+
+	if (!nvmeq->polled)
+		flags |= NVME_CQ_IRQ_ENABLED;
 
 	/*
 	 * Note: we (ab)use the fact that the prp fields survive if no data
@@ -1346,7 +1396,8 @@ static int nvme_suspend_queue(struct nvme_queue *nvmeq)
 	if (!nvmeq->qid && nvmeq->dev->ctrl.admin_q)
 		blk_mq_quiesce_queue(nvmeq->dev->ctrl.admin_q);
 
-	pci_free_irq(to_pci_dev(nvmeq->dev->dev), vector, nvmeq);
+	if (!nvmeq->polled)
+		pci_free_irq(to_pci_dev(nvmeq->dev->dev), vector, nvmeq);
 
 	return 0;
 }
@@ -1485,9 +1536,13 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 
 	/*
 	 * A queue's vector matches the queue identifier unless the controller
-	 * has only one vector available.
+	 * has only one vector available.  A polled queue has none, and its
+	 * cq_vector only tells that it is live.
 	 */
-	nvmeq->cq_vector = dev->num_vecs == 1 ? 0 : qid;
+	nvmeq->polled = qid > nvme_irq_io_queues(dev);
+	if (nvmeq->polled)
+		nvmeq->tags = dev->queues[qid - nvme_irq_io_queues(dev)].tags;
+	nvmeq->cq_vector = (dev->num_vecs == 1 || nvmeq->polled) ? 0 : qid;
 	result = adapter_alloc_cq(dev, qid, nvmeq);
 	if (result < 0)
 		goto release_vector;
@@ -1497,9 +1552,11 @@ static int nvme_create_queue(struct nvme_queue *nvmeq, int qid)
 		goto release_cq;
 
 	nvme_init_queue(nvmeq, qid);
-	result = queue_request_irq(nvmeq);
-	if (result < 0)
-		goto release_sq;
+	if (!nvmeq->polled) {
+		result = queue_request_irq(nvmeq);
+		if (result < 0)
+			goto release_sq;
+	}
 
 	return result;
 
@@ -1938,7 +1995,7 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 {
 	struct nvme_queue *adminq = &dev->queues[0];
 	struct pci_dev *pdev = to_pci_dev(dev->dev);
-	int result, nr_io_queues;
+	int result, nr_io_queues, irq_queues;
 	unsigned long size;
 
 	struct irq_affinity affd = {
@@ -1946,6 +2003,8 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	};
 
 	nr_io_queues = num_possible_cpus();
+	if (poll_queues)
+		nr_io_queues *= 2;
 	result = nvme_set_queue_count(&dev->ctrl, &nr_io_queues);
 	if (result < 0)
 		return result;
@@ -1980,12 +2039,21 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 	 * setting up the full range we need.
 	 */
 	pci_free_irq_vectors(pdev);
-	result = pci_alloc_irq_vectors_affinity(pdev, 1, nr_io_queues + 1,
+	irq_queues = nr_io_queues;
+	if (poll_queues && nr_io_queues > 1)
+		irq_queues = nr_io_queues / 2;
+	result = pci_alloc_irq_vectors_affinity(pdev, 1, irq_queues + 1,
 			PCI_IRQ_ALL_TYPES | PCI_IRQ_AFFINITY, &affd);
 	if (result <= 0)
 		return -EIO;
 	dev->num_vecs = result;
-	dev->max_qid = max(result - 1, 1);
+	irq_queues = max(result - 1, 1);
+
+	/* Each I/O queue gets a polled twin, or none of them does */
+	dev->nr_poll_queues = 0;
+	if (poll_queues && nr_io_queues >= 2 * irq_queues)
+		dev->nr_poll_queues = irq_queues;
+	dev->max_qid = irq_queues + dev->nr_poll_queues;
 
 	/*
 	 * Should investigate if there's a performance win from allocating
@@ -2084,6 +2152,12 @@ static void nvme_disable_io_queues(struct nvme_dev *dev)
 	}
 }
 
+/* The hctxs only map to the I/O queues with an interrupt */
+static unsigned int nvme_nr_hw_queues(struct nvme_dev *dev)
+{
+	return min(dev->online_queues - 1, nvme_irq_io_queues(dev));
+}
+
 /*
  * return error value only when tagset allocation failed
  */
@@ -2093,7 +2167,7 @@ static int nvme_dev_add(struct nvme_dev *dev)
 
 	if (!dev->ctrl.tagset) {
 		dev->tagset.ops = &nvme_mq_ops;
-		dev->tagset.nr_hw_queues = dev->online_queues - 1;
+		dev->tagset.nr_hw_queues = nvme_nr_hw_queues(dev);
 		dev->tagset.timeout = NVME_IO_TIMEOUT;
 		dev->tagset.numa_node = dev_to_node(dev->dev);
 		dev->tagset.queue_depth =
@@ -2116,7 +2190,8 @@ static int nvme_dev_add(struct nvme_dev *dev)
 
 		nvme_dbbuf_set(dev);
 	} else {
-		blk_mq_update_nr_hw_queues(&dev->tagset, dev->online_queues - 1);
+		blk_mq_update_nr_hw_queues(&dev->tagset,
+					   nvme_nr_hw_queues(dev));
 
 		/* Free previously allocated queues that are no longer usable */
 		nvme_free_queues(dev, dev->online_queues);
@@ -2539,7 +2614,8 @@ static int nvme_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	if (!dev)
 		return -ENOMEM;
 
-	dev->queues = kcalloc_node(num_possible_cpus() + 1,
+	dev->queues = kcalloc_node(
+			(poll_queues ? 2 : 1) * num_possible_cpus() + 1,
 			sizeof(struct nvme_queue), GFP_KERNEL, node);
 	if (!dev->queues)
 		goto free;
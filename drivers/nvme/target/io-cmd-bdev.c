@@ -0,0 +1,419 @@
+/*
+ * NVMe I/O command implementation for block device backed namespaces.
+ * Copyright (c) 2015-2016 HGST, a Western Digital Company.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/blkdev.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include "nvmet.h"
+
+/*
+ * Namespaces with use_poll set have their completions reaped by a polling
+ * thread on the CPU that submitted the I/O, which is the CPU the fabric
+ * queue runs on.  Each pass polls the hardware queue of the oldest
+ * outstanding request and completes everything found there, so requests
+ * sharing a hardware queue are completed in batches.
+ */
+struct nvmet_bdev_poller {
+	struct task_struct	*thread;
+	spinlock_t		lock;
+	struct list_head	reqs;
+	wait_queue_head_t	wait;
+};
+
+static DEFINE_PER_CPU(struct nvmet_bdev_poller, nvmet_bdev_pollers);
+static DEFINE_MUTEX(nvmet_bdev_poll_mutex);
+static unsigned int nvmet_bdev_poll_users;
+
+static int nvmet_bdev_poll_thread(void *data)
+{
+	struct nvmet_bdev_poller *poller = data;
+	struct nvmet_req *req;
+	struct nvmet_ns *ns;
+	blk_qc_t cookie;
+
+	while (!kthread_should_stop()) {
+		spin_lock_irq(&poller->lock);
+		req = list_first_entry_or_null(&poller->reqs,
+				struct nvmet_req, b.poll_entry);
+		if (!req) {
+			spin_unlock_irq(&poller->lock);
+			wait_event_interruptible(poller->wait,
+					!list_empty_careful(&poller->reqs) ||
+					kthread_should_stop());
+			continue;
+		}
+
+		/* rotate so that every hardware queue gets its turn */
+		list_move_tail(&req->b.poll_entry, &poller->reqs);
+		cookie = req->b.cookie;
+		ns = req->ns;
+		/* the request may complete as soon as we drop the lock */
+		percpu_ref_get(&ns->ref);
+		spin_unlock_irq(&poller->lock);
+
+		blk_poll(bdev_get_queue(ns->bdev), cookie);
+		nvmet_put_namespace(ns);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static void nvmet_bdev_poll_put(void)
+{
+	struct nvmet_bdev_poller *poller;
+	int cpu;
+
+	mutex_lock(&nvmet_bdev_poll_mutex);
+	if (--nvmet_bdev_poll_users)
+		goto out_unlock;
+
+	for_each_possible_cpu(cpu) {
+		poller = per_cpu_ptr(&nvmet_bdev_pollers, cpu);
+		if (!poller->thread)
+			continue;
+		WARN_ON_ONCE(!list_empty(&poller->reqs));
+		kthread_stop(poller->thread);
+		poller->thread = NULL;
+	}
+out_unlock:
+	mutex_unlock(&nvmet_bdev_poll_mutex);
+}
+
+static int nvmet_bdev_poll_get(void)
+{
+	struct nvmet_bdev_poller *poller;
+	struct task_struct *thread;
+	int cpu, ret = 0;
+
+	mutex_lock(&nvmet_bdev_poll_mutex);
+	if (nvmet_bdev_poll_users++)
+		goto out_unlock;
+
+	for_each_online_cpu(cpu) {
+		poller = per_cpu_ptr(&nvmet_bdev_pollers, cpu);
+		spin_lock_init(&poller->lock);
+		INIT_LIST_HEAD(&poller->reqs);
+		init_waitqueue_head(&poller->wait);
+
+		thread = kthread_create_on_cpu(nvmet_bdev_poll_thread, poller,
+				cpu, "nvmet_poll/%u");
+		if (IS_ERR(thread)) {
+			ret = PTR_ERR(thread);
+			goto out_unlock;
+		}
+		poller->thread = thread;
+		wake_up_process(thread);
+	}
+out_unlock:
+	mutex_unlock(&nvmet_bdev_poll_mutex);
+	if (ret)
+		nvmet_bdev_poll_put();
+	return ret;
+}
+
+/*
+ * Called before the bio is submitted, so that the completion always finds
+ * the request on the list.  CPUs that came online after polling was set up
+ * have no thread and fall back to polling inline.
+ */
+static struct nvmet_bdev_poller *nvmet_bdev_poll_add(struct nvmet_req *req)
+{
+	struct nvmet_bdev_poller *poller;
+
+	poller = per_cpu_ptr(&nvmet_bdev_pollers, raw_smp_processor_id());
+	if (!poller->thread)
+		return NULL;
+
+	req->b.poller = poller;
+	req->b.cookie = BLK_QC_T_NONE;
+	spin_lock_irq(&poller->lock);
+	list_add_tail(&req->b.poll_entry, &poller->reqs);
+	spin_unlock_irq(&poller->lock);
+	return poller;
+}
+
+static void nvmet_bdev_poll_start(struct nvmet_bdev_poller *poller,
+		struct nvmet_req *req, blk_qc_t cookie)
+{
+	spin_lock_irq(&poller->lock);
+	/* don't touch the request if it already completed */
+	if (!list_empty(&req->b.poll_entry))
+		req->b.cookie = cookie;
+	spin_unlock_irq(&poller->lock);
+
+	wake_up(&poller->wait);
+}
+
+static void nvmet_bdev_poll_del(struct nvmet_req *req)
+{
+	struct nvmet_bdev_poller *poller = req->b.poller;
+	unsigned long flags;
+
+	spin_lock_irqsave(&poller->lock, flags);
+	list_del_init(&req->b.poll_entry);
+	spin_unlock_irqrestore(&poller->lock, flags);
+}
+
+int nvmet_bdev_ns_enable(struct nvmet_ns *ns)
+{
+	int ret;
+
+	ns->bdev = blkdev_get_by_path(ns->device_path,
+			FMODE_READ | FMODE_WRITE, NULL);
+	if (IS_ERR(ns->bdev)) {
+		ret = PTR_ERR(ns->bdev);
+		if (ret != -ENOTBLK) {
+			pr_err("failed to open block device %s: (%ld)\n",
+					ns->device_path, PTR_ERR(ns->bdev));
+		}
+		ns->bdev = NULL;
+		return ret;
+	}
+	ns->size = i_size_read(ns->bdev->bd_inode);
+	ns->blksize_shift = blksize_bits(bdev_logical_block_size(ns->bdev));
+
+	ns->poll = false;
+	if (ns->use_poll) {
+		if (!test_bit(QUEUE_FLAG_POLL,
+			      &bdev_get_queue(ns->bdev)->queue_flags)) {
+			pr_info("%s does not support polling, not polling it\n",
+				ns->device_path);
+		} else if (!nvmet_bdev_poll_get()) {
+			ns->poll = true;
+		}
+	}
+
+	return 0;
+}
+
+void nvmet_bdev_ns_disable(struct nvmet_ns *ns)
+{
+	if (ns->bdev) {
+		if (ns->poll)
+			nvmet_bdev_poll_put();
+		ns->poll = false;
+		blkdev_put(ns->bdev, FMODE_WRITE | FMODE_READ);
+		ns->bdev = NULL;
+	}
+}
+
+
+static void nvmet_bio_done(struct bio *bio)
+{
+	struct nvmet_req *req = bio->bi_private;
+
+	if (req->b.poller)
+		nvmet_bdev_poll_del(req);
+
+	nvmet_req_complete(req,
+		bio->bi_status ? NVME_SC_INTERNAL | NVME_SC_DNR : 0);
+
+	if (bio != &req->b.inline_bio)
+		bio_put(bio);
+}
+
+static void nvmet_bdev_execute_rw(struct nvmet_req *req)
+{
+	int sg_cnt = req->sg_cnt;
+	struct bio *bio = &req->b.inline_bio;
+	struct nvmet_bdev_poller *poller = NULL;
+	struct scatterlist *sg;
+	sector_t sector;
+	blk_qc_t cookie;
+	int op, op_flags = 0, i;
+
+	if (!req->sg_cnt) {
+		nvmet_req_complete(req, 0);
+		return;
+	}
+
+	if (req->cmd->rw.opcode == nvme_cmd_write) {
+		op = REQ_OP_WRITE;
+		op_flags = REQ_SYNC | REQ_IDLE;
+		if (req->cmd->rw.control & cpu_to_le16(NVME_RW_FUA))
+			op_flags |= REQ_FUA;
+	} else {
+		op = REQ_OP_READ;
+	}
+
+	sector = le64_to_cpu(req->cmd->rw.slba);
+	sector <<= (req->ns->blksize_shift - 9);
+
+	bio_init(bio, req->inline_bvec, ARRAY_SIZE(req->inline_bvec));
+	bio_set_dev(bio, req->ns->bdev);
+	bio->bi_iter.bi_sector = sector;
+	bio->bi_private = req;
+	bio->bi_end_io = nvmet_bio_done;
+	bio_set_op_attrs(bio, op, op_flags);
+
+	for_each_sg(req->sg, sg, req->sg_cnt, i) {
+		while (bio_add_page(bio, sg_page(sg), sg->length, sg->offset)
+				!= sg->length) {
+			struct bio *prev = bio;
+
+			bio = bio_alloc(GFP_KERNEL, min(sg_cnt, BIO_MAX_PAGES));
+			bio_set_dev(bio, req->ns->bdev);
+			bio->bi_iter.bi_sector = sector;
+			bio_set_op_attrs(bio, op, op_flags);
+
+			bio_chain(bio, prev);
+			submit_bio(prev);
+		}
+
+		sector += sg->length >> 9;
+		sg_cnt--;
+	}
+
+	if (req->ns->poll)
+		poller = nvmet_bdev_poll_add(req);
+
+	cookie = submit_bio(bio);
+
+	if (poller)
+		nvmet_bdev_poll_start(poller, req, cookie);
+	else
+		blk_poll(bdev_get_queue(req->ns->bdev), cookie);
+}
+
+static void nvmet_bdev_execute_flush(struct nvmet_req *req)
+{
+	struct bio *bio = &req->b.inline_bio;
+
+	bio_init(bio, req->inline_bvec, ARRAY_SIZE(req->inline_bvec));
+	bio_set_dev(bio, req->ns->bdev);
+	bio->bi_private = req;
+	bio->bi_end_io = nvmet_bio_done;
+	bio->bi_opf = REQ_OP_WRITE | REQ_PREFLUSH;
+
+	submit_bio(bio);
+}
+
+static u16 nvmet_bdev_discard_range(struct nvmet_ns *ns,
+		struct nvme_dsm_range *range, struct bio **bio)
+{
+	int ret;
+
+	ret = __blkdev_issue_discard(ns->bdev,
+			le64_to_cpu(range->slba) << (ns->blksize_shift - 9),
+			le32_to_cpu(range->nlb) << (ns->blksize_shift - 9),
+			GFP_KERNEL, 0, bio);
+	if (ret && ret != -EOPNOTSUPP)
+		return NVME_SC_INTERNAL | NVME_SC_DNR;
+	return 0;
+}
+
+static void nvmet_bdev_execute_discard(struct nvmet_req *req)
+{
+	struct nvme_dsm_range range;
+	struct bio *bio = NULL;
+	int i;
+	u16 status;
+
+	for (i = 0; i <= le32_to_cpu(req->cmd->dsm.nr); i++) {
+		status = nvmet_copy_from_sgl(req, i * sizeof(range), &range,
+				sizeof(range));
+		if (status)
+			break;
+
+		status = nvmet_bdev_discard_range(req->ns, &range, &bio);
+		if (status)
+			break;
+	}
+
+	if (bio) {
+		bio->bi_private = req;
+		bio->bi_end_io = nvmet_bio_done;
+		if (status) {
+			bio->bi_status = BLK_STS_IOERR;
+			bio_endio(bio);
+		} else {
+			submit_bio(bio);
+		}
+	} else {
+		nvmet_req_complete(req, status);
+	}
+}
+
+static void nvmet_bdev_execute_dsm(struct nvmet_req *req)
+{
+	switch (le32_to_cpu(req->cmd->dsm.attributes)) {
+	case NVME_DSMGMT_AD:
+		nvmet_bdev_execute_discard(req);
+		return;
+	case NVME_DSMGMT_IDR:
+	case NVME_DSMGMT_IDW:
+	default:
+		/* Not supported yet */
+		nvmet_req_complete(req, 0);
+		return;
+	}
+}
+
+static void nvmet_bdev_execute_write_zeroes(struct nvmet_req *req)
+{
+	struct nvme_write_zeroes_cmd *write_zeroes = &req->cmd->write_zeroes;
+	struct bio *bio = NULL;
+	u16 status = NVME_SC_SUCCESS;
+	sector_t sector;
+	sector_t nr_sector;
+
+	sector = le64_to_cpu(write_zeroes->slba) <<
+		(req->ns->blksize_shift - 9);
+	nr_sector = (((sector_t)le16_to_cpu(write_zeroes->length) + 1) <<
+		(req->ns->blksize_shift - 9));
+
+	if (__blkdev_issue_zeroout(req->ns->bdev, sector, nr_sector,
+				GFP_KERNEL, &bio, 0))
+		status = NVME_SC_INTERNAL | NVME_SC_DNR;
+
+	if (bio) {
+		bio->bi_private = req;
+		bio->bi_end_io = nvmet_bio_done;
+		submit_bio(bio);
+	} else {
+		nvmet_req_complete(req, status);
+	}
+}
+
+u16 nvmet_bdev_parse_io_cmd(struct nvmet_req *req)
+{
+	struct nvme_command *cmd = req->cmd;
+
+	req->b.poller = NULL;
+
+	switch (cmd->common.opcode) {
+	case nvme_cmd_read:
+	case nvme_cmd_write:
+		req->execute = nvmet_bdev_execute_rw;
+		req->data_len = nvmet_rw_len(req);
+		return 0;
+	case nvme_cmd_flush:
+		req->execute = nvmet_bdev_execute_flush;
+		req->data_len = 0;
+		return 0;
+	case nvme_cmd_dsm:
+		req->execute = nvmet_bdev_execute_dsm;
+		req->data_len = (le32_to_cpu(cmd->dsm.nr) + 1) *
+			sizeof(struct nvme_dsm_range);
+		return 0;
+	case nvme_cmd_write_zeroes:
+		req->execute = nvmet_bdev_execute_write_zeroes;
+		return 0;
+	default:
+		pr_err("unhandled cmd %d on qid %d\n", cmd->common.opcode,
+		       req->sq->qid);
+		return NVME_SC_INVALID_OPCODE | NVME_SC_DNR;
+	}
+}
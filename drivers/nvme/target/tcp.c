@@ -0,0 +1,1850 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NVMe over Fabrics TCP target.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/highmem.h>
+#include <linux/inet.h>
+#include <linux/llist.h>
+#include <linux/nvme-tcp.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+#include <crypto/hash.h>
+
+#include "nvmet.h"
+
+/*
+ * We allow up to four pages of in-capsule data on the I/O queues, writes
+ * beyond that are solicited with R2Ts.
+ */
+#define NVMET_TCP_INLINE_DATA_SIZE	(4 * PAGE_SIZE)
+
+/* largest H2C data PDU we solicit with a single R2T */
+#define NVMET_TCP_MAXH2CDATA		0x400000
+
+#define NVMET_TCP_RECV_BUDGET		8
+#define NVMET_TCP_SEND_BUDGET		8
+
+enum nvmet_tcp_send_state {
+	NVMET_TCP_SEND_DATA_PDU = 0,
+	NVMET_TCP_SEND_DATA,
+	NVMET_TCP_SEND_R2T,
+	NVMET_TCP_SEND_DDGST,
+	NVMET_TCP_SEND_RESPONSE,
+};
+
+enum nvmet_tcp_recv_state {
+	NVMET_TCP_RECV_PDU = 0,
+	NVMET_TCP_RECV_DATA,
+	NVMET_TCP_RECV_DDGST,
+	NVMET_TCP_RECV_ERR,
+};
+
+enum {
+	NVMET_TCP_F_INIT_FAILED	= (1 << 0),
+};
+
+struct nvmet_tcp_cmd {
+	struct nvmet_tcp_queue		*queue;
+	struct nvmet_req		req;
+
+	struct nvme_tcp_cmd_pdu		*cmd_pdu;
+	struct nvme_tcp_rsp_pdu		*rsp_pdu;
+	struct nvme_tcp_data_pdu	*data_pdu;
+	struct nvme_tcp_r2t_pdu		*r2t_pdu;
+
+	u32				rbytes_done;
+	u32				wbytes_done;
+
+	/* data of the PDU currently being received */
+	u32				pdu_len;
+	u32				pdu_recv;
+	int				nr_mapped;
+	struct msghdr			recv_msg;
+	struct bio_vec			*iov;
+	u32				flags;
+
+	struct list_head		entry;
+	struct llist_node		lentry;
+
+	/* send state */
+	u32				offset;
+	struct scatterlist		*cur_sg;
+	enum nvmet_tcp_send_state	state;
+
+	__le32				exp_ddgst;
+	__le32				recv_ddgst;
+};
+
+enum nvmet_tcp_queue_state {
+	NVMET_TCP_Q_CONNECTING,
+	NVMET_TCP_Q_LIVE,
+	NVMET_TCP_Q_DISCONNECTING,
+};
+
+struct nvmet_tcp_queue {
+	struct socket		*sock;
+	struct nvmet_tcp_port	*port;
+	struct work_struct	io_work;
+	int			cpu;
+	struct nvmet_cq		nvme_cq;
+	struct nvmet_sq		nvme_sq;
+
+	/* send state */
+	struct nvmet_tcp_cmd	*cmds;
+	unsigned int		nr_cmds;
+	struct list_head	free_list;
+	struct llist_head	resp_list;
+	struct list_head	resp_send_list;
+	struct nvmet_tcp_cmd	*snd_cmd;
+
+	/* recv state */
+	int			offset;
+	int			left;
+	enum nvmet_tcp_recv_state rcv_state;
+	struct nvmet_tcp_cmd	*cmd;
+	union nvme_tcp_pdu	pdu;
+
+	/* digest state */
+	bool			hdr_digest;
+	bool			data_digest;
+	struct shash_desc	*snd_hash;
+	struct shash_desc	*rcv_hash;
+
+	spinlock_t		state_lock;
+	enum nvmet_tcp_queue_state state;
+
+	struct sockaddr_storage	sockaddr;
+	struct sockaddr_storage	sockaddr_peer;
+	struct work_struct	release_work;
+
+	int			idx;
+	struct list_head	queue_list;
+
+	struct nvmet_tcp_cmd	connect;
+
+	void (*data_ready)(struct sock *);
+	void (*state_change)(struct sock *);
+	void (*write_space)(struct sock *);
+};
+
+struct nvmet_tcp_port {
+	struct socket		*sock;
+	struct work_struct	accept_work;
+	struct nvmet_port	*nport;
+	struct sockaddr_storage addr;
+	int			last_cpu;
+	void (*data_ready)(struct sock *);
+};
+
+static DEFINE_IDA(nvmet_tcp_queue_ida);
+static LIST_HEAD(nvmet_tcp_queue_list);
+static DEFINE_MUTEX(nvmet_tcp_queue_mutex);
+
+static struct workqueue_struct *nvmet_tcp_wq;
+static const struct nvmet_fabrics_ops nvmet_tcp_ops;
+
+static inline u16 nvmet_tcp_cmd_tag(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *cmd)
+{
+	return cmd - queue->cmds;
+}
+
+static inline bool nvmet_tcp_need_data_in(struct nvmet_tcp_cmd *cmd)
+{
+	return nvme_is_write(cmd->req.cmd) &&
+		cmd->rbytes_done < cmd->req.transfer_len &&
+		!cmd->req.rsp->status;
+}
+
+static inline bool nvmet_tcp_need_data_out(struct nvmet_tcp_cmd *cmd)
+{
+	return !nvme_is_write(cmd->req.cmd) &&
+		cmd->req.transfer_len > 0 &&
+		!cmd->req.rsp->status;
+}
+
+static inline bool nvmet_tcp_has_inline_data(struct nvmet_tcp_cmd *cmd)
+{
+	return nvme_is_write(cmd->req.cmd) && cmd->pdu_len &&
+		!cmd->rbytes_done;
+}
+
+static inline u8 nvmet_tcp_hdgst_len(struct nvmet_tcp_queue *queue)
+{
+	return queue->hdr_digest ? NVME_TCP_DIGEST_LENGTH : 0;
+}
+
+static inline u8 nvmet_tcp_ddgst_len(struct nvmet_tcp_queue *queue)
+{
+	return queue->data_digest ? NVME_TCP_DIGEST_LENGTH : 0;
+}
+
+/*
+ * The admin queue (and any queue that has not been connected yet, which
+ * is where the connect command itself arrives) takes the fixed admin
+ * capsule size, I/O queues what we advertise in IOCCSZ.
+ */
+static inline u32 nvmet_tcp_inline_data_size(struct nvmet_tcp_queue *queue)
+{
+	return queue->nvme_sq.qid ? queue->port->nport->inline_data_size :
+		NVME_TCP_ADMIN_CCSZ;
+}
+
+static inline struct nvmet_tcp_cmd *
+nvmet_tcp_get_cmd(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd;
+
+	cmd = list_first_entry_or_null(&queue->free_list,
+				struct nvmet_tcp_cmd, entry);
+	if (!cmd)
+		return NULL;
+	list_del_init(&cmd->entry);
+
+	cmd->rbytes_done = cmd->wbytes_done = 0;
+	cmd->pdu_len = 0;
+	cmd->pdu_recv = 0;
+	cmd->iov = NULL;
+	cmd->flags = 0;
+	return cmd;
+}
+
+static inline void nvmet_tcp_put_cmd(struct nvmet_tcp_cmd *cmd)
+{
+	/* the connect command is not part of the command pool */
+	if (unlikely(cmd == &cmd->queue->connect))
+		return;
+
+	list_add_tail(&cmd->entry, &cmd->queue->free_list);
+}
+
+static inline void nvmet_tcp_hdgst(struct shash_desc *hash,
+		void *pdu, size_t len)
+{
+	crypto_shash_digest(hash, pdu, len, pdu + len);
+}
+
+static inline void nvmet_tcp_ddgst_update(struct shash_desc *hash,
+		struct page *page, size_t off, size_t len)
+{
+	void *vaddr = kmap_atomic(page);
+
+	crypto_shash_update(hash, vaddr + off, len);
+	kunmap_atomic(vaddr);
+}
+
+static int nvmet_tcp_verify_hdgst(struct nvmet_tcp_queue *queue,
+		void *pdu, size_t len)
+{
+	struct nvme_tcp_hdr *hdr = pdu;
+	__le32 recv_digest;
+	__le32 exp_digest;
+
+	if (unlikely(!(hdr->flags & NVME_TCP_F_HDGST))) {
+		pr_err("queue %d: header digest enabled but no header digest\n",
+			queue->idx);
+		return -EPROTO;
+	}
+
+	recv_digest = *(__le32 *)(pdu + hdr->hlen);
+	nvmet_tcp_hdgst(queue->rcv_hash, pdu, len);
+	exp_digest = *(__le32 *)(pdu + hdr->hlen);
+	if (recv_digest != exp_digest) {
+		pr_err("queue %d: header digest error: recv %#x expected %#x\n",
+			queue->idx, le32_to_cpu(recv_digest),
+			le32_to_cpu(exp_digest));
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the number of data bytes carried by a received PDU, after
+ * checking that the data sits where we said it should (cpda is zero, so
+ * right behind the header and its digest) and that it is digested iff
+ * data digests were negotiated.
+ */
+static int nvmet_tcp_pdu_data_len(struct nvmet_tcp_queue *queue,
+		struct nvme_tcp_hdr *hdr)
+{
+	u8 ddgst = (hdr->flags & NVME_TCP_F_DDGST) ? NVME_TCP_DIGEST_LENGTH : 0;
+	u32 plen = le32_to_cpu(hdr->plen);
+
+	if (!hdr->pdo)
+		return 0;
+
+	if (unlikely(hdr->pdo != hdr->hlen + nvmet_tcp_hdgst_len(queue) ||
+		     plen <= hdr->pdo + ddgst)) {
+		pr_err("queue %d: bad pdo %d plen %u\n",
+			queue->idx, hdr->pdo, plen);
+		return -EPROTO;
+	}
+
+	if (unlikely(queue->data_digest != !!ddgst)) {
+		pr_err("queue %d: data digest flag is %s\n", queue->idx,
+			ddgst ? "set" : "cleared");
+		return -EPROTO;
+	}
+
+	return plen - hdr->pdo - ddgst;
+}
+
+static void nvmet_tcp_free_cmd_buffers(struct nvmet_tcp_cmd *cmd)
+{
+	kfree(cmd->iov);
+	sgl_free(cmd->req.sg);
+	cmd->iov = NULL;
+	cmd->req.sg = NULL;
+}
+
+static void nvmet_tcp_map_pdu_iovec(struct nvmet_tcp_cmd *cmd)
+{
+	struct bio_vec *iov = cmd->iov;
+	struct scatterlist *sg;
+	u32 length, offset;
+
+	length = cmd->pdu_len;
+	offset = cmd->rbytes_done;
+	/* sgl_alloc() hands out a flat table of order-0 pages */
+	sg = &cmd->req.sg[offset / PAGE_SIZE];
+	offset %= PAGE_SIZE;
+
+	cmd->nr_mapped = 0;
+	while (length) {
+		u32 iov_len = min_t(u32, length, sg->length - offset);
+
+		iov->bv_page = sg_page(sg);
+		iov->bv_offset = sg->offset + offset;
+		iov->bv_len = iov_len;
+
+		length -= iov_len;
+		sg = sg_next(sg);
+		iov++;
+		offset = 0;
+		cmd->nr_mapped++;
+	}
+
+	iov_iter_bvec(&cmd->recv_msg.msg_iter, READ | ITER_BVEC,
+		cmd->iov, cmd->nr_mapped, cmd->pdu_len);
+}
+
+static void nvmet_tcp_fatal_error(struct nvmet_tcp_queue *queue)
+{
+	queue->rcv_state = NVMET_TCP_RECV_ERR;
+	if (queue->nvme_sq.ctrl)
+		nvmet_ctrl_fatal_error(queue->nvme_sq.ctrl);
+	else
+		kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+}
+
+static int nvmet_tcp_alloc_data(struct nvmet_tcp_cmd *cmd, u32 len)
+{
+	cmd->req.sg = sgl_alloc(len, GFP_KERNEL, &cmd->req.sg_cnt);
+	if (!cmd->req.sg)
+		return -ENOMEM;
+	cmd->cur_sg = cmd->req.sg;
+
+	if (nvme_is_write(cmd->req.cmd)) {
+		cmd->iov = kmalloc_array(cmd->req.sg_cnt,
+				sizeof(*cmd->iov), GFP_KERNEL);
+		if (!cmd->iov) {
+			sgl_free(cmd->req.sg);
+			cmd->req.sg = NULL;
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static u16 nvmet_tcp_map_data(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_sgl_desc *sgl = &cmd->req.cmd->common.dptr.sgl;
+	u32 len = le32_to_cpu(sgl->length);
+
+	if (sgl->type == ((NVME_SGL_FMT_DATA_DESC << 4) |
+			  NVME_SGL_FMT_OFFSET)) {
+		if (!nvme_is_write(cmd->req.cmd))
+			return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+
+		if (sgl->addr || len != cmd->pdu_len ||
+		    len > nvmet_tcp_inline_data_size(cmd->queue)) {
+			pr_err("invalid inline data offset!\n");
+			return NVME_SC_SGL_INVALID_OFFSET | NVME_SC_DNR;
+		}
+	} else if (sgl->type == ((NVME_TRANSPORT_SGL_DATA_DESC << 4) |
+				 NVME_SGL_FMT_TRANSPORT_A)) {
+		if (cmd->pdu_len)
+			return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	} else {
+		pr_err("invalid SGL type: %#x\n", sgl->type);
+		return NVME_SC_SGL_INVALID_TYPE | NVME_SC_DNR;
+	}
+
+	/* no data command? */
+	if (!len)
+		return 0;
+
+	if (nvmet_tcp_alloc_data(cmd, len))
+		return NVME_SC_INTERNAL;
+
+	cmd->req.transfer_len += len;
+	return 0;
+}
+
+static void nvmet_setup_c2h_data_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_tcp_data_pdu *pdu = cmd->data_pdu;
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 hdgst = nvmet_tcp_hdgst_len(cmd->queue);
+	u8 ddgst = nvmet_tcp_ddgst_len(cmd->queue);
+
+	cmd->offset = 0;
+	cmd->state = NVMET_TCP_SEND_DATA_PDU;
+
+	pdu->hdr.type = nvme_tcp_c2h_data;
+	pdu->hdr.flags = NVME_TCP_F_DATA_LAST;
+	if (queue->hdr_digest)
+		pdu->hdr.flags |= NVME_TCP_F_HDGST;
+	if (queue->data_digest)
+		pdu->hdr.flags |= NVME_TCP_F_DDGST;
+	pdu->hdr.hlen = sizeof(*pdu);
+	pdu->hdr.pdo = pdu->hdr.hlen + hdgst;
+	pdu->hdr.plen =
+		cpu_to_le32(pdu->hdr.hlen + hdgst +
+				cmd->req.transfer_len + ddgst);
+	pdu->command_id = cmd->req.cmd->common.command_id;
+	pdu->ttag = 0;
+	pdu->data_length = cpu_to_le32(cmd->req.transfer_len);
+	pdu->data_offset = cpu_to_le32(cmd->wbytes_done);
+
+	if (queue->hdr_digest)
+		nvmet_tcp_hdgst(queue->snd_hash, pdu, sizeof(*pdu));
+}
+
+static void nvmet_setup_r2t_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_tcp_r2t_pdu *pdu = cmd->r2t_pdu;
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 hdgst = nvmet_tcp_hdgst_len(cmd->queue);
+
+	cmd->offset = 0;
+	cmd->state = NVMET_TCP_SEND_R2T;
+
+	pdu->hdr.type = nvme_tcp_r2t;
+	pdu->hdr.flags = 0;
+	if (queue->hdr_digest)
+		pdu->hdr.flags |= NVME_TCP_F_HDGST;
+	pdu->hdr.hlen = sizeof(*pdu);
+	pdu->hdr.pdo = 0;
+	pdu->hdr.plen = cpu_to_le32(pdu->hdr.hlen + hdgst);
+
+	pdu->command_id = cmd->req.cmd->common.command_id;
+	pdu->ttag = nvmet_tcp_cmd_tag(cmd->queue, cmd);
+	pdu->r2t_length = cpu_to_le32(min_t(u32, NVMET_TCP_MAXH2CDATA,
+				cmd->req.transfer_len - cmd->rbytes_done));
+	pdu->r2t_offset = cpu_to_le32(cmd->rbytes_done);
+
+	if (queue->hdr_digest)
+		nvmet_tcp_hdgst(queue->snd_hash, pdu, sizeof(*pdu));
+}
+
+static void nvmet_setup_response_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_tcp_rsp_pdu *pdu = cmd->rsp_pdu;
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 hdgst = nvmet_tcp_hdgst_len(cmd->queue);
+
+	cmd->offset = 0;
+	cmd->state = NVMET_TCP_SEND_RESPONSE;
+
+	pdu->hdr.type = nvme_tcp_rsp;
+	pdu->hdr.flags = 0;
+	if (queue->hdr_digest)
+		pdu->hdr.flags |= NVME_TCP_F_HDGST;
+	pdu->hdr.hlen = sizeof(*pdu);
+	pdu->hdr.pdo = 0;
+	pdu->hdr.plen = cpu_to_le32(pdu->hdr.hlen + hdgst);
+
+	if (queue->hdr_digest)
+		nvmet_tcp_hdgst(queue->snd_hash, pdu, sizeof(*pdu));
+}
+
+static void nvmet_tcp_process_resp_list(struct nvmet_tcp_queue *queue)
+{
+	struct llist_node *node;
+	struct nvmet_tcp_cmd *cmd;
+
+	node = llist_reverse_order(llist_del_all(&queue->resp_list));
+	while (node) {
+		cmd = llist_entry(node, struct nvmet_tcp_cmd, lentry);
+		node = node->next;
+		list_add_tail(&cmd->entry, &queue->resp_send_list);
+	}
+}
+
+static struct nvmet_tcp_cmd *nvmet_tcp_fetch_cmd(struct nvmet_tcp_queue *queue)
+{
+	queue->snd_cmd = list_first_entry_or_null(&queue->resp_send_list,
+				struct nvmet_tcp_cmd, entry);
+	if (!queue->snd_cmd) {
+		nvmet_tcp_process_resp_list(queue);
+		queue->snd_cmd =
+			list_first_entry_or_null(&queue->resp_send_list,
+					struct nvmet_tcp_cmd, entry);
+		if (unlikely(!queue->snd_cmd))
+			return NULL;
+	}
+
+	list_del_init(&queue->snd_cmd->entry);
+
+	if (nvmet_tcp_need_data_out(queue->snd_cmd))
+		nvmet_setup_c2h_data_pdu(queue->snd_cmd);
+	else if (nvmet_tcp_need_data_in(queue->snd_cmd))
+		nvmet_setup_r2t_pdu(queue->snd_cmd);
+	else
+		nvmet_setup_response_pdu(queue->snd_cmd);
+
+	return queue->snd_cmd;
+}
+
+static void nvmet_tcp_queue_response(struct nvmet_req *req)
+{
+	struct nvmet_tcp_cmd *cmd =
+		container_of(req, struct nvmet_tcp_cmd, req);
+	struct nvmet_tcp_queue *queue = cmd->queue;
+
+	/*
+	 * A command failed by nvmet_req_init() may still have in-capsule
+	 * data on the wire, which has to be consumed before the response
+	 * goes out and the command is recycled.
+	 */
+	if (unlikely(cmd == queue->cmd &&
+		     queue->rcv_state == NVMET_TCP_RECV_PDU &&
+		     cmd->pdu_len && nvme_is_write(req->cmd)))
+		return;
+
+	llist_add(&cmd->lentry, &queue->resp_list);
+	queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+}
+
+static bool nvmet_tcp_more_to_send(struct nvmet_tcp_queue *queue)
+{
+	return !list_empty(&queue->resp_send_list) ||
+		!llist_empty(&queue->resp_list);
+}
+
+static int nvmet_tcp_send_buf(struct nvmet_tcp_queue *queue, void *buf,
+		size_t len, int flags)
+{
+	struct msghdr msg = { .msg_flags = flags };
+	struct kvec iov = { .iov_base = buf, .iov_len = len };
+
+	return kernel_sendmsg(queue->sock, &msg, &iov, 1, len);
+}
+
+static int nvmet_try_send_data_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 hdgst = nvmet_tcp_hdgst_len(queue);
+	int left = sizeof(*cmd->data_pdu) - cmd->offset + hdgst;
+	int ret;
+
+	ret = nvmet_tcp_send_buf(queue, (void *)cmd->data_pdu + cmd->offset,
+			left, MSG_DONTWAIT | MSG_MORE);
+	if (ret <= 0)
+		return ret;
+
+	cmd->offset += ret;
+	left -= ret;
+	if (left)
+		return -EAGAIN;
+
+	cmd->state = NVMET_TCP_SEND_DATA;
+	cmd->offset = 0;
+	if (queue->data_digest)
+		crypto_shash_init(queue->snd_hash);
+	return 1;
+}
+
+/*
+ * Read data is handed to the socket straight out of the pages the backend
+ * filled, with sendpage, so it is never copied on the target side either;
+ * the data digest is computed as the pages go out.
+ */
+static int nvmet_try_send_data(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	int ret;
+
+	while (cmd->cur_sg) {
+		struct page *page = sg_page(cmd->cur_sg);
+		u32 offset = cmd->cur_sg->offset + cmd->offset;
+		u32 left = cmd->cur_sg->length - cmd->offset;
+
+		/* the response always follows */
+		ret = kernel_sendpage(queue->sock, page, offset, left,
+				MSG_DONTWAIT | MSG_MORE);
+		if (ret <= 0)
+			return ret;
+
+		if (queue->data_digest)
+			nvmet_tcp_ddgst_update(queue->snd_hash, page,
+					offset, ret);
+
+		cmd->offset += ret;
+		cmd->wbytes_done += ret;
+
+		/* done with this sg? */
+		if (cmd->offset == cmd->cur_sg->length) {
+			cmd->cur_sg = sg_next(cmd->cur_sg);
+			cmd->offset = 0;
+		}
+	}
+
+	if (queue->data_digest) {
+		crypto_shash_final(queue->snd_hash, (u8 *)&cmd->exp_ddgst);
+		cmd->state = NVMET_TCP_SEND_DDGST;
+		cmd->offset = 0;
+	} else {
+		nvmet_setup_response_pdu(cmd);
+	}
+	return 1;
+}
+
+static int nvmet_try_send_ddgst(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	int left = NVME_TCP_DIGEST_LENGTH - cmd->offset;
+	int ret;
+
+	ret = nvmet_tcp_send_buf(queue, (void *)&cmd->exp_ddgst + cmd->offset,
+			left, MSG_DONTWAIT | MSG_MORE);
+	if (unlikely(ret <= 0))
+		return ret;
+
+	cmd->offset += ret;
+	if (cmd->offset < NVME_TCP_DIGEST_LENGTH)
+		return -EAGAIN;
+
+	nvmet_setup_response_pdu(cmd);
+	return 1;
+}
+
+static int nvmet_try_send_response(struct nvmet_tcp_cmd *cmd,
+		bool last_in_batch)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 hdgst = nvmet_tcp_hdgst_len(queue);
+	int left = sizeof(*cmd->rsp_pdu) - cmd->offset + hdgst;
+	int flags = MSG_DONTWAIT;
+	int ret;
+
+	flags |= last_in_batch ? MSG_EOR : MSG_MORE;
+
+	ret = nvmet_tcp_send_buf(queue, (void *)cmd->rsp_pdu + cmd->offset,
+			left, flags);
+	if (ret <= 0)
+		return ret;
+
+	cmd->offset += ret;
+	left -= ret;
+	if (left)
+		return -EAGAIN;
+
+	nvmet_tcp_free_cmd_buffers(cmd);
+	queue->snd_cmd = NULL;
+	nvmet_tcp_put_cmd(cmd);
+	return 1;
+}
+
+static int nvmet_try_send_r2t(struct nvmet_tcp_cmd *cmd, bool last_in_batch)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 hdgst = nvmet_tcp_hdgst_len(queue);
+	int left = sizeof(*cmd->r2t_pdu) - cmd->offset + hdgst;
+	int flags = MSG_DONTWAIT;
+	int ret;
+
+	flags |= last_in_batch ? MSG_EOR : MSG_MORE;
+
+	ret = nvmet_tcp_send_buf(queue, (void *)cmd->r2t_pdu + cmd->offset,
+			left, flags);
+	if (ret <= 0)
+		return ret;
+
+	cmd->offset += ret;
+	left -= ret;
+	if (left)
+		return -EAGAIN;
+
+	/* the command stays around until its data arrives */
+	queue->snd_cmd = NULL;
+	return 1;
+}
+
+static int nvmet_tcp_try_send_one(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->snd_cmd;
+	bool last_in_batch;
+	int ret = 0;
+
+	if (!cmd) {
+		cmd = nvmet_tcp_fetch_cmd(queue);
+		if (unlikely(!cmd))
+			return 0;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_DATA_PDU) {
+		ret = nvmet_try_send_data_pdu(cmd);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_DATA) {
+		ret = nvmet_try_send_data(cmd);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_DDGST) {
+		ret = nvmet_try_send_ddgst(cmd);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	/* only push the socket once there is nothing queued behind us */
+	last_in_batch = !nvmet_tcp_more_to_send(queue);
+
+	if (cmd->state == NVMET_TCP_SEND_R2T) {
+		ret = nvmet_try_send_r2t(cmd, last_in_batch);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_RESPONSE)
+		ret = nvmet_try_send_response(cmd, last_in_batch);
+
+done_send:
+	if (ret < 0) {
+		if (ret == -EAGAIN)
+			return 0;
+		return ret;
+	}
+
+	return 1;
+}
+
+static int nvmet_tcp_try_send(struct nvmet_tcp_queue *queue, int budget)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < budget; i++) {
+		ret = nvmet_tcp_try_send_one(queue);
+		if (ret <= 0)
+			break;
+	}
+
+	return ret < 0 ? ret : i;
+}
+
+static void nvmet_prepare_receive_pdu(struct nvmet_tcp_queue *queue)
+{
+	queue->offset = 0;
+	queue->left = sizeof(struct nvme_tcp_hdr);
+	queue->cmd = NULL;
+	queue->rcv_state = NVMET_TCP_RECV_PDU;
+}
+
+static void nvmet_tcp_free_crypto(struct nvmet_tcp_queue *queue)
+{
+	struct crypto_shash *tfm = queue->rcv_hash->tfm;
+
+	kfree(queue->rcv_hash);
+	kfree(queue->snd_hash);
+	crypto_free_shash(tfm);
+}
+
+static int nvmet_tcp_alloc_crypto(struct nvmet_tcp_queue *queue)
+{
+	struct crypto_shash *tfm;
+	size_t size;
+
+	tfm = crypto_alloc_shash("crc32c", 0, 0);
+	if (IS_ERR(tfm))
+		return PTR_ERR(tfm);
+
+	size = sizeof(struct shash_desc) + crypto_shash_descsize(tfm);
+	queue->snd_hash = kzalloc(size, GFP_KERNEL);
+	if (!queue->snd_hash)
+		goto free_tfm;
+	queue->snd_hash->tfm = tfm;
+
+	queue->rcv_hash = kzalloc(size, GFP_KERNEL);
+	if (!queue->rcv_hash)
+		goto free_snd_hash;
+	queue->rcv_hash->tfm = tfm;
+
+	return 0;
+free_snd_hash:
+	kfree(queue->snd_hash);
+free_tfm:
+	crypto_free_shash(tfm);
+	return -ENOMEM;
+}
+
+static int nvmet_tcp_handle_icreq(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_icreq_pdu *icreq = &queue->pdu.icreq;
+	struct nvme_tcp_icresp_pdu *icresp = &queue->pdu.icresp;
+	struct msghdr msg = {};
+	struct kvec iov;
+	int ret;
+
+	if (le32_to_cpu(icreq->hdr.plen) != sizeof(*icreq)) {
+		pr_err("queue %d: bad icreq pdu length %d\n",
+			queue->idx, le32_to_cpu(icreq->hdr.plen));
+		return -EPROTO;
+	}
+
+	if (icreq->pfv != NVME_TCP_PFV_1_0) {
+		pr_err("queue %d: bad pfv %d\n", queue->idx, icreq->pfv);
+		return -EPROTO;
+	}
+
+	if (icreq->hpda != 0) {
+		pr_err("queue %d: unsupported hpda %d\n",
+			queue->idx, icreq->hpda);
+		return -EPROTO;
+	}
+
+	queue->hdr_digest = !!(icreq->digest & NVME_TCP_HDR_DIGEST_ENABLE);
+	queue->data_digest = !!(icreq->digest & NVME_TCP_DATA_DIGEST_ENABLE);
+	if (queue->hdr_digest || queue->data_digest) {
+		ret = nvmet_tcp_alloc_crypto(queue);
+		if (ret) {
+			queue->hdr_digest = queue->data_digest = false;
+			return ret;
+		}
+	}
+
+	memset(icresp, 0, sizeof(*icresp));
+	icresp->hdr.type = nvme_tcp_icresp;
+	icresp->hdr.hlen = sizeof(*icresp);
+	icresp->hdr.pdo = 0;
+	icresp->hdr.plen = cpu_to_le32(icresp->hdr.hlen);
+	icresp->pfv = cpu_to_le16(NVME_TCP_PFV_1_0);
+	icresp->maxdata = cpu_to_le32(NVMET_TCP_MAXH2CDATA);
+	icresp->cpda = 0; /* no alignment constraint */
+	if (queue->hdr_digest)
+		icresp->digest |= NVME_TCP_HDR_DIGEST_ENABLE;
+	if (queue->data_digest)
+		icresp->digest |= NVME_TCP_DATA_DIGEST_ENABLE;
+
+	iov.iov_base = icresp;
+	iov.iov_len = sizeof(*icresp);
+	ret = kernel_sendmsg(queue->sock, &msg, &iov, 1, iov.iov_len);
+	if (ret < 0)
+		return ret; /* crypto is released with the queue */
+
+	spin_lock_bh(&queue->state_lock);
+	if (queue->state == NVMET_TCP_Q_CONNECTING)
+		queue->state = NVMET_TCP_Q_LIVE;
+	spin_unlock_bh(&queue->state_lock);
+	nvmet_prepare_receive_pdu(queue);
+	return 0;
+}
+
+/*
+ * nvmet_req_init() failed, so there is no command to execute, but any
+ * in-capsule data still has to be drained from the socket before the
+ * error response can go out.
+ */
+static void nvmet_tcp_handle_req_failure(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *cmd)
+{
+	if (!cmd->pdu_len) {
+		nvmet_prepare_receive_pdu(queue);
+		return;
+	}
+
+	if (!nvme_is_write(cmd->req.cmd) ||
+	    cmd->pdu_len > nvmet_tcp_inline_data_size(queue) ||
+	    nvmet_tcp_alloc_data(cmd, cmd->pdu_len)) {
+		nvmet_tcp_fatal_error(queue);
+		return;
+	}
+
+	cmd->flags |= NVMET_TCP_F_INIT_FAILED;
+	nvmet_tcp_map_pdu_iovec(cmd);
+	queue->rcv_state = NVMET_TCP_RECV_DATA;
+}
+
+static int nvmet_tcp_handle_h2c_data_pdu(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_data_pdu *data = &queue->pdu.data;
+	struct nvmet_tcp_cmd *cmd;
+	int data_len;
+
+	if (unlikely(data->ttag >= queue->nr_cmds)) {
+		pr_err("queue %d: received out of bound ttag %u, nr_cmds %u\n",
+			queue->idx, data->ttag, queue->nr_cmds);
+		return -EPROTO;
+	}
+	cmd = &queue->cmds[data->ttag];
+
+	if (unlikely(!nvmet_tcp_need_data_in(cmd) ||
+		     le32_to_cpu(data->data_offset) != cmd->rbytes_done)) {
+		pr_err("queue %d ttag %u unexpected data offset %u (expected %u)\n",
+			queue->idx, data->ttag,
+			le32_to_cpu(data->data_offset), cmd->rbytes_done);
+		return -EPROTO;
+	}
+
+	data_len = nvmet_tcp_pdu_data_len(queue, &data->hdr);
+	if (unlikely(data_len < 0))
+		return data_len;
+
+	cmd->pdu_len = le32_to_cpu(data->data_length);
+	if (unlikely(!cmd->pdu_len || cmd->pdu_len != data_len ||
+		     cmd->rbytes_done + cmd->pdu_len >
+		     cmd->req.transfer_len)) {
+		pr_err("queue %d ttag %u bad data length %u\n",
+			queue->idx, data->ttag, cmd->pdu_len);
+		return -EPROTO;
+	}
+
+	cmd->pdu_recv = 0;
+	nvmet_tcp_map_pdu_iovec(cmd);
+	queue->cmd = cmd;
+	queue->rcv_state = NVMET_TCP_RECV_DATA;
+
+	return 0;
+}
+
+static int nvmet_tcp_done_recv_pdu(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_hdr *hdr = &queue->pdu.cmd.hdr;
+	struct nvme_command *nvme_cmd = &queue->pdu.cmd.cmd;
+	struct nvmet_tcp_cmd *cmd;
+	struct nvmet_req *req;
+	int data_len;
+	u16 status;
+
+	if (unlikely(queue->state == NVMET_TCP_Q_CONNECTING)) {
+		if (hdr->type != nvme_tcp_icreq) {
+			pr_err("queue %d: unexpected pdu type %d before icreq\n",
+				queue->idx, hdr->type);
+			return -EPROTO;
+		}
+		return nvmet_tcp_handle_icreq(queue);
+	}
+
+	if (hdr->type == nvme_tcp_h2c_data)
+		return nvmet_tcp_handle_h2c_data_pdu(queue);
+
+	if (unlikely(hdr->type == nvme_tcp_h2c_term)) {
+		pr_err("queue %d: terminated by host, fes %#x\n", queue->idx,
+			le16_to_cpu(queue->pdu.term.fes));
+		return -ECONNRESET;
+	}
+
+	if (unlikely(hdr->type != nvme_tcp_cmd)) {
+		pr_err("queue %d: unexpected pdu type %d\n",
+			queue->idx, hdr->type);
+		return -EPROTO;
+	}
+
+	data_len = nvmet_tcp_pdu_data_len(queue, hdr);
+	if (unlikely(data_len < 0))
+		return data_len;
+
+	cmd = nvmet_tcp_get_cmd(queue);
+	if (unlikely(!cmd)) {
+		/* This should never happen */
+		pr_err("queue %d: out of commands (%d), opcode: %d\n",
+			queue->idx, queue->nr_cmds, nvme_cmd->common.opcode);
+		return -ENOMEM;
+	}
+	queue->cmd = cmd;
+
+	req = &cmd->req;
+	memcpy(req->cmd, nvme_cmd, sizeof(*nvme_cmd));
+	cmd->pdu_len = data_len;
+
+	if (unlikely(!nvmet_req_init(req, &queue->nvme_cq,
+			&queue->nvme_sq, &nvmet_tcp_ops))) {
+		pr_err("queue %d: failed cmd %d opcode %d, data_len: %d\n",
+			queue->idx, req->cmd->common.command_id,
+			req->cmd->common.opcode, data_len);
+		nvmet_tcp_handle_req_failure(queue, cmd);
+		return 0;
+	}
+
+	status = nvmet_tcp_map_data(cmd);
+	if (unlikely(status)) {
+		pr_err("queue %d: failed to map data\n", queue->idx);
+		if (cmd->pdu_len) {
+			/* without a buffer the data can't be skipped either */
+			nvmet_req_uninit(req);
+			nvmet_tcp_fatal_error(queue);
+			return 0;
+		}
+		nvmet_prepare_receive_pdu(queue);
+		nvmet_req_complete(req, status);
+		return 0;
+	}
+
+	if (nvmet_tcp_has_inline_data(cmd)) {
+		nvmet_tcp_map_pdu_iovec(cmd);
+		queue->rcv_state = NVMET_TCP_RECV_DATA;
+		return 0;
+	}
+
+	nvmet_prepare_receive_pdu(queue);
+
+	/* solicit the data with an R2T */
+	if (nvmet_tcp_need_data_in(cmd)) {
+		nvmet_tcp_queue_response(req);
+		return 0;
+	}
+
+	nvmet_req_execute(req);
+	return 0;
+}
+
+static inline u8 nvmet_tcp_pdu_size(u8 type)
+{
+	switch (type) {
+	case nvme_tcp_icreq:
+		return sizeof(struct nvme_tcp_icreq_pdu);
+	case nvme_tcp_h2c_term:
+		return sizeof(struct nvme_tcp_term_pdu);
+	case nvme_tcp_cmd:
+		return sizeof(struct nvme_tcp_cmd_pdu);
+	case nvme_tcp_h2c_data:
+		return sizeof(struct nvme_tcp_data_pdu);
+	default:
+		return 0;
+	}
+}
+
+/*
+ * The common header is read first, which tells us how much more of the
+ * PDU header (and its digest) follows.
+ */
+static int nvmet_tcp_try_recv_pdu(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_hdr *hdr = &queue->pdu.cmd.hdr;
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	struct kvec iov;
+	int len, ret;
+
+recv:
+	iov.iov_base = (void *)&queue->pdu + queue->offset;
+	iov.iov_len = queue->left;
+	len = kernel_recvmsg(queue->sock, &msg, &iov, 1,
+			iov.iov_len, msg.msg_flags);
+	if (unlikely(len <= 0))
+		return len ? len : -EAGAIN;
+
+	queue->offset += len;
+	queue->left -= len;
+	if (queue->left)
+		return -EAGAIN;
+
+	if (queue->offset == sizeof(struct nvme_tcp_hdr)) {
+		u8 hdgst = nvmet_tcp_hdgst_len(queue);
+
+		if (unlikely(hdr->hlen != nvmet_tcp_pdu_size(hdr->type))) {
+			pr_err("queue %d: pdu type %d has unexpected header length %d\n",
+				queue->idx, hdr->type, hdr->hlen);
+			return -EPROTO;
+		}
+
+		if (unlikely(!queue->hdr_digest &&
+			     (hdr->flags & NVME_TCP_F_HDGST))) {
+			pr_err("queue %d: header digest flag is set\n",
+				queue->idx);
+			return -EPROTO;
+		}
+
+		queue->left = hdr->hlen - queue->offset + hdgst;
+		goto recv;
+	}
+
+	if (queue->hdr_digest) {
+		ret = nvmet_tcp_verify_hdgst(queue, &queue->pdu, hdr->hlen);
+		if (unlikely(ret))
+			return ret;
+	}
+
+	return nvmet_tcp_done_recv_pdu(queue);
+}
+
+static void nvmet_tcp_data_in_done(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *cmd)
+{
+	nvmet_prepare_receive_pdu(queue);
+
+	if (unlikely(cmd->flags & NVMET_TCP_F_INIT_FAILED)) {
+		/* the error response was held back until now */
+		nvmet_tcp_queue_response(&cmd->req);
+		return;
+	}
+
+	if (cmd->rbytes_done == cmd->req.transfer_len)
+		nvmet_req_execute(&cmd->req);
+	else
+		nvmet_tcp_queue_response(&cmd->req); /* the next R2T */
+}
+
+static void nvmet_tcp_prep_recv_ddgst(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	int i;
+
+	crypto_shash_init(queue->rcv_hash);
+	for (i = 0; i < cmd->nr_mapped; i++)
+		nvmet_tcp_ddgst_update(queue->rcv_hash, cmd->iov[i].bv_page,
+				cmd->iov[i].bv_offset, cmd->iov[i].bv_len);
+	crypto_shash_final(queue->rcv_hash, (u8 *)&cmd->exp_ddgst);
+
+	queue->offset = 0;
+	queue->left = NVME_TCP_DIGEST_LENGTH;
+	queue->rcv_state = NVMET_TCP_RECV_DDGST;
+}
+
+/*
+ * Data is received straight into the command's scatterlist, the iterator
+ * set up by nvmet_tcp_map_pdu_iovec() covers exactly this PDU's payload.
+ */
+static int nvmet_tcp_try_recv_data(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->cmd;
+	int ret;
+
+	while (msg_data_left(&cmd->recv_msg)) {
+		ret = sock_recvmsg(queue->sock, &cmd->recv_msg,
+				cmd->recv_msg.msg_flags);
+		if (ret <= 0)
+			return ret ? ret : -EAGAIN;
+
+		cmd->pdu_recv += ret;
+		cmd->rbytes_done += ret;
+	}
+
+	if (queue->data_digest) {
+		nvmet_tcp_prep_recv_ddgst(cmd);
+		return 0;
+	}
+
+	nvmet_tcp_data_in_done(queue, cmd);
+	return 0;
+}
+
+static int nvmet_tcp_try_recv_ddgst(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->cmd;
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	struct kvec iov = {
+		.iov_base = (void *)&cmd->recv_ddgst + queue->offset,
+		.iov_len = queue->left
+	};
+	int ret;
+
+	ret = kernel_recvmsg(queue->sock, &msg, &iov, 1,
+			iov.iov_len, msg.msg_flags);
+	if (unlikely(ret <= 0))
+		return ret ? ret : -EAGAIN;
+
+	queue->offset += ret;
+	queue->left -= ret;
+	if (queue->left)
+		return -EAGAIN;
+
+	if (cmd->recv_ddgst != cmd->exp_ddgst) {
+		pr_err("queue %d: cmd %d pdu (%d) data digest error: recv %#x expected %#x\n",
+			queue->idx, cmd->req.cmd->common.command_id,
+			queue->pdu.cmd.hdr.type, le32_to_cpu(cmd->recv_ddgst),
+			le32_to_cpu(cmd->exp_ddgst));
+		/* the data was not accepted, leave it to the queue teardown */
+		cmd->rbytes_done -= cmd->pdu_len;
+		return -EPROTO;
+	}
+
+	nvmet_tcp_data_in_done(queue, cmd);
+	return 0;
+}
+
+static int nvmet_tcp_try_recv_one(struct nvmet_tcp_queue *queue)
+{
+	int result = 0;
+
+	if (unlikely(queue->rcv_state == NVMET_TCP_RECV_ERR))
+		return 0;
+
+	if (queue->rcv_state == NVMET_TCP_RECV_PDU) {
+		result = nvmet_tcp_try_recv_pdu(queue);
+		if (result != 0)
+			goto done_recv;
+	}
+
+	if (queue->rcv_state == NVMET_TCP_RECV_DATA) {
+		result = nvmet_tcp_try_recv_data(queue);
+		if (result != 0)
+			goto done_recv;
+	}
+
+	if (queue->rcv_state == NVMET_TCP_RECV_DDGST) {
+		result = nvmet_tcp_try_recv_ddgst(queue);
+		if (result != 0)
+			goto done_recv;
+	}
+
+done_recv:
+	if (result < 0) {
+		if (result == -EAGAIN)
+			return 0;
+		return result;
+	}
+	return 1;
+}
+
+static int nvmet_tcp_try_recv(struct nvmet_tcp_queue *queue, int budget)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < budget; i++) {
+		ret = nvmet_tcp_try_recv_one(queue);
+		if (ret <= 0)
+			break;
+	}
+
+	return ret < 0 ? ret : i;
+}
+
+static void nvmet_tcp_schedule_release_queue(struct nvmet_tcp_queue *queue)
+{
+	spin_lock_bh(&queue->state_lock);
+	if (queue->state != NVMET_TCP_Q_DISCONNECTING) {
+		queue->state = NVMET_TCP_Q_DISCONNECTING;
+		schedule_work(&queue->release_work);
+	}
+	spin_unlock_bh(&queue->state_lock);
+}
+
+/*
+ * Both directions of a queue are driven from here, always on queue->cpu.
+ * Receive and send each get a budget per round so neither starves the
+ * other, and the work yields after a millisecond like the host side does.
+ */
+static void nvmet_tcp_io_work(struct work_struct *w)
+{
+	struct nvmet_tcp_queue *queue =
+		container_of(w, struct nvmet_tcp_queue, io_work);
+	unsigned long deadline = jiffies + msecs_to_jiffies(1);
+	bool pending;
+	int ret;
+
+	if (unlikely(queue->state == NVMET_TCP_Q_DISCONNECTING))
+		return;
+
+	do {
+		pending = false;
+
+		ret = nvmet_tcp_try_recv(queue, NVMET_TCP_RECV_BUDGET);
+		if (ret > 0)
+			pending = true;
+		else if (ret < 0)
+			goto out_err;
+
+		ret = nvmet_tcp_try_send(queue, NVMET_TCP_SEND_BUDGET);
+		if (ret > 0)
+			pending = true;
+		else if (ret < 0)
+			goto out_err;
+
+	} while (pending && !time_after(jiffies, deadline));
+
+	if (pending)
+		queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+	return;
+
+out_err:
+	if (ret == -EPIPE || ret == -ECONNRESET)
+		kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	else
+		nvmet_tcp_fatal_error(queue);
+}
+
+static int nvmet_tcp_alloc_cmd(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *c)
+{
+	/* digests are negotiated later, always leave room for one */
+	size_t hdgst = NVME_TCP_DIGEST_LENGTH;
+
+	c->queue = queue;
+	c->req.port = queue->port->nport;
+
+	c->cmd_pdu = kzalloc(sizeof(*c->cmd_pdu) + hdgst, GFP_KERNEL);
+	if (!c->cmd_pdu)
+		return -ENOMEM;
+	c->req.cmd = &c->cmd_pdu->cmd;
+
+	c->rsp_pdu = kzalloc(sizeof(*c->rsp_pdu) + hdgst, GFP_KERNEL);
+	if (!c->rsp_pdu)
+		goto out_free_cmd;
+	c->req.rsp = &c->rsp_pdu->cqe;
+
+	c->data_pdu = kzalloc(sizeof(*c->data_pdu) + hdgst, GFP_KERNEL);
+	if (!c->data_pdu)
+		goto out_free_rsp;
+
+	c->r2t_pdu = kzalloc(sizeof(*c->r2t_pdu) + hdgst, GFP_KERNEL);
+	if (!c->r2t_pdu)
+		goto out_free_data;
+
+	c->recv_msg.msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+	INIT_LIST_HEAD(&c->entry);
+
+	return 0;
+out_free_data:
+	kfree(c->data_pdu);
+out_free_rsp:
+	kfree(c->rsp_pdu);
+out_free_cmd:
+	kfree(c->cmd_pdu);
+	return -ENOMEM;
+}
+
+static void nvmet_tcp_free_cmd(struct nvmet_tcp_cmd *c)
+{
+	nvmet_tcp_free_cmd_buffers(c);
+	kfree(c->r2t_pdu);
+	kfree(c->data_pdu);
+	kfree(c->rsp_pdu);
+	kfree(c->cmd_pdu);
+}
+
+/*
+ * Until the connect command has told us the queue size only the connect
+ * command itself is available, the real pool is set up from
+ * nvmet_tcp_install_queue().
+ */
+static int nvmet_tcp_alloc_cmds(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmds;
+	int i, ret, nr_cmds = queue->nvme_sq.size * 2;
+
+	cmds = kcalloc(nr_cmds, sizeof(struct nvmet_tcp_cmd), GFP_KERNEL);
+	if (!cmds)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_cmds; i++) {
+		ret = nvmet_tcp_alloc_cmd(queue, cmds + i);
+		if (ret)
+			goto out_free;
+	}
+
+	for (i = 0; i < nr_cmds; i++)
+		list_add_tail(&cmds[i].entry, &queue->free_list);
+
+	queue->cmds = cmds;
+	queue->nr_cmds = nr_cmds;
+	return 0;
+
+out_free:
+	while (--i >= 0)
+		nvmet_tcp_free_cmd(cmds + i);
+	kfree(cmds);
+	return ret;
+}
+
+static void nvmet_tcp_free_cmds(struct nvmet_tcp_queue *queue)
+{
+	int i;
+
+	for (i = 0; i < queue->nr_cmds; i++)
+		nvmet_tcp_free_cmd(queue->cmds + i);
+	kfree(queue->cmds);
+
+	nvmet_tcp_free_cmd(&queue->connect);
+}
+
+/*
+ * Commands still waiting for data from the host hold an sq reference that
+ * nobody else is going to drop.
+ */
+static void nvmet_tcp_uninit_data_in_cmds(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->cmds;
+	int i;
+
+	for (i = 0; i < queue->nr_cmds; i++, cmd++) {
+		if (nvmet_tcp_need_data_in(cmd))
+			nvmet_req_uninit(&cmd->req);
+	}
+
+	if (!queue->nr_cmds && nvmet_tcp_need_data_in(&queue->connect)) {
+		/* failed in connect */
+		nvmet_req_uninit(&queue->connect.req);
+	}
+}
+
+static void nvmet_tcp_restore_socket_callbacks(struct nvmet_tcp_queue *queue)
+{
+	struct socket *sock = queue->sock;
+
+	write_lock_bh(&sock->sk->sk_callback_lock);
+	sock->sk->sk_data_ready =  queue->data_ready;
+	sock->sk->sk_state_change = queue->state_change;
+	sock->sk->sk_write_space = queue->write_space;
+	sock->sk->sk_user_data = NULL;
+	write_unlock_bh(&sock->sk->sk_callback_lock);
+}
+
+static void nvmet_tcp_release_queue_work(struct work_struct *w)
+{
+	struct nvmet_tcp_queue *queue =
+		container_of(w, struct nvmet_tcp_queue, release_work);
+
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_del_init(&queue->queue_list);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+
+	nvmet_tcp_restore_socket_callbacks(queue);
+	flush_work(&queue->io_work);
+
+	nvmet_tcp_uninit_data_in_cmds(queue);
+	nvmet_sq_destroy(&queue->nvme_sq);
+	cancel_work_sync(&queue->io_work);
+	sock_release(queue->sock);
+	nvmet_tcp_free_cmds(queue);
+	if (queue->hdr_digest || queue->data_digest)
+		nvmet_tcp_free_crypto(queue);
+	ida_simple_remove(&nvmet_tcp_queue_ida, queue->idx);
+
+	kfree(queue);
+}
+
+static void nvmet_tcp_data_ready(struct sock *sk)
+{
+	struct nvmet_tcp_queue *queue;
+
+	read_lock(&sk->sk_callback_lock);
+	queue = sk->sk_user_data;
+	if (likely(queue))
+		queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+	read_unlock(&sk->sk_callback_lock);
+}
+
+static void nvmet_tcp_write_space(struct sock *sk)
+{
+	struct nvmet_tcp_queue *queue;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	queue = sk->sk_user_data;
+	if (unlikely(!queue))
+		goto out;
+
+	if (unlikely(queue->state == NVMET_TCP_Q_CONNECTING)) {
+		queue->write_space(sk);
+		goto out;
+	}
+
+	if (sk_stream_is_writeable(sk)) {
+		clear_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
+		queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+	}
+out:
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void nvmet_tcp_state_change(struct sock *sk)
+{
+	struct nvmet_tcp_queue *queue;
+
+	read_lock(&sk->sk_callback_lock);
+	queue = sk->sk_user_data;
+	if (!queue)
+		goto done;
+
+	switch (sk->sk_state) {
+	case TCP_FIN_WAIT1:
+	case TCP_CLOSE_WAIT:
+	case TCP_CLOSE:
+		nvmet_tcp_schedule_release_queue(queue);
+		break;
+	default:
+		pr_warn("queue %d unhandled state %d\n",
+			queue->idx, sk->sk_state);
+	}
+
+	queue->state_change(sk);
+done:
+	read_unlock(&sk->sk_callback_lock);
+}
+
+static int nvmet_tcp_set_queue_sock(struct nvmet_tcp_queue *queue)
+{
+	struct socket *sock = queue->sock;
+	struct linger sol = { .l_onoff = 1, .l_linger = 0 };
+	int ret;
+
+	ret = kernel_getsockname(sock,
+		(struct sockaddr *)&queue->sockaddr);
+	if (ret < 0)
+		return ret;
+
+	ret = kernel_getpeername(sock,
+		(struct sockaddr *)&queue->sockaddr_peer);
+	if (ret < 0)
+		return ret;
+
+	/*
+	 * Cleanup whatever is sitting in the TCP transmit queue on socket
+	 * close. This is done to prevent stale data from being sent should
+	 * the network connection be restored before TCP times out.
+	 */
+	ret = kernel_setsockopt(sock, SOL_SOCKET, SO_LINGER,
+			(char *)&sol, sizeof(sol));
+	if (ret)
+		return ret;
+
+	write_lock_bh(&sock->sk->sk_callback_lock);
+	if (sock->sk->sk_state != TCP_ESTABLISHED) {
+		/* the host went away before we got to install our callbacks */
+		ret = -ENOTCONN;
+	} else {
+		sock->sk->sk_user_data = queue;
+		queue->data_ready = sock->sk->sk_data_ready;
+		sock->sk->sk_data_ready = nvmet_tcp_data_ready;
+		queue->state_change = sock->sk->sk_state_change;
+		sock->sk->sk_state_change = nvmet_tcp_state_change;
+		queue->write_space = sock->sk->sk_write_space;
+		sock->sk->sk_write_space = nvmet_tcp_write_space;
+	}
+	write_unlock_bh(&sock->sk->sk_callback_lock);
+
+	return ret;
+}
+
+static int nvmet_tcp_alloc_queue(struct nvmet_tcp_port *port,
+		struct socket *newsock)
+{
+	struct nvmet_tcp_queue *queue;
+	int ret;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL);
+	if (!queue)
+		return -ENOMEM;
+
+	INIT_WORK(&queue->release_work, nvmet_tcp_release_queue_work);
+	INIT_WORK(&queue->io_work, nvmet_tcp_io_work);
+	queue->sock = newsock;
+	queue->port = port;
+	queue->nr_cmds = 0;
+	spin_lock_init(&queue->state_lock);
+	queue->state = NVMET_TCP_Q_CONNECTING;
+	INIT_LIST_HEAD(&queue->free_list);
+	init_llist_head(&queue->resp_list);
+	INIT_LIST_HEAD(&queue->resp_send_list);
+
+	queue->idx = ida_simple_get(&nvmet_tcp_queue_ida, 0, 0, GFP_KERNEL);
+	if (queue->idx < 0) {
+		ret = queue->idx;
+		goto out_free_queue;
+	}
+
+	ret = nvmet_tcp_alloc_cmd(queue, &queue->connect);
+	if (ret)
+		goto out_ida_remove;
+	list_add_tail(&queue->connect.entry, &queue->free_list);
+
+	ret = nvmet_sq_init(&queue->nvme_sq);
+	if (ret)
+		goto out_free_connect;
+
+	/* spread the queues accepted on a port over the online CPUs */
+	port->last_cpu = cpumask_next_wrap(port->last_cpu,
+				cpu_online_mask, -1, false);
+	queue->cpu = port->last_cpu;
+	nvmet_prepare_receive_pdu(queue);
+
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_add_tail(&queue->queue_list, &nvmet_tcp_queue_list);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+
+	ret = nvmet_tcp_set_queue_sock(queue);
+	if (ret)
+		goto out_destroy_sq;
+
+	queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+
+	return 0;
+out_destroy_sq:
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_del_init(&queue->queue_list);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+	nvmet_sq_destroy(&queue->nvme_sq);
+out_free_connect:
+	nvmet_tcp_free_cmd(&queue->connect);
+out_ida_remove:
+	ida_simple_remove(&nvmet_tcp_queue_ida, queue->idx);
+out_free_queue:
+	kfree(queue);
+	return ret;
+}
+
+static void nvmet_tcp_accept_work(struct work_struct *w)
+{
+	struct nvmet_tcp_port *port =
+		container_of(w, struct nvmet_tcp_port, accept_work);
+	struct socket *newsock;
+	int ret;
+
+	while (true) {
+		ret = kernel_accept(port->sock, &newsock, O_NONBLOCK);
+		if (ret < 0) {
+			if (ret != -EAGAIN)
+				pr_warn("failed to accept err=%d\n", ret);
+			return;
+		}
+		ret = nvmet_tcp_alloc_queue(port, newsock);
+		if (ret) {
+			pr_err("failed to allocate queue\n");
+			sock_release(newsock);
+		}
+	}
+}
+
+static void nvmet_tcp_listen_data_ready(struct sock *sk)
+{
+	struct nvmet_tcp_port *port;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	port = sk->sk_user_data;
+	if (!port)
+		goto out;
+
+	if (sk->sk_state == TCP_LISTEN)
+		schedule_work(&port->accept_work);
+out:
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static int nvmet_tcp_add_port(struct nvmet_port *nport)
+{
+	struct nvmet_tcp_port *port;
+	__kernel_sa_family_t af;
+	int opt, ret;
+
+	port = kzalloc(sizeof(*port), GFP_KERNEL);
+	if (!port)
+		return -ENOMEM;
+
+	switch (nport->disc_addr.adrfam) {
+	case NVMF_ADDR_FAMILY_IP4:
+		af = AF_INET;
+		break;
+	case NVMF_ADDR_FAMILY_IP6:
+		af = AF_INET6;
+		break;
+	default:
+		pr_err("address family %d not supported\n",
+				nport->disc_addr.adrfam);
+		ret = -EINVAL;
+		goto err_port;
+	}
+
+	if (nport->inline_data_size < 0)
+		nport->inline_data_size = NVMET_TCP_INLINE_DATA_SIZE;
+
+	ret = inet_pton_with_scope(&init_net, af, nport->disc_addr.traddr,
+			nport->disc_addr.trsvcid, &port->addr);
+	if (ret) {
+		pr_err("malformed ip/port passed: %s:%s\n",
+			nport->disc_addr.traddr, nport->disc_addr.trsvcid);
+		goto err_port;
+	}
+
+	port->nport = nport;
+	port->last_cpu = -1;
+	INIT_WORK(&port->accept_work, nvmet_tcp_accept_work);
+
+	ret = sock_create_kern(&init_net, port->addr.ss_family,
+			SOCK_STREAM, IPPROTO_TCP, &port->sock);
+	if (ret) {
+		pr_err("failed to create a socket\n");
+		goto err_port;
+	}
+
+	port->sock->sk->sk_user_data = port;
+	port->data_ready = port->sock->sk->sk_data_ready;
+	port->sock->sk->sk_data_ready = nvmet_tcp_listen_data_ready;
+
+	opt = 1;
+	ret = kernel_setsockopt(port->sock, SOL_SOCKET, SO_REUSEADDR,
+			(char *)&opt, sizeof(opt));
+	if (ret) {
+		pr_err("failed to set SO_REUSEADDR sock opt %d\n", ret);
+		goto err_sock;
+	}
+
+	/* inherited by every socket accepted on this port */
+	ret = kernel_setsockopt(port->sock, IPPROTO_TCP, TCP_NODELAY,
+			(char *)&opt, sizeof(opt));
+	if (ret) {
+		pr_err("failed to set TCP_NODELAY sock opt %d\n", ret);
+		goto err_sock;
+	}
+
+	ret = kernel_bind(port->sock, (struct sockaddr *)&port->addr,
+			sizeof(port->addr));
+	if (ret) {
+		pr_err("failed to bind port socket %d\n", ret);
+		goto err_sock;
+	}
+
+	ret = kernel_listen(port->sock, 128);
+	if (ret) {
+		pr_err("failed to listen %d on port sock\n", ret);
+		goto err_sock;
+	}
+
+	nport->priv = port;
+	pr_info("enabling port %d (%pISpc)\n",
+		le16_to_cpu(nport->disc_addr.portid), &port->addr);
+
+	return 0;
+
+err_sock:
+	sock_release(port->sock);
+err_port:
+	kfree(port);
+	return ret;
+}
+
+static void nvmet_tcp_remove_port(struct nvmet_port *nport)
+{
+	struct nvmet_tcp_port *port = xchg(&nport->priv, NULL);
+	struct nvmet_tcp_queue *queue;
+
+	if (!port)
+		return;
+
+	write_lock_bh(&port->sock->sk->sk_callback_lock);
+	port->sock->sk->sk_data_ready = port->data_ready;
+	port->sock->sk->sk_user_data = NULL;
+	write_unlock_bh(&port->sock->sk->sk_callback_lock);
+	cancel_work_sync(&port->accept_work);
+
+	/* the queues accepted on this port point back at it */
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_for_each_entry(queue, &nvmet_tcp_queue_list, queue_list)
+		if (queue->port == port)
+			kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+	flush_scheduled_work();
+
+	sock_release(port->sock);
+	kfree(port);
+}
+
+static void nvmet_tcp_delete_ctrl(struct nvmet_ctrl *ctrl)
+{
+	struct nvmet_tcp_queue *queue;
+
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_for_each_entry(queue, &nvmet_tcp_queue_list, queue_list)
+		if (queue->nvme_sq.ctrl == ctrl)
+			kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+}
+
+static u16 nvmet_tcp_install_queue(struct nvmet_sq *sq)
+{
+	struct nvmet_tcp_queue *queue =
+		container_of(sq, struct nvmet_tcp_queue, nvme_sq);
+
+	if (nvmet_tcp_alloc_cmds(queue))
+		return NVME_SC_INTERNAL;
+
+	return 0;
+}
+
+static void nvmet_tcp_disc_port_addr(struct nvmet_req *req,
+		struct nvmet_port *nport, char *traddr)
+{
+	struct nvmet_tcp_port *port = nport->priv;
+
+	if (inet_addr_is_any((struct sockaddr *)&port->addr)) {
+		struct nvmet_tcp_cmd *cmd =
+			container_of(req, struct nvmet_tcp_cmd, req);
+		struct nvmet_tcp_queue *queue = cmd->queue;
+
+		sprintf(traddr, "%pISc", (struct sockaddr *)&queue->sockaddr);
+	} else {
+		memcpy(traddr, nport->disc_addr.traddr, NVMF_TRADDR_SIZE);
+	}
+}
+
+static const struct nvmet_fabrics_ops nvmet_tcp_ops = {
+	.owner			= THIS_MODULE,
+	.type			= NVMF_TRTYPE_TCP,
+	.msdbd			= 1,
+	.add_port		= nvmet_tcp_add_port,
+	.remove_port		= nvmet_tcp_remove_port,
+	.queue_response		= nvmet_tcp_queue_response,
+	.delete_ctrl		= nvmet_tcp_delete_ctrl,
+	.install_queue		= nvmet_tcp_install_queue,
+	.disc_traddr		= nvmet_tcp_disc_port_addr,
+};
+
+static int __init nvmet_tcp_init(void)
+{
+	int ret;
+
+	nvmet_tcp_wq = alloc_workqueue("nvmet_tcp_wq", WQ_HIGHPRI, 0);
+	if (!nvmet_tcp_wq)
+		return -ENOMEM;
+
+	ret = nvmet_register_transport(&nvmet_tcp_ops);
+	if (ret)
+		goto err;
+
+	return 0;
+err:
+	destroy_workqueue(nvmet_tcp_wq);
+	return ret;
+}
+
+static void __exit nvmet_tcp_exit(void)
+{
+	struct nvmet_tcp_queue *queue;
+
+	nvmet_unregister_transport(&nvmet_tcp_ops);
+
+	flush_scheduled_work();
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_for_each_entry(queue, &nvmet_tcp_queue_list, queue_list)
+		kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+	flush_scheduled_work();
+
+	destroy_workqueue(nvmet_tcp_wq);
+	ida_destroy(&nvmet_tcp_queue_ida);
+}
+
+module_init(nvmet_tcp_init);
+module_exit(nvmet_tcp_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("nvmet-transport-3"); /* 3 == NVMF_TRTYPE_TCP */
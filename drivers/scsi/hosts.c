@@ -573,6 +573,37 @@ void scsi_host_put(struct Scsi_Host *shost)
 }
 EXPORT_SYMBOL(scsi_host_put);
 
+static void scsi_host_check_in_flight(struct request *rq, void *data,
+				      bool reserved)
+{
+	struct scsi_cmnd *cmd = blk_mq_rq_to_pdu(rq);
+	int *count = data;
+
+	if (test_bit(SCMD_STATE_INFLIGHT, &cmd->state))
+		(*count)++;
+}
+
+/**
+ * scsi_host_busy - Return the number of commands active on the host
+ * @shost:	Pointer to Scsi_Host.
+ *
+ * With blk-mq there is no shared counter to keep up to date on every
+ * command, the commands handed to the low-level driver are counted by
+ * walking the tag set instead.
+ **/
+int scsi_host_busy(struct Scsi_Host *shost)
+{
+	int cnt = 0;
+
+	if (!shost_use_blk_mq(shost))
+		return atomic_read(&shost->host_busy);
+
+	blk_mq_tagset_busy_iter(&shost->tag_set, scsi_host_check_in_flight,
+				&cnt);
+	return cnt;
+}
+EXPORT_SYMBOL(scsi_host_busy);
+
 int scsi_init_hosts(void)
 {
 	return class_register(&shost_class);
@@ -30,6 +30,7 @@
 #include <linux/sched/mm.h>
 #include <linux/sched/signal.h>
 #include <linux/interval_tree_generic.h>
+#include <linux/idr.h>
 
 #include "vhost.h"
 
@@ -46,6 +47,11 @@ enum {
 	VHOST_MEMORY_F_LOG = 0x1,
 };
 
+/* Workers can be shared between devices of one owner, so their ids live in
+ * a global namespace. */
+static DEFINE_MUTEX(vhost_workers_lock);
+static DEFINE_IDR(vhost_workers);
+
 #define vhost_used_event(vq) ((__virtio16 __user *)&vq->avail->ring[vq->num])
 #define vhost_avail_event(vq) ((__virtio16 __user *)&vq->used->ring[vq->num])
 
@@ -186,12 +192,14 @@ EXPORT_SYMBOL_GPL(vhost_work_init);
 
 /* Init poll structure */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     __poll_t mask, struct vhost_dev *dev)
+		     __poll_t mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -231,54 +239,94 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
+{
+	if (!worker)
+		return;
+
+	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
+		/* We can only add the work to the list after we're
+		 * sure it was not in the list.
+		 * test_and_set_bit() implies a memory barrier.
+		 */
+		llist_add(&work->node, &worker->work_list);
+		wake_up_process(worker->task);
+	}
+}
+
+static void vhost_worker_flush(struct vhost_worker *worker)
 {
 	struct vhost_flush_struct flush;
 
-	if (dev->worker) {
+	if (worker) {
 		init_completion(&flush.wait_event);
 		vhost_work_init(&flush.work, vhost_flush_work);
 
-		vhost_work_queue(dev, &flush.work);
+		vhost_worker_queue(worker, &flush.work);
 		wait_for_completion(&flush.wait_event);
 	}
 }
+
+static struct vhost_worker *vhost_vq_worker(struct vhost_virtqueue *vq)
+{
+	struct vhost_worker *worker = READ_ONCE(vq->worker);
+
+	return worker ? worker : READ_ONCE(vq->dev->worker);
+}
+
+void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+{
+	vhost_worker_flush(dev->worker);
+}
 EXPORT_SYMBOL_GPL(vhost_work_flush);
 
 /* Flush any work that has been scheduled. When calling this, don't hold any
  * locks that are also used by the callback. */
 void vhost_poll_flush(struct vhost_poll *poll)
 {
-	vhost_work_flush(poll->dev, &poll->work);
+	if (poll->vq)
+		vhost_worker_flush(vhost_vq_worker(poll->vq));
+	else
+		vhost_work_flush(poll->dev, &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 {
-	if (!dev->worker)
-		return;
-
-	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
-		/* We can only add the work to the list after we're
-		 * sure it was not in the list.
-		 * test_and_set_bit() implies a memory barrier.
-		 */
-		llist_add(&work->node, &dev->work_list);
-		wake_up_process(dev->worker);
-	}
+	vhost_worker_queue(dev->worker, work);
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+/* Queue work on the worker servicing @vq. */
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	vhost_worker_queue(vhost_vq_worker(vq), work);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_queue);
+
 /* A lockless hint for busy polling code to exit the loop */
 bool vhost_has_work(struct vhost_dev *dev)
 {
-	return !llist_empty(&dev->work_list);
+	return dev->worker && !llist_empty(&dev->worker->work_list);
 }
 EXPORT_SYMBOL_GPL(vhost_has_work);
 
+/* Same as vhost_has_work(), for the worker servicing @vq */
+bool vhost_vq_has_work(struct vhost_virtqueue *vq)
+{
+	struct vhost_worker *worker = vhost_vq_worker(vq);
+
+	return worker && !llist_empty(&worker->work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	if (poll->vq)
+		vhost_vq_work_queue(poll->vq, &poll->work);
+	else
+		vhost_work_queue(poll->dev, &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -308,6 +356,9 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->last_avail_idx = 0;
 	vq->avail_idx = 0;
 	vq->last_used_idx = 0;
+	vq->avail_wrap_counter = true;
+	vq->used_wrap_counter = true;
+	vq->avail_hist_idx = 0;
 	vq->signalled_used = 0;
 	vq->signalled_used_valid = false;
 	vq->used_flags = 0;
@@ -325,18 +376,19 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->busyloop_timeout = 0;
 	vq->umem = NULL;
 	vq->iotlb = NULL;
+	vq->worker = NULL;
 	__vhost_vq_meta_reset(vq);
 }
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
 	struct vhost_work *work, *work_next;
 	struct llist_node *node;
 	mm_segment_t oldfs = get_fs();
 
 	set_fs(USER_DS);
-	use_mm(dev->mm);
+	use_mm(worker->mm);
 
 	for (;;) {
 		/* mb paired w/ kthread_stop */
@@ -347,7 +399,7 @@ static int vhost_worker(void *data)
 			break;
 		}
 
-		node = llist_del_all(&dev->work_list);
+		node = llist_del_all(&worker->work_list);
 		if (!node)
 			schedule();
 
@@ -362,7 +414,7 @@ static int vhost_worker(void *data)
 				schedule();
 		}
 	}
-	unuse_mm(dev->mm);
+	unuse_mm(worker->mm);
 	set_fs(oldfs);
 	return 0;
 }
@@ -375,6 +427,10 @@ static void vhost_vq_free_iovecs(struct vhost_virtqueue *vq)
 	vq->log = NULL;
 	kfree(vq->heads);
 	vq->heads = NULL;
+	kfree(vq->avail_hist);
+	vq->avail_hist = NULL;
+	kfree(vq->desc_count);
+	vq->desc_count = NULL;
 }
 
 /* Helper to allocate iovec buffers for all vqs. */
@@ -389,7 +445,9 @@ static long vhost_dev_alloc_iovecs(struct vhost_dev *dev)
 				       GFP_KERNEL);
 		vq->log = kmalloc(sizeof *vq->log * UIO_MAXIOV, GFP_KERNEL);
 		vq->heads = kmalloc(sizeof *vq->heads * UIO_MAXIOV, GFP_KERNEL);
-		if (!vq->indirect || !vq->log || !vq->heads)
+		vq->avail_hist = kmalloc(sizeof *vq->avail_hist * UIO_MAXIOV,
+					 GFP_KERNEL);
+		if (!vq->indirect || !vq->log || !vq->heads || !vq->avail_hist)
 			goto err_nomem;
 	}
 	return 0;
@@ -422,7 +480,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->iotlb = NULL;
 	dev->mm = NULL;
 	dev->worker = NULL;
-	init_llist_head(&dev->work_list);
+	dev->vq_workers = false;
 	init_waitqueue_head(&dev->wait);
 	INIT_LIST_HEAD(&dev->read_list);
 	INIT_LIST_HEAD(&dev->pending_list);
@@ -439,7 +497,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
-					EPOLLIN, dev);
+					EPOLLIN, dev, vq);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -466,17 +524,230 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	vhost_worker_queue(worker, &attach.work);
+	vhost_worker_flush(worker);
 	return attach.ret;
 }
 
+/* Caller should hold vhost_workers_lock */
+static void __vhost_worker_put(struct vhost_worker *worker)
+{
+	if (--worker->refcnt)
+		return;
+
+	idr_remove(&vhost_workers, worker->id);
+	WARN_ON(!llist_empty(&worker->work_list));
+	kthread_stop(worker->task);
+	mmput(worker->mm);
+	kfree(worker);
+}
+
+static void vhost_worker_put(struct vhost_worker *worker)
+{
+	mutex_lock(&vhost_workers_lock);
+	__vhost_worker_put(worker);
+	mutex_unlock(&vhost_workers_lock);
+}
+
+/* Look up a worker usable by @dev and take a reference on it. */
+static struct vhost_worker *vhost_worker_get(struct vhost_dev *dev, u32 id)
+{
+	struct vhost_worker *worker;
+
+	mutex_lock(&vhost_workers_lock);
+	worker = idr_find(&vhost_workers, id);
+	/* The worker runs in its creator's address space. */
+	if (worker && worker->mm == dev->mm)
+		worker->refcnt++;
+	else
+		worker = NULL;
+	mutex_unlock(&vhost_workers_lock);
+
+	return worker;
+}
+
+/* Create a worker owned by @dev, running on @cpu if it is not negative.
+ * Caller should have device mutex. */
+static struct vhost_worker *vhost_worker_create(struct vhost_dev *dev, int cpu)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int id, err;
+
+	if (cpu >= 0 && (cpu >= nr_cpu_ids || !cpu_online(cpu)))
+		return ERR_PTR(-EINVAL);
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return ERR_PTR(-ENOMEM);
+
+	init_llist_head(&worker->work_list);
+	mmget(dev->mm);
+	worker->mm = dev->mm;
+	worker->owner = dev;
+	worker->refcnt = 1;
+
+	task = kthread_create(vhost_worker, worker, "vhost-%d", current->pid);
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto err_task;
+	}
+	worker->task = task;
+	if (cpu >= 0)
+		set_cpus_allowed_ptr(task, cpumask_of(cpu));
+	wake_up_process(task);	/* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err)
+		goto err_cgroup;
+
+	mutex_lock(&vhost_workers_lock);
+	id = idr_alloc(&vhost_workers, worker, 0, 0, GFP_KERNEL);
+	mutex_unlock(&vhost_workers_lock);
+	if (id < 0) {
+		err = id;
+		goto err_cgroup;
+	}
+	worker->id = id;
+
+	return worker;
+err_cgroup:
+	kthread_stop(task);
+err_task:
+	mmput(worker->mm);
+	kfree(worker);
+	return ERR_PTR(err);
+}
+
+/* Drop the device's references on its rings' workers and on the workers it
+ * created.  Workers shared with other devices live on until released
+ * there. */
+static void vhost_dev_free_workers(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	int i, id;
+
+	mutex_lock(&vhost_workers_lock);
+	for (i = 0; i < dev->nvqs; ++i) {
+		if (dev->vqs[i]->worker) {
+			__vhost_worker_put(dev->vqs[i]->worker);
+			dev->vqs[i]->worker = NULL;
+		}
+	}
+	idr_for_each_entry(&vhost_workers, worker, id) {
+		if (worker->owner != dev)
+			continue;
+		worker->owner = NULL;
+		__vhost_worker_put(worker);
+	}
+	mutex_unlock(&vhost_workers_lock);
+	dev->worker = NULL;
+}
+
+/* Caller should have device mutex */
+static long vhost_new_worker(struct vhost_dev *dev, void __user *argp)
+{
+	struct vhost_worker_state state;
+	struct vhost_worker *worker;
+
+	if (copy_from_user(&state, argp, sizeof(state)))
+		return -EFAULT;
+
+	worker = vhost_worker_create(dev, state.cpu);
+	if (IS_ERR(worker))
+		return PTR_ERR(worker);
+
+	state.worker_id = worker->id;
+	if (copy_to_user(argp, &state, sizeof(state))) {
+		vhost_worker_put(worker);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/* Caller should have device mutex */
+static long vhost_free_worker(struct vhost_dev *dev, void __user *argp)
+{
+	struct vhost_worker_state state;
+	struct vhost_worker *worker;
+	long r = 0;
+
+	if (copy_from_user(&state, argp, sizeof(state)))
+		return -EFAULT;
+
+	mutex_lock(&vhost_workers_lock);
+	worker = idr_find(&vhost_workers, state.worker_id);
+	if (!worker || worker->owner != dev || worker == dev->worker)
+		r = -EINVAL;
+	else if (worker->refcnt > 1)
+		r = -EBUSY;
+	else
+		__vhost_worker_put(worker);
+	mutex_unlock(&vhost_workers_lock);
+
+	return r;
+}
+
+/* Caller should have device mutex */
+static long vhost_vring_worker_ioctl(struct vhost_dev *dev, unsigned int ioctl,
+				     void __user *argp)
+{
+	struct vhost_worker *worker, *old;
+	struct vhost_vring_worker w;
+	struct vhost_virtqueue *vq;
+
+	if (copy_from_user(&w, argp, sizeof(w)))
+		return -EFAULT;
+	if (w.index >= dev->nvqs)
+		return -ENOBUFS;
+	vq = dev->vqs[w.index];
+
+	if (ioctl == VHOST_ATTACH_VRING_WORKER && !dev->vq_workers)
+		return -EOPNOTSUPP;
+
+	if (ioctl == VHOST_GET_VRING_WORKER) {
+		w.worker_id = vhost_vq_worker(vq)->id;
+		return copy_to_user(argp, &w, sizeof(w)) ? -EFAULT : 0;
+	}
+
+	worker = vhost_worker_get(dev, w.worker_id);
+	if (!worker)
+		return -EINVAL;
+
+	mutex_lock(&vq->mutex);
+	/* Moving a ring with an active backend?
+	 * You don't want to do that. */
+	if (vq->private_data) {
+		mutex_unlock(&vq->mutex);
+		vhost_worker_put(worker);
+		return -EBUSY;
+	}
+	old = vq->worker;
+	if (worker == dev->worker) {
+		/* The device default needs no reference. */
+		WRITE_ONCE(vq->worker, NULL);
+		vhost_worker_put(worker);
+	} else {
+		WRITE_ONCE(vq->worker, worker);
+	}
+	mutex_unlock(&vq->mutex);
+
+	/* Let work already queued on the old worker finish. */
+	if (old) {
+		vhost_worker_flush(old);
+		vhost_worker_put(old);
+	} else {
+		vhost_worker_flush(dev->worker);
+	}
+	return 0;
+}
+
 /* Caller should have device mutex */
 bool vhost_dev_has_owner(struct vhost_dev *dev)
 {
@@ -487,7 +758,7 @@ EXPORT_SYMBOL_GPL(vhost_dev_has_owner);
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
+	struct vhost_worker *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -498,27 +769,25 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
+	if (!dev->mm) {
+		err = -EINVAL;
+		goto err_mm;
+	}
+	worker = vhost_worker_create(dev, -1);
 	if (IS_ERR(worker)) {
 		err = PTR_ERR(worker);
 		goto err_worker;
 	}
 
 	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
-
-	err = vhost_attach_cgroups(dev);
-	if (err)
-		goto err_cgroup;
 
 	err = vhost_dev_alloc_iovecs(dev);
 	if (err)
-		goto err_cgroup;
+		goto err_iovecs;
 
 	return 0;
-err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+err_iovecs:
+	vhost_dev_free_workers(dev);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -610,6 +879,7 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 {
 	int i;
 
+	vhost_dev_free_workers(dev);
 	for (i = 0; i < dev->nvqs; ++i) {
 		if (dev->vqs[i]->error_ctx)
 			eventfd_ctx_put(dev->vqs[i]->error_ctx);
@@ -630,11 +900,6 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 	dev->iotlb = NULL;
 	vhost_clear_msg(dev);
 	wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
-	WARN_ON(!llist_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -846,7 +1111,7 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 	return __vhost_get_user_slow(vq, addr, size, type);
 }
 
-#define vhost_put_user(vq, x, ptr)		\
+#define __vhost_put_user(vq, x, ptr, type)	\
 ({ \
 	int ret = -EFAULT; \
 	if (!vq->iotlb) { \
@@ -854,7 +1119,7 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 	} else { \
 		__typeof__(ptr) to = \
 			(__typeof__(ptr)) __vhost_get_user(vq, ptr,	\
-					  sizeof(*ptr), VHOST_ADDR_USED); \
+					  sizeof(*ptr), type); \
 		if (to != NULL) \
 			ret = __put_user(x, to); \
 		else \
@@ -863,6 +1128,13 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 	ret; \
 })
 
+#define vhost_put_user(vq, x, ptr) \
+	__vhost_put_user(vq, x, ptr, VHOST_ADDR_USED)
+
+/* The device writes used elements back into the packed descriptor ring. */
+#define vhost_put_desc(vq, x, ptr) \
+	__vhost_put_user(vq, x, ptr, VHOST_ADDR_DESC)
+
 #define vhost_get_user(vq, x, ptr, type)		\
 ({ \
 	int ret; \
@@ -887,6 +1159,9 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 #define vhost_get_used(vq, x, ptr) \
 	vhost_get_user(vq, x, ptr, VHOST_ADDR_USED)
 
+#define vhost_get_desc(vq, x, ptr) \
+	vhost_get_user(vq, x, ptr, VHOST_ADDR_DESC)
+
 static void vhost_dev_lock_vqs(struct vhost_dev *d)
 {
 	int i = 0;
@@ -1135,6 +1410,17 @@ static int vhost_iotlb_miss(struct vhost_virtqueue *vq, u64 iova, int access)
 	return 0;
 }
 
+static bool vq_access_ok_packed(struct vhost_virtqueue *vq, unsigned int num,
+				struct vring_packed_desc __user *desc,
+				struct vring_packed_desc_event __user *driver,
+				struct vring_packed_desc_event __user *device)
+{
+	/* The device writes used descriptors back in place. */
+	return access_ok(VERIFY_WRITE, desc, num * sizeof *desc) &&
+	       access_ok(VERIFY_READ, driver, sizeof *driver) &&
+	       access_ok(VERIFY_WRITE, device, sizeof *device);
+}
+
 static bool vq_access_ok(struct vhost_virtqueue *vq, unsigned int num,
 			 struct vring_desc __user *desc,
 			 struct vring_avail __user *avail,
@@ -1143,6 +1429,11 @@ static bool vq_access_ok(struct vhost_virtqueue *vq, unsigned int num,
 {
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
 
+	if (vhost_is_packed(vq))
+		return vq_access_ok_packed(vq, num, (void __user *)desc,
+					   (void __user *)avail,
+					   (void __user *)used);
+
 	return access_ok(VERIFY_READ, desc, num * sizeof *desc) &&
 	       access_ok(VERIFY_READ, avail,
 			 sizeof *avail + num * sizeof *avail->ring + s) &&
@@ -1157,7 +1448,10 @@ static void vhost_vq_meta_update(struct vhost_virtqueue *vq,
 	int access = (type == VHOST_ADDR_USED) ?
 		     VHOST_ACCESS_WO : VHOST_ACCESS_RO;
 
-	if (likely(node->perm & access))
+	if (type == VHOST_ADDR_DESC && vhost_is_packed(vq))
+		access = VHOST_ACCESS_RW;
+
+	if (likely((node->perm & access) == access))
 		vq->meta_iotlb[type] = node;
 }
 
@@ -1178,7 +1472,7 @@ static bool iotlb_access_ok(struct vhost_virtqueue *vq,
 		if (node == NULL || node->start > addr) {
 			vhost_iotlb_miss(vq, addr, access);
 			return false;
-		} else if (!(node->perm & access)) {
+		} else if ((node->perm & access) != access) {
 			/* Report the possible access violation by
 			 * request another translation from userspace.
 			 */
@@ -1205,6 +1499,20 @@ int vq_iotlb_prefetch(struct vhost_virtqueue *vq)
 	if (!vq->iotlb)
 		return 1;
 
+	if (vhost_is_packed(vq))
+		return iotlb_access_ok(vq, VHOST_ACCESS_RW,
+				       (u64)(uintptr_t)vq->desc_packed,
+				       num * sizeof(*vq->desc_packed),
+				       VHOST_ADDR_DESC) &&
+		       iotlb_access_ok(vq, VHOST_ACCESS_RO,
+				       (u64)(uintptr_t)vq->driver_event,
+				       sizeof(*vq->driver_event),
+				       VHOST_ADDR_AVAIL) &&
+		       iotlb_access_ok(vq, VHOST_ACCESS_WO,
+				       (u64)(uintptr_t)vq->device_event,
+				       sizeof(*vq->device_event),
+				       VHOST_ADDR_USED);
+
 	return iotlb_access_ok(vq, VHOST_ACCESS_RO, (u64)(uintptr_t)vq->desc,
 			       num * sizeof(*vq->desc), VHOST_ADDR_DESC) &&
 	       iotlb_access_ok(vq, VHOST_ACCESS_RO, (u64)(uintptr_t)vq->avail,
@@ -1232,12 +1540,13 @@ static bool vq_log_access_ok(struct vhost_virtqueue *vq,
 			     void __user *log_base)
 {
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
+	size_t sz = vhost_is_packed(vq) ?
+		    vq->num * sizeof *vq->desc_packed :
+		    sizeof *vq->used + vq->num * sizeof *vq->used->ring + s;
 
 	return vq_memory_access_ok(log_base, vq->umem,
 				   vhost_has_feature(vq, VHOST_F_LOG_ALL)) &&
-		(!vq->log_used || log_access_ok(log_base, vq->log_addr,
-					sizeof *vq->used +
-					vq->num * sizeof *vq->used->ring + s));
+		(!vq->log_used || log_access_ok(log_base, vq->log_addr, sz));
 }
 
 /* Can we start vq? */
@@ -1371,7 +1680,11 @@ long vhost_vring_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *arg
 			r = -EFAULT;
 			break;
 		}
-		if (!s.num || s.num > 0xffff || (s.num & (s.num - 1))) {
+		/* Packed rings need not be a power of 2, but their
+		 * indices carry a wrap counter in bit 15. */
+		if (!s.num || s.num > 0xffff ||
+		    (vhost_is_packed(vq) ? s.num > 0x8000 :
+					   (s.num & (s.num - 1)))) {
 			r = -EINVAL;
 			break;
 		}
@@ -1392,13 +1705,34 @@ long vhost_vring_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *arg
 			r = -EINVAL;
 			break;
 		}
-		vq->last_avail_idx = s.num;
+		if (vhost_is_packed(vq)) {
+			/* Bits 0-14 are the ring index, bit 15 is the wrap
+			 * counter.  No buffers are in flight across a
+			 * restore, so the used side starts at the same
+			 * place. */
+			u16 base = s.num & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+			if (base >= vq->num) {
+				r = -EINVAL;
+				break;
+			}
+			vq->last_avail_idx = base;
+			vq->avail_wrap_counter = !!(s.num &
+					(1 << VRING_PACKED_EVENT_F_WRAP_CTR));
+			vq->last_used_idx = vq->last_avail_idx;
+			vq->used_wrap_counter = vq->avail_wrap_counter;
+		} else {
+			vq->last_avail_idx = s.num;
+		}
 		/* Forget the cached index value. */
 		vq->avail_idx = vq->last_avail_idx;
 		break;
 	case VHOST_GET_VRING_BASE:
 		s.index = idx;
 		s.num = vq->last_avail_idx;
+		if (vhost_is_packed(vq))
+			s.num |= (u32)vq->avail_wrap_counter <<
+				 VRING_PACKED_EVENT_F_WRAP_CTR;
 		if (copy_to_user(argp, &s, sizeof s))
 			r = -EFAULT;
 		break;
@@ -1442,9 +1776,12 @@ long vhost_vring_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *arg
 				break;
 			}
 
-			/* Also validate log access for used ring if enabled. */
+			/* Also validate log access for used ring if enabled.
+			 * Packed rings log the descriptor ring instead. */
 			if ((a.flags & (0x1 << VHOST_VRING_F_LOG)) &&
 			    !log_access_ok(vq->log_base, a.log_guest_addr,
+					   vhost_is_packed(vq) ?
+					   vq->num * sizeof *vq->desc_packed :
 					   sizeof *vq->used +
 					   vq->num * sizeof *vq->used->ring)) {
 				r = -EINVAL;
@@ -1627,6 +1964,16 @@ long vhost_dev_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *argp)
 		if (ctx)
 			eventfd_ctx_put(ctx);
 		break;
+	case VHOST_NEW_WORKER:
+		r = vhost_new_worker(d, argp);
+		break;
+	case VHOST_FREE_WORKER:
+		r = vhost_free_worker(d, argp);
+		break;
+	case VHOST_ATTACH_VRING_WORKER:
+	case VHOST_GET_VRING_WORKER:
+		r = vhost_vring_worker_ioctl(d, ioctl, argp);
+		break;
 	default:
 		r = -ENOIOCTLCMD;
 		break;
@@ -1711,9 +2058,39 @@ int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 }
 EXPORT_SYMBOL_GPL(vhost_log_write);
 
+/* The packed ring has no used->flags; mirror the notification state kept
+ * in vq->used_flags into the device event suppression structure. */
+static int vhost_update_device_flags(struct vhost_virtqueue *vq)
+{
+	u16 flags, off_wrap;
+
+	if (vq->used_flags & VRING_USED_F_NO_NOTIFY) {
+		flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+	} else if (vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+		off_wrap = vq->last_avail_idx | vq->avail_wrap_counter <<
+						 VRING_PACKED_EVENT_F_WRAP_CTR;
+		if (vhost_put_user(vq, cpu_to_le16(off_wrap),
+				   &vq->device_event->off_wrap))
+			return -EFAULT;
+		/* Make sure the event offset is seen before the flags. */
+		smp_wmb();
+		flags = VRING_PACKED_EVENT_FLAG_DESC;
+	} else {
+		flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+	}
+
+	if (vhost_put_user(vq, cpu_to_le16(flags), &vq->device_event->flags))
+		return -EFAULT;
+	return 0;
+}
+
 static int vhost_update_used_flags(struct vhost_virtqueue *vq)
 {
 	void __user *used;
+
+	if (vhost_is_packed(vq))
+		return vhost_update_device_flags(vq);
+
 	if (vhost_put_user(vq, cpu_to_vhost16(vq, vq->used_flags),
 			   &vq->used->flags) < 0)
 		return -EFAULT;
@@ -1762,10 +2139,23 @@ int vhost_vq_init_access(struct vhost_virtqueue *vq)
 
 	vhost_init_is_le(vq);
 
+	if (vhost_is_packed(vq)) {
+		kfree(vq->desc_count);
+		vq->desc_count = kcalloc(vq->num, sizeof(*vq->desc_count),
+					 GFP_KERNEL);
+		if (!vq->desc_count) {
+			r = -ENOMEM;
+			goto err;
+		}
+	}
+
 	r = vhost_update_used_flags(vq);
 	if (r)
 		goto err;
 	vq->signalled_used_valid = false;
+	/* The used position of a packed ring comes from SET_VRING_BASE. */
+	if (vhost_is_packed(vq))
+		return 0;
 	if (!vq->iotlb &&
 	    !access_ok(VERIFY_READ, &vq->used->idx, sizeof vq->used->idx)) {
 		r = -EFAULT;
@@ -1946,6 +2336,249 @@ static int get_indirect(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+static bool vhost_desc_avail_packed(u16 flags, bool wrap_counter)
+{
+	bool avail = flags & (1 << VRING_PACKED_DESC_F_AVAIL);
+	bool used = flags & (1 << VRING_PACKED_DESC_F_USED);
+
+	return avail == wrap_counter && used != wrap_counter;
+}
+
+static bool vhost_vq_avail_empty_packed(struct vhost_virtqueue *vq)
+{
+	__le16 flags;
+
+	if (vhost_get_desc(vq, flags,
+			   &vq->desc_packed[vq->last_avail_idx].flags))
+		return false;
+
+	return !vhost_desc_avail_packed(le16_to_cpu(flags),
+					vq->avail_wrap_counter);
+}
+
+static int get_indirect_packed(struct vhost_virtqueue *vq,
+			       struct iovec iov[], unsigned int iov_size,
+			       unsigned int *out_num, unsigned int *in_num,
+			       struct vhost_log *log, unsigned int *log_num,
+			       struct vring_packed_desc *indirect)
+{
+	struct vring_packed_desc desc;
+	unsigned int i, count;
+	u32 len = le32_to_cpu(indirect->len);
+	struct iov_iter from;
+	int ret, access;
+
+	/* Sanity check */
+	if (unlikely(!len || len % sizeof desc)) {
+		vq_err(vq, "Invalid length in indirect descriptor: "
+		       "len 0x%llx not multiple of 0x%zx\n",
+		       (unsigned long long)len,
+		       sizeof desc);
+		return -EINVAL;
+	}
+
+	ret = translate_desc(vq, le64_to_cpu(indirect->addr), len,
+			     vq->indirect, UIO_MAXIOV, VHOST_ACCESS_RO);
+	if (unlikely(ret < 0)) {
+		if (ret != -EAGAIN)
+			vq_err(vq, "Translation failure %d in indirect.\n", ret);
+		return ret;
+	}
+	iov_iter_init(&from, READ, vq->indirect, ret, len);
+
+	/* We will use the result as an address to read from, so most
+	 * architectures only need a compiler barrier here. */
+	read_barrier_depends();
+
+	/* Indirect tables are laid out sequentially, there is no chaining
+	 * through the next field. */
+	count = len / sizeof desc;
+	if (unlikely(count > USHRT_MAX + 1)) {
+		vq_err(vq, "Indirect buffer length too big: %d\n", len);
+		return -E2BIG;
+	}
+
+	for (i = 0; i < count; i++) {
+		unsigned iov_count = *in_num + *out_num;
+		u16 flags;
+
+		if (unlikely(!copy_from_iter_full(&desc, sizeof(desc), &from))) {
+			vq_err(vq, "Failed indirect descriptor: idx %d, %zx\n",
+			       i, (size_t)le64_to_cpu(indirect->addr) +
+			       i * sizeof desc);
+			return -EINVAL;
+		}
+		flags = le16_to_cpu(desc.flags);
+		if (unlikely(flags & VRING_DESC_F_INDIRECT)) {
+			vq_err(vq, "Nested indirect descriptor: idx %d, %zx\n",
+			       i, (size_t)le64_to_cpu(indirect->addr) +
+			       i * sizeof desc);
+			return -EINVAL;
+		}
+
+		if (flags & VRING_DESC_F_WRITE)
+			access = VHOST_ACCESS_WO;
+		else
+			access = VHOST_ACCESS_RO;
+
+		ret = translate_desc(vq, le64_to_cpu(desc.addr),
+				     le32_to_cpu(desc.len), iov + iov_count,
+				     iov_size - iov_count, access);
+		if (unlikely(ret < 0)) {
+			if (ret != -EAGAIN)
+				vq_err(vq, "Translation failure %d indirect idx %d\n",
+					ret, i);
+			return ret;
+		}
+		/* If this is an input descriptor, increment that count. */
+		if (access == VHOST_ACCESS_WO) {
+			*in_num += ret;
+			if (unlikely(log)) {
+				log[*log_num].addr = le64_to_cpu(desc.addr);
+				log[*log_num].len = le32_to_cpu(desc.len);
+				++*log_num;
+			}
+		} else {
+			/* If it's an output descriptor, they're all supposed
+			 * to come before any input descriptors. */
+			if (unlikely(*in_num)) {
+				vq_err(vq, "Indirect descriptor "
+				       "has out after in: idx %d\n", i);
+				return -EINVAL;
+			}
+			*out_num += ret;
+		}
+	}
+	return 0;
+}
+
+/* Packed ring version of vhost_get_vq_desc(): the driver makes a buffer
+ * available by flipping the flags of its first descriptor, and the buffer
+ * id to report back is carried by its last one. */
+static int vhost_get_vq_desc_packed(struct vhost_virtqueue *vq,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num, unsigned int *in_num,
+				    struct vhost_log *log,
+				    unsigned int *log_num)
+{
+	struct vring_packed_desc desc;
+	unsigned int i, count = 0;
+	bool wrap_counter = vq->avail_wrap_counter;
+	u16 flags, id = 0;
+	__le16 head_flags;
+	int ret, access;
+
+	i = vq->last_avail_idx;
+	if (unlikely(vhost_get_desc(vq, head_flags,
+				    &vq->desc_packed[i].flags))) {
+		vq_err(vq, "Failed to access avail desc flags at %p\n",
+		       &vq->desc_packed[i].flags);
+		return -EFAULT;
+	}
+
+	/* If there's nothing new since last we looked, return invalid. */
+	if (!vhost_desc_avail_packed(le16_to_cpu(head_flags), wrap_counter))
+		return vq->num;
+
+	/* Only read the rest of the chain after the driver exposed it. */
+	smp_rmb();
+
+	/* When we start there are none of either input nor output. */
+	*out_num = *in_num = 0;
+	if (unlikely(log))
+		*log_num = 0;
+
+	do {
+		unsigned iov_count = *in_num + *out_num;
+
+		if (unlikely(++count > vq->num)) {
+			vq_err(vq, "Loop detected: last one at %u "
+			       "vq size %u head %u\n",
+			       i, vq->num, vq->last_avail_idx);
+			return -EINVAL;
+		}
+		ret = vhost_copy_from_user(vq, &desc, vq->desc_packed + i,
+					   sizeof desc);
+		if (unlikely(ret)) {
+			vq_err(vq, "Failed to get descriptor: idx %d addr %p\n",
+			       i, vq->desc_packed + i);
+			return -EFAULT;
+		}
+		flags = le16_to_cpu(desc.flags);
+		id = le16_to_cpu(desc.id);
+
+		if (flags & VRING_DESC_F_INDIRECT) {
+			ret = get_indirect_packed(vq, iov, iov_size,
+						  out_num, in_num,
+						  log, log_num, &desc);
+			if (unlikely(ret < 0)) {
+				if (ret != -EAGAIN)
+					vq_err(vq, "Failure detected "
+						"in indirect descriptor at idx %d\n", i);
+				return ret;
+			}
+			goto next;
+		}
+
+		if (flags & VRING_DESC_F_WRITE)
+			access = VHOST_ACCESS_WO;
+		else
+			access = VHOST_ACCESS_RO;
+		ret = translate_desc(vq, le64_to_cpu(desc.addr),
+				     le32_to_cpu(desc.len), iov + iov_count,
+				     iov_size - iov_count, access);
+		if (unlikely(ret < 0)) {
+			if (ret != -EAGAIN)
+				vq_err(vq, "Translation failure %d descriptor idx %d\n",
+					ret, i);
+			return ret;
+		}
+		if (access == VHOST_ACCESS_WO) {
+			/* If this is an input descriptor,
+			 * increment that count. */
+			*in_num += ret;
+			if (unlikely(log)) {
+				log[*log_num].addr = le64_to_cpu(desc.addr);
+				log[*log_num].len = le32_to_cpu(desc.len);
+				++*log_num;
+			}
+		} else {
+			/* If it's an output descriptor, they're all supposed
+			 * to come before any input descriptors. */
+			if (unlikely(*in_num)) {
+				vq_err(vq, "Descriptor has out after in: "
+				       "idx %d\n", i);
+				return -EINVAL;
+			}
+			*out_num += ret;
+		}
+next:
+		if (++i >= vq->num) {
+			i = 0;
+			wrap_counter ^= 1;
+		}
+	} while (flags & VRING_DESC_F_NEXT);
+
+	/* If their number is silly, that's an error. */
+	if (unlikely(id >= vq->num)) {
+		vq_err(vq, "Guest says buffer id %u > %u is available",
+		       id, vq->num);
+		return -EINVAL;
+	}
+
+	/* On success, move past the chain and remember its length for
+	 * vhost_add_used_n() and vhost_discard_vq_desc(). */
+	vq->desc_count[id] = count;
+	vq->avail_hist[vq->avail_hist_idx++ % UIO_MAXIOV] = count;
+	vq->last_avail_idx = i;
+	vq->avail_wrap_counter = wrap_counter;
+
+	/* Assume notifications from guest are disabled at this point,
+	 * if they aren't we would need to update the device event. */
+	BUG_ON(!(vq->used_flags & VRING_USED_F_NO_NOTIFY));
+	return id;
+}
+
 /* This looks in the virtqueue and for the first available buffer, and converts
  * it to an iovec for convenient access.  Since descriptors consist of some
  * number of output then some number of input descriptors, it's actually two
@@ -1966,6 +2599,11 @@ int vhost_get_vq_desc(struct vhost_virtqueue *vq,
 	__virtio16 ring_head;
 	int ret, access;
 
+	if (vhost_is_packed(vq))
+		return vhost_get_vq_desc_packed(vq, iov, iov_size,
+						out_num, in_num,
+						log, log_num);
+
 	/* Check it isn't doing very strange things with descriptor numbers. */
 	last_avail_idx = vq->last_avail_idx;
 
@@ -2100,7 +2738,21 @@ EXPORT_SYMBOL_GPL(vhost_get_vq_desc);
 /* Reverse the effect of vhost_get_vq_desc. Useful for error handling. */
 void vhost_discard_vq_desc(struct vhost_virtqueue *vq, int n)
 {
-	vq->last_avail_idx -= n;
+	u16 count;
+
+	if (!vhost_is_packed(vq)) {
+		vq->last_avail_idx -= n;
+		return;
+	}
+
+	while (n--) {
+		count = vq->avail_hist[--vq->avail_hist_idx % UIO_MAXIOV];
+		if (vq->last_avail_idx < count) {
+			vq->last_avail_idx += vq->num;
+			vq->avail_wrap_counter ^= 1;
+		}
+		vq->last_avail_idx -= count;
+	}
 }
 EXPORT_SYMBOL_GPL(vhost_discard_vq_desc);
 
@@ -2160,6 +2812,103 @@ static int __vhost_add_used_n(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+static void vhost_log_used_packed(struct vhost_virtqueue *vq, u16 start,
+				  unsigned int count)
+{
+	unsigned int n = min_t(unsigned int, count, vq->num - start);
+
+	log_write(vq->log_base, vq->log_addr + start * sizeof(*vq->desc_packed),
+		  n * sizeof(*vq->desc_packed));
+	if (count > n)
+		log_write(vq->log_base, vq->log_addr,
+			  (count - n) * sizeof(*vq->desc_packed));
+}
+
+/* Used buffers are written back into the descriptor ring in order, each
+ * one skipping over as many slots as its chain occupied.  The flags of the
+ * first element are written last so the driver sees the batch at once. */
+static int vhost_add_used_n_packed(struct vhost_virtqueue *vq,
+				   struct vring_used_elem *heads,
+				   unsigned count)
+{
+	struct vring_packed_desc __user *desc;
+	u16 idx = vq->last_used_idx, start = idx;
+	bool wrap_counter = vq->used_wrap_counter;
+	__le16 head_flags = 0;
+	unsigned int i, total = 0, dist;
+	u16 flags;
+	u32 id, len;
+
+	for (i = 0; i < count; i++) {
+		id = vhost32_to_cpu(vq, heads[i].id);
+		len = vhost32_to_cpu(vq, heads[i].len);
+		if (unlikely(id >= vq->num || !vq->desc_count[id])) {
+			vq_err(vq, "Used buffer id %u is not in flight", id);
+			return -EINVAL;
+		}
+
+		desc = vq->desc_packed + idx;
+		if (vhost_put_desc(vq, cpu_to_le16(id), &desc->id) ||
+		    vhost_put_desc(vq, cpu_to_le32(len), &desc->len)) {
+			vq_err(vq, "Failed to write used desc");
+			return -EFAULT;
+		}
+
+		flags = wrap_counter ? 1 << VRING_PACKED_DESC_F_AVAIL |
+				       1 << VRING_PACKED_DESC_F_USED : 0;
+		if (len)
+			flags |= VRING_DESC_F_WRITE;
+		if (i == 0) {
+			head_flags = cpu_to_le16(flags);
+		} else {
+			/* Make sure id and len are seen before flags. */
+			smp_wmb();
+			if (vhost_put_desc(vq, cpu_to_le16(flags),
+					   &desc->flags)) {
+				vq_err(vq, "Failed to write used flags");
+				return -EFAULT;
+			}
+		}
+
+		total += vq->desc_count[id];
+		idx += vq->desc_count[id];
+		vq->desc_count[id] = 0;
+		if (idx >= vq->num) {
+			idx -= vq->num;
+			wrap_counter ^= 1;
+		}
+	}
+
+	if (count) {
+		/* Make sure the whole batch is seen before the head flags. */
+		smp_wmb();
+		if (vhost_put_desc(vq, head_flags,
+				   &vq->desc_packed[start].flags)) {
+			vq_err(vq, "Failed to write used flags");
+			return -EFAULT;
+		}
+	}
+
+	if (unlikely(vq->log_used)) {
+		/* Make sure data is seen before log. */
+		smp_wmb();
+		vhost_log_used_packed(vq, start, min_t(unsigned int, total,
+						       vq->num));
+		if (vq->log_ctx)
+			eventfd_signal(vq->log_ctx, 1);
+	}
+
+	vq->last_used_idx = idx;
+	vq->used_wrap_counter = wrap_counter;
+
+	/* Passing the last signalled position means it is more than a
+	 * lap behind; invalidate it, as __vhost_add_used_n() does. */
+	dist = (vq->signalled_used + vq->num - start) % vq->num;
+	if (unlikely(total >= vq->num || (dist && dist <= total)))
+		vq->signalled_used_valid = false;
+	return 0;
+}
+
 /* After we've used one of their buffers, we tell them about it.  We'll then
  * want to notify the guest, using eventfd. */
 int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
@@ -2167,6 +2916,9 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 {
 	int start, n, r;
 
+	if (vhost_is_packed(vq))
+		return vhost_add_used_n_packed(vq, heads, count);
+
 	start = vq->last_used_idx & (vq->num - 1);
 	n = vq->num - start;
 	if (n < count) {
@@ -2197,6 +2949,51 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 }
 EXPORT_SYMBOL_GPL(vhost_add_used_n);
 
+static bool vhost_notify_packed(struct vhost_dev *dev,
+				struct vhost_virtqueue *vq)
+{
+	__u16 old, new, event;
+	__le16 flags, off_wrap;
+	bool v, wrap_counter;
+
+	if (vhost_has_feature(vq, VIRTIO_F_NOTIFY_ON_EMPTY) &&
+	    unlikely(vhost_vq_avail_empty_packed(vq)))
+		return true;
+
+	if (vhost_get_avail(vq, flags, &vq->driver_event->flags)) {
+		vq_err(vq, "Failed to get driver event flags");
+		return true;
+	}
+	if (flags != cpu_to_le16(VRING_PACKED_EVENT_FLAG_DESC)) {
+		vq->signalled_used_valid = false;
+		return flags != cpu_to_le16(VRING_PACKED_EVENT_FLAG_DISABLE);
+	}
+
+	old = vq->signalled_used;
+	v = vq->signalled_used_valid;
+	new = vq->signalled_used = vq->last_used_idx;
+	vq->signalled_used_valid = true;
+
+	if (unlikely(!v))
+		return true;
+
+	if (vhost_get_avail(vq, off_wrap, &vq->driver_event->off_wrap)) {
+		vq_err(vq, "Failed to get driver event off_wrap");
+		return true;
+	}
+	event = le16_to_cpu(off_wrap);
+	wrap_counter = event >> VRING_PACKED_EVENT_F_WRAP_CTR;
+	event &= ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+	/* Bring the event and the old position into the lap of new. */
+	if (wrap_counter != vq->used_wrap_counter)
+		event -= vq->num;
+	if (new < old)
+		old -= vq->num;
+
+	return vring_need_event(event, new, old);
+}
+
 static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
 	__u16 old, new;
@@ -2207,6 +3004,9 @@ static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	 * interrupts. */
 	smp_mb();
 
+	if (vhost_is_packed(vq))
+		return vhost_notify_packed(dev, vq);
+
 	if (vhost_has_feature(vq, VIRTIO_F_NOTIFY_ON_EMPTY) &&
 	    unlikely(vq->avail_idx == vq->last_avail_idx))
 		return true;
@@ -2269,6 +3069,9 @@ bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	__virtio16 avail_idx;
 	int r;
 
+	if (vhost_is_packed(vq))
+		return vhost_vq_avail_empty_packed(vq);
+
 	if (vq->avail_idx != vq->last_avail_idx)
 		return false;
 
@@ -2290,6 +3093,17 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (!(vq->used_flags & VRING_USED_F_NO_NOTIFY))
 		return false;
 	vq->used_flags &= ~VRING_USED_F_NO_NOTIFY;
+	if (vhost_is_packed(vq)) {
+		r = vhost_update_used_flags(vq);
+		if (r) {
+			vq_err(vq, "Failed to enable notification at %p: %d\n",
+			       &vq->device_event->flags, r);
+			return false;
+		}
+		/* They could have slipped one in as we were doing that. */
+		smp_mb();
+		return !vhost_vq_avail_empty_packed(vq);
+	}
 	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r) {
@@ -2327,7 +3141,8 @@ void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (vq->used_flags & VRING_USED_F_NO_NOTIFY)
 		return;
 	vq->used_flags |= VRING_USED_F_NO_NOTIFY;
-	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+	if (vhost_is_packed(vq) ||
+	    !vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r)
 			vq_err(vq, "Failed to enable notification at %p: %d\n",
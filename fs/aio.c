@@ -150,6 +150,15 @@ struct kioctx {
 		spinlock_t	completion_lock;
 	} ____cacheline_aligned_in_smp;
 
+	/*
+	 * Polled (RWF_HIPRI) requests in flight.  Their completion only
+	 * marks them done; they get to the ring when reaped by the poller.
+	 */
+	struct {
+		struct mutex	poll_mutex;
+		struct list_head poll_list;
+	} ____cacheline_aligned_in_smp;
+
 	struct page		*internal_pages[AIO_RING_PAGES];
 	struct file		*aio_ring_file;
 
@@ -190,6 +199,11 @@ struct aio_kiocb {
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
 
+	/* for polled requests, see aio_iopoll() */
+	struct list_head	ki_poll_list;
+	long			ki_poll_res, ki_poll_res2;
+	bool			ki_poll_done;
+
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
 	 * this is the underlying eventfd context to deliver events to.
@@ -766,6 +780,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
+	mutex_init(&ctx->poll_mutex);
+	INIT_LIST_HEAD(&ctx->poll_list);
 
 	if (percpu_ref_init(&ctx->users, free_ioctx_users, 0, GFP_KERNEL))
 		goto err;
@@ -828,6 +844,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	return ERR_PTR(err);
 }
 
+static void aio_iopoll_drain(struct kioctx *ctx);
+
 /* kill_ioctx
  *	Cancels all outstanding aio requests on an aio context.  Used
  *	when the processes owning a context have all exited to encourage
@@ -852,6 +870,9 @@ static int kill_ioctx(struct mm_struct *mm, struct kioctx *ctx,
 	/* free_ioctx_reqs() will do the necessary RCU synchronization */
 	wake_up_all(&ctx->wait);
 
+	/* Nobody else is going to reap the polled requests */
+	aio_iopoll_drain(ctx);
+
 	/*
 	 * It'd be more correct to do this in free_ioctx(), after all
 	 * the outstanding kiocbs have finished - but by then io_destroy
@@ -1175,6 +1196,65 @@ static void aio_complete(struct aio_kiocb *iocb, long res, long res2)
 	percpu_ref_put(&ctx->reqs);
 }
 
+static void aio_complete_rw(struct kiocb *kiocb, long res, long res2);
+
+static void aio_complete_rw_poll(struct kiocb *kiocb, long res, long res2)
+{
+	struct aio_kiocb *iocb = container_of(kiocb, struct aio_kiocb, rw);
+
+	iocb->ki_poll_res = res;
+	iocb->ki_poll_res2 = res2;
+	smp_store_release(&iocb->ki_poll_done, true);
+}
+
+/*
+ * Complete the polled requests that are done, polling once for each of the
+ * others first.  A request stays around until it is reaped here, which is
+ * what lets the file's ->iopoll() look at it after it has completed.
+ *
+ * The caller holds a reference on ctx->users, so that the last request
+ * completed can't free @ctx under us.
+ */
+static void aio_iopoll(struct kioctx *ctx)
+{
+	struct aio_kiocb *iocb, *next;
+
+	mutex_lock(&ctx->poll_mutex);
+	list_for_each_entry_safe(iocb, next, &ctx->poll_list, ki_poll_list) {
+		struct kiocb *kiocb = &iocb->rw;
+
+		if (!smp_load_acquire(&iocb->ki_poll_done))
+			kiocb->ki_filp->f_op->iopoll(kiocb);
+		if (!smp_load_acquire(&iocb->ki_poll_done))
+			continue;
+
+		list_del(&iocb->ki_poll_list);
+		aio_complete_rw(kiocb, iocb->ki_poll_res, iocb->ki_poll_res2);
+	}
+	mutex_unlock(&ctx->poll_mutex);
+}
+
+static void aio_iopoll_drain(struct kioctx *ctx)
+{
+	while (!list_empty_careful(&ctx->poll_list)) {
+		aio_iopoll(ctx);
+		cond_resched();
+	}
+}
+
+static void aio_iopoll_add(struct aio_kiocb *iocb)
+{
+	struct kioctx *ctx = iocb->ki_ctx;
+
+	mutex_lock(&ctx->poll_mutex);
+	list_add_tail(&iocb->ki_poll_list, &ctx->poll_list);
+	mutex_unlock(&ctx->poll_mutex);
+
+	/* Racing with kill_ioctx(), which may be done draining already */
+	if (unlikely(atomic_read(&ctx->dead)))
+		aio_iopoll_drain(ctx);
+}
+
 /* aio_read_events_ring
  *	Pull an event off of the ioctx's event ring.  Returns the number of
  *	events fetched
@@ -1277,12 +1357,48 @@ static bool aio_read_events(struct kioctx *ctx, long min_nr, long nr,
 	return ret < 0 || *i >= min_nr;
 }
 
+/*
+ * The completions of polled requests only show up when they are polled
+ * for, so spin doing that instead of sleeping, as long as there are some.
+ */
+static long read_events_polled(struct kioctx *ctx, long min_nr, long nr,
+			       struct io_event __user *event,
+			       ktime_t until)
+{
+	ktime_t end = ktime_add_safe(ktime_get(), until);
+	long ret = 0;
+
+	for (;;) {
+		aio_iopoll(ctx);
+		if (aio_read_events(ctx, min_nr, nr, event, &ret))
+			break;
+		if (until == 0 || signal_pending(current))
+			break;
+		if (until != KTIME_MAX) {
+			until = ktime_sub(end, ktime_get());
+			if (until <= 0)
+				break;
+		}
+		if (list_empty_careful(&ctx->poll_list)) {
+			wait_event_interruptible_hrtimeout(ctx->wait,
+				aio_read_events(ctx, min_nr, nr, event, &ret),
+				until);
+			break;
+		}
+		cond_resched();
+	}
+	return ret;
+}
+
 static long read_events(struct kioctx *ctx, long min_nr, long nr,
 			struct io_event __user *event,
 			ktime_t until)
 {
 	long ret = 0;
 
+	if (!list_empty_careful(&ctx->poll_list))
+		return read_events_polled(ctx, min_nr, nr, event, until);
+
 	/*
 	 * Note that aio_read_events() is being called as the conditional - i.e.
 	 * we're calling it after prepare_to_wait() has set task state to
@@ -1452,9 +1568,23 @@ static int aio_prep_rw(struct kiocb *req, struct iocb *iocb)
 		req->ki_flags |= IOCB_EVENTFD;
 	req->ki_hint = file_write_hint(req->ki_filp);
 	ret = kiocb_set_rw_flags(req, iocb->aio_rw_flags);
-	if (unlikely(ret))
+	if (unlikely(ret)) {
 		fput(req->ki_filp);
-	return ret;
+		return ret;
+	}
+
+	/*
+	 * Polled completions are reaped by io_getevents(), which an eventfd
+	 * user doesn't call, and need a file that knows how to poll.
+	 */
+	if (req->ki_flags & IOCB_HIPRI) {
+		if (req->ki_filp->f_op->iopoll &&
+		    !(req->ki_flags & IOCB_EVENTFD))
+			req->ki_complete = aio_complete_rw_poll;
+		else
+			req->ki_flags &= ~IOCB_HIPRI;
+	}
+	return 0;
 }
 
 static int aio_setup_rw(int rw, struct iocb *iocb, struct iovec **iovec,
@@ -1480,6 +1610,8 @@ static inline ssize_t aio_rw_ret(struct kiocb *req, ssize_t ret)
 {
 	switch (ret) {
 	case -EIOCBQUEUED:
+		if (req->ki_flags & IOCB_HIPRI)
+			aio_iopoll_add(container_of(req, struct aio_kiocb, rw));
 		return ret;
 	case -ERESTARTSYS:
 	case -ERESTARTNOINTR:
@@ -687,6 +687,36 @@ static unsigned long randomize_stack_top(unsigned long stack_top)
 #endif
 }
 
+/*
+ * Map what the page cache already holds of the program and interpreter
+ * before they start, instead of taking a fault per page on the way to
+ * main().  One read fault per page table is enough: fault-around maps
+ * the rest of the cached pages it covers, see vma_fault_around_bytes().
+ * Nothing waits for I/O here, pages that are not cached yet only get
+ * their readahead started.
+ */
+static void elf_prefault(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	unsigned long addr;
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!vma->vm_file || !vma->vm_ops || !vma->vm_ops->map_pages)
+			continue;
+
+		for (addr = vma->vm_start; addr < vma->vm_end;
+		     addr = (addr + PMD_SIZE) & PMD_MASK) {
+			if (fatal_signal_pending(current))
+				goto out;
+			handle_mm_fault(vma, addr, FAULT_FLAG_ALLOW_RETRY |
+						   FAULT_FLAG_RETRY_NOWAIT);
+		}
+	}
+out:
+	up_read(&mm->mmap_sem);
+}
+
 static int load_elf_binary(struct linux_binprm *bprm)
 {
 	struct file *interpreter = NULL; /* to shut gcc up */
@@ -1129,6 +1159,8 @@ static int load_elf_binary(struct linux_binprm *bprm)
 			  load_addr, interp_load_addr);
 	if (retval < 0)
 		goto out;
+	if (test_bit(MMF_EXEC_PREFAULT, &current->mm->flags))
+		elf_prefault(current->mm);
 	/* N.B. passed_fileno might not be initialized? */
 	current->mm->end_code = end_code;
 	current->mm->start_code = start_code;
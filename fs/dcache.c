@@ -72,6 +72,13 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * Unused negative dentries live on their own per-superblock LRU, which
+ * reclaim scans first.  When it grows beyond this many entries, the
+ * oldest are pruned from a work item.  Zero means no limit.
+ */
+unsigned long sysctl_negative_dentry_limit __read_mostly;
+
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -119,6 +126,7 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
+static DEFINE_PER_CPU(long, nr_dentry_negative);
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
@@ -152,11 +160,21 @@ static long get_nr_dentry_unused(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -311,6 +329,8 @@ void release_dentry_name_snapshot(struct name_snapshot *name)
 }
 EXPORT_SYMBOL(release_dentry_name_snapshot);
 
+static void d_lru_retype(struct dentry *dentry);
+
 static inline void __d_set_inode_and_type(struct dentry *dentry,
 					  struct inode *inode,
 					  unsigned type_flags)
@@ -322,6 +342,7 @@ static inline void __d_set_inode_and_type(struct dentry *dentry,
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	flags |= type_flags;
 	WRITE_ONCE(dentry->d_flags, flags);
+	d_lru_retype(dentry);
 }
 
 static inline void __d_clear_type_and_inode(struct dentry *dentry)
@@ -331,6 +352,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
+	d_lru_retype(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -388,24 +410,76 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * The per-cpu "nr_dentry_unused" counters are updated with
  * the DCACHE_LRU_LIST bit.
  *
+ * The DCACHE_LRU_NEGATIVE bit says that the dentry was put on the
+ * superblock's negative dentry LRU instead of the main one; the
+ * per-cpu "nr_dentry_negative" counters follow it.  It stays set
+ * while the dentry is moved to a shrink list.
+ *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
  */
 #define D_FLAG_VERIFY(dentry,x) WARN_ON_ONCE(((dentry)->d_flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST)) != (x))
+static void d_prune_negative_workfn(struct work_struct *work);
+static DECLARE_WORK(d_prune_negative_work, d_prune_negative_workfn);
+
+static inline struct list_lru *d_lru_list(struct dentry *dentry)
+{
+	if (dentry->d_flags & DCACHE_LRU_NEGATIVE)
+		return &dentry->d_sb->s_dentry_neg_lru;
+	return &dentry->d_sb->s_dentry_lru;
+}
+
+static inline void d_lru_clear_negative(struct dentry *dentry)
+{
+	if (dentry->d_flags & DCACHE_LRU_NEGATIVE) {
+		dentry->d_flags &= ~DCACHE_LRU_NEGATIVE;
+		this_cpu_dec(nr_dentry_negative);
+	}
+}
+
 static void d_lru_add(struct dentry *dentry)
 {
+	unsigned long limit;
+
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
-	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
+	if (d_is_negative(dentry)) {
+		dentry->d_flags |= DCACHE_LRU_NEGATIVE;
+		this_cpu_inc(nr_dentry_negative);
+	}
+	WARN_ON_ONCE(!list_lru_add(d_lru_list(dentry), &dentry->d_lru));
+
+	limit = READ_ONCE(sysctl_negative_dentry_limit);
+	if (limit && (dentry->d_flags & DCACHE_LRU_NEGATIVE) &&
+	    list_lru_count(&dentry->d_sb->s_dentry_neg_lru) > limit)
+		schedule_work(&d_prune_negative_work);
 }
 
 static void d_lru_del(struct dentry *dentry)
 {
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
+	WARN_ON_ONCE(!list_lru_del(d_lru_list(dentry), &dentry->d_lru));
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
+	d_lru_clear_negative(dentry);
 	this_cpu_dec(nr_dentry_unused);
-	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
+}
+
+/*
+ * An unused dentry that becomes positive or negative moves over to the
+ * LRU for its new type, so a create/unlink storm doesn't leave the
+ * negative ones among the positive.
+ */
+static void d_lru_retype(struct dentry *dentry)
+{
+	unsigned int flags = dentry->d_flags;
+
+	if ((flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST)) != DCACHE_LRU_LIST)
+		return;
+	if (!(flags & DCACHE_LRU_NEGATIVE) == !d_is_negative(dentry))
+		return;
+	d_lru_del(dentry);
+	d_lru_add(dentry);
 }
 
 static void d_shrink_del(struct dentry *dentry)
@@ -413,6 +487,7 @@ static void d_shrink_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~(DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
+	d_lru_clear_negative(dentry);
 	this_cpu_dec(nr_dentry_unused);
 }
 
@@ -434,6 +509,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 {
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
+	d_lru_clear_negative(dentry);
 	this_cpu_dec(nr_dentry_unused);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
@@ -1169,12 +1245,40 @@ long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc)
 	LIST_HEAD(dispose);
 	long freed;
 
-	freed = list_lru_shrink_walk(&sb->s_dentry_lru, sc,
+	/* Negative dentries go first, with what's left over for the rest */
+	freed = list_lru_shrink_walk(&sb->s_dentry_neg_lru, sc,
 				     dentry_lru_isolate, &dispose);
+	if (sc->nr_to_scan)
+		freed += list_lru_shrink_walk(&sb->s_dentry_lru, sc,
+					      dentry_lru_isolate, &dispose);
 	shrink_dentry_list(&dispose);
 	return freed;
 }
 
+static void d_prune_negative_sb(struct super_block *sb, void *unused)
+{
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+	unsigned long nr = list_lru_count(&sb->s_dentry_neg_lru);
+	LIST_HEAD(dispose);
+
+	if (!limit || nr <= limit)
+		return;
+
+	list_lru_walk(&sb->s_dentry_neg_lru, dentry_lru_isolate, &dispose,
+		      nr - limit);
+	shrink_dentry_list(&dispose);
+}
+
+/*
+ * Bring the negative dentry LRUs that went over the limit back to it,
+ * oldest first.  Any left over because they were referenced are taken
+ * care of the next time a negative dentry is added.
+ */
+static void d_prune_negative_workfn(struct work_struct *work)
+{
+	iterate_supers(d_prune_negative_sb, NULL);
+}
+
 static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
 {
@@ -1212,10 +1316,13 @@ void shrink_dcache_sb(struct super_block *sb)
 
 		freed = list_lru_walk(&sb->s_dentry_lru,
 			dentry_lru_isolate_shrink, &dispose, 1024);
+		freed += list_lru_walk(&sb->s_dentry_neg_lru,
+			dentry_lru_isolate_shrink, &dispose, 1024);
 
 		this_cpu_sub(nr_dentry_unused, freed);
 		shrink_dentry_list(&dispose);
-	} while (list_lru_count(&sb->s_dentry_lru) > 0);
+	} while (list_lru_count(&sb->s_dentry_lru) > 0 ||
+		 list_lru_count(&sb->s_dentry_neg_lru) > 0);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
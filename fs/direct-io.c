@@ -86,6 +86,8 @@ struct dio_submit {
 	dio_submit_t *submit_io;	/* IO submition function */
 
 	loff_t logical_offset_in_bio;	/* current first logical block in bio */
+	unsigned int max_bio_size;	/* bytes the bio may grow to without
+					   being split by the queue */
 	sector_t final_block_in_bio;	/* current final block in bio + 1 */
 	sector_t next_block_for_io;	/* next block to be put under IO,
 					   in dio_blocks units */
@@ -738,9 +740,11 @@ static inline int dio_new_bio(struct dio *dio, struct dio_submit *sdio,
 	if (ret)
 		goto out;
 	sector = start_sector << (sdio->blkbits - 9);
-	nr_pages = min(sdio->pages_in_io, BIO_MAX_PAGES);
+	nr_pages = min_t(int, sdio->pages_in_io,
+			 bdev_max_bio_pages(map_bh->b_bdev));
 	BUG_ON(nr_pages <= 0);
 	dio_bio_alloc(dio, sdio, map_bh->b_bdev, sector, nr_pages);
+	sdio->max_bio_size = bdev_max_bio_sectors(map_bh->b_bdev, sector) << 9;
 	sdio->boundary = 0;
 out:
 	return ret;
@@ -814,6 +818,14 @@ static inline int dio_send_cur_page(struct dio *dio, struct dio_submit *sdio,
 			dio_bio_submit(dio, sdio);
 	}
 
+	/*
+	 * Don't grow the bio past what the queue takes in one piece, it
+	 * would only be split up again below us.
+	 */
+	if (sdio->bio && sdio->bio->bi_iter.bi_size + sdio->cur_page_len >
+			 sdio->max_bio_size)
+		dio_bio_submit(dio, sdio);
+
 	if (sdio->bio == NULL) {
 		ret = dio_new_bio(dio, sdio, sdio->cur_page_block, map_bh);
 		if (ret)
@@ -14,6 +14,7 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/sched/signal.h>
+#include <linux/sched/topology.h>
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/signal.h>
@@ -42,6 +43,7 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/vmalloc.h>
 #include <net/busy_poll.h>
 
 /*
@@ -100,6 +102,10 @@
 #define EPOLLEXCLUSIVE_OK_BITS (EPOLLINOUT_BITS | EPOLLERR | EPOLLHUP | \
 				EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
 
+/* Flags accepted by epoll_create1() and epoll_create2() */
+#define EP_CREATE_FLAGS (EPOLL_CLOEXEC | EPOLL_USERPOLL | EPOLL_WAKE_LOCAL | \
+			 EPOLL_WAKE_ROTATE)
+
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
 
@@ -150,11 +156,18 @@ struct epitem {
 	/* List header used to link this structure to the eventpoll ready list */
 	struct list_head rdllink;
 
-	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
-	 */
-	struct epitem *next;
+	union {
+		/*
+		 * Works together "struct eventpoll"->ovflist in keeping the
+		 * single linked chain of items.
+		 */
+		struct epitem *next;
+		/*
+		 * Slot in the user-mapped items array, EPOLL_USERPOLL
+		 * descriptors have no ovflist.
+		 */
+		int bit;
+	};
 
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
@@ -230,6 +243,35 @@ struct eventpoll {
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
 #endif
+
+	/*
+	 * For EPOLL_USERPOLL: the header and items shared with userspace,
+	 * the index ring that follows them in the same mapping and the
+	 * bitmaps of allocated item slots and of slots that were deleted
+	 * while userspace still had an event for them.  The bitmaps are
+	 * protected by "mtx".
+	 */
+	struct epoll_uheader *user_header;
+	unsigned int *user_index;
+	unsigned int user_index_mask;
+	unsigned long *items_bm;
+	unsigned long *removed_bm;
+
+	/* EPOLL_WAKE_* policy flags given at creation */
+	int wake_flags;
+
+	/*
+	 * Where the tasks woken from "wq" last ran relative to the waking CPU,
+	 * and how many exclusive wakeups were taken or passed on for lack of
+	 * waiters.  Updated under "lock", or the "wq" lock for EPOLL_USERPOLL.
+	 */
+	struct {
+		unsigned long local;
+		unsigned long llc;
+		unsigned long remote;
+		unsigned long excl_taken;
+		unsigned long excl_passed;
+	} wake_stats;
 };
 
 /* Wait structure used by the poll hooks */
@@ -385,6 +427,69 @@ static inline int ep_events_available(struct eventpoll *ep)
 	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
 }
 
+static bool ep_wake_waiter(struct eventpoll *ep, wait_queue_entry_t *wait,
+			   int cpu)
+{
+	/* The CPU the task last ran on, i.e. where its cache footprint is */
+	int tcpu = task_cpu(wait->private);
+
+	if (!wait->func(wait, TASK_NORMAL, 0, NULL))
+		return false;
+
+	if (tcpu == cpu)
+		ep->wake_stats.local++;
+	else if (cpus_share_cache(tcpu, cpu))
+		ep->wake_stats.llc++;
+	else
+		ep->wake_stats.remote++;
+
+	return true;
+}
+
+/*
+ * Wake up one task sleeping in epoll_wait(), with the lock of "wq" held.
+ * Waiters queue at the head, so without EPOLL_WAKE_LOCAL this wakes the
+ * most recent one, exactly like wake_up_locked().
+ */
+static void ep_wake_up_locked(struct eventpoll *ep)
+{
+	wait_queue_entry_t *curr, *pick = NULL;
+	int cpu = smp_processor_id();
+
+	if (ep->wake_flags & EPOLL_WAKE_LOCAL) {
+		list_for_each_entry(curr, &ep->wq.head, entry) {
+			int tcpu = task_cpu(curr->private);
+
+			if (tcpu == cpu) {
+				pick = curr;
+				break;
+			}
+			if (!pick && cpus_share_cache(tcpu, cpu))
+				pick = curr;
+		}
+		if (pick && ep_wake_waiter(ep, pick, cpu))
+			return;
+	}
+
+	/* Tasks already woken but not yet off the queue don't count */
+	list_for_each_entry(curr, &ep->wq.head, entry) {
+		if (curr != pick && ep_wake_waiter(ep, curr, cpu))
+			return;
+	}
+}
+
+static inline bool ep_userpoll(struct eventpoll *ep)
+{
+	return ep->user_header != NULL;
+}
+
+/* Userspace has not yet consumed everything the kernel put in the ring */
+static inline bool ep_user_events_available(struct eventpoll *ep)
+{
+	return READ_ONCE(ep->user_header->head) !=
+	       READ_ONCE(ep->user_header->tail);
+}
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 static bool ep_busy_loop_end(void *p, unsigned long start_time)
 {
@@ -736,7 +841,7 @@ static __poll_t ep_scan_ready_list(struct eventpoll *ep,
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			ep_wake_up_locked(ep);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -758,6 +863,100 @@ static void epi_rcu_free(struct rcu_head *head)
 	kmem_cache_free(epi_cache, epi);
 }
 
+/*
+ * Merge @pollflags into the user item of @bit and, if the item had no
+ * pending events, append it to the index ring.  Returns true if it was
+ * appended, i.e. userspace has something new to look at.  Called without
+ * ep->lock, concurrently from any number of wakeups.
+ */
+static bool ep_add_event_to_uring(struct eventpoll *ep, int bit,
+				  __poll_t pollflags)
+{
+	struct epoll_uheader *header = ep->user_header;
+	struct epoll_uitem *uitem = &header->items[bit];
+	__poll_t old, prev;
+	unsigned int tail;
+
+	old = READ_ONCE(uitem->ready_events);
+	for (;;) {
+		prev = cmpxchg(&uitem->ready_events, old, old | pollflags);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+	/* Still queued, userspace will see the new bits when it gets there */
+	if (old)
+		return false;
+
+	tail = READ_ONCE(header->tail);
+	for (;;) {
+		prev = cmpxchg(&header->tail, tail, tail + 1);
+		if (prev == tail)
+			break;
+		tail = prev;
+	}
+	/* Zero means "not written yet" to userspace, hence the + 1 */
+	WRITE_ONCE(ep->user_index[tail & ep->user_index_mask], bit + 1);
+
+	return true;
+}
+
+static void ep_user_wakeup(struct eventpoll *ep)
+{
+	unsigned long flags;
+
+	/* The cmpxchg()s in ep_add_event_to_uring() order the ring update */
+	if (waitqueue_active(&ep->wq)) {
+		spin_lock_irqsave(&ep->wq.lock, flags);
+		ep_wake_up_locked(ep);
+		spin_unlock_irqrestore(&ep->wq.lock, flags);
+	}
+	if (waitqueue_active(&ep->poll_wait))
+		ep_poll_safewake(&ep->poll_wait);
+}
+
+/*
+ * Find a free item slot, reclaiming deleted ones that userspace has
+ * finished with.  Must be called with "mtx" held.
+ */
+static int ep_get_user_item(struct eventpoll *ep)
+{
+	unsigned int max = ep->user_header->max_items_nr;
+	unsigned int bit;
+
+	bit = find_first_zero_bit(ep->items_bm, max);
+	if (bit >= max) {
+		for_each_set_bit(bit, ep->removed_bm, max) {
+			if (READ_ONCE(ep->user_header->items[bit].ready_events))
+				continue;
+			clear_bit(bit, ep->removed_bm);
+			clear_bit(bit, ep->items_bm);
+		}
+		bit = find_first_zero_bit(ep->items_bm, max);
+		if (bit >= max)
+			return -ENOSPC;
+	}
+	set_bit(bit, ep->items_bm);
+
+	return bit;
+}
+
+/*
+ * Release the item slot of @epi once its wait queues are gone.  If the
+ * item is still in the ring, or being consumed, userspace will find
+ * EPOLLREMOVED and the slot is kept until it has cleared ready_events.
+ * Must be called with "mtx" held.
+ */
+static void ep_put_user_item(struct eventpoll *ep, struct epitem *epi)
+{
+	struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+
+	if (xchg(&uitem->ready_events, EPOLLREMOVED))
+		set_bit(epi->bit, ep->removed_bm);
+	else
+		clear_bit(epi->bit, ep->items_bm);
+}
+
 /*
  * Removes a "struct epitem" from the eventpoll RB tree and deallocates
  * all the associated resources. Must be called with "mtx" held.
@@ -777,6 +976,9 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 	 */
 	ep_unregister_pollwait(ep, epi);
 
+	if (ep_userpoll(ep))
+		ep_put_user_item(ep, epi);
+
 	/* Remove the current item from the list of epoll hooks */
 	spin_lock(&file->f_lock);
 	list_del_rcu(&epi->fllink);
@@ -853,6 +1055,9 @@ static void ep_free(struct eventpoll *ep)
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
+	vfree(ep->user_header);
+	kfree(ep->items_bm);
+	kfree(ep->removed_bm);
 	kfree(ep);
 }
 
@@ -889,6 +1094,9 @@ static __poll_t ep_item_poll(const struct epitem *epi, poll_table *pt,
 
 	ep = epi->ffd.file->private_data;
 	poll_wait(epi->ffd.file, &ep->poll_wait, pt);
+	if (ep_userpoll(ep))
+		return ep_user_events_available(ep) ?
+		       (EPOLLIN | EPOLLRDNORM) & epi->event.events : 0;
 	locked = pt && (pt->_qproc == ep_ptable_queue_proc);
 
 	return ep_scan_ready_list(epi->ffd.file->private_data,
@@ -931,6 +1139,9 @@ static __poll_t ep_eventpoll_poll(struct file *file, poll_table *wait)
 	/* Insert inside our poll wait queue */
 	poll_wait(file, &ep->poll_wait, wait);
 
+	if (ep_userpoll(ep))
+		return ep_user_events_available(ep) ? EPOLLIN | EPOLLRDNORM : 0;
+
 	/*
 	 * Proceed to find out if wanted events are really available inside
 	 * the ready list.
@@ -959,10 +1170,29 @@ static void ep_show_fdinfo(struct seq_file *m, struct file *f)
 		if (seq_has_overflowed(m))
 			break;
 	}
+
+	seq_printf(m, "wakeups: local: %lu llc: %lu remote: %lu "
+		   "exclusive-taken: %lu exclusive-passed: %lu\n",
+		   ep->wake_stats.local, ep->wake_stats.llc,
+		   ep->wake_stats.remote, ep->wake_stats.excl_taken,
+		   ep->wake_stats.excl_passed);
 	mutex_unlock(&ep->mtx);
 }
 #endif
 
+static int ep_eventpoll_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct eventpoll *ep = file->private_data;
+
+	if (!ep_userpoll(ep))
+		return -ENODEV;
+	/* Userspace writes head, the index and ready_events back */
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ep->user_header, vma->vm_pgoff);
+}
+
 /* File callbacks that implement the eventpoll file behaviour */
 static const struct file_operations eventpoll_fops = {
 #ifdef CONFIG_PROC_FS
@@ -970,6 +1200,7 @@ static const struct file_operations eventpoll_fops = {
 #endif
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
+	.mmap		= ep_eventpoll_mmap,
 	.llseek		= noop_llseek,
 };
 
@@ -1036,6 +1267,41 @@ static int ep_alloc(struct eventpoll **pep)
 	return error;
 }
 
+/*
+ * Allocate the memory shared with userspace for an EPOLL_USERPOLL
+ * descriptor of up to @nr items.
+ */
+static int ep_alloc_user(struct eventpoll *ep, unsigned int nr)
+{
+	struct epoll_uheader *header;
+	unsigned int header_length, index_length;
+	size_t bm_size = BITS_TO_LONGS(nr) * sizeof(long);
+
+	header_length = PAGE_ALIGN(sizeof(*header) +
+				   nr * sizeof(struct epoll_uitem));
+	index_length = PAGE_ALIGN(roundup_pow_of_two(nr) * sizeof(u32));
+
+	ep->items_bm = kzalloc(bm_size, GFP_KERNEL);
+	ep->removed_bm = kzalloc(bm_size, GFP_KERNEL);
+	if (!ep->items_bm || !ep->removed_bm)
+		return -ENOMEM;
+
+	header = vmalloc_user(header_length + index_length);
+	if (!header)
+		return -ENOMEM;
+
+	header->magic = EPOLL_USERPOLL_HEADER_MAGIC;
+	header->header_length = header_length;
+	header->index_length = index_length;
+	header->max_items_nr = nr;
+
+	ep->user_index = (void *)header + header_length;
+	ep->user_index_mask = index_length / sizeof(u32) - 1;
+	ep->user_header = header;
+
+	return 0;
+}
+
 /*
  * Search the file inside the eventpoll tree. The RB tree operations
  * are protected by the "mtx" mutex, and ep_find() must be called with
@@ -1109,6 +1375,48 @@ struct file *get_epoll_tfile_raw_ptr(struct file *file, int tfd,
 }
 #endif /* CONFIG_CHECKPOINT_RESTORE */
 
+static void ep_pollfree(wait_queue_entry_t *wait)
+{
+	/*
+	 * If we race with ep_remove_wait_queue() it can miss
+	 * ->whead = NULL and do another remove_wait_queue() after
+	 * us, so we can't use __remove_wait_queue().
+	 */
+	list_del_init(&wait->entry);
+	/*
+	 * ->whead != NULL protects us from the race with ep_free()
+	 * or ep_remove(), ep_remove_wait_queue() takes whead->lock
+	 * held by the caller. Once we nullify it, nothing protects
+	 * ep/epi or even wait.
+	 */
+	smp_store_release(&ep_pwq_from_wait(wait)->whead, NULL);
+}
+
+/*
+ * The EPOLL_USERPOLL flavour of ep_poll_callback(): the events go straight
+ * into the shared ring, so no ep->lock and no ready list.  Devices that
+ * do not pass the events in "key" get the whole interest mask reported.
+ */
+static int ep_poll_callback_user(wait_queue_entry_t *wait, struct epitem *epi,
+				 __poll_t pollflags)
+{
+	struct eventpoll *ep = epi->ep;
+	__poll_t events = READ_ONCE(epi->event.events) & ~EP_PRIVATE_BITS;
+
+	if (pollflags & POLLFREE) {
+		ep_pollfree(wait);
+		return 1;
+	}
+
+	if (!pollflags)
+		pollflags = events;
+	pollflags &= events;
+	if (pollflags && ep_add_event_to_uring(ep, epi->bit, pollflags))
+		ep_user_wakeup(ep);
+
+	return 1;
+}
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
@@ -1123,6 +1431,9 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	__poll_t pollflags = key_to_poll(key);
 	int ewake = 0;
 
+	if (ep_userpoll(ep))
+		return ep_poll_callback_user(wait, epi, pollflags);
+
 	spin_lock_irqsave(&ep->lock, flags);
 
 	ep_set_busy_poll_napi_id(epi);
@@ -1194,7 +1505,13 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 				break;
 			}
 		}
-		wake_up_locked(&ep->wq);
+		ep_wake_up_locked(ep);
+	}
+	if (epi->event.events & EPOLLEXCLUSIVE) {
+		if (ewake)
+			ep->wake_stats.excl_taken++;
+		else
+			ep->wake_stats.excl_passed++;
 	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
@@ -1208,22 +1525,16 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 
 	if (!(epi->event.events & EPOLLEXCLUSIVE))
 		ewake = 1;
-
-	if (pollflags & POLLFREE) {
-		/*
-		 * If we race with ep_remove_wait_queue() it can miss
-		 * ->whead = NULL and do another remove_wait_queue() after
-		 * us, so we can't use __remove_wait_queue().
-		 */
-		list_del_init(&wait->entry);
+	else if (ewake && (ep->wake_flags & EPOLL_WAKE_ROTATE))
 		/*
-		 * ->whead != NULL protects us from the race with ep_free()
-		 * or ep_remove(), ep_remove_wait_queue() takes whead->lock
-		 * held by the caller. Once we nullify it, nothing protects
-		 * ep/epi or even wait.
+		 * Let the other exclusive waiters of this queue, whose lock
+		 * our caller holds, take the next wakeup.
 		 */
-		smp_store_release(&ep_pwq_from_wait(wait)->whead, NULL);
-	}
+		list_move_tail(&wait->entry,
+			       &ep_pwq_from_wait(wait)->whead->head);
+
+	if (pollflags & POLLFREE)
+		ep_pollfree(wait);
 
 	return ewake;
 }
@@ -1446,6 +1757,21 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 		RCU_INIT_POINTER(epi->ws, NULL);
 	}
 
+	if (ep_userpoll(ep)) {
+		struct epoll_uitem *uitem;
+
+		error = ep_get_user_item(ep);
+		if (error < 0)
+			goto error_create_wakeup_source;
+		epi->bit = error;
+
+		/* The callback can start filling ready_events right away */
+		uitem = &ep->user_header->items[epi->bit];
+		uitem->events = event->events;
+		uitem->data = event->data;
+		WRITE_ONCE(uitem->ready_events, 0);
+	}
+
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
 	init_poll_funcptr(&epq.pt, ep_ptable_queue_proc);
@@ -1484,6 +1810,13 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 	if (full_check && reverse_path_check())
 		goto error_remove_epi;
 
+	if (ep_userpoll(ep)) {
+		atomic_long_inc(&ep->user->epoll_watches);
+		if (revents && ep_add_event_to_uring(ep, epi->bit, revents))
+			ep_user_wakeup(ep);
+		return 0;
+	}
+
 	/* We have to drop the new item inside our item list to keep track of it */
 	spin_lock_irqsave(&ep->lock, flags);
 
@@ -1497,7 +1830,7 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 
 		/* Notify waiting tasks that events are available */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			ep_wake_up_locked(ep);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -1521,6 +1854,8 @@ static int ep_insert(struct eventpoll *ep, const struct epoll_event *event,
 
 error_unregister:
 	ep_unregister_pollwait(ep, epi);
+	if (ep_userpoll(ep))
+		ep_put_user_item(ep, epi);
 
 	/*
 	 * We need to do this because an event could have been arrived on some
@@ -1566,6 +1901,12 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	} else if (ep_has_wakeup_source(epi)) {
 		ep_destroy_wakeup_source(epi);
 	}
+	if (ep_userpoll(ep)) {
+		struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+
+		WRITE_ONCE(uitem->events, event->events);
+		WRITE_ONCE(uitem->data, event->data);
+	}
 
 	/*
 	 * The following barrier has two effects:
@@ -1593,6 +1934,13 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	 * If the item is "hot" and it is not registered inside the ready
 	 * list, push it inside.
 	 */
+	if (ep_userpoll(ep)) {
+		__poll_t revents = ep_item_poll(epi, &pt, 1);
+
+		if (revents && ep_add_event_to_uring(ep, epi->bit, revents))
+			ep_user_wakeup(ep);
+		return 0;
+	}
 	if (ep_item_poll(epi, &pt, 1)) {
 		spin_lock_irq(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
@@ -1601,7 +1949,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 
 			/* Notify waiting tasks that events are available */
 			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+				ep_wake_up_locked(ep);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
@@ -1851,6 +2199,52 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
  * Returns: Returns zero if adding the epoll @file inside current epoll
  *          structure @ep does not violate the constraints, or -1 otherwise.
  */
+/*
+ * Wait for the user ring of an EPOLL_USERPOLL descriptor to become non
+ * empty.  Returns 1 if it is, 0 on timeout, or -EINTR.
+ */
+static int ep_poll_user(struct eventpoll *ep, long timeout)
+{
+	int res = 0, timed_out = 0;
+	u64 slack = 0;
+	wait_queue_entry_t wait;
+	ktime_t expires, *to = NULL;
+
+	if (ep_user_events_available(ep))
+		return 1;
+	if (timeout == 0)
+		return 0;
+	if (timeout > 0) {
+		struct timespec64 end_time = ep_set_mstimeout(timeout);
+
+		slack = select_estimate_accuracy(&end_time);
+		to = &expires;
+		*to = timespec64_to_ktime(end_time);
+	}
+
+	init_waitqueue_entry(&wait, current);
+	add_wait_queue_exclusive(&ep->wq, &wait);
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (ep_user_events_available(ep)) {
+			res = 1;
+			break;
+		}
+		if (timed_out)
+			break;
+		if (signal_pending(current)) {
+			res = -EINTR;
+			break;
+		}
+		if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
+			timed_out = 1;
+	}
+	__set_current_state(TASK_RUNNING);
+	remove_wait_queue(&ep->wq, &wait);
+
+	return res;
+}
+
 static int ep_loop_check_proc(void *priv, void *cookie, int call_nests)
 {
 	int error = 0;
@@ -1936,7 +2330,7 @@ static void clear_tfile_check_list(void)
 /*
  * Open an eventpoll file descriptor.
  */
-static int do_epoll_create(int flags)
+static int do_epoll_create(int flags, unsigned int size)
 {
 	int error, fd;
 	struct eventpoll *ep = NULL;
@@ -1945,14 +2339,27 @@ static int do_epoll_create(int flags)
 	/* Check the EPOLL_* constant for consistency.  */
 	BUILD_BUG_ON(EPOLL_CLOEXEC != O_CLOEXEC);
 
-	if (flags & ~EPOLL_CLOEXEC)
+	if (flags & ~EP_CREATE_FLAGS)
+		return -EINVAL;
+	/* The size of the user ring, only for EPOLL_USERPOLL */
+	if (flags & EPOLL_USERPOLL) {
+		if (!size || size > max_user_watches)
+			return -EINVAL;
+	} else if (size) {
 		return -EINVAL;
+	}
 	/*
 	 * Create the internal data structure ("struct eventpoll").
 	 */
 	error = ep_alloc(&ep);
 	if (error < 0)
 		return error;
+	ep->wake_flags = flags & (EPOLL_WAKE_LOCAL | EPOLL_WAKE_ROTATE);
+	if (flags & EPOLL_USERPOLL) {
+		error = ep_alloc_user(ep, size);
+		if (error)
+			goto out_free_ep;
+	}
 	/*
 	 * Creates all the items needed to setup an eventpoll file. That is,
 	 * a file structure and a free file descriptor.
@@ -1981,7 +2388,12 @@ static int do_epoll_create(int flags)
 
 SYSCALL_DEFINE1(epoll_create1, int, flags)
 {
-	return do_epoll_create(flags);
+	return do_epoll_create(flags, 0);
+}
+
+SYSCALL_DEFINE2(epoll_create2, int, flags, unsigned int, size)
+{
+	return do_epoll_create(flags, size);
 }
 
 SYSCALL_DEFINE1(epoll_create, int, size)
@@ -1989,7 +2401,7 @@ SYSCALL_DEFINE1(epoll_create, int, size)
 	if (size <= 0)
 		return -EINVAL;
 
-	return do_epoll_create(0);
+	return do_epoll_create(0, 0);
 }
 
 /*
@@ -2060,6 +2472,16 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	 */
 	ep = f.file->private_data;
 
+	/*
+	 * Events of an EPOLL_USERPOLL descriptor go to the user ring without
+	 * ep->lock, which only works for edge triggered items and none of the
+	 * modes that need the ready list.
+	 */
+	if (ep_userpoll(ep) && ep_op_has_event(op) &&
+	    (!(epds.events & EPOLLET) ||
+	     (epds.events & (EPOLLONESHOT | EPOLLEXCLUSIVE | EPOLLWAKEUP))))
+		goto error_tgt_fput;
+
 	/*
 	 * When we insert an epoll file descriptor, inside another epoll file
 	 * descriptor, there is the change of creating closed loops, which are
@@ -2160,12 +2582,17 @@ static int do_epoll_wait(int epfd, struct epoll_event __user *events,
 	struct fd f;
 	struct eventpoll *ep;
 
-	/* The maximum number of event must be greater than zero */
-	if (maxevents <= 0 || maxevents > EP_MAX_EVENTS)
+	/*
+	 * The maximum number of event must be greater than zero, except for
+	 * EPOLL_USERPOLL descriptors which take neither events nor maxevents.
+	 */
+	if (maxevents < 0 || maxevents > EP_MAX_EVENTS ||
+	    (!maxevents && events))
 		return -EINVAL;
 
 	/* Verify that the area passed by the user is writeable */
-	if (!access_ok(VERIFY_WRITE, events, maxevents * sizeof(struct epoll_event)))
+	if (maxevents &&
+	    !access_ok(VERIFY_WRITE, events, maxevents * sizeof(struct epoll_event)))
 		return -EFAULT;
 
 	/* Get the "struct file *" for the eventpoll file */
@@ -2187,8 +2614,16 @@ static int do_epoll_wait(int epfd, struct epoll_event __user *events,
 	 */
 	ep = f.file->private_data;
 
+	if (ep_userpoll(ep) != !maxevents) {
+		error = -EINVAL;
+		goto error_fput;
+	}
+
 	/* Time to fish for events ... */
-	error = ep_poll(ep, events, maxevents, timeout);
+	if (ep_userpoll(ep))
+		error = ep_poll_user(ep, timeout);
+	else
+		error = ep_poll(ep, events, maxevents, timeout);
 
 error_fput:
 	fdput(f);
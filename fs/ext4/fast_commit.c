@@ -0,0 +1,324 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ *  ext4 fast commits: fsync without committing the whole transaction.
+ *
+ * A small fsync normally commits the running transaction, writing every
+ * metadata block it touched to the journal plus a commit block.  With the
+ * fast_commit mount option, fsync of a file whose changes in the running
+ * transaction only concern the file itself (size, timestamps and extents
+ * held in the inode) instead writes a single block to the fast commit area
+ * of the journal, holding a copy of the on-disk inode.  The transaction is
+ * committed normally later on.
+ *
+ * Recovery copies the inode back into the inode table and marks the blocks
+ * its extents point to as in use.  That is only correct if nothing else the
+ * inode depends on changed in the transaction, so the whole transaction is
+ * marked ineligible when it runs a handle of a kind that isn't simple file
+ * data or inode updates (directory operations, truncate, xattrs, quota,
+ * ...), frees blocks, uses the orphan list or allocates from a block group
+ * whose bitmap isn't initialized yet.  The inode itself has to use extents
+ * with no index blocks.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+/* Default size of the fast commit area, in journal blocks */
+#define EXT4_DEF_FC_BLOCKS	256
+
+/* On-disk record, following the journal header of a fast commit block */
+struct ext4_fc_inode {
+	__le32	fc_ino;		/* inode number */
+	__le16	fc_len;		/* size of the inode copy */
+	__le16	fc_flags;	/* unused */
+	__u8	fc_raw[];	/* the on-disk inode */
+};
+
+static void ext4_fc_set_ineligible(struct super_block *sb, handle_t *handle)
+{
+	if (!ext4_handle_valid(handle) || !handle->h_transaction)
+		return;
+	WRITE_ONCE(EXT4_SB(sb)->s_fc_ineligible_tid,
+		   handle->h_transaction->t_tid);
+}
+
+/*
+ * Record that the transaction of @handle did something fast commits can't
+ * describe.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	if (test_opt(sb, FAST_COMMIT))
+		ext4_fc_set_ineligible(sb, handle);
+}
+
+/* Called when a handle of @type is started or restarted */
+void ext4_fc_start_handle(struct super_block *sb, handle_t *handle, int type)
+{
+	if (!test_opt(sb, FAST_COMMIT))
+		return;
+
+	switch (type) {
+	case EXT4_HT_INODE:
+	case EXT4_HT_WRITE_PAGE:
+	case EXT4_HT_MAP_BLOCKS:
+	case EXT4_HT_EXT_CONVERT:
+		break;
+	default:
+		ext4_fc_set_ineligible(sb, handle);
+	}
+}
+
+/* Can the copy of the on-disk inode be replayed on its own? */
+static bool ext4_fc_raw_inode_eligible(struct ext4_inode *raw)
+{
+	struct ext4_extent_header *eh = (struct ext4_extent_header *)raw->i_block;
+	__u32 flags = le32_to_cpu(raw->i_flags);
+
+	if (!(flags & EXT4_EXTENTS_FL) || (flags & EXT4_INLINE_DATA_FL))
+		return false;
+	if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth != 0)
+		return false;
+	return le16_to_cpu(eh->eh_entries) <= le16_to_cpu(eh->eh_max) &&
+	       le16_to_cpu(eh->eh_max) <= (sizeof(raw->i_block) - sizeof(*eh)) /
+					  sizeof(struct ext4_extent);
+}
+
+/**
+ * ext4_fc_commit() - persist an inode with a fast commit
+ * @inode: the inode being fsynced, whose data has been written
+ * @tid: the transaction holding the inode's changes
+ *
+ * Returns -EAGAIN if the transaction has to be committed normally instead.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int inode_len = EXT4_INODE_SIZE(sb);
+	struct ext4_fc_inode *fc;
+	struct ext4_iloc iloc;
+	struct buffer_head *bh;
+	int ret;
+
+	if (!ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ext4_has_inline_data(inode) || ext_depth(inode) != 0)
+		return -EAGAIN;
+	if (sizeof(journal_header_t) + sizeof(*fc) + inode_len +
+	    sizeof(struct jbd2_journal_block_tail) > journal->j_blocksize)
+		return -EAGAIN;
+
+	ret = jbd2_fc_begin_commit(journal, tid);
+	if (ret)
+		return -EAGAIN;
+
+	if (READ_ONCE(sbi->s_fc_ineligible_tid) == tid) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		goto out;
+
+	bh = jbd2_fc_get_buf(journal);
+	if (IS_ERR(bh)) {
+		ret = PTR_ERR(bh) == -ENOSPC ? -EAGAIN : PTR_ERR(bh);
+		brelse(iloc.bh);
+		goto out;
+	}
+
+	fc = (struct ext4_fc_inode *)(bh->b_data + sizeof(journal_header_t));
+	fc->fc_ino = cpu_to_le32(inode->i_ino);
+	fc->fc_len = cpu_to_le16(inode_len);
+	spin_lock(&ei->i_raw_lock);
+	memcpy(fc->fc_raw, ext4_raw_inode(&iloc), inode_len);
+	spin_unlock(&ei->i_raw_lock);
+	brelse(iloc.bh);
+
+	/*
+	 * Handles mark the transaction ineligible before they change
+	 * anything, so checking again now covers whatever the copy picked
+	 * up.  The block is simply left unwritten if we give up.
+	 */
+	if (READ_ONCE(sbi->s_fc_ineligible_tid) == tid ||
+	    !ext4_fc_raw_inode_eligible((struct ext4_inode *)fc->fc_raw)) {
+		brelse(bh);
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	ret = jbd2_fc_write_buf(journal, bh);
+out:
+	jbd2_fc_end_commit(journal);
+	return ret;
+}
+
+/* Mark @len blocks from @pblk as in use in the on-disk bitmaps */
+static int ext4_fc_mark_used(struct super_block *sb, ext4_fsblk_t pblk,
+			     unsigned int len)
+{
+	struct buffer_head *bitmap_bh, *gd_bh;
+	struct ext4_group_desc *gdp;
+	ext4_group_t group;
+	ext4_grpblk_t off, i;
+	unsigned int n, set;
+
+	if (!ext4_data_block_valid(EXT4_SB(sb), pblk, len))
+		return -EFSCORRUPTED;
+
+	while (len) {
+		ext4_get_group_no_and_offset(sb, pblk, &group, &off);
+		n = min_t(unsigned int, len, EXT4_BLOCKS_PER_GROUP(sb) - off);
+
+		gdp = ext4_get_group_desc(sb, group, &gd_bh);
+		if (!gdp)
+			return -EFSCORRUPTED;
+		/* allocating there made the transaction ineligible */
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))
+			return -EFSCORRUPTED;
+
+		bitmap_bh = sb_bread(sb, ext4_block_bitmap(sb, gdp));
+		if (!bitmap_bh)
+			return -EIO;
+
+		ext4_lock_group(sb, group);
+		for (i = off, set = 0; i < off + n; i++)
+			if (!ext4_test_and_set_bit(i, bitmap_bh->b_data))
+				set++;
+		if (set) {
+			ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_group_clusters(sb, gdp) - set);
+			ext4_block_bitmap_csum_set(sb, group, gdp, bitmap_bh);
+			ext4_group_desc_csum_set(sb, group, gdp);
+		}
+		ext4_unlock_group(sb, group);
+
+		if (set) {
+			mark_buffer_dirty(bitmap_bh);
+			mark_buffer_dirty(gd_bh);
+		}
+		brelse(bitmap_bh);
+
+		pblk += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Write back the copy of an inode into the inode table */
+static int ext4_fc_replay_inode(struct super_block *sb, unsigned long ino,
+				struct ext4_inode *raw, int len)
+{
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_group_t group;
+	unsigned long offset;
+
+	group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EFSCORRUPTED;
+
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * len;
+	bh = sb_bread(sb, ext4_inode_table(sb, gdp) +
+		      (offset >> sb->s_blocksize_bits));
+	if (!bh)
+		return -EIO;
+
+	lock_buffer(bh);
+	memcpy(bh->b_data + (offset & (sb->s_blocksize - 1)), raw, len);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	return 0;
+}
+
+/*
+ * jbd2 recovery callback, run for each fast commit block of the
+ * transaction that didn't make it to the log.
+ */
+int ext4_fc_replay(journal_t *journal, struct buffer_head *bh)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_inode *fc;
+	struct ext4_inode *raw;
+	struct ext4_extent *ex;
+	unsigned long ino;
+	int len, i, err;
+
+	fc = (struct ext4_fc_inode *)(bh->b_data + sizeof(journal_header_t));
+	ino = le32_to_cpu(fc->fc_ino);
+	len = le16_to_cpu(fc->fc_len);
+	raw = (struct ext4_inode *)fc->fc_raw;
+
+	if (!ext4_valid_inum(sb, ino) || len != EXT4_INODE_SIZE(sb) ||
+	    sizeof(journal_header_t) + sizeof(*fc) + len +
+	    sizeof(struct jbd2_journal_block_tail) > bh->b_size ||
+	    !ext4_fc_raw_inode_eligible(raw)) {
+		ext4_msg(sb, KERN_ERR, "invalid fast commit record for "
+			 "inode %lu", ino);
+		return -EFSCORRUPTED;
+	}
+
+	ex = EXT_FIRST_EXTENT((struct ext4_extent_header *)raw->i_block);
+	for (i = 0; i < le16_to_cpu(((struct ext4_extent_header *)
+				     raw->i_block)->eh_entries); i++, ex++) {
+		err = ext4_fc_mark_used(sb, ext4_ext_pblock(ex),
+					ext4_ext_get_actual_len(ex));
+		if (err)
+			return err;
+	}
+
+	err = ext4_fc_replay_inode(sb, ino, raw, len);
+	if (!err)
+		jbd_debug(1, "EXT4: replayed fast commit of inode %lu\n", ino);
+	return err;
+}
+
+/*
+ * Set up the fast commit area, once the journal has been loaded and before
+ * any handle is started.
+ */
+int ext4_fc_init(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	int err;
+
+	if (test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA) {
+		ext4_msg(sb, KERN_ERR, "can't mount with fast_commit in "
+			 "data=journal mode");
+		return -EINVAL;
+	}
+	if (ext4_has_feature_bigalloc(sb) || ext4_has_feature_quota(sb) ||
+	    test_opt(sb, QUOTA)) {
+		ext4_msg(sb, KERN_ERR, "can't mount with fast_commit on "
+			 "bigalloc or quota file systems");
+		return -EINVAL;
+	}
+	if (!jbd2_journal_has_csum_v2or3(journal)) {
+		ext4_msg(sb, KERN_ERR, "fast_commit needs journal "
+			 "checksums v2 or v3");
+		return -EINVAL;
+	}
+
+	sbi->s_fc_ineligible_tid = journal->j_transaction_sequence - 1;
+
+	/* Carving out the area writes the journal superblock */
+	if (sb_rdonly(sb))
+		return 0;
+	err = jbd2_fc_init(journal, EXT4_DEF_FC_BLOCKS);
+	if (err)
+		ext4_msg(sb, KERN_ERR, "can't set up the fast commit area: %d",
+			 err);
+	return err;
+}
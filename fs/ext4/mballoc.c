@@ -155,6 +155,13 @@ MODULE_PARM_DESC(mballoc_debug, "Debugging level for ext4's mballoc");
  * can be used for allocation. ext4_mb_good_group explains how the groups are
  * checked.
  *
+ * As walking all the groups gets expensive on large, fragmented file
+ * systems, the groups whose buddy has been loaded are also kept on one list
+ * per order of their largest free extent.  With mb_optimize_scan set, the
+ * cr 0 and cr 1 passes first look for a group on the lists for orders that
+ * can satisfy the request, and only scan the groups linearly, starting from
+ * the goal, if that doesn't find anything.
+ *
  * Both the prealloc space are getting populated as above. So for the first
  * request we will hit the buddy cache which will result in this prealloc
  * space getting filled. The prealloc space is then later used for the
@@ -692,6 +699,8 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
 	int i;
 	int bits;
 
@@ -704,6 +713,24 @@ mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 			break;
 		}
 	}
+
+	/* Move the group to the list of its new order, called w/ group lock */
+	if (old == grp->bb_largest_free_order &&
+	    !list_empty(&grp->bb_largest_free_order_node))
+		return;
+
+	if (!list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	i = grp->bb_largest_free_order;
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
 }
 
 static noinline_for_stack
@@ -2094,6 +2121,77 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Find a group on the largest free order lists that passes
+ * ext4_mb_good_group() for criteria @cr and scan it.  Only cr 0 and 1 use
+ * the lists: for those the order of the largest free extent bounds what a
+ * group can offer.  Groups whose buddy hasn't been loaded yet aren't on the
+ * lists, so finding nothing here doesn't mean that there is nothing; the
+ * caller then scans the groups as usual.
+ */
+static int ext4_mb_find_by_order(struct ext4_allocation_context *ac, int cr,
+				 struct ext4_buddy *e4b)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	ext4_group_t group = 0;
+	bool found = false;
+	int order, err;
+
+	/* a cr 1 request needs a free extent of at least fe_len blocks */
+	order = cr == 0 ? ac->ac_2order : fls(ac->ac_g_ex.fe_len);
+	for (; order <= sb->s_blocksize_bits + 1 && !found; order++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[order]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[order],
+				    bb_largest_free_order_node) {
+			/* indexed groups are initialized, this doesn't sleep */
+			if (EXT4_MB_GRP_NEED_INIT(grp) ||
+			    ext4_mb_good_group(ac, grp->bb_group, cr) <= 0)
+				continue;
+			if (!ext4_test_inode_flag(ac->ac_inode,
+						  EXT4_INODE_EXTENTS) &&
+			    grp->bb_group >= sbi->s_blockfile_groups)
+				continue;
+			group = grp->bb_group;
+			found = true;
+			break;
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
+
+	if (!found) {
+		if (sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_index_misses);
+		return 0;
+	}
+
+	err = ext4_mb_load_buddy(sb, group, e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+	/* the group may have changed since we looked */
+	if (ext4_mb_good_group(ac, group, cr) > 0) {
+		ac->ac_groups_scanned++;
+		if (cr == 0)
+			ext4_mb_simple_scan_group(ac, e4b);
+		else if (sbi->s_stripe &&
+			 !(ac->ac_g_ex.fe_len % sbi->s_stripe))
+			ext4_mb_scan_aligned(ac, e4b);
+		else
+			ext4_mb_complex_scan_group(ac, e4b);
+	}
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(e4b);
+
+	if (sbi->s_mb_stats)
+		atomic_inc(&sbi->s_bal_index_hits);
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2161,6 +2259,15 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
+		if (cr <= 1 && sbi->s_mb_optimize_scan) {
+			err = ext4_mb_find_by_order(ac, cr, &e4b);
+			if (err)
+				goto out;
+			if (ac->ac_status != AC_STATUS_CONTINUE)
+				break;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -2432,9 +2539,11 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2583,6 +2692,25 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	i = (sb->s_blocksize_bits + 2) *
+		sizeof(*sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = kmalloc(i, GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	i = (sb->s_blocksize_bits + 2) *
+		sizeof(*sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = kmalloc(i, GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders_locks == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < sb->s_blocksize_bits + 2; i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2612,6 +2740,7 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_max_to_scan = MB_DEFAULT_MAX_TO_SCAN;
 	sbi->s_mb_min_to_scan = MB_DEFAULT_MIN_TO_SCAN;
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	/*
@@ -2666,6 +2795,10 @@ int ext4_mb_init(struct super_block *sb)
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2718,6 +2851,8 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -2735,6 +2870,10 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_2orders),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
+		ext4_msg(sb, KERN_INFO,
+		       "mballoc: %u groups found by order, %u order misses",
+				atomic_read(&sbi->s_bal_index_hits),
+				atomic_read(&sbi->s_bal_index_misses));
 		ext4_msg(sb, KERN_INFO,
 		       "mballoc: %lu generated and it took %Lu",
 				sbi->s_mb_buddies_generated,
@@ -2990,6 +3129,8 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 	ext4_set_bits(bitmap_bh->b_data, ac->ac_b_ex.fe_start,
 		      ac->ac_b_ex.fe_len);
 	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+		/* a fast commit replay can't initialize the bitmap */
+		ext4_fc_mark_ineligible(sb, handle);
 		gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
 		ext4_free_group_clusters_set(sb, gdp,
 					     ext4_free_clusters_after_init(sb,
@@ -4731,6 +4872,7 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 
 	ext4_debug("freeing block %llu\n", block);
 	trace_ext4_free_blocks(inode, block, count, flags);
+	ext4_fc_mark_ineligible(sb, handle);
 
 	if (bh && (flags & EXT4_FREE_BLOCKS_FORGET)) {
 		BUG_ON(count > 1);
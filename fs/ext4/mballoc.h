@@ -58,6 +58,12 @@ do {									\
  */
 #define MB_DEFAULT_STATS		0
 
+/*
+ * Look up candidate groups in the index by largest free order before
+ * falling back to scanning the groups in turn
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
 /*
  * files smaller than MB_DEFAULT_STREAM_THRESHOLD are served
  * by the stream allocator, which purpose is to pack requests
@@ -1378,6 +1378,7 @@ enum {
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
 	Opt_max_dir_size_kb, Opt_nojournal_checksum, Opt_nombcache,
+	Opt_group_commit, Opt_nogroup_commit, Opt_fast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1434,6 +1435,9 @@ static const match_table_t tokens = {
 	{Opt_barrier, "barrier=%u"},
 	{Opt_barrier, "barrier"},
 	{Opt_nobarrier, "nobarrier"},
+	{Opt_group_commit, "group_commit"},
+	{Opt_nogroup_commit, "nogroup_commit"},
+	{Opt_fast_commit, "fast_commit"},
 	{Opt_i_version, "i_version"},
 	{Opt_dax, "dax"},
 	{Opt_stripe, "stripe=%u"},
@@ -1619,6 +1623,10 @@ static const struct mount_opts {
 	 MOPT_NO_EXT2},
 	{Opt_barrier, EXT4_MOUNT_BARRIER, MOPT_SET},
 	{Opt_nobarrier, EXT4_MOUNT_BARRIER, MOPT_CLEAR},
+	{Opt_group_commit, EXT4_MOUNT_GROUP_COMMIT, MOPT_NO_EXT2 | MOPT_SET},
+	{Opt_nogroup_commit, EXT4_MOUNT_GROUP_COMMIT,
+	 MOPT_NO_EXT2 | MOPT_CLEAR},
+	{Opt_fast_commit, EXT4_MOUNT_FAST_COMMIT, MOPT_NO_EXT2 | MOPT_SET},
 	{Opt_noauto_da_alloc, EXT4_MOUNT_NO_AUTO_DA_ALLOC, MOPT_SET},
 	{Opt_auto_da_alloc, EXT4_MOUNT_NO_AUTO_DA_ALLOC, MOPT_CLEAR},
 	{Opt_noinit_itable, EXT4_MOUNT_INIT_INODE_TABLE, MOPT_CLEAR},
@@ -4162,6 +4170,9 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount_wq;
 	}
 
+	if (test_opt(sb, FAST_COMMIT) && ext4_fc_init(sb))
+		goto failed_mount_wq;
+
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
@@ -4481,6 +4492,10 @@ static void ext4_init_journal_params(struct super_block *sb, journal_t *journal)
 		journal->j_flags |= JBD2_ABORT_ON_SYNCDATA_ERR;
 	else
 		journal->j_flags &= ~JBD2_ABORT_ON_SYNCDATA_ERR;
+	if (test_opt(sb, GROUP_COMMIT))
+		journal->j_flags |= JBD2_GROUP_COMMIT;
+	else
+		journal->j_flags &= ~JBD2_GROUP_COMMIT;
 	write_unlock(&journal->j_state_lock);
 }
 
@@ -4693,6 +4708,7 @@ static int ext4_load_journal(struct super_block *sb,
 	if (!(journal->j_flags & JBD2_BARRIER))
 		ext4_msg(sb, KERN_INFO, "barriers disabled");
 
+	journal->j_fc_replay_callback = ext4_fc_replay;
 	if (!ext4_has_feature_journal_needs_recovery(sb))
 		err = jbd2_journal_wipe(journal, !really_read_only);
 	if (!err) {
@@ -5086,6 +5102,12 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		goto restore_opts;
 	}
 
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT4_MOUNT_FAST_COMMIT) {
+		ext4_msg(sb, KERN_ERR, "can't enable fast_commit during remount");
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
 	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT4_MOUNT_DAX) {
 		ext4_msg(sb, KERN_WARNING, "warning: refusing change of "
 			"dax flag with busy inodes while remounting");
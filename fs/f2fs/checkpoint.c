@@ -1386,6 +1386,8 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	int err = 0;
 
 	mutex_lock(&sbi->cp_mutex);
+	/* let the GC workers finish their victims, they don't hold gc_mutex */
+	down_write(&sbi->gc_workers_lock);
 
 	if (!is_sbi_flag_set(sbi, SBI_IS_DIRTY) &&
 		((cpc->reason & CP_FASTBOOT) || (cpc->reason & CP_SYNC) ||
@@ -1457,6 +1459,7 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	f2fs_update_time(sbi, CP_TIME);
 	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "finish checkpoint");
 out:
+	up_write(&sbi->gc_workers_lock);
 	mutex_unlock(&sbi->cp_mutex);
 	return err;
 }
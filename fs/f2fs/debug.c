@@ -104,6 +104,20 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->avail_nids = NM_I(sbi)->available_nids;
 	si->alloc_nids = NM_I(sbi)->nid_cnt[PREALLOC_NID];
 	si->bg_gc = sbi->bg_gc;
+	si->nr_gc_workers = 0;
+	if (sbi->gc_thread) {
+		struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+
+		si->nr_gc_workers = gc_th->nr_workers;
+		for (i = 0; i < si->nr_gc_workers; i++) {
+			struct f2fs_gc_worker *w = &gc_th->workers[i];
+
+			si->gc_worker_secs[i] = w->nr_secs;
+			si->gc_worker_blks[i] = w->nr_blks;
+			si->gc_worker_bps[i] = w->busy_jiffies ?
+				div64_u64(w->nr_blks * HZ, w->busy_jiffies) : 0;
+		}
+	}
 	si->util_free = (int)(free_user_blocks(sbi) >> sbi->log_blocks_per_seg)
 		* 100 / (int)(sbi->user_block_count >> sbi->log_blocks_per_seg)
 		/ 2;
@@ -342,6 +356,13 @@ static int stat_show(struct seq_file *s, void *v)
 				si->bg_data_blks);
 		seq_printf(s, "  - node blocks : %d (%d)\n", si->node_blks,
 				si->bg_node_blks);
+		seq_printf(s, "BG GC threads: %d\n", si->nr_gc_workers);
+		for (j = 0; j < si->nr_gc_workers; j++)
+			seq_printf(s, "  - thread %d: %llu secs, %llu blks "
+					"(%llu blks/s)\n", j,
+					si->gc_worker_secs[j],
+					si->gc_worker_blks[j],
+					si->gc_worker_bps[j]);
 		seq_puts(s, "\nExtent Cache:\n");
 		seq_printf(s, "  - Hit Count: L1-1:%llu L1-2:%llu L2:%llu\n",
 				si->hit_largest, si->hit_cached,
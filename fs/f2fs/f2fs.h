@@ -1194,6 +1194,8 @@ struct f2fs_sb_info {
 	struct mutex gc_mutex;			/* mutex for GC */
 	struct f2fs_gc_kthread	*gc_thread;	/* GC thread */
 	unsigned int cur_victim_sec;		/* current victim section num */
+	struct rw_semaphore gc_workers_lock;	/* GC workers vs. checkpoint */
+	unsigned int gc_workers;		/* # of background GC threads */
 
 	/* threshold for converting bg victims for fg */
 	u64 fggc_threshold;
@@ -2906,6 +2908,8 @@ bool f2fs_overwrite_io(struct inode *inode, loff_t pos, size_t len);
 /*
  * gc.c
  */
+#define MAX_GC_WORKERS		8	/* max. # of background GC threads */
+
 int start_gc_thread(struct f2fs_sb_info *sbi);
 void stop_gc_thread(struct f2fs_sb_info *sbi);
 block_t start_bidx_of_node(unsigned int node_ofs, struct inode *inode);
@@ -2955,6 +2959,10 @@ struct f2fs_stat_info {
 	int bg_node_segs, bg_data_segs;
 	int tot_blks, data_blks, node_blks;
 	int bg_data_blks, bg_node_blks;
+	int nr_gc_workers;
+	unsigned long long gc_worker_secs[MAX_GC_WORKERS];
+	unsigned long long gc_worker_blks[MAX_GC_WORKERS];
+	unsigned long long gc_worker_bps[MAX_GC_WORKERS];
 	int curseg[NR_CURSEG_TYPE];
 	int cursec[NR_CURSEG_TYPE];
 	int curzone[NR_CURSEG_TYPE];
@@ -16,6 +16,7 @@
 #include <linux/kthread.h>
 #include <linux/delay.h>
 #include <linux/freezer.h>
+#include <linux/sort.h>
 
 #include "f2fs.h"
 #include "node.h"
@@ -23,6 +24,18 @@
 #include "gc.h"
 #include <trace/events/f2fs.h>
 
+static void wake_up_gc_workers(struct f2fs_gc_kthread *gc_th)
+{
+	int i;
+
+	if (gc_th->nr_workers <= 1)
+		return;
+
+	for (i = 1; i < gc_th->nr_workers; i++)
+		gc_th->workers[i].wake = true;
+	wake_up_interruptible_all(&gc_th->workers_wait);
+}
+
 static int gc_thread_func(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
@@ -98,6 +111,9 @@ static int gc_thread_func(void *data)
 do_gc:
 		stat_inc_bggc_count(sbi);
 
+		if (!test_opt(sbi, FORCE_FG_GC))
+			wake_up_gc_workers(gc_th);
+
 		/* if return value is not zero, no victim was selected */
 		if (f2fs_gc(sbi, test_opt(sbi, FORCE_FG_GC), true, NULL_SEGNO))
 			wait_ms = gc_th->no_gc_sleep_time;
@@ -114,10 +130,20 @@ static int gc_thread_func(void *data)
 	return 0;
 }
 
+static int gc_worker_func(void *data);
+
+static void stop_gc_workers(struct f2fs_gc_kthread *gc_th)
+{
+	while (gc_th->nr_workers > 1)
+		kthread_stop(gc_th->workers[--gc_th->nr_workers].task);
+}
+
 int start_gc_thread(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_gc_kthread *gc_th;
+	struct f2fs_gc_worker *w;
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
+	unsigned int nr_workers, i;
 	int err = 0;
 
 	gc_th = f2fs_kmalloc(sbi, sizeof(struct f2fs_gc_kthread), GFP_KERNEL);
@@ -135,6 +161,10 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->gc_urgent = 0;
 	gc_th->gc_wake= 0;
 
+	memset(gc_th->workers, 0, sizeof(gc_th->workers));
+	gc_th->nr_workers = 1;
+	init_waitqueue_head(&gc_th->workers_wait);
+
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
 	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
@@ -143,6 +173,25 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 		err = PTR_ERR(gc_th->f2fs_gc_task);
 		kfree(gc_th);
 		sbi->gc_thread = NULL;
+		goto out;
+	}
+	gc_th->workers[0].task = gc_th->f2fs_gc_task;
+
+	nr_workers = min_t(unsigned int, sbi->gc_workers, MAX_GC_WORKERS);
+	for (i = 1; i < nr_workers; i++) {
+		w = &gc_th->workers[i];
+		w->sbi = sbi;
+		w->task = kthread_run(gc_worker_func, w, "f2fs_gc-%u:%u/%u",
+					MAJOR(dev), MINOR(dev), i);
+		if (IS_ERR(w->task)) {
+			err = PTR_ERR(w->task);
+			stop_gc_workers(gc_th);
+			kthread_stop(gc_th->f2fs_gc_task);
+			kfree(gc_th);
+			sbi->gc_thread = NULL;
+			goto out;
+		}
+		gc_th->nr_workers++;
 	}
 out:
 	return err;
@@ -153,6 +202,7 @@ void stop_gc_thread(struct f2fs_sb_info *sbi)
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	if (!gc_th)
 		return;
+	stop_gc_workers(gc_th);
 	kthread_stop(gc_th->f2fs_gc_task);
 	kfree(gc_th);
 	sbi->gc_thread = NULL;
@@ -301,6 +351,80 @@ static unsigned int count_bits(const unsigned long *addr,
 	return sum;
 }
 
+/*
+ * Keep the GC_VICTIM_BATCH cheapest candidates seen by a scan, in a max-heap
+ * on the cost so that the most expensive one is the one to drop.
+ */
+static void add_victim_entry(struct dirty_seglist_info *dirty_i,
+				unsigned int segno, unsigned int cost)
+{
+	struct victim_entry *heap = dirty_i->victims;
+	unsigned int n = dirty_i->nr_victims;
+	unsigned int i, child;
+
+	if (n < GC_VICTIM_BATCH) {
+		for (i = dirty_i->nr_victims++; i; i = (i - 1) / 2) {
+			if (heap[(i - 1) / 2].cost >= cost)
+				break;
+			heap[i] = heap[(i - 1) / 2];
+		}
+		heap[i].segno = segno;
+		heap[i].cost = cost;
+		return;
+	}
+
+	if (cost >= heap[0].cost)
+		return;
+
+	for (i = 0; (child = 2 * i + 1) < n; i = child) {
+		if (child + 1 < n && heap[child + 1].cost > heap[child].cost)
+			child++;
+		if (heap[child].cost <= cost)
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i].segno = segno;
+	heap[i].cost = cost;
+}
+
+static int victim_entry_cmp(const void *a, const void *b)
+{
+	const struct victim_entry *va = a, *vb = b;
+
+	if (va->cost == vb->cost)
+		return 0;
+	return va->cost < vb->cost ? -1 : 1;
+}
+
+/*
+ * Hand out the next victim of the batch built by the last scan, skipping
+ * the ones that aren't candidates anymore.
+ */
+static unsigned int get_batched_victim(struct f2fs_sb_info *sbi,
+				struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int segno, secno;
+
+	if (dirty_i->victims_mode != p->gc_mode)
+		return NULL_SEGNO;
+
+	while (dirty_i->next_victim < dirty_i->nr_victims) {
+		segno = dirty_i->victims[dirty_i->next_victim++].segno;
+		secno = GET_SEC_FROM_SEG(sbi, segno);
+
+		if (!test_bit(segno, p->dirty_segmap))
+			continue;
+		if (sec_usage_check(sbi, secno))
+			continue;
+		if (test_bit(secno, dirty_i->victim_secmap))
+			continue;
+		p->min_cost = dirty_i->victims[dirty_i->next_victim - 1].cost;
+		return segno;
+	}
+	return NULL_SEGNO;
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -318,6 +442,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 	unsigned int secno, last_victim;
 	unsigned int last_segment = MAIN_SEGS(sbi);
 	unsigned int nsearched = 0;
+	bool batch = (alloc_mode == LFS && gc_type == BG_GC);
 
 	mutex_lock(&dirty_i->seglist_lock);
 
@@ -345,6 +470,16 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (batch) {
+		p.min_segno = get_batched_victim(sbi, &p);
+		if (p.min_segno != NULL_SEGNO)
+			goto got_it;
+
+		dirty_i->nr_victims = 0;
+		dirty_i->next_victim = 0;
+		dirty_i->victims_mode = p.gc_mode;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -383,7 +518,10 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 
 		cost = get_gc_cost(sbi, segno, &p);
 
-		if (p.min_cost > cost) {
+		if (batch) {
+			if (p.min_cost > cost)
+				add_victim_entry(dirty_i, segno, cost);
+		} else if (p.min_cost > cost) {
 			p.min_segno = segno;
 			p.min_cost = cost;
 		}
@@ -397,14 +535,22 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			break;
 		}
 	}
+	if (batch) {
+		sort(dirty_i->victims, dirty_i->nr_victims,
+			sizeof(struct victim_entry), victim_entry_cmp, NULL);
+		p.min_segno = get_batched_victim(sbi, &p);
+	}
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
 			secno = GET_SEC_FROM_SEG(sbi, p.min_segno);
-			if (gc_type == FG_GC)
+			if (gc_type == FG_GC) {
 				sbi->cur_victim_sec = secno;
-			else
+			} else {
 				set_bit(secno, dirty_i->victim_secmap);
+				/* cleared once the victim has been moved */
+				set_bit(secno, dirty_i->busy_secmap);
+			}
 		}
 		*result = (p.min_segno / p.ofs_unit) * p.ofs_unit;
 
@@ -919,6 +1065,14 @@ static void gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 		goto next_step;
 }
 
+static void gc_worker_account(struct f2fs_gc_worker *w, unsigned int vblocks,
+				unsigned long start)
+{
+	w->nr_secs++;
+	w->nr_blks += vblocks;
+	w->busy_jiffies += jiffies - start;
+}
+
 static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
 			int gc_type)
 {
@@ -1014,6 +1168,8 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 	int ret = 0;
 	struct cp_control cpc;
 	unsigned int init_segno = segno;
+	unsigned int vblocks;
+	unsigned long start;
 	struct gc_inode_list gc_list = {
 		.ilist = LIST_HEAD_INIT(gc_list.ilist),
 		.iroot = RADIX_TREE_INIT(gc_list.iroot, GFP_NOFS),
@@ -1064,6 +1220,9 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 		goto stop;
 	}
 
+	vblocks = get_valid_blocks(sbi, segno, true);
+	start = jiffies;
+
 	seg_freed = do_garbage_collect(sbi, segno, &gc_list, gc_type);
 	if (gc_type == FG_GC && seg_freed == sbi->segs_per_sec)
 		sec_freed++;
@@ -1071,6 +1230,12 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 
 	if (gc_type == FG_GC)
 		sbi->cur_victim_sec = NULL_SEGNO;
+	else
+		clear_bit(GET_SEC_FROM_SEG(sbi, segno),
+					DIRTY_I(sbi)->busy_secmap);
+
+	if (background && sbi->gc_thread)
+		gc_worker_account(&sbi->gc_thread->workers[0], vblocks, start);
 
 	if (!sync) {
 		if (has_not_enough_free_secs(sbi, sec_freed, 0)) {
@@ -1103,6 +1268,72 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 	return ret;
 }
 
+/*
+ * Move one background victim on behalf of the GC thread.  Unlike f2fs_gc(),
+ * this doesn't take gc_mutex: the victim is claimed in busy_secmap so that
+ * no other collector or SSR picks it meanwhile, and gc_workers_lock keeps
+ * checkpoints out.  Foreground GC and checkpoints for the lack of free
+ * sections are left to the GC thread.
+ */
+static void gc_worker_collect(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_worker *w)
+{
+	unsigned int segno = NULL_SEGNO;
+	unsigned int vblocks;
+	unsigned long start;
+	struct gc_inode_list gc_list = {
+		.ilist = LIST_HEAD_INIT(gc_list.ilist),
+		.iroot = RADIX_TREE_INIT(gc_list.iroot, GFP_NOFS),
+	};
+
+	down_read(&sbi->gc_workers_lock);
+
+	if (unlikely(!(sbi->sb->s_flags & SB_ACTIVE)) ||
+			unlikely(f2fs_cp_error(sbi)) ||
+			has_not_enough_free_secs(sbi, 0, 0))
+		goto out;
+
+	if (!__get_victim(sbi, &segno, BG_GC))
+		goto out;
+
+	vblocks = get_valid_blocks(sbi, segno, true);
+	start = jiffies;
+
+	do_garbage_collect(sbi, segno, &gc_list, BG_GC);
+	clear_bit(GET_SEC_FROM_SEG(sbi, segno), DIRTY_I(sbi)->busy_secmap);
+
+	gc_worker_account(w, vblocks, start);
+out:
+	up_read(&sbi->gc_workers_lock);
+
+	put_gc_inode(&gc_list);
+}
+
+static int gc_worker_func(void *data)
+{
+	struct f2fs_gc_worker *w = data;
+	struct f2fs_sb_info *sbi = w->sbi;
+	wait_queue_head_t *wq = &sbi->gc_thread->workers_wait;
+
+	set_freezable();
+	do {
+		wait_event_interruptible(*wq, kthread_should_stop() ||
+					freezing(current) || w->wake);
+		w->wake = false;
+
+		if (try_to_freeze())
+			continue;
+		if (kthread_should_stop())
+			break;
+
+		if (!sb_start_write_trylock(sbi->sb))
+			continue;
+		gc_worker_collect(sbi, w);
+		sb_end_write(sbi->sb);
+	} while (!kthread_should_stop());
+	return 0;
+}
+
 void build_gc_manager(struct f2fs_sb_info *sbi)
 {
 	u64 main_count, resv_count, ovp_count;
@@ -1118,6 +1349,13 @@ void build_gc_manager(struct f2fs_sb_info *sbi)
 				BLKS_PER_SEC(sbi), (main_count - resv_count));
 	sbi->gc_pin_file_threshold = DEF_GC_FAILED_PINNED_FILES;
 
+	/* zoned devices are large and only written sequentially */
+	if (f2fs_sb_has_blkzoned(sbi->sb))
+		sbi->gc_workers = min_t(unsigned int, num_online_cpus(),
+					DEF_GC_ZONED_WORKERS);
+	else
+		sbi->gc_workers = DEF_GC_WORKERS;
+
 	/* give warm/cold data area from slower device */
 	if (sbi->s_ndevs && sbi->segs_per_sec == 1)
 		SIT_I(sbi)->last_victim[ALLOC_NEXT] =
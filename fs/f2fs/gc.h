@@ -25,10 +25,32 @@
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
+#define DEF_GC_WORKERS		1	/* just the GC thread */
+#define DEF_GC_ZONED_WORKERS	4	/* on zoned block devices */
+
+struct f2fs_gc_worker {
+	struct f2fs_sb_info *sbi;
+	struct task_struct *task;
+	bool wake;
+
+	/* for stat information */
+	unsigned long long nr_secs;	/* # of victim sections */
+	unsigned long long nr_blks;	/* # of valid blocks in them */
+	unsigned long busy_jiffies;	/* time spent on them */
+};
+
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
 
+	/*
+	 * workers[0] accounts for the GC thread itself, the others are
+	 * extra threads it wakes up to move victims of their own
+	 */
+	unsigned int nr_workers;
+	struct f2fs_gc_worker workers[MAX_GC_WORKERS];
+	wait_queue_head_t workers_wait;
+
 	/* for gc sleep time */
 	unsigned int urgent_sleep_time;
 	unsigned int min_sleep_time;
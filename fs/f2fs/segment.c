@@ -3733,6 +3733,15 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	dirty_i->victim_secmap = f2fs_kvzalloc(sbi, bitmap_size, GFP_KERNEL);
 	if (!dirty_i->victim_secmap)
 		return -ENOMEM;
+
+	dirty_i->busy_secmap = f2fs_kvzalloc(sbi, bitmap_size, GFP_KERNEL);
+	if (!dirty_i->busy_secmap)
+		return -ENOMEM;
+
+	dirty_i->victims = f2fs_kzalloc(sbi, GC_VICTIM_BATCH *
+				sizeof(struct victim_entry), GFP_KERNEL);
+	if (!dirty_i->victims)
+		return -ENOMEM;
 	return 0;
 }
 
@@ -3878,6 +3887,8 @@ static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
 	kvfree(dirty_i->victim_secmap);
+	kvfree(dirty_i->busy_secmap);
+	kfree(dirty_i->victims);
 }
 
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
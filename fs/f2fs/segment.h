@@ -278,6 +278,22 @@ struct dirty_seglist_info {
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	unsigned long *busy_secmap;		/* BG GC victims being moved */
+	struct victim_entry *victims;		/* batch of BG GC victims */
+	unsigned int nr_victims;		/* # of victims in the batch */
+	unsigned int next_victim;		/* next victim to hand out */
+	int victims_mode;			/* gc_mode of the batch */
+};
+
+/*
+ * Background GC picks up to GC_VICTIM_BATCH victims with each scan of the
+ * dirty segmap and hands them out in the order of their cost.
+ */
+#define GC_VICTIM_BATCH		16
+
+struct victim_entry {
+	unsigned int segno;			/* a dirty segment of the victim */
+	unsigned int cost;			/* gc cost at the time of the scan */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -784,6 +800,8 @@ static inline bool sec_usage_check(struct f2fs_sb_info *sbi, unsigned int secno)
 {
 	if (IS_CURSEC(sbi, secno) || (sbi->cur_victim_sec == secno))
 		return true;
+	if (test_bit(secno, DIRTY_I(sbi)->busy_secmap))
+		return true;
 	return false;
 }
 
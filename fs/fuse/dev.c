@@ -21,12 +21,50 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/eventfd.h>
+#include <linux/vmalloc.h>
+#include <linux/bvec.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
+/* Limits of the shared-memory rings */
+#define FUSE_RING_MAX_ENTRIES	1024
+#define FUSE_RING_MAX_SIZE	(16 << 20)
+
+/*
+ * Shared-memory ring of a device, see the description of the layout in
+ * include/uapi/linux/fuse.h.  'lock' serializes FUSE_DEV_IOC_RING_ENTER,
+ * and so everything but 'entry' which is protected by fiq->waitq.lock.
+ */
+struct fuse_ring {
+	struct list_head entry;		/* on fiq->rings */
+	struct mutex lock;
+
+	void *area;			/* vmalloc_user()ed, mapped by the daemon */
+	size_t size;
+	struct fuse_ring_hdr *hdr;
+	struct fuse_ring_entry *req;
+	struct fuse_ring_entry *rep;
+
+	unsigned int entries;
+	unsigned int entry_size;
+	unsigned int slot_pages;
+	struct bio_vec *bvecs;		/* pages of the slots */
+
+	unsigned int req_tail;		/* our copies of the header indexes */
+	unsigned int rep_head;
+
+	unsigned int *free;		/* stack of the slots we own */
+	unsigned int nr_free;
+	unsigned long *busy;		/* slots owned by the daemon */
+
+	struct eventfd_ctx *eventfd;
+	int cpu;
+};
+
 static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
@@ -304,17 +342,86 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_iqueue *fiq)
+static u64 fuse_get_unique(struct fuse_conn *fc)
+{
+	return atomic64_inc_return(&fc->reqctr);
+}
+
+/*
+ * Lock the input queue a new request should go on: the queue of the device
+ * bound to the current CPU if there is one, the shared queue otherwise.
+ */
+static struct fuse_iqueue *fuse_lock_iq(struct fuse_conn *fc)
+{
+	struct fuse_iqueue **cpu_iqs = READ_ONCE(fc->cpu_iqs);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iqs) {
+		fiq = READ_ONCE(cpu_iqs[raw_smp_processor_id()]);
+		if (fiq && READ_ONCE(fiq->bound)) {
+			spin_lock(&fiq->waitq.lock);
+			if (likely(fiq->bound))
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+	fiq = &fc->iq;
+	spin_lock(&fiq->waitq.lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue @req was queued on.  Unbinding a device moves its
+ * requests to the shared queue, so recheck once the lock is held.
+ */
+static struct fuse_iqueue *fuse_req_lock_iq(struct fuse_conn *fc,
+					    struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq) ?: &fc->iq;
+		spin_lock(&fiq->waitq.lock);
+		if (fiq == (req->fiq ?: &fc->iq))
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
+}
+
+/*
+ * Signal the eventfd of a ring that there are requests to read, preferably
+ * the one set up for the current CPU, otherwise going round the others.
+ * Called with fiq->waitq.lock held.
+ */
+static void fuse_ring_wake(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	struct fuse_ring *ring, *found = NULL;
+	int cpu = raw_smp_processor_id();
+
+	list_for_each_entry(ring, &fiq->rings, entry) {
+		if (!ring->eventfd)
+			continue;
+		if (ring->cpu == cpu) {
+			eventfd_signal(ring->eventfd, 1);
+			return;
+		}
+		if (!found)
+			found = ring;
+	}
+	if (found) {
+		list_move_tail(&found->entry, &fiq->rings);
+		eventfd_signal(found->eventfd, 1);
+	}
 }
 
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
+	fuse_ring_wake(fiq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 }
 
@@ -331,6 +438,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
 		wake_up_locked(&fiq->waitq);
+		fuse_ring_wake(fiq);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
@@ -343,13 +451,13 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
-		req->in.h.unique = fuse_get_unique(fiq);
+		fiq = fuse_lock_iq(fc);
+		req->in.h.unique = fuse_get_unique(fc);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
 	}
@@ -365,12 +473,12 @@ static void flush_bg_queue(struct fuse_conn *fc)
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		return;
 
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_req_lock_iq(fc, req);
 	list_del_init(&req->intr_entry);
 	spin_unlock(&fiq->waitq.lock);
 	WARN_ON(test_bit(FR_PENDING, &req->flags));
@@ -401,9 +509,10 @@ static void request_end(struct fuse_conn *fc, struct fuse_req *req)
 	fuse_put_request(fc, req);
 }
 
-static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
+static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	spin_lock(&fiq->waitq.lock);
+	struct fuse_iqueue *fiq = fuse_req_lock_iq(fc, req);
+
 	if (test_bit(FR_FINISHED, &req->flags)) {
 		spin_unlock(&fiq->waitq.lock);
 		return;
@@ -411,6 +520,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 	if (list_empty(&req->intr_entry)) {
 		list_add_tail(&req->intr_entry, &fiq->interrupts);
 		wake_up_locked(&fiq->waitq);
+		fuse_ring_wake(fiq);
 	}
 	spin_unlock(&fiq->waitq.lock);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -418,7 +528,7 @@ static void queue_interrupt(struct fuse_iqueue *fiq, struct fuse_req *req)
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -432,7 +542,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		/* matches barrier in fuse_dev_do_read() */
 		smp_mb__after_atomic();
 		if (test_bit(FR_SENT, &req->flags))
-			queue_interrupt(fiq, req);
+			queue_interrupt(fc, req);
 	}
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
@@ -442,7 +552,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_req_lock_iq(fc, req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -463,15 +573,15 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iq(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
 	} else {
-		req->in.h.unique = fuse_get_unique(fiq);
+		req->in.h.unique = fuse_get_unique(fc);
 		queue_request(fiq, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
@@ -605,11 +715,11 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
 	int err = -ENODEV;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	__clear_bit(FR_ISREPLY, &req->flags);
 	req->in.h.unique = unique;
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iq(fc);
 	if (fiq->connected) {
 		queue_request(fiq, req);
 		err = 0;
@@ -1060,7 +1170,7 @@ static int request_pending(struct fuse_iqueue *fiq)
  *
  * Called with fiq->waitq.lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_iqueue *fiq,
+static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_iqueue *fiq,
 			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
 __releases(fiq->waitq.lock)
@@ -1071,7 +1181,7 @@ __releases(fiq->waitq.lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fiq);
+	req->intr_unique = fuse_get_unique(fc);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -1113,7 +1223,8 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_iqueue *fiq,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_iqueue *fiq,
+static int fuse_read_single_forget(struct fuse_conn *fc,
+				   struct fuse_iqueue *fiq,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
 __releases(fiq->waitq.lock)
@@ -1126,7 +1237,7 @@ __releases(fiq->waitq.lock)
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fiq),
+		.unique = fuse_get_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1146,8 +1257,9 @@ __releases(fiq->waitq.lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_iqueue *fiq,
-				   struct fuse_copy_state *cs, size_t nbytes)
+static int fuse_read_batch_forget(struct fuse_conn *fc,
+				  struct fuse_iqueue *fiq,
+				  struct fuse_copy_state *cs, size_t nbytes)
 __releases(fiq->waitq.lock)
 {
 	int err;
@@ -1157,7 +1269,7 @@ __releases(fiq->waitq.lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fiq),
+		.unique = fuse_get_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1201,9 +1313,9 @@ static int fuse_read_forget(struct fuse_conn *fc, struct fuse_iqueue *fiq,
 __releases(fiq->waitq.lock)
 {
 	if (fc->minor < 16 || fiq->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fiq, cs, nbytes);
+		return fuse_read_single_forget(fc, fiq, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fiq, cs, nbytes);
+		return fuse_read_batch_forget(fc, fiq, cs, nbytes);
 }
 
 /*
@@ -1215,12 +1327,12 @@ __releases(fiq->waitq.lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, bool nonblock,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = READ_ONCE(fud->iq);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1229,8 +1341,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
  restart:
 	spin_lock(&fiq->waitq.lock);
 	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fiq->connected &&
-	    !request_pending(fiq))
+	if (nonblock && fiq->connected && !request_pending(fiq))
 		goto err_unlock;
 
 	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
@@ -1246,7 +1357,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	if (!list_empty(&fiq->interrupts)) {
 		req = list_entry(fiq->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fiq, cs, nbytes, req);
+		return fuse_read_interrupt(fc, fiq, cs, nbytes, req);
 	}
 
 	if (forget_pending(fiq)) {
@@ -1303,7 +1414,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(fc, req);
 
 	return reqsize;
 
@@ -1344,7 +1455,8 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, struct iov_iter *to)
 
 	fuse_copy_init(&cs, 1, to);
 
-	return fuse_dev_do_read(fud, file, &cs, iov_iter_count(to));
+	return fuse_dev_do_read(fud, file->f_flags & O_NONBLOCK, &cs,
+				iov_iter_count(to));
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -1367,7 +1479,7 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	fuse_copy_init(&cs, 1, NULL);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fud, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in->f_flags & O_NONBLOCK, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1870,7 +1982,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(&fc->iq, req);
+			queue_interrupt(fc, req);
 
 		fuse_copy_finish(cs);
 		return nbytes;
@@ -2012,7 +2124,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return EPOLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = READ_ONCE(fud->iq);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2042,6 +2154,32 @@ static void end_requests(struct fuse_conn *fc, struct list_head *head)
 	}
 }
 
+/*
+ * Disconnect an input queue, moving its pending requests to @to_end.
+ * Called with fc->lock held.
+ */
+static void fuse_abort_iqueue(struct fuse_iqueue *fiq,
+			      struct list_head *to_end)
+{
+	struct fuse_ring *ring;
+	struct fuse_req *req;
+
+	spin_lock(&fiq->waitq.lock);
+	fiq->connected = 0;
+	list_for_each_entry(req, &fiq->pending, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(dequeue_forget(fiq, 1, NULL));
+	wake_up_all_locked(&fiq->waitq);
+	list_for_each_entry(ring, &fiq->rings, entry) {
+		if (ring->eventfd)
+			eventfd_signal(ring->eventfd, 1);
+	}
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 static void end_polls(struct fuse_conn *fc)
 {
 	struct rb_node *p;
@@ -2077,8 +2215,6 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
@@ -2111,16 +2247,16 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 		fc->max_background = UINT_MAX;
 		flush_bg_queue(fc);
 
-		spin_lock(&fiq->waitq.lock);
-		fiq->connected = 0;
-		list_splice_init(&fiq->pending, &to_end2);
-		list_for_each_entry(req, &to_end2, list)
-			clear_bit(FR_PENDING, &req->flags);
-		while (forget_pending(fiq))
-			kfree(dequeue_forget(fiq, 1, NULL));
-		wake_up_all_locked(&fiq->waitq);
-		spin_unlock(&fiq->waitq.lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		fuse_abort_iqueue(&fc->iq, &to_end2);
+		if (fc->cpu_iqs) {
+			int cpu;
+
+			for_each_possible_cpu(cpu) {
+				if (fc->cpu_iqs[cpu])
+					fuse_abort_iqueue(fc->cpu_iqs[cpu],
+							  &to_end2);
+			}
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2138,6 +2274,351 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+static void fuse_ring_free(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = fud->iq;
+	struct fuse_ring *ring = fud->ring;
+
+	if (!ring)
+		return;
+
+	spin_lock(&fiq->waitq.lock);
+	list_del(&ring->entry);
+	spin_unlock(&fiq->waitq.lock);
+
+	if (ring->eventfd)
+		eventfd_ctx_put(ring->eventfd);
+	kfree(ring->busy);
+	kvfree(ring->free);
+	kvfree(ring->bvecs);
+	vfree(ring->area);
+	kfree(ring);
+	fud->ring = NULL;
+}
+
+static int fuse_ring_setup(struct fuse_dev *fud,
+			   struct fuse_ring_setup __user *argp)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq;
+	struct fuse_ring_setup p;
+	struct fuse_ring *ring;
+	unsigned int slots_off, i;
+	u64 size;
+	int err;
+
+	if (copy_from_user(&p, argp, sizeof(p)))
+		return -EFAULT;
+
+	if (p.flags || p.padding)
+		return -EINVAL;
+	if (!is_power_of_2(p.entries) || p.entries > FUSE_RING_MAX_ENTRIES)
+		return -EINVAL;
+	if (p.entry_size < FUSE_MIN_READ_BUFFER ||
+	    !PAGE_ALIGNED(p.entry_size))
+		return -EINVAL;
+	if (p.cpu < -1 || p.cpu >= (int)nr_cpu_ids)
+		return -EINVAL;
+
+	slots_off = PAGE_ALIGN(sizeof(struct fuse_ring_hdr) +
+			       2 * p.entries * sizeof(struct fuse_ring_entry));
+	size = slots_off + (u64)p.entries * p.entry_size;
+	if (size > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	err = -ENOMEM;
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&ring->entry);
+	mutex_init(&ring->lock);
+	ring->size = size;
+	ring->entries = p.entries;
+	ring->entry_size = p.entry_size;
+	ring->slot_pages = p.entry_size >> PAGE_SHIFT;
+	ring->cpu = p.cpu;
+
+	ring->area = vmalloc_user(size);
+	ring->bvecs = kvmalloc_array(p.entries * ring->slot_pages,
+				     sizeof(struct bio_vec), GFP_KERNEL);
+	ring->free = kvmalloc_array(p.entries, sizeof(unsigned int),
+				    GFP_KERNEL);
+	ring->busy = kcalloc(BITS_TO_LONGS(p.entries), sizeof(unsigned long),
+			     GFP_KERNEL);
+	if (!ring->area || !ring->bvecs || !ring->free || !ring->busy)
+		goto out_free;
+
+	if (p.eventfd >= 0) {
+		ring->eventfd = eventfd_ctx_fdget(p.eventfd);
+		if (IS_ERR(ring->eventfd)) {
+			err = PTR_ERR(ring->eventfd);
+			ring->eventfd = NULL;
+			goto out_free;
+		}
+	}
+
+	for (i = 0; i < p.entries * ring->slot_pages; i++) {
+		struct bio_vec *bv = &ring->bvecs[i];
+
+		bv->bv_page = vmalloc_to_page(ring->area + slots_off +
+					      i * PAGE_SIZE);
+		bv->bv_len = PAGE_SIZE;
+		bv->bv_offset = 0;
+	}
+	for (i = 0; i < p.entries; i++)
+		ring->free[i] = p.entries - 1 - i;
+	ring->nr_free = p.entries;
+
+	ring->hdr = ring->area;
+	ring->hdr->entries = p.entries;
+	ring->hdr->entry_size = p.entry_size;
+	ring->hdr->req_off = sizeof(struct fuse_ring_hdr);
+	ring->hdr->rep_off = ring->hdr->req_off +
+			     p.entries * sizeof(struct fuse_ring_entry);
+	ring->hdr->slots_off = slots_off;
+	ring->req = ring->area + ring->hdr->req_off;
+	ring->rep = ring->area + ring->hdr->rep_off;
+
+	/* fc->lock keeps the device from being bound to a CPU meanwhile */
+	spin_lock(&fc->lock);
+	if (fud->ring) {
+		spin_unlock(&fc->lock);
+		err = -EBUSY;
+		goto out_free;
+	}
+	fud->ring = ring;
+	fiq = fud->iq;
+	spin_lock(&fiq->waitq.lock);
+	list_add_tail(&ring->entry, &fiq->rings);
+	spin_unlock(&fiq->waitq.lock);
+	spin_unlock(&fc->lock);
+
+	p.size = size;
+	if (copy_to_user(argp, &p, sizeof(p)))
+		return -EFAULT;
+	return 0;
+
+ out_free:
+	if (ring->eventfd)
+		eventfd_ctx_put(ring->eventfd);
+	kfree(ring->busy);
+	kvfree(ring->free);
+	kvfree(ring->bvecs);
+	vfree(ring->area);
+	kfree(ring);
+	return err;
+}
+
+static void fuse_ring_iter(struct fuse_ring *ring, unsigned int slot,
+			   int dir, size_t len, struct iov_iter *iter)
+{
+	iov_iter_bvec(iter, ITER_BVEC | dir,
+		      ring->bvecs + slot * ring->slot_pages,
+		      ring->slot_pages, len);
+}
+
+/* Hand the slots queued back by the daemon to fuse_dev_do_write() */
+static unsigned int fuse_ring_reap(struct fuse_dev *fud,
+				   struct fuse_ring *ring)
+{
+	struct fuse_copy_state cs;
+	struct iov_iter iter;
+	unsigned int mask = ring->entries - 1;
+	unsigned int head = ring->rep_head;
+	unsigned int tail = smp_load_acquire(&ring->hdr->rep_tail);
+	unsigned int avail = min(tail - head, ring->entries);
+	unsigned int nr = 0;
+
+	while (avail--) {
+		struct fuse_ring_entry *ent = &ring->rep[head++ & mask];
+		unsigned int slot = READ_ONCE(ent->slot);
+		unsigned int len = READ_ONCE(ent->len);
+
+		/* ignore slots the daemon doesn't own */
+		if (slot >= ring->entries ||
+		    !test_and_clear_bit(slot, ring->busy))
+			continue;
+
+		if (len && len <= ring->entry_size) {
+			fuse_ring_iter(ring, slot, WRITE, len, &iter);
+			fuse_copy_init(&cs, 0, &iter);
+			fuse_dev_do_write(fud, &cs, len);
+		}
+		ring->free[ring->nr_free++] = slot;
+		nr++;
+	}
+
+	ring->rep_head = head;
+	smp_store_release(&ring->hdr->rep_head, head);
+	return nr;
+}
+
+static int fuse_ring_enter(struct fuse_dev *fud,
+			   struct fuse_ring_enter __user *argp)
+{
+	struct fuse_ring *ring = READ_ONCE(fud->ring);
+	struct fuse_copy_state cs;
+	struct fuse_ring_enter e;
+	struct iov_iter iter;
+	unsigned int slot;
+	ssize_t ret;
+	int err = 0;
+
+	if (!ring)
+		return -EINVAL;
+	if (copy_from_user(&e, argp, sizeof(e)))
+		return -EFAULT;
+	if (e.flags & ~FUSE_RING_ENTER_WAIT)
+		return -EINVAL;
+
+	mutex_lock(&ring->lock);
+	e.nr_replies = fuse_ring_reap(fud, ring);
+	e.nr_requests = 0;
+
+	while (ring->nr_free) {
+		bool nonblock = e.nr_requests ||
+				!(e.flags & FUSE_RING_ENTER_WAIT);
+
+		slot = ring->free[ring->nr_free - 1];
+		fuse_ring_iter(ring, slot, READ, ring->entry_size, &iter);
+		fuse_copy_init(&cs, 1, &iter);
+		ret = fuse_dev_do_read(fud, nonblock, &cs, ring->entry_size);
+		if (ret < 0) {
+			if (!e.nr_requests && ret != -EAGAIN)
+				err = ret;
+			break;
+		}
+
+		ring->nr_free--;
+		set_bit(slot, ring->busy);
+		ring->req[ring->req_tail & (ring->entries - 1)] =
+			(struct fuse_ring_entry) { .slot = slot, .len = ret };
+		ring->req_tail++;
+		/* the entry and the slot are visible before the tail */
+		smp_store_release(&ring->hdr->req_tail, ring->req_tail);
+		e.nr_requests++;
+	}
+	mutex_unlock(&ring->lock);
+
+	if (err)
+		return err;
+	if (copy_to_user(argp, &e, sizeof(e)))
+		return -EFAULT;
+	return 0;
+}
+
+static int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_ring *ring;
+
+	if (!fud)
+		return -EPERM;
+
+	ring = READ_ONCE(fud->ring);
+	if (!ring)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->area, vma->vm_pgoff);
+}
+
+/*
+ * Bind a device to a CPU: requests submitted on that CPU are queued for
+ * this device alone instead of on the queue shared by all the devices of
+ * the connection.
+ */
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue **cpu_iqs = NULL, *fiq = NULL;
+	int err;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	if (!READ_ONCE(fc->cpu_iqs)) {
+		cpu_iqs = kcalloc(nr_cpu_ids, sizeof(*cpu_iqs), GFP_KERNEL);
+		if (!cpu_iqs)
+			return -ENOMEM;
+	}
+	/* Queues are never freed before the connection, nor replaced */
+	if (cpu_iqs || !READ_ONCE(fc->cpu_iqs[cpu])) {
+		fiq = kmalloc(sizeof(*fiq), GFP_KERNEL);
+		if (!fiq) {
+			kfree(cpu_iqs);
+			return -ENOMEM;
+		}
+		fuse_iqueue_init(fiq);
+	}
+
+	spin_lock(&fc->lock);
+	err = -ENOTCONN;
+	if (!fc->connected)
+		goto out_unlock;
+	if (!fc->cpu_iqs) {
+		smp_store_release(&fc->cpu_iqs, cpu_iqs);
+		cpu_iqs = NULL;
+	}
+	if (!fc->cpu_iqs[cpu]) {
+		smp_store_release(&fc->cpu_iqs[cpu], fiq);
+		fiq = NULL;
+	}
+
+	err = -EBUSY;
+	if (fud->iq != &fc->iq || fud->ring)
+		goto out_unlock;
+
+	spin_lock(&fc->cpu_iqs[cpu]->waitq.lock);
+	if (!fc->cpu_iqs[cpu]->bound) {
+		fc->cpu_iqs[cpu]->bound = fud;
+		fud->iq = fc->cpu_iqs[cpu];
+		fud->cpu = cpu;
+		err = 0;
+	}
+	spin_unlock(&fc->cpu_iqs[cpu]->waitq.lock);
+
+ out_unlock:
+	spin_unlock(&fc->lock);
+	kfree(cpu_iqs);
+	kfree(fiq);
+	return err;
+}
+
+/*
+ * Undo fuse_dev_bind_cpu(): whatever is still queued for the device goes
+ * back to the shared queue, for the other devices to pick up.
+ */
+static void fuse_dev_unbind(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *shared = &fc->iq;
+	struct fuse_iqueue *fiq = fud->iq;
+	struct fuse_req *req;
+
+	if (fiq == shared)
+		return;
+
+	spin_lock(&shared->waitq.lock);
+	spin_lock_nested(&fiq->waitq.lock, SINGLE_DEPTH_NESTING);
+	fiq->bound = NULL;
+	list_for_each_entry(req, &fiq->pending, list)
+		WRITE_ONCE(req->fiq, shared);
+	list_for_each_entry(req, &fiq->interrupts, intr_entry)
+		WRITE_ONCE(req->fiq, shared);
+	list_splice_tail_init(&fiq->pending, &shared->pending);
+	list_splice_tail_init(&fiq->interrupts, &shared->interrupts);
+	spin_unlock(&fiq->waitq.lock);
+	if (request_pending(shared)) {
+		wake_up_locked(&shared->waitq);
+		fuse_ring_wake(shared);
+	}
+	spin_unlock(&shared->waitq.lock);
+	kill_fasync(&shared->fasync, SIGIO, POLL_IN);
+
+	fud->iq = shared;
+	fud->cpu = -1;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2148,6 +2629,8 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		WARN_ON(!list_empty(&fpq->io));
 		end_requests(fc, &fpq->processing);
+		fuse_ring_free(fud);
+		fuse_dev_unbind(fud);
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2192,6 +2675,38 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 {
 	int err = -ENOTTY;
 
+	if (cmd == FUSE_DEV_IOC_RING_SETUP || cmd == FUSE_DEV_IOC_RING_ENTER) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		if (!fud)
+			return -EPERM;
+		if (cmd == FUSE_DEV_IOC_RING_SETUP)
+			return fuse_ring_setup(fud, (void __user *) arg);
+		return fuse_ring_enter(fud, (void __user *) arg);
+	}
+
+	if (cmd == FUSE_DEV_IOC_BIND_CPU) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		if (!fud)
+			return -EPERM;
+		if (get_user(cpu, (__u32 __user *) arg))
+			return -EFAULT;
+		return fuse_dev_bind_cpu(fud, cpu);
+	}
+
+	if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		int fd;
+
+		if (!fud)
+			return -EPERM;
+		if (get_user(fd, (__u32 __user *) arg))
+			return -EFAULT;
+		return fuse_passthrough_open(fud->fc, fd);
+	}
+
 	if (cmd == FUSE_DEV_IOC_CLONE) {
 		int oldfd;
 
@@ -2232,6 +2747,7 @@ const struct file_operations fuse_dev_operations = {
 	.write_iter	= fuse_dev_write,
 	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
+	.mmap		= fuse_dev_mmap,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
@@ -27,6 +27,7 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -108,6 +109,30 @@ struct fuse_inode {
 
 	/** Lock for serializing lookup and readdir for back compatibility*/
 	struct mutex mutex;
+
+	/** Readdir cache, kept in the page cache of a directory */
+	struct {
+		/** true if fully cached */
+		bool cached;
+
+		/** Size of cache */
+		loff_t size;
+
+		/** position at end of cache (position of next entry) */
+		loff_t pos;
+
+		/** version of the cache */
+		u64 version;
+
+		/** modification time of directory when cache was started */
+		struct timespec mtime;
+
+		/** iversion of directory when cache was started */
+		u64 iversion;
+
+		/** protects above fields */
+		spinlock_t lock;
+	} rdc;
 };
 
 /** FUSE inode state bits */
@@ -122,6 +147,12 @@ enum {
 
 struct fuse_conn;
 
+/** Backing file of a file opened with FOPEN_PASSTHROUGH */
+struct fuse_passthrough {
+	struct file *filp;
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -154,6 +185,27 @@ struct fuse_file {
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
 
+	/** Readdir related */
+	struct {
+		/*
+		 * Protects below fields against (crazy) parallel readdir on
+		 * same open file.  Uncontended in the normal case.
+		 */
+		struct mutex lock;
+
+		/* Dir stream position */
+		loff_t pos;
+
+		/* Offset in cache */
+		loff_t cache_off;
+
+		/* Version of cache we are reading */
+		u64 version;
+	} readdir;
+
+	/** Backing file, for passthrough */
+	struct fuse_passthrough passthrough;
+
 	/** Has flock been performed on this file? */
 	bool flock:1;
 };
@@ -314,6 +366,9 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Input queue the request was queued on */
+	struct fuse_iqueue *fiq;
+
 	/* Request flags, updated with test/set/clear_bit() */
 	unsigned long flags;
 
@@ -391,8 +446,8 @@ struct fuse_iqueue {
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
+	/** Device bound to the CPU of a per-CPU queue, if any */
+	struct fuse_dev *bound;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -409,6 +464,9 @@ struct fuse_iqueue {
 
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
+
+	/** Shared-memory rings of the devices */
+	struct list_head rings;
 };
 
 struct fuse_pqueue {
@@ -435,8 +493,17 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Input queue read by this device */
+	struct fuse_iqueue *iq;
+
+	/** CPU whose requests the device serves, or -1 */
+	int cpu;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Shared-memory ring, if set up */
+	struct fuse_ring *ring;
 };
 
 /**
@@ -479,12 +546,24 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/**
+	 * Per-CPU input queues, allocated when a device first gets bound
+	 * to a CPU and kept until the connection goes away
+	 */
+	struct fuse_iqueue **cpu_iqs;
+
+	/** The next unique request id */
+	atomic64_t reqctr;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
 	/** rbtree of fuse_files waiting for poll events indexed by ph */
 	struct rb_root polled_files;
 
+	/** Passthrough backing files not yet claimed by an open */
+	struct idr passthrough_req;
+
 	/** Maximum number of outstanding background requests */
 	unsigned max_background;
 
@@ -551,6 +630,9 @@ struct fuse_conn {
 	/** handle fs handles killing suid/sgid/cap on write/chown/trunc */
 	unsigned handle_killpriv:1;
 
+	/** Can read, write and mmap be passed through to backing files? */
+	unsigned passthrough:1;
+
 	/*
 	 * The following bitfields are only for optimization purposes
 	 * and hence races in setting them will not cause malfunction
@@ -868,6 +950,12 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort);
  */
 void fuse_invalidate_attr(struct inode *inode);
 
+/**
+ * Invalidate the attributes and the readdir cache of a directory whose
+ * contents changed
+ */
+void fuse_dir_changed(struct inode *dir);
+
 void fuse_invalidate_entry_cache(struct dentry *entry);
 
 void fuse_invalidate_atime(struct inode *inode);
@@ -877,6 +965,11 @@ void fuse_invalidate_atime(struct inode *inode);
  */
 struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
 /**
  * Initialize fuse_conn
  */
@@ -990,4 +1083,14 @@ struct posix_acl;
 struct posix_acl *fuse_get_acl(struct inode *inode, int type);
 int fuse_set_acl(struct inode *inode, struct posix_acl *acl, int type);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_conn *fc, int fd);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_passthrough *pt);
+void fuse_passthrough_free_unclaimed(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
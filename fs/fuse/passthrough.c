@@ -0,0 +1,222 @@
+/*
+ * FUSE: Filesystem in Userspace
+ *
+ * Passthrough of read, write and mmap to a backing file handed over by
+ * the daemon, for filesystems whose file data lives in a local file.
+ *
+ * This program can be distributed under the terms of the GNU GPL.
+ * See the file COPYING.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs_stack.h>
+#include <linux/idr.h>
+#include <linux/uio.h>
+
+static rwf_t iocb_to_rw_flags(int ifl)
+{
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_APPEND)
+		flags |= RWF_APPEND;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = vfs_iter_read(backing_file, to, &iocb->ki_pos,
+			    iocb_to_rw_flags(iocb->ki_flags));
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(inode);
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(backing_file);
+	ret = vfs_iter_write(backing_file, from, &iocb->ki_pos,
+			     iocb_to_rw_flags(iocb->ki_flags));
+	file_end_write(backing_file);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		fuse_write_update_size(inode, iocb->ki_pos);
+		/* mtime, ctime and the suid bits are the backing file's */
+		fuse_invalidate_attr(inode);
+	}
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing_file = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+	if (!backing_file->f_op->mmap)
+		return -ENODEV;
+
+	/* The mapping is the backing file's, so it is pinned instead */
+	vma->vm_file = get_file(backing_file);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret)
+		fput(backing_file);
+	else
+		fput(file);
+
+	fuse_invalidate_atime(file_inode(file));
+	return ret;
+}
+
+/*
+ * Register a backing file for passthrough, on behalf of the daemon.
+ * Returns the id to put in the reply to the open it is meant for, which
+ * consumes it.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, int fd)
+{
+	struct fuse_passthrough *pt;
+	struct file *backing_file;
+	int id;
+
+	if (!fc->passthrough)
+		return -EPERM;
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	backing_file = fget(fd);
+	if (!backing_file)
+		return -EBADF;
+
+	id = -EINVAL;
+	if (!backing_file->f_op->read_iter || !backing_file->f_op->write_iter)
+		goto out_fput;
+	/* Both the FUSE mount and the backing file's need room to stack */
+	if (file_inode(backing_file)->i_sb->s_stack_depth + 1 >
+	    FILESYSTEM_MAX_STACK_DEPTH)
+		goto out_fput;
+
+	id = -ENOMEM;
+	pt = kmalloc(sizeof(*pt), GFP_KERNEL);
+	if (!pt)
+		goto out_fput;
+	pt->filp = backing_file;
+	pt->cred = prepare_creds();
+	if (!pt->cred)
+		goto out_free;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	id = idr_alloc(&fc->passthrough_req, pt, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (id > 0)
+		return id;
+
+	put_cred(pt->cred);
+ out_free:
+	kfree(pt);
+ out_fput:
+	fput(backing_file);
+	return id;
+}
+
+/*
+ * Attach the backing file named by an open reply to the new file.  If the
+ * id does not name one, I/O keeps going through the daemon.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg)
+{
+	struct fuse_passthrough *pt = NULL;
+
+	if (!(openarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	ff->open_flags &= ~FOPEN_PASSTHROUGH;
+	if (fc->passthrough && openarg->passthrough_fh > 0) {
+		spin_lock(&fc->lock);
+		pt = idr_remove(&fc->passthrough_req, openarg->passthrough_fh);
+		spin_unlock(&fc->lock);
+	}
+	if (!pt) {
+		pr_warn_ratelimited("fuse: passthrough id %u not found\n",
+				    openarg->passthrough_fh);
+		return;
+	}
+
+	ff->passthrough = *pt;
+	kfree(pt);
+	/* I/O goes to the backing file, not to the daemon's page cache */
+	ff->open_flags &= ~FOPEN_DIRECT_IO;
+	ff->open_flags |= FOPEN_PASSTHROUGH;
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *pt)
+{
+	if (pt->filp) {
+		fput(pt->filp);
+		put_cred(pt->cred);
+		pt->filp = NULL;
+		pt->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_one(int id, void *p, void *data)
+{
+	struct fuse_passthrough *pt = p;
+
+	fuse_passthrough_release(pt);
+	kfree(pt);
+	return 0;
+}
+
+/* Drop the backing files no open reply claimed */
+void fuse_passthrough_free_unclaimed(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_one, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
@@ -0,0 +1,1656 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Shared application/kernel submission and completion ring pairs, for
+ * supporting fast/efficient IO.
+ *
+ * A note on the read/write ordering memory barriers that are matched between
+ * the application and kernel side. When the application reads the CQ ring
+ * tail, it must use an appropriate smp_rmb() to order with the smp_wmb()
+ * the kernel uses after writing the tail. Failure to do so could cause a
+ * delay in when the application notices that completion events available.
+ * This isn't a fatal condition. Likewise, the application must use an
+ * appropriate smp_wmb() both before writing the SQ tail, and after writing
+ * the SQ tail. The first one orders the sqe writes with the tail write, and
+ * the latter is paired with the smp_rmb() the kernel will issue before
+ * reading the SQ tail on submission.
+ *
+ * Requests are first issued inline from io_uring_enter(2) without blocking.
+ * Those that can't make progress that way are retried from a workqueue:
+ * sockets and other pollable files wait for readiness through their poll
+ * waitqueue and are retried without blocking again, buffered reads from
+ * files that support it wait on the page lock the same way, and anything
+ * else is handed to a worker that is allowed to block.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/syscalls.h>
+#include <linux/compat.h>
+#include <linux/refcount.h>
+#include <linux/uio.h>
+
+#include <linux/sched/signal.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/task.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/mmu_context.h>
+#include <linux/pagemap.h>
+#include <linux/percpu-refcount.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/net.h>
+#include <linux/poll.h>
+#include <linux/anon_inodes.h>
+#include <linux/cred.h>
+#include <net/sock.h>
+
+#include <linux/uaccess.h>
+
+#include <uapi/linux/io_uring.h>
+
+#include "internal.h"
+
+#define IORING_MAX_ENTRIES	4096
+
+struct io_uring {
+	u32 head ____cacheline_aligned_in_smp;
+	u32 tail ____cacheline_aligned_in_smp;
+};
+
+struct io_sq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			dropped;
+	u32			flags;
+	u32			array[];
+};
+
+struct io_cq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;
+	struct io_uring_cqe	cqes[];
+};
+
+struct io_ring_ctx {
+	struct {
+		struct percpu_ref	refs;
+	} ____cacheline_aligned_in_smp;
+
+	struct {
+		bool			compat;
+
+		/*
+		 * Ring buffer of indices into array of io_uring_sqe, which is
+		 * mmapped by the application using the IORING_OFF_SQES offset.
+		 *
+		 * This indirection could e.g. be used to assign fixed
+		 * io_uring_sqe entries to operations and only submit them to
+		 * the queue when needed.
+		 *
+		 * The kernel modifies neither the indices array nor the entries
+		 * array.
+		 */
+		struct io_sq_ring	*sq_ring;
+		unsigned		cached_sq_head;
+		unsigned		sq_entries;
+		unsigned		sq_mask;
+		struct io_uring_sqe	*sq_sqes;
+	} ____cacheline_aligned_in_smp;
+
+	/* IO offload */
+	struct workqueue_struct	*sqo_wq;
+	struct mm_struct	*sqo_mm;
+	const struct cred	*creds;
+
+	struct {
+		/* CQ ring */
+		struct io_cq_ring	*cq_ring;
+		unsigned		cached_cq_tail;
+		unsigned		cq_entries;
+		unsigned		cq_mask;
+		struct wait_queue_head	cq_wait;
+	} ____cacheline_aligned_in_smp;
+
+	size_t			sq_ring_sz;
+	size_t			sq_sqes_sz;
+	size_t			cq_ring_sz;
+
+	struct work_struct	free_work;
+
+	struct {
+		struct mutex		uring_lock;
+		wait_queue_head_t	wait;
+	} ____cacheline_aligned_in_smp;
+
+	struct {
+		spinlock_t		completion_lock;
+		/* polls waiting for an event, for cancellation at teardown */
+		struct list_head	cancel_list;
+	} ____cacheline_aligned_in_smp;
+};
+
+/*
+ * First field must be the file pointer in all the
+ * iocb unions! See also 'struct kiocb' in <linux/fs.h>
+ */
+struct io_poll_iocb {
+	struct file			*file;
+	struct wait_queue_head		*head;
+	__poll_t			events;
+	bool				done;
+	bool				canceled;
+	struct wait_queue_entry		wait;
+};
+
+/*
+ * NOTE! Each of the iocb union members has the file pointer
+ * as the first entry in their struct definition. So you can
+ * access the file pointer through any of the sub-structs,
+ * or directly as just 'ki_filp' in this struct.
+ */
+struct io_kiocb {
+	union {
+		struct file		*file;
+		struct kiocb		rw;
+		struct io_poll_iocb	poll;
+	};
+
+	struct io_ring_ctx	*ctx;
+	struct list_head	list;
+	/* the submitter, for requests that need its file table from a worker */
+	struct task_struct	*task;
+	refcount_t		refs;
+#define REQ_F_NOWAIT		1	/* must not punt to workers */
+#define REQ_F_POLL_RETRY	2	/* poll armed to retry the request */
+#define REQ_F_POLLED		4	/* file was reported ready */
+	unsigned int		flags;
+	/* bytes of a buffered read already done before it had to wait */
+	size_t			result;
+	u64			user_data;
+	struct io_uring_sqe	sqe;
+	struct work_struct	work;
+	struct wait_page_queue	wpq;
+};
+
+static struct kmem_cache *req_cachep;
+
+static const struct file_operations io_uring_fops;
+
+static void io_sq_wq_submit_work(struct work_struct *work);
+
+static void io_ring_ctx_ref_free(struct percpu_ref *ref)
+{
+	struct io_ring_ctx *ctx = container_of(ref, struct io_ring_ctx, refs);
+
+	/*
+	 * The last reference can be dropped from a worker on ctx->sqo_wq or
+	 * from interrupt context, tear down from process context instead.
+	 */
+	schedule_work(&ctx->free_work);
+}
+
+static void io_ring_ctx_free(struct io_ring_ctx *ctx);
+
+static void io_ring_ctx_free_work(struct work_struct *work)
+{
+	io_ring_ctx_free(container_of(work, struct io_ring_ctx, free_work));
+}
+
+static struct io_ring_ctx *io_ring_ctx_alloc(void)
+{
+	struct io_ring_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	if (percpu_ref_init(&ctx->refs, io_ring_ctx_ref_free, 0, GFP_KERNEL)) {
+		kfree(ctx);
+		return NULL;
+	}
+
+	INIT_WORK(&ctx->free_work, io_ring_ctx_free_work);
+	init_waitqueue_head(&ctx->cq_wait);
+	mutex_init(&ctx->uring_lock);
+	init_waitqueue_head(&ctx->wait);
+	spin_lock_init(&ctx->completion_lock);
+	INIT_LIST_HEAD(&ctx->cancel_list);
+	return ctx;
+}
+
+static void io_commit_cqring(struct io_ring_ctx *ctx)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+
+	if (ctx->cached_cq_tail != READ_ONCE(ring->r.tail)) {
+		/* order cqe stores with ring update */
+		smp_store_release(&ring->r.tail, ctx->cached_cq_tail);
+
+		/*
+		 * Write side barrier of tail update, app has read side. See
+		 * comment at the top of this file.
+		 */
+		smp_wmb();
+
+		if (wq_has_sleeper(&ctx->cq_wait))
+			wake_up_interruptible(&ctx->cq_wait);
+	}
+}
+
+static struct io_uring_cqe *io_get_cqring(struct io_ring_ctx *ctx)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	unsigned tail;
+
+	tail = ctx->cached_cq_tail;
+	/* See comment at the top of the file */
+	smp_rmb();
+	if (tail - READ_ONCE(ring->r.head) == ctx->cq_entries)
+		return NULL;
+
+	ctx->cached_cq_tail++;
+	return &ring->cqes[tail & ctx->cq_mask];
+}
+
+static void io_cqring_fill_event(struct io_ring_ctx *ctx, u64 ki_user_data,
+				 long res)
+{
+	struct io_uring_cqe *cqe;
+
+	/*
+	 * If we can't get a cq entry, userspace overflowed the
+	 * submission (by quite a lot). Increment the overflow count in
+	 * the ring.
+	 */
+	cqe = io_get_cqring(ctx);
+	if (cqe) {
+		WRITE_ONCE(cqe->user_data, ki_user_data);
+		WRITE_ONCE(cqe->res, res);
+		WRITE_ONCE(cqe->flags, 0);
+	} else {
+		unsigned overflow = READ_ONCE(ctx->cq_ring->overflow);
+
+		WRITE_ONCE(ctx->cq_ring->overflow, overflow + 1);
+	}
+}
+
+static void io_cqring_ev_posted(struct io_ring_ctx *ctx)
+{
+	if (wq_has_sleeper(&ctx->wait))
+		wake_up(&ctx->wait);
+}
+
+static void io_cqring_add_event(struct io_ring_ctx *ctx, u64 user_data,
+				long res)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	io_cqring_fill_event(ctx, user_data, res);
+	io_commit_cqring(ctx);
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	io_cqring_ev_posted(ctx);
+}
+
+static struct io_kiocb *io_get_req(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	if (!percpu_ref_tryget(&ctx->refs))
+		return NULL;
+
+	req = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (unlikely(!req)) {
+		percpu_ref_put(&ctx->refs);
+		return NULL;
+	}
+
+	req->file = NULL;
+	req->ctx = ctx;
+	INIT_LIST_HEAD(&req->list);
+	req->task = NULL;
+	refcount_set(&req->refs, 1);
+	req->flags = 0;
+	req->result = 0;
+	return req;
+}
+
+static void io_put_req(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (!refcount_dec_and_test(&req->refs))
+		return;
+
+	if (req->file)
+		fput(req->file);
+	if (req->task)
+		put_task_struct(req->task);
+	kmem_cache_free(req_cachep, req);
+	percpu_ref_put(&ctx->refs);
+}
+
+/* Complete @req with @res and drop the submission reference */
+static void io_req_complete(struct io_kiocb *req, long res)
+{
+	io_cqring_add_event(req->ctx, req->user_data, res);
+	io_put_req(req);
+}
+
+static void io_kiocb_end_write(struct kiocb *kiocb)
+{
+	if (kiocb->ki_flags & IOCB_WRITE) {
+		struct inode *inode = file_inode(kiocb->ki_filp);
+
+		/*
+		 * Tell lockdep we inherited freeze protection from submission
+		 * thread.
+		 */
+		if (S_ISREG(inode->i_mode))
+			__sb_writers_acquired(inode->i_sb, SB_FREEZE_WRITE);
+		file_end_write(kiocb->ki_filp);
+	}
+}
+
+static void io_complete_rw(struct kiocb *kiocb, long res, long res2)
+{
+	struct io_kiocb *req = container_of(kiocb, struct io_kiocb, rw);
+
+	io_kiocb_end_write(kiocb);
+	io_req_complete(req, res);
+}
+
+/*
+ * Sockets, pipes and the like can wait for readiness through ->poll, so a
+ * nonblocking attempt that fails is retried once the file is ready rather
+ * than tying up a worker that sleeps in the file's own waitqueue.
+ */
+static bool io_file_pollable(struct file *file)
+{
+	umode_t mode = file_inode(file)->i_mode;
+
+	return file->f_op->poll && !S_ISREG(mode) && !S_ISBLK(mode);
+}
+
+static __poll_t io_file_poll(struct file *file, struct poll_table_struct *pt)
+{
+	if (unlikely(!file->f_op->poll))
+		return DEFAULT_POLLMASK;
+	return file->f_op->poll(file, pt);
+}
+
+static int io_prep_rw(struct io_kiocb *req, bool force_nonblock)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct kiocb *kiocb = &req->rw;
+	int ret;
+
+	if (unlikely(sqe->ioprio))
+		return -EINVAL;
+
+	kiocb->ki_pos = sqe->off;
+	kiocb->ki_flags = iocb_flags(kiocb->ki_filp);
+	kiocb->ki_hint = file_write_hint(kiocb->ki_filp);
+	ret = kiocb_set_rw_flags(kiocb, sqe->rw_flags);
+	if (unlikely(ret))
+		return ret;
+
+	/* the application asked for -EAGAIN rather than waiting */
+	if (kiocb->ki_flags & IOCB_NOWAIT)
+		req->flags |= REQ_F_NOWAIT;
+
+	if (force_nonblock) {
+		/*
+		 * Files that can't honour IOCB_NOWAIT go to a worker, unless
+		 * poll already reported them ready or they're O_NONBLOCK.
+		 */
+		if (kiocb->ki_filp->f_mode & FMODE_NOWAIT)
+			kiocb->ki_flags |= IOCB_NOWAIT;
+		else if (!(req->flags & (REQ_F_POLLED | REQ_F_NOWAIT)))
+			return -EAGAIN;
+	}
+
+	kiocb->ki_complete = io_complete_rw;
+	return 0;
+}
+
+static inline void io_rw_done(struct kiocb *kiocb, ssize_t ret)
+{
+	switch (ret) {
+	case -EIOCBQUEUED:
+		break;
+	case -ERESTARTSYS:
+	case -ERESTARTNOINTR:
+	case -ERESTARTNOHAND:
+	case -ERESTART_RESTARTBLOCK:
+		/*
+		 * We can't just restart the syscall, since previously
+		 * submitted sqes may already be in progress. Just fail this
+		 * IO with EINTR.
+		 */
+		ret = -EINTR;
+		/* fall through */
+	default:
+		kiocb->ki_complete(kiocb, ret, 0);
+	}
+}
+
+static int io_import_iovec(struct io_ring_ctx *ctx, int rw,
+			   const struct io_uring_sqe *sqe,
+			   struct iovec **iovec, struct iov_iter *iter)
+{
+	void __user *buf = u64_to_user_ptr(sqe->addr);
+
+#ifdef CONFIG_COMPAT
+	if (ctx->compat)
+		return compat_import_iovec(rw, buf, sqe->len, UIO_FASTIOV,
+						iovec, iter);
+#endif
+
+	return import_iovec(rw, buf, sqe->len, UIO_FASTIOV, iovec, iter);
+}
+
+static bool io_retry_async(struct io_kiocb *req, bool force_nonblock,
+			   ssize_t ret)
+{
+	return force_nonblock && ret == -EAGAIN &&
+		!(req->flags & REQ_F_NOWAIT);
+}
+
+/*
+ * The page a buffered read was waiting on got unlocked, reissue the read
+ * from a worker.  It still doesn't block on the page cache, so a read that
+ * misses again just queues itself on the next page.
+ */
+static int io_async_buf_func(struct wait_queue_entry *wait, unsigned mode,
+			     int sync, void *arg)
+{
+	struct wait_page_queue *wpq = container_of(wait, struct wait_page_queue,
+							wait);
+	struct io_kiocb *req = wait->private;
+	struct wait_page_key *key = arg;
+	int ret;
+
+	ret = wake_page_match(wpq, key);
+	if (ret != 1)
+		return ret;
+
+	list_del_init(&wait->entry);
+
+	req->flags |= REQ_F_POLLED;
+	INIT_WORK(&req->work, io_sq_wq_submit_work);
+	queue_work(req->ctx->sqo_wq, &req->work);
+	return 1;
+}
+
+/*
+ * A nonblocking buffered read came up short or would block on I/O.  For
+ * files that support it, let the read start I/O and wait for pages to
+ * come in via the page lock waitqueue instead of using a blocking worker.
+ */
+static bool io_rw_should_retry(struct io_kiocb *req, bool force_nonblock,
+			       ssize_t ret, struct iov_iter *iter)
+{
+	struct kiocb *kiocb = &req->rw;
+
+	if (!force_nonblock || (req->flags & REQ_F_NOWAIT))
+		return false;
+	if (ret != -EAGAIN && !(ret > 0 && iov_iter_count(iter)))
+		return false;
+	if (!(kiocb->ki_filp->f_mode & FMODE_BUF_RASYNC) ||
+	    (kiocb->ki_flags & IOCB_DIRECT))
+		return false;
+
+	init_waitqueue_func_entry(&req->wpq.wait, io_async_buf_func);
+	req->wpq.wait.private = req;
+	kiocb->ki_waitq = &req->wpq;
+	kiocb->ki_flags &= ~IOCB_NOWAIT;
+	kiocb->ki_flags |= IOCB_WAITQ;
+	return true;
+}
+
+static int io_read(struct io_kiocb *req, bool force_nonblock)
+{
+	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
+	struct kiocb *kiocb = &req->rw;
+	struct iov_iter iter;
+	struct file *file;
+	ssize_t ret;
+
+	ret = io_prep_rw(req, force_nonblock);
+	if (ret)
+		return ret;
+	file = kiocb->ki_filp;
+
+	if (unlikely(!(file->f_mode & FMODE_READ)))
+		return -EBADF;
+	if (unlikely(!file->f_op->read_iter))
+		return -EINVAL;
+
+	ret = io_import_iovec(req->ctx, READ, &req->sqe, &iovec, &iter);
+	if (ret)
+		return ret;
+
+	/* pick up where an earlier attempt that had to wait left off */
+	if (req->result) {
+		kiocb->ki_pos += req->result;
+		iov_iter_advance(&iter, req->result);
+	}
+
+	ret = rw_verify_area(READ, file, &kiocb->ki_pos, iov_iter_count(&iter));
+	if (!ret) {
+		ssize_t ret2;
+
+		ret2 = call_read_iter(file, kiocb, &iter);
+		if (io_rw_should_retry(req, force_nonblock, ret2, &iter)) {
+			do {
+				if (ret2 > 0)
+					req->result += ret2;
+				ret2 = call_read_iter(file, kiocb, &iter);
+			} while (ret2 > 0 && iov_iter_count(&iter));
+
+			/* the page lock callback will reissue the read */
+			if (ret2 == -EIOCBQUEUED)
+				goto out_free;
+		}
+
+		if (io_retry_async(req, force_nonblock, ret2)) {
+			ret = -EAGAIN;
+		} else {
+			/* report what was read before a later error */
+			if (req->result)
+				ret2 = ret2 > 0 ? ret2 + req->result : req->result;
+			io_rw_done(kiocb, ret2);
+		}
+	}
+out_free:
+	kfree(iovec);
+	return ret;
+}
+
+static int io_write(struct io_kiocb *req, bool force_nonblock)
+{
+	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
+	struct kiocb *kiocb = &req->rw;
+	struct iov_iter iter;
+	struct inode *inode;
+	struct file *file;
+	ssize_t ret;
+
+	ret = io_prep_rw(req, force_nonblock);
+	if (ret)
+		return ret;
+	file = kiocb->ki_filp;
+	inode = file_inode(file);
+
+	if (unlikely(!(file->f_mode & FMODE_WRITE)))
+		return -EBADF;
+	if (unlikely(!file->f_op->write_iter))
+		return -EINVAL;
+
+	/* buffered writes to files and block devices don't support NOWAIT */
+	if (force_nonblock && !(kiocb->ki_flags & IOCB_DIRECT) &&
+	    (S_ISREG(inode->i_mode) || S_ISBLK(inode->i_mode)))
+		return -EAGAIN;
+
+	ret = io_import_iovec(req->ctx, WRITE, &req->sqe, &iovec, &iter);
+	if (ret)
+		return ret;
+
+	ret = rw_verify_area(WRITE, file, &kiocb->ki_pos, iov_iter_count(&iter));
+	if (!ret) {
+		ssize_t ret2;
+
+		/*
+		 * Open-code file_start_write here to grab freeze protection,
+		 * which will be released by another thread in
+		 * io_complete_rw().  Fool lockdep by telling it the lock got
+		 * released so that it doesn't complain about the held lock when
+		 * we return to userspace.
+		 */
+		if (S_ISREG(inode->i_mode)) {
+			if (!__sb_start_write(inode->i_sb, SB_FREEZE_WRITE,
+					      !force_nonblock)) {
+				ret = -EAGAIN;
+				goto out_free;
+			}
+			__sb_writers_release(inode->i_sb, SB_FREEZE_WRITE);
+		}
+		kiocb->ki_flags |= IOCB_WRITE;
+
+		ret2 = call_write_iter(file, kiocb, &iter);
+		if (!io_retry_async(req, force_nonblock, ret2)) {
+			io_rw_done(kiocb, ret2);
+		} else {
+			io_kiocb_end_write(kiocb);
+			ret = -EAGAIN;
+		}
+	}
+out_free:
+	kfree(iovec);
+	return ret;
+}
+
+/*
+ * IORING_OP_NOP just posts a completion event, nothing else.
+ */
+static int io_nop(struct io_kiocb *req)
+{
+	io_req_complete(req, 0);
+	return 0;
+}
+
+static int io_fsync(struct io_kiocb *req, bool force_nonblock)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	loff_t end = sqe->off + sqe->len;
+	int ret;
+
+	if (unlikely(sqe->addr || sqe->ioprio))
+		return -EINVAL;
+	if (unlikely(sqe->fsync_flags & ~IORING_FSYNC_DATASYNC))
+		return -EINVAL;
+	if (unlikely(!req->file->f_op->fsync))
+		return -EINVAL;
+
+	/* fsync always requires a blocking context */
+	if (force_nonblock)
+		return -EAGAIN;
+
+	ret = vfs_fsync_range(req->file, sqe->off, end > 0 ? end : LLONG_MAX,
+				sqe->fsync_flags & IORING_FSYNC_DATASYNC);
+	io_req_complete(req, ret);
+	return 0;
+}
+
+static int io_sendrecv_prep(struct io_kiocb *req, bool force_nonblock,
+			    struct socket **sock, unsigned int *flags)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	int ret;
+
+	if (unlikely(sqe->ioprio || sqe->off || sqe->len))
+		return -EINVAL;
+
+	*sock = sock_from_file(req->file, &ret);
+	if (!*sock)
+		return ret;
+
+	*flags = sqe->msg_flags;
+	if (*flags & MSG_CMSG_COMPAT)
+		return -EINVAL;
+
+	if (*flags & MSG_DONTWAIT)
+		req->flags |= REQ_F_NOWAIT;
+	else if (force_nonblock)
+		*flags |= MSG_DONTWAIT;
+
+#ifdef CONFIG_COMPAT
+	if (req->ctx->compat)
+		*flags |= MSG_CMSG_COMPAT;
+#endif
+	return 0;
+}
+
+static int io_sendmsg(struct io_kiocb *req, bool force_nonblock)
+{
+	struct user_msghdr __user *msg = u64_to_user_ptr(req->sqe.addr);
+	struct socket *sock;
+	unsigned int flags;
+	long ret;
+
+	ret = io_sendrecv_prep(req, force_nonblock, &sock, &flags);
+	if (ret)
+		return ret;
+
+	ret = __sys_sendmsg_sock(sock, msg, flags);
+	if (io_retry_async(req, force_nonblock, ret))
+		return -EAGAIN;
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	io_req_complete(req, ret);
+	return 0;
+}
+
+static int io_recvmsg(struct io_kiocb *req, bool force_nonblock)
+{
+	struct user_msghdr __user *msg = u64_to_user_ptr(req->sqe.addr);
+	struct socket *sock;
+	unsigned int flags;
+	long ret;
+
+	ret = io_sendrecv_prep(req, force_nonblock, &sock, &flags);
+	if (ret)
+		return ret;
+
+	ret = __sys_recvmsg_sock(sock, msg, flags);
+	if (io_retry_async(req, force_nonblock, ret))
+		return -EAGAIN;
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	io_req_complete(req, ret);
+	return 0;
+}
+
+/*
+ * The new file descriptor is installed in current->files, which for retries
+ * from a worker is the submitter's table borrowed by io_sq_wq_submit_work().
+ */
+static int io_accept(struct io_kiocb *req, bool force_nonblock)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct sockaddr __user *addr;
+	int __user *addr_len;
+	int ret;
+
+	if (unlikely(sqe->ioprio || sqe->len))
+		return -EINVAL;
+
+	addr = u64_to_user_ptr(sqe->addr);
+	addr_len = u64_to_user_ptr(sqe->off);
+
+	ret = __sys_accept4_file(req->file, force_nonblock ? O_NONBLOCK : 0,
+				 addr, addr_len, sqe->accept_flags);
+	if (io_retry_async(req, force_nonblock, ret))
+		return -EAGAIN;
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	io_req_complete(req, ret);
+	return 0;
+}
+
+struct io_poll_table {
+	struct poll_table_struct pt;
+	struct io_kiocb *req;
+	int error;
+};
+
+static void io_poll_queue_proc(struct file *file, struct wait_queue_head *head,
+			       struct poll_table_struct *p)
+{
+	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
+
+	/* multiple wait queues per file are not supported */
+	if (unlikely(pt->req->poll.head)) {
+		pt->error = -EINVAL;
+		return;
+	}
+
+	pt->error = 0;
+	pt->req->poll.head = head;
+	add_wait_queue(head, &pt->req->poll.wait);
+}
+
+static void io_poll_remove_one(struct io_kiocb *req)
+{
+	struct io_poll_iocb *poll = &req->poll;
+
+	spin_lock(&poll->head->lock);
+	WRITE_ONCE(poll->canceled, true);
+	if (!list_empty(&poll->wait.entry)) {
+		list_del_init(&poll->wait.entry);
+		queue_work(req->ctx->sqo_wq, &req->work);
+	}
+	spin_unlock(&poll->head->lock);
+
+	list_del_init(&req->list);
+}
+
+static void io_poll_remove_all(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	spin_lock_irq(&ctx->completion_lock);
+	while (!list_empty(&ctx->cancel_list)) {
+		req = list_first_entry(&ctx->cancel_list, struct io_kiocb, list);
+		io_poll_remove_one(req);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+}
+
+static void io_poll_complete(struct io_ring_ctx *ctx, struct io_kiocb *req,
+			     __poll_t mask)
+{
+	req->poll.done = true;
+	io_cqring_fill_event(ctx, req->user_data, mangle_poll(mask));
+	io_commit_cqring(ctx);
+}
+
+static void io_poll_complete_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_poll_iocb *poll = &req->poll;
+	struct poll_table_struct pt = { ._key = poll->events };
+	struct io_ring_ctx *ctx = req->ctx;
+	__poll_t mask = 0;
+
+	if (!READ_ONCE(poll->canceled))
+		mask = io_file_poll(poll->file, &pt) & poll->events;
+
+	/*
+	 * io_poll_remove_one() cancels under the completion lock, so the
+	 * canceled check has to be redone with it held.  A spurious wakeup
+	 * goes back on the waitqueue, still on the cancel list.
+	 */
+	spin_lock_irq(&ctx->completion_lock);
+	if (!mask && !READ_ONCE(poll->canceled)) {
+		add_wait_queue(poll->head, &poll->wait);
+		spin_unlock_irq(&ctx->completion_lock);
+		return;
+	}
+	list_del_init(&req->list);
+	if (READ_ONCE(poll->canceled)) {
+		poll->done = true;
+		io_cqring_fill_event(ctx, req->user_data, -ECANCELED);
+		io_commit_cqring(ctx);
+	} else {
+		io_poll_complete(ctx, req, mask);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	io_cqring_ev_posted(ctx);
+	io_put_req(req);
+}
+
+/*
+ * The file a request was parked on became ready: take it off the cancel
+ * list and issue it again, still without blocking where the file allows.
+ */
+static void io_poll_retry_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_ring_ctx *ctx = req->ctx;
+	bool canceled;
+
+	spin_lock_irq(&ctx->completion_lock);
+	list_del_init(&req->list);
+	canceled = READ_ONCE(req->poll.canceled);
+	spin_unlock_irq(&ctx->completion_lock);
+
+	if (canceled) {
+		io_req_complete(req, -ECANCELED);
+		return;
+	}
+
+	/* the poll state is dead from here on, ->rw reuses its space */
+	req->flags &= ~REQ_F_POLL_RETRY;
+	req->flags |= REQ_F_POLLED;
+	INIT_WORK(&req->work, io_sq_wq_submit_work);
+	io_sq_wq_submit_work(&req->work);
+}
+
+static int io_poll_wake(struct wait_queue_entry *wait, unsigned mode, int sync,
+			void *key)
+{
+	struct io_poll_iocb *poll = container_of(wait, struct io_poll_iocb,
+							wait);
+	struct io_kiocb *req = container_of(poll, struct io_kiocb, poll);
+	struct io_ring_ctx *ctx = req->ctx;
+	__poll_t mask = key_to_poll(key);
+	unsigned long flags;
+
+	/* for instances that support it check for an event match first: */
+	if (mask && !(mask & poll->events))
+		return 0;
+
+	list_del_init(&poll->wait.entry);
+
+	/*
+	 * POLL_ADD requests that are fully armed can be completed right here
+	 * if the completion lock is uncontended, everything else goes through
+	 * the work item.
+	 */
+	if (mask && !(req->flags & REQ_F_POLL_RETRY) &&
+	    spin_trylock_irqsave(&ctx->completion_lock, flags)) {
+		if (!list_empty(&req->list)) {
+			list_del_init(&req->list);
+			io_poll_complete(ctx, req, mask);
+			spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+			io_cqring_ev_posted(ctx);
+			io_put_req(req);
+			return 1;
+		}
+		spin_unlock_irqrestore(&ctx->completion_lock, flags);
+	}
+
+	queue_work(ctx->sqo_wq, &req->work);
+	return 1;
+}
+
+/*
+ * Wait for @events on the request's file.  For IORING_OP_POLL_ADD the
+ * request completes with the mask, for a retry the request is reissued by
+ * io_poll_retry_work() once the file is ready.
+ */
+static int io_poll_arm(struct io_kiocb *req, __poll_t events, bool retry)
+{
+	struct io_poll_iocb *poll = &req->poll;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_poll_table ipt;
+	bool cancel = false;
+	__poll_t mask;
+
+	if (retry) {
+		req->flags |= REQ_F_POLL_RETRY;
+		INIT_WORK(&req->work, io_poll_retry_work);
+	} else {
+		INIT_WORK(&req->work, io_poll_complete_work);
+	}
+
+	poll->events = events | EPOLLERR | EPOLLHUP;
+	poll->head = NULL;
+	poll->done = false;
+	poll->canceled = false;
+
+	ipt.pt._qproc = io_poll_queue_proc;
+	ipt.pt._key = poll->events;
+	ipt.req = req;
+	ipt.error = -EINVAL; /* same as no support for IOCB_CMD_POLL */
+
+	/* initialized the list so that we can do list_empty checks */
+	INIT_LIST_HEAD(&poll->wait.entry);
+	init_waitqueue_func_entry(&poll->wait, io_poll_wake);
+
+	/* a wakeup may complete the request while we're still arming it */
+	refcount_inc(&req->refs);
+
+	mask = io_file_poll(poll->file, &ipt.pt) & poll->events;
+
+	spin_lock_irq(&ctx->completion_lock);
+	if (likely(poll->head)) {
+		spin_lock(&poll->head->lock);
+		if (unlikely(list_empty(&poll->wait.entry))) {
+			if (ipt.error)
+				cancel = true;
+			ipt.error = 0;
+			mask = 0;
+		}
+		if (mask || ipt.error)
+			list_del_init(&poll->wait.entry);
+		else if (cancel)
+			WRITE_ONCE(poll->canceled, true);
+		else if (!poll->done) /* actually waiting for an event */
+			list_add_tail(&req->list, &ctx->cancel_list);
+		spin_unlock(&poll->head->lock);
+
+		/* raced with io_poll_remove_all(), nobody will cancel it later */
+		if (!list_empty(&req->list) && percpu_ref_is_dying(&ctx->refs))
+			io_poll_remove_one(req);
+	}
+	if (mask && !retry) { /* no async, we'd stolen it */
+		ipt.error = 0;
+		io_poll_complete(ctx, req, mask);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	if (mask) {
+		if (retry) {
+			/* ready already, reissue from the worker */
+			queue_work(ctx->sqo_wq, &req->work);
+			ipt.error = 0;
+		} else {
+			io_cqring_ev_posted(ctx);
+			io_put_req(req);
+		}
+	}
+
+	io_put_req(req);
+	return ipt.error;
+}
+
+static int io_poll_add(struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+
+	if (sqe->addr || sqe->ioprio || sqe->off || sqe->len)
+		return -EINVAL;
+
+	return io_poll_arm(req, demangle_poll(sqe->poll_events), false);
+}
+
+static int __io_submit_sqe(struct io_kiocb *req, bool force_nonblock)
+{
+	switch (req->sqe.opcode) {
+	case IORING_OP_NOP:
+		return io_nop(req);
+	case IORING_OP_READV:
+		return io_read(req, force_nonblock);
+	case IORING_OP_WRITEV:
+		return io_write(req, force_nonblock);
+	case IORING_OP_FSYNC:
+		return io_fsync(req, force_nonblock);
+	case IORING_OP_POLL_ADD:
+		return io_poll_add(req);
+	case IORING_OP_SENDMSG:
+		return io_sendmsg(req, force_nonblock);
+	case IORING_OP_RECVMSG:
+		return io_recvmsg(req, force_nonblock);
+	case IORING_OP_ACCEPT:
+		return io_accept(req, force_nonblock);
+	default:
+		return -EINVAL;
+	}
+}
+
+/* The readiness a request returning -EAGAIN should wait for, if any */
+static __poll_t io_req_poll_mask(struct io_kiocb *req)
+{
+	if (!io_file_pollable(req->file))
+		return 0;
+
+	switch (req->sqe.opcode) {
+	case IORING_OP_READV:
+	case IORING_OP_RECVMSG:
+	case IORING_OP_ACCEPT:
+		return EPOLLIN | EPOLLRDNORM;
+	case IORING_OP_WRITEV:
+	case IORING_OP_SENDMSG:
+		return EPOLLOUT | EPOLLWRNORM;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Queue a request that couldn't be issued without blocking.  Pollable
+ * files wait for readiness, anything else goes to a worker that may block.
+ */
+static void io_queue_async(struct io_kiocb *req)
+{
+	__poll_t mask = io_req_poll_mask(req);
+
+	if (mask && !io_poll_arm(req, mask, true))
+		return;
+
+	/* no usable waitqueue, let the worker block on it */
+	req->flags &= ~(REQ_F_POLL_RETRY | REQ_F_POLLED);
+	INIT_WORK(&req->work, io_sq_wq_submit_work);
+	queue_work(req->ctx->sqo_wq, &req->work);
+}
+
+static void io_sq_wq_submit_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_ring_ctx *ctx = req->ctx;
+	struct files_struct *files = NULL, *old_files = NULL;
+	bool force_nonblock = req->flags & REQ_F_POLLED;
+	const struct cred *old_cred;
+	int ret;
+
+	old_cred = override_creds(ctx->creds);
+
+	if (!mmget_not_zero(ctx->sqo_mm)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	use_mm(ctx->sqo_mm);
+
+	if (req->task) {
+		/* the submitter is gone, don't take a connection for nobody */
+		files = get_files_struct(req->task);
+		if (!files) {
+			ret = -ECANCELED;
+			goto out_mm;
+		}
+		task_lock(current);
+		old_files = current->files;
+		current->files = files;
+		task_unlock(current);
+	}
+
+	ret = __io_submit_sqe(req, force_nonblock);
+
+	if (files) {
+		task_lock(current);
+		current->files = old_files;
+		task_unlock(current);
+		put_files_struct(files);
+	}
+out_mm:
+	unuse_mm(ctx->sqo_mm);
+	mmput(ctx->sqo_mm);
+out:
+	revert_creds(old_cred);
+
+	if (ret == -EAGAIN && force_nonblock && !(req->flags & REQ_F_NOWAIT)) {
+		io_queue_async(req);
+		return;
+	}
+	if (ret)
+		io_req_complete(req, ret);
+}
+
+static void io_submit_sqe(struct io_ring_ctx *ctx, struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	int ret;
+
+	req->user_data = sqe->user_data;
+
+	/* no sqe flags are defined yet */
+	if (unlikely(sqe->flags)) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	if (sqe->opcode != IORING_OP_NOP) {
+		req->file = fget(sqe->fd);
+		if (unlikely(!req->file)) {
+			ret = -EBADF;
+			goto err;
+		}
+		/* an io_uring can't wait on itself */
+		if (unlikely(req->file->f_op == &io_uring_fops)) {
+			ret = -EBADF;
+			goto err;
+		}
+		if (io_file_pollable(req->file) &&
+		    (req->file->f_flags & O_NONBLOCK))
+			req->flags |= REQ_F_NOWAIT;
+	}
+
+	ret = __io_submit_sqe(req, true);
+	if (ret == -EAGAIN && !(req->flags & REQ_F_NOWAIT)) {
+		if (sqe->opcode == IORING_OP_ACCEPT) {
+			get_task_struct(current);
+			req->task = current;
+		}
+		io_queue_async(req);
+		return;
+	}
+	if (!ret)
+		return;
+err:
+	io_req_complete(req, ret);
+}
+
+static void io_commit_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+
+	if (ctx->cached_sq_head != READ_ONCE(ring->r.head)) {
+		/*
+		 * Ensure any loads from the SQEs are done at this point,
+		 * since once we write the new head, the application could
+		 * write new data to them.
+		 */
+		smp_store_release(&ring->r.head, ctx->cached_sq_head);
+
+		/*
+		 * write side barrier of head update, app has read side. See
+		 * comment at the top of this file
+		 */
+		smp_wmb();
+	}
+}
+
+/*
+ * Copy the next SQE the application has published into @sqe.  The copy
+ * means nothing in the request can change under us once it's been
+ * fetched, even though the app can reuse the slot right away.
+ */
+static bool io_get_sqring(struct io_ring_ctx *ctx, struct io_uring_sqe *sqe)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+	unsigned head;
+
+	/*
+	 * The cached sq head (or cq tail) serves two purposes:
+	 *
+	 * 1) allows us to batch the cost of updating the user visible
+	 *    head updates.
+	 * 2) allows the kernel side to track the head on its own, even
+	 *    though the application is the one updating it.
+	 */
+	head = ctx->cached_sq_head;
+	/* See comment at the top of this file */
+	smp_rmb();
+	while (head != READ_ONCE(ring->r.tail)) {
+		unsigned index = READ_ONCE(ring->array[head & ctx->sq_mask]);
+
+		ctx->cached_sq_head = ++head;
+		if (likely(index < ctx->sq_entries)) {
+			memcpy(sqe, &ctx->sq_sqes[index], sizeof(*sqe));
+			return true;
+		}
+
+		/* drop invalid entries */
+		WRITE_ONCE(ring->dropped, ring->dropped + 1);
+	}
+
+	return false;
+}
+
+static int io_ring_submit(struct io_ring_ctx *ctx, unsigned int to_submit)
+{
+	int i, submitted = 0;
+
+	for (i = 0; i < to_submit; i++) {
+		struct io_kiocb *req;
+
+		req = io_get_req(ctx);
+		if (unlikely(!req)) {
+			if (!submitted)
+				submitted = -EAGAIN;
+			break;
+		}
+		if (!io_get_sqring(ctx, &req->sqe)) {
+			io_put_req(req);
+			break;
+		}
+
+		io_submit_sqe(ctx, req);
+		submitted++;
+	}
+	io_commit_sqring(ctx);
+
+	return submitted;
+}
+
+static unsigned io_cqring_events(struct io_cq_ring *ring)
+{
+	return READ_ONCE(ring->r.tail) - READ_ONCE(ring->r.head);
+}
+
+/*
+ * Wait until events become available, if we don't already have some. The
+ * application must reap them itself, as they reside on the shared cq ring.
+ */
+static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
+			  const sigset_t __user *sig, size_t sigsz)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	sigset_t ksigmask, sigsaved;
+	DEFINE_WAIT(wait);
+	int ret = 0;
+
+	/* See comment at the top of this file */
+	smp_rmb();
+	if (io_cqring_events(ring) >= min_events)
+		return 0;
+
+	if (sig) {
+		if (sigsz != sizeof(sigset_t))
+			return -EINVAL;
+#ifdef CONFIG_COMPAT
+		if (in_compat_syscall()) {
+			if (get_compat_sigset(&ksigmask,
+					(const compat_sigset_t __user *)sig))
+				return -EFAULT;
+		} else
+#endif
+		if (copy_from_user(&ksigmask, sig, sizeof(ksigmask)))
+			return -EFAULT;
+		sigdelsetmask(&ksigmask, sigmask(SIGKILL) | sigmask(SIGSTOP));
+		sigprocmask(SIG_SETMASK, &ksigmask, &sigsaved);
+	}
+
+	for (;;) {
+		prepare_to_wait(&ctx->wait, &wait, TASK_INTERRUPTIBLE);
+		/* See comment at the top of this file */
+		smp_rmb();
+		if (io_cqring_events(ring) >= min_events)
+			break;
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		schedule();
+	}
+	finish_wait(&ctx->wait, &wait);
+
+	if (sig) {
+		if (signal_pending(current)) {
+			current->saved_sigmask = sigsaved;
+			set_restore_sigmask();
+		} else {
+			sigprocmask(SIG_SETMASK, &sigsaved, NULL);
+		}
+	}
+
+	return ret;
+}
+
+static void *io_mem_alloc(size_t size)
+{
+	gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN |
+				__GFP_NORETRY;
+
+	return alloc_pages_exact(size, gfp_flags);
+}
+
+/*
+ * The rings are mapped into the application with vm_insert_page(), which
+ * takes a reference on each page, so they stay valid while still mapped.
+ */
+static void io_mem_free(void *ptr, size_t size)
+{
+	if (ptr)
+		free_pages_exact(ptr, size);
+}
+
+static void io_ring_ctx_free(struct io_ring_ctx *ctx)
+{
+	if (ctx->sqo_wq)
+		destroy_workqueue(ctx->sqo_wq);
+	if (ctx->sqo_mm)
+		mmdrop(ctx->sqo_mm);
+	if (ctx->creds)
+		put_cred(ctx->creds);
+
+	io_mem_free(ctx->sq_ring, ctx->sq_ring_sz);
+	io_mem_free(ctx->sq_sqes, ctx->sq_sqes_sz);
+	io_mem_free(ctx->cq_ring, ctx->cq_ring_sz);
+
+	percpu_ref_exit(&ctx->refs);
+	kfree(ctx);
+}
+
+static __poll_t io_uring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	__poll_t mask = 0;
+
+	poll_wait(file, &ctx->cq_wait, wait);
+	/* See comment at the top of this file */
+	smp_rmb();
+	if (READ_ONCE(ctx->sq_ring->r.tail) - ctx->cached_sq_head !=
+	    ctx->sq_entries)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	if (READ_ONCE(ctx->cq_ring->r.head) != ctx->cached_cq_tail)
+		mask |= EPOLLIN | EPOLLRDNORM;
+
+	return mask;
+}
+
+/*
+ * Requests hold references on the ring, so the final free happens once the
+ * last of them completes.  Parked polls would never complete on their own,
+ * cancel them here.
+ */
+static int io_uring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	file->private_data = NULL;
+
+	mutex_lock(&ctx->uring_lock);
+	percpu_ref_kill(&ctx->refs);
+	mutex_unlock(&ctx->uring_lock);
+
+	io_poll_remove_all(ctx);
+	return 0;
+}
+
+static int io_uring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	loff_t offset = (loff_t) vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long sz = vma->vm_end - vma->vm_start;
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned long addr;
+	size_t ring_sz;
+	void *ptr;
+	int ret;
+
+	switch (offset) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		ring_sz = ctx->sq_ring_sz;
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sq_sqes;
+		ring_sz = ctx->sq_sqes_sz;
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		ring_sz = ctx->cq_ring_sz;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (sz > PAGE_ALIGN(ring_sz))
+		return -EINVAL;
+	/* the rings are shared with the kernel, a private COW copy is useless */
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTEXPAND;
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE) {
+		ret = vm_insert_page(vma, addr, virt_to_page(ptr));
+		if (ret)
+			return ret;
+		ptr += PAGE_SIZE;
+	}
+
+	return 0;
+}
+
+SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
+		u32, min_complete, u32, flags, const sigset_t __user *, sig,
+		size_t, sigsz)
+{
+	struct io_ring_ctx *ctx;
+	long ret = -EBADF;
+	int submitted = 0;
+	struct fd f;
+
+	if (flags & ~IORING_ENTER_GETEVENTS)
+		return -EINVAL;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	if (f.file->f_op != &io_uring_fops)
+		goto out_fput;
+
+	ret = -ENXIO;
+	ctx = f.file->private_data;
+	if (!percpu_ref_tryget(&ctx->refs))
+		goto out_fput;
+
+	ret = 0;
+	if (to_submit) {
+		/*
+		 * Addresses in the sqes are resolved in the submitter's mm
+		 * inline but in the ring owner's mm from the workers, so
+		 * they must be the same.
+		 */
+		ret = -EPERM;
+		if (current->mm != ctx->sqo_mm)
+			goto out_ctx;
+
+		to_submit = min(to_submit, ctx->sq_entries);
+
+		mutex_lock(&ctx->uring_lock);
+		submitted = io_ring_submit(ctx, to_submit);
+		mutex_unlock(&ctx->uring_lock);
+	}
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = min(min_complete, ctx->cq_entries);
+		ret = io_cqring_wait(ctx, min_complete, sig, sigsz);
+	}
+
+out_ctx:
+	percpu_ref_put(&ctx->refs);
+out_fput:
+	fdput(f);
+	return submitted ? submitted : ret;
+}
+
+static const struct file_operations io_uring_fops = {
+	.release	= io_uring_release,
+	.mmap		= io_uring_mmap,
+	.poll		= io_uring_poll,
+};
+
+static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
+				  struct io_uring_params *p)
+{
+	struct io_sq_ring *sq_ring;
+	struct io_cq_ring *cq_ring;
+
+	ctx->sq_ring_sz = sizeof(*sq_ring) + p->sq_entries * sizeof(u32);
+	sq_ring = io_mem_alloc(ctx->sq_ring_sz);
+	if (!sq_ring)
+		return -ENOMEM;
+
+	ctx->sq_ring = sq_ring;
+	sq_ring->ring_mask = p->sq_entries - 1;
+	sq_ring->ring_entries = p->sq_entries;
+	ctx->sq_mask = sq_ring->ring_mask;
+	ctx->sq_entries = sq_ring->ring_entries;
+
+	ctx->sq_sqes_sz = p->sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sq_sqes = io_mem_alloc(ctx->sq_sqes_sz);
+	if (!ctx->sq_sqes)
+		return -ENOMEM;
+
+	ctx->cq_ring_sz = sizeof(*cq_ring) +
+			  p->cq_entries * sizeof(struct io_uring_cqe);
+	cq_ring = io_mem_alloc(ctx->cq_ring_sz);
+	if (!cq_ring)
+		return -ENOMEM;
+
+	ctx->cq_ring = cq_ring;
+	cq_ring->ring_mask = p->cq_entries - 1;
+	cq_ring->ring_entries = p->cq_entries;
+	ctx->cq_mask = cq_ring->ring_mask;
+	ctx->cq_entries = cq_ring->ring_entries;
+	return 0;
+}
+
+static void io_fill_offsets(struct io_uring_params *p)
+{
+	memset(&p->sq_off, 0, sizeof(p->sq_off));
+	p->sq_off.head = offsetof(struct io_sq_ring, r.head);
+	p->sq_off.tail = offsetof(struct io_sq_ring, r.tail);
+	p->sq_off.ring_mask = offsetof(struct io_sq_ring, ring_mask);
+	p->sq_off.ring_entries = offsetof(struct io_sq_ring, ring_entries);
+	p->sq_off.flags = offsetof(struct io_sq_ring, flags);
+	p->sq_off.dropped = offsetof(struct io_sq_ring, dropped);
+	p->sq_off.array = offsetof(struct io_sq_ring, array);
+
+	memset(&p->cq_off, 0, sizeof(p->cq_off));
+	p->cq_off.head = offsetof(struct io_cq_ring, r.head);
+	p->cq_off.tail = offsetof(struct io_cq_ring, r.tail);
+	p->cq_off.ring_mask = offsetof(struct io_cq_ring, ring_mask);
+	p->cq_off.ring_entries = offsetof(struct io_cq_ring, ring_entries);
+	p->cq_off.overflow = offsetof(struct io_cq_ring, overflow);
+	p->cq_off.cqes = offsetof(struct io_cq_ring, cqes);
+}
+
+static int io_uring_create(unsigned entries, struct io_uring_params *p,
+			   struct io_uring_params __user *params)
+{
+	struct io_ring_ctx *ctx;
+	struct file *file;
+	int ret, fd;
+
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+
+	/*
+	 * Use twice as many entries for the CQ ring. It's possible for the
+	 * application to drive a higher depth than the size of the SQ ring,
+	 * since the sqes are only used at submission time. This allows for
+	 * some flexibility in overcommitting a bit.
+	 */
+	p->sq_entries = roundup_pow_of_two(entries);
+	p->cq_entries = 2 * p->sq_entries;
+
+	ctx = io_ring_ctx_alloc();
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->compat = in_compat_syscall();
+	ctx->creds = get_current_cred();
+	mmgrab(current->mm);
+	ctx->sqo_mm = current->mm;
+
+	ret = io_allocate_scq_urings(ctx, p);
+	if (ret)
+		goto err;
+
+	/* Do QD, or 2 * CPUS, whatever is smallest */
+	ret = -ENOMEM;
+	ctx->sqo_wq = alloc_workqueue("io_ring-wq", WQ_UNBOUND | WQ_FREEZABLE,
+			min(ctx->sq_entries, 2 * num_online_cpus()));
+	if (!ctx->sqo_wq)
+		goto err;
+
+	io_fill_offsets(p);
+	ret = -EFAULT;
+	if (copy_to_user(params, p, sizeof(*p)))
+		goto err;
+
+	fd = get_unused_fd_flags(O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		ret = fd;
+		goto err;
+	}
+
+	file = anon_inode_getfile("[io_uring]", &io_uring_fops, ctx,
+				  O_RDWR | O_CLOEXEC);
+	if (IS_ERR(file)) {
+		put_unused_fd(fd);
+		ret = PTR_ERR(file);
+		goto err;
+	}
+
+	fd_install(fd, file);
+	return fd;
+err:
+	io_ring_ctx_free(ctx);
+	return ret;
+}
+
+/*
+ * Sets up an aio uring context, and returns the fd. Applications asks for a
+ * ring size, we return the actual sq/cq ring sizes (among other things) in the
+ * params structure passed in.
+ */
+static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
+{
+	struct io_uring_params p;
+	int i;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++) {
+		if (p.resv[i])
+			return -EINVAL;
+	}
+
+	if (p.flags)
+		return -EINVAL;
+
+	return io_uring_create(entries, &p, params);
+}
+
+SYSCALL_DEFINE2(io_uring_setup, u32, entries,
+		struct io_uring_params __user *, params)
+{
+	return io_uring_setup(entries, params);
+}
+
+static int __init io_uring_init(void)
+{
+	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+	return 0;
+};
+__initcall(io_uring_init);
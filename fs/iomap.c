@@ -860,6 +860,7 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 	unsigned int blkbits = blksize_bits(bdev_logical_block_size(iomap->bdev));
 	unsigned int fs_block_size = i_blocksize(inode), pad;
 	unsigned int align = iov_iter_alignment(dio->submit.iter);
+	unsigned int max_pages = bdev_max_bio_pages(iomap->bdev);
 	struct iov_iter iter;
 	struct bio *bio;
 	bool need_zeroout = false;
@@ -914,7 +915,7 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 	iter = *dio->submit.iter;
 	iov_iter_truncate(&iter, length);
 
-	nr_pages = iov_iter_npages(&iter, BIO_MAX_PAGES);
+	nr_pages = iov_iter_npages(&iter, max_pages);
 	if (nr_pages <= 0)
 		return nr_pages;
 
@@ -926,7 +927,7 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 	}
 
 	do {
-		size_t n;
+		size_t count, max_bytes, n;
 		if (dio->error) {
 			iov_iter_revert(dio->submit.iter, copied);
 			return 0;
@@ -940,11 +941,23 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 		bio->bi_private = dio;
 		bio->bi_end_io = iomap_dio_bio_end_io;
 
+		/*
+		 * Build the bio no larger than the queue takes in one piece,
+		 * so it does not have to be split again below us.
+		 */
+		count = iov_iter_count(&iter);
+		max_bytes = (size_t)bdev_max_bio_sectors(iomap->bdev,
+				bio->bi_iter.bi_sector) << 9;
+		max_bytes &= ~((size_t)(1 << blkbits) - 1);
+		if (max_bytes)
+			iov_iter_truncate(&iter, max_bytes);
+
 		ret = bio_iov_iter_get_pages(bio, &iter);
 		if (unlikely(ret)) {
 			bio_put(bio);
 			return copied ? copied : ret;
 		}
+		iov_iter_reexpand(&iter, count - bio->bi_iter.bi_size);
 
 		n = bio->bi_iter.bi_size;
 		if (dio->flags & IOMAP_DIO_WRITE) {
@@ -966,7 +979,7 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 		pos += n;
 		copied += n;
 
-		nr_pages = iov_iter_npages(&iter, BIO_MAX_PAGES);
+		nr_pages = iov_iter_npages(&iter, max_pages);
 
 		atomic_inc(&dio->ref);
 
@@ -351,8 +351,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int flags;
 	int err;
 	unsigned long long blocknr;
-	ktime_t start_time;
-	u64 commit_time;
+	ktime_t start_time, flush_start;
+	u64 commit_time, flush_time;
 	char *tagp = NULL;
 	journal_block_tag_t *tag = NULL;
 	int space_left = 0;
@@ -855,6 +855,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	commit_transaction->t_state = T_COMMIT_JFLUSH;
 	write_unlock(&journal->j_state_lock);
 
+	flush_start = ktime_get();
 	if (!jbd2_has_feature_async_commit(journal)) {
 		err = journal_submit_commit_record(journal, commit_transaction,
 						&cbh, crc32_sum);
@@ -867,10 +868,20 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	    journal->j_flags & JBD2_BARRIER) {
 		blkdev_issue_flush(journal->j_dev, GFP_NOFS, NULL);
 	}
+	flush_time = ktime_to_ns(ktime_sub(ktime_get(), flush_start));
 
 	if (err)
 		jbd2_journal_abort(journal, err);
 
+	/*
+	 * The transaction is stable now: let fsync waiters go rather than
+	 * holding them while we refile buffers and run the commit callback.
+	 */
+	write_lock(&journal->j_state_lock);
+	journal->j_durable_sequence = commit_transaction->t_tid;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_wait_done_commit);
+
 	/*
 	 * Now disk caches for filesystem device are flushed so we are safe to
 	 * erase checkpointed transactions from the log by updating journal
@@ -1086,6 +1097,11 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 				journal->j_average_commit_time*3) / 4;
 	else
 		journal->j_average_commit_time = commit_time;
+	if (likely(journal->j_average_flush_time))
+		journal->j_average_flush_time = (flush_time +
+				journal->j_average_flush_time*3) / 4;
+	else
+		journal->j_average_flush_time = flush_time;
 
 	write_unlock(&journal->j_state_lock);
 
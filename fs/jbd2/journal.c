@@ -41,6 +41,7 @@
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
 #include <linux/sched/mm.h>
+#include <linux/hrtimer.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/jbd2.h>
@@ -101,6 +102,7 @@ EXPORT_SYMBOL(jbd2_inode_cache);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
 static int jbd2_journal_create_slab(size_t slab_size);
+static int jbd2_write_superblock(journal_t *journal, int write_flags);
 
 #ifdef CONFIG_JBD2_DEBUG
 void __jbd2_debug(int level, const char *file, const char *func,
@@ -734,6 +736,31 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid)
 	return err;
 }
 
+/*
+ * Wait for the commit record of the transaction with the given tid to be
+ * on stable storage.  Unlike jbd2_log_wait_commit() this doesn't wait for
+ * the commit to be cleaned up, so the transaction's buffers may not have
+ * been refiled yet; that is enough for fsync.
+ */
+static int jbd2_log_wait_durable(journal_t *journal, tid_t tid)
+{
+	int err = 0;
+
+	read_lock(&journal->j_state_lock);
+	while (tid_gt(tid, journal->j_durable_sequence)) {
+		read_unlock(&journal->j_state_lock);
+		wake_up(&journal->j_wait_commit);
+		wait_event(journal->j_wait_done_commit,
+				!tid_gt(tid, journal->j_durable_sequence));
+		read_lock(&journal->j_state_lock);
+	}
+	read_unlock(&journal->j_state_lock);
+
+	if (unlikely(is_journal_aborted(journal)))
+		err = -EIO;
+	return err;
+}
+
 /* Return 1 when transaction with given tid has already committed. */
 int jbd2_transaction_committed(journal_t *journal, tid_t tid)
 {
@@ -752,13 +779,45 @@ int jbd2_transaction_committed(journal_t *journal, tid_t tid)
 EXPORT_SYMBOL(jbd2_transaction_committed);
 
 /*
- * When this function returns the transaction corresponding to tid
- * will be completed.  If the transaction has currently running, start
- * committing that transaction before waiting for it to complete.  If
- * the transaction id is stale, it is by definition already completed,
- * so just return SUCCESS.
+ * Group commit: before kicking off the commit of a transaction somebody
+ * wants to wait for, give other tasks about as long as it takes the device
+ * to flush a commit record to join in, so that a single commit and cache
+ * flush carries all of their fsyncs.  The window is the measured flush
+ * latency bounded by the min/max_batch_time tunables, and counts from the
+ * start of the transaction, so old ones are committed without delay.  As
+ * in jbd2_journal_stop(), a task that keeps syncing on its own doesn't
+ * wait for itself.
  */
-int jbd2_complete_transaction(journal_t *journal, tid_t tid)
+static void jbd2_group_commit_delay(journal_t *journal, ktime_t start_time)
+{
+	u64 window, trans_time;
+	pid_t pid = current->pid;
+
+	if (!(journal->j_flags & JBD2_GROUP_COMMIT) ||
+	    !journal->j_max_batch_time)
+		return;
+	if (journal->j_last_sync_writer == pid)
+		return;
+	journal->j_last_sync_writer = pid;
+
+	read_lock(&journal->j_state_lock);
+	window = journal->j_average_flush_time;
+	read_unlock(&journal->j_state_lock);
+
+	window = max_t(u64, window, 1000*journal->j_min_batch_time);
+	window = min_t(u64, window, 1000*journal->j_max_batch_time);
+
+	trans_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
+	if (trans_time < window) {
+		ktime_t expires = ktime_add_ns(start_time, window);
+
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	}
+}
+
+static int __jbd2_complete_transaction(journal_t *journal, tid_t tid,
+				       bool durable)
 {
 	int	need_to_wait = 1;
 
@@ -766,8 +825,12 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid)
 	if (journal->j_running_transaction &&
 	    journal->j_running_transaction->t_tid == tid) {
 		if (journal->j_commit_request != tid) {
+			ktime_t start_time =
+				journal->j_running_transaction->t_start_time;
+
 			/* transaction not yet started, so request it */
 			read_unlock(&journal->j_state_lock);
+			jbd2_group_commit_delay(journal, start_time);
 			jbd2_log_start_commit(journal, tid);
 			goto wait_commit;
 		}
@@ -778,10 +841,36 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid)
 	if (!need_to_wait)
 		return 0;
 wait_commit:
+	if (durable)
+		return jbd2_log_wait_durable(journal, tid);
 	return jbd2_log_wait_commit(journal, tid);
 }
+
+/*
+ * When this function returns the transaction corresponding to tid
+ * will be completed.  If the transaction has currently running, start
+ * committing that transaction before waiting for it to complete.  If
+ * the transaction id is stale, it is by definition already completed,
+ * so just return SUCCESS.
+ */
+int jbd2_complete_transaction(journal_t *journal, tid_t tid)
+{
+	return __jbd2_complete_transaction(journal, tid, false);
+}
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Like jbd2_complete_transaction(), but return as soon as the transaction
+ * is safely in the log rather than when its commit has finished.  This
+ * is all fsync needs, and spares it the post-commit processing of the
+ * journal thread.
+ */
+int jbd2_fsync_transaction(journal_t *journal, tid_t tid)
+{
+	return __jbd2_complete_transaction(journal, tid, true);
+}
+EXPORT_SYMBOL(jbd2_fsync_transaction);
+
 /*
  * Log buffer allocation routines:
  */
@@ -886,6 +975,174 @@ void jbd2_descriptor_block_csum_set(journal_t *j, struct buffer_head *bh)
 	tail->t_checksum = cpu_to_be32(csum);
 }
 
+/*
+ * Fast commits.
+ *
+ * With the fast_commit feature the last s_num_fc_blks blocks of the journal
+ * are kept out of the log.  Instead of committing the whole running
+ * transaction, the filesystem can write a few blocks there describing the
+ * changes it needs to persist, in a format of its own.  Each block has a
+ * journal header with the tid of the running transaction and a block tail
+ * checksum; the blocks of a transaction are written from the start of the
+ * area in order.  Once the transaction commits normally they are stale,
+ * and recovery only hands the blocks of the first transaction missing from
+ * the log to j_fc_replay_callback, stopping at the first block that isn't
+ * one of them.
+ */
+
+/*
+ * Carve the fast commit area out of the end of the journal, recording it
+ * in the journal superblock.  Must be called when the log is empty, i.e.
+ * right after the journal has been loaded.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err = 0;
+
+	if (jbd2_has_feature_fast_commit(journal))
+		return 0;
+	if (!jbd2_journal_has_csum_v2or3(journal))
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_checkpoint_transactions ||
+	    journal->j_head != journal->j_first ||
+	    journal->j_tail != journal->j_first) {
+		err = -EBUSY;
+	} else if (num_fc_blks > (journal->j_last - journal->j_first) / 4) {
+		err = -ENOSPC;
+	} else {
+		journal->j_fc_last = journal->j_last;
+		journal->j_last -= num_fc_blks;
+		journal->j_fc_first = journal->j_last;
+		journal->j_free = journal->j_last - journal->j_first;
+	}
+	write_unlock(&journal->j_state_lock);
+	if (err)
+		return err;
+
+	lock_buffer(journal->j_sb_buffer);
+	sb->s_num_fc_blks = cpu_to_be32(num_fc_blks);
+	unlock_buffer(journal->j_sb_buffer);
+	if (!jbd2_journal_set_features(journal, 0, 0,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EINVAL;
+	return jbd2_write_superblock(journal, REQ_SYNC | REQ_FUA);
+}
+EXPORT_SYMBOL(jbd2_fc_init);
+
+/*
+ * Start a fast commit for the running transaction @tid.  Returns -EAGAIN
+ * when the transaction has to be committed normally instead: it is no
+ * longer running, its commit has been requested, or the journal has been
+ * flushed, in which case recovery wouldn't look at the area.  On success
+ * the caller must call jbd2_fc_end_commit().
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	int err = 0;
+
+	if (!jbd2_has_feature_fast_commit(journal))
+		return -EAGAIN;
+
+	mutex_lock(&journal->j_fc_mutex);
+	read_lock(&journal->j_state_lock);
+	if (is_journal_aborted(journal) ||
+	    (journal->j_flags & JBD2_FLUSHED) ||
+	    !journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid ||
+	    journal->j_commit_request == tid)
+		err = -EAGAIN;
+	read_unlock(&journal->j_state_lock);
+	if (err) {
+		mutex_unlock(&journal->j_fc_mutex);
+		return err;
+	}
+
+	if (journal->j_fc_tid != tid) {
+		journal->j_fc_tid = tid;
+		journal->j_fc_off = 0;
+	}
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/*
+ * Get the next block of the fast commit area, zeroed but for the header.
+ * Returns ERR_PTR(-ENOSPC) once the area is full.
+ */
+struct buffer_head *jbd2_fc_get_buf(journal_t *journal)
+{
+	struct buffer_head *bh;
+	unsigned long long blocknr;
+	journal_header_t *header;
+	int err;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return ERR_PTR(-ENOSPC);
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + journal->j_fc_off,
+				&blocknr);
+	if (err)
+		return ERR_PTR(err);
+
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return ERR_PTR(-ENOMEM);
+	journal->j_fc_off++;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	header = (journal_header_t *)bh->b_data;
+	header->h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	header->h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	header->h_sequence = cpu_to_be32(journal->j_fc_tid);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	return bh;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+/*
+ * Checksum and write out a fast commit block, and wait for it to be on
+ * stable storage along with whatever was written before it, on both the
+ * journal and the filesystem device.  Drops the reference to @bh.
+ */
+int jbd2_fc_write_buf(journal_t *journal, struct buffer_head *bh)
+{
+	int write_flags = REQ_SYNC;
+	int err = 0;
+
+	if (journal->j_flags & JBD2_BARRIER) {
+		if (journal->j_fs_dev != journal->j_dev)
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		write_flags |= REQ_PREFLUSH | REQ_FUA;
+	}
+
+	jbd2_descriptor_block_csum_set(journal, bh);
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	get_bh(bh);
+	submit_bh(REQ_OP_WRITE, write_flags, bh);
+	wait_on_buffer(bh);
+	if (unlikely(!buffer_uptodate(bh)))
+		err = -EIO;
+	put_bh(bh);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_write_buf);
+
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	mutex_unlock(&journal->j_fc_mutex);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
 /*
  * Return tid of the oldest transaction in the journal and block in the journal
  * where the transaction starts.
@@ -1031,6 +1288,8 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    jiffies_to_msecs(s->stats->run.rs_logging / s->stats->ts_tid));
 	seq_printf(seq, "  %lluus average transaction commit time\n",
 		   div_u64(s->journal->j_average_commit_time, 1000));
+	seq_printf(seq, "  %lluus average commit record flush time\n",
+		   div_u64(s->journal->j_average_flush_time, 1000));
 	seq_printf(seq, "  %lu handles per transaction\n",
 	    s->stats->run.rs_handle_count / s->stats->ts_tid);
 	seq_printf(seq, "  %lu blocks per transaction\n",
@@ -1147,6 +1406,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_reserved);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	mutex_init(&journal->j_fc_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	rwlock_init(&journal->j_state_lock);
@@ -1305,7 +1565,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = journal->j_last;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1323,6 +1583,7 @@ static int journal_reset(journal_t *journal)
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
+	journal->j_durable_sequence = journal->j_commit_sequence;
 
 	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
 
@@ -1638,6 +1899,20 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	/* The fast commit area isn't part of the log */
+	if (jbd2_has_feature_fast_commit(journal)) {
+		unsigned long num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+
+		if (num_fc_blks > (journal->j_last - journal->j_first) / 4) {
+			printk(KERN_ERR "JBD2: Invalid fast commit area size "
+			       "%lu\n", num_fc_blks);
+			return -EFSCORRUPTED;
+		}
+		journal->j_fc_last = journal->j_last;
+		journal->j_last -= num_fc_blks;
+		journal->j_fc_first = journal->j_last;
+	}
+
 	return 0;
 }
 
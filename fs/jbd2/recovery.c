@@ -190,6 +190,46 @@ static int jbd2_descriptor_block_csum_verify(journal_t *j, void *buf)
 	return provided == cpu_to_be32(calculated);
 }
 
+/*
+ * Hand the fast commit blocks of transaction @tid, the first one that
+ * isn't in the log, to the filesystem.  They were written in order from
+ * the start of the area, so the first block that doesn't belong to @tid or
+ * fails its checksum ends them.
+ */
+static int fc_do_replay(journal_t *journal, tid_t tid)
+{
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	journal_header_t *header;
+	int nr = 0, err = 0;
+
+	for (blocknr = journal->j_fc_first; blocknr < journal->j_fc_last;
+	     blocknr++) {
+		err = jread(&bh, journal, blocknr);
+		if (err)
+			break;
+
+		header = (journal_header_t *)bh->b_data;
+		if (header->h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    header->h_blocktype != cpu_to_be32(JBD2_FC_BLOCK) ||
+		    be32_to_cpu(header->h_sequence) != tid ||
+		    !jbd2_descriptor_block_csum_verify(journal, bh->b_data)) {
+			brelse(bh);
+			break;
+		}
+
+		err = journal->j_fc_replay_callback(journal, bh);
+		brelse(bh);
+		if (err)
+			break;
+		nr++;
+	}
+
+	jbd_debug(1, "JBD2: replayed %d fast commit blocks of transaction %u\n",
+		  nr, tid);
+	return err;
+}
+
 /*
  * Count the number of in-use tags in a journal descriptor block.
  */
@@ -276,6 +316,10 @@ int jbd2_journal_recover(journal_t *journal)
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
 
+	if (!err && jbd2_has_feature_fast_commit(journal) &&
+	    journal->j_fc_replay_callback)
+		err = fc_do_replay(journal, info.end_transaction);
+
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
 	journal->j_transaction_sequence = ++info.end_transaction;
@@ -369,6 +369,7 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 	struct buffer_head map_bh;
 	unsigned long first_logical_block = 0;
 	gfp_t gfp = readahead_gfp_mask(mapping);
+	LIST_HEAD(lru_pages);
 
 	map_bh.b_state = 0;
 	map_bh.b_size = 0;
@@ -377,18 +378,22 @@ mpage_readpages(struct address_space *mapping, struct list_head *pages,
 
 		prefetchw(&page->flags);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
+		if (add_to_page_cache_nolru(page, mapping,
 					page->index,
 					gfp)) {
-			bio = do_mpage_readpage(bio, page,
-					nr_pages - page_idx,
-					&last_block_in_bio, &map_bh,
-					&first_logical_block,
-					get_block, gfp);
+			put_page(page);
+			continue;
 		}
-		put_page(page);
+		/* Added to the LRU in one go below, with our reference */
+		list_add_tail(&page->lru, &lru_pages);
+		bio = do_mpage_readpage(bio, page,
+				nr_pages - page_idx,
+				&last_block_in_bio, &map_bh,
+				&first_logical_block,
+				get_block, gfp);
 	}
 	BUG_ON(!list_empty(pages));
+	lru_cache_add_list(&lru_pages);
 	if (bio)
 		mpage_bio_submit(REQ_OP_READ, 0, bio);
 	return 0;
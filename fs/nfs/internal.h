@@ -80,6 +80,7 @@ struct nfs_client_initdata {
 	size_t addrlen;
 	struct nfs_subversion *nfs_mod;
 	int proto;
+	unsigned int nconnect;
 	u32 minorversion;
 	struct net *net;
 	const struct rpc_timeout *timeparms;
@@ -92,6 +93,7 @@ struct nfs_parsed_mount_data {
 	int			flags;
 	unsigned int		rsize, wsize;
 	unsigned int		timeo, retrans;
+	unsigned int		nconnect;
 	unsigned int		acregmin, acregmax,
 				acdirmin, acdirmax;
 	unsigned int		namlen;
@@ -68,6 +68,8 @@
 #include "nfs.h"
 
 #define NFSDBG_FACILITY		NFSDBG_VFS
+
+#define NFS_MAX_CONNECTIONS	16
 #define NFS_TEXT_DATA		1
 
 #if IS_ENABLED(CONFIG_NFS_V3)
@@ -95,6 +97,7 @@ enum {
 	Opt_port,
 	Opt_rsize, Opt_wsize, Opt_bsize,
 	Opt_timeo, Opt_retrans,
+	Opt_nconnect,
 	Opt_acregmin, Opt_acregmax,
 	Opt_acdirmin, Opt_acdirmax,
 	Opt_actimeo,
@@ -158,6 +161,7 @@ static const match_table_t nfs_mount_option_tokens = {
 	{ Opt_bsize, "bsize=%s" },
 	{ Opt_timeo, "timeo=%s" },
 	{ Opt_retrans, "retrans=%s" },
+	{ Opt_nconnect, "nconnect=%s" },
 	{ Opt_acregmin, "acregmin=%s" },
 	{ Opt_acregmax, "acregmax=%s" },
 	{ Opt_acdirmin, "acdirmin=%s" },
@@ -677,6 +681,8 @@ static void nfs_show_mount_options(struct seq_file *m, struct nfs_server *nfss,
 
 	seq_printf(m, ",timeo=%lu", 10U * nfss->client->cl_timeout->to_initval / HZ);
 	seq_printf(m, ",retrans=%u", nfss->client->cl_timeout->to_retries);
+	if (clp->cl_nconnect > 0)
+		seq_printf(m, ",nconnect=%u", clp->cl_nconnect);
 	seq_printf(m, ",sec=%s", nfs_pseudoflavour_to_name(nfss->client->cl_auth->au_flavor));
 
 	if (version != 4)
@@ -1369,6 +1375,12 @@ static int nfs_parse_mount_options(char *raw,
 				goto out_invalid_value;
 			mnt->retrans = option;
 			break;
+		case Opt_nconnect:
+			if (nfs_get_option_ul_bound(args, &option,
+						    1, NFS_MAX_CONNECTIONS))
+				goto out_invalid_value;
+			mnt->nconnect = option;
+			break;
 		case Opt_acregmin:
 			if (nfs_get_option_ul(args, &option))
 				goto out_invalid_value;
@@ -2274,6 +2286,7 @@ nfs_remount(struct super_block *sb, int *flags, char *raw_data)
 	data->rsize = nfss->rsize;
 	data->wsize = nfss->wsize;
 	data->retrans = nfss->client->cl_timeout->to_retries;
+	data->nconnect = nfss->nfs_client->cl_nconnect;
 	data->selected_flavor = nfss->client->cl_auth->au_flavor;
 	data->acregmin = nfss->acregmin / HZ;
 	data->acregmax = nfss->acregmax / HZ;
@@ -73,10 +73,19 @@ enum {
 /* Checksum this amount of the request */
 #define RC_CSUMLEN		(256U)
 
+/* Reply cache counters, summed over all CPUs */
+struct nfsd_drc_stats {
+	unsigned int	hits;
+	unsigned int	misses;
+	unsigned int	nocache;
+	unsigned int	payload_misses;
+};
+
 int	nfsd_reply_cache_init(void);
 void	nfsd_reply_cache_shutdown(void);
 int	nfsd_cache_lookup(struct svc_rqst *);
 void	nfsd_cache_update(struct svc_rqst *, int, __be32 *);
 int	nfsd_reply_cache_stats_open(struct inode *, struct file *);
+void	nfsd_reply_cache_get_stats(struct nfsd_drc_stats *);
 
 #endif /* NFSCACHE_H */
@@ -15,6 +15,7 @@
 #include <linux/highmem.h>
 #include <linux/log2.h>
 #include <linux/hash.h>
+#include <linux/percpu_counter.h>
 #include <net/checksum.h>
 
 #include "nfsd.h"
@@ -32,7 +33,7 @@
 struct nfsd_drc_bucket {
 	struct list_head lru_head;
 	spinlock_t cache_lock;
-};
+} ____cacheline_aligned_in_smp;
 
 static struct nfsd_drc_bucket	*drc_hashtbl;
 static struct kmem_cache	*drc_slab;
@@ -45,18 +46,19 @@ static unsigned int		maskbits;
 static unsigned int		drc_hashsize;
 
 /*
- * Stats and other tracking of on the duplicate reply cache. All of these and
- * the "rc" fields in nfsdstats are protected by the cache_lock
+ * Stats and other tracking of on the duplicate reply cache. The ones that
+ * change on every request are per-CPU, so that the buckets, each under its
+ * own cache_lock, don't all bounce the same cachelines.
  */
 
 /* total number of entries */
-static atomic_t			num_drc_entries;
-
-/* cache misses due only to checksum comparison failures */
-static unsigned int		payload_misses;
+static struct percpu_counter	num_drc_entries;
 
 /* amount of memory (in bytes) currently consumed by the DRC */
-static unsigned int		drc_mem_usage;
+static struct percpu_counter	drc_mem_usage;
+
+/* hits, misses, uncached requests and checksum only misses */
+static DEFINE_PER_CPU(struct nfsd_drc_stats, drc_stats);
 
 /* longest hash chain seen */
 static unsigned int		longest_chain;
@@ -138,12 +140,12 @@ static void
 nfsd_reply_cache_free_locked(struct svc_cacherep *rp)
 {
 	if (rp->c_type == RC_REPLBUFF && rp->c_replvec.iov_base) {
-		drc_mem_usage -= rp->c_replvec.iov_len;
+		percpu_counter_sub(&drc_mem_usage, rp->c_replvec.iov_len);
 		kfree(rp->c_replvec.iov_base);
 	}
 	list_del(&rp->c_lru);
-	atomic_dec(&num_drc_entries);
-	drc_mem_usage -= sizeof(*rp);
+	percpu_counter_dec(&num_drc_entries);
+	percpu_counter_sub(&drc_mem_usage, sizeof(*rp));
 	kmem_cache_free(drc_slab, rp);
 }
 
@@ -162,13 +164,19 @@ int nfsd_reply_cache_init(void)
 	int status = 0;
 
 	max_drc_entries = nfsd_cache_size_limit();
-	atomic_set(&num_drc_entries, 0);
 	hashsize = nfsd_hashsize(max_drc_entries);
 	maskbits = ilog2(hashsize);
 
-	status = register_shrinker(&nfsd_reply_cache_shrinker);
+	status = percpu_counter_init(&num_drc_entries, 0, GFP_KERNEL);
 	if (status)
 		return status;
+	status = percpu_counter_init(&drc_mem_usage, 0, GFP_KERNEL);
+	if (status)
+		goto out_entries;
+
+	status = register_shrinker(&nfsd_reply_cache_shrinker);
+	if (status)
+		goto out_mem_usage;
 
 	drc_slab = kmem_cache_create("nfsd_drc", sizeof(struct svc_cacherep),
 					0, 0, NULL);
@@ -189,6 +197,11 @@ int nfsd_reply_cache_init(void)
 	drc_hashsize = hashsize;
 
 	return 0;
+out_mem_usage:
+	percpu_counter_destroy(&drc_mem_usage);
+out_entries:
+	percpu_counter_destroy(&num_drc_entries);
+	return status;
 out_nomem:
 	printk(KERN_ERR "nfsd: failed to allocate reply cache\n");
 	nfsd_reply_cache_shutdown();
@@ -216,6 +229,9 @@ void nfsd_reply_cache_shutdown(void)
 
 	kmem_cache_destroy(drc_slab);
 	drc_slab = NULL;
+
+	percpu_counter_destroy(&drc_mem_usage);
+	percpu_counter_destroy(&num_drc_entries);
 }
 
 /*
@@ -242,7 +258,8 @@ prune_bucket(struct nfsd_drc_bucket *b)
 		 */
 		if (rp->c_state == RC_INPROG)
 			continue;
-		if (atomic_read(&num_drc_entries) <= max_drc_entries &&
+		if (percpu_counter_read_positive(&num_drc_entries) <=
+		    max_drc_entries &&
 		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
 			break;
 		nfsd_reply_cache_free_locked(rp);
@@ -276,7 +293,7 @@ prune_cache_entries(void)
 static unsigned long
 nfsd_reply_cache_count(struct shrinker *shrink, struct shrink_control *sc)
 {
-	return atomic_read(&num_drc_entries);
+	return percpu_counter_read_positive(&num_drc_entries);
 }
 
 static unsigned long
@@ -325,7 +342,7 @@ nfsd_cache_match(struct svc_rqst *rqstp, __wsum csum, struct svc_cacherep *rp)
 		return false;
 	/* compare checksum of NFS data */
 	if (csum != rp->c_csum) {
-		++payload_misses;
+		this_cpu_inc(drc_stats.payload_misses);
 		return false;
 	}
 
@@ -365,12 +382,13 @@ nfsd_cache_search(struct nfsd_drc_bucket *b, struct svc_rqst *rqstp,
 	/* tally hash chain length stats */
 	if (entries > longest_chain) {
 		longest_chain = entries;
-		longest_chain_cachesize = atomic_read(&num_drc_entries);
+		longest_chain_cachesize =
+			percpu_counter_read_positive(&num_drc_entries);
 	} else if (entries == longest_chain) {
 		/* prefer to keep the smallest cachesize possible here */
 		longest_chain_cachesize = min_t(unsigned int,
 				longest_chain_cachesize,
-				atomic_read(&num_drc_entries));
+				percpu_counter_read_positive(&num_drc_entries));
 	}
 
 	return ret;
@@ -399,7 +417,7 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 
 	rqstp->rq_cacherep = NULL;
 	if (type == RC_NOCACHE) {
-		nfsdstats.rcnocache++;
+		this_cpu_inc(drc_stats.nocache);
 		return rtn;
 	}
 
@@ -412,8 +430,8 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	rp = nfsd_reply_cache_alloc();
 	spin_lock(&b->cache_lock);
 	if (likely(rp)) {
-		atomic_inc(&num_drc_entries);
-		drc_mem_usage += sizeof(*rp);
+		percpu_counter_inc(&num_drc_entries);
+		percpu_counter_add(&drc_mem_usage, sizeof(*rp));
 	}
 
 	/* go ahead and prune the cache */
@@ -432,7 +450,7 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 		goto out;
 	}
 
-	nfsdstats.rcmisses++;
+	this_cpu_inc(drc_stats.misses);
 	rqstp->rq_cacherep = rp;
 	rp->c_state = RC_INPROG;
 	rp->c_xid = xid;
@@ -448,7 +466,7 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 
 	/* release any buffer */
 	if (rp->c_type == RC_REPLBUFF) {
-		drc_mem_usage -= rp->c_replvec.iov_len;
+		percpu_counter_sub(&drc_mem_usage, rp->c_replvec.iov_len);
 		kfree(rp->c_replvec.iov_base);
 		rp->c_replvec.iov_base = NULL;
 	}
@@ -458,7 +476,7 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	return rtn;
 
 found_entry:
-	nfsdstats.rchits++;
+	this_cpu_inc(drc_stats.hits);
 	/* We found a matching entry which is either in progress or done. */
 	lru_put_end(b, rp);
 
@@ -557,7 +575,7 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		return;
 	}
 	spin_lock(&b->cache_lock);
-	drc_mem_usage += bufsize;
+	percpu_counter_add(&drc_mem_usage, bufsize);
 	lru_put_end(b, rp);
 	rp->c_secure = test_bit(RQ_SECURE, &rqstp->rq_flags);
 	rp->c_type = cachetype;
@@ -586,6 +604,21 @@ nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *data)
 	return 1;
 }
 
+void nfsd_reply_cache_get_stats(struct nfsd_drc_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		struct nfsd_drc_stats *s = per_cpu_ptr(&drc_stats, cpu);
+
+		stats->hits += s->hits;
+		stats->misses += s->misses;
+		stats->nocache += s->nocache;
+		stats->payload_misses += s->payload_misses;
+	}
+}
+
 /*
  * Note that fields may be added, removed or reordered in the future. Programs
  * scraping this file for info should test the labels to ensure they're
@@ -593,15 +626,19 @@ nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *data)
  */
 static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
 {
+	struct nfsd_drc_stats stats;
+
+	nfsd_reply_cache_get_stats(&stats);
 	seq_printf(m, "max entries:           %u\n", max_drc_entries);
-	seq_printf(m, "num entries:           %u\n",
-			atomic_read(&num_drc_entries));
+	seq_printf(m, "num entries:           %lld\n",
+			percpu_counter_sum_positive(&num_drc_entries));
 	seq_printf(m, "hash buckets:          %u\n", 1 << maskbits);
-	seq_printf(m, "mem usage:             %u\n", drc_mem_usage);
-	seq_printf(m, "cache hits:            %u\n", nfsdstats.rchits);
-	seq_printf(m, "cache misses:          %u\n", nfsdstats.rcmisses);
-	seq_printf(m, "not cached:            %u\n", nfsdstats.rcnocache);
-	seq_printf(m, "payload misses:        %u\n", payload_misses);
+	seq_printf(m, "mem usage:             %lld\n",
+			percpu_counter_sum_positive(&drc_mem_usage));
+	seq_printf(m, "cache hits:            %u\n", stats.hits);
+	seq_printf(m, "cache misses:          %u\n", stats.misses);
+	seq_printf(m, "not cached:            %u\n", stats.nocache);
+	seq_printf(m, "payload misses:        %u\n", stats.payload_misses);
 	seq_printf(m, "longest chain len:     %u\n", longest_chain);
 	seq_printf(m, "cachesize at longest:  %u\n", longest_chain_cachesize);
 	return 0;
@@ -2,6 +2,7 @@
 #include <linux/fanotify.h>
 #include <linux/fdtable.h>
 #include <linux/fsnotify_backend.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h> /* UINT_MAX */
@@ -30,12 +31,30 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	return false;
 }
 
-/* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+static struct hlist_head *
+fanotify_merge_bucket(struct fsnotify_group *group,
+		      struct fanotify_event_info *event)
 {
-	struct fsnotify_event *test_event;
+	unsigned long key = (unsigned long)event->path.dentry ^
+			    (unsigned long)event->path.mnt ^
+			    (unsigned long)event->tgid;
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
+	return &group->fanotify_data.merge_hash[hash_long(key,
+						FANOTIFY_HTABLE_BITS)];
+}
+
+/*
+ * Only the queued events that could merge with @event are looked at, so
+ * a long queue no longer makes every new event more expensive.
+ *
+ * Called with the notification_lock held.
+ */
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
+{
+	struct fanotify_event_info *test_event;
+
+	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 
 	/*
 	 * Don't merge a permission event with any other event so that we know
@@ -45,9 +64,12 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	if (fanotify_is_perm_event(event->mask))
 		return 0;
 
-	list_for_each_entry_reverse(test_event, list, list) {
-		if (should_merge(test_event, event)) {
-			test_event->mask |= event->mask;
+	/* Newest first, like the queue walk this replaces */
+	hlist_for_each_entry(test_event,
+			     fanotify_merge_bucket(group, FANOTIFY_E(event)),
+			     merge_list) {
+		if (should_merge(&test_event->fse, event)) {
+			test_event->fse.mask |= event->mask;
 			return 1;
 		}
 	}
@@ -55,6 +77,18 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	return 0;
 }
 
+/* Called with the notification_lock held, after @event was queued */
+static void fanotify_insert_event(struct fsnotify_group *group,
+				  struct fsnotify_event *event)
+{
+	/* Permission events are never merged, see fanotify_merge() */
+	if (fanotify_is_perm_event(event->mask))
+		return;
+
+	hlist_add_head(&FANOTIFY_E(event)->merge_list,
+		       fanotify_merge_bucket(group, FANOTIFY_E(event)));
+}
+
 static int fanotify_get_response(struct fsnotify_group *group,
 				 struct fanotify_perm_event_info *event,
 				 struct fsnotify_iter_info *iter_info)
@@ -168,6 +202,7 @@ struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 		return NULL;
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
+	INIT_HLIST_NODE(&event->merge_list);
 	event->tgid = get_pid(task_tgid(current));
 	if (path) {
 		event->path = *path;
@@ -228,7 +263,8 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	}
 
 	fsn_event = &event->fse;
-	ret = fsnotify_add_event(group, fsn_event, fanotify_merge);
+	ret = fsnotify_add_event(group, fsn_event, fanotify_merge,
+				 fanotify_insert_event);
 	if (ret) {
 		/* Permission events shouldn't be merged */
 		BUG_ON(ret == 1 && mask & FAN_ALL_PERM_EVENTS);
@@ -252,6 +288,7 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 {
 	struct user_struct *user;
 
+	kfree(group->fanotify_data.merge_hash);
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
@@ -20,8 +20,13 @@ struct fanotify_event_info {
 	 */
 	struct path path;
 	struct pid *tgid;
+	/* in group->fanotify_data.merge_hash while queued */
+	struct hlist_node merge_list;
 };
 
+#define FANOTIFY_HTABLE_BITS	7
+#define FANOTIFY_HTABLE_SIZE	(1 << FANOTIFY_HTABLE_BITS)
+
 /*
  * Structure for permission fanotify events. It gets allocated and freed in
  * fanotify_handle_event() since we wait there for user response. When the
@@ -52,6 +57,12 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
+/* Called with the notification_lock held as the event leaves the queue */
+static inline void fanotify_unhash_event(struct fsnotify_event *fse)
+{
+	hlist_del_init(&FANOTIFY_E(fse)->merge_list);
+}
+
 struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 						 struct inode *inode, u32 mask,
 						 const struct path *path);
@@ -34,6 +34,25 @@
 
 #include "internal.h"
 
+/*
+ * Huge pages in the page cache of a regular file are read-only, so the
+ * page cache must go once the file can be written.  Called after
+ * i_writecount has been raised; paired with smp_mb() in collapse_file():
+ * either khugepaged sees the writer and backs off, or we see its nr_thps
+ * here.  Private COW copies in existing mappings are left alone.
+ */
+static void drop_file_thps(struct inode *inode)
+{
+	struct address_space *mapping = inode->i_mapping;
+
+	smp_mb();
+	if (filemap_nr_thps(mapping)) {
+		filemap_write_and_wait(mapping);
+		unmap_mapping_range(mapping, 0, 0, 0);
+		truncate_inode_pages(mapping, 0);
+	}
+}
+
 int do_truncate(struct dentry *dentry, loff_t length, unsigned int time_attrs,
 	struct file *filp)
 {
@@ -104,6 +123,7 @@ long vfs_truncate(const struct path *path, loff_t length)
 	error = get_write_access(upperdentry->d_inode);
 	if (error)
 		goto mnt_drop_write_and_out;
+	drop_file_thps(upperdentry->d_inode);
 
 	/*
 	 * Make sure that there are no leases.  get_write_access() protects
@@ -794,6 +814,9 @@ static int do_dentry_open(struct file *f,
 	     likely(f->f_op->write || f->f_op->write_iter))
 		f->f_mode |= FMODE_CAN_WRITE;
 
+	if (f->f_mode & FMODE_WRITE)
+		drop_file_thps(inode);
+
 	f->f_write_hint = WRITE_LIFE_NOT_SET;
 	f->f_flags &= ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
 
@@ -207,6 +207,16 @@ static int ovl_set_timestamps(struct dentry *upperdentry, struct kstat *stat)
 	return notify_change(upperdentry, &attr, NULL);
 }
 
+static int ovl_set_size(struct dentry *upperdentry, struct kstat *stat)
+{
+	struct iattr attr = {
+		.ia_valid = ATTR_SIZE,
+		.ia_size = stat->size,
+	};
+
+	return notify_change(upperdentry, &attr, NULL);
+}
+
 int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 {
 	int err = 0;
@@ -416,6 +426,7 @@ struct ovl_copy_up_ctx {
 	bool tmpfile;
 	bool origin;
 	bool indexed;
+	bool metacopy;
 };
 
 static int ovl_link_up(struct ovl_copy_up_ctx *c)
@@ -536,7 +547,7 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 {
 	int err;
 
-	if (S_ISREG(c->stat.mode)) {
+	if (S_ISREG(c->stat.mode) && !c->metacopy) {
 		struct path upperpath;
 
 		ovl_path_upper(c->dentry, &upperpath);
@@ -552,8 +563,19 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 	if (err)
 		return err;
 
+	if (c->metacopy) {
+		err = ovl_check_setxattr(c->dentry, temp, OVL_XATTR_METACOPY,
+					 NULL, 0, -EOPNOTSUPP);
+		if (err)
+			return err;
+	}
+
 	inode_lock(temp->d_inode);
-	err = ovl_set_attr(temp, &c->stat);
+	/* The data stays in lower, but the upper has to report its size */
+	if (c->metacopy)
+		err = ovl_set_size(temp, &c->stat);
+	if (!err)
+		err = ovl_set_attr(temp, &c->stat);
 	inode_unlock(temp->d_inode);
 	if (err)
 		return err;
@@ -607,6 +629,9 @@ static int ovl_copy_up_locked(struct ovl_copy_up_ctx *c)
 		goto out_cleanup;
 
 	inode = d_inode(c->dentry);
+	/* Set before the upper is published by ovl_inode_update() */
+	if (c->metacopy)
+		ovl_set_flag(OVL_METACOPY, inode);
 	ovl_inode_update(inode, newdentry);
 	if (S_ISDIR(inode->i_mode))
 		ovl_set_flag(OVL_WHITEOUTS, inode);
@@ -644,6 +669,8 @@ static int ovl_do_copy_up(struct ovl_copy_up_ctx *c)
 	 */
 	if (ovl_need_index(c->dentry)) {
 		c->indexed = true;
+		/* The index is looked up by origin, which needs the data */
+		c->metacopy = false;
 		if (S_ISDIR(c->stat.mode))
 			c->workdir = ovl_indexdir(c->dentry->d_sb);
 		else
@@ -710,6 +737,56 @@ static int ovl_do_copy_up(struct ovl_copy_up_ctx *c)
 	return err;
 }
 
+static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
+				  int flags)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+
+	if (!ofs->config.metacopy || !S_ISREG(mode))
+		return false;
+
+	/* Opened for write, the data is going to be needed right away */
+	if ((OPEN_FMODE(flags) & FMODE_WRITE) || (flags & O_TRUNC))
+		return false;
+
+	return true;
+}
+
+/* Copy up the data of a metadata only copy up and drop its metacopy mark */
+static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
+{
+	struct path upperpath;
+	struct kstat ustat;
+	int err;
+
+	ovl_path_upper(c->dentry, &upperpath);
+	if (WARN_ON(upperpath.dentry == NULL))
+		return -EIO;
+
+	err = vfs_getattr(&upperpath, &ustat, STATX_ATIME | STATX_MTIME,
+			  AT_STATX_SYNC_AS_STAT);
+	if (err)
+		return err;
+
+	err = ovl_copy_up_data(&c->lowerpath, &upperpath, c->stat.size);
+	if (err)
+		return err;
+
+	inode_lock(d_inode(upperpath.dentry));
+	/* Writing the data is not a change of the file: keep its times */
+	ovl_set_timestamps(upperpath.dentry, &ustat);
+	err = vfs_removexattr(upperpath.dentry, OVL_XATTR_METACOPY);
+	inode_unlock(d_inode(upperpath.dentry));
+	if (err)
+		return err;
+
+	/* Pairs with smp_rmb() in ovl_dentry_is_metacopy() */
+	smp_wmb();
+	ovl_clear_flag(OVL_METACOPY, d_inode(c->dentry));
+
+	return 0;
+}
+
 static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			   int flags)
 {
@@ -743,6 +820,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			return err;
 	}
 
+	ctx.metacopy = ovl_need_meta_copy_up(dentry, ctx.stat.mode, flags);
+
 	/* maybe truncate regular file. this has no effect on dirs */
 	if (flags & O_TRUNC)
 		ctx.stat.size = 0;
@@ -754,7 +833,7 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	}
 	ovl_do_check_copy_up(ctx.lowerpath.dentry);
 
-	err = ovl_copy_up_start(dentry);
+	err = ovl_copy_up_start(dentry, flags);
 	/* err < 0: interrupted, err > 0: raced with another copy-up */
 	if (unlikely(err)) {
 		if (err > 0)
@@ -764,6 +843,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			err = ovl_do_copy_up(&ctx);
 		if (!err && parent && !ovl_dentry_has_upper_alias(dentry))
 			err = ovl_link_up(&ctx);
+		if (!err && ovl_dentry_needs_data_copy_up(dentry, flags))
+			err = ovl_copy_up_meta_inode_data(&ctx);
 		ovl_copy_up_end(dentry);
 	}
 	do_delayed_call(&done);
@@ -803,7 +884,8 @@ int ovl_copy_up_flags(struct dentry *dentry, int flags)
 		 *      with rename.
 		 */
 		if (ovl_dentry_upper(dentry) &&
-		    (ovl_dentry_has_upper_alias(dentry) || disconnected))
+		    (ovl_dentry_has_upper_alias(dentry) || disconnected) &&
+		    !ovl_dentry_needs_data_copy_up(dentry, flags))
 			break;
 
 		next = dget(dentry);
@@ -832,3 +914,9 @@ int ovl_copy_up(struct dentry *dentry)
 {
 	return ovl_copy_up_flags(dentry, 0);
 }
+
+/* Copy up including the data of a metadata only copy up */
+int ovl_copy_up_with_data(struct dentry *dentry)
+{
+	return ovl_copy_up_flags(dentry, O_WRONLY);
+}
@@ -590,7 +590,8 @@ static int ovl_link(struct dentry *old, struct inode *newdir,
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(old);
+	/* The data of a metacopy upper is found by name, so it can't move */
+	err = ovl_copy_up_with_data(old);
 	if (err)
 		goto out_drop_write;
 
@@ -947,7 +948,8 @@ static int ovl_rename(struct inode *olddir, struct dentry *old,
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(old);
+	/* The data of a metacopy upper is found by name, so it can't move */
+	err = ovl_copy_up_with_data(old);
 	if (err)
 		goto out_drop_write;
 
@@ -955,7 +957,7 @@ static int ovl_rename(struct inode *olddir, struct dentry *old,
 	if (err)
 		goto out_drop_write;
 	if (!overwrite) {
-		err = ovl_copy_up(new);
+		err = ovl_copy_up_with_data(new);
 		if (err)
 			goto out_drop_write;
 	} else {
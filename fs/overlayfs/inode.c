@@ -39,7 +39,11 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	if (err)
 		goto out;
 
-	err = ovl_copy_up(dentry);
+	/* Truncating a metadata only copy up needs its data first */
+	if (attr->ia_valid & ATTR_SIZE)
+		err = ovl_copy_up_with_data(dentry);
+	else
+		err = ovl_copy_up(dentry);
 	if (!err) {
 		upperdentry = ovl_dentry_upper(dentry);
 
@@ -190,6 +194,19 @@ int ovl_getattr(const struct path *path, struct kstat *stat,
 	if (err)
 		goto out;
 
+	/* The data blocks of a metadata only copy up are still in lower */
+	if ((request_mask & STATX_BLOCKS) && ovl_dentry_is_metacopy(dentry)) {
+		struct kstat lowerdatastat;
+
+		ovl_path_lower(dentry, &realpath);
+		err = vfs_getattr(&realpath, &lowerdatastat, STATX_BLOCKS,
+				  flags);
+		if (err)
+			goto out;
+
+		stat->blocks = lowerdatastat.blocks;
+	}
+
 	/*
 	 * It's probably not worth it to count subdirs to get the
 	 * correct link count.  nlink=1 seems to pacify 'find' and
@@ -389,7 +406,8 @@ static bool ovl_open_need_copy_up(struct dentry *dentry, int flags)
 	/* Copy up of disconnected dentry does not set upper alias */
 	if (ovl_dentry_upper(dentry) &&
 	    (ovl_dentry_has_upper_alias(dentry) ||
-	     (dentry->d_flags & DCACHE_DISCONNECTED)))
+	     (dentry->d_flags & DCACHE_DISCONNECTED)) &&
+	    !ovl_dentry_needs_data_copy_up(dentry, flags))
 		return false;
 
 	if (special_file(d_inode(dentry)->i_mode))
@@ -751,7 +769,7 @@ static bool ovl_hash_bylower(struct super_block *sb, struct dentry *upper,
 
 struct inode *ovl_get_inode(struct super_block *sb, struct dentry *upperdentry,
 			    struct ovl_path *lowerpath, struct dentry *index,
-			    unsigned int numlower)
+			    unsigned int numlower, bool metacopy)
 {
 	struct inode *realinode = upperdentry ? d_inode(upperdentry) : NULL;
 	struct inode *inode;
@@ -814,6 +832,13 @@ struct inode *ovl_get_inode(struct super_block *sb, struct dentry *upperdentry,
 	if (index)
 		ovl_set_flag(OVL_INDEX, inode);
 
+	/*
+	 * Only set on a new inode: on a cached one, the data may have been
+	 * copied up since the lookup found the metacopy xattr.
+	 */
+	if (metacopy)
+		ovl_set_flag(OVL_METACOPY, inode);
+
 	/* Check for non-merge dir that may have whiteouts */
 	if (is_dir) {
 		if (((upperdentry && lowerdentry) || numlower > 1) ||
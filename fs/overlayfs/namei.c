@@ -830,6 +830,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	unsigned int ctr = 0;
 	struct inode *inode = NULL;
 	bool upperopaque = false;
+	bool metacopy = false;
 	char *upperredirect = NULL;
 	struct dentry *this;
 	unsigned int i;
@@ -873,6 +874,23 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 			err = ovl_check_origin(ofs, upperdentry, &stack, &ctr);
 			if (err)
 				goto out_put_upper;
+
+			err = ovl_check_metacopy_xattr(upperdentry);
+			if (err < 0)
+				goto out_put;
+
+			metacopy = err;
+			/* Like redirects, metacopy points into lower layers */
+			err = -EPERM;
+			if (metacopy && !ofs->config.metacopy) {
+				pr_warn_ratelimited("overlayfs: refusing to follow metacopy for (%pd2)\n",
+						    dentry);
+				goto out_put;
+			}
+
+			/* No origin, so look the data up by name in lower */
+			if (metacopy && !ctr)
+				d.stop = false;
 		}
 
 		if (d.redirect) {
@@ -913,7 +931,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		 * If no origin fh is stored in upper of a merge dir, store fh
 		 * of lower dir and set upper parent "impure".
 		 */
-		if (upperdentry && !ctr && !ofs->noxattr) {
+		if (upperdentry && !ctr && !metacopy && !ofs->noxattr) {
 			err = ovl_fix_origin(dentry, this, upperdentry);
 			if (err) {
 				dput(this);
@@ -926,7 +944,8 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		 * lower dir that does not match a stored origin xattr. In any
 		 * case, only verified origin is used for index lookup.
 		 */
-		if (upperdentry && !ctr && ovl_verify_lower(dentry->d_sb)) {
+		if (upperdentry && !ctr && !metacopy &&
+		    ovl_verify_lower(dentry->d_sb)) {
 			err = ovl_verify_origin(upperdentry, this, false);
 			if (err) {
 				dput(this);
@@ -958,7 +977,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 			goto out_put;
 		}
 
-		if (d.stop)
+		if (d.stop || metacopy)
 			break;
 
 		if (d.redirect && d.redirect[0] == '/' && poe != roe) {
@@ -968,6 +987,14 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		}
 	}
 
+	/* The data of a metacopy upper has to be in a lower regular file */
+	if (metacopy && (!ctr || !d_is_reg(stack[0].dentry))) {
+		err = -EIO;
+		pr_warn_ratelimited("overlayfs: no lower data for metacopy (%pd2)\n",
+				    dentry);
+		goto out_put;
+	}
+
 	/*
 	 * Lookup index by lower inode and verify it matches upper inode.
 	 * We only trust dir index if we verified that lower dir matches
@@ -1005,7 +1032,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 
 	if (upperdentry || ctr) {
 		inode = ovl_get_inode(dentry->d_sb, upperdentry, stack, index,
-				      ctr);
+				      ctr, metacopy);
 		err = PTR_ERR(inode);
 		if (IS_ERR(inode))
 			goto out_free_oe;
@@ -238,21 +238,39 @@ void ovl_dir_cache_free(struct inode *inode)
 	}
 }
 
-static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
+static void ovl_merged_cache_put(struct ovl_dir_cache *cache)
 {
-	struct ovl_dir_cache *cache = od->cache;
-
 	WARN_ON(cache->refcount <= 0);
 	cache->refcount--;
 	if (!cache->refcount) {
-		if (ovl_dir_cache(d_inode(dentry)) == cache)
-			ovl_set_dir_cache(d_inode(dentry), NULL);
-
 		ovl_cache_free(&cache->entries);
 		kfree(cache);
 	}
 }
 
+/* Drop the reference the inode holds on its merged dir cache */
+static void ovl_merged_cache_drop(struct inode *inode)
+{
+	struct ovl_dir_cache *cache = ovl_dir_cache(inode);
+
+	if (cache) {
+		ovl_set_dir_cache(inode, NULL);
+		ovl_merged_cache_put(cache);
+	}
+}
+
+static void ovl_cache_put(struct ovl_dir_file *od, struct dentry *dentry)
+{
+	struct ovl_dir_cache *cache = od->cache;
+
+	/* No point in keeping a stale cache around for the next open */
+	if (ovl_dir_cache(d_inode(dentry)) == cache &&
+	    ovl_dentry_version_get(dentry) != cache->version)
+		ovl_merged_cache_drop(d_inode(dentry));
+
+	ovl_merged_cache_put(cache);
+}
+
 static int ovl_fill_merge(struct dir_context *ctx, const char *name,
 			  int namelen, loff_t offset, u64 ino,
 			  unsigned int d_type)
@@ -405,6 +423,13 @@ static void ovl_seek_cursor(struct ovl_dir_file *od, loff_t pos)
 	od->cursor = p;
 }
 
+/*
+ * The merged cache is kept in the overlay inode, which holds a reference
+ * to it, so that it outlives the open files and the next opendir doesn't
+ * have to read and merge all the layers again.  Changes to the upper dir
+ * bump the dir version, which invalidates the cache.  It goes away with
+ * the inode.
+ */
 static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 {
 	int res;
@@ -416,13 +441,14 @@ static struct ovl_dir_cache *ovl_cache_get(struct dentry *dentry)
 		cache->refcount++;
 		return cache;
 	}
-	ovl_set_dir_cache(d_inode(dentry), NULL);
+	ovl_merged_cache_drop(d_inode(dentry));
 
 	cache = kzalloc(sizeof(struct ovl_dir_cache), GFP_KERNEL);
 	if (!cache)
 		return ERR_PTR(-ENOMEM);
 
-	cache->refcount = 1;
+	/* One for the open file and one for the inode */
+	cache->refcount = 2;
 	INIT_LIST_HEAD(&cache->entries);
 	cache->root = RB_ROOT;
 
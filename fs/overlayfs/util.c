@@ -368,13 +368,14 @@ struct file *ovl_path_open(struct path *path, int flags)
 	return dentry_open(path, flags | O_NOATIME, current_cred());
 }
 
-int ovl_copy_up_start(struct dentry *dentry)
+int ovl_copy_up_start(struct dentry *dentry, int flags)
 {
 	struct ovl_inode *oi = OVL_I(d_inode(dentry));
 	int err;
 
 	err = mutex_lock_interruptible(&oi->lock);
-	if (!err && ovl_dentry_has_upper_alias(dentry)) {
+	if (!err && ovl_dentry_has_upper_alias(dentry) &&
+	    !ovl_dentry_needs_data_copy_up(dentry, flags)) {
 		err = 1; /* Already copied up */
 		mutex_unlock(&oi->lock);
 	}
@@ -400,6 +401,49 @@ bool ovl_check_origin_xattr(struct dentry *dentry)
 	return false;
 }
 
+/*
+ * Is @dentry, an upper file, a metadata only copy up?  Returns 1 if so, 0
+ * if not and < 0 on error.
+ */
+int ovl_check_metacopy_xattr(struct dentry *dentry)
+{
+	int res;
+
+	/* Only regular files can have metacopy xattr */
+	if (!d_is_reg(dentry))
+		return 0;
+
+	res = vfs_getxattr(dentry, OVL_XATTR_METACOPY, NULL, 0);
+	if (res < 0) {
+		if (res == -ENODATA || res == -EOPNOTSUPP)
+			return 0;
+		pr_warn_ratelimited("overlayfs: failed to get metacopy (%i)\n",
+				    res);
+		return res;
+	}
+
+	return 1;
+}
+
+bool ovl_dentry_is_metacopy(struct dentry *dentry)
+{
+	if (!d_is_reg(dentry))
+		return false;
+
+	/* Pairs with smp_wmb() in ovl_inode_update() and data copy up */
+	smp_rmb();
+	return ovl_test_flag(OVL_METACOPY, d_inode(dentry));
+}
+
+/* Does opening @dentry with @flags require the data to be copied up? */
+bool ovl_dentry_needs_data_copy_up(struct dentry *dentry, int flags)
+{
+	if (!(OPEN_FMODE(flags) & FMODE_WRITE) && !(flags & O_TRUNC))
+		return false;
+
+	return ovl_dentry_is_metacopy(dentry);
+}
+
 bool ovl_check_dir_xattr(struct dentry *dentry, const char *name)
 {
 	int res;
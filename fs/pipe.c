@@ -248,6 +248,7 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 	size_t total_len = iov_iter_count(to);
 	struct file *filp = iocb->ki_filp;
 	struct pipe_inode_info *pipe = filp->private_data;
+	bool was_full;
 	int do_wakeup;
 	ssize_t ret;
 
@@ -258,6 +259,14 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 	do_wakeup = 0;
 	ret = 0;
 	__pipe_lock(pipe);
+
+	/*
+	 * Writers only ever sleep on a full pipe, so they need a wakeup
+	 * when we free a slot in one and at no other time.  Streaming
+	 * readers then stop paying for a wakeup per buffer.  Edge
+	 * triggered pollers want to hear about every slot though.
+	 */
+	was_full = pipe_full(pipe) || pipe->poll_usage;
 	for (;;) {
 		int bufs = pipe->nrbufs;
 		if (bufs) {
@@ -298,7 +307,7 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 				curbuf = (curbuf + 1) & (pipe->buffers - 1);
 				pipe->curbuf = curbuf;
 				pipe->nrbufs = --bufs;
-				do_wakeup = 1;
+				do_wakeup = was_full;
 			}
 			total_len -= chars;
 			if (!total_len)
@@ -328,19 +337,23 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 		}
 		if (do_wakeup) {
 			wake_up_interruptible_sync_poll(&pipe->wait, EPOLLOUT | EPOLLWRNORM);
- 			kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+			do_wakeup = 0;
 		}
+		if (ret > 0)
+			kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
 		pipe_wait(pipe);
+		was_full = pipe_full(pipe) || pipe->poll_usage;
 	}
 	__pipe_unlock(pipe);
 
 	/* Signal writers asynchronously that there is more room. */
-	if (do_wakeup) {
+	if (do_wakeup)
 		wake_up_interruptible_sync_poll(&pipe->wait, EPOLLOUT | EPOLLWRNORM);
+	/* SIGIO users still hear about every read, as they always did */
+	if (ret > 0) {
 		kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
-	}
-	if (ret > 0)
 		file_accessed(filp);
+	}
 	return ret;
 }
 
@@ -356,6 +369,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 	struct pipe_inode_info *pipe = filp->private_data;
 	ssize_t ret = 0;
 	int do_wakeup = 0;
+	bool was_empty;
 	size_t total_len = iov_iter_count(from);
 	ssize_t chars;
 
@@ -371,6 +385,12 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		goto out;
 	}
 
+	/*
+	 * Readers only ever sleep on an empty pipe, so only the write
+	 * that makes it non-empty has to wake them, see pipe_read().
+	 */
+	was_empty = pipe_empty(pipe) || pipe->poll_usage;
+
 	/* We try to merge small writes */
 	chars = total_len & (PAGE_SIZE-1); /* size of the last buffer */
 	if (pipe->nrbufs && chars != 0) {
@@ -389,7 +409,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				ret = -EFAULT;
 				goto out;
 			}
-			do_wakeup = 1;
+			do_wakeup = was_empty;
 			buf->len += ret;
 			if (!iov_iter_count(from))
 				goto out;
@@ -420,12 +440,12 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				}
 				pipe->tmp_page = page;
 			}
-			/* Always wake up, even if the copy fails. Otherwise
-			 * we lock up (O_NONBLOCK-)readers that sleep due to
-			 * syscall merging.
-			 * FIXME! Is this really true?
+			/* Wake up even if the copy fails. Otherwise we lock
+			 * up (O_NONBLOCK-)readers that sleep due to syscall
+			 * merging: they do so on an empty pipe, which is
+			 * exactly when was_empty is set.
 			 */
-			do_wakeup = 1;
+			do_wakeup = was_empty;
 			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
 			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
 				if (!ret)
@@ -464,19 +484,21 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		}
 		if (do_wakeup) {
 			wake_up_interruptible_sync_poll(&pipe->wait, EPOLLIN | EPOLLRDNORM);
-			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
 			do_wakeup = 0;
 		}
+		if (ret > 0)
+			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
 		pipe->waiting_writers++;
 		pipe_wait(pipe);
 		pipe->waiting_writers--;
+		was_empty = pipe_empty(pipe) || pipe->poll_usage;
 	}
 out:
 	__pipe_unlock(pipe);
-	if (do_wakeup) {
+	if (do_wakeup)
 		wake_up_interruptible_sync_poll(&pipe->wait, EPOLLIN | EPOLLRDNORM);
+	if (ret > 0)
 		kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
-	}
 	if (ret > 0 && sb_start_write_trylock(file_inode(filp)->i_sb)) {
 		int err = file_update_time(filp);
 		if (err)
@@ -517,6 +539,15 @@ pipe_poll(struct file *filp, poll_table *wait)
 	struct pipe_inode_info *pipe = filp->private_data;
 	int nrbufs;
 
+	/*
+	 * Edge triggered epoll expects an event per read or write, not
+	 * just on the empty and full transitions pipe_read() and
+	 * pipe_write() otherwise wake up on.  Remember that someone
+	 * polls so they can go back to waking up every time.
+	 */
+	if (unlikely(!pipe->poll_usage))
+		pipe->poll_usage = true;
+
 	poll_wait(filp, &pipe->wait, wait);
 
 	/* Reading only -- no need for acquiring the semaphore.  */
@@ -34,6 +34,7 @@
 #include <linux/socket.h>
 #include <linux/compat.h>
 #include <linux/sched/signal.h>
+#include <linux/shmem_fs.h>
 
 #include "internal.h"
 
@@ -664,6 +665,132 @@ ssize_t splice_from_pipe(struct pipe_inode_info *pipe, struct file *out,
 	return ret;
 }
 
+/*
+ * SPLICE_F_MOVE into the page cache bypasses ->write_iter(), so only do
+ * it for filesystems whose ->write_iter() is the generic one, which the
+ * move below follows.  shmem does its own accounting of its pages.
+ */
+static bool splice_can_move(struct file *out)
+{
+	struct address_space *mapping = out->f_mapping;
+
+	return out->f_op->write_iter == generic_file_write_iter &&
+	       mapping->a_ops->write_begin && !shmem_mapping(mapping) &&
+	       !IS_DAX(mapping->host) && !(out->f_flags & O_DIRECT);
+}
+
+/*
+ * Move the page of the buffer at the head of the pipe into the page cache
+ * of sd->u.file, at sd->pos, instead of copying it.  That takes a whole
+ * page going to a page aligned position in a hole of the page cache, and
+ * a buffer that can be stolen: a page nobody else has a reference to,
+ * and that doesn't belong to a mapping, an LRU list or a memcg yet.
+ *
+ * Returns PAGE_SIZE if the page was moved, 0 if it needs to be copied, or
+ * a negative error.
+ */
+static int splice_move_page(struct pipe_inode_info *pipe,
+			    struct splice_desc *sd)
+{
+	struct pipe_buffer *buf = pipe->bufs + pipe->curbuf;
+	struct file *file = sd->u.file;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct page *page = buf->page, *cached;
+	pgoff_t index = sd->pos >> PAGE_SHIFT;
+	struct kiocb kiocb;
+	void *fsdata;
+	int ret;
+
+	if (buf->offset || buf->len != PAGE_SIZE ||
+	    sd->total_len < PAGE_SIZE || offset_in_page(sd->pos))
+		return 0;
+
+	/* Leave the limits for the copy to enforce */
+	if (sd->pos + PAGE_SIZE > inode->i_sb->s_maxbytes ||
+	    sd->pos + PAGE_SIZE > rlimit(RLIMIT_FSIZE))
+		return 0;
+
+	if (pipe_buf_confirm(pipe, buf))
+		return 0;
+
+	inode_lock(inode);
+
+	cached = find_get_page(mapping, index);
+	if (cached) {
+		put_page(cached);
+		ret = 0;
+		goto out_unlock_inode;
+	}
+
+	ret = file_remove_privs(file);
+	if (!ret)
+		ret = file_update_time(file);
+	if (ret)
+		goto out_unlock_inode;
+
+	if (pipe_buf_steal(pipe, buf))
+		goto out_unlock_inode;
+
+	/* Locked and ours alone now, but fit for the page cache? */
+	if (PageCompound(page) || PageLRU(page) || PageAnon(page) ||
+	    PageSwapBacked(page) || page->mapping)
+		goto out_unlock_page;
+
+	/*
+	 * Uptodate before it can be found, so that nobody reads the
+	 * block under it over its contents.
+	 */
+	SetPageUptodate(page);
+	if (add_to_page_cache_locked(page, mapping, index,
+			mapping_gfp_constraint(mapping, GFP_KERNEL))) {
+		ClearPageUptodate(page);
+		goto out_unlock_page;
+	}
+	lru_cache_add_file(page);
+	unlock_page(page);
+
+	/*
+	 * Let the filesystem allocate the blocks and do its accounting as
+	 * for any write.  It finds the page just added, or if truncate got
+	 * to it meanwhile, a new one that still needs the data.
+	 */
+	ret = pagecache_write_begin(file, mapping, sd->pos, PAGE_SIZE, 0,
+				    &cached, &fsdata);
+	if (ret) {
+		lock_page(page);
+		if (page->mapping == mapping)
+			delete_from_page_cache(page);
+		unlock_page(page);
+		goto out_unlock_inode;
+	}
+
+	if (cached != page)
+		copy_highpage(cached, page);
+	flush_dcache_page(cached);
+
+	ret = pagecache_write_end(file, mapping, sd->pos, PAGE_SIZE, PAGE_SIZE,
+				  cached, fsdata);
+	inode_unlock(inode);
+	if (ret < 0)
+		return ret;
+	if (ret != PAGE_SIZE)
+		return -EIO;
+
+	sd->pos += PAGE_SIZE;
+	balance_dirty_pages_ratelimited(mapping);
+
+	init_sync_kiocb(&kiocb, file);
+	kiocb.ki_pos = sd->pos;
+	return generic_write_sync(&kiocb, PAGE_SIZE);
+
+out_unlock_page:
+	unlock_page(page);
+out_unlock_inode:
+	inode_unlock(inode);
+	return ret;
+}
+
 /**
  * iter_file_splice_write - splice data from a pipe to a file
  * @pipe:	pipe info
@@ -691,6 +818,7 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 	int nbufs = pipe->buffers;
 	struct bio_vec *array = kcalloc(nbufs, sizeof(struct bio_vec),
 					GFP_KERNEL);
+	bool move = (flags & SPLICE_F_MOVE) && splice_can_move(out);
 	ssize_t ret;
 
 	if (unlikely(!array))
@@ -708,6 +836,16 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 		if (ret <= 0)
 			break;
 
+		if (move) {
+			ret = splice_move_page(pipe, &sd);
+			if (ret < 0)
+				break;
+			if (ret) {
+				count_vm_event(SPLICE_PAGE_MOVED);
+				goto consumed;
+			}
+		}
+
 		if (unlikely(nbufs < pipe->buffers)) {
 			kfree(array);
 			nbufs = pipe->buffers;
@@ -719,9 +857,15 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 			}
 		}
 
-		/* build the vector */
+		/*
+		 * build the vector, one buffer at a time when moving so that
+		 * every buffer gets a chance to be moved
+		 */
 		left = sd.total_len;
 		for (n = 0, idx = pipe->curbuf; left && n < pipe->nrbufs; n++, idx++) {
+			if (move && n)
+				break;
+
 			struct pipe_buffer *buf = pipe->bufs + idx;
 			size_t this_len = buf->len;
 
@@ -750,6 +894,9 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 		if (ret <= 0)
 			break;
 
+		count_vm_events(SPLICE_PAGE_COPIED,
+				DIV_ROUND_UP(ret, PAGE_SIZE));
+consumed:
 		sd.num_spliced += ret;
 		sd.total_len -= ret;
 		*ppos = sd.pos;
@@ -796,6 +943,7 @@ static int write_pipe_buf(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	data = kmap(buf->page);
 	ret = __kernel_write(sd->u.file, data + buf->offset, sd->len, &tmp);
 	kunmap(buf->page);
+	count_vm_event(SPLICE_PAGE_COPIED);
 
 	return ret;
 }
@@ -1235,6 +1383,8 @@ static int pipe_to_user(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 			struct splice_desc *sd)
 {
 	int n = copy_page_to_iter(buf->page, buf->offset, sd->len, sd->u.data);
+
+	count_vm_event(SPLICE_PAGE_COPIED);
 	return n == sd->len ? n : -EFAULT;
 }
 
@@ -81,7 +81,8 @@ static unsigned long super_cache_scan(struct shrinker *shrink,
 		fs_objects = sb->s_op->nr_cached_objects(sb, sc);
 
 	inodes = list_lru_shrink_count(&sb->s_inode_lru, sc);
-	dentries = list_lru_shrink_count(&sb->s_dentry_lru, sc);
+	dentries = list_lru_shrink_count(&sb->s_dentry_lru, sc) +
+		   list_lru_shrink_count(&sb->s_dentry_neg_lru, sc);
 	total_objects = dentries + inodes + fs_objects + 1;
 	if (!total_objects)
 		total_objects = 1;
@@ -142,6 +143,7 @@ static unsigned long super_cache_count(struct shrinker *shrink,
 		total_objects = sb->s_op->nr_cached_objects(sb, sc);
 
 	total_objects += list_lru_shrink_count(&sb->s_dentry_lru, sc);
+	total_objects += list_lru_shrink_count(&sb->s_dentry_neg_lru, sc);
 	total_objects += list_lru_shrink_count(&sb->s_inode_lru, sc);
 
 	total_objects = vfs_pressure_ratio(total_objects);
@@ -156,6 +158,7 @@ static void destroy_super_work(struct work_struct *work)
 
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_free_rwsem(&s->s_writers.rw_sem[i]);
+	free_dlock_list_heads(&s->s_inodes);
 	kfree(s);
 }
 
@@ -173,6 +176,7 @@ static void destroy_unused_super(struct super_block *s)
 		return;
 	up_write(&s->s_umount);
 	list_lru_destroy(&s->s_dentry_lru);
+	list_lru_destroy(&s->s_dentry_neg_lru);
 	list_lru_destroy(&s->s_inode_lru);
 	security_sb_free(s);
 	put_user_ns(s->s_user_ns);
@@ -239,13 +243,15 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags,
 	INIT_HLIST_NODE(&s->s_instances);
 	INIT_HLIST_BL_HEAD(&s->s_roots);
 	mutex_init(&s->s_sync_lock);
-	INIT_LIST_HEAD(&s->s_inodes);
-	spin_lock_init(&s->s_inode_list_lock);
+	if (alloc_dlock_list_heads(&s->s_inodes))
+		goto fail;
 	INIT_LIST_HEAD(&s->s_inodes_wb);
 	spin_lock_init(&s->s_inode_wblist_lock);
 
 	if (list_lru_init_memcg(&s->s_dentry_lru))
 		goto fail;
+	if (list_lru_init_memcg(&s->s_dentry_neg_lru))
+		goto fail;
 	if (list_lru_init_memcg(&s->s_inode_lru))
 		goto fail;
 	s->s_count = 1;
@@ -282,6 +288,7 @@ static void __put_super(struct super_block *s)
 	if (!--s->s_count) {
 		list_del_init(&s->s_list);
 		WARN_ON(s->s_dentry_lru.node);
+		WARN_ON(s->s_dentry_neg_lru.node);
 		WARN_ON(s->s_inode_lru.node);
 		WARN_ON(!list_empty(&s->s_mounts));
 		security_sb_free(s);
@@ -331,6 +338,7 @@ void deactivate_locked_super(struct super_block *s)
 		 * the lru lists right now.
 		 */
 		list_lru_destroy(&s->s_dentry_lru);
+		list_lru_destroy(&s->s_dentry_neg_lru);
 		list_lru_destroy(&s->s_inode_lru);
 
 		put_filesystem(fs);
@@ -452,7 +460,7 @@ void generic_shutdown_super(struct super_block *sb)
 		if (sop->put_super)
 			sop->put_super(sb);
 
-		if (!list_empty(&sb->s_inodes)) {
+		if (!dlock_lists_empty(&sb->s_inodes)) {
 			printk("VFS: Busy inodes after unmount of %s. "
 			   "Self-destruct in 5 seconds.  Have a nice day...\n",
 			   sb->s_id);
@@ -129,9 +129,19 @@ struct aead_request {
  * @exit: Deinitialize the cryptographic transformation object. This is a
  *	  counterpart to @init, used to remove various changes set in
  *	  @init.
+ * @encrypt_batch: Encrypt up to @max_batch requests of one transformation
+ *		   at once, storing the result of each request in its slot of
+ *		   the error array as @encrypt would have returned it.  Meant
+ *		   for multi-buffer implementations that process several
+ *		   requests in parallel lanes.  Optional.
+ * @decrypt_batch: Decryption counterpart of @encrypt_batch.  Must be set
+ *		   together with @encrypt_batch.
+ * @max_batch: Number of requests @encrypt_batch and @decrypt_batch accept
+ *	       at once, at least 2 if they are set.
  * @base: Definition of a generic crypto cipher algorithm.
  *
- * All fields except @ivsize is mandatory and must be filled.
+ * All fields except @ivsize and the batch operations are mandatory and must
+ * be filled.
  */
 struct aead_alg {
 	int (*setkey)(struct crypto_aead *tfm, const u8 *key,
@@ -141,12 +151,17 @@ struct aead_alg {
 	int (*decrypt)(struct aead_request *req);
 	int (*init)(struct crypto_aead *tfm);
 	void (*exit)(struct crypto_aead *tfm);
+	void (*encrypt_batch)(struct aead_request **reqs, int *errs,
+			      unsigned int nr);
+	void (*decrypt_batch)(struct aead_request **reqs, int *errs,
+			      unsigned int nr);
 
 	const char *geniv;
 
 	unsigned int ivsize;
 	unsigned int maxauthsize;
 	unsigned int chunksize;
+	unsigned int max_batch;
 
 	struct crypto_alg base;
 };
@@ -370,6 +385,37 @@ static inline int crypto_aead_decrypt(struct aead_request *req)
 	return crypto_aead_alg(aead)->decrypt(req);
 }
 
+/**
+ * crypto_aead_encrypt_batch() - encrypt an array of requests
+ * @reqs: requests to encrypt
+ * @errs: array of @nr return codes, one per request
+ * @nr: number of requests
+ *
+ * Submit @nr requests at once, so that algorithms with a multi-buffer
+ * implementation can process several of them in parallel.  Consecutive
+ * requests on the same transformation are handed to the algorithm
+ * together; the others are encrypted one by one.  The requests may use
+ * different transformations.
+ *
+ * @errs[i] receives what crypto_aead_encrypt() would have returned for
+ * @reqs[i], including -EINPROGRESS and -EBUSY for requests that complete
+ * asynchronously through their callbacks.
+ */
+void crypto_aead_encrypt_batch(struct aead_request **reqs, int *errs,
+			       unsigned int nr);
+
+/**
+ * crypto_aead_decrypt_batch() - decrypt an array of requests
+ * @reqs: requests to decrypt
+ * @errs: array of @nr return codes, one per request
+ * @nr: number of requests
+ *
+ * Decryption counterpart of crypto_aead_encrypt_batch().  @errs[i] receives
+ * what crypto_aead_decrypt() would have returned for @reqs[i].
+ */
+void crypto_aead_decrypt_batch(struct aead_request **reqs, int *errs,
+			       unsigned int nr);
+
 /**
  * DOC: Asynchronous AEAD Request Handle
  *
@@ -26,6 +26,7 @@
 
 #include <drm/spsc_queue.h>
 #include <linux/dma-fence.h>
+#include <linux/ktime.h>
 
 struct drm_gpu_scheduler;
 struct drm_sched_rq;
@@ -53,6 +54,9 @@ enum drm_sched_priority {
 struct drm_sched_entity {
 	struct list_head		list;
 	struct drm_sched_rq		*rq;
+	/* Run queues of identical rings the entity may move between */
+	struct drm_sched_rq		**rq_list;
+	unsigned int			num_rq_list;
 	spinlock_t			rq_lock;
 	struct drm_gpu_scheduler	*sched;
 
@@ -67,6 +71,27 @@ struct drm_sched_entity {
 	atomic_t			*guilty; /* points to ctx's guilty */
 	int            fini_status;
 	struct dma_fence    *last_scheduled;
+
+	/* Latency accounting, see drm_sched_entity_get_stats() */
+	atomic64_t			stat_jobs;
+	atomic64_t			stat_wait_ns;
+	ktime_t				last_submit;
+	ktime_t				last_run;
+};
+
+/**
+ * drm_sched_entity_stats - Latency accounting of an entity
+ *
+ * @jobs: Number of jobs handed to the hardware so far.
+ * @wait_ns: Time those jobs spent queued in the entity, in total.
+ * @last_submit: When the last job was pushed to the entity.
+ * @last_run: When the last job was handed to the hardware.
+ */
+struct drm_sched_entity_stats {
+	u64				jobs;
+	u64				wait_ns;
+	ktime_t				last_submit;
+	ktime_t				last_run;
 };
 
 /**
@@ -76,6 +101,7 @@ struct drm_sched_entity {
 */
 struct drm_sched_rq {
 	spinlock_t			lock;
+	struct drm_gpu_scheduler	*sched;
 	struct list_head		entities;
 	struct drm_sched_entity		*current_entity;
 };
@@ -99,6 +125,8 @@ struct drm_sched_fence {
 	struct drm_gpu_scheduler	*sched;
 	spinlock_t			lock;
 	void				*owner;
+	/* When the job was pushed to its entity */
+	ktime_t				submitted;
 };
 
 struct drm_sched_fence *to_drm_sched_fence(struct dma_fence *f);
@@ -172,6 +200,8 @@ struct drm_gpu_scheduler {
 	wait_queue_head_t		wake_up_worker;
 	wait_queue_head_t		job_scheduled;
 	atomic_t			hw_rq_count;
+	/* jobs pushed to entities on this scheduler and not finished yet */
+	atomic_t			num_jobs;
 	atomic64_t			job_id_count;
 	struct task_struct		*thread;
 	struct list_head		ring_mirror_list;
@@ -199,6 +229,11 @@ void drm_sched_entity_push_job(struct drm_sched_job *sched_job,
 			       struct drm_sched_entity *entity);
 void drm_sched_entity_set_rq(struct drm_sched_entity *entity,
 			     struct drm_sched_rq *rq);
+void drm_sched_entity_set_rq_list(struct drm_sched_entity *entity,
+				  struct drm_sched_rq **rq_list,
+				  unsigned int num_rq_list);
+void drm_sched_entity_get_stats(struct drm_sched_entity *entity,
+				struct drm_sched_entity_stats *stats);
 
 struct drm_sched_fence *drm_sched_fence_create(
 	struct drm_sched_entity *s_entity, void *owner);
@@ -21,6 +21,7 @@
 #include <linux/blkdev.h>
 #include <linux/atomic.h>
 #include <linux/kthread.h>
+#include <linux/u64_stats_sync.h>
 
 /* percpu_counter batch for blkg_[rw]stats, per-cpu drift doesn't matter */
 #define BLKG_STAT_CPU_BATCH	(INT_MAX / 2)
@@ -40,6 +41,13 @@ enum blkg_rwstat_type {
 	BLKG_RWSTAT_TOTAL = BLKG_RWSTAT_NR,
 };
 
+enum blkg_iostat_type {
+	BLKG_IOSTAT_READ,
+	BLKG_IOSTAT_WRITE,
+
+	BLKG_IOSTAT_NR,
+};
+
 struct blkcg_gq;
 
 struct blkcg {
@@ -73,6 +81,22 @@ struct blkg_rwstat {
 	atomic64_t			aux_cnt[BLKG_RWSTAT_NR];
 };
 
+struct blkg_iostat {
+	u64				bytes[BLKG_IOSTAT_NR];
+	u64				ios[BLKG_IOSTAT_NR];
+};
+
+/*
+ * Per-cpu, @cur is what was counted and @last what was propagated to the
+ * blkg.  In the blkg, @cur includes the descendants and @last is what was
+ * propagated to the parent.
+ */
+struct blkg_iostat_set {
+	struct u64_stats_sync		sync;
+	struct blkg_iostat		cur;
+	struct blkg_iostat		last;
+};
+
 /*
  * A blkcg_gq (blkg) is association between a block cgroup (blkcg) and a
  * request_queue (q).  This is used by blkcg policies which need to track
@@ -130,9 +154,14 @@ struct blkcg_gq {
 	/* is this blkg online? protected by both blkcg and q locks */
 	bool				online;
 
+	/* io stats of the legacy hierarchy, summed up on read */
 	struct blkg_rwstat		stat_bytes;
 	struct blkg_rwstat		stat_ios;
 
+	/* io.stat of the default hierarchy, aggregated by rstat flushes */
+	struct blkg_iostat_set __percpu	*iostat_cpu;
+	struct blkg_iostat_set		iostat;
+
 	struct blkg_policy_data		*pd[BLKCG_MAX_POLS];
 
 	struct rcu_head			rcu_head;
@@ -680,6 +709,27 @@ static inline bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg
 				  struct bio *bio) { return false; }
 #endif
 
+/*
+ * Count @bio in the per-cpu io.stat of @blkg and mark its cgroup for the
+ * next rstat flush.
+ */
+static inline void blkg_iostat_add_bio(struct blkcg_gq *blkg, struct bio *bio)
+{
+	struct blkg_iostat_set *bis;
+	int rw, cpu;
+
+	rw = op_is_write(bio_op(bio)) ? BLKG_IOSTAT_WRITE : BLKG_IOSTAT_READ;
+
+	cpu = get_cpu();
+	bis = per_cpu_ptr(blkg->iostat_cpu, cpu);
+	u64_stats_update_begin(&bis->sync);
+	bis->cur.bytes[rw] += bio->bi_iter.bi_size;
+	bis->cur.ios[rw]++;
+	u64_stats_update_end(&bis->sync);
+	cgroup_rstat_updated(blkg->blkcg->css.cgroup, cpu);
+	put_cpu();
+}
+
 static inline bool blkcg_bio_issue_check(struct request_queue *q,
 					 struct bio *bio)
 {
@@ -706,9 +756,13 @@ static inline bool blkcg_bio_issue_check(struct request_queue *q,
 
 	if (!throtl) {
 		blkg = blkg ?: q->root_blkg;
-		blkg_rwstat_add(&blkg->stat_bytes, bio->bi_opf,
-				bio->bi_iter.bi_size);
-		blkg_rwstat_add(&blkg->stat_ios, bio->bi_opf, 1);
+		if (cgroup_subsys_on_dfl(io_cgrp_subsys)) {
+			blkg_iostat_add_bio(blkg, bio);
+		} else {
+			blkg_rwstat_add(&blkg->stat_bytes, bio->bi_opf,
+					bio->bi_iter.bi_size);
+			blkg_rwstat_add(&blkg->stat_ios, bio->bi_opf, 1);
+		}
 	}
 
 	rcu_read_unlock();
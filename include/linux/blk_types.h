@@ -181,6 +181,9 @@ struct bio {
 	struct cgroup_subsys_state *bi_css;
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 	void			*bi_cg_private;
+#endif
+#if defined(CONFIG_BLK_DEV_THROTTLING_LOW) || \
+	defined(CONFIG_BLK_CGROUP_IOLATENCY)
 	struct bio_issue	bi_issue;
 #endif
 #endif
@@ -229,6 +232,7 @@ struct bio {
 				 * throttling rules. Don't do it again. */
 #define BIO_TRACE_COMPLETION 10	/* bio_endio() should trace the final completion
 				 * of this bio. */
+#define BIO_TRACKED	11	/* accounted by the latency controller */
 /* See BVEC_POOL_OFFSET below before adding new flags */
 
 /*
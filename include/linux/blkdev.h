@@ -56,7 +56,7 @@ struct blk_stat_callback;
  * Maximum number of blkcg policies allowed to be registered concurrently.
  * Defined here to simplify include dependency.
  */
-#define BLKCG_MAX_POLS		3
+#define BLKCG_MAX_POLS		5
 
 typedef void (rq_end_io_fn)(struct request *, blk_status_t);
 
@@ -656,6 +656,12 @@ struct request_queue {
 #ifdef CONFIG_BLK_DEV_THROTTLING
 	/* Throttle data */
 	struct throtl_data *td;
+#endif
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+	struct blk_iolatency	*blkiolat;
+#endif
+#ifdef CONFIG_BLK_CGROUP_IOCOST
+	struct ioc		*blkioc;
 #endif
 	struct rcu_head		rcu_head;
 	wait_queue_head_t	mq_freeze_wq;
@@ -1333,6 +1339,11 @@ struct blk_plug {
 	struct list_head list; /* requests */
 	struct list_head mq_list; /* blk-mq requests */
 	struct list_head cb_list; /* md requires an unplug callback */
+
+	/* blk-mq driver tags allocated ahead, all of tag_hctx */
+	struct blk_mq_hw_ctx *tag_hctx;
+	unsigned long cached_tags;
+	unsigned int tag_offset;
 };
 #define BLK_MAX_REQUEST_COUNT 16
 #define BLK_PLUG_FLUSH_SIZE (128 * 1024)
@@ -1373,7 +1384,8 @@ static inline bool blk_needs_flush_plug(struct task_struct *tsk)
 	return plug &&
 		(!list_empty(&plug->list) ||
 		 !list_empty(&plug->mq_list) ||
-		 !list_empty(&plug->cb_list));
+		 !list_empty(&plug->cb_list) ||
+		 plug->tag_hctx);
 }
 
 /*
@@ -1476,6 +1488,29 @@ static inline unsigned short queue_max_segments(struct request_queue *q)
 	return q->limits.max_segments;
 }
 
+/*
+ * The largest bio, in sectors, that can be started at @sector of @bdev
+ * without the queue having to split it for its size or chunk limits.
+ */
+static inline unsigned int bdev_max_bio_sectors(struct block_device *bdev,
+						sector_t sector)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+
+	return min(blk_max_size_offset(q, sector + get_start_sect(bdev)),
+		   queue_max_sectors(q));
+}
+
+/*
+ * The most pages a bio for @bdev should be built from, so that it is not
+ * split for the segment limit even if none of them can be merged.
+ */
+static inline unsigned int bdev_max_bio_pages(struct block_device *bdev)
+{
+	return min_t(unsigned int, queue_max_segments(bdev_get_queue(bdev)),
+		     BIO_MAX_PAGES);
+}
+
 static inline unsigned short queue_max_discard_segments(struct request_queue *q)
 {
 	return q->limits.max_discard_segments;
@@ -38,6 +38,7 @@ enum bpf_reg_liveness {
 	REG_LIVE_NONE = 0, /* reg hasn't been read or written this branch */
 	REG_LIVE_READ, /* reg was read, so we're sensitive to initial value */
 	REG_LIVE_WRITTEN, /* reg was written first, screening off later reads */
+	REG_LIVE_READ_TYPE = 4, /* reg was read, but only its type mattered */
 };
 
 struct bpf_reg_state {
@@ -148,6 +149,7 @@ struct bpf_insn_aux_data {
 	int ctx_field_size; /* the ctx field size for load insn, maybe 0 */
 	int sanitize_stack_off; /* stack slot to be cleared */
 	bool seen; /* this insn was processed by the verifier */
+	bool zext_needed; /* zero-extension is not a no-op on some path */
 };
 
 #define MAX_USED_MAPS 64 /* max number of maps accessed by one eBPF program */
@@ -179,6 +181,14 @@ struct bpf_subprog_info {
 	u16 stack_depth; /* max. stack depth used by this function */
 };
 
+/* Maximum number of register states that can exist at once */
+#define BPF_ID_MAP_SIZE (MAX_BPF_REG + MAX_BPF_STACK / BPF_REG_SIZE)
+
+struct bpf_idpair {
+	u32 old;
+	u32 cur;
+};
+
 /* single container for all structs
  * one verifier_env per bpf_check() call
  */
@@ -199,6 +209,15 @@ struct bpf_verifier_env {
 	struct bpf_verifier_log log;
 	struct bpf_subprog_info subprog_info[BPF_MAX_SUBPROGS + 1];
 	u32 subprog_cnt;
+	struct {
+		int *insn_state;
+		int *insn_stack;	/* stack of insns to process */
+		int cur_stack;		/* current stack index */
+	} cfg;
+	struct bpf_idpair idmap_scratch[BPF_ID_MAP_SIZE];
+	u32 insn_processed;
+	u32 total_states;	/* states kept for search pruning */
+	u32 pruned_states;	/* paths cut short by search pruning */
 };
 
 __printf(2, 0) void bpf_verifier_vlog(struct bpf_verifier_log *log,
@@ -474,6 +474,9 @@ extern void ceph_osdc_put_request(struct ceph_osd_request *req);
 extern int ceph_osdc_start_request(struct ceph_osd_client *osdc,
 				   struct ceph_osd_request *req,
 				   bool nofail);
+extern void ceph_osdc_batch_begin(struct ceph_osd_client *osdc);
+extern void ceph_osdc_batch_submit(struct ceph_osd_request *req);
+extern void ceph_osdc_batch_end(struct ceph_osd_client *osdc);
 extern void ceph_osdc_cancel_request(struct ceph_osd_request *req);
 extern int ceph_osdc_wait_request(struct ceph_osd_client *osdc,
 				  struct ceph_osd_request *req);
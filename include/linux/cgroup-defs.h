@@ -20,6 +20,7 @@
 #include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 #include <linux/bpf-cgroup.h>
+#include <linux/psi_types.h>
 
 #ifdef CONFIG_CGROUPS
 
@@ -443,6 +444,9 @@ struct cgroup {
 	/* used to store eBPF programs */
 	struct cgroup_bpf bpf;
 
+	/* Used to track the pressure stalls on this cgroup */
+	struct psi_group psi;
+
 	/* ids of the ancestors at each level including self */
 	int ancestor_ids[];
 };
@@ -362,6 +362,8 @@ struct compress_alg {
 			    unsigned int slen, u8 *dst, unsigned int *dlen);
 	int (*coa_decompress)(struct crypto_tfm *tfm, const u8 *src,
 			      unsigned int slen, u8 *dst, unsigned int *dlen);
+	int (*coa_setdict)(struct crypto_tfm *tfm, const u8 *dict,
+			   unsigned int len);
 };
 
 
@@ -578,6 +580,8 @@ struct compress_tfm {
 	int (*cot_decompress)(struct crypto_tfm *tfm,
 	                      const u8 *src, unsigned int slen,
 	                      u8 *dst, unsigned int *dlen);
+	int (*cot_setdict)(struct crypto_tfm *tfm,
+			   const u8 *dict, unsigned int len);
 };
 
 #define crt_ablkcipher	crt_u.ablkcipher
@@ -1660,5 +1664,24 @@ static inline int crypto_comp_decompress(struct crypto_comp *tfm,
 						    src, slen, dst, dlen);
 }
 
+/**
+ * crypto_comp_setdict() - set a compression dictionary
+ * @tfm: compression handle
+ * @dict: dictionary, copied by the algorithm
+ * @len: length of @dict, 0 to drop the dictionary
+ *
+ * All later compression and decompression through @tfm uses the
+ * dictionary.  The caller must not compress or decompress concurrently.
+ *
+ * Return: 0 on success, -ENOSYS if the algorithm doesn't support
+ *	   dictionaries, or another negative errno
+ */
+static inline int crypto_comp_setdict(struct crypto_comp *tfm,
+				      const u8 *dict, unsigned int len)
+{
+	return crypto_comp_crt(tfm)->cot_setdict(crypto_comp_tfm(tfm),
+						 dict, len);
+}
+
 #endif	/* _LINUX_CRYPTO_H */
 
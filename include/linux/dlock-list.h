@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __LINUX_DLOCK_LIST_H
+#define __LINUX_DLOCK_LIST_H
+
+/*
+ * Distributed and locked lists.
+ *
+ * A dlock list is an array of list heads, one per possible CPU, each with
+ * its own spinlock.  Entries are added to the list of the CPU doing the
+ * add and remember which list they went on, so adds and deletes from
+ * different CPUs don't contend.  The price is paid by walkers, which have
+ * to go through each of the lists in turn, with that list's lock held.
+ *
+ * The order of the entries is not preserved across the lists.
+ */
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/lockdep.h>
+
+struct dlock_list_head {
+	struct list_head list;
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp;
+
+struct dlock_list_heads {
+	struct dlock_list_head *heads;
+};
+
+/*
+ * An entry of a dlock list.  @head is the list it is on, set when it gets
+ * added and cleared by the delete.
+ */
+struct dlock_list_node {
+	struct list_head list;
+	struct dlock_list_head *head;
+};
+
+/*
+ * Iterator state.  While walking, the lock of the list that holds the
+ * current entry is held; it can be dropped and retaken around code that
+ * sleeps with dlock_list_unlock() and dlock_list_relock(), provided the
+ * current entry is kept from being deleted meanwhile.
+ */
+struct dlock_list_iter {
+	int index;
+	struct dlock_list_head *head, *entry;
+};
+
+#define DEFINE_DLOCK_LIST_ITER(s, heads)		\
+	struct dlock_list_iter s = {			\
+		.index = -1,				\
+		.head = (heads)->heads,			\
+	}
+
+static inline void init_dlock_list_iter(struct dlock_list_iter *iter,
+					struct dlock_list_heads *heads)
+{
+	*iter = (struct dlock_list_iter) {
+		.index = -1,
+		.head = heads->heads,
+	};
+}
+
+static inline void init_dlock_list_node(struct dlock_list_node *node)
+{
+	INIT_LIST_HEAD(&node->list);
+	node->head = NULL;
+}
+
+static inline bool dlock_list_node_empty(struct dlock_list_node *node)
+{
+	return list_empty(&node->list);
+}
+
+static inline void dlock_list_unlock(struct dlock_list_iter *iter)
+{
+	spin_unlock(&iter->entry->lock);
+}
+
+static inline void dlock_list_relock(struct dlock_list_iter *iter)
+{
+	spin_lock(&iter->entry->lock);
+}
+
+extern int __alloc_dlock_list_heads(struct dlock_list_heads *dlist,
+				    struct lock_class_key *key);
+extern void free_dlock_list_heads(struct dlock_list_heads *dlist);
+
+/* Each user gets its own lock class for the list locks */
+#define alloc_dlock_list_heads(dlist)					\
+({									\
+	static struct lock_class_key _key;				\
+	__alloc_dlock_list_heads(dlist, &_key);				\
+})
+
+extern bool dlock_lists_empty(struct dlock_list_heads *dlist);
+extern void dlock_lists_add(struct dlock_list_node *node,
+			    struct dlock_list_heads *dlist);
+extern void dlock_lists_del(struct dlock_list_node *node);
+
+extern struct dlock_list_node *
+__dlock_list_next_list(struct dlock_list_iter *iter);
+
+/*
+ * Return the entry after @curr, or the first entry when @curr is NULL,
+ * moving on to the next non-empty list when the current one is done.
+ * Returns NULL, with no lock held, at the end of the walk.
+ */
+static inline struct dlock_list_node *
+__dlock_list_next_entry(struct dlock_list_node *curr,
+			struct dlock_list_iter *iter)
+{
+	if (curr) {
+		curr = list_next_entry(curr, list);
+		if (&curr->list != &iter->entry->list)
+			return curr;
+	}
+
+	return __dlock_list_next_list(iter);
+}
+
+#define __dlock_list_entry(node, type, member)				\
+({									\
+	struct dlock_list_node *__node = (node);			\
+	__node ? container_of(__node, type, member) : NULL;		\
+})
+
+/**
+ * dlist_for_each_entry - iterate over all the entries of a dlock list
+ * @pos:    the type * to use as a loop cursor
+ * @iter:   the dlock list iterator set up with DEFINE_DLOCK_LIST_ITER
+ * @member: the name of the dlock_list_node within the struct
+ *
+ * The body runs with the lock of the list holding @pos taken.  Breaking
+ * out of the loop leaves it held, so call dlock_list_unlock() first.
+ */
+#define dlist_for_each_entry(pos, iter, member)				\
+	for (pos = __dlock_list_entry(__dlock_list_next_entry(NULL, iter), \
+				      typeof(*pos), member);		\
+	     pos != NULL;						\
+	     pos = __dlock_list_entry(__dlock_list_next_entry(		\
+					&pos->member, iter),		\
+				      typeof(*pos), member))
+
+#endif /* __LINUX_DLOCK_LIST_H */
@@ -51,6 +51,20 @@ struct dma_buf_attachment;
  * @vunmap: [optional] unmaps a vmap from the buffer
  */
 struct dma_buf_ops {
+	/**
+	 * @cache_sgt_mapping:
+	 *
+	 * If true the &sg_table returned by @map_dma_buf is kept on the
+	 * attachment and handed out again by dma_buf_map_attachment() until
+	 * the attachment is detached or the exporter drops it with
+	 * dma_buf_invalidate_mappings().  Importers mapping and unmapping for
+	 * every use then pay for the IOMMU setup only once.
+	 *
+	 * @map_dma_buf and @unmap_dma_buf are called with &dma_buf.lock held
+	 * when this is set, so they must not take it themselves.
+	 */
+	bool cache_sgt_mapping;
+
 	/**
 	 * @attach:
 	 *
@@ -311,6 +325,17 @@ struct dma_buf {
  * @dev: device attached to the buffer.
  * @node: list of dma_buf_attachment.
  * @priv: exporter specific attachment data.
+ * @sgt: cached mapping, if the exporter sets &dma_buf_ops.cache_sgt_mapping.
+ * @dir: direction @sgt was mapped for.
+ * @map_count: number of users of @sgt, protected by &dma_buf.lock.
+ * @sgt_stale: @sgt was invalidated while in use and goes away once unused.
+ * @invalidate: optional importer callback, called with &dma_buf.lock held
+ *	when the exporter invalidates @sgt while it is in use.  The importer
+ *	should stop using and unmap it as soon as it can.
+ * @explicit_sync: set by importers synchronising with explicit fences, such
+ *	as sync_file, only.  They neither wait for nor add fences to the
+ *	reservation object of the buffer, and exporters and other helpers
+ *	may skip implicit fencing on their behalf.
  *
  * This structure holds the attachment information between the dma_buf buffer
  * and its user device(s). The list contains one attachment struct per device
@@ -326,6 +351,12 @@ struct dma_buf_attachment {
 	struct device *dev;
 	struct list_head node;
 	void *priv;
+	struct sg_table *sgt;
+	enum dma_data_direction dir;
+	unsigned int map_count;
+	bool sgt_stale;
+	void (*invalidate)(struct dma_buf_attachment *);
+	bool explicit_sync;
 };
 
 /**
@@ -391,6 +422,20 @@ struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *,
 					enum dma_data_direction);
 void dma_buf_unmap_attachment(struct dma_buf_attachment *, struct sg_table *,
 				enum dma_data_direction);
+void dma_buf_invalidate_mappings(struct dma_buf *dmabuf);
+
+/**
+ * dma_buf_attachment_implicit_sync - does an importer use implicit fencing
+ * @attach:	[in]	attachment to check
+ *
+ * Returns false if the importer only synchronises with explicit fences and
+ * the reservation object of the buffer can be left alone for its accesses.
+ */
+static inline bool
+dma_buf_attachment_implicit_sync(struct dma_buf_attachment *attach)
+{
+	return !attach->explicit_sync;
+}
 int dma_buf_begin_cpu_access(struct dma_buf *dma_buf,
 			     enum dma_data_direction dir);
 int dma_buf_end_cpu_access(struct dma_buf *dma_buf,
@@ -52,6 +52,8 @@ union futex_key {
 
 #ifdef CONFIG_FUTEX
 extern void exit_robust_list(struct task_struct *curr);
+extern int futex_hash_allocate(struct mm_struct *mm);
+extern void futex_hash_free(struct mm_struct *mm);
 
 long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	      u32 __user *uaddr2, u32 val2, u32 val3);
@@ -65,6 +67,15 @@ static inline void exit_robust_list(struct task_struct *curr)
 {
 }
 
+static inline int futex_hash_allocate(struct mm_struct *mm)
+{
+	return 0;
+}
+
+static inline void futex_hash_free(struct mm_struct *mm)
+{
+}
+
 static inline long do_futex(u32 __user *uaddr, int op, u32 val,
 			    ktime_t *timeout, u32 __user *uaddr2,
 			    u32 val2, u32 val3)
@@ -456,6 +456,37 @@ __alloc_pages(gfp_t gfp_mask, unsigned int order, int preferred_nid)
 	return __alloc_pages_nodemask(gfp_mask, order, preferred_nid, NULL);
 }
 
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, int preferred_nid,
+				nodemask_t *nodemask, int nr_pages,
+				struct list_head *page_list,
+				struct page **page_array);
+
+/* Bulk allocate order-0 pages onto a list */
+static inline unsigned long
+alloc_pages_bulk_list(gfp_t gfp_mask, int nid, unsigned long nr_pages,
+		      struct list_head *list)
+{
+	if (nid == NUMA_NO_NODE)
+		nid = numa_mem_id();
+
+	return __alloc_pages_bulk(gfp_mask, nid, NULL, nr_pages, list, NULL);
+}
+
+/*
+ * Bulk allocate order-0 pages into an array. Only NULL slots of the array
+ * are populated; the return value is the number of populated slots.
+ */
+static inline unsigned long
+alloc_pages_bulk_array(gfp_t gfp_mask, int nid, unsigned long nr_pages,
+		       struct page **page_array)
+{
+	if (nid == NUMA_NO_NODE)
+		nid = numa_mem_id();
+
+	return __alloc_pages_bulk(gfp_mask, nid, NULL, nr_pages, NULL,
+				  page_array);
+}
+
 /*
  * Allocate pages, preferring the node given as nid. The node must be valid and
  * online. For more general interface, see alloc_pages_node().
@@ -527,6 +558,7 @@ extern void __free_pages(struct page *page, unsigned int order);
 extern void free_pages(unsigned long addr, unsigned int order);
 extern void free_unref_page(struct page *page);
 extern void free_unref_page_list(struct list_head *list);
+extern void free_pages_bulk(struct page **pages, int nr);
 
 struct page_frag_cache;
 extern void __page_frag_cache_drain(struct page *page, unsigned int count);
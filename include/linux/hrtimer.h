@@ -186,6 +186,10 @@ enum  hrtimer_base_type {
  * @nr_retries:		Total number of hrtimer interrupt retries
  * @nr_hangs:		Total number of hrtimer interrupt hangs
  * @max_hang_time:	Maximum time spent in hrtimer_interrupt
+ * @nr_coalesced:	Total number of hard hrtimers expired ahead of their
+ *			hard expiry time by an event armed for another timer
+ * @nr_reprog_skipped:	Total number of clock event reprograms avoided on
+ *			timer removal
  * @expires_next:	absolute time of the next event, is required for remote
  *			hrtimer enqueue; it is the total first expiry time (hard
  *			and soft hrtimer are taken into account)
@@ -212,6 +216,8 @@ struct hrtimer_cpu_base {
 	unsigned short			nr_retries;
 	unsigned short			nr_hangs;
 	unsigned int			max_hang_time;
+	unsigned int			nr_coalesced;
+	unsigned int			nr_reprog_skipped;
 #endif
 	ktime_t				expires_next;
 	struct hrtimer			*next_timer;
@@ -17,8 +17,28 @@
 
 #include <uapi/linux/if_tun.h>
 
+#include <linux/virtio_net.h>
+
 #define TUN_XDP_FLAG 0x1UL
 
+#define TUN_MSG_UBUF 1
+#define TUN_MSG_PTR  2
+/* msg_control passed by vhost-net to the sendmsg of tun and tap sockets:
+ * either a zerocopy ubuf_info, or an array of @num xdp_buffs to transmit
+ * in one go.
+ */
+struct tun_msg_ctl {
+	unsigned short type;
+	unsigned short num;
+	void *ptr;
+};
+
+/* Header at data_hard_start of each xdp_buff in a TUN_MSG_PTR batch */
+struct tun_xdp_hdr {
+	int buflen;
+	struct virtio_net_hdr gso;
+};
+
 #if defined(CONFIG_TUN) || defined(CONFIG_TUN_MODULE)
 struct socket *tun_get_socket(struct file *);
 struct ptr_ring *tun_get_tx_ring(struct file *file);
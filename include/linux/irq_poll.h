@@ -2,6 +2,8 @@
 #ifndef IRQ_POLL_H
 #define IRQ_POLL_H
 
+#include <linux/interrupt.h>
+
 struct irq_poll;
 typedef int (irq_poll_fn)(struct irq_poll *, int);
 
@@ -10,15 +12,20 @@ struct irq_poll {
 	unsigned long state;
 	int weight;
 	irq_poll_fn *poll;
+	unsigned int irq;
 };
 
 enum {
 	IRQ_POLL_F_SCHED	= 0,
 	IRQ_POLL_F_DISABLE	= 1,
+	IRQ_POLL_F_IRQ		= 2,	/* irq is masked while polling */
 };
 
 extern void irq_poll_sched(struct irq_poll *);
 extern void irq_poll_init(struct irq_poll *, int, irq_poll_fn *);
+extern void irq_poll_init_irq(struct irq_poll *, int, irq_poll_fn *,
+			      unsigned int);
+extern irqreturn_t irq_poll_irq_handler(int, void *);
 extern void irq_poll_complete(struct irq_poll *);
 extern void irq_poll_enable(struct irq_poll *);
 extern void irq_poll_disable(struct irq_poll *);
@@ -50,6 +50,11 @@ struct pt_regs;
  * @request_mutex:	mutex to protect request/free before locking desc->lock
  * @dir:		/proc/irq/ procfs entry
  * @debugfs_file:	dentry for the debugfs file
+ * @balance_count:	handled events since the last balancer pass
+ * @balance_time:	handler time in ns since the last balancer pass
+ * @balance_last_count:	handled events in the last balancer interval
+ * @balance_last_time:	handler time in ns in the last balancer interval
+ * @balance_owned:	affinity was last set by the balancer
  * @name:		flow handler name for /proc/interrupts output
  */
 struct irq_desc {
@@ -96,6 +101,13 @@ struct irq_desc {
 	struct dentry		*debugfs_file;
 	const char		*dev_name;
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	unsigned int		balance_count;
+	unsigned int		balance_last_count;
+	u64			balance_time;
+	u64			balance_last_time;
+	bool			balance_owned;
+#endif
 #ifdef CONFIG_SPARSE_IRQ
 	struct rcu_head		rcu;
 	struct kobject		kobj;
@@ -126,6 +126,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -265,7 +266,10 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Nr of fast commit blocks at the end
+					   of the journal */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +295,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +306,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -902,6 +908,41 @@ struct journal_s
 	 */
 	unsigned long		j_last;
 
+	/**
+	 * @j_fc_first:
+	 *
+	 * The first block of the fast commit area, which follows the log
+	 * and ends at j_fc_last.
+	 */
+	unsigned long		j_fc_first;
+
+	/**
+	 * @j_fc_last:
+	 *
+	 * The block number one beyond the end of the fast commit area.
+	 */
+	unsigned long		j_fc_last;
+
+	/**
+	 * @j_fc_off:
+	 *
+	 * Number of fast commit blocks written for @j_fc_tid [j_fc_mutex].
+	 */
+	unsigned long		j_fc_off;
+
+	/**
+	 * @j_fc_tid:
+	 *
+	 * The transaction the blocks in the fast commit area belong to
+	 * [j_fc_mutex].
+	 */
+	tid_t			j_fc_tid;
+
+	/**
+	 * @j_fc_mutex: Serialises fast commits.
+	 */
+	struct mutex		j_fc_mutex;
+
 	/**
 	 * @j_dev: Device where we store the journal.
 	 */
@@ -979,6 +1020,16 @@ struct journal_s
 	 */
 	tid_t			j_commit_sequence;
 
+	/**
+	 * @j_durable_sequence:
+	 *
+	 * Sequence number of the most recent transaction whose commit
+	 * record is on stable storage, which can be ahead of
+	 * @j_commit_sequence while the commit is being cleaned up
+	 * [j_state_lock].
+	 */
+	tid_t			j_durable_sequence;
+
 	/**
 	 * @j_commit_request:
 	 *
@@ -1068,6 +1119,14 @@ struct journal_s
 	 */
 	u64			j_average_commit_time;
 
+	/**
+	 * @j_average_flush_time:
+	 *
+	 * The average amount of time in nanoseconds it takes to write the
+	 * commit record and flush it to stable storage. [j_state_lock]
+	 */
+	u64			j_average_flush_time;
+
 	/**
 	 * @j_min_batch_time:
 	 *
@@ -1092,6 +1151,15 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/**
+	 * @j_fc_replay_callback:
+	 *
+	 * Called during recovery for each valid fast commit block of the
+	 * first transaction that didn't make it to the log.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *,
+							struct buffer_head *);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1221,6 +1289,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1235,6 +1304,8 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_GROUP_COMMIT	0x100	/* Hold commits requested by fsync for
+					 * about one device flush */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1264,6 +1335,13 @@ void jbd2_descriptor_block_csum_set(journal_t *, struct buffer_head *);
 int jbd2_journal_next_log_block(journal_t *, unsigned long long *);
 int jbd2_journal_get_log_tail(journal_t *journal, tid_t *tid,
 			      unsigned long *block);
+
+/* Fast commits */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks);
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+struct buffer_head *jbd2_fc_get_buf(journal_t *journal);
+int jbd2_fc_write_buf(journal_t *journal, struct buffer_head *bh);
+void jbd2_fc_end_commit(journal_t *journal);
 int __jbd2_update_log_tail(journal_t *journal, tid_t tid, unsigned long block);
 void jbd2_update_log_tail(journal_t *journal, tid_t tid, unsigned long block);
 
@@ -1474,6 +1552,7 @@ int jbd2_journal_start_commit(journal_t *journal, tid_t *tid);
 int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_transaction_committed(journal_t *journal, tid_t tid);
 int jbd2_complete_transaction(journal_t *journal, tid_t tid);
+int jbd2_fsync_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
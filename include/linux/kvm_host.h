@@ -27,12 +27,14 @@
 #include <linux/irqbypass.h>
 #include <linux/swait.h>
 #include <linux/refcount.h>
+#include <linux/hashtable.h>
 #include <asm/signal.h>
 
 #include <linux/kvm.h>
 #include <linux/kvm_para.h>
 
 #include <linux/kvm_types.h>
+#include <linux/kvm_dirty_ring.h>
 
 #include <asm/kvm_host.h>
 
@@ -149,6 +151,7 @@ struct kvm_io_range {
 };
 
 #define NR_IOBUS_DEVS 1000
+#define KVM_IOEVENTFD_HASH_BITS 8
 
 struct kvm_io_bus {
 	int dev_count;
@@ -214,6 +217,19 @@ struct kvm_mmio_fragment {
 	unsigned len;
 };
 
+/*
+ * Histogram of recent halt durations.  Bucket i counts blocks shorter
+ * than 2^(i + KVM_HALT_POLL_HIST_SHIFT) ns; the last bucket also takes
+ * everything longer.
+ */
+#define KVM_HALT_POLL_HIST_SHIFT	10
+#define KVM_HALT_POLL_HIST_BUCKETS	20
+
+struct kvm_halt_poll_hist {
+	u32 bucket[KVM_HALT_POLL_HIST_BUCKETS];
+	u32 total;
+};
+
 struct kvm_vcpu {
 	struct kvm *kvm;
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -240,6 +256,10 @@ struct kvm_vcpu {
 	struct kvm_vcpu_stat stat;
 	unsigned int halt_poll_ns;
 	bool valid_wakeup;
+	struct kvm_halt_poll_hist halt_hist;
+	u64 halt_poll_success_ns;
+	u64 halt_poll_fail_ns;
+	u64 halt_wait_ns;
 
 #ifdef CONFIG_HAS_IOMEM
 	int mmio_needed;
@@ -274,6 +294,7 @@ struct kvm_vcpu {
 	bool preempted;
 	struct kvm_vcpu_arch arch;
 	struct dentry *debugfs_dentry;
+	struct kvm_dirty_ring dirty_ring;
 };
 
 static inline int kvm_vcpu_exiting_guest_mode(struct kvm_vcpu *vcpu)
@@ -413,6 +434,8 @@ struct kvm {
 		struct mutex      resampler_lock;
 	} irqfds;
 	struct list_head ioeventfds;
+	/* Exact-address ioeventfd lookup, see kvm_ioeventfd_write() */
+	DECLARE_HASHTABLE(ioeventfd_hash, KVM_IOEVENTFD_HASH_BITS);
 #endif
 	struct kvm_vm_stat stat;
 	struct kvm_arch arch;
@@ -421,6 +444,10 @@ struct kvm {
 	struct kvm_coalesced_mmio_ring *coalesced_mmio_ring;
 	spinlock_t ring_lock;
 	struct list_head coalesced_zones;
+	/* Entries in coalesced_mmio_ring, which spans 1 << order pages */
+	u32 coalesced_mmio_max;
+	unsigned int coalesced_mmio_order;
+	struct eventfd_ctx *coalesced_mmio_eventfd;
 #endif
 
 	struct mutex irq_lock;
@@ -446,6 +473,8 @@ struct kvm {
 	struct srcu_struct srcu;
 	struct srcu_struct irq_srcu;
 	pid_t userspace_pid;
+	/* Bytes per vcpu dirty ring, zero if dirty rings are not in use */
+	u32 dirty_ring_size;
 };
 
 #define kvm_err(fmt, ...) \
@@ -535,6 +564,7 @@ void kvm_vcpu_uninit(struct kvm_vcpu *vcpu);
 
 void vcpu_load(struct kvm_vcpu *vcpu);
 void vcpu_put(struct kvm_vcpu *vcpu);
+struct kvm_vcpu *kvm_get_running_vcpu(void);
 
 #ifdef __KVM_HAVE_IOAPIC
 void kvm_arch_post_irq_ack_notifier_list_update(struct kvm *kvm);
@@ -1069,6 +1099,9 @@ int kvm_send_userspace_msi(struct kvm *kvm, struct kvm_msi *msi);
 
 void kvm_eventfd_init(struct kvm *kvm);
 int kvm_ioeventfd(struct kvm *kvm, struct kvm_ioeventfd *args);
+int kvm_ioeventfd_write(struct kvm_vcpu *vcpu, enum kvm_bus bus_idx,
+			gpa_t addr, int len, const void *val);
+void kvm_ioeventfd_release(struct kvm *kvm);
 
 #ifdef CONFIG_HAVE_KVM_IRQFD
 int kvm_irqfd(struct kvm *kvm, struct kvm_irqfd *args);
@@ -1105,6 +1138,15 @@ static inline int kvm_ioeventfd(struct kvm *kvm, struct kvm_ioeventfd *args)
 	return -ENOSYS;
 }
 
+static inline int kvm_ioeventfd_write(struct kvm_vcpu *vcpu,
+				      enum kvm_bus bus_idx, gpa_t addr,
+				      int len, const void *val)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline void kvm_ioeventfd_release(struct kvm *kvm) {}
+
 #endif /* CONFIG_HAVE_KVM_EVENTFD */
 
 void kvm_arch_irq_routing_update(struct kvm *kvm);
@@ -1155,6 +1197,8 @@ extern bool kvm_rebooting;
 extern unsigned int halt_poll_ns;
 extern unsigned int halt_poll_ns_grow;
 extern unsigned int halt_poll_ns_shrink;
+extern unsigned int halt_poll_target_pct;
+extern unsigned int halt_poll_budget_pct;
 
 struct kvm_device {
 	struct kvm_device_ops *ops;
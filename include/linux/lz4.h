@@ -63,6 +63,15 @@
 	? 0 \
 	: (isize) + ((isize)/255) + 16)
 
+/*
+ * In-place decompression (see LZ4_decompress_safe_inplace()) needs the
+ * buffer to be this much larger than the decompressed data.
+ */
+#define LZ4_DECOMPRESS_INPLACE_MARGIN(compressedSize) \
+	(((compressedSize) >> 8) + 32)
+#define LZ4_DECOMPRESS_INPLACE_BUFFER_SIZE(decompressedSize) \
+	((decompressedSize) + LZ4_DECOMPRESS_INPLACE_MARGIN(decompressedSize))
+
 #define LZ4_ACCELERATION_DEFAULT 1
 #define LZ4_HASHLOG	 (LZ4_MEMORY_USAGE-2)
 #define LZ4_HASHTABLESIZE (1 << LZ4_MEMORY_USAGE)
@@ -292,6 +301,26 @@ int LZ4_decompress_fast(const char *source, char *dest, int originalSize);
 int LZ4_decompress_safe(const char *source, char *dest, int compressedSize,
 	int maxDecompressedSize);
 
+/**
+ * LZ4_decompress_safe_inplace() - Decompress a block within a single buffer
+ * @buffer: buffer holding the compressed block at its very end
+ * @compressedSize: is the precise full size of the compressed block
+ * @bufferSize: is the size of 'buffer'
+ *
+ * Decompresses the block stored in the last 'compressedSize' bytes of
+ * 'buffer' to the start of 'buffer', saving a second buffer and a copy.
+ * The decoder stays behind the compressed data it still has to read as
+ * long as 'bufferSize' is at least
+ * LZ4_DECOMPRESS_INPLACE_BUFFER_SIZE(decompressedSize).  With a smaller
+ * buffer or a malformed block decompression may fail, but it never reads
+ * or writes outside of 'buffer'.
+ *
+ * Return: number of bytes decompressed to the start of 'buffer'
+ *	or a negative result in case of error
+ */
+int LZ4_decompress_safe_inplace(char *buffer, int compressedSize,
+	int bufferSize);
+
 /**
  * LZ4_decompress_safe_partial() - Decompress a block of size 'compressedSize'
  *	at position 'source' into buffer 'dest'
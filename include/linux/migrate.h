@@ -25,6 +25,7 @@ enum migrate_reason {
 	MR_MEMPOLICY_MBIND,
 	MR_NUMA_MISPLACED,
 	MR_CONTIG_RANGE,
+	MR_DEMOTION,
 	MR_TYPES
 };
 
@@ -123,6 +124,21 @@ static inline void __ClearPageMovable(struct page *page)
 }
 #endif
 
+#if defined(CONFIG_MIGRATION) && defined(CONFIG_NUMA)
+extern int next_demotion_node(int node);
+extern bool node_is_demotion_target(int node);
+extern int set_demotion_target(int node, int target);
+#else
+static inline int next_demotion_node(int node)
+{
+	return NUMA_NO_NODE;
+}
+static inline bool node_is_demotion_target(int node)
+{
+	return false;
+}
+#endif
+
 #ifdef CONFIG_NUMA_BALANCING
 extern bool pmd_trans_migrating(pmd_t pmd);
 extern int migrate_misplaced_page(struct page *page,
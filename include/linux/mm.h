@@ -898,6 +898,21 @@ static inline void get_page(struct page *page)
 	page_ref_inc(page);
 }
 
+/*
+ * pin_user_pages_fast() takes GUP_PIN_COUNTING_BIAS references on a page
+ * instead of one, so that pages that are likely pinned for DMA can be told
+ * apart by reclaim and writeback: see page_maybe_dma_pinned().  A page
+ * with that many ordinary references is a rare false positive; a pinned
+ * page is never missed.
+ */
+#define GUP_PIN_COUNTING_BIAS (1U << 10)
+
+static inline bool page_maybe_dma_pinned(struct page *page)
+{
+	return ((unsigned int)page_ref_count(compound_head(page))) >=
+		GUP_PIN_COUNTING_BIAS;
+}
+
 static inline void put_page(struct page *page)
 {
 	page = compound_head(page);
@@ -1454,6 +1469,10 @@ static inline long get_user_pages_longterm(unsigned long start,
 
 int get_user_pages_fast(unsigned long start, int nr_pages, int write,
 			struct page **pages);
+int pin_user_pages_fast(unsigned long start, int nr_pages,
+			unsigned int gup_flags, struct page **pages);
+void unpin_user_page(struct page *page);
+void unpin_user_pages(struct page **pages, unsigned long npages);
 
 /* Container for pinned pfns / pages */
 struct frame_vector {
@@ -2274,6 +2293,8 @@ extern unsigned long do_mmap(struct file *file, unsigned long addr,
 	unsigned long len, unsigned long prot, unsigned long flags,
 	vm_flags_t vm_flags, unsigned long pgoff, unsigned long *populate,
 	struct list_head *uf);
+extern int __do_munmap(struct mm_struct *, unsigned long, size_t,
+		       struct list_head *uf, bool downgrade);
 extern int do_munmap(struct mm_struct *, unsigned long, size_t,
 		     struct list_head *uf);
 
@@ -339,6 +339,7 @@ struct core_state {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct vm_area_struct *mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
@@ -434,6 +435,10 @@ struct mm_struct {
 	spinlock_t			ioctx_lock;
 	struct kioctx_table __rcu	*ioctx_table;
 #endif
+#ifdef CONFIG_FUTEX
+	/* set up once the mm is shared, see futex_hash_allocate() */
+	struct futex_private_hash	*futex_hash;
+#endif
 #ifdef CONFIG_MEMCG
 	struct mem_cgroup __rcu	*memcg;
 #endif
@@ -383,6 +383,9 @@ struct module {
 	const s32 *gpl_future_crcs;
 	unsigned int num_gpl_future_syms;
 
+	/* All of the above, hashed by name for find_symbol(). */
+	struct module_exports *exports;
+
 	/* Exception table */
 	unsigned int num_exentries;
 	struct exception_table_entry *extable;
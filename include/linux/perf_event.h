@@ -1340,6 +1340,12 @@ extern void perf_restore_debug_store(void);
 static inline void perf_restore_debug_store(void)			{ }
 #endif
 
+#if defined(CONFIG_PERF_EVENTS) && defined(CONFIG_CMA)
+extern void perf_aux_cma_reserve(void);
+#else
+static inline void perf_aux_cma_reserve(void)				{ }
+#endif
+
 static __always_inline bool perf_raw_frag_last(const struct perf_raw_frag *frag)
 {
 	return frag->pad < sizeof(u64);
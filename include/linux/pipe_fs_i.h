@@ -38,6 +38,7 @@ struct pipe_buffer {
  *	@writers: number of current writers of this pipe
  *	@files: number of struct file referring this pipe (protected by ->i_lock)
  *	@waiting_writers: number of writers blocked waiting for room
+ *	@poll_usage: the pipe has been polled, wake up on every read and write
  *	@r_counter: reader counter
  *	@w_counter: writer counter
  *	@fasync_readers: reader side fasync
@@ -53,6 +54,7 @@ struct pipe_inode_info {
 	unsigned int writers;
 	unsigned int files;
 	unsigned int waiting_writers;
+	bool poll_usage;
 	unsigned int r_counter;
 	unsigned int w_counter;
 	struct page *tmp_page;
@@ -62,6 +64,16 @@ struct pipe_inode_info {
 	struct user_struct *user;
 };
 
+static inline bool pipe_empty(struct pipe_inode_info *pipe)
+{
+	return !pipe->nrbufs;
+}
+
+static inline bool pipe_full(struct pipe_inode_info *pipe)
+{
+	return pipe->nrbufs >= pipe->buffers;
+}
+
 /*
  * Note on the nesting of these functions:
  *
@@ -341,6 +341,10 @@ void radix_tree_iter_tag_set(struct radix_tree_root *,
 		const struct radix_tree_iter *iter, unsigned int tag);
 void radix_tree_iter_tag_clear(struct radix_tree_root *,
 		const struct radix_tree_iter *iter, unsigned int tag);
+unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
+		unsigned long *first_indexp, unsigned long last_index,
+		unsigned long nr_to_tag, unsigned int iftag,
+		unsigned int settag);
 unsigned int radix_tree_gang_lookup_tag(const struct radix_tree_root *,
 		void **results, unsigned long first_index,
 		unsigned int max_items, unsigned int tag);
@@ -160,6 +160,10 @@ struct rhashtable_params {
  * @mutex: Mutex to protect current/future table swapping
  * @lock: Spin lock to protect walker list
  * @nelems: Number of elements in table
+ * @rehash_pending: A chain grew too long while a rehash was in progress
+ * @nr_grows: Number of completed expansions
+ * @nr_shrinks: Number of completed shrinks
+ * @nr_rehashes: Number of completed rehashes at the same size
  */
 struct rhashtable {
 	struct bucket_table __rcu	*tbl;
@@ -171,6 +175,10 @@ struct rhashtable {
 	struct mutex                    mutex;
 	spinlock_t			lock;
 	atomic_t			nelems;
+	bool				rehash_pending;
+	unsigned int			nr_grows;
+	unsigned int			nr_shrinks;
+	unsigned int			nr_rehashes;
 };
 
 /**
@@ -852,6 +860,39 @@ static inline int rhashtable_insert_fast(
 	return ret == NULL ? 0 : -EEXIST;
 }
 
+/**
+ * rhashtable_insert_bulk - insert several objects into hash table
+ * @ht:		hash table
+ * @objs:	pointers to the hash heads inside the objects
+ * @n:		number of objects
+ * @errp:	error of the object which could not be inserted
+ * @params:	hash table parameters
+ *
+ * Inserts the objects in order within a single RCU read side critical
+ * section, like rhashtable_insert_fast() would one at a time.
+ *
+ * Returns the number of objects inserted.  If that is less than @n,
+ * inserting objs[ret] failed with the error stored in *@errp.
+ */
+static inline unsigned int rhashtable_insert_bulk(
+	struct rhashtable *ht, struct rhash_head **objs, unsigned int n,
+	int *errp, const struct rhashtable_params params)
+{
+	unsigned int i;
+	int err = 0;
+
+	rcu_read_lock();
+	for (i = 0; i < n; i++) {
+		err = rhashtable_insert_fast(ht, objs[i], params);
+		if (err)
+			break;
+	}
+	rcu_read_unlock();
+
+	*errp = err;
+	return i;
+}
+
 /**
  * rhltable_insert_key - insert object into hash list table
  * @hlt:	hash list table
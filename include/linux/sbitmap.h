@@ -36,6 +36,13 @@ struct sbitmap_word {
 	 * @depth: Number of bits being used in @word.
 	 */
 	unsigned long depth;
+
+	/**
+	 * @cleared: Bits freed but not yet cleared in @word.  Allocators
+	 * move them over in one go once @word is full, so that freeing
+	 * doesn't write the cacheline allocators are working on.
+	 */
+	unsigned long cleared ____cacheline_aligned_in_smp;
 } ____cacheline_aligned_in_smp;
 
 /**
@@ -248,12 +255,14 @@ static inline void __sbitmap_for_each_set(struct sbitmap *sb,
 	nr = SB_NR_TO_BIT(sb, start);
 
 	while (scanned < sb->depth) {
-		struct sbitmap_word *word = &sb->map[index];
-		unsigned int depth = min_t(unsigned int, word->depth - nr,
+		unsigned long word;
+		unsigned int depth = min_t(unsigned int,
+					   sb->map[index].depth - nr,
 					   sb->depth - scanned);
 
 		scanned += depth;
-		if (!word->word)
+		word = sb->map[index].word & ~sb->map[index].cleared;
+		if (!word)
 			goto next;
 
 		/*
@@ -263,7 +272,7 @@ static inline void __sbitmap_for_each_set(struct sbitmap *sb,
 		 */
 		depth += nr;
 		while (1) {
-			nr = find_next_bit(&word->word, depth, nr);
+			nr = find_next_bit(&word, depth, nr);
 			if (nr >= depth)
 				break;
 			if (!fn(sb, (index << sb->shift) + nr, data))
@@ -314,6 +323,18 @@ static inline void sbitmap_clear_bit_unlock(struct sbitmap *sb,
 	clear_bit_unlock(SB_NR_TO_BIT(sb, bitnr), __sbitmap_word(sb, bitnr));
 }
 
+/*
+ * Free a bit by marking it in the cleared mask of its word.  The bit is
+ * only reused once an allocator has moved the mask over to the word.
+ */
+static inline void sbitmap_deferred_clear_bit(struct sbitmap *sb,
+					      unsigned int bitnr)
+{
+	unsigned long *addr = &sb->map[SB_NR_TO_INDEX(sb, bitnr)].cleared;
+
+	set_bit(SB_NR_TO_BIT(sb, bitnr), addr);
+}
+
 static inline int sbitmap_test_bit(struct sbitmap *sb, unsigned int bitnr)
 {
 	return test_bit(SB_NR_TO_BIT(sb, bitnr), __sbitmap_word(sb, bitnr));
@@ -404,6 +425,23 @@ int __sbitmap_queue_get(struct sbitmap_queue *sbq);
 int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 				unsigned int shallow_depth);
 
+/**
+ * __sbitmap_queue_get_batch() - Try to allocate several free bits at once
+ * from a &struct sbitmap_queue with preemption already disabled.
+ * @sbq: Bitmap queue to allocate from.
+ * @nr_tags: Number of bits wanted, at most the depth of a word.
+ * @offset: Output parameter; the bit number of bit 0 of the returned mask.
+ *
+ * The bits all come from a single word with a single atomic operation, so
+ * fewer than @nr_tags may be returned.  They are freed with
+ * sbitmap_queue_clear() or sbitmap_queue_clear_batch().  Nothing is
+ * allocated from a round-robin bitmap queue.
+ *
+ * Return: Mask of the allocated bits, or 0 if none could be allocated.
+ */
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset);
+
 /**
  * sbitmap_queue_get() - Try to allocate a free bit from a &struct
  * sbitmap_queue.
@@ -477,6 +515,18 @@ void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu);
 
+/**
+ * sbitmap_queue_clear_batch() - Free several allocated bits of one word and
+ * wake up waiters on a &struct sbitmap_queue.
+ * @sbq: Bitmap to free from.
+ * @offset: Bit number of bit 0 of @mask, as returned by
+ *          __sbitmap_queue_get_batch().
+ * @mask: Bits to free.
+ * @cpu: CPU the bits were allocated on.
+ */
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, unsigned int offset,
+			       unsigned long mask, unsigned int cpu);
+
 static inline int sbq_index_inc(int index)
 {
 	return (index + 1) & (SBQ_WAIT_QUEUES - 1);
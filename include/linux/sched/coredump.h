@@ -72,8 +72,10 @@ static inline int get_dumpable(struct mm_struct *mm)
 #define MMF_DISABLE_THP		24	/* disable THP for all VMAs */
 #define MMF_OOM_VICTIM		25	/* mm is the oom victim */
 #define MMF_DISABLE_THP_MASK	(1 << MMF_DISABLE_THP)
+#define MMF_EXEC_PREFAULT	26	/* map cached file pages at exec */
+#define MMF_EXEC_PREFAULT_MASK	(1 << MMF_EXEC_PREFAULT)
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK |\
-				 MMF_DISABLE_THP_MASK)
+				 MMF_DISABLE_THP_MASK | MMF_EXEC_PREFAULT_MASK)
 
 #endif /* _LINUX_SCHED_COREDUMP_H */
@@ -36,8 +36,14 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	FREE_REMOTE_BATCH,	/* Free queued in the remote free array */
+	FREE_REMOTE_FLUSH,	/* Remote free array flushed */
+	FREE_REMOTE_SLAB,	/* Slab updated while flushing remote frees */
 	NR_SLUB_STAT_ITEMS };
 
+/* Maximum number of remote frees queued per cpu */
+#define SLUB_REMOTE_BATCH_MAX	16
+
 struct kmem_cache_cpu {
 	void **freelist;	/* Pointer to next available object */
 	unsigned long tid;	/* Globally unique transaction id */
@@ -45,6 +51,10 @@ struct kmem_cache_cpu {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 	struct page *partial;	/* Partially allocated frozen slabs */
 #endif
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+	unsigned int nr_remote;	/* Number of queued remote frees */
+	void *remote[SLUB_REMOTE_BATCH_MAX];	/* Frees not to cpu slab */
+#endif
 #ifdef CONFIG_SLUB_STATS
 	unsigned stat[NR_SLUB_STAT_ITEMS];
 #endif
@@ -67,6 +77,12 @@ struct kmem_cache_cpu {
 #define slub_percpu_partial_read_once(c)	NULL
 #endif // CONFIG_SLUB_CPU_PARTIAL
 
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+#define slub_percpu_remote(c)		((c)->nr_remote)
+#else
+#define slub_percpu_remote(c)		0
+#endif
+
 /*
  * Word size structure that can be atomically updated or read and that
  * contains both the order and the number of objects that a slab of the
@@ -90,6 +106,10 @@ struct kmem_cache {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 	/* Number of per cpu partial objects to keep around */
 	unsigned int cpu_partial;
+#endif
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+	/* Number of remote frees to queue per cpu before flushing */
+	unsigned int remote_batch;
 #endif
 	struct kmem_cache_order_objects oo;
 
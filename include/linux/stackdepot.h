@@ -29,4 +29,8 @@ depot_stack_handle_t depot_save_stack(struct stack_trace *trace, gfp_t flags);
 
 void depot_fetch_stack(depot_stack_handle_t handle, struct stack_trace *trace);
 
+void depot_stack_count_add(depot_stack_handle_t handle, long nr);
+
+depot_stack_handle_t depot_next_stack(loff_t *pos, long *count);
+
 #endif
@@ -11,11 +11,15 @@
 #ifndef _LINUX_SYSCALLS_H
 #define _LINUX_SYSCALLS_H
 
+struct cachestat;
+struct cachestat_inode;
+struct cachestat_range;
 struct epoll_event;
 struct iattr;
 struct inode;
 struct iocb;
 struct io_event;
+struct io_uring_params;
 struct iovec;
 struct itimerspec;
 struct itimerval;
@@ -296,6 +300,11 @@ asmlinkage long sys_io_pgetevents(aio_context_t ctx_id,
 				struct io_event __user *events,
 				struct timespec __user *timeout,
 				const struct __aio_sigset *sig);
+asmlinkage long sys_io_uring_setup(u32 entries,
+				struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				u32 min_complete, u32 flags,
+				const sigset_t __user *sig, size_t sigsz);
 
 /* fs/xattr.c */
 asmlinkage long sys_setxattr(const char __user *path, const char __user *name,
@@ -332,6 +341,7 @@ asmlinkage long sys_eventfd2(unsigned int count, int flags);
 
 /* fs/eventpoll.c */
 asmlinkage long sys_epoll_create1(int flags);
+asmlinkage long sys_epoll_create2(int flags, unsigned int size);
 asmlinkage long sys_epoll_ctl(int epfd, int op, int fd,
 				struct epoll_event __user *event);
 asmlinkage long sys_epoll_pwait(int epfd, struct epoll_event __user *events,
@@ -737,6 +747,13 @@ asmlinkage long sys_recvmsg(int fd, struct user_msghdr __user *msg, unsigned fla
 
 /* mm/filemap.c */
 asmlinkage long sys_readahead(int fd, loff_t offset, size_t count);
+asmlinkage long sys_cachestat(unsigned int fd,
+				struct cachestat_range __user *range,
+				struct cachestat __user *cstat,
+				unsigned int flags);
+asmlinkage long sys_cachestat_sb(unsigned int fd, __u64 __user *pos,
+				struct cachestat_inode __user *buf,
+				unsigned int count, unsigned int flags);
 
 /* mm/nommu.c, also with MMU */
 asmlinkage long sys_brk(unsigned long brk);
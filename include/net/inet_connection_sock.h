@@ -303,6 +303,7 @@ static inline __poll_t inet_csk_listen_poll(const struct sock *sk)
 
 int inet_csk_listen_start(struct sock *sk, int backlog);
 void inet_csk_listen_stop(struct sock *sk);
+void inet_csk_listen_stop_migrate(struct sock *sk, struct sock *nsk);
 
 void inet_csk_addr2sockaddr(struct sock *sk, struct sockaddr *uaddr);
 
@@ -20,11 +20,20 @@ struct nf_flowtable_type {
 	struct module			*owner;
 };
 
+#define NF_FLOWTABLE_F_HW		0x1
+
 struct nf_flowtable {
 	struct list_head		list;
 	struct rhashtable		rhashtable;
 	const struct nf_flowtable_type	*type;
+	u32				flags;
 	struct delayed_work		gc_work;
+	/* hardware offload, see nf_flow_offload_hw_work() */
+	struct work_struct		hw_work;
+	spinlock_t			hw_lock;
+	struct list_head		hw_pending;
+	struct list_head		hw_flows;
+	bool				hw_stats;
 };
 
 enum flow_offload_tuple_dir {
@@ -81,6 +90,27 @@ struct flow_offload {
 
 #define NF_FLOW_TIMEOUT (30 * HZ)
 
+enum nf_flow_offload_hw_command {
+	FLOW_OFFLOAD_HW_ADD,
+	FLOW_OFFLOAD_HW_DEL,
+	FLOW_OFFLOAD_HW_STATS,
+};
+
+/* Passed to ndo_setup_tc(TC_SETUP_FT) on the input device of one
+ * direction of an established flow, under RTNL. The driver forwards
+ * matching packets to the output device of the tuple, applying the
+ * NAT described by the flow flags and the tuples of both directions,
+ * and must still pass up TCP packets with FIN or RST set so that the
+ * software flowtable can tear the flow down. On FLOW_OFFLOAD_HW_STATS
+ * it reports in lastused the last time (jiffies) it matched a packet.
+ */
+struct nf_flow_offload_hw {
+	enum nf_flow_offload_hw_command	command;
+	const struct flow_offload	*flow;
+	enum flow_offload_tuple_dir	dir;
+	unsigned long			lastused;
+};
+
 struct nf_flow_route {
 	struct {
 		struct dst_entry	*dst;
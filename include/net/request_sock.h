@@ -154,16 +154,29 @@ struct fastopen_queue {
 	struct tcp_fastopen_context __rcu *ctx; /* cipher context for cookie */
 };
 
+/* One cpu's slice of a listener's accept queue (TCP_ACCEPT_PERCPU).
+ * Children are queued on the cpu that completed the handshake.
+ */
+struct request_sock_shard {
+	spinlock_t		lock;
+	struct request_sock	*head;
+	struct request_sock	*tail;
+};
+
 /** struct request_sock_queue - queue of request_socks
  *
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
  * @rskq_defer_accept - User waits for some data after accept()
+ * @rskq_percpu - User asked for per-cpu accept queues at listen()
+ * @rskq_shards - Per-cpu accept queues, used instead of the FIFO if set
+ * @rskq_shard_qlen - Number of children queued in @rskq_shards
  *
  */
 struct request_sock_queue {
 	spinlock_t		rskq_lock;
 	u8			rskq_defer_accept;
+	u8			rskq_percpu;
 
 	u32			synflood_warned;
 	atomic_t		qlen;
@@ -174,23 +187,45 @@ struct request_sock_queue {
 	struct fastopen_queue	fastopenq;  /* Check max_qlen != 0 to determine
 					     * if TFO is enabled.
 					     */
+
+	struct request_sock_shard __percpu *rskq_shards;
+	atomic_t		rskq_shard_qlen;
 };
 
 void reqsk_queue_alloc(struct request_sock_queue *queue);
+int reqsk_queue_alloc_shards(struct request_sock_queue *queue);
+void reqsk_queue_free_shards(struct request_sock_queue *queue);
+struct request_sock *reqsk_queue_remove_shard(struct request_sock_queue *queue,
+					      struct sock *parent);
 
 void reqsk_fastopen_remove(struct sock *sk, struct request_sock *req,
 			   bool reset);
 
 static inline bool reqsk_queue_empty(const struct request_sock_queue *queue)
 {
+	if (queue->rskq_shards)
+		return !atomic_read(&queue->rskq_shard_qlen);
 	return queue->rskq_accept_head == NULL;
 }
 
+/* With per-cpu accept queues the backlog is counted in rskq_shard_qlen,
+ * sk_ack_backlog only mirrors it for the backlog limit and for diag.
+ */
+static inline void reqsk_shard_acceptq_update(struct request_sock_queue *queue,
+					      struct sock *parent, int delta)
+{
+	WRITE_ONCE(parent->sk_ack_backlog,
+		   atomic_add_return(delta, &queue->rskq_shard_qlen));
+}
+
 static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue *queue,
 						      struct sock *parent)
 {
 	struct request_sock *req;
 
+	if (queue->rskq_shards)
+		return reqsk_queue_remove_shard(queue, parent);
+
 	spin_lock_bh(&queue->rskq_lock);
 	req = queue->rskq_accept_head;
 	if (req) {
@@ -10,6 +10,7 @@
 #include <linux/percpu.h>
 #include <linux/dynamic_queue_limits.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/refcount.h>
 #include <linux/workqueue.h>
 #include <net/gen_stats.h>
@@ -30,6 +31,7 @@ struct qdisc_rate_table {
 enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
+	__QDISC_STATE_DEFERRED,
 };
 
 struct qdisc_size_table {
@@ -73,6 +75,10 @@ struct Qdisc {
 #define TCQ_F_INVISIBLE		0x80 /* invisible by default in dump */
 #define TCQ_F_NOLOCK		0x100 /* qdisc does not require locking */
 #define TCQ_F_OFFLOADED		0x200 /* qdisc is offloaded to HW */
+#define TCQ_F_DEFER		0x400 /* contended enqueues are staged in
+				       * per cpu queues and drained by the
+				       * CPU running the qdisc.
+				       */
 	u32			limit;
 	const struct Qdisc_ops	*ops;
 	struct qdisc_size_table	__rcu *stab;
@@ -85,6 +91,7 @@ struct Qdisc {
 	struct net_rate_estimator __rcu *rate_est;
 	struct gnet_stats_basic_cpu __percpu *cpu_bstats;
 	struct gnet_stats_queue	__percpu *cpu_qstats;
+	struct qdisc_defer_queue __percpu *defer_q;
 
 	/*
 	 * For performance sake on SMP, we put highly modified fields at the end
@@ -104,6 +111,14 @@ struct Qdisc {
 	spinlock_t		seqlock;
 };
 
+/* Per cpu staging queue for TCQ_F_DEFER qdiscs */
+struct qdisc_defer_queue {
+	struct llist_head	head;
+	atomic_t		len;
+};
+
+#define QDISC_DEFER_LIMIT	64
+
 static inline void qdisc_refcount_inc(struct Qdisc *qdisc)
 {
 	if (qdisc->flags & TCQ_F_BUILTIN)
@@ -139,6 +154,15 @@ static inline void qdisc_run_end(struct Qdisc *qdisc)
 	write_seqcount_end(&qdisc->running);
 	if (qdisc->flags & TCQ_F_NOLOCK)
 		spin_unlock(&qdisc->seqlock);
+
+	/* Pairs with qdisc_defer_enqueue(): skbs staged while we were
+	 * running are either seen here or by the stager itself.
+	 */
+	if (qdisc->flags & TCQ_F_DEFER) {
+		smp_mb();
+		if (test_bit(__QDISC_STATE_DEFERRED, &qdisc->state))
+			__netif_schedule(qdisc);
+	}
 }
 
 static inline bool qdisc_may_bulk(const struct Qdisc *qdisc)
@@ -508,6 +532,8 @@ void dev_deactivate_many(struct list_head *head);
 struct Qdisc *dev_graft_qdisc(struct netdev_queue *dev_queue,
 			      struct Qdisc *qdisc);
 void qdisc_reset(struct Qdisc *qdisc);
+bool qdisc_defer_enqueue(struct sk_buff *skb, struct Qdisc *q);
+void qdisc_defer_drain(struct Qdisc *q);
 void qdisc_destroy(struct Qdisc *qdisc);
 void qdisc_tree_reduce_backlog(struct Qdisc *qdisc, unsigned int n,
 			       unsigned int len);
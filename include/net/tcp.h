@@ -702,9 +702,12 @@ void tcp_send_window_probe(struct sock *sk);
  */
 #define TCP_TS_HZ	1000
 
+/* CLOCK_MONOTONIC based, as the departure times TCP stores in skb->tstamp
+ * are compared with ktime_get_ns() by pacing qdiscs.
+ */
 static inline u64 tcp_clock_ns(void)
 {
-	return local_clock();
+	return ktime_get_ns();
 }
 
 static inline u64 tcp_clock_us(void)
@@ -725,13 +728,17 @@ static inline u32 tcp_time_stamp_raw(void)
 }
 
 
-/* Refresh 1us clock of a TCP socket,
- * ensuring monotically increasing values.
+/* Refresh 1us clock of a TCP socket, and the ns clock cache used for
+ * departure times, ensuring monotically increasing values.
  */
 static inline void tcp_mstamp_refresh(struct tcp_sock *tp)
 {
-	u64 val = tcp_clock_us();
+	u64 val = tcp_clock_ns();
+
+	if (val > tp->tcp_clock_cache)
+		tp->tcp_clock_cache = val;
 
+	val = div_u64(val, NSEC_PER_USEC);
 	if (val > tp->tcp_mstamp)
 		tp->tcp_mstamp = val;
 }
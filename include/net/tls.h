@@ -58,6 +58,16 @@
 #define TLS_AAD_SPACE_SIZE		13
 #define TLS_DEVICE_NAME_MAX		32
 
+enum {
+	TLS_BASE,
+	TLS_SW,
+#ifdef CONFIG_TLS_DEVICE
+	TLS_HW,
+#endif
+	TLS_HW_RECORD,
+	TLS_NUM_CONFIG,
+};
+
 /*
  * This structure defines the routines for Inline TLS driver.
  * The following routines are optional and filled with a
@@ -138,7 +148,6 @@ struct tls_offload_context {
 	u64 unacked_record_sn;
 
 	struct scatterlist sg_tx_data[MAX_SKB_FRAGS];
-	void (*sk_destruct)(struct sock *sk);
 	u8 driver_state[];
 	/* The TLS layer reserves room for driver specific state
 	 * Currently the belief is that there is not enough
@@ -151,8 +160,28 @@ struct tls_offload_context {
 	(ALIGN(sizeof(struct tls_offload_context), sizeof(void *)) +           \
 	 TLS_DRIVER_STATE_SIZE)
 
+struct tls_offload_context_rx {
+	/* sw must be the first member of tls_offload_context_rx */
+	struct tls_sw_context_rx sw;
+	/* resync request from the driver: TCP sequence of the expected
+	 * record header in the upper 32 bits, bit 0 set while pending
+	 */
+	atomic64_t resync_req;
+	u8 driver_state[];
+	/* The TLS layer reserves room for driver specific state
+	 * Currently the belief is that there is not enough
+	 * driver specific state to justify another layer of indirection
+	 */
+};
+
+#define TLS_OFFLOAD_CONTEXT_SIZE_RX                                            \
+	(ALIGN(sizeof(struct tls_offload_context_rx), sizeof(void *)) +        \
+	 TLS_DRIVER_STATE_SIZE)
+
 enum {
-	TLS_PENDING_CLOSED_RECORD
+	TLS_PENDING_CLOSED_RECORD,
+	TLS_RX_SYNC_RUNNING,
+	TLS_RX_DEV_CLOSED,
 };
 
 struct cipher_context {
@@ -197,6 +226,7 @@ struct tls_context {
 	int (*push_pending_record)(struct sock *sk, int flags);
 
 	void (*sk_write_space)(struct sock *sk);
+	void (*sk_destruct)(struct sock *sk);
 	void (*sk_proto_close)(struct sock *sk, long timeout);
 
 	int  (*setsockopt)(struct sock *sk, int level,
@@ -223,6 +253,7 @@ int tls_sw_sendpage(struct sock *sk, struct page *page,
 void tls_sw_close(struct sock *sk, long timeout);
 void tls_sw_free_resources_tx(struct sock *sk);
 void tls_sw_free_resources_rx(struct sock *sk);
+void tls_sw_release_resources_rx(struct sock *sk);
 int tls_sw_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
 		   int nonblock, int flags, int *addr_len);
 unsigned int tls_sw_poll(struct file *file, struct socket *sock,
@@ -238,6 +269,9 @@ int tls_device_sendpage(struct sock *sk, struct page *page,
 void tls_device_sk_destruct(struct sock *sk);
 void tls_device_init(void);
 void tls_device_cleanup(void);
+struct sk_buff *tls_validate_xmit_skb(struct sock *sk,
+				      struct net_device *dev,
+				      struct sk_buff *skb);
 
 struct tls_record_info *tls_get_record(struct tls_offload_context *context,
 				       u32 seq, u64 *p_record_sn);
@@ -293,7 +327,8 @@ static inline bool tls_is_sk_tx_device_offloaded(struct sock *sk)
 {
 	return sk_fullsock(sk) &&
 	       /* matches smp_store_release in tls_set_device_offload */
-	       smp_load_acquire(&sk->sk_destruct) == &tls_device_sk_destruct;
+	       smp_load_acquire(&sk->sk_validate_xmit_skb) ==
+			&tls_validate_xmit_skb;
 }
 
 static inline void tls_err_abort(struct sock *sk, int err)
@@ -386,17 +421,39 @@ static inline struct tls_offload_context *tls_offload_ctx(
 	return (struct tls_offload_context *)tls_ctx->priv_ctx_tx;
 }
 
+static inline struct tls_offload_context_rx *tls_offload_ctx_rx(
+		const struct tls_context *tls_ctx)
+{
+	return (struct tls_offload_context_rx *)tls_ctx->priv_ctx_rx;
+}
+
+/* Called by the driver when it lost track of the record boundaries, @seq
+ * is the TCP sequence number at which it expects the next record header.
+ * The request is answered through tlsdev_ops->tls_dev_resync_rx() once
+ * the stack parses a record starting at @seq.
+ */
+static inline void tls_offload_rx_resync_request(struct sock *sk, u32 seq)
+{
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
+	struct tls_offload_context_rx *rx_ctx = tls_offload_ctx_rx(tls_ctx);
+
+	atomic64_set(&rx_ctx->resync_req, ((u64)seq << 32) | 1);
+}
+
 int tls_proccess_cmsg(struct sock *sk, struct msghdr *msg,
 		      unsigned char *record_type);
 void tls_register_device(struct tls_device *device);
 void tls_unregister_device(struct tls_device *device);
 
-struct sk_buff *tls_validate_xmit_skb(struct sock *sk,
-				      struct net_device *dev,
-				      struct sk_buff *skb);
-
 int tls_sw_fallback_init(struct sock *sk,
 			 struct tls_offload_context *offload_ctx,
 			 struct tls_crypto_info *crypto_info);
 
+int tls_set_device_offload_rx(struct sock *sk, struct tls_context *ctx);
+void tls_device_offload_cleanup_rx(struct sock *sk);
+void tls_device_rx_resync_new_rec(struct sock *sk, u32 seq);
+int tls_device_decrypted(struct sock *sk, struct sk_buff *skb);
+int decrypt_skb(struct sock *sk, struct sk_buff *skb,
+		struct scatterlist *sgout);
+
 #endif /* _TLS_OFFLOAD_H */
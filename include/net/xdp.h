@@ -6,6 +6,8 @@
 #ifndef __LINUX_NET_XDP_H__
 #define __LINUX_NET_XDP_H__
 
+#include <linux/skbuff.h> /* skb_shared_info */
+
 /**
  * DOC: XDP RX-queue information
  *
@@ -33,10 +35,26 @@
  * also mandatory during RX-ring setup.
  */
 
+/**
+ * DOC: XDP multi-buffer frames
+ *
+ * A driver whose RX-ring can spread a frame over several buffers
+ * (jumbo MTU, HW-GRO/LRO) announces the size of each buffer with
+ * xdp_rxq_info_set_frag_size().  The first buffer is then described
+ * by the xdp_buff as usual, and the remaining buffers are listed as
+ * page frags in a struct skb_shared_info placed at the very end of
+ * that first buffer, exactly where build_skb() expects it.  The
+ * driver must reserve this tailroom and call xdp_buff_init_frags()
+ * for every frame, before appending frags with xdp_buff_add_frag().
+ *
+ * All frags use the same memory model as the head buffer.
+ */
+
 enum xdp_mem_type {
 	MEM_TYPE_PAGE_SHARED = 0, /* Split-page refcnt based model */
 	MEM_TYPE_PAGE_ORDER0,     /* Orig XDP full page model */
 	MEM_TYPE_PAGE_POOL,
+	MEM_TYPE_ZERO_COPY,
 	MEM_TYPE_MAX,
 };
 
@@ -47,11 +65,19 @@ struct xdp_mem_info {
 
 struct page_pool;
 
+/* MEM_TYPE_ZERO_COPY allocator: buffers belong to an AF_XDP UMEM and are
+ * identified by the driver supplied xdp_buff handle.
+ */
+struct zero_copy_allocator {
+	void (*free)(struct zero_copy_allocator *zca, unsigned long handle);
+};
+
 struct xdp_rxq_info {
 	struct net_device *dev;
 	u32 queue_index;
 	u32 reg_state;
 	struct xdp_mem_info mem;
+	u32 frag_size; /* non-zero if frames can carry frags */
 } ____cacheline_aligned; /* perf critical, avoid false-sharing */
 
 struct xdp_buff {
@@ -59,6 +85,7 @@ struct xdp_buff {
 	void *data_end;
 	void *data_meta;
 	void *data_hard_start;
+	unsigned long handle;
 	struct xdp_rxq_info *rxq;
 };
 
@@ -72,8 +99,87 @@ struct xdp_frame {
 	 */
 	struct xdp_mem_info mem;
 	struct net_device *dev_rx; /* used by cpumap */
+	u32 frame_sz; /* non-zero if frags follow in the tailroom */
 };
 
+static __always_inline struct skb_shared_info *
+__xdp_shared_info(void *hard_start, u32 frame_sz)
+{
+	return hard_start + frame_sz -
+	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+}
+
+static __always_inline struct skb_shared_info *
+xdp_get_shared_info_from_buff(const struct xdp_buff *xdp)
+{
+	return __xdp_shared_info(xdp->data_hard_start, xdp->rxq->frag_size);
+}
+
+static __always_inline bool xdp_buff_has_frags(const struct xdp_buff *xdp)
+{
+	return xdp->rxq->frag_size &&
+	       xdp_get_shared_info_from_buff(xdp)->nr_frags;
+}
+
+static __always_inline void xdp_buff_init_frags(struct xdp_buff *xdp)
+{
+	xdp_get_shared_info_from_buff(xdp)->nr_frags = 0;
+}
+
+/* Returns false if the frame already holds MAX_SKB_FRAGS frags */
+static __always_inline bool xdp_buff_add_frag(struct xdp_buff *xdp,
+					      struct page *page,
+					      unsigned int off,
+					      unsigned int size)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_buff(xdp);
+	skb_frag_t *frag;
+
+	if (unlikely(sinfo->nr_frags >= MAX_SKB_FRAGS))
+		return false;
+
+	frag = &sinfo->frags[sinfo->nr_frags++];
+	__skb_frag_set_page(frag, page);
+	frag->page_offset = off;
+	skb_frag_size_set(frag, size);
+	return true;
+}
+
+static inline unsigned int
+xdp_shared_info_frags_len(const struct skb_shared_info *sinfo)
+{
+	unsigned int i, len = 0;
+
+	for (i = 0; i < sinfo->nr_frags; i++)
+		len += skb_frag_size(&sinfo->frags[i]);
+
+	return len;
+}
+
+/* Full length of the frame, head buffer plus all frags */
+static inline unsigned int xdp_get_buff_len(const struct xdp_buff *xdp)
+{
+	unsigned int len = xdp->data_end - xdp->data;
+
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		len += xdp_shared_info_frags_len(
+				xdp_get_shared_info_from_buff(xdp));
+	return len;
+}
+
+static __always_inline bool xdp_frame_has_frags(const struct xdp_frame *xdpf)
+{
+	return xdpf->frame_sz;
+}
+
+static __always_inline struct skb_shared_info *
+xdp_get_shared_info_from_frame(const struct xdp_frame *xdpf)
+{
+	void *hard_start = xdpf->data - xdpf->headroom - sizeof(*xdpf);
+
+	return __xdp_shared_info(hard_start, xdpf->frame_sz);
+}
+
 /* Convert xdp_buff to xdp_frame */
 static inline
 struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
@@ -82,6 +188,12 @@ struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
 	int metasize;
 	int headroom;
 
+	/* Zero-copy buffers belong to the UMEM, they cannot be handed
+	 * over to another device or cpu.
+	 */
+	if (xdp->rxq->mem.type == MEM_TYPE_ZERO_COPY)
+		return NULL;
+
 	/* Assure headroom is available for storing info */
 	headroom = xdp->data - xdp->data_hard_start;
 	metasize = xdp->data - xdp->data_meta;
@@ -97,6 +209,9 @@ struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
 	xdp_frame->headroom = headroom - sizeof(*xdp_frame);
 	xdp_frame->metasize = metasize;
 
+	/* Frags stay in the tailroom, only remember where it ends */
+	xdp_frame->frame_sz = xdp_buff_has_frags(xdp) ? xdp->rxq->frag_size : 0;
+
 	/* rxq only valid until napi_schedule ends, convert to xdp_mem_info */
 	xdp_frame->mem = xdp->rxq->mem;
 
@@ -105,6 +220,7 @@ struct xdp_frame *convert_to_xdp_frame(struct xdp_buff *xdp)
 
 void xdp_return_frame(struct xdp_frame *xdpf);
 void xdp_return_buff(struct xdp_buff *xdp);
+void xdp_return_frag(skb_frag_t *frag, struct xdp_mem_info *mem);
 
 int xdp_rxq_info_reg(struct xdp_rxq_info *xdp_rxq,
 		     struct net_device *dev, u32 queue_index);
@@ -113,6 +229,7 @@ void xdp_rxq_info_unused(struct xdp_rxq_info *xdp_rxq);
 bool xdp_rxq_info_is_reg(struct xdp_rxq_info *xdp_rxq);
 int xdp_rxq_info_reg_mem_model(struct xdp_rxq_info *xdp_rxq,
 			       enum xdp_mem_type type, void *allocator);
+int xdp_rxq_info_set_frag_size(struct xdp_rxq_info *xdp_rxq, u32 frag_size);
 
 /* Drivers not supporting XDP metadata can use this helper, which
  * rejects any room expansion for metadata as a result.
@@ -2483,6 +2483,16 @@ struct ib_device {
 	struct ib_mr *             (*reg_dm_mr)(struct ib_pd *pd, struct ib_dm *dm,
 						struct ib_dm_mr_attr *attr,
 						struct uverbs_attr_bundle *attrs);
+	/*
+	 * Fault in and map the ranges of on-demand paging MRs of @pd given
+	 * in @sg_list ahead of the device accessing them.
+	 */
+	int                        (*advise_mr)(struct ib_pd *pd,
+						enum ib_uverbs_advise_mr_advice advice,
+						u32 flags,
+						struct ib_sge *sg_list,
+						u32 num_sge,
+						struct uverbs_attr_bundle *attrs);
 	/**
 	 * rdma netdev operation
 	 *
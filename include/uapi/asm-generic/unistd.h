@@ -734,9 +734,19 @@ __SYSCALL(__NR_pkey_free,     sys_pkey_free)
 __SYSCALL(__NR_statx,     sys_statx)
 #define __NR_io_pgetevents 292
 __SC_COMP(__NR_io_pgetevents, sys_io_pgetevents, compat_sys_io_pgetevents)
+#define __NR_io_uring_setup 293
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 294
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_epoll_create2 295
+__SYSCALL(__NR_epoll_create2, sys_epoll_create2)
+#define __NR_cachestat 296
+__SYSCALL(__NR_cachestat, sys_cachestat)
+#define __NR_cachestat_sb 297
+__SYSCALL(__NR_cachestat_sb, sys_cachestat_sb)
 
 #undef __NR_syscalls
-#define __NR_syscalls 293
+#define __NR_syscalls 298
 
 /*
  * 32 bit systems traditionally used different
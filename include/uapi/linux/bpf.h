@@ -97,6 +97,10 @@ enum bpf_cmd {
 	BPF_RAW_TRACEPOINT_OPEN,
 	BPF_BTF_LOAD,
 	BPF_BTF_GET_FD_BY_ID,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
 };
 
 enum bpf_map_type {
@@ -119,6 +123,8 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_CPUMAP,
 	BPF_MAP_TYPE_XSKMAP,
 	BPF_MAP_TYPE_SOCKHASH,
+	BPF_MAP_TYPE_RINGBUF,
+	BPF_MAP_TYPE_SK_STORAGE,
 };
 
 enum bpf_prog_type {
@@ -141,6 +147,7 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_SK_MSG,
 	BPF_PROG_TYPE_RAW_TRACEPOINT,
 	BPF_PROG_TYPE_CGROUP_SOCK_ADDR,
+	BPF_PROG_TYPE_TRACING,
 };
 
 enum bpf_attach_type {
@@ -158,6 +165,8 @@ enum bpf_attach_type {
 	BPF_CGROUP_INET6_CONNECT,
 	BPF_CGROUP_INET4_POST_BIND,
 	BPF_CGROUP_INET6_POST_BIND,
+	BPF_TRACE_FENTRY,
+	BPF_TRACE_FEXIT,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -258,6 +267,17 @@ enum bpf_stack_build_id_status {
 	BPF_STACK_BUILD_ID_IP = 2,
 };
 
+/* BPF_PROG_TEST_RUN latency histogram: bucket 0 counts runs taking
+ * less than 1ns, bucket n runs taking [2^(n-1), 2^n) ns. The last
+ * bucket also counts all slower runs.
+ */
+#define BPF_TEST_RUN_HIST_MAX	64
+
+struct bpf_test_run_perf {
+	__u64	instructions;
+	__u64	cache_misses;
+};
+
 #define BPF_BUILD_ID_SIZE 20
 struct bpf_stack_build_id {
 	__s32		status;
@@ -298,6 +318,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -315,6 +352,13 @@ union bpf_attr {
 		 * (context accesses, allowed helpers, etc).
 		 */
 		__u32		expected_attach_type;
+		/* Kernel function a BPF_PROG_TYPE_TRACING program is
+		 * attached to and its number of arguments. The program
+		 * context is an array of that many u64 arguments, followed
+		 * by the return value for BPF_TRACE_FEXIT.
+		 */
+		__u32		attach_func_nargs;
+		__aligned_u64	attach_func_name;
 	};
 
 	struct { /* anonymous struct used by BPF_OBJ_* commands */
@@ -339,6 +383,16 @@ union bpf_attr {
 		__aligned_u64	data_out;
 		__u32		repeat;
 		__u32		duration;
+		/* Optional benchmark output, each is filled in when
+		 * non-zero: a latency histogram, the cycles each of the
+		 * first cycles_size runs took and the perf counter deltas
+		 * over all runs.
+		 */
+		__u32		hist_size;	/* entries in hist */
+		__u32		cycles_size;	/* entries in cycles */
+		__aligned_u64	hist;		/* __u64[hist_size] */
+		__aligned_u64	cycles;		/* __u64[cycles_size] */
+		__aligned_u64	perf;		/* struct bpf_test_run_perf */
 	} test;
 
 	struct { /* anonymous struct used by BPF_*_GET_*_ID */
@@ -368,7 +422,7 @@ union bpf_attr {
 	} query;
 
 	struct {
-		__u64 name;
+		__u64 name;	/* 0 for BPF_PROG_TYPE_TRACING programs */
 		__u32 prog_fd;
 	} raw_tracepoint;
 
@@ -1902,6 +1956,78 @@ union bpf_attr {
  *		egress otherwise). This is the only flag supported for now.
  *	Return
  *		**SK_PASS** on success, or **SK_DROP** on error.
+ *
+ * int bpf_xdp_get_buff_len(struct xdp_buff *xdp_md)
+ *	Description
+ *		Get the total size of the frame, including the data held in
+ *		frags when the driver built a multi-buffer frame. Direct
+ *		packet access only covers the first buffer, that is
+ *		*xdp_md*\ **->data** up to *xdp_md*\ **->data_end**.
+ *	Return
+ *		The length of the frame.
+ *
+ * int bpf_xdp_load_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		This helper is provided as an easy way to load data from an
+ *		XDP frame that may span several buffers. It reads *len*
+ *		bytes from *offset* into *buf*.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_xdp_store_bytes(struct xdp_buff *xdp_md, u32 offset, void *buf, u32 len)
+ *	Description
+ *		Store *len* bytes from *buf* into the XDP frame at *offset*,
+ *		which may lie in any of the buffers of a multi-buffer frame.
+ *	Return
+ *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_ringbuf_output(void *ringbuf, void *data, u64 size, u64 flags)
+ *	Description
+ *		Copy *size* bytes from *data* into a new record of the ring
+ *		buffer *ringbuf*, a map of type **BPF_MAP_TYPE_RINGBUF**
+ *		shared by all CPUs. Records from concurrent producers are
+ *		laid out in the order their space was reserved.
+ *
+ *		By default, the consumer is woken up when it has caught up
+ *		with the new record. **BPF_RB_NO_WAKEUP** suppresses the
+ *		wakeup, **BPF_RB_FORCE_WAKEUP** forces it.
+ *	Return
+ *		0 on success, **-EAGAIN** if the ring buffer is full, or
+ *		another negative error in case of failure.
+ *
+ * u64 bpf_ringbuf_query(void *ringbuf, u64 flags)
+ *	Description
+ *		Query a property of the ring buffer *ringbuf*, selected by
+ *		*flags*: **BPF_RB_AVAIL_DATA** for the amount of data not
+ *		consumed yet, **BPF_RB_RING_SIZE** for the size of the data
+ *		area, **BPF_RB_CONS_POS** and **BPF_RB_PROD_POS** for the
+ *		consumer and producer positions. The values are only a
+ *		snapshot and may be stale by the time they are used.
+ *	Return
+ *		The requested value, or 0 if *flags* is not known.
+ *
+ * void *bpf_sk_storage_get(struct bpf_map *map, void *ctx, void *value, u64 flags)
+ *	Description
+ *		Get the storage of *map*, a map of type
+ *		**BPF_MAP_TYPE_SK_STORAGE**, attached to the socket of the
+ *		program context *ctx*: the socket of the skb for cgroup
+ *		skb and tc programs, the socket being operated on for
+ *		sock_ops programs.
+ *
+ *		If there is no storage yet and *flags* has
+ *		**BPF_SK_STORAGE_GET_F_CREATE**, new storage is created,
+ *		initialized from *value* if it isn't NULL, or zeroed
+ *		otherwise.
+ *	Return
+ *		A pointer to the storage, or NULL if there is no socket or
+ *		no storage, or if creating it failed.
+ *
+ * int bpf_sk_storage_delete(struct bpf_map *map, void *ctx)
+ *	Description
+ *		Delete the storage of *map* attached to the socket of the
+ *		program context *ctx*.
+ *	Return
+ *		0 on success, **-ENOENT** if there is no such storage.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -1976,7 +2102,14 @@ union bpf_attr {
 	FN(fib_lookup),			\
 	FN(sock_hash_update),		\
 	FN(msg_redirect_hash),		\
-	FN(sk_redirect_hash),
+	FN(sk_redirect_hash),		\
+	FN(xdp_get_buff_len),		\
+	FN(xdp_load_bytes),		\
+	FN(xdp_store_bytes),		\
+	FN(ringbuf_output),		\
+	FN(ringbuf_query),		\
+	FN(sk_storage_get),		\
+	FN(sk_storage_delete),
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -2032,6 +2165,29 @@ enum bpf_func_id {
 /* BPF_FUNC_perf_event_output for sk_buff input context. */
 #define BPF_F_CTXLEN_MASK		(0xfffffULL << 32)
 
+/* BPF_FUNC_sk_storage_get flags */
+#define BPF_SK_STORAGE_GET_F_CREATE	(1ULL << 0)
+
+/* BPF_FUNC_ringbuf_output flags. */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_FUNC_ringbuf_query flags. */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* Layout of a BPF_MAP_TYPE_RINGBUF record: an 8 byte header, whose
+ * first 32 bits hold the data length, followed by the data, padded to
+ * 8 bytes. The consumer must stop at a record that still has the busy
+ * bit set in its length, it is being written by a producer.
+ */
+#define BPF_RINGBUF_BUSY_BIT		(1U << 31)
+#define BPF_RINGBUF_HDR_SZ		8
+
 /* Mode for BPF_FUNC_skb_adjust_room helper. */
 enum bpf_adj_room_mode {
 	BPF_ADJ_ROOM_NET,
@@ -2205,6 +2361,10 @@ struct bpf_prog_info {
 	__u32 gpl_compatible:1;
 	__u64 netns_dev;
 	__u64 netns_ino;
+	__u64 verif_time;	/* ns spent in the verifier */
+	__u32 verified_insns;	/* insns processed by the verifier */
+	__u32 verified_states;	/* states kept for search pruning */
+	__u32 pruned_states;	/* paths cut short by search pruning */
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -22,6 +22,22 @@
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
 
+/* Flags for epoll_create2: deliver events through a user-mapped ring */
+#define EPOLL_USERPOLL 1
+
+/*
+ * Wake policy flags for epoll_create1 and epoll_create2.  By default the
+ * thread that went to sleep in epoll_wait last is woken first.
+ * EPOLL_WAKE_LOCAL prefers a thread that last ran on, or shares a cache
+ * with, the CPU delivering the event.  EPOLL_WAKE_ROTATE moves the
+ * EPOLLEXCLUSIVE items of the descriptor behind the other exclusive
+ * waiters of the target each time one of them takes a wakeup, spreading
+ * the wakeups over epoll descriptors instead of favouring the first one
+ * added.
+ */
+#define EPOLL_WAKE_LOCAL 2
+#define EPOLL_WAKE_ROTATE 4
+
 /* Valid opcodes to issue to sys_epoll_ctl() */
 #define EPOLL_CTL_ADD 1
 #define EPOLL_CTL_DEL 2
@@ -62,6 +78,9 @@
 /* Set the Edge Triggered behaviour for the target file descriptor */
 #define EPOLLET (__force __poll_t)(1U << 31)
 
+/* Set in epoll_uitem->ready_events once the item has been deleted */
+#define EPOLLREMOVED (__force __poll_t)(1U << 27)
+
 /* 
  * On x86-64 make the 64bit structure have the same alignment as the
  * 32bit structure. This makes 32bit emulation easier.
@@ -79,6 +98,44 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * An EPOLL_USERPOLL descriptor is mmap(2)ed with MAP_SHARED from offset 0.
+ * The mapping starts with struct epoll_uheader, followed by the items
+ * array, one slot per descriptor in the interest set.  At offset
+ * header_length follows the index ring of index_length bytes: an array
+ * of __u32 whose number of entries is a power of 2.
+ *
+ * When an item becomes ready the kernel ORs the events into its
+ * ready_events and, if it was zero before, stores the item number plus
+ * one at index[tail & mask] and increments tail.  The index entry can
+ * appear shortly after tail moves, so a consumer seeing zero must retry.
+ * To consume, userspace zeroes index[head & mask], advances head and only
+ * then exchanges the item's ready_events with zero; the value returned
+ * is the set of events to handle, or contains EPOLLREMOVED if the item
+ * was deleted meanwhile.
+ *
+ * epoll_wait(2) on such a descriptor takes no events array: it blocks
+ * until head != tail and returns 1, or 0 on timeout.
+ */
+#define EPOLL_USERPOLL_HEADER_MAGIC 0xeb01eb01
+
+struct epoll_uitem {
+	__poll_t ready_events;
+	__poll_t events;
+	__u64 data;
+};
+
+struct epoll_uheader {
+	__u32 magic;		/* EPOLL_USERPOLL_HEADER_MAGIC */
+	__u32 header_length;	/* length of the header and items, in bytes */
+	__u32 index_length;	/* length of the index ring, in bytes */
+	__u32 max_items_nr;	/* number of items slots */
+	__u32 head;		/* updated by userspace */
+	__u32 tail;		/* updated by the kernel */
+
+	struct epoll_uitem items[] __attribute__((aligned(128)));
+};
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
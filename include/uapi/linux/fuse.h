@@ -116,6 +116,11 @@
  *
  *  7.27
  *  - add FUSE_ABORT_ERROR
+ *
+ *  7.28
+ *  - add FOPEN_CACHE_DIR
+ *  - add FUSE_PASSTHROUGH, FOPEN_PASSTHROUGH and passthrough_fh to
+ *    fuse_open_out
  */
 
 #ifndef _LINUX_FUSE_H
@@ -151,7 +156,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 27
+#define FUSE_KERNEL_MINOR_VERSION 28
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -219,10 +224,15 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_CACHE_DIR: allow caching this directory
+ * FOPEN_PASSTHROUGH: read, write and mmap go to the backing file given by
+ *		      passthrough_fh instead of the filesystem
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_CACHE_DIR		(1 << 3)
+#define FOPEN_PASSTHROUGH	(1 << 4)
 
 /**
  * INIT request/reply flags
@@ -249,6 +259,7 @@ struct fuse_file_lock {
  * FUSE_HANDLE_KILLPRIV: fs handles killing suid/sgid/cap on write/chown/trunc
  * FUSE_POSIX_ACL: filesystem supports posix acls
  * FUSE_ABORT_ERROR: reading the device after abort returns ECONNABORTED
+ * FUSE_PASSTHROUGH: filesystem can pass I/O through to backing files
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -272,6 +283,7 @@ struct fuse_file_lock {
 #define FUSE_HANDLE_KILLPRIV	(1 << 19)
 #define FUSE_POSIX_ACL		(1 << 20)
 #define FUSE_ABORT_ERROR	(1 << 21)
+#define FUSE_PASSTHROUGH	(1 << 22)
 
 /**
  * CUSE INIT request/reply flags
@@ -503,7 +515,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	uint32_t	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -780,6 +792,85 @@ struct fuse_notify_retrieve_in {
 
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+#define FUSE_DEV_IOC_RING_SETUP	_IOWR(229, 1, struct fuse_ring_setup)
+#define FUSE_DEV_IOC_RING_ENTER	_IOWR(229, 2, struct fuse_ring_enter)
+#define FUSE_DEV_IOC_BIND_CPU	_IOW(229, 3, uint32_t)
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(229, 4, uint32_t)
+
+/*
+ * FUSE_DEV_IOC_PASSTHROUGH_OPEN takes the file descriptor of a backing
+ * file and returns an id to set as passthrough_fh, together with
+ * FOPEN_PASSTHROUGH, in the reply to the open of a file whose data it
+ * holds.  The id is consumed by that open.  I/O on the backing file is
+ * done with the credentials of the caller of the ioctl, which needs
+ * CAP_SYS_ADMIN.
+ */
+
+/*
+ * FUSE_DEV_IOC_BIND_CPU gives a device file descriptor its own input
+ * queue, holding the requests submitted on the given CPU.  A CPU can have
+ * one bound device at most, and a device must be bound before a ring is
+ * set up on it.  Forgets, and requests from CPUs without a bound device,
+ * still go to the queue shared by the unbound devices.
+ */
+
+/*
+ * Shared-memory transport
+ *
+ * A device file descriptor can have a ring set up, which passes requests
+ * and replies through memory mapped by the daemon instead of read(2) and
+ * write(2).  The mapping starts with struct fuse_ring_hdr, followed by
+ * the request and the reply queues at req_off and rep_off, each an array
+ * of 'entries' struct fuse_ring_entry, and the slots at slots_off, each
+ * 'entry_size' bytes.
+ *
+ * FUSE_DEV_IOC_RING_ENTER first consumes the replies the daemon queued,
+ * then fills free slots with requests, just like read(2) would, and
+ * queues them.  Each slot queued as a request belongs to the daemon until
+ * it queues it back as a reply: the reply goes in the same slot, with a
+ * length of zero for requests needing no reply.  The kernel advances
+ * req_tail and rep_head, the daemon req_head and rep_tail.
+ *
+ * If an eventfd was given, it is signalled when there are requests to
+ * read, preferably for the ring set up for the current CPU.
+ */
+struct fuse_ring_setup {
+	uint32_t	entries;	/* # of slots, a power of 2 */
+	uint32_t	entry_size;	/* multiple of the page size */
+	int32_t		eventfd;	/* -1 for none */
+	int32_t		cpu;		/* CPU to serve, -1 for any */
+	uint32_t	flags;		/* must be zero */
+	uint32_t	padding;
+	uint64_t	size;		/* out: length to mmap() at offset 0 */
+};
+
+struct fuse_ring_hdr {
+	uint32_t	req_head;
+	uint32_t	req_tail;
+	uint32_t	rep_head;
+	uint32_t	rep_tail;
+	uint32_t	entries;
+	uint32_t	entry_size;
+	uint32_t	req_off;
+	uint32_t	rep_off;
+	uint32_t	slots_off;
+	uint32_t	padding[7];
+};
+
+struct fuse_ring_entry {
+	uint32_t	slot;
+	uint32_t	len;
+};
+
+/* Wait for at least one request if none is pending */
+#define FUSE_RING_ENTER_WAIT	(1 << 0)
+
+struct fuse_ring_enter {
+	uint32_t	flags;
+	uint32_t	padding;
+	uint32_t	nr_replies;	/* out: # of replies consumed */
+	uint32_t	nr_requests;	/* out: # of requests queued */
+};
 
 struct fuse_lseek_in {
 	uint64_t	fh;
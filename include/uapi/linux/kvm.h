@@ -235,6 +235,7 @@ struct kvm_hyperv_exit {
 #define KVM_EXIT_S390_STSI        25
 #define KVM_EXIT_IOAPIC_EOI       26
 #define KVM_EXIT_HYPERV           27
+#define KVM_EXIT_DIRTY_RING_FULL  28
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -420,13 +421,19 @@ struct kvm_run {
 struct kvm_coalesced_mmio_zone {
 	__u64 addr;
 	__u32 size;
-	__u32 pad;
+	union {
+		__u32 pad;
+		__u32 pio;
+	};
 };
 
 struct kvm_coalesced_mmio {
 	__u64 phys_addr;
 	__u32 len;
-	__u32 pad;
+	union {
+		__u32 pad;
+		__u32 pio;
+	};
 	__u8  data[8];
 };
 
@@ -439,6 +446,38 @@ struct kvm_coalesced_mmio_ring {
 	((PAGE_SIZE - sizeof(struct kvm_coalesced_mmio_ring)) / \
 	 sizeof(struct kvm_coalesced_mmio))
 
+/*
+ * for KVM_ENABLE_CAP(KVM_CAP_COALESCED_MMIO_RING): args[0] is the ring
+ * size in pages (a power of two, at most KVM_COALESCED_MMIO_MAX_PAGES)
+ * and, with KVM_COALESCED_MMIO_RING_EVENTFD in flags, args[1] is an
+ * eventfd signalled whenever an entry is added to an empty ring.
+ */
+#define KVM_COALESCED_MMIO_MAX_PAGES	32
+#define KVM_COALESCED_MMIO_RING_EVENTFD	(1 << 0)
+
+#define KVM_COALESCED_MMIO_RING_ENTRIES(pages) \
+	(((pages) * PAGE_SIZE - sizeof(struct kvm_coalesced_mmio_ring)) / \
+	 sizeof(struct kvm_coalesced_mmio))
+
+/*
+ * Per-vcpu dirty ring, enabled with KVM_CAP_DIRTY_LOG_RING and mapped
+ * from the vcpu fd at page offset KVM_DIRTY_LOG_PAGE_OFFSET.  KVM sets
+ * KVM_DIRTY_GFN_F_DIRTY on each entry it publishes; userspace sets
+ * KVM_DIRTY_GFN_F_RESET once it has collected the page and then calls
+ * KVM_RESET_DIRTY_RINGS to re-arm dirty tracking for collected pages.
+ */
+#define KVM_DIRTY_LOG_PAGE_OFFSET 64
+
+#define KVM_DIRTY_GFN_F_DIRTY	(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET	(1 << 1)
+#define KVM_DIRTY_GFN_F_MASK	0x3
+
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot; /* as_id | slot_id */
+	__u64 offset;
+};
+
 /* for KVM_TRANSLATE */
 struct kvm_translation {
 	/* in */
@@ -948,6 +987,9 @@ struct kvm_ppc_resize_hpt {
 #define KVM_CAP_S390_BPB 152
 #define KVM_CAP_GET_MSR_FEATURES 153
 #define KVM_CAP_HYPERV_EVENTFD 154
+#define KVM_CAP_DIRTY_LOG_RING 155
+#define KVM_CAP_COALESCED_PIO 156
+#define KVM_CAP_COALESCED_MMIO_RING 157
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1390,6 +1432,9 @@ struct kvm_enc_region {
 /* Available with KVM_CAP_HYPERV_EVENTFD */
 #define KVM_HYPERV_EVENTFD        _IOW(KVMIO,  0xbd, struct kvm_hyperv_eventfd)
 
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS     _IO(KVMIO,   0xbe)
+
 
 /* Secure Encrypted Virtualization command */
 enum sev_cmd_id {
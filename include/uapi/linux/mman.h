@@ -4,6 +4,7 @@
 
 #include <asm/mman.h>
 #include <asm-generic/hugetlb_encode.h>
+#include <linux/types.h>
 
 #define MREMAP_MAYMOVE	1
 #define MREMAP_FIXED	2
@@ -33,4 +34,34 @@
 #define MAP_HUGE_2GB	HUGETLB_FLAG_ENCODE_2GB
 #define MAP_HUGE_16GB	HUGETLB_FLAG_ENCODE_16GB
 
+/*
+ * cachestat() and cachestat_sb(): page cache residency of a file, or of
+ * every cached file of a filesystem.  A @len of 0 means up to the end of
+ * the file.
+ */
+struct cachestat_range {
+	__u64 off;
+	__u64 len;
+};
+
+struct cachestat {
+	__u64 nr_cache;		/* pages in the page cache */
+	__u64 nr_dirty;		/* of which dirty */
+	__u64 nr_writeback;	/* of which under writeback */
+	__u64 nr_referenced;	/* of which referenced or active */
+	__u64 nr_evicted;	/* pages evicted or swapped out */
+};
+
+struct cachestat_inode {
+	__u64 ino;
+	struct cachestat cs;
+};
+
+/*
+ * Look at every cached page.  Without it, nr_referenced and nr_evicted
+ * are only counted for partial ranges, and a whole file costs no more
+ * than walking its dirty and writeback tags.
+ */
+#define CACHESTAT_PAGES		0x1
+
 #endif /* _UAPI_LINUX_MMAN_H */
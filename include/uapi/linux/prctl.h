@@ -223,4 +223,8 @@ struct prctl_mm_map {
 # define PR_SPEC_DISABLE		(1UL << 2)
 # define PR_SPEC_FORCE_DISABLE		(1UL << 3)
 
+/* Map the page cached parts of executables up front at exec */
+#define PR_SET_EXEC_PREFAULT		54
+#define PR_GET_EXEC_PREFAULT		55
+
 #endif /* _LINUX_PRCTL_H */
@@ -28,6 +28,18 @@ struct vhost_vring_file {
 
 };
 
+struct vhost_worker_state {
+	/* Returned by VHOST_NEW_WORKER, passed to VHOST_FREE_WORKER. */
+	unsigned int worker_id;
+	/* VHOST_NEW_WORKER only: CPU to run the new worker on, or -1. */
+	int cpu;
+};
+
+struct vhost_vring_worker {
+	unsigned int index;
+	unsigned int worker_id;
+};
+
 struct vhost_vring_addr {
 	unsigned int index;
 	/* Option flags. */
@@ -119,6 +131,16 @@ struct vhost_memory {
 /* Specify an eventfd file descriptor to signal on log write. */
 #define VHOST_SET_LOG_FD _IOW(VHOST_VIRTIO, 0x07, int)
 
+/* Worker threads. */
+/* By default every ring of a device is serviced by a single kernel thread
+ * created by VHOST_SET_OWNER.  Additional workers can be created and rings
+ * attached to them while the ring has no backend.  A worker may be shared by
+ * devices owned by the same process. */
+/* Create a worker, optionally bound to a CPU; returns its id. */
+#define VHOST_NEW_WORKER _IOWR(VHOST_VIRTIO, 0x08, struct vhost_worker_state)
+/* Free a worker created on this device.  Fails while rings are attached. */
+#define VHOST_FREE_WORKER _IOW(VHOST_VIRTIO, 0x09, struct vhost_worker_state)
+
 /* Ring setup. */
 /* Set number of descriptors in ring. This parameter can not
  * be modified while ring is running (bound to a device). */
@@ -143,6 +165,13 @@ struct vhost_memory {
 #define VHOST_VRING_BIG_ENDIAN 1
 #define VHOST_SET_VRING_ENDIAN _IOW(VHOST_VIRTIO, 0x13, struct vhost_vring_state)
 #define VHOST_GET_VRING_ENDIAN _IOW(VHOST_VIRTIO, 0x14, struct vhost_vring_state)
+/* Service a ring with the given worker.  Only devices whose rings are
+ * independent (vhost-net) support this; others return EOPNOTSUPP. */
+#define VHOST_ATTACH_VRING_WORKER _IOW(VHOST_VIRTIO, 0x15,		\
+				       struct vhost_vring_worker)
+/* Get the id of the worker servicing a ring. */
+#define VHOST_GET_VRING_WORKER _IOWR(VHOST_VIRTIO, 0x16,		\
+				     struct vhost_vring_worker)
 
 /* The following ioctls use eventfd file descriptors to signal and poll
  * for events. */
@@ -20,6 +20,9 @@
 #include <linux/syscalls.h>
 #include <linux/utime.h>
 #include <linux/file.h>
+#include <linux/async.h>
+#include <linux/ktime.h>
+#include <linux/initrd.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
 {
@@ -607,8 +610,17 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+static bool initramfs_async = true;
+
+static int __init initramfs_async_setup(char *str)
 {
+	return !strtobool(str, &initramfs_async);
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
+{
+	ktime_t start = ktime_get();
 	/* Load the built in initramfs */
 	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
 	if (err)
@@ -654,11 +666,61 @@ static int __init populate_rootfs(void)
 #endif
 	}
 	flush_delayed_fput();
-	/*
-	 * Try loading default modules from initramfs.  This gives
-	 * us a chance to load before device_initcalls.
-	 */
-	load_default_modules();
+
+	if (initcall_debug)
+		pr_info("initramfs unpacked in %lld usecs\n",
+			ktime_us_delta(ktime_get(), start));
+}
+
+static ASYNC_DOMAIN_EXCLUSIVE(initramfs_domain);
+static async_cookie_t initramfs_cookie;
+
+/**
+ * wait_for_initramfs - wait until the initramfs has been unpacked
+ *
+ * populate_rootfs() unpacks the initramfs in the background so the
+ * initcalls that follow it overlap with the decompression.  Anything
+ * that looks up files in rootfs before kernel_init() is done with
+ * the initcalls has to call this first.
+ */
+void wait_for_initramfs(void)
+{
+	ktime_t start;
+
+	if (!initramfs_cookie) {
+		/*
+		 * Nothing has been scheduled yet, so whoever is asking
+		 * runs before rootfs_initcall() and must not expect any
+		 * files.
+		 */
+		pr_warn_once("wait_for_initramfs() called before rootfs_initcalls\n");
+		return;
+	}
+
+	start = ktime_get();
+	async_synchronize_cookie_domain(initramfs_cookie + 1, &initramfs_domain);
+	if (initcall_debug && system_state < SYSTEM_RUNNING)
+		pr_info("%pS waited %lld usecs for the initramfs\n",
+			__builtin_return_address(0),
+			ktime_us_delta(ktime_get(), start));
+}
+EXPORT_SYMBOL_GPL(wait_for_initramfs);
+
+static int __init populate_rootfs(void)
+{
+	initramfs_cookie = async_schedule_domain(do_populate_rootfs, NULL,
+						 &initramfs_domain);
+	if (!initramfs_async) {
+		wait_for_initramfs();
+
+		/*
+		 * Try loading default modules from initramfs.  This gives
+		 * us a chance to load before device_initcalls.  When
+		 * unpacking in the background, kernel_init_freeable()
+		 * loads them once the initramfs is there.
+		 */
+		load_default_modules();
+	}
 
 	return 0;
 }
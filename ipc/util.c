@@ -330,7 +330,7 @@ static int ipcget_new(struct ipc_namespace *ns, struct ipc_ids *ids,
  *
  * On success, the ipc id is returned.
  *
- * It is called with ipc_ids.rwsem and ipcp->lock held.
+ * It is called with ipcp->lock held.
  */
 static int ipc_check_perms(struct ipc_namespace *ns,
 			   struct kern_ipc_perm *ipcp,
@@ -350,6 +350,63 @@ static int ipc_check_perms(struct ipc_namespace *ns,
 	return err;
 }
 
+/*
+ * Checks for an existing key, called with ipcp->lock held and with or
+ * without ipc_ids.rwsem.
+ */
+static int ipcget_existing(struct ipc_namespace *ns,
+			   struct kern_ipc_perm *ipcp,
+			   const struct ipc_ops *ops,
+			   struct ipc_params *params)
+{
+	int flg = params->flg;
+	int err = 0;
+
+	if (flg & IPC_CREAT && flg & IPC_EXCL)
+		return -EEXIST;
+
+	if (ops->more_checks)
+		err = ops->more_checks(ipcp, params);
+	if (!err)
+		/* ipc_check_perms returns the IPC id on success */
+		err = ipc_check_perms(ns, ipcp, ops, params);
+
+	return err;
+}
+
+/*
+ * ipcget_public_fast - look up an existing key without ipc_ids.rwsem
+ *
+ * Most calls for a public key find an object that already exists, so
+ * try that under RCU first and only serialize against creation and
+ * removal on the writer rwsem when it is not there.
+ *
+ * Returns -ENOENT when the caller must fall back to the locked path.
+ */
+static int ipcget_public_fast(struct ipc_namespace *ns, struct ipc_ids *ids,
+		const struct ipc_ops *ops, struct ipc_params *params)
+{
+	struct kern_ipc_perm *ipcp;
+	int err = -ENOENT;
+
+	if (!READ_ONCE(ids->tables_initialized))
+		return -ENOENT;
+
+	rcu_read_lock();
+	ipcp = rhashtable_lookup(&ids->key_ht, &params->key, ipc_kht_params);
+	if (!ipcp) {
+		rcu_read_unlock();
+		return -ENOENT;
+	}
+
+	ipc_lock_object(ipcp);
+	if (ipc_valid_object(ipcp))
+		err = ipcget_existing(ns, ipcp, ops, params);
+	ipc_unlock(ipcp);
+
+	return err;
+}
+
 /**
  * ipcget_public - get an ipc object or create a new one
  * @ns: ipc namespace
@@ -371,6 +428,10 @@ static int ipcget_public(struct ipc_namespace *ns, struct ipc_ids *ids,
 	int flg = params->flg;
 	int err;
 
+	err = ipcget_public_fast(ns, ids, ops, params);
+	if (err != -ENOENT)
+		return err;
+
 	/*
 	 * Take the lock as a writer since we are potentially going to add
 	 * a new entry + read locks are not "upgradable"
@@ -385,20 +446,7 @@ static int ipcget_public(struct ipc_namespace *ns, struct ipc_ids *ids,
 			err = ops->getnew(ns, params);
 	} else {
 		/* ipc object has been locked by ipc_findkey() */
-
-		if (flg & IPC_CREAT && flg & IPC_EXCL)
-			err = -EEXIST;
-		else {
-			err = 0;
-			if (ops->more_checks)
-				err = ops->more_checks(ipcp, params);
-			if (!err)
-				/*
-				 * ipc_check_perms returns the IPC id on
-				 * success
-				 */
-				err = ipc_check_perms(ns, ipcp, ops, params);
-		}
+		err = ipcget_existing(ns, ipcp, ops, params);
 		ipc_unlock(ipcp);
 	}
 	up_write(&ids->rwsem);
@@ -32,6 +32,8 @@
 #include <linux/kallsyms.h>
 #include <linux/rcupdate.h>
 #include <linux/perf_event.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
 
 #include <asm/unaligned.h>
 
@@ -219,15 +221,16 @@ int bpf_prog_calc_tag(struct bpf_prog *fp)
 	return 0;
 }
 
-static int bpf_adj_delta_to_imm(struct bpf_insn *insn, u32 pos, u32 delta,
-				u32 curr, const bool probe_pass)
+static int bpf_adj_delta_to_imm(struct bpf_insn *insn, u32 pos, s32 end_old,
+				s32 end_new, s32 curr, const bool probe_pass)
 {
 	const s64 imm_min = S32_MIN, imm_max = S32_MAX;
+	s32 delta = end_new - end_old;
 	s64 imm = insn->imm;
 
-	if (curr < pos && curr + imm + 1 > pos)
+	if (curr < pos && curr + imm + 1 >= end_old)
 		imm += delta;
-	else if (curr > pos + delta && curr + imm + 1 <= pos + delta)
+	else if (curr >= end_new && curr + imm + 1 < end_new)
 		imm -= delta;
 	if (imm < imm_min || imm > imm_max)
 		return -ERANGE;
@@ -236,15 +239,16 @@ static int bpf_adj_delta_to_imm(struct bpf_insn *insn, u32 pos, u32 delta,
 	return 0;
 }
 
-static int bpf_adj_delta_to_off(struct bpf_insn *insn, u32 pos, u32 delta,
-				u32 curr, const bool probe_pass)
+static int bpf_adj_delta_to_off(struct bpf_insn *insn, u32 pos, s32 end_old,
+				s32 end_new, s32 curr, const bool probe_pass)
 {
 	const s32 off_min = S16_MIN, off_max = S16_MAX;
+	s32 delta = end_new - end_old;
 	s32 off = insn->off;
 
-	if (curr < pos && curr + off + 1 > pos)
+	if (curr < pos && curr + off + 1 >= end_old)
 		off += delta;
-	else if (curr > pos + delta && curr + off + 1 <= pos + delta)
+	else if (curr >= end_new && curr + off + 1 < end_new)
 		off -= delta;
 	if (off < off_min || off > off_max)
 		return -ERANGE;
@@ -253,10 +257,14 @@ static int bpf_adj_delta_to_off(struct bpf_insn *insn, u32 pos, u32 delta,
 	return 0;
 }
 
-static int bpf_adj_branches(struct bpf_prog *prog, u32 pos, u32 delta,
-			    const bool probe_pass)
+/* Instructions [pos, end_old) were replaced by [pos, end_new), fix up
+ * the branches crossing that range. This covers both patching, where
+ * end_new > end_old, and removal, where end_new == pos.
+ */
+static int bpf_adj_branches(struct bpf_prog *prog, u32 pos, s32 end_old,
+			    s32 end_new, const bool probe_pass)
 {
-	u32 i, insn_cnt = prog->len + (probe_pass ? delta : 0);
+	u32 i, insn_cnt = prog->len + (probe_pass ? end_new - end_old : 0);
 	struct bpf_insn *insn = prog->insnsi;
 	int ret = 0;
 
@@ -268,8 +276,8 @@ static int bpf_adj_branches(struct bpf_prog *prog, u32 pos, u32 delta,
 		 * do any other adjustments. Therefore skip the patchlet.
 		 */
 		if (probe_pass && i == pos) {
-			i += delta + 1;
-			insn++;
+			i = end_new;
+			insn = prog->insnsi + end_old;
 		}
 		code = insn->code;
 		if (BPF_CLASS(code) != BPF_JMP ||
@@ -279,11 +287,11 @@ static int bpf_adj_branches(struct bpf_prog *prog, u32 pos, u32 delta,
 		if (BPF_OP(code) == BPF_CALL) {
 			if (insn->src_reg != BPF_PSEUDO_CALL)
 				continue;
-			ret = bpf_adj_delta_to_imm(insn, pos, delta, i,
-						   probe_pass);
+			ret = bpf_adj_delta_to_imm(insn, pos, end_old,
+						   end_new, i, probe_pass);
 		} else {
-			ret = bpf_adj_delta_to_off(insn, pos, delta, i,
-						   probe_pass);
+			ret = bpf_adj_delta_to_off(insn, pos, end_old,
+						   end_new, i, probe_pass);
 		}
 		if (ret)
 			break;
@@ -313,7 +321,7 @@ struct bpf_prog *bpf_patch_insn_single(struct bpf_prog *prog, u32 off,
 	 * we afterwards may not fail anymore.
 	 */
 	if (insn_adj_cnt > cnt_max &&
-	    bpf_adj_branches(prog, off, insn_delta, true))
+	    bpf_adj_branches(prog, off, off + 1, off + len, true))
 		return NULL;
 
 	/* Several new instructions need to be inserted. Make room
@@ -345,11 +353,24 @@ struct bpf_prog *bpf_patch_insn_single(struct bpf_prog *prog, u32 off,
 	 * the ship has sailed to reverse to the original state. An
 	 * overflow cannot happen at this point.
 	 */
-	BUG_ON(bpf_adj_branches(prog_adj, off, insn_delta, false));
+	BUG_ON(bpf_adj_branches(prog_adj, off, off + 1, off + len, false));
 
 	return prog_adj;
 }
 
+int bpf_remove_insns(struct bpf_prog *prog, u32 off, u32 cnt)
+{
+	/* Branch offsets can't overflow when the program is shrinking,
+	 * so there is no need for a probing pass here.
+	 */
+	memmove(prog->insnsi + off, prog->insnsi + off + cnt,
+		sizeof(struct bpf_insn) * (prog->len - off - cnt));
+	prog->len -= cnt;
+
+	return WARN_ON_ONCE(bpf_adj_branches(prog, off, off + cnt, off,
+					     false));
+}
+
 #ifdef CONFIG_BPF_JIT
 /* All BPF JIT sysctl knobs here. */
 int bpf_jit_enable   __read_mostly = IS_BUILTIN(CONFIG_BPF_JIT_ALWAYS_ON);
@@ -455,7 +476,10 @@ static void bpf_prog_ksym_node_del(struct bpf_prog_aux *aux)
 
 static bool bpf_prog_kallsyms_candidate(const struct bpf_prog *fp)
 {
-	return fp->jited && !bpf_prog_was_classic(fp);
+	/* A shared image is already known under the name of the program
+	 * that was JITed into it.
+	 */
+	return fp->jited && !bpf_prog_was_classic(fp) && !fp->aux->jit_shared;
 }
 
 static bool bpf_prog_kallsyms_verify_off(const struct bpf_prog *fp)
@@ -802,6 +826,149 @@ struct bpf_prog *bpf_jit_blind_constants(struct bpf_prog *prog)
 	clone->blinded = 1;
 	return clone;
 }
+
+/* Identical programs, f.e. the same cgroup program loaded once for
+ * every container, are JITed into identical images. The images of
+ * programs that are not blinded are therefore kept in a hash table
+ * keyed by their final instructions, and loading such a program again
+ * takes a reference on the existing image instead of JITing a copy.
+ */
+struct bpf_jit_image {
+	struct hlist_node node;
+	refcount_t refcnt;
+	u32 hash;
+	struct bpf_binary_header *hdr;
+	unsigned int (*bpf_func)(const void *ctx,
+				 const struct bpf_insn *insn);
+	u32 jited_len;
+	enum bpf_prog_type type;
+	u32 stack_depth;
+	u32 len;
+	struct bpf_insn insnsi[0];
+};
+
+#define BPF_JIT_IMAGE_HASH_BITS	8
+
+static DEFINE_HASHTABLE(bpf_jit_images, BPF_JIT_IMAGE_HASH_BITS);
+static DEFINE_MUTEX(bpf_jit_image_mutex);
+
+static bool bpf_jit_image_cacheable(struct bpf_prog *fp)
+{
+	/* Blinded images must stay private, their random constants are
+	 * not to be shared across programs. Programs with bpf-to-bpf
+	 * calls are JITed by the verifier one function at a time.
+	 */
+	return fp->jit_requested && bpf_jit_supports_image_sharing() &&
+	       !bpf_jit_blinding_enabled(fp) && !fp->is_func &&
+	       !fp->aux->func_cnt;
+}
+
+static u32 bpf_jit_image_hash(const struct bpf_prog *fp)
+{
+	return jhash(fp->insnsi, bpf_prog_insn_size(fp),
+		     fp->type ^ fp->aux->stack_depth);
+}
+
+static bool bpf_jit_image_match(const struct bpf_jit_image *img,
+				const struct bpf_prog *fp, u32 hash)
+{
+	return img->hash == hash && img->type == fp->type &&
+	       img->stack_depth == fp->aux->stack_depth &&
+	       img->len == fp->len &&
+	       !memcmp(img->insnsi, fp->insnsi, bpf_prog_insn_size(fp));
+}
+
+static bool bpf_jit_image_get(struct bpf_prog *fp)
+{
+	struct bpf_jit_image *img;
+	u32 hash;
+
+	if (!bpf_jit_image_cacheable(fp))
+		return false;
+
+	hash = bpf_jit_image_hash(fp);
+	mutex_lock(&bpf_jit_image_mutex);
+	hash_for_each_possible(bpf_jit_images, img, node, hash) {
+		if (!bpf_jit_image_match(img, fp, hash))
+			continue;
+
+		refcount_inc(&img->refcnt);
+		mutex_unlock(&bpf_jit_image_mutex);
+
+		fp->bpf_func = img->bpf_func;
+		fp->jited_len = img->jited_len;
+		fp->jited = 1;
+		fp->aux->jit_image = img;
+		fp->aux->jit_shared = true;
+		return true;
+	}
+	mutex_unlock(&bpf_jit_image_mutex);
+
+	return false;
+}
+
+static void bpf_jit_image_add(struct bpf_prog *fp)
+{
+	struct bpf_jit_image *img, *tmp;
+
+	if (!fp->jited || fp->blinded || !bpf_jit_image_cacheable(fp))
+		return;
+
+	/* Failing here only means the image stays private to fp. */
+	img = kvmalloc(sizeof(*img) + bpf_prog_insn_size(fp), GFP_KERNEL);
+	if (!img)
+		return;
+
+	refcount_set(&img->refcnt, 1);
+	img->hash = bpf_jit_image_hash(fp);
+	img->hdr = bpf_jit_binary_hdr(fp);
+	img->bpf_func = fp->bpf_func;
+	img->jited_len = fp->jited_len;
+	img->type = fp->type;
+	img->stack_depth = fp->aux->stack_depth;
+	img->len = fp->len;
+	memcpy(img->insnsi, fp->insnsi, bpf_prog_insn_size(fp));
+
+	mutex_lock(&bpf_jit_image_mutex);
+	hash_for_each_possible(bpf_jit_images, tmp, node, img->hash) {
+		/* An identical program was JITed in parallel. */
+		if (bpf_jit_image_match(tmp, fp, img->hash)) {
+			mutex_unlock(&bpf_jit_image_mutex);
+			kvfree(img);
+			return;
+		}
+	}
+	hash_add(bpf_jit_images, &img->node, img->hash);
+	mutex_unlock(&bpf_jit_image_mutex);
+
+	fp->aux->jit_image = img;
+}
+
+static void bpf_jit_image_put(struct bpf_jit_image *img)
+{
+	if (!refcount_dec_and_mutex_lock(&img->refcnt, &bpf_jit_image_mutex))
+		return;
+
+	hash_del(&img->node);
+	mutex_unlock(&bpf_jit_image_mutex);
+
+	bpf_jit_binary_unlock_ro(img->hdr);
+	bpf_jit_binary_free(img->hdr);
+	kvfree(img);
+}
+#else
+static inline bool bpf_jit_image_get(struct bpf_prog *fp)
+{
+	return false;
+}
+
+static inline void bpf_jit_image_add(struct bpf_prog *fp)
+{
+}
+
+static inline void bpf_jit_image_put(struct bpf_jit_image *img)
+{
+}
 #endif /* CONFIG_BPF_JIT */
 
 /* Base function for offset calculation. Needs to go into .text section,
@@ -1016,6 +1183,12 @@ static u64 ___bpf_prog_run(u64 *regs, const struct bpf_insn *insn, u64 *stack)
 		CONT;
 	ALU64_MOV_X:
 		DST = SRC;
+		/* Only reached when the JIT failed after the verifier
+		 * already emitted it, see bpf_jit_supports_percpu_insn().
+		 */
+		if (unlikely(insn->off == BPF_ADDR_PERCPU))
+			DST = (unsigned long)
+			      this_cpu_ptr((void __percpu *)(unsigned long)SRC);
 		CONT;
 	ALU64_MOV_K:
 		DST = IMM;
@@ -1459,7 +1632,10 @@ struct bpf_prog *bpf_prog_select_runtime(struct bpf_prog *fp, int *err)
 	 * be JITed, but falls back to the interpreter.
 	 */
 	if (!bpf_prog_is_dev_bound(fp->aux)) {
-		fp = bpf_int_jit_compile(fp);
+		if (!bpf_jit_image_get(fp)) {
+			fp = bpf_int_jit_compile(fp);
+			bpf_jit_image_add(fp);
+		}
 #ifdef CONFIG_BPF_JIT_ALWAYS_ON
 		if (!fp->jited) {
 			*err = -ENOTSUPP;
@@ -1702,6 +1878,9 @@ static void bpf_prog_free_deferred(struct work_struct *work)
 	if (aux->func_cnt) {
 		kfree(aux->func);
 		bpf_prog_unlock_free(aux->prog);
+	} else if (aux->jit_image) {
+		bpf_jit_image_put(aux->jit_image);
+		bpf_prog_unlock_free(aux->prog);
 	} else {
 		bpf_jit_free(aux->prog);
 	}
@@ -1758,6 +1937,8 @@ const struct bpf_func_proto bpf_get_current_uid_gid_proto __weak;
 const struct bpf_func_proto bpf_get_current_comm_proto __weak;
 const struct bpf_func_proto bpf_sock_map_update_proto __weak;
 const struct bpf_func_proto bpf_sock_hash_update_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_output_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_query_proto __weak;
 
 const struct bpf_func_proto * __weak bpf_get_trace_printk_proto(void)
 {
@@ -1798,6 +1979,23 @@ void __weak bpf_jit_compile(struct bpf_prog *prog)
 {
 }
 
+/* Return true if the JIT handles BPF_MOV64_PERCPU_REG(), which allows
+ * the verifier to inline lookups in per-cpu maps.
+ */
+bool __weak bpf_jit_supports_percpu_insn(void)
+{
+	return false;
+}
+
+/* Return true if JITed images depend on nothing but the instructions
+ * and stack depth of the program and are freed by the generic
+ * bpf_jit_free(), so that identical programs can share one image.
+ */
+bool __weak bpf_jit_supports_image_sharing(void)
+{
+	return false;
+}
+
 bool __weak bpf_helper_changes_pkt_data(void *func)
 {
 	return false;
@@ -25,10 +25,12 @@
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
 #include <linux/capability.h>
+#include <linux/prefetch.h>
 #include <trace/events/xdp.h>
 
-#include <linux/netdevice.h>   /* netif_receive_skb_core */
+#include <linux/netdevice.h>   /* napi_gro_receive */
 #include <linux/etherdevice.h> /* eth_type_trans */
+#include <linux/skbuff.h>      /* skbuff_head_cache */
 
 /* General idea: XDP packets getting XDP redirected to another CPU,
  * will maximum be stored/queued for one driver ->poll() call.  It is
@@ -57,6 +59,9 @@ struct bpf_cpu_map_entry {
 	struct task_struct *kthread;
 	struct work_struct kthread_stop_wq;
 
+	/* GRO context, only touched by the kthread */
+	struct napi_struct napi;
+
 	atomic_t refcnt; /* Control when this struct can be free'ed */
 	struct rcu_head rcu;
 };
@@ -159,12 +164,49 @@ static void cpu_map_kthread_stop(struct work_struct *work)
 	kthread_stop(rcpu->kthread);
 }
 
-static struct sk_buff *cpu_map_build_skb(struct bpf_cpu_map_entry *rcpu,
-					 struct xdp_frame *xdpf)
+/* Multi-buffer frames: the frag list already sits where build_skb()
+ * places skb_shared_info, and build_skb() leaves frags[] untouched.
+ */
+static struct sk_buff *cpu_map_build_skb_frags(struct xdp_frame *xdpf,
+						struct sk_buff *skb)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_frame(xdpf);
+	void *hard_start = xdpf->data - xdpf->headroom - sizeof(*xdpf);
+	unsigned int headroom = xdpf->headroom + sizeof(*xdpf);
+	u8 nr_frags = sinfo->nr_frags;
+	unsigned int frags_len;
+
+	frags_len = xdp_shared_info_frags_len(sinfo);
+
+	skb = build_skb_around(skb, hard_start, xdpf->frame_sz);
+	if (!skb)
+		return NULL;
+
+	skb_reserve(skb, headroom);
+	__skb_put(skb, xdpf->len);
+	if (xdpf->metasize)
+		skb_metadata_set(skb, xdpf->metasize);
+
+	skb_shinfo(skb)->nr_frags = nr_frags;
+	skb->len += frags_len;
+	skb->data_len += frags_len;
+	skb->truesize += nr_frags * xdpf->frame_sz;
+
+	return skb;
+}
+
+static struct sk_buff *cpu_map_build_skb(struct xdp_frame *xdpf,
+					 struct sk_buff *skb)
 {
 	unsigned int frame_size;
 	void *pkt_data_start;
-	struct sk_buff *skb;
+
+	if (unlikely(xdp_frame_has_frags(xdpf))) {
+		skb = cpu_map_build_skb_frags(xdpf, skb);
+		if (!skb)
+			return NULL;
+		goto out;
+	}
 
 	/* build_skb need to place skb_shared_info after SKB end, and
 	 * also want to know the memory "truesize".  Thus, need to
@@ -187,7 +229,7 @@ static struct sk_buff *cpu_map_build_skb(struct bpf_cpu_map_entry *rcpu,
 		SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 
 	pkt_data_start = xdpf->data - xdpf->headroom;
-	skb = build_skb(pkt_data_start, frame_size);
+	skb = build_skb_around(skb, pkt_data_start, frame_size);
 	if (!skb)
 		return NULL;
 
@@ -196,6 +238,7 @@ static struct sk_buff *cpu_map_build_skb(struct bpf_cpu_map_entry *rcpu,
 	if (xdpf->metasize)
 		skb_metadata_set(skb, xdpf->metasize);
 
+out:
 	/* Essential SKB info: protocol and skb->dev */
 	skb->protocol = eth_type_trans(skb, xdpf->dev_rx);
 
@@ -233,6 +276,8 @@ static void put_cpu_map_entry(struct bpf_cpu_map_entry *rcpu)
 	}
 }
 
+#define CPUMAP_BATCH 8
+
 static int cpu_map_kthread_run(void *data)
 {
 	struct bpf_cpu_map_entry *rcpu = data;
@@ -245,8 +290,10 @@ static int cpu_map_kthread_run(void *data)
 	 * kthread_stop signal until queue is empty.
 	 */
 	while (!kthread_should_stop() || !__ptr_ring_empty(rcpu->queue)) {
-		unsigned int processed = 0, drops = 0, sched = 0;
-		struct xdp_frame *xdpf;
+		unsigned int drops = 0, sched = 0;
+		void *frames[CPUMAP_BATCH];
+		void *skbs[CPUMAP_BATCH];
+		int i, n, m;
 
 		/* Release CPU reschedule checks */
 		if (__ptr_ring_empty(rcpu->queue)) {
@@ -262,34 +309,57 @@ static int cpu_map_kthread_run(void *data)
 			sched = cond_resched();
 		}
 
-		/* Process packets in rcpu->queue */
-		local_bh_disable();
 		/*
 		 * The bpf_cpu_map_entry is single consumer, with this
 		 * kthread CPU pinned. Lockless access to ptr_ring
 		 * consume side valid as no-resize allowed of queue.
 		 */
-		while ((xdpf = __ptr_ring_consume(rcpu->queue))) {
+		n = __ptr_ring_consume_batched(rcpu->queue, frames,
+					       CPUMAP_BATCH);
+		for (i = 0; i < n; i++) {
+			struct xdp_frame *xdpf = frames[i];
+
+			/* Bring struct page to this CPU, build_skb_around()
+			 * reads it and the final page_frag_free() writes it.
+			 */
+			prefetchw(virt_to_page(xdpf));
+		}
+
+		/* kmem_cache_alloc_bulk() is all or nothing */
+		m = kmem_cache_alloc_bulk(skbuff_head_cache, GFP_ATOMIC,
+					  n, skbs);
+		if (unlikely(m == 0)) {
+			for (i = 0; i < n; i++)
+				skbs[i] = NULL;
+			drops = n;
+		}
+
+		/* Process packets in rcpu->queue, BH-disable period is
+		 * limited by CPUMAP_BATCH.
+		 */
+		local_bh_disable();
+		for (i = 0; i < n; i++) {
+			struct xdp_frame *xdpf = frames[i];
 			struct sk_buff *skb;
-			int ret;
 
-			skb = cpu_map_build_skb(rcpu, xdpf);
+			skb = cpu_map_build_skb(xdpf, skbs[i]);
 			if (!skb) {
 				xdp_return_frame(xdpf);
 				continue;
 			}
 
 			/* Inject into network stack */
-			ret = netif_receive_skb_core(skb);
-			if (ret == NET_RX_DROP)
+			if (napi_gro_receive(&rcpu->napi, skb) == GRO_DROP)
 				drops++;
-
-			/* Limit BH-disable period */
-			if (++processed == 8)
-				break;
 		}
+		/* Hold back young flows only while more frames are queued;
+		 * the kthread never sleeps with packets left in GRO.
+		 */
+		napi_gro_flush_normal(&rcpu->napi,
+				      !__ptr_ring_empty(rcpu->queue));
+
 		/* Feedback loop via tracepoint */
-		trace_xdp_cpumap_kthread(rcpu->map_id, processed, drops, sched);
+		trace_xdp_cpumap_kthread(rcpu->map_id, n, drops, sched);
 
 		local_bh_enable(); /* resched point, may call do_softirq() */
 	}
@@ -332,6 +402,9 @@ static struct bpf_cpu_map_entry *__cpu_map_entry_alloc(u32 qsize, u32 cpu,
 	rcpu->map_id = map_id;
 	rcpu->qsize  = qsize;
 
+	/* Standalone GRO context, never scheduled as a real NAPI */
+	INIT_LIST_HEAD(&rcpu->napi.rx_list);
+
 	/* Setup kthread */
 	rcpu->kthread = kthread_create_on_node(cpu_map_kthread_run, rcpu, numa,
 					       "cpumap/%d/map:%d", cpu, map_id);
@@ -27,10 +27,22 @@ struct bucket {
 	raw_spinlock_t lock;
 };
 
+/* Preallocated elements live in one pool per NUMA node, unless the map
+ * was pinned to a node or is an LRU map, in which case there is a single
+ * pool.
+ */
+struct htab_elem_pool {
+	void *elems;
+	u32 nr_elems;
+	int node;
+	int cpu;	/* takes back elements freed on remote nodes */
+};
+
 struct bpf_htab {
 	struct bpf_map map;
 	struct bucket *buckets;
-	void *elems;
+	struct htab_elem_pool *pools;
+	u32 n_pools;
 	union {
 		struct pcpu_freelist freelist;
 		struct bpf_lru lru;
@@ -50,6 +62,7 @@ struct htab_elem {
 			union {
 				struct bpf_htab *htab;
 				struct pcpu_freelist_node fnode;
+				struct htab_elem *batch_flink;
 			};
 		};
 	};
@@ -96,28 +109,129 @@ static void *fd_htab_map_get_ptr(const struct bpf_map *map, struct htab_elem *l)
 	return *(void **)(l->key + roundup(map->key_size, 8));
 }
 
-static struct htab_elem *get_htab_elem(struct bpf_htab *htab, int i)
+#define for_each_htab_pool(pool, htab)					\
+	for (pool = (htab)->pools; pool < (htab)->pools + (htab)->n_pools; \
+	     pool++)
+
+static struct htab_elem *get_htab_elem(struct bpf_htab *htab,
+				       struct htab_elem_pool *pool, int i)
 {
-	return (struct htab_elem *) (htab->elems + i * htab->elem_size);
+	return (struct htab_elem *) (pool->elems + i * htab->elem_size);
 }
 
 static void htab_free_elems(struct bpf_htab *htab)
 {
+	struct htab_elem_pool *pool;
 	int i;
 
-	if (!htab_is_percpu(htab))
-		goto free_elems;
+	for_each_htab_pool(pool, htab) {
+		if (!pool->elems)
+			continue;
 
-	for (i = 0; i < htab->map.max_entries; i++) {
-		void __percpu *pptr;
+		for (i = 0; htab_is_percpu(htab) && i < pool->nr_elems; i++) {
+			void __percpu *pptr;
 
-		pptr = htab_elem_get_ptr(get_htab_elem(htab, i),
-					 htab->map.key_size);
-		free_percpu(pptr);
-		cond_resched();
+			pptr = htab_elem_get_ptr(get_htab_elem(htab, pool, i),
+						 htab->map.key_size);
+			free_percpu(pptr);
+			cond_resched();
+		}
+		bpf_map_area_free(pool->elems);
 	}
-free_elems:
-	bpf_map_area_free(htab->elems);
+	kfree(htab->pools);
+}
+
+/* Split num_entries over the nodes in proportion to their number of
+ * possible cpus and allocate every pool on its own node, so that the
+ * elements a cpu pops from its freelist are node local. Maps created
+ * with BPF_F_NUMA_NODE and LRU maps, whose lists don't know about
+ * nodes, keep a single pool.
+ */
+static int htab_alloc_pools(struct bpf_htab *htab, u32 num_entries)
+{
+	u32 nr_cpus = num_possible_cpus(), seen = 0, done = 0;
+	struct htab_elem_pool *pool;
+	int cpu, nid;
+
+	if (htab->map.numa_node != NUMA_NO_NODE || htab_is_lru(htab) ||
+	    num_possible_nodes() < 2)
+		goto single;
+
+	for_each_possible_cpu(cpu)
+		if (cpu_to_node(cpu) < 0)
+			goto single;
+
+	htab->pools = kcalloc(nr_node_ids, sizeof(*htab->pools), GFP_USER);
+	if (!htab->pools)
+		return -ENOMEM;
+	htab->n_pools = nr_node_ids;
+
+	/* count the cpus of each node in nr_elems first */
+	for_each_possible_cpu(cpu) {
+		pool = &htab->pools[cpu_to_node(cpu)];
+		if (!pool->nr_elems++)
+			pool->cpu = cpu;
+	}
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		pool = &htab->pools[nid];
+		pool->node = nid;
+		if (!pool->nr_elems)
+			continue;
+		seen += pool->nr_elems;
+		pool->nr_elems = div_u64((u64) num_entries * seen, nr_cpus) -
+				 done;
+		done += pool->nr_elems;
+		if (!pool->nr_elems)
+			continue;
+
+		pool->elems = bpf_map_area_alloc(htab->elem_size *
+						 pool->nr_elems, nid);
+		if (!pool->elems)
+			goto free_pools;
+	}
+	return 0;
+
+single:
+	htab->pools = kzalloc(sizeof(*htab->pools), GFP_USER);
+	if (!htab->pools)
+		return -ENOMEM;
+	htab->n_pools = 1;
+
+	pool = htab->pools;
+	pool->node = htab->map.numa_node;
+	pool->cpu = -1;
+	pool->nr_elems = num_entries;
+	pool->elems = bpf_map_area_alloc(htab->elem_size * num_entries,
+					 htab->map.numa_node);
+	if (!pool->elems)
+		goto free_pools;
+	return 0;
+
+free_pools:
+	for_each_htab_pool(pool, htab)
+		bpf_map_area_free(pool->elems);
+	kfree(htab->pools);
+	return -ENOMEM;
+}
+
+/* Return the cpu whose freelist should take back a preallocated element
+ * that was freed on another node, or -1 to keep it on the local list.
+ */
+static int htab_elem_home_cpu(struct bpf_htab *htab, struct htab_elem *l)
+{
+	struct htab_elem_pool *pool;
+
+	if (htab->n_pools < 2)
+		return -1;
+
+	for_each_htab_pool(pool, htab) {
+		if ((void *) l < pool->elems ||
+		    (void *) l >= pool->elems + pool->nr_elems * htab->elem_size)
+			continue;
+		return pool->node == numa_node_id() ? -1 : pool->cpu;
+	}
+	return -1;
 }
 
 static struct htab_elem *prealloc_lru_pop(struct bpf_htab *htab, void *key,
@@ -138,29 +252,33 @@ static struct htab_elem *prealloc_lru_pop(struct bpf_htab *htab, void *key,
 static int prealloc_init(struct bpf_htab *htab)
 {
 	u32 num_entries = htab->map.max_entries;
-	int err = -ENOMEM, i;
+	struct htab_elem_pool *pool;
+	int err, i;
 
 	if (!htab_is_percpu(htab) && !htab_is_lru(htab))
 		num_entries += num_possible_cpus();
 
-	htab->elems = bpf_map_area_alloc(htab->elem_size * num_entries,
-					 htab->map.numa_node);
-	if (!htab->elems)
-		return -ENOMEM;
+	err = htab_alloc_pools(htab, num_entries);
+	if (err)
+		return err;
 
+	err = -ENOMEM;
 	if (!htab_is_percpu(htab))
 		goto skip_percpu_elems;
 
-	for (i = 0; i < num_entries; i++) {
-		u32 size = round_up(htab->map.value_size, 8);
-		void __percpu *pptr;
-
-		pptr = __alloc_percpu_gfp(size, 8, GFP_USER | __GFP_NOWARN);
-		if (!pptr)
-			goto free_elems;
-		htab_elem_set_ptr(get_htab_elem(htab, i), htab->map.key_size,
-				  pptr);
-		cond_resched();
+	for_each_htab_pool(pool, htab) {
+		for (i = 0; i < pool->nr_elems; i++) {
+			u32 size = round_up(htab->map.value_size, 8);
+			void __percpu *pptr;
+
+			pptr = __alloc_percpu_gfp(size, 8,
+						  GFP_USER | __GFP_NOWARN);
+			if (!pptr)
+				goto free_elems;
+			htab_elem_set_ptr(get_htab_elem(htab, pool, i),
+					  htab->map.key_size, pptr);
+			cond_resched();
+		}
 	}
 
 skip_percpu_elems:
@@ -177,14 +295,27 @@ static int prealloc_init(struct bpf_htab *htab)
 	if (err)
 		goto free_elems;
 
-	if (htab_is_lru(htab))
-		bpf_lru_populate(&htab->lru, htab->elems,
+	if (htab_is_lru(htab)) {
+		bpf_lru_populate(&htab->lru, htab->pools[0].elems,
 				 offsetof(struct htab_elem, lru_node),
 				 htab->elem_size, num_entries);
-	else
+	} else if (htab->n_pools == 1) {
 		pcpu_freelist_populate(&htab->freelist,
-				       htab->elems + offsetof(struct htab_elem, fnode),
+				       htab->pools[0].elems +
+				       offsetof(struct htab_elem, fnode),
 				       htab->elem_size, num_entries);
+	} else {
+		for_each_htab_pool(pool, htab) {
+			if (!pool->nr_elems)
+				continue;
+			pcpu_freelist_populate_node(&htab->freelist, pool->node,
+						    pool->elems +
+						    offsetof(struct htab_elem,
+							     fnode),
+						    htab->elem_size,
+						    pool->nr_elems);
+		}
+	}
 
 	return 0;
 
@@ -668,7 +799,12 @@ static void free_htab_elem(struct bpf_htab *htab, struct htab_elem *l)
 	}
 
 	if (htab_is_prealloc(htab)) {
-		pcpu_freelist_push(&htab->freelist, &l->fnode);
+		int cpu = htab_elem_home_cpu(htab, l);
+
+		if (cpu < 0)
+			pcpu_freelist_push(&htab->freelist, &l->fnode);
+		else
+			pcpu_freelist_push_cpu(&htab->freelist, &l->fnode, cpu);
 	} else {
 		atomic_dec(&htab->count);
 		l->htab = htab;
@@ -1152,6 +1288,274 @@ static void htab_map_free(struct bpf_map *map)
 	kfree(htab);
 }
 
+/* The batch cursor is a bucket index. A whole bucket is copied out
+ * under its lock, so an element is never returned twice nor missed
+ * because of concurrent updates to the bucket, and the walk doesn't
+ * depend on the previous key still being in the table.
+ */
+static int
+__htab_map_lookup_and_delete_batch(struct bpf_map *map,
+				   const union bpf_attr *attr,
+				   union bpf_attr __user *uattr,
+				   bool do_delete, bool is_lru_map,
+				   bool is_percpu)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u32 bucket_cnt, total, key_size, value_size, roundup_key_size;
+	void *keys = NULL, *values = NULL, *value, *dst_key, *dst_val;
+	void __user *uvalues = u64_to_user_ptr(attr->batch.values);
+	void __user *ukeys = u64_to_user_ptr(attr->batch.keys);
+	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
+	u32 batch, max_count, size, bucket_size;
+	struct htab_elem *node_to_free = NULL;
+	struct hlist_nulls_head *head;
+	struct hlist_nulls_node *n;
+	unsigned long flags = 0;
+	bool locked = false;
+	struct htab_elem *l;
+	struct bucket *b;
+	int ret = 0;
+
+	if (attr->batch.elem_flags || attr->batch.flags)
+		return -EINVAL;
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	batch = 0;
+	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+
+	if (batch >= htab->n_buckets)
+		return -ENOENT;
+
+	key_size = htab->map.key_size;
+	roundup_key_size = round_up(htab->map.key_size, 8);
+	value_size = htab->map.value_size;
+	size = round_up(value_size, 8);
+	if (is_percpu)
+		value_size = size * num_possible_cpus();
+	total = 0;
+	/* a good starting guess, most buckets hold fewer elements */
+	bucket_size = 5;
+
+alloc:
+	/* copy_to_user() can't be done under the bucket lock, stage the
+	 * bucket in kernel buffers big enough for it
+	 */
+	keys = kvmalloc_array(key_size, bucket_size, GFP_USER | __GFP_NOWARN);
+	values = kvmalloc_array(value_size, bucket_size,
+				GFP_USER | __GFP_NOWARN);
+	if (!keys || !values) {
+		ret = -ENOMEM;
+		goto after_loop;
+	}
+
+again:
+	preempt_disable();
+	__this_cpu_inc(bpf_prog_active);
+	rcu_read_lock();
+again_nocopy:
+	dst_key = keys;
+	dst_val = values;
+	b = &htab->buckets[batch];
+	head = &b->head;
+	/* only take the lock for a bucket that isn't empty */
+	if (locked)
+		raw_spin_lock_irqsave(&b->lock, flags);
+
+	bucket_cnt = 0;
+	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
+		bucket_cnt++;
+
+	if (bucket_cnt && !locked) {
+		locked = true;
+		goto again_nocopy;
+	}
+
+	if (bucket_cnt > (max_count - total)) {
+		if (total == 0)
+			ret = -ENOSPC;
+		/* bucket_cnt > 0, so we hold the lock */
+		raw_spin_unlock_irqrestore(&b->lock, flags);
+		rcu_read_unlock();
+		__this_cpu_dec(bpf_prog_active);
+		preempt_enable();
+		goto after_loop;
+	}
+
+	if (bucket_cnt > bucket_size) {
+		bucket_size = bucket_cnt;
+		/* bucket_cnt > 0, so we hold the lock */
+		raw_spin_unlock_irqrestore(&b->lock, flags);
+		rcu_read_unlock();
+		__this_cpu_dec(bpf_prog_active);
+		preempt_enable();
+		locked = false;
+		kvfree(keys);
+		kvfree(values);
+		goto alloc;
+	}
+
+	if (!locked)
+		goto next_batch;
+
+	hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
+		memcpy(dst_key, l->key, key_size);
+
+		if (is_percpu) {
+			int off = 0, cpu;
+			void __percpu *pptr;
+
+			pptr = htab_elem_get_ptr(l, map->key_size);
+			for_each_possible_cpu(cpu) {
+				bpf_long_memcpy(dst_val + off,
+						per_cpu_ptr(pptr, cpu), size);
+				off += size;
+			}
+		} else {
+			value = l->key + roundup_key_size;
+			memcpy(dst_val, value, value_size);
+		}
+		if (do_delete) {
+			hlist_nulls_del_rcu(&l->hash_node);
+
+			/* bpf_lru_push_free() takes the LRU lock, which
+			 * must not nest inside the bucket lock, see
+			 * prealloc_lru_pop(). Free after unlocking.
+			 */
+			if (is_lru_map) {
+				l->batch_flink = node_to_free;
+				node_to_free = l;
+			} else {
+				free_htab_elem(htab, l);
+			}
+		}
+		dst_key += key_size;
+		dst_val += value_size;
+	}
+
+	raw_spin_unlock_irqrestore(&b->lock, flags);
+	locked = false;
+
+	while (node_to_free) {
+		l = node_to_free;
+		node_to_free = node_to_free->batch_flink;
+		bpf_lru_push_free(&htab->lru, &l->lru_node);
+	}
+
+next_batch:
+	/* empty buckets need no copying, move on without leaving RCU */
+	if (!bucket_cnt && (batch + 1 < htab->n_buckets)) {
+		batch++;
+		goto again_nocopy;
+	}
+
+	rcu_read_unlock();
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+	if (bucket_cnt && (copy_to_user(ukeys + total * key_size, keys,
+					key_size * bucket_cnt) ||
+			   copy_to_user(uvalues + total * value_size, values,
+					value_size * bucket_cnt))) {
+		ret = -EFAULT;
+		goto after_loop;
+	}
+
+	total += bucket_cnt;
+	batch++;
+	if (batch >= htab->n_buckets) {
+		ret = -ENOENT;
+		goto after_loop;
+	}
+	cond_resched();
+	goto again;
+
+after_loop:
+	if (ret == -EFAULT)
+		goto out;
+
+	/* copy # of entries and next batch */
+	ubatch = u64_to_user_ptr(attr->batch.out_batch);
+	if (copy_to_user(ubatch, &batch, sizeof(batch)) ||
+	    put_user(total, &uattr->batch.count))
+		ret = -EFAULT;
+
+out:
+	kvfree(keys);
+	kvfree(values);
+	return ret;
+}
+
+static int htab_map_lookup_batch(struct bpf_map *map,
+				 const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  false, false);
+}
+
+static int htab_map_lookup_and_delete_batch(struct bpf_map *map,
+					    const union bpf_attr *attr,
+					    union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  false, false);
+}
+
+static int htab_lru_map_lookup_batch(struct bpf_map *map,
+				     const union bpf_attr *attr,
+				     union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  true, false);
+}
+
+static int htab_lru_map_lookup_and_delete_batch(struct bpf_map *map,
+						const union bpf_attr *attr,
+						union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  true, false);
+}
+
+static int htab_percpu_map_lookup_batch(struct bpf_map *map,
+					const union bpf_attr *attr,
+					union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  false, true);
+}
+
+static int htab_percpu_map_lookup_and_delete_batch(struct bpf_map *map,
+						   const union bpf_attr *attr,
+						   union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  false, true);
+}
+
+static int htab_lru_percpu_map_lookup_batch(struct bpf_map *map,
+					    const union bpf_attr *attr,
+					    union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, false,
+						  true, true);
+}
+
+static int
+htab_lru_percpu_map_lookup_and_delete_batch(struct bpf_map *map,
+					    const union bpf_attr *attr,
+					    union bpf_attr __user *uattr)
+{
+	return __htab_map_lookup_and_delete_batch(map, attr, uattr, true,
+						  true, true);
+}
+
 const struct bpf_map_ops htab_map_ops = {
 	.map_alloc_check = htab_map_alloc_check,
 	.map_alloc = htab_map_alloc,
@@ -1161,6 +1565,10 @@ const struct bpf_map_ops htab_map_ops = {
 	.map_update_elem = htab_map_update_elem,
 	.map_delete_elem = htab_map_delete_elem,
 	.map_gen_lookup = htab_map_gen_lookup,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_map_ops = {
@@ -1172,6 +1580,10 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_update_elem = htab_lru_map_update_elem,
 	.map_delete_elem = htab_lru_map_delete_elem,
 	.map_gen_lookup = htab_lru_map_gen_lookup,
+	.map_lookup_batch = htab_lru_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_lru_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 /* Called from eBPF program */
@@ -1255,6 +1667,10 @@ const struct bpf_map_ops htab_percpu_map_ops = {
 	.map_lookup_elem = htab_percpu_map_lookup_elem,
 	.map_update_elem = htab_percpu_map_update_elem,
 	.map_delete_elem = htab_map_delete_elem,
+	.map_lookup_batch = htab_percpu_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_percpu_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_percpu_map_ops = {
@@ -1265,6 +1681,10 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_lookup_elem = htab_lru_percpu_map_lookup_elem,
 	.map_update_elem = htab_lru_percpu_map_update_elem,
 	.map_delete_elem = htab_lru_map_delete_elem,
+	.map_lookup_batch = htab_lru_percpu_map_lookup_batch,
+	.map_lookup_and_delete_batch = htab_lru_percpu_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 static int fd_htab_map_alloc_check(union bpf_attr *attr)
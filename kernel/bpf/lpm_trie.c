@@ -29,9 +29,32 @@ struct lpm_trie_node {
 	u8				data[0];
 };
 
+/* The first LPM_STRIDE_BITS of a lookup are resolved with a direct
+ * indexed table instead of walking the top of the trie bit by bit. It
+ * is split into chunks that are copied, updated and swapped in with
+ * RCU whenever an update changes any of their entries.
+ */
+#define LPM_STRIDE_BITS		16
+#define LPM_CHUNK_BITS		8
+#define LPM_CHUNK_SIZE		(1U << LPM_CHUNK_BITS)
+#define LPM_NR_CHUNKS		(1U << (LPM_STRIDE_BITS - LPM_CHUNK_BITS))
+
+struct lpm_stride_ent {
+	/* first node on the path with prefixlen >= LPM_STRIDE_BITS */
+	struct lpm_trie_node		*node;
+	/* longest non-intermediate match above @node */
+	struct lpm_trie_node		*best;
+};
+
+struct lpm_stride_chunk {
+	struct rcu_head			rcu;
+	struct lpm_stride_ent		ent[LPM_CHUNK_SIZE];
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
+	struct lpm_stride_chunk __rcu	**stride;
 	size_t				n_entries;
 	size_t				max_prefixlen;
 	size_t				data_size;
@@ -147,6 +170,14 @@ struct lpm_trie {
  * is a child that can be used to become more specific, the trie is traversed
  * downwards. The last node in the traversal that is a non-intermediate one is
  * returned.
+ *
+ * With large tries, the top of that walk is the same for many lookups but
+ * still costs a cache miss per level. Tries whose keys are at least
+ * LPM_STRIDE_BITS wide thus also keep a table indexed by the first
+ * LPM_STRIDE_BITS of the key. Each entry caches where the walk above would
+ * be after consuming those bits: the first node on the path whose prefix is
+ * at least that long, and the best match found on the way there. Lookups
+ * with a long enough key start from there.
  */
 
 static inline int extract_bit(const u8 *data, size_t index)
@@ -185,16 +216,37 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
+static inline u32 lpm_stride_index(const u8 *data)
+{
+	return (data[0] << 8) | data[1];
+}
+
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *found = NULL;
 	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_stride_chunk *chunk = NULL;
+	u32 idx = 0;
+
+	/* Start walking the trie from the stride table entry if there is
+	 * one for this key, from the root node otherwise ...
+	 */
+	if (trie->stride && key->prefixlen >= LPM_STRIDE_BITS) {
+		idx = lpm_stride_index(key->data);
+		chunk = rcu_dereference(trie->stride[idx >> LPM_CHUNK_BITS]);
+	}
 
-	/* Start walking the trie from the root node ... */
+	if (chunk) {
+		idx &= LPM_CHUNK_SIZE - 1;
+		node = chunk->ent[idx].node;
+		found = chunk->ent[idx].best;
+	} else {
+		node = rcu_dereference(trie->root);
+	}
 
-	for (node = rcu_dereference(trie->root); node;) {
+	while (node) {
 		unsigned int next_bit;
 		size_t matchlen;
 
@@ -258,12 +310,91 @@ static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
 	return node;
 }
 
+/* Compute the stride table entry for @idx by walking the trie the way
+ * trie_lookup_elem() does, stopping at the first node whose prefix is at
+ * least LPM_STRIDE_BITS long.
+ */
+static void lpm_stride_fill(const struct lpm_trie *trie, u32 idx,
+			    struct lpm_stride_ent *ent)
+{
+	u8 data[2] = { idx >> 8, idx & 0xff };
+	struct lpm_trie_node *node, *best = NULL;
+	u32 mismatch;
+
+	node = rcu_dereference_protected(trie->root,
+					 lockdep_is_held(&trie->lock));
+	while (node && node->prefixlen < LPM_STRIDE_BITS) {
+		mismatch = lpm_stride_index(node->data) ^ idx;
+		if (mismatch >> (LPM_STRIDE_BITS - node->prefixlen)) {
+			node = NULL;
+			break;
+		}
+
+		if (!(node->flags & LPM_TREE_NODE_FLAG_IM))
+			best = node;
+
+		node = rcu_dereference_protected(
+			node->child[extract_bit(data, node->prefixlen)],
+			lockdep_is_held(&trie->lock));
+	}
+
+	ent->node = node;
+	ent->best = best;
+}
+
+/* A node with the prefix @data/@prefixlen was added, removed or changed.
+ * Recompute the stride table entries for all keys it covers. Chunks
+ * that can't be reallocated are dropped, which only sends their lookups
+ * the long way from the root.
+ */
+static void lpm_stride_update(struct lpm_trie *trie, const u8 *data,
+			      u32 prefixlen)
+{
+	u32 bits = min_t(u32, prefixlen, LPM_STRIDE_BITS);
+	u32 first, last, idx, c;
+
+	if (!trie->stride)
+		return;
+
+	first = lpm_stride_index(data);
+	if (bits < LPM_STRIDE_BITS)
+		first &= ~((1U << (LPM_STRIDE_BITS - bits)) - 1);
+	last = first + (1U << (LPM_STRIDE_BITS - bits)) - 1;
+
+	for (c = first >> LPM_CHUNK_BITS; c <= last >> LPM_CHUNK_BITS; c++) {
+		struct lpm_stride_chunk *old, *new;
+		u32 start = c << LPM_CHUNK_BITS;
+		u32 from, to;
+
+		old = rcu_dereference_protected(trie->stride[c],
+						lockdep_is_held(&trie->lock));
+		new = kmalloc_node(sizeof(*new), GFP_ATOMIC | __GFP_NOWARN,
+				   trie->map.numa_node);
+		if (new) {
+			/* a new chunk needs all of its entries */
+			from = old ? max(first, start) : start;
+			to = old ? min(last, start + LPM_CHUNK_SIZE - 1) :
+				   start + LPM_CHUNK_SIZE - 1;
+			if (old)
+				memcpy(new->ent, old->ent, sizeof(new->ent));
+			for (idx = from; idx <= to; idx++)
+				lpm_stride_fill(trie, idx,
+						&new->ent[idx - start]);
+		}
+
+		rcu_assign_pointer(trie->stride[c], new);
+		if (old)
+			kfree_rcu(old, rcu);
+	}
+}
+
 /* Called from syscall or from eBPF program */
 static int trie_update_elem(struct bpf_map *map,
 			    void *_key, void *value, u64 flags)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *im_node = NULL, *new_node = NULL;
+	struct lpm_trie_node *top = NULL, *old_node = NULL;
 	struct lpm_trie_node __rcu **slot;
 	struct bpf_lpm_trie_key *key = _key;
 	unsigned long irq_flags;
@@ -298,6 +429,8 @@ static int trie_update_elem(struct bpf_map *map,
 	RCU_INIT_POINTER(new_node->child[0], NULL);
 	RCU_INIT_POINTER(new_node->child[1], NULL);
 	memcpy(new_node->data, key->data, trie->data_size);
+	/* the topmost node the update touches */
+	top = new_node;
 
 	/* Now find a slot to attach the new node. To do that, walk the tree
 	 * from the root and match as many bits as possible for each node until
@@ -338,7 +471,8 @@ static int trie_update_elem(struct bpf_map *map,
 			trie->n_entries--;
 
 		rcu_assign_pointer(*slot, new_node);
-		kfree_rcu(node, rcu);
+		/* freed once the stride table no longer points to it */
+		old_node = node;
 
 		goto out;
 	}
@@ -374,6 +508,7 @@ static int trie_update_elem(struct bpf_map *map,
 
 	/* Finally, assign the intermediate node to the determined spot */
 	rcu_assign_pointer(*slot, im_node);
+	top = im_node;
 
 out:
 	if (ret) {
@@ -382,6 +517,10 @@ static int trie_update_elem(struct bpf_map *map,
 
 		kfree(new_node);
 		kfree(im_node);
+	} else {
+		lpm_stride_update(trie, top->data, top->prefixlen);
+		if (old_node)
+			kfree_rcu(old_node, rcu);
 	}
 
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
@@ -443,6 +582,7 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 	if (rcu_access_pointer(node->child[0]) &&
 	    rcu_access_pointer(node->child[1])) {
 		node->flags |= LPM_TREE_NODE_FLAG_IM;
+		lpm_stride_update(trie, node->data, node->prefixlen);
 		goto out;
 	}
 
@@ -461,6 +601,7 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 		else
 			rcu_assign_pointer(
 				*trim2, rcu_access_pointer(parent->child[0]));
+		lpm_stride_update(trie, parent->data, parent->prefixlen);
 		kfree_rcu(parent, rcu);
 		kfree_rcu(node, rcu);
 		goto out;
@@ -476,6 +617,7 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 		rcu_assign_pointer(*trim, rcu_access_pointer(node->child[1]));
 	else
 		RCU_INIT_POINTER(*trim, NULL);
+	lpm_stride_update(trie, node->data, node->prefixlen);
 	kfree_rcu(node, rcu);
 
 out:
@@ -530,6 +672,9 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 	cost_per_node = sizeof(struct lpm_trie_node) +
 			attr->value_size + trie->data_size;
 	cost += (u64) attr->max_entries * cost_per_node;
+	if (trie->max_prefixlen >= LPM_STRIDE_BITS)
+		cost += LPM_NR_CHUNKS * (sizeof(struct lpm_stride_chunk) +
+					 sizeof(*trie->stride));
 	if (cost >= U32_MAX - PAGE_SIZE) {
 		ret = -E2BIG;
 		goto out_err;
@@ -541,6 +686,18 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 	if (ret)
 		goto out_err;
 
+	/* Chunks of the stride table are only allocated by updates. */
+	if (trie->max_prefixlen >= LPM_STRIDE_BITS) {
+		trie->stride = kcalloc_node(LPM_NR_CHUNKS,
+					    sizeof(*trie->stride),
+					    GFP_USER | __GFP_NOWARN,
+					    trie->map.numa_node);
+		if (!trie->stride) {
+			ret = -ENOMEM;
+			goto out_err;
+		}
+	}
+
 	raw_spin_lock_init(&trie->lock);
 
 	return &trie->map;
@@ -590,6 +747,13 @@ static void trie_free(struct bpf_map *map)
 	}
 
 out:
+	if (trie->stride) {
+		unsigned int i;
+
+		for (i = 0; i < LPM_NR_CHUNKS; i++)
+			kfree(rcu_dereference_protected(trie->stride[i], 1));
+		kfree(trie->stride);
+	}
 	kfree(trie);
 }
 
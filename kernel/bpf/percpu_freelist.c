@@ -45,14 +45,41 @@ void pcpu_freelist_push(struct pcpu_freelist *s,
 	__pcpu_freelist_push(head, node);
 }
 
-void pcpu_freelist_populate(struct pcpu_freelist *s, void *buf, u32 elem_size,
-			    u32 nr_elems)
+/* Push onto the list of a specific, possibly remote, cpu. Used to hand
+ * NUMA-local elements back to their home node.
+ */
+void pcpu_freelist_push_cpu(struct pcpu_freelist *s,
+			    struct pcpu_freelist_node *node, int cpu)
+{
+	struct pcpu_freelist_head *head = per_cpu_ptr(s->freelist, cpu);
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__pcpu_freelist_push(head, node);
+	local_irq_restore(flags);
+}
+
+/* Spread nr_elems elements of buf over the lists of the possible cpus
+ * of node nid, or of all possible cpus when nid is NUMA_NO_NODE.
+ */
+void pcpu_freelist_populate_node(struct pcpu_freelist *s, int nid, void *buf,
+				 u32 elem_size, u32 nr_elems)
 {
 	struct pcpu_freelist_head *head;
 	unsigned long flags;
-	int i, cpu, pcpu_entries;
+	int i, cpu, nr_cpus, pcpu_entries;
 
-	pcpu_entries = nr_elems / num_possible_cpus() + 1;
+	if (!nr_elems)
+		return;
+
+	nr_cpus = 0;
+	for_each_possible_cpu(cpu)
+		if (nid == NUMA_NO_NODE || cpu_to_node(cpu) == nid)
+			nr_cpus++;
+	if (WARN_ON_ONCE(!nr_cpus))
+		return;
+
+	pcpu_entries = nr_elems / nr_cpus + 1;
 	i = 0;
 
 	/* disable irq to workaround lockdep false positive
@@ -61,6 +88,8 @@ void pcpu_freelist_populate(struct pcpu_freelist *s, void *buf, u32 elem_size,
 	 */
 	local_irq_save(flags);
 	for_each_possible_cpu(cpu) {
+		if (nid != NUMA_NO_NODE && cpu_to_node(cpu) != nid)
+			continue;
 again:
 		head = per_cpu_ptr(s->freelist, cpu);
 		__pcpu_freelist_push(head, buf);
@@ -74,31 +103,57 @@ void pcpu_freelist_populate(struct pcpu_freelist *s, void *buf, u32 elem_size,
 	local_irq_restore(flags);
 }
 
-struct pcpu_freelist_node *pcpu_freelist_pop(struct pcpu_freelist *s)
+void pcpu_freelist_populate(struct pcpu_freelist *s, void *buf, u32 elem_size,
+			    u32 nr_elems)
+{
+	pcpu_freelist_populate_node(s, NUMA_NO_NODE, buf, elem_size, nr_elems);
+}
+
+static inline struct pcpu_freelist_node *
+__pcpu_freelist_pop(struct pcpu_freelist_head *head)
 {
-	struct pcpu_freelist_head *head;
 	struct pcpu_freelist_node *node;
+
+	raw_spin_lock(&head->lock);
+	node = head->first;
+	if (node)
+		head->first = node->next;
+	raw_spin_unlock(&head->lock);
+	return node;
+}
+
+struct pcpu_freelist_node *pcpu_freelist_pop(struct pcpu_freelist *s)
+{
+	struct pcpu_freelist_node *node = NULL;
+	bool remote = false, skipped = false;
 	unsigned long flags;
-	int orig_cpu, cpu;
+	int orig_cpu, cpu, nid;
 
 	local_irq_save(flags);
 	orig_cpu = cpu = raw_smp_processor_id();
+	nid = cpu_to_node(orig_cpu);
+	/* First walk the lists of the cpus on our own node, so that node
+	 * local elements are handed out while there are any, and only
+	 * then steal from remote nodes.
+	 */
 	while (1) {
-		head = per_cpu_ptr(s->freelist, cpu);
-		raw_spin_lock(&head->lock);
-		node = head->first;
-		if (node) {
-			head->first = node->next;
-			raw_spin_unlock_irqrestore(&head->lock, flags);
-			return node;
+		if ((cpu_to_node(cpu) != nid) == remote) {
+			node = __pcpu_freelist_pop(per_cpu_ptr(s->freelist,
+							       cpu));
+			if (node)
+				break;
+		} else {
+			skipped = true;
 		}
-		raw_spin_unlock(&head->lock);
 		cpu = cpumask_next(cpu, cpu_possible_mask);
 		if (cpu >= nr_cpu_ids)
 			cpu = 0;
 		if (cpu == orig_cpu) {
-			local_irq_restore(flags);
-			return NULL;
+			if (remote || !skipped)
+				break;
+			remote = true;
 		}
 	}
+	local_irq_restore(flags);
+	return node;
 }
@@ -8,6 +8,7 @@
 #define __PERCPU_FREELIST_H__
 #include <linux/spinlock.h>
 #include <linux/percpu.h>
+#include <linux/topology.h>
 
 struct pcpu_freelist_head {
 	struct pcpu_freelist_node *first;
@@ -23,9 +24,13 @@ struct pcpu_freelist_node {
 };
 
 void pcpu_freelist_push(struct pcpu_freelist *, struct pcpu_freelist_node *);
+void pcpu_freelist_push_cpu(struct pcpu_freelist *s,
+			    struct pcpu_freelist_node *node, int cpu);
 struct pcpu_freelist_node *pcpu_freelist_pop(struct pcpu_freelist *);
 void pcpu_freelist_populate(struct pcpu_freelist *s, void *buf, u32 elem_size,
 			    u32 nr_elems);
+void pcpu_freelist_populate_node(struct pcpu_freelist *s, int nid, void *buf,
+				 u32 elem_size, u32 nr_elems);
 int pcpu_freelist_init(struct pcpu_freelist *);
 void pcpu_freelist_destroy(struct pcpu_freelist *s);
 #endif
@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Direct-call attach points for BPF_PROG_TYPE_TRACING programs.
+ *
+ * Every kernel function with programs attached gets a trampoline: a
+ * page of code generated by the JIT that saves the function's register
+ * arguments into an array of u64 on its stack, runs the fentry programs
+ * with that array as context, and, when there are fexit programs, calls
+ * the function body itself and runs them with the return value appended
+ * to the array. The function's fentry call site, a 5 byte nop, is then
+ * patched into a direct call to the trampoline.
+ *
+ * The page holds two images. A new image is always generated into the
+ * half that isn't live, and the call site is switched over to it, so
+ * that a cpu already running the old one is never disturbed.
+ */
+#include <linux/hash.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/kallsyms.h>
+#include <linux/moduleloader.h>
+#include <linux/rcupdate.h>
+#include <linux/uaccess.h>
+
+#define TRAMPOLINE_HASH_BITS 10
+#define TRAMPOLINE_TABLE_SIZE (1 << TRAMPOLINE_HASH_BITS)
+
+struct bpf_trampoline {
+	struct hlist_node hlist;
+	/* serializes updates of progs_hlist and of the image */
+	struct mutex mutex;
+	refcount_t refcnt;
+	void *func_addr;
+	u32 nr_args;
+	struct hlist_head progs_hlist[BPF_TRAMP_MAX];
+	int progs_cnt[BPF_TRAMP_MAX];
+	void *image;
+	u64 selector;
+};
+
+static struct hlist_head trampoline_table[TRAMPOLINE_TABLE_SIZE];
+
+/* serializes access to trampoline_table */
+static DEFINE_MUTEX(trampoline_mutex);
+
+static struct bpf_trampoline *bpf_trampoline_lookup(void *func_addr,
+						    u32 nr_args)
+{
+	struct bpf_trampoline *tr;
+	struct hlist_head *head;
+	void *image;
+	int i;
+
+	mutex_lock(&trampoline_mutex);
+	head = &trampoline_table[hash_ptr(func_addr, TRAMPOLINE_HASH_BITS)];
+	hlist_for_each_entry(tr, head, hlist) {
+		if (tr->func_addr == func_addr) {
+			refcount_inc(&tr->refcnt);
+			goto out;
+		}
+	}
+	tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+	if (!tr)
+		goto out;
+
+	/* module_alloc() places the image within a call's reach of the
+	 * kernel text, which a direct call needs.
+	 */
+	image = module_alloc(PAGE_SIZE);
+	if (!image) {
+		kfree(tr);
+		tr = NULL;
+		goto out;
+	}
+
+	tr->func_addr = func_addr;
+	tr->nr_args = nr_args;
+	INIT_HLIST_NODE(&tr->hlist);
+	hlist_add_head(&tr->hlist, head);
+	refcount_set(&tr->refcnt, 1);
+	mutex_init(&tr->mutex);
+	for (i = 0; i < BPF_TRAMP_MAX; i++)
+		INIT_HLIST_HEAD(&tr->progs_hlist[i]);
+	tr->image = image;
+out:
+	mutex_unlock(&trampoline_mutex);
+	return tr;
+}
+
+static void bpf_trampoline_put(struct bpf_trampoline *tr)
+{
+	mutex_lock(&trampoline_mutex);
+	if (!refcount_dec_and_test(&tr->refcnt))
+		goto out;
+	WARN_ON_ONCE(mutex_is_locked(&tr->mutex));
+	if (WARN_ON_ONCE(!hlist_empty(&tr->progs_hlist[BPF_TRAMP_FENTRY])))
+		goto out;
+	if (WARN_ON_ONCE(!hlist_empty(&tr->progs_hlist[BPF_TRAMP_FEXIT])))
+		goto out;
+	/* The call site no longer points to the image, but a task may
+	 * still be preempted inside of it. Wait for every task to pass
+	 * through a voluntary context switch before freeing it.
+	 */
+	synchronize_rcu_tasks();
+	module_memfree(tr->image);
+	hlist_del(&tr->hlist);
+	kfree(tr);
+out:
+	mutex_unlock(&trampoline_mutex);
+}
+
+static int bpf_trampoline_update(struct bpf_trampoline *tr)
+{
+	void *old_image = tr->image + ((tr->selector + 1) & 1) * PAGE_SIZE / 2;
+	void *new_image = tr->image + (tr->selector & 1) * PAGE_SIZE / 2;
+	struct bpf_prog *progs_to_run[BPF_MAX_TRAMP_PROGS];
+	int fentry_cnt = tr->progs_cnt[BPF_TRAMP_FENTRY];
+	int fexit_cnt = tr->progs_cnt[BPF_TRAMP_FEXIT];
+	struct bpf_prog **progs, **fentry, **fexit;
+	u32 flags = BPF_TRAMP_F_RESTORE_REGS;
+	struct bpf_prog_aux *aux;
+	int err;
+
+	if (fentry_cnt + fexit_cnt == 0) {
+		err = bpf_arch_text_poke(tr->func_addr, BPF_MOD_CALL_TO_NOP,
+					 old_image, NULL);
+		tr->selector = 0;
+		return err;
+	}
+
+	fentry = progs = progs_to_run;
+	hlist_for_each_entry(aux, &tr->progs_hlist[BPF_TRAMP_FENTRY],
+			     tramp_hlist)
+		*progs++ = aux->prog;
+
+	fexit = progs;
+	hlist_for_each_entry(aux, &tr->progs_hlist[BPF_TRAMP_FEXIT],
+			     tramp_hlist)
+		*progs++ = aux->prog;
+
+	if (fexit_cnt)
+		flags = BPF_TRAMP_F_CALL_ORIG | BPF_TRAMP_F_SKIP_FRAME;
+
+	/* The half we are about to overwrite isn't live, but it was two
+	 * updates ago, and a task may have been preempted in it since.
+	 */
+	synchronize_rcu_tasks();
+
+	err = arch_prepare_bpf_trampoline(new_image, tr->nr_args, flags,
+					  fentry, fentry_cnt,
+					  fexit, fexit_cnt,
+					  tr->func_addr);
+	if (err)
+		return err;
+
+	if (tr->selector)
+		err = bpf_arch_text_poke(tr->func_addr, BPF_MOD_CALL_TO_CALL,
+					 old_image, new_image);
+	else
+		err = bpf_arch_text_poke(tr->func_addr, BPF_MOD_NOP_TO_CALL,
+					 NULL, new_image);
+	if (err)
+		return err;
+
+	tr->selector++;
+	return 0;
+}
+
+static enum bpf_tramp_prog_type bpf_prog_tramp_type(struct bpf_prog *prog)
+{
+	return prog->expected_attach_type == BPF_TRACE_FEXIT ?
+	       BPF_TRAMP_FEXIT : BPF_TRAMP_FENTRY;
+}
+
+int bpf_trampoline_link_prog(struct bpf_prog *prog)
+{
+	enum bpf_tramp_prog_type kind = bpf_prog_tramp_type(prog);
+	struct bpf_prog_aux *aux = prog->aux;
+	struct bpf_trampoline *tr;
+	int err;
+
+	tr = bpf_trampoline_lookup(aux->attach_func_addr,
+				   aux->attach_func_nargs);
+	if (!tr)
+		return -ENOMEM;
+
+	mutex_lock(&tr->mutex);
+	if (!hlist_unhashed(&aux->tramp_hlist)) {
+		/* prog is already attached */
+		err = -EBUSY;
+		goto out;
+	}
+	if (tr->nr_args != aux->attach_func_nargs) {
+		err = -EINVAL;
+		goto out;
+	}
+	if (tr->progs_cnt[BPF_TRAMP_FENTRY] + tr->progs_cnt[BPF_TRAMP_FEXIT] >=
+	    BPF_MAX_TRAMP_PROGS) {
+		err = -E2BIG;
+		goto out;
+	}
+
+	hlist_add_head(&aux->tramp_hlist, &tr->progs_hlist[kind]);
+	tr->progs_cnt[kind]++;
+	err = bpf_trampoline_update(tr);
+	if (err) {
+		hlist_del_init(&aux->tramp_hlist);
+		tr->progs_cnt[kind]--;
+		goto out;
+	}
+	aux->trampoline = tr;
+out:
+	mutex_unlock(&tr->mutex);
+	if (err)
+		bpf_trampoline_put(tr);
+	return err;
+}
+
+int bpf_trampoline_unlink_prog(struct bpf_prog *prog)
+{
+	enum bpf_tramp_prog_type kind = bpf_prog_tramp_type(prog);
+	struct bpf_trampoline *tr = prog->aux->trampoline;
+	int err;
+
+	if (WARN_ON_ONCE(!tr))
+		return -EINVAL;
+
+	mutex_lock(&tr->mutex);
+	hlist_del_init(&prog->aux->tramp_hlist);
+	tr->progs_cnt[kind]--;
+	err = bpf_trampoline_update(tr);
+	prog->aux->trampoline = NULL;
+	mutex_unlock(&tr->mutex);
+
+	bpf_trampoline_put(tr);
+	return err;
+}
+
+/* Called by the trampoline around each program it runs. A program is
+ * skipped when another one is already running on this cpu, so that it
+ * can't recurse through a traced function it calls itself.
+ */
+u32 notrace __bpf_prog_enter(void)
+{
+	preempt_disable();
+	rcu_read_lock();
+	return __this_cpu_inc_return(bpf_prog_active) == 1;
+}
+
+void notrace __bpf_prog_exit(void)
+{
+	__this_cpu_dec(bpf_prog_active);
+	rcu_read_unlock();
+	preempt_enable();
+}
+
+int __weak
+arch_prepare_bpf_trampoline(void *image, u32 nr_args, u32 flags,
+			    struct bpf_prog **fentry_progs, int fentry_cnt,
+			    struct bpf_prog **fexit_progs, int fexit_cnt,
+			    void *orig_call)
+{
+	return -ENOTSUPP;
+}
+
+int __weak bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
+			      void *old_addr, void *new_addr)
+{
+	return -ENOTSUPP;
+}
+
+/* Look up the function named in attr for a tracing program at load
+ * time, since the verifier needs its number of arguments to check
+ * context accesses.
+ */
+int bpf_tracing_prog_resolve(struct bpf_prog *prog,
+			     const union bpf_attr *attr)
+{
+	char name[KSYM_NAME_LEN];
+	unsigned long addr;
+
+	if (attr->attach_func_nargs > BPF_MAX_TRAMP_ARGS)
+		return -E2BIG;
+
+	if (strncpy_from_user(name, u64_to_user_ptr(attr->attach_func_name),
+			      sizeof(name) - 1) < 0)
+		return -EFAULT;
+	name[sizeof(name) - 1] = 0;
+
+	addr = kallsyms_lookup_name(name);
+	if (!addr)
+		return -ENOENT;
+
+	prog->aux->attach_func_addr = (void *)addr;
+	prog->aux->attach_func_nargs = attr->attach_func_nargs;
+	return 0;
+}
+
+BPF_CALL_3(bpf_tracing_probe_read, void *, dst, u32, size,
+	   const void *, unsafe_ptr)
+{
+	int ret;
+
+	ret = probe_kernel_read(dst, unsafe_ptr, size);
+	if (unlikely(ret < 0))
+		memset(dst, 0, size);
+
+	return ret;
+}
+
+static const struct bpf_func_proto bpf_tracing_probe_read_proto = {
+	.func		= bpf_tracing_probe_read,
+	.gpl_only	= true,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg2_type	= ARG_CONST_SIZE_OR_ZERO,
+	.arg3_type	= ARG_ANYTHING,
+};
+
+static const struct bpf_func_proto *
+tracing_prog_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	switch (func_id) {
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_probe_read:
+		return &bpf_tracing_probe_read_proto;
+	case BPF_FUNC_ktime_get_ns:
+		return &bpf_ktime_get_ns_proto;
+	case BPF_FUNC_tail_call:
+		return &bpf_tail_call_proto;
+	case BPF_FUNC_get_current_pid_tgid:
+		return &bpf_get_current_pid_tgid_proto;
+	case BPF_FUNC_get_current_uid_gid:
+		return &bpf_get_current_uid_gid_proto;
+	case BPF_FUNC_get_current_comm:
+		return &bpf_get_current_comm_proto;
+	case BPF_FUNC_get_prandom_u32:
+		return &bpf_get_prandom_u32_proto;
+	case BPF_FUNC_get_smp_processor_id:
+		return &bpf_get_smp_processor_id_proto;
+	case BPF_FUNC_get_numa_node_id:
+		return &bpf_get_numa_node_id_proto;
+	case BPF_FUNC_ringbuf_output:
+		return &bpf_ringbuf_output_proto;
+	case BPF_FUNC_ringbuf_query:
+		return &bpf_ringbuf_query_proto;
+	default:
+		return NULL;
+	}
+}
+
+static bool tracing_prog_is_valid_access(int off, int size,
+					 enum bpf_access_type type,
+					 const struct bpf_prog *prog,
+					 struct bpf_insn_access_aux *info)
+{
+	u32 nr_slots = prog->aux->attach_func_nargs;
+
+	/* fexit programs see the return value after the arguments */
+	if (prog->expected_attach_type == BPF_TRACE_FEXIT)
+		nr_slots++;
+
+	if (off < 0 || off >= sizeof(__u64) * nr_slots)
+		return false;
+	if (type != BPF_READ)
+		return false;
+	if (off % size != 0)
+		return false;
+	return true;
+}
+
+const struct bpf_verifier_ops tracing_verifier_ops = {
+	.get_func_proto  = tracing_prog_func_proto,
+	.is_valid_access = tracing_prog_is_valid_access,
+};
+
+const struct bpf_prog_ops tracing_prog_ops = {
+};
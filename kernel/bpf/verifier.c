@@ -42,7 +42,9 @@ static const struct bpf_verifier_ops * const bpf_verifier_ops[] = {
  * The first pass is depth-first-search to check that the program is a DAG.
  * It rejects the following programs:
  * - larger than BPF_MAXINSNS insns
- * - if loop is present (detected via back-edge)
+ * - if loop is present (detected via back-edge), unless the program is
+ *   loaded by a privileged user: the second pass then has to prove that
+ *   every loop terminates
  * - unreachable insns exist (shouldn't be a forest. program = one function)
  * - out of bounds or malformed jumps
  * The second pass is all possible path descent from the 1st insn.
@@ -244,10 +246,12 @@ static const char * const reg_type_str[] = {
 static void print_liveness(struct bpf_verifier_env *env,
 			   enum bpf_reg_liveness live)
 {
-	if (live & (REG_LIVE_READ | REG_LIVE_WRITTEN))
+	if (live & (REG_LIVE_READ | REG_LIVE_READ_TYPE | REG_LIVE_WRITTEN))
 	    verbose(env, "_");
 	if (live & REG_LIVE_READ)
 		verbose(env, "r");
+	else if (live & REG_LIVE_READ_TYPE)
+		verbose(env, "t");
 	if (live & REG_LIVE_WRITTEN)
 		verbose(env, "w");
 }
@@ -735,6 +739,7 @@ static void init_func_state(struct bpf_verifier_env *env,
 
 enum reg_arg_type {
 	SRC_OP,		/* register is used as source operand */
+	SRC_OP_TYPE,	/* same as above, but its value doesn't matter */
 	DST_OP,		/* register is used as destination operand */
 	DST_OP_NO_MARK	/* same as above, check only, don't mark */
 };
@@ -905,9 +910,10 @@ struct bpf_verifier_state *skip_callee(struct bpf_verifier_env *env,
 static int mark_reg_read(struct bpf_verifier_env *env,
 			 const struct bpf_verifier_state *state,
 			 struct bpf_verifier_state *parent,
-			 u32 regno)
+			 u32 regno, enum bpf_reg_liveness flag)
 {
 	bool writes = parent == state->parent; /* Observe write marks */
+	struct bpf_reg_state *reg;
 
 	if (regno == BPF_REG_FP)
 		/* We don't need to worry about FP liveness because it's read-only */
@@ -920,8 +926,14 @@ static int mark_reg_read(struct bpf_verifier_env *env,
 		parent = skip_callee(env, state, parent, regno);
 		if (!parent)
 			return -EFAULT;
+		reg = &parent->frame[parent->curframe]->regs[regno];
+		/* The walk up from an already marked parent was done by
+		 * whoever marked it, and a full read covers a type read.
+		 */
+		if (reg->live & (flag | REG_LIVE_READ))
+			break;
 		/* ... then we depend on parent's value */
-		parent->frame[parent->curframe]->regs[regno].live |= REG_LIVE_READ;
+		reg->live |= flag;
 		state = parent;
 		parent = state->parent;
 		writes = true;
@@ -941,13 +953,15 @@ static int check_reg_arg(struct bpf_verifier_env *env, u32 regno,
 		return -EINVAL;
 	}
 
-	if (t == SRC_OP) {
+	if (t == SRC_OP || t == SRC_OP_TYPE) {
 		/* check whether register used as source operand can be read */
 		if (regs[regno].type == NOT_INIT) {
 			verbose(env, "R%d !read_ok\n", regno);
 			return -EACCES;
 		}
-		return mark_reg_read(env, vstate, vstate->parent, regno);
+		return mark_reg_read(env, vstate, vstate->parent, regno,
+				     t == SRC_OP ? REG_LIVE_READ :
+						   REG_LIVE_READ_TYPE);
 	} else {
 		/* check whether register used as dest operand can be written to */
 		if (regno == BPF_REG_FP) {
@@ -1131,6 +1145,9 @@ static void mark_stack_slot_read(struct bpf_verifier_env *env,
 		/* if read wasn't screened by an earlier write ... */
 		if (writes && state->frame[frameno]->stack[slot].spilled_ptr.live & REG_LIVE_WRITTEN)
 			break;
+		/* the rest of the chain was marked along with the parent */
+		if (parent->frame[frameno]->stack[slot].spilled_ptr.live & REG_LIVE_READ)
+			break;
 		/* ... then we depend on parent's value */
 		parent->frame[frameno]->stack[slot].spilled_ptr.live |= REG_LIVE_READ;
 		state = parent;
@@ -1767,8 +1784,8 @@ static int check_xadd(struct bpf_verifier_env *env, int insn_idx, struct bpf_ins
 		return -EINVAL;
 	}
 
-	/* check src1 operand */
-	err = check_reg_arg(env, insn->src_reg, SRC_OP);
+	/* check src1 operand, whose value only ends up in memory */
+	err = check_reg_arg(env, insn->src_reg, SRC_OP_TYPE);
 	if (err)
 		return err;
 
@@ -1923,7 +1940,9 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 	if (arg_type == ARG_DONTCARE)
 		return 0;
 
-	err = check_reg_arg(env, regno, SRC_OP);
+	/* helpers take ARG_ANYTHING as an opaque value */
+	err = check_reg_arg(env, regno,
+			    arg_type == ARG_ANYTHING ? SRC_OP_TYPE : SRC_OP);
 	if (err)
 		return err;
 
@@ -1942,8 +1961,14 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		return -EACCES;
 	}
 
+	if (arg_type == ARG_PTR_TO_MAP_VALUE_OR_NULL &&
+	    register_is_null(reg))
+		/* the helper copes with a NULL value itself */
+		return 0;
+
 	if (arg_type == ARG_PTR_TO_MAP_KEY ||
-	    arg_type == ARG_PTR_TO_MAP_VALUE) {
+	    arg_type == ARG_PTR_TO_MAP_VALUE ||
+	    arg_type == ARG_PTR_TO_MAP_VALUE_OR_NULL) {
 		expected_type = PTR_TO_STACK;
 		if (!type_is_pkt_pointer(type) && type != PTR_TO_MAP_VALUE &&
 		    type != expected_type)
@@ -2000,7 +2025,8 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 		err = check_helper_mem_access(env, regno,
 					      meta->map_ptr->key_size, false,
 					      NULL);
-	} else if (arg_type == ARG_PTR_TO_MAP_VALUE) {
+	} else if (arg_type == ARG_PTR_TO_MAP_VALUE ||
+		   arg_type == ARG_PTR_TO_MAP_VALUE_OR_NULL) {
 		/* bpf_map_xxx(..., map_ptr, ..., value) call:
 		 * check [value, value + map->value_size) validity
 		 */
@@ -2125,6 +2151,16 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		    func_id != BPF_FUNC_msg_redirect_hash)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_RINGBUF:
+		if (func_id != BPF_FUNC_ringbuf_output &&
+		    func_id != BPF_FUNC_ringbuf_query)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_SK_STORAGE:
+		if (func_id != BPF_FUNC_sk_storage_get &&
+		    func_id != BPF_FUNC_sk_storage_delete)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -2172,6 +2208,16 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		if (map->map_type != BPF_MAP_TYPE_SOCKHASH)
 			goto error;
 		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_query:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
+	case BPF_FUNC_sk_storage_get:
+	case BPF_FUNC_sk_storage_delete:
+		if (map->map_type != BPF_MAP_TYPE_SK_STORAGE)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -4059,9 +4105,12 @@ enum {
 
 #define STATE_LIST_MARK ((struct bpf_verifier_state_list *) -1L)
 
-static int *insn_stack;	/* stack of insns to process */
-static int cur_stack;	/* current stack index */
-static int *insn_state;
+/* recursion through bpf-to-bpf calls stays forbidden */
+static bool is_pseudo_call_insn(const struct bpf_insn *insn)
+{
+	return insn->code == (BPF_JMP | BPF_CALL) &&
+	       insn->src_reg == BPF_PSEUDO_CALL;
+}
 
 /* t, w, e - match pseudo-code above:
  * t - index of current instruction
@@ -4070,6 +4119,9 @@ static int *insn_state;
  */
 static int push_insn(int t, int w, int e, struct bpf_verifier_env *env)
 {
+	int *insn_stack = env->cfg.insn_stack;
+	int *insn_state = env->cfg.insn_state;
+
 	if (e == FALLTHROUGH && insn_state[t] >= (DISCOVERED | FALLTHROUGH))
 		return 0;
 
@@ -4089,11 +4141,20 @@ static int push_insn(int t, int w, int e, struct bpf_verifier_env *env)
 		/* tree-edge */
 		insn_state[t] = DISCOVERED | e;
 		insn_state[w] = DISCOVERED;
-		if (cur_stack >= env->prog->len)
+		if (env->cfg.cur_stack >= env->prog->len)
 			return -E2BIG;
-		insn_stack[cur_stack++] = w;
+		insn_stack[env->cfg.cur_stack++] = w;
 		return 1;
 	} else if ((insn_state[w] & 0xF0) == DISCOVERED) {
+		if (env->allow_ptr_leaks &&
+		    !is_pseudo_call_insn(&env->prog->insnsi[t])) {
+			/* loop: the loop head must be a prune point, so that
+			 * is_state_visited() sees every iteration
+			 */
+			insn_state[t] = DISCOVERED | e;
+			env->explored_states[w] = STATE_LIST_MARK;
+			return 0;
+		}
 		verbose(env, "back-edge from insn %d to %d\n", t, w);
 		return -EINVAL;
 	} else if (insn_state[w] == EXPLORED) {
@@ -4113,6 +4174,7 @@ static int check_cfg(struct bpf_verifier_env *env)
 {
 	struct bpf_insn *insns = env->prog->insnsi;
 	int insn_cnt = env->prog->len;
+	int *insn_stack, *insn_state;
 	int ret = 0;
 	int i, t;
 
@@ -4129,15 +4191,17 @@ static int check_cfg(struct bpf_verifier_env *env)
 		kfree(insn_state);
 		return -ENOMEM;
 	}
+	env->cfg.insn_state = insn_state;
+	env->cfg.insn_stack = insn_stack;
 
 	insn_state[0] = DISCOVERED; /* mark 1st insn as discovered */
 	insn_stack[0] = 0; /* 0 is the first instruction */
-	cur_stack = 1;
+	env->cfg.cur_stack = 1;
 
 peek_stack:
-	if (cur_stack == 0)
+	if (env->cfg.cur_stack == 0)
 		goto check_state;
-	t = insn_stack[cur_stack - 1];
+	t = insn_stack[env->cfg.cur_stack - 1];
 
 	if (BPF_CLASS(insns[t].code) == BPF_JMP) {
 		u8 opcode = BPF_OP(insns[t].code);
@@ -4205,7 +4269,7 @@ static int check_cfg(struct bpf_verifier_env *env)
 
 mark_explored:
 	insn_state[t] = EXPLORED;
-	if (cur_stack-- <= 0) {
+	if (env->cfg.cur_stack-- <= 0) {
 		verbose(env, "pop stack internal bug\n");
 		ret = -EFAULT;
 		goto err_free;
@@ -4225,6 +4289,8 @@ static int check_cfg(struct bpf_verifier_env *env)
 err_free:
 	kfree(insn_state);
 	kfree(insn_stack);
+	env->cfg.insn_state = NULL;
+	env->cfg.insn_stack = NULL;
 	return ret;
 }
 
@@ -4238,13 +4304,6 @@ static bool range_within(struct bpf_reg_state *old,
 	       old->smax_value >= cur->smax_value;
 }
 
-/* Maximum number of register states that can exist at once */
-#define ID_MAP_SIZE	(MAX_BPF_REG + MAX_BPF_STACK / BPF_REG_SIZE)
-struct idpair {
-	u32 old;
-	u32 cur;
-};
-
 /* If in the old state two registers had the same id, then they need to have
  * the same id in the new state as well.  But that id could be different from
  * the old state, so we need to track the mapping from old to new ids.
@@ -4255,11 +4314,11 @@ struct idpair {
  * So we look through our idmap to see if this old id has been seen before.  If
  * so, we require the new id to match; otherwise, we add the id pair to the map.
  */
-static bool check_ids(u32 old_id, u32 cur_id, struct idpair *idmap)
+static bool check_ids(u32 old_id, u32 cur_id, struct bpf_idpair *idmap)
 {
 	unsigned int i;
 
-	for (i = 0; i < ID_MAP_SIZE; i++) {
+	for (i = 0; i < BPF_ID_MAP_SIZE; i++) {
 		if (!idmap[i].old) {
 			/* Reached an empty slot; haven't seen this id before */
 			idmap[i].old = old_id;
@@ -4276,13 +4335,20 @@ static bool check_ids(u32 old_id, u32 cur_id, struct idpair *idmap)
 
 /* Returns true if (rold safe implies rcur safe) */
 static bool regsafe(struct bpf_reg_state *rold, struct bpf_reg_state *rcur,
-		    struct idpair *idmap)
+		    struct bpf_idpair *idmap)
 {
 	bool equal;
 
-	if (!(rold->live & REG_LIVE_READ))
-		/* explored state didn't use this */
-		return true;
+	if (!(rold->live & REG_LIVE_READ)) {
+		if (!(rold->live & REG_LIVE_READ_TYPE))
+			/* explored state didn't use this */
+			return true;
+		/* explored state only stored this scalar to memory or
+		 * handed it to a helper, any other scalar will do
+		 */
+		if (rold->type == SCALAR_VALUE && rcur->type == SCALAR_VALUE)
+			return true;
+	}
 
 	equal = memcmp(rold, rcur, offsetof(struct bpf_reg_state, frameno)) == 0;
 
@@ -4380,16 +4446,10 @@ static bool regsafe(struct bpf_reg_state *rold, struct bpf_reg_state *rcur,
 
 static bool stacksafe(struct bpf_func_state *old,
 		      struct bpf_func_state *cur,
-		      struct idpair *idmap)
+		      struct bpf_idpair *idmap)
 {
 	int i, spi;
 
-	/* if explored stack has more populated slots than current stack
-	 * such stacks are not equivalent
-	 */
-	if (old->allocated_stack > cur->allocated_stack)
-		return false;
-
 	/* walk slots of the explored stack and ignore any additional
 	 * slots in the current stack, since explored(safe) state
 	 * didn't use them
@@ -4397,12 +4457,20 @@ static bool stacksafe(struct bpf_func_state *old,
 	for (i = 0; i < old->allocated_stack; i++) {
 		spi = i / BPF_REG_SIZE;
 
-		if (!(old->stack[spi].spilled_ptr.live & REG_LIVE_READ))
+		if (!(old->stack[spi].spilled_ptr.live & REG_LIVE_READ)) {
 			/* explored state didn't use this */
+			i += BPF_REG_SIZE - 1;
 			continue;
+		}
 
 		if (old->stack[spi].slot_type[i % BPF_REG_SIZE] == STACK_INVALID)
 			continue;
+
+		/* explored stack has more populated slots than current
+		 * stack and the explored state used them
+		 */
+		if (i >= cur->allocated_stack)
+			return false;
 		/* if old state was safe with misc data in the stack
 		 * it will be safe with zero-initialized stack.
 		 * The opposite is not true
@@ -4466,29 +4534,20 @@ static bool stacksafe(struct bpf_func_state *old,
  * whereas register type in current state is meaningful, it means that
  * the current state will reach 'bpf_exit' instruction safely
  */
-static bool func_states_equal(struct bpf_func_state *old,
+static bool func_states_equal(struct bpf_verifier_env *env,
+			      struct bpf_func_state *old,
 			      struct bpf_func_state *cur)
 {
-	struct idpair *idmap;
-	bool ret = false;
+	struct bpf_idpair *idmap = env->idmap_scratch;
 	int i;
 
-	idmap = kcalloc(ID_MAP_SIZE, sizeof(struct idpair), GFP_KERNEL);
-	/* If we failed to allocate the idmap, just say it's not safe */
-	if (!idmap)
-		return false;
-
+	memset(idmap, 0, sizeof(env->idmap_scratch));
 	for (i = 0; i < MAX_BPF_REG; i++) {
 		if (!regsafe(&old->regs[i], &cur->regs[i], idmap))
-			goto out_free;
+			return false;
 	}
 
-	if (!stacksafe(old, cur, idmap))
-		goto out_free;
-	ret = true;
-out_free:
-	kfree(idmap);
-	return ret;
+	return stacksafe(old, cur, idmap);
 }
 
 static bool states_equal(struct bpf_verifier_env *env,
@@ -4506,7 +4565,7 @@ static bool states_equal(struct bpf_verifier_env *env,
 	for (i = 0; i <= old->curframe; i++) {
 		if (old->frame[i]->callsite != cur->frame[i]->callsite)
 			return false;
-		if (!func_states_equal(old->frame[i], cur->frame[i]))
+		if (!func_states_equal(env, old->frame[i], cur->frame[i]))
 			return false;
 	}
 	return true;
@@ -4535,13 +4594,21 @@ static int propagate_liveness(struct bpf_verifier_env *env,
 	BUILD_BUG_ON(BPF_REG_FP + 1 != MAX_BPF_REG);
 	/* We don't need to worry about FP liveness because it's read-only */
 	for (i = 0; i < BPF_REG_FP; i++) {
-		if (vparent->frame[vparent->curframe]->regs[i].live & REG_LIVE_READ)
+		enum bpf_reg_liveness live, plive;
+
+		live = vstate->frame[vstate->curframe]->regs[i].live;
+		plive = vparent->frame[vparent->curframe]->regs[i].live;
+		if (plive & REG_LIVE_READ)
 			continue;
-		if (vstate->frame[vstate->curframe]->regs[i].live & REG_LIVE_READ) {
-			err = mark_reg_read(env, vstate, vparent, i);
-			if (err)
-				return err;
-		}
+		if (live & REG_LIVE_READ)
+			err = mark_reg_read(env, vstate, vparent, i,
+					    REG_LIVE_READ);
+		else if ((live & REG_LIVE_READ_TYPE) &&
+			 !(plive & REG_LIVE_READ_TYPE))
+			err = mark_reg_read(env, vstate, vparent, i,
+					    REG_LIVE_READ_TYPE);
+		if (err)
+			return err;
 	}
 
 	/* ... and stack slots */
@@ -4559,6 +4626,20 @@ static int propagate_liveness(struct bpf_verifier_env *env,
 	return err;
 }
 
+/* States still being explored are exactly the parentage chain of the
+ * current state: depth-first exploration finishes the subtree of any
+ * other explored state before it can reach it again. Only loops bring
+ * a path back to one of its own ancestors.
+ */
+static bool state_is_ancestor(const struct bpf_verifier_state *cur,
+			      const struct bpf_verifier_state *st)
+{
+	for (cur = cur->parent; cur; cur = cur->parent)
+		if (cur == st)
+			return true;
+	return false;
+}
+
 static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 {
 	struct bpf_verifier_state_list *new_sl;
@@ -4575,6 +4656,14 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 
 	while (sl != STATE_LIST_MARK) {
 		if (states_equal(env, &sl->state, cur)) {
+			/* An ancestor is not proven safe yet, and coming back
+			 * to a state it covers means the loop may never end.
+			 */
+			if (state_is_ancestor(cur, &sl->state)) {
+				verbose(env, "infinite loop detected at insn %d\n",
+					insn_idx);
+				return -EINVAL;
+			}
 			/* reached equivalent register/stack state,
 			 * prune the search.
 			 * Registers read by the continuation are read by us.
@@ -4588,6 +4677,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 			err = propagate_liveness(env, &sl->state, cur);
 			if (err)
 				return err;
+			env->pruned_states++;
 			return 1;
 		}
 		sl = sl->next;
@@ -4596,9 +4686,10 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	/* there were no equivalent states, remember current one.
 	 * technically the current state is not proven to be safe yet,
 	 * but it will either reach outer most bpf_exit (which means it's safe)
-	 * or it will be rejected. Since there are no loops, we won't be
-	 * seeing this tuple (frame[0].callsite, frame[1].callsite, .. insn_idx)
-	 * again on the way to bpf_exit
+	 * or it will be rejected. A loop may bring us back to this tuple
+	 * (frame[0].callsite, frame[1].callsite, .. insn_idx) on the way to
+	 * bpf_exit; state_is_ancestor() keeps it from being used for pruning
+	 * until then.
 	 */
 	new_sl = kzalloc(sizeof(struct bpf_verifier_state_list), GFP_KERNEL);
 	if (!new_sl)
@@ -4613,6 +4704,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	}
 	new_sl->next = env->explored_states[insn_idx];
 	env->explored_states[insn_idx] = new_sl;
+	env->total_states++;
 	/* connect new state to parentage chain */
 	cur->parent = &new_sl->state;
 	/* clear write marks in current state: the writes we did are not writes
@@ -4634,6 +4726,40 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	return 0;
 }
 
+/* Return true if insn only zero-extends the lower 32 bits of its dst_reg
+ * and thus is a no-op when the upper 32 bits are already known to be
+ * zero. 'r <<= 32' is the first half of the 'r <<= 32; r >>= 32' pair
+ * llvm emits to zero-extend a register.
+ */
+static bool insn_is_zext(const struct bpf_insn *insn)
+{
+	switch (insn->code) {
+	case BPF_ALU | BPF_MOV | BPF_X:
+		return insn->dst_reg == insn->src_reg;
+#if defined(__LITTLE_ENDIAN)
+	case BPF_ALU | BPF_END | BPF_TO_LE:
+		return insn->imm == 32;
+#endif
+	case BPF_ALU64 | BPF_LSH | BPF_K:
+		return insn->imm == 32;
+	default:
+		return false;
+	}
+}
+
+static void mark_zext_needed(struct bpf_verifier_env *env,
+			     const struct bpf_insn *insn, int insn_idx)
+{
+	const struct bpf_reg_state *reg;
+
+	if (!insn_is_zext(insn) || insn->dst_reg >= MAX_BPF_REG)
+		return;
+
+	reg = &cur_regs(env)[insn->dst_reg];
+	if (reg->type != SCALAR_VALUE || reg->umax_value > U32_MAX)
+		env->insn_aux_data[insn_idx].zext_needed = true;
+}
+
 static int do_check(struct bpf_verifier_env *env)
 {
 	struct bpf_verifier_state *state;
@@ -4641,7 +4767,6 @@ static int do_check(struct bpf_verifier_env *env)
 	struct bpf_reg_state *regs;
 	int insn_cnt = env->prog->len, i;
 	int insn_idx, prev_insn_idx = 0;
-	int insn_processed = 0;
 	bool do_print_state = false;
 
 	state = kzalloc(sizeof(struct bpf_verifier_state), GFP_KERNEL);
@@ -4674,10 +4799,10 @@ static int do_check(struct bpf_verifier_env *env)
 		insn = &insns[insn_idx];
 		class = BPF_CLASS(insn->code);
 
-		if (++insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
+		if (++env->insn_processed > BPF_COMPLEXITY_LIMIT_INSNS) {
 			verbose(env,
 				"BPF program is too large. Processed %d insn\n",
-				insn_processed);
+				env->insn_processed);
 			return -E2BIG;
 		}
 
@@ -4729,6 +4854,7 @@ static int do_check(struct bpf_verifier_env *env)
 		regs = cur_regs(env);
 		env->insn_aux_data[insn_idx].seen = true;
 		if (class == BPF_ALU || class == BPF_ALU64) {
+			mark_zext_needed(env, insn, insn_idx);
 			err = check_alu_op(env, insn);
 			if (err)
 				return err;
@@ -4792,8 +4918,14 @@ static int do_check(struct bpf_verifier_env *env)
 				continue;
 			}
 
-			/* check src1 operand */
-			err = check_reg_arg(env, insn->src_reg, SRC_OP);
+			dst_reg_type = regs[insn->dst_reg].type;
+
+			/* check src1 operand; a stack write keeps track of
+			 * the value stored, other memory doesn't
+			 */
+			err = check_reg_arg(env, insn->src_reg,
+					    dst_reg_type == PTR_TO_STACK ?
+					    SRC_OP : SRC_OP_TYPE);
 			if (err)
 				return err;
 			/* check src2 operand */
@@ -4801,8 +4933,6 @@ static int do_check(struct bpf_verifier_env *env)
 			if (err)
 				return err;
 
-			dst_reg_type = regs[insn->dst_reg].type;
-
 			/* check that memory (dst_reg + off) is writeable */
 			err = check_mem_access(env, insn_idx, insn->dst_reg, insn->off,
 					       BPF_SIZE(insn->code), BPF_WRITE,
@@ -4957,7 +5087,7 @@ static int do_check(struct bpf_verifier_env *env)
 	}
 
 	verbose(env, "processed %d insns (limit %d), stack depth ",
-		insn_processed, BPF_COMPLEXITY_LIMIT_INSNS);
+		env->insn_processed, BPF_COMPLEXITY_LIMIT_INSNS);
 	for (i = 0; i < env->subprog_cnt; i++) {
 		u32 depth = env->subprog_info[i].stack_depth;
 
@@ -5220,6 +5350,210 @@ static void sanitize_dead_code(struct bpf_verifier_env *env)
 	}
 }
 
+static bool insn_is_cond_jump(u8 code)
+{
+	u8 op;
+
+	if (BPF_CLASS(code) != BPF_JMP)
+		return false;
+
+	op = BPF_OP(code);
+	return op != BPF_JA && op != BPF_EXIT && op != BPF_CALL;
+}
+
+/* A conditional jump which the verifier found to always or never be
+ * taken becomes 'ja', so that the branch not taken can be removed as
+ * dead code.
+ */
+static void opt_hard_wire_dead_code_branches(struct bpf_verifier_env *env)
+{
+	struct bpf_insn_aux_data *aux_data = env->insn_aux_data;
+	struct bpf_insn ja = BPF_JMP_IMM(BPF_JA, 0, 0, 0);
+	struct bpf_insn *insn = env->prog->insnsi;
+	const int insn_cnt = env->prog->len;
+	int i;
+
+	for (i = 0; i < insn_cnt; i++, insn++) {
+		if (!insn_is_cond_jump(insn->code))
+			continue;
+
+		if (!aux_data[i + 1].seen)
+			ja.off = insn->off;
+		else if (!aux_data[i + 1 + insn->off].seen)
+			ja.off = 0;
+		else
+			continue;
+
+		memcpy(insn, &ja, sizeof(ja));
+	}
+}
+
+static bool insn_is_jmp_target(struct bpf_verifier_env *env, int idx)
+{
+	struct bpf_insn *insn = env->prog->insnsi;
+	const int insn_cnt = env->prog->len;
+	int i;
+
+	for (i = 0; i < insn_cnt; i++, insn++) {
+		if (BPF_CLASS(insn->code) != BPF_JMP ||
+		    BPF_OP(insn->code) == BPF_EXIT)
+			continue;
+		if (BPF_OP(insn->code) == BPF_CALL) {
+			if (insn->src_reg == BPF_PSEUDO_CALL &&
+			    i + insn->imm + 1 == idx)
+				return true;
+			continue;
+		}
+		if (i + insn->off + 1 == idx)
+			return true;
+	}
+
+	return false;
+}
+
+/* Turn zero-extensions of registers whose upper 32 bits were zero on
+ * every path reaching them into nops, which opt_remove_nops() then
+ * drops. x86-64 and arm64 zero-extend 32 bit results for free, so
+ * these only cost an extra mov or shift pair in the JITed image.
+ */
+static void opt_zext_to_nops(struct bpf_verifier_env *env)
+{
+	struct bpf_insn_aux_data *aux_data = env->insn_aux_data;
+	const struct bpf_insn ja = BPF_JMP_IMM(BPF_JA, 0, 0, 0);
+	struct bpf_insn *insn = env->prog->insnsi;
+	const int insn_cnt = env->prog->len;
+	int i;
+
+	for (i = 0; i < insn_cnt; i++) {
+		if (!aux_data[i].seen || aux_data[i].zext_needed ||
+		    !insn_is_zext(&insn[i]))
+			continue;
+
+		if (insn[i].code != (BPF_ALU64 | BPF_LSH | BPF_K)) {
+			memcpy(&insn[i], &ja, sizeof(ja));
+			continue;
+		}
+
+		/* the shift pair can only go as a whole */
+		if (i + 1 >= insn_cnt ||
+		    insn[i + 1].code != (BPF_ALU64 | BPF_RSH | BPF_K) ||
+		    insn[i + 1].dst_reg != insn[i].dst_reg ||
+		    insn[i + 1].imm != 32 ||
+		    insn_is_jmp_target(env, i + 1))
+			continue;
+
+		memcpy(&insn[i], &ja, sizeof(ja));
+		memcpy(&insn[i + 1], &ja, sizeof(ja));
+		i++;
+	}
+}
+
+static int adjust_subprog_starts_after_remove(struct bpf_verifier_env *env,
+					      u32 off, u32 cnt)
+{
+	int i, j;
+
+	/* find first prog starting at or after off (first to remove) */
+	for (i = 0; i < env->subprog_cnt; i++)
+		if (env->subprog_info[i].start >= off)
+			break;
+	/* find first prog starting at or after off + cnt (first to stay) */
+	for (j = i; j < env->subprog_cnt; j++)
+		if (env->subprog_info[j].start >= off + cnt)
+			break;
+	/* if j doesn't start exactly at off + cnt, we are just removing
+	 * the front of previous prog
+	 */
+	if (env->subprog_info[j].start != off + cnt)
+		j--;
+
+	if (j > i) {
+		/* move fake 'exit' subprog as well */
+		int move = env->subprog_cnt + 1 - j;
+
+		memmove(env->subprog_info + i,
+			env->subprog_info + j,
+			sizeof(*env->subprog_info) * move);
+		env->subprog_cnt -= j - i;
+	} else {
+		/* convert i from "first prog to remove" to "first to adjust" */
+		if (env->subprog_info[i].start == off)
+			i++;
+	}
+
+	/* update fake 'exit' subprog as well */
+	for (; i <= env->subprog_cnt; i++)
+		env->subprog_info[i].start -= cnt;
+
+	return 0;
+}
+
+static int verifier_remove_insns(struct bpf_verifier_env *env, u32 off,
+				 u32 cnt)
+{
+	struct bpf_insn_aux_data *aux_data = env->insn_aux_data;
+	unsigned int orig_prog_len = env->prog->len;
+	int err;
+
+	err = bpf_remove_insns(env->prog, off, cnt);
+	if (err)
+		return err;
+
+	err = adjust_subprog_starts_after_remove(env, off, cnt);
+	if (err)
+		return err;
+
+	memmove(aux_data + off, aux_data + off + cnt,
+		sizeof(*aux_data) * (orig_prog_len - off - cnt));
+
+	return 0;
+}
+
+static int opt_remove_dead_code(struct bpf_verifier_env *env)
+{
+	struct bpf_insn_aux_data *aux_data = env->insn_aux_data;
+	int insn_cnt = env->prog->len;
+	int i, err;
+
+	for (i = 0; i < insn_cnt; i++) {
+		int j;
+
+		j = 0;
+		while (i + j < insn_cnt && !aux_data[i + j].seen)
+			j++;
+		if (!j)
+			continue;
+
+		err = verifier_remove_insns(env, i, j);
+		if (err)
+			return err;
+		insn_cnt = env->prog->len;
+	}
+
+	return 0;
+}
+
+static int opt_remove_nops(struct bpf_verifier_env *env)
+{
+	const struct bpf_insn ja = BPF_JMP_IMM(BPF_JA, 0, 0, 0);
+	struct bpf_insn *insn = env->prog->insnsi;
+	int insn_cnt = env->prog->len;
+	int i, err;
+
+	for (i = 0; i < insn_cnt; i++) {
+		if (memcmp(&insn[i], &ja, sizeof(ja)))
+			continue;
+
+		err = verifier_remove_insns(env, i, 1);
+		if (err)
+			return err;
+		insn_cnt--;
+		i--;
+	}
+
+	return 0;
+}
+
 /* convert load instructions that access fields of 'struct __sk_buff'
  * into sequence of instructions that access fields of 'struct sk_buff'
  */
@@ -5677,7 +6011,10 @@ static int fixup_bpf_calls(struct bpf_verifier_env *env)
 				goto patch_call_imm;
 
 			cnt = map_ptr->ops->map_gen_lookup(map_ptr, insn_buf);
-			if (cnt == 0 || cnt >= ARRAY_SIZE(insn_buf)) {
+			/* the map may decline to inline this lookup */
+			if (cnt == 0)
+				goto patch_call_imm;
+			if (cnt >= ARRAY_SIZE(insn_buf)) {
 				verbose(env, "bpf verifier is misconfigured\n");
 				return -EINVAL;
 			}
@@ -5758,9 +6095,11 @@ static void free_states(struct bpf_verifier_env *env)
 
 int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 {
+	u64 start_time = ktime_get_ns();
 	struct bpf_verifier_env *env;
 	struct bpf_verifier_log *log;
 	int ret = -EINVAL;
+	bool is_priv;
 
 	/* no program is valid */
 	if (ARRAY_SIZE(bpf_verifier_ops) == 0)
@@ -5782,8 +6121,13 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	env->prog = *prog;
 	env->ops = bpf_verifier_ops[env->prog->type];
 
-	/* grab the mutex to protect few globals used by verifier */
-	mutex_lock(&bpf_verifier_lock);
+	/* All verifier state lives in env, so privileged loads can run in
+	 * parallel. Unprivileged ones stay serialized to bound the memory
+	 * and CPU time a user can tie up in the verifier.
+	 */
+	is_priv = capable(CAP_SYS_ADMIN);
+	if (!is_priv)
+		mutex_lock(&bpf_verifier_lock);
 
 	if (attr->log_level || attr->log_buf || attr->log_size) {
 		/* user requested verbose verifier output
@@ -5821,7 +6165,7 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	if (!env->explored_states)
 		goto skip_full_check;
 
-	env->allow_ptr_leaks = capable(CAP_SYS_ADMIN);
+	env->allow_ptr_leaks = is_priv;
 
 	ret = check_cfg(env);
 	if (ret < 0)
@@ -5837,12 +6181,24 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 	while (!pop_stack(env, NULL, NULL));
 	free_states(env);
 
-	if (ret == 0)
-		sanitize_dead_code(env);
-
 	if (ret == 0)
 		ret = check_max_stack_depth(env);
 
+	/* instruction rewrites happen after this point */
+	if (is_priv && !bpf_prog_is_dev_bound(env->prog->aux)) {
+		if (ret == 0)
+			opt_hard_wire_dead_code_branches(env);
+		if (ret == 0)
+			opt_zext_to_nops(env);
+		if (ret == 0)
+			ret = opt_remove_dead_code(env);
+		if (ret == 0)
+			ret = opt_remove_nops(env);
+	} else {
+		if (ret == 0)
+			sanitize_dead_code(env);
+	}
+
 	if (ret == 0)
 		/* program is valid, convert *(u32*)(ctx + off) accesses */
 		ret = convert_ctx_accesses(env);
@@ -5887,9 +6243,14 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr)
 		 * them now. Otherwise free_used_maps() will release them.
 		 */
 		release_maps(env);
+	env->prog->aux->verif_time = ktime_get_ns() - start_time;
+	env->prog->aux->verified_insns = env->insn_processed;
+	env->prog->aux->verified_states = env->total_states;
+	env->prog->aux->pruned_states = env->pruned_states;
 	*prog = env->prog;
 err_unlock:
-	mutex_unlock(&bpf_verifier_lock);
+	if (!is_priv)
+		mutex_unlock(&bpf_verifier_lock);
 	vfree(env->insn_aux_data);
 err_free_env:
 	kfree(env);
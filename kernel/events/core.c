@@ -7723,6 +7723,27 @@ int perf_event_account_interrupt(struct perf_event *event)
  * Generic event overflow handling, sampling.
  */
 
+/*
+ * An aux_pause event stops the AUX leader of its group when it fires,
+ * so that the leader's buffer holds the trace leading up to it: a
+ * flight recorder snapshot, taken on a breakpoint or whatever a BPF
+ * program attached to the event decides is interesting. The leader
+ * stays off, and readers are woken, until it is re-enabled.
+ */
+static void perf_event_aux_pause(struct perf_event *event)
+{
+	struct perf_event *leader = event->group_leader;
+
+	if (leader == event || !has_aux(leader))
+		return;
+
+	if (READ_ONCE(leader->state) != PERF_EVENT_STATE_ACTIVE)
+		return;
+
+	leader->pending_wakeup = 1;
+	perf_event_disable_inatomic(leader);
+}
+
 static int __perf_event_overflow(struct perf_event *event,
 				   int throttle, struct perf_sample_data *data,
 				   struct pt_regs *regs)
@@ -7754,6 +7775,10 @@ static int __perf_event_overflow(struct perf_event *event,
 
 	READ_ONCE(event->overflow_handler)(event, data, regs);
 
+	/* With a BPF program attached, it gets to filter the pause */
+	if (event->attr.aux_pause && !event->prog)
+		perf_event_aux_pause(event);
+
 	if (*perf_event_fasync(event) && event->pending_kill) {
 		event->pending_wakeup = 1;
 		irq_work_queue(&event->pending);
@@ -8506,6 +8531,9 @@ static void bpf_overflow_handler(struct perf_event *event,
 	if (!ret)
 		return;
 
+	if (event->attr.aux_pause)
+		perf_event_aux_pause(event);
+
 	event->orig_overflow_handler(event, data, regs);
 }
 
@@ -10603,6 +10631,13 @@ SYSCALL_DEFINE5(perf_event_open,
 		 */
 		if (attr.exclusive || attr.pinned)
 			goto err_context;
+
+		if (attr.aux_pause && !has_aux(group_leader))
+			goto err_context;
+	} else if (attr.aux_pause) {
+		/* There must be an AUX leader to pause */
+		err = -EINVAL;
+		goto err_context;
 	}
 
 	if (output_event) {
@@ -15,6 +15,8 @@
 #include <linux/circ_buf.h>
 #include <linux/poll.h>
 #include <linux/nospec.h>
+#include <linux/cma.h>
+#include <linux/highmem.h>
 
 #include "internal.h"
 
@@ -522,6 +524,73 @@ EXPORT_SYMBOL_GPL(perf_get_aux);
 
 #define PERF_AUX_GFP	(GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN | __GFP_NORETRY)
 
+#ifdef CONFIG_CMA
+/*
+ * perf_aux_cma=<size> sets aside a contiguous area at boot that AUX
+ * buffers are carved from before trying the buddy allocator. Large
+ * AUX buffers (Intel PT in particular) then get high-order chunks,
+ * and so short ToPA tables, however fragmented memory has become.
+ */
+static phys_addr_t perf_aux_cma_size __initdata;
+static struct cma *perf_aux_cma;
+
+static int __init early_perf_aux_cma(char *p)
+{
+	perf_aux_cma_size = memparse(p, &p);
+	return 0;
+}
+early_param("perf_aux_cma", early_perf_aux_cma);
+
+void __init perf_aux_cma_reserve(void)
+{
+	int ret;
+
+	if (!perf_aux_cma_size)
+		return;
+
+	ret = cma_declare_contiguous(0, perf_aux_cma_size, 0, 0, 0, false,
+				     "perf_aux", &perf_aux_cma);
+	if (ret)
+		pr_warn("perf: failed to reserve %llu MiB for AUX buffers: %d\n",
+			(unsigned long long)perf_aux_cma_size >> 20, ret);
+}
+
+static struct page *rb_alloc_aux_cma_page(int order)
+{
+	struct page *page;
+	int i;
+
+	if (!perf_aux_cma)
+		return NULL;
+
+	page = cma_alloc(perf_aux_cma, 1 << order, order,
+			 GFP_KERNEL | __GFP_NOWARN);
+	if (!page)
+		return NULL;
+
+	/* Unlike the buddy allocator, CMA doesn't clear the pages for us */
+	for (i = 0; i < (1 << order); i++)
+		clear_highpage(page + i);
+
+	return page;
+}
+
+static bool rb_free_aux_cma_page(struct page *page)
+{
+	return perf_aux_cma && cma_release(perf_aux_cma, page, 1);
+}
+#else
+static inline struct page *rb_alloc_aux_cma_page(int order)
+{
+	return NULL;
+}
+
+static inline bool rb_free_aux_cma_page(struct page *page)
+{
+	return false;
+}
+#endif
+
 static struct page *rb_alloc_aux_page(int node, int order)
 {
 	struct page *page;
@@ -529,6 +598,17 @@ static struct page *rb_alloc_aux_page(int node, int order)
 	if (order > MAX_ORDER)
 		order = MAX_ORDER;
 
+	/*
+	 * CMA hands out runs of order-0 pages rather than a compound
+	 * page, so there is nothing to split; freeing is per page.
+	 */
+	page = order ? rb_alloc_aux_cma_page(order) : NULL;
+	if (page) {
+		SetPagePrivate(page);
+		set_page_private(page, order);
+		return page;
+	}
+
 	do {
 		page = alloc_pages_node(node, PERF_AUX_GFP, order);
 	} while (!page && order--);
@@ -554,7 +634,8 @@ static void rb_free_aux_page(struct ring_buffer *rb, int idx)
 
 	ClearPagePrivate(page);
 	page->mapping = NULL;
-	__free_page(page);
+	if (!rb_free_aux_cma_page(page))
+		__free_page(page);
 }
 
 static void __rb_free_aux(struct ring_buffer *rb)
@@ -609,6 +609,7 @@ void __mmdrop(struct mm_struct *mm)
 	mmu_notifier_mm_destroy(mm);
 	check_mm(mm);
 	put_user_ns(mm->user_ns);
+	futex_hash_free(mm);
 	free_mm(mm);
 }
 EXPORT_SYMBOL_GPL(__mmdrop);
@@ -930,6 +931,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	mm->pmd_huge_pte = NULL;
 #endif
 	mm_init_uprobes_state(mm);
+#ifdef CONFIG_FUTEX
+	mm->futex_hash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -1301,6 +1305,15 @@ static int copy_mm(unsigned long clone_flags, struct task_struct *tsk)
 	vmacache_flush(tsk);
 
 	if (clone_flags & CLONE_VM) {
+		/*
+		 * A vfork child borrows the mm only until it execs, so it is
+		 * not worth a futex hash of its own.
+		 */
+		if (!(clone_flags & CLONE_VFORK)) {
+			retval = futex_hash_allocate(oldmm);
+			if (retval)
+				goto fail_nomem;
+		}
 		mmget(oldmm);
 		mm = oldmm;
 		goto good_mm;
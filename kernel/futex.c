@@ -65,7 +65,6 @@
 #include <linux/sched/mm.h>
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
-#include <linux/bootmem.h>
 #include <linux/fault-inject.h>
 
 #include <asm/futex.h>
@@ -266,16 +265,28 @@ struct futex_hash_bucket {
 } ____cacheline_aligned_in_smp;
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in hash_futex()), so ensure that they
- * reside in the same cacheline.
+ * The global hash is split into one bucket array per possible node, each
+ * allocated on its node.  The arrays and their size are always used
+ * together (after initialization only in hash_futex()), so ensure that
+ * the size shares a cacheline with the first array pointers.
  */
 static struct {
-	struct futex_hash_bucket *queues;
-	unsigned long            hashsize;
+	unsigned long            hashshift;
+	struct futex_hash_bucket *queues[MAX_NUMNODES];
 } __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+#define futex_queues    (__futex_data.queues)
+#define futex_hashshift (__futex_data.hashshift)
+
+/*
+ * Futexes which can only be reached through one mm (private futexes and
+ * shared futexes on anonymous memory) of a multi-threaded process are
+ * hashed here instead, so that unrelated processes no longer contend on
+ * the same global buckets.  See futex_hash_allocate().
+ */
+struct futex_private_hash {
+	unsigned int             hashmask;
+	struct futex_hash_bucket queues[];
+};
 
 
 /*
@@ -383,19 +394,101 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+static inline void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+}
+
+/*
+ * Keys without an inode reference carry the mm they belong to.  That mm
+ * is pinned for the lifetime of the key: by a reference for shared keys
+ * and by the task using it for private ones (a pi_state found on an
+ * exiting owner's list still has a waiter blocked in that mm).
+ */
+static inline struct futex_private_hash *
+futex_private_hash(union futex_key *key)
+{
+	struct mm_struct *mm;
+
+	if (key->both.offset & FUT_OFF_INODE)
+		return NULL;
+
+	mm = key->private.mm;
+	return mm ? READ_ONCE(mm->futex_hash) : NULL;
+}
+
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket for a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the owning process' hash if it has one, or in
+ * the global hash otherwise.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	struct futex_private_hash *fph = futex_private_hash(key);
+	int node;
+
+	if (fph)
+		return &fph->queues[hash & fph->hashmask];
+
+	/*
+	 * The hash bits above the bucket index pick the node.  The node of
+	 * the futex page can't be used: the page may migrate while waiters
+	 * are queued, and the wakeup would then look at the wrong node.
+	 */
+	node = (hash >> futex_hashshift) % nr_node_ids;
+	if (!node_possible(node))
+		node = next_node_in(node, node_possible_map);
+
+	return &futex_queues[node][hash & ((1UL << futex_hashshift) - 1)];
+}
+
+/**
+ * futex_hash_allocate - Give a process its own futex hash
+ * @mm:		The mm about to gain a second user
+ *
+ * Called from copy_mm() before a CLONE_VM child is created.  Until then the
+ * caller is the only task that can operate on futexes hashed via @mm, and it
+ * is not waiting on any, so no waiter needs to move out of the global hash.
+ * The hash is sized for the CPUs the caller may run on, which bounds the
+ * number of tasks contending on it, and is not resized afterwards.
+ *
+ * Return: 0 on success, -ENOMEM if the hash could not be allocated.
+ */
+int futex_hash_allocate(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned int buckets, i;
+
+	if (CONFIG_BASE_SMALL || mm->futex_hash)
+		return 0;
+
+	buckets = roundup_pow_of_two(4 * current->nr_cpus_allowed);
+	buckets = clamp(buckets, 16U, 1U << futex_hashshift);
+
+	fph = kvzalloc(sizeof(*fph) + buckets * sizeof(fph->queues[0]),
+		       GFP_KERNEL_ACCOUNT);
+	if (!fph)
+		return -ENOMEM;
+
+	fph->hashmask = buckets - 1;
+	for (i = 0; i < buckets; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+
+	WRITE_ONCE(mm->futex_hash, fph);
+	return 0;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_hash);
 }
 
 
@@ -2698,6 +2791,170 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/*
+ * Unqueue the first @count entries of @qs and drop their key references.
+ * Returns the index of the first one that had already been woken, or -1.
+ */
+static int unqueue_multiple(struct futex_q *qs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&qs[i]) && ret < 0)
+			ret = i;
+	}
+	return ret;
+}
+
+/**
+ * futex_wait_multiple() - Wait on several futexes at once
+ * @ublocks:	userspace array of struct futex_wait_block
+ * @flags:	futex flags (FLAGS_SHARED, etc.)
+ * @count:	number of entries in @ublocks
+ * @abs_time:	absolute CLOCK_MONOTONIC timeout, or NULL
+ *
+ * The task is queued on each futex in turn, with the bucket locked while
+ * the value is checked exactly as futex_wait_setup() does for one.  A wake
+ * on a futex queued earlier, while later ones are still being queued, only
+ * puts the task back to TASK_RUNNING and is noticed before it sleeps, so
+ * no wakeup is lost and the task never sleeps on a stale value.
+ *
+ * Return:
+ *  - >=0 - index in @ublocks of a futex that was woken;
+ *  - <0  - -EWOULDBLOCK if a futex did not contain its value, -ETIMEDOUT,
+ *          -ERESTARTSYS, or -EINTR for a signal when a timeout was given
+ *          (the remaining time is not tracked for a restart)
+ */
+static int futex_wait_multiple(struct futex_wait_block __user *ublocks,
+			       unsigned int flags, u32 count, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_wait_block *blocks;
+	struct futex_hash_bucket *hb;
+	u32 __user *uaddr;
+	struct futex_q *qs;
+	int ret, i, queued;
+	u32 uval;
+
+	if (!count || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	blocks = kmalloc_array(count, sizeof(*blocks), GFP_KERNEL);
+	qs = kmalloc_array(count, sizeof(*qs), GFP_KERNEL);
+	if (!blocks || !qs) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	if (copy_from_user(blocks, ublocks, count * sizeof(*blocks))) {
+		ret = -EFAULT;
+		goto out_free;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!blocks[i].bitset) {
+			ret = -EINVAL;
+			goto out_free;
+		}
+		qs[i] = futex_q_init;
+		qs[i].bitset = blocks[i].bitset;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+retry:
+	/* Looking up shared keys may sleep, so do it before queueing */
+	for (i = 0; i < count; i++) {
+		uaddr = u64_to_user_ptr(blocks[i].uaddr);
+		ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &qs[i].key,
+				    VERIFY_READ);
+		if (ret) {
+			while (--i >= 0)
+				put_futex_key(&qs[i].key);
+			goto out;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	for (queued = 0; queued < count; queued++) {
+		uaddr = u64_to_user_ptr(blocks[queued].uaddr);
+
+		hb = queue_lock(&qs[queued]);
+		ret = get_futex_value_locked(&uval, uaddr);
+		if (ret || uval != blocks[queued].val) {
+			queue_unlock(hb);
+			if (!ret)
+				ret = -EWOULDBLOCK;
+			break;
+		}
+		queue_me(&qs[queued], hb);
+	}
+
+	if (queued < count) {
+		__set_current_state(TASK_RUNNING);
+
+		for (i = queued; i < count; i++)
+			put_futex_key(&qs[i].key);
+
+		/* A wake that already came in must not be lost */
+		i = unqueue_multiple(qs, queued);
+		if (i >= 0) {
+			ret = i;
+			goto out;
+		}
+		if (ret == -EWOULDBLOCK)
+			goto out;
+
+		ret = get_user(uval, uaddr);
+		if (ret)
+			goto out;
+		goto retry;
+	}
+
+	if (to)
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+
+	/* Skip the sleep if one of the futexes was woken while queueing */
+	for (i = 0; i < count; i++) {
+		if (plist_node_empty(&qs[i].list))
+			break;
+	}
+	if (i == count && (!to || to->task))
+		freezable_schedule();
+	__set_current_state(TASK_RUNNING);
+
+	ret = unqueue_multiple(qs, count);
+	if (ret >= 0)
+		goto out;
+
+	ret = -ETIMEDOUT;
+	if (to && !to->task)
+		goto out;
+
+	/* As in futex_wait(), this may be a spurious wakeup */
+	if (!signal_pending(current))
+		goto retry;
+
+	ret = abs_time ? -EINTR : -ERESTARTSYS;
+
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(qs);
+	kfree(blocks);
+	return ret;
+}
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -3547,6 +3804,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAIT_MULTIPLE:
+		return futex_wait_multiple((void __user *)uaddr, flags, val,
+					   timeout);
 	}
 	return -ENOSYS;
 }
@@ -3563,7 +3823,8 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (unlikely(should_fail_futex(!(op & FUTEX_PRIVATE_FLAG))))
 			return -EFAULT;
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
@@ -3572,7 +3833,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
@@ -3609,30 +3870,35 @@ static void __init futex_detect_cmpxchg(void)
 
 static int __init futex_init(void)
 {
-	unsigned int futex_shift;
-	unsigned long i;
+	struct futex_hash_bucket *table;
+	unsigned long hashsize, i;
+	int node;
 
 #if CONFIG_BASE_SMALL
-	futex_hashsize = 16;
+	hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	hashsize = 256 * num_possible_cpus() / num_possible_nodes();
+	hashsize = roundup_pow_of_two(max(hashsize, 16UL));
 #endif
+	futex_hashshift = ilog2(hashsize);
 
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0,
-					       futex_hashsize < 256 ? HASH_SMALL : 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
-
-	futex_detect_cmpxchg();
+	for_each_node(node) {
+		table = kvmalloc_node(hashsize * sizeof(*table), GFP_KERNEL,
+				      node);
+		if (!table)
+			panic("futex: failed to allocate hash for node %d\n",
+			      node);
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+		for (i = 0; i < hashsize; i++)
+			futex_hash_bucket_init(&table[i]);
+		futex_queues[node] = table;
 	}
 
+	pr_info("futex hash table entries: %lu per node, %d nodes\n",
+		hashsize, num_possible_nodes());
+
+	futex_detect_cmpxchg();
+
 	return 0;
 }
 core_initcall(futex_init);
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Load driven interrupt balancing.
+ *
+ * The time spent in the hard interrupt handlers is accounted per
+ * interrupt.  Every irqbalance.interval_ms the balancer sums it up per
+ * target CPU and, if the busiest CPU spent more than
+ * irqbalance.threshold percent of the interval in interrupt handlers,
+ * moves one interrupt from it to the least loaded CPU it may use.
+ *
+ * Only interrupts whose affinity is not managed and was not set by a
+ * driver or by the user are moved.  Setting the affinity of a moved
+ * interrupt takes it away from the balancer again.  Moves go through the
+ * regular affinity setting path, so the vector matrix allocator decides
+ * whether the target CPU can take the interrupt.
+ *
+ * /proc/irq/balance shows the per interrupt counts and handler times of
+ * the last interval, so that user space balancers don't have to compute
+ * them from /proc/interrupts.
+ */
+#include <linux/irq.h>
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "irqbalance."
+
+DEFINE_STATIC_KEY_FALSE(irq_balance_enabled);
+
+static bool irq_balance_on;
+static unsigned int irq_balance_interval_ms = 1000;
+module_param_named(interval_ms, irq_balance_interval_ms, uint, 0644);
+static unsigned int irq_balance_threshold = 10;
+module_param_named(threshold, irq_balance_threshold, uint, 0644);
+
+static bool irq_balance_ready;
+static DEFINE_MUTEX(irq_balance_mutex);
+static void irq_balance_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(irq_balance_work, irq_balance_fn);
+
+/* Per CPU handler time of the current pass */
+static u64 *irq_balance_load;
+
+struct irq_balance_stat {
+	unsigned int	irq;
+	unsigned int	cpu;
+	u64		time;
+};
+
+static unsigned long irq_balance_delay(void)
+{
+	return msecs_to_jiffies(max(READ_ONCE(irq_balance_interval_ms), 10U));
+}
+
+void irq_balance_disown(struct irq_desc *desc)
+{
+	desc->balance_owned = false;
+}
+
+static bool irq_balance_movable(struct irq_desc *desc)
+{
+	struct irq_data *d = irq_desc_get_irq_data(desc);
+
+	if (!desc->action || irq_settings_is_per_cpu_devid(desc))
+		return false;
+	if (irqd_affinity_is_managed(d) || !irqd_can_balance(d))
+		return false;
+	if (irqd_is_setaffinity_pending(d))
+		return false;
+
+	return !irqd_has_set(d, IRQD_AFFINITY_SET) || desc->balance_owned;
+}
+
+/*
+ * Pick the least loaded online CPU among the default affinity CPUs, on the
+ * node of @desc if possible.
+ */
+static int irq_balance_target(struct irq_desc *desc)
+{
+	int node = irq_desc_get_node(desc);
+	const struct cpumask *nodemask = NULL;
+	int cpu, target = -1;
+
+	if (node != NUMA_NO_NODE) {
+		nodemask = cpumask_of_node(node);
+		if (!cpumask_intersects(nodemask, irq_default_affinity) ||
+		    !cpumask_intersects(nodemask, cpu_online_mask))
+			nodemask = NULL;
+	}
+
+	for_each_cpu_and(cpu, irq_default_affinity, cpu_online_mask) {
+		if (nodemask && !cpumask_test_cpu(cpu, nodemask))
+			continue;
+		if (target < 0 ||
+		    irq_balance_load[cpu] < irq_balance_load[target])
+			target = cpu;
+	}
+
+	return target;
+}
+
+static void irq_balance_move(unsigned int irq, int cpu)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	unsigned long flags;
+
+	if (!desc)
+		return;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	if (irq_balance_movable(desc) &&
+	    !irq_set_affinity_locked(irq_desc_get_irq_data(desc),
+				     cpumask_of(cpu), false))
+		desc->balance_owned = true;
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+}
+
+static void irq_balance_fn(struct work_struct *work)
+{
+	u64 interval_ns = (u64)READ_ONCE(irq_balance_interval_ms) *
+			  NSEC_PER_MSEC;
+	struct irq_balance_stat *stats, *best = NULL;
+	int i, nr = 0, busiest = -1, target, best_target = -1;
+	const struct cpumask *mask;
+	struct irq_desc *desc;
+	unsigned long flags;
+	unsigned int irq;
+
+	memset(irq_balance_load, 0, nr_cpu_ids * sizeof(*irq_balance_load));
+
+	irq_lock_sparse();
+
+	stats = kvmalloc_array(nr_irqs, sizeof(*stats), GFP_KERNEL);
+
+	for_each_irq_desc(irq, desc) {
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		desc->balance_last_count = desc->balance_count;
+		desc->balance_last_time = desc->balance_time;
+		desc->balance_count = 0;
+		desc->balance_time = 0;
+
+		mask = irq_data_get_effective_affinity_mask(&desc->irq_data);
+		i = cpumask_first_and(mask, cpu_online_mask);
+		if (i < nr_cpu_ids && desc->balance_last_time) {
+			irq_balance_load[i] += desc->balance_last_time;
+			if (stats && irq_balance_movable(desc)) {
+				stats[nr].irq = irq;
+				stats[nr].cpu = i;
+				stats[nr].time = desc->balance_last_time;
+				nr++;
+			}
+		}
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+
+	for_each_online_cpu(i) {
+		if (busiest < 0 ||
+		    irq_balance_load[i] > irq_balance_load[busiest])
+			busiest = i;
+	}
+
+	if (busiest < 0 || irq_balance_load[busiest] * 100 <
+			   interval_ns * READ_ONCE(irq_balance_threshold))
+		goto out;
+
+	/*
+	 * Move the heaviest interrupt of the busiest CPU whose move lowers
+	 * the peak load.  One interrupt per pass keeps things stable.
+	 */
+	for (i = 0; i < nr; i++) {
+		if (stats[i].cpu != busiest)
+			continue;
+		if (best && stats[i].time <= best->time)
+			continue;
+
+		target = irq_balance_target(irq_to_desc(stats[i].irq));
+		if (target < 0 || target == busiest ||
+		    irq_balance_load[target] + stats[i].time >=
+		    irq_balance_load[busiest])
+			continue;
+
+		best = &stats[i];
+		best_target = target;
+	}
+
+	if (best)
+		irq_balance_move(best->irq, best_target);
+out:
+	irq_unlock_sparse();
+	kvfree(stats);
+
+	mutex_lock(&irq_balance_mutex);
+	if (irq_balance_on)
+		schedule_delayed_work(&irq_balance_work, irq_balance_delay());
+	mutex_unlock(&irq_balance_mutex);
+}
+
+static void irq_balance_update(void)
+{
+	lockdep_assert_held(&irq_balance_mutex);
+
+	if (!irq_balance_ready)
+		return;
+
+	if (irq_balance_on) {
+		static_branch_enable(&irq_balance_enabled);
+		schedule_delayed_work(&irq_balance_work, irq_balance_delay());
+	} else {
+		static_branch_disable(&irq_balance_enabled);
+	}
+}
+
+static int irq_balance_set(const char *val, const struct kernel_param *kp)
+{
+	int ret;
+
+	mutex_lock(&irq_balance_mutex);
+	ret = param_set_bool(val, kp);
+	if (!ret)
+		irq_balance_update();
+	mutex_unlock(&irq_balance_mutex);
+
+	return ret;
+}
+
+static const struct kernel_param_ops irq_balance_ops = {
+	.set = irq_balance_set,
+	.get = param_get_bool,
+};
+module_param_cb(enabled, &irq_balance_ops, &irq_balance_on, 0644);
+
+static int irq_balance_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc;
+	unsigned int irq;
+	int cpu;
+
+	seq_puts(m, "irq cpu count time_ns\n");
+
+	irq_lock_sparse();
+	for_each_irq_desc(irq, desc) {
+		if (!desc->action || !desc->balance_last_count)
+			continue;
+
+		cpu = cpumask_first(
+			irq_data_get_effective_affinity_mask(&desc->irq_data));
+		seq_printf(m, "%u %d %u %llu\n", irq, cpu,
+			   desc->balance_last_count, desc->balance_last_time);
+	}
+	irq_unlock_sparse();
+
+	return 0;
+}
+
+static int __init irq_balance_init(void)
+{
+	irq_balance_load = kcalloc(nr_cpu_ids, sizeof(*irq_balance_load),
+				   GFP_KERNEL);
+	if (!irq_balance_load)
+		return -ENOMEM;
+
+	proc_create_single("irq/balance", 0444, NULL, irq_balance_show);
+
+	mutex_lock(&irq_balance_mutex);
+	irq_balance_ready = true;
+	irq_balance_update();
+	mutex_unlock(&irq_balance_mutex);
+
+	return 0;
+}
+late_initcall(irq_balance_init);
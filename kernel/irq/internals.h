@@ -376,6 +376,32 @@ static inline void irq_setup_timings(struct irq_desc *desc,
 static inline void record_irq_time(struct irq_desc *desc) {}
 #endif /* CONFIG_IRQ_TIMINGS */
 
+#ifdef CONFIG_IRQ_BALANCE
+DECLARE_STATIC_KEY_FALSE(irq_balance_enabled);
+
+void irq_balance_disown(struct irq_desc *desc);
+
+static inline u64 irq_balance_start(void)
+{
+	if (static_branch_unlikely(&irq_balance_enabled))
+		return local_clock();
+	return 0;
+}
+
+/* Called with desc->lock held */
+static inline void irq_balance_account(struct irq_desc *desc, u64 start)
+{
+	if (start) {
+		desc->balance_time += local_clock() - start;
+		desc->balance_count++;
+	}
+}
+#else
+static inline void irq_balance_disown(struct irq_desc *desc) { }
+static inline u64 irq_balance_start(void) { return 0; }
+static inline void irq_balance_account(struct irq_desc *desc, u64 start) { }
+#endif /* CONFIG_IRQ_BALANCE */
+
 
 #ifdef CONFIG_GENERIC_IRQ_CHIP
 void irq_init_generic_chip(struct irq_chip_generic *gc, const char *name,
@@ -226,6 +226,7 @@ int irq_set_affinity_locked(struct irq_data *data, const struct cpumask *mask,
 		schedule_work(&desc->affinity_notify->work);
 	}
 	irqd_set(data, IRQD_AFFINITY_SET);
+	irq_balance_disown(desc);
 
 	return ret;
 }
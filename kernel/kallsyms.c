@@ -24,6 +24,10 @@
 #include <linux/filter.h>
 #include <linux/ftrace.h>
 #include <linux/compiler.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/stringhash.h>
 
 /*
  * These will be re-linked against their real values
@@ -158,6 +162,97 @@ static unsigned long kallsyms_sym_address(int idx)
 	return kallsyms_relative_base - 1 - kallsyms_offsets[idx];
 }
 
+#ifdef CONFIG_KALLSYMS_NAME_INDEX
+/*
+ * A hash of the symbol names, so that kallsyms_lookup_name() only has
+ * to decompress the few names that share a bucket with the one it is
+ * after.  Both arrays hold symbol indexes plus one, zero ends a chain.
+ * Each chain is in index order, so the first match is still the one a
+ * linear scan would have returned.
+ */
+static unsigned int kallsyms_hash_bits;
+static u32 *kallsyms_hash_next;
+static u32 *kallsyms_hash_head;
+
+static u32 kallsyms_name_hash(const char *name)
+{
+	return hash_32(full_name_hash(NULL, name, strlen(name)),
+		       kallsyms_hash_bits);
+}
+
+static int __init kallsyms_name_index_init(void)
+{
+	char namebuf[KSYM_NAME_LEN];
+	unsigned int off;
+	u32 *head, *next;
+	unsigned long i;
+
+	if (!kallsyms_num_syms)
+		return 0;
+
+	kallsyms_hash_bits = ilog2(roundup_pow_of_two(kallsyms_num_syms)) ?: 1;
+	next = kvmalloc_array(kallsyms_num_syms, sizeof(u32), GFP_KERNEL);
+	head = kvzalloc(sizeof(u32) << kallsyms_hash_bits, GFP_KERNEL);
+	if (!next || !head)
+		goto fail;
+
+	/* The names can only be decompressed front to back... */
+	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
+		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
+		next[i] = kallsyms_name_hash(namebuf);
+	}
+
+	/* ...but pushing back to front keeps each chain in index order. */
+	for (i = kallsyms_num_syms; i-- > 0; ) {
+		u32 bucket = next[i];
+
+		next[i] = head[bucket];
+		head[bucket] = i + 1;
+	}
+
+	kallsyms_hash_next = next;
+	/* Pairs with smp_load_acquire() in kallsyms_lookup_name() */
+	smp_store_release(&kallsyms_hash_head, head);
+	return 0;
+
+fail:
+	kvfree(head);
+	kvfree(next);
+	pr_warn("kallsyms: no memory for the name index, lookups will scan\n");
+	return 0;
+}
+core_initcall(kallsyms_name_index_init);
+
+static bool kallsyms_lookup_name_index(const char *name,
+				       unsigned long *addr)
+{
+	u32 *head = smp_load_acquire(&kallsyms_hash_head);
+	char namebuf[KSYM_NAME_LEN];
+	u32 i;
+
+	if (!head)
+		return false;
+
+	for (i = head[kallsyms_name_hash(name)]; i;
+	     i = kallsyms_hash_next[i - 1]) {
+		kallsyms_expand_symbol(get_symbol_offset(i - 1), namebuf,
+				       ARRAY_SIZE(namebuf));
+		if (strcmp(namebuf, name) == 0) {
+			*addr = kallsyms_sym_address(i - 1);
+			return true;
+		}
+	}
+	*addr = module_kallsyms_lookup_name(name);
+	return true;
+}
+#else
+static inline bool kallsyms_lookup_name_index(const char *name,
+					      unsigned long *addr)
+{
+	return false;
+}
+#endif
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
@@ -165,6 +260,10 @@ unsigned long kallsyms_lookup_name(const char *name)
 	unsigned long i;
 	unsigned int off;
 
+	/* Until the index is there, or without it, go through them all */
+	if (kallsyms_lookup_name_index(name, &i))
+		return i;
+
 	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
 		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
 
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _GEN_CNA_LOCK_SLOWPATH
+#error "do not include this file"
+#endif
+
+#include <linux/topology.h>
+
+/*
+ * Implement a NUMA-aware version of MCS (aka CNA, or compact NUMA-aware lock).
+ *
+ * In CNA, spinning threads are organized in two queues, a primary queue for
+ * threads running on the same NUMA node as the current lock holder, and a
+ * secondary queue for threads running on other nodes.  When the MCS lock is
+ * passed on, the holder looks for a waiter on its own node in the primary
+ * queue and moves the waiters it skips over to the secondary queue.  The
+ * secondary queue is spliced back in front of the primary queue when no
+ * local waiter is left, or after CNA_INTRA_NODE_THRESHOLD consecutive local
+ * handoffs so that remote waiters are not starved.
+ *
+ * The secondary queue belongs to the holder of the MCS lock.  It is passed
+ * along in the @locked field of the successor's node, which then holds the
+ * encoded tail of the secondary queue instead of 1.  The secondary queue is
+ * circular: the @next field of its tail points to its head.
+ *
+ * Like PV, CNA keeps its per-node state in the second cacheline of the
+ * per-cpu node array.
+ */
+
+struct cna_node {
+	struct mcs_spinlock	mcs;
+	struct mcs_spinlock	__res[3];
+
+	int			numa_node;
+	u32			encoded_tail;
+	u32			intra_count;
+};
+
+#define CNA_INTRA_NODE_THRESHOLD	(1 << 16)
+
+static inline struct cna_node *to_cna_node(struct mcs_spinlock *node)
+{
+	return (struct cna_node *)node;
+}
+
+static void cna_init_node(struct mcs_spinlock *node)
+{
+	struct cna_node *cn = to_cna_node(node);
+	int idx = node - this_cpu_ptr(&mcs_nodes[0]);
+
+	BUILD_BUG_ON(sizeof(struct cna_node) > 5*sizeof(struct mcs_spinlock));
+
+	cn->numa_node = numa_node_id();
+	cn->encoded_tail = encode_tail(smp_processor_id(), idx);
+	cn->intra_count = 0;
+}
+
+/*
+ * Move the waiters from @first to @last to the end of the secondary queue
+ * whose tail is encoded in @tail_2nd, and return the new encoded tail.
+ */
+static u32 cna_move_to_secondary(u32 tail_2nd, struct mcs_spinlock *first,
+				 struct mcs_spinlock *last)
+{
+	struct mcs_spinlock *tail;
+
+	if (tail_2nd > _Q_LOCKED_VAL) {
+		tail = decode_tail(tail_2nd);
+		WRITE_ONCE(last->next, tail->next);
+		WRITE_ONCE(tail->next, first);
+	} else {
+		WRITE_ONCE(last->next, first);
+	}
+
+	return to_cna_node(last)->encoded_tail;
+}
+
+/*
+ * Pass the MCS lock to a waiter on the holder's node if there is one, or
+ * to the head of the secondary queue otherwise.  Only waiters which already
+ * have a successor are moved aside, so the lock tail is never affected.
+ */
+static void cna_pass_lock(struct mcs_spinlock *node,
+			  struct mcs_spinlock *next)
+{
+	struct cna_node *cn = to_cna_node(node);
+	struct mcs_spinlock *prev = NULL, *cur, *succ;
+	u32 tail_2nd = node->locked ? node->locked : _Q_LOCKED_VAL;
+	u32 intra_count = 0;
+
+	if (tail_2nd > _Q_LOCKED_VAL &&
+	    cn->intra_count >= CNA_INTRA_NODE_THRESHOLD)
+		goto splice;
+
+	for (cur = next; cur; prev = cur, cur = READ_ONCE(cur->next)) {
+		if (to_cna_node(cur)->numa_node == cn->numa_node)
+			break;
+	}
+
+	if (cur) {
+		if (cur != next)
+			tail_2nd = cna_move_to_secondary(tail_2nd, next, prev);
+		if (tail_2nd > _Q_LOCKED_VAL)
+			intra_count = cn->intra_count + 1;
+		succ = cur;
+		goto pass;
+	}
+
+splice:
+	succ = next;
+	if (tail_2nd > _Q_LOCKED_VAL) {
+		struct mcs_spinlock *tail = decode_tail(tail_2nd);
+
+		succ = tail->next;
+		WRITE_ONCE(tail->next, next);
+	}
+	tail_2nd = _Q_LOCKED_VAL;
+
+pass:
+	to_cna_node(succ)->intra_count = intra_count;
+	smp_store_release(&succ->locked, tail_2nd);
+}
+
+/*
+ * The primary queue is empty.  If remote waiters are parked on the
+ * secondary queue, make it the primary queue and let its head go;
+ * otherwise do what MCS does.
+ */
+static bool cna_try_clear_tail(struct qspinlock *lock, u32 val,
+			       struct mcs_spinlock *node)
+{
+	struct mcs_spinlock *tail, *head;
+	u32 tail_2nd = node->locked;
+
+	if (tail_2nd <= _Q_LOCKED_VAL)
+		return __try_clear_tail(lock, val, node);
+
+	tail = decode_tail(tail_2nd);
+	head = tail->next;
+	WRITE_ONCE(tail->next, NULL);
+
+	/*
+	 * Release, so that a waiter which queues behind @tail as soon as it
+	 * becomes the lock tail can't have its link overwritten by the
+	 * store above.
+	 */
+	if (atomic_try_cmpxchg_release(&lock->val, &val,
+				       tail_2nd | _Q_LOCKED_VAL)) {
+		to_cna_node(head)->intra_count = 0;
+		smp_store_release(&head->locked, _Q_LOCKED_VAL);
+		return true;
+	}
+
+	WRITE_ONCE(tail->next, head);
+	return false;
+}
+
+/*
+ * numa_spinlock=on|off|auto; auto enables CNA on machines with more than
+ * one online node.
+ */
+static int numa_spinlock_flag = -1;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto"))
+		numa_spinlock_flag = -1;
+	else if (!strcmp(str, "on"))
+		numa_spinlock_flag = 1;
+	else if (!strcmp(str, "off"))
+		numa_spinlock_flag = 0;
+	else
+		return 0;
+
+	return 1;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+/*
+ * Native and CNA waiters must not be mixed on one lock, as a native holder
+ * would drop the secondary queue.  Switch before the other CPUs come up,
+ * while no lock can be contended.
+ */
+static int __init cna_init(void)
+{
+	bool enable = numa_spinlock_flag < 0 ? num_online_nodes() > 1 :
+					       numa_spinlock_flag;
+
+	if (enable) {
+		static_branch_enable(&cna_lock_slowpath);
+		pr_info("Enabling CNA spinlock\n");
+	}
+
+	return 0;
+}
+early_initcall(cna_init);
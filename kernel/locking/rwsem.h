@@ -1,24 +1,26 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 /*
- * The owner field of the rw_semaphore structure will be set to
- * RWSEM_READER_OWNED when a reader grabs the lock. A writer will clear
- * the owner field when it unlocks. A reader, on the other hand, will
- * not touch the owner field when it unlocks.
+ * The owner field of the rw_semaphore structure holds the task that owns
+ * the lock, with the following flags in its low bits:
  *
- * In essence, the owner field now has the following 4 states:
- *  1) 0
- *     - lock is free or the owner hasn't set the field yet
- *  2) RWSEM_READER_OWNED
- *     - lock is currently or previously owned by readers (lock is free
- *       or not set by owner yet)
- *  3) RWSEM_ANONYMOUSLY_OWNED bit set with some other bits set as well
- *     - lock is owned by an anonymous writer, so spinning on the lock
- *       owner should be disabled.
- *  4) Other non-zero value
- *     - a writer owns the lock and other writers can spin on the lock owner.
+ *  - RWSEM_READER_OWNED (bit 0)
+ *    The lock is currently or was previously owned by readers. The task
+ *    is the reader that first took it after a writer and is only kept for
+ *    debugging; readers don't touch the owner field when they unlock.
+ *  - RWSEM_NONSPINNABLE (bit 1)
+ *    Optimistic spinners must neither spin on the owner nor steal the
+ *    lock. It is set by a spinner which has waited too long on readers,
+ *    by a writer which has waited too long in the queue and wants the
+ *    lock handed to it, and for writers of unknown identity. It survives
+ *    readers and unlocking writers, and is cleared when a writer takes
+ *    the lock.
+ *
+ * With no flag set, a non-NULL owner is the writer holding the lock, and
+ * NULL means that the lock is free or the owner hasn't set the field yet.
  */
-#define RWSEM_ANONYMOUSLY_OWNED	(1UL << 0)
-#define RWSEM_READER_OWNED	((struct task_struct *)RWSEM_ANONYMOUSLY_OWNED)
+#define RWSEM_READER_OWNED	(1UL << 0)
+#define RWSEM_NONSPINNABLE	(1UL << 1)
+#define RWSEM_OWNER_FLAGS_MASK	(RWSEM_READER_OWNED | RWSEM_NONSPINNABLE)
 
 #ifdef CONFIG_DEBUG_RWSEMS
 # define DEBUG_RWSEMS_WARN_ON(c)	DEBUG_LOCKS_WARN_ON(c)
@@ -39,6 +41,105 @@ static inline void rwsem_set_owner(struct rw_semaphore *sem)
 	WRITE_ONCE(sem->owner, current);
 }
 
+static inline void rwsem_clear_owner(struct rw_semaphore *sem)
+{
+	/* A pending handoff must outlive the writer, see above */
+	if (!((unsigned long)READ_ONCE(sem->owner) & RWSEM_NONSPINNABLE))
+		WRITE_ONCE(sem->owner, NULL);
+}
+
+static inline void __rwsem_set_reader_owned(struct rw_semaphore *sem,
+					    struct task_struct *owner)
+{
+	unsigned long val = (unsigned long)READ_ONCE(sem->owner);
+
+	/*
+	 * We check the owner value first to make sure that we will only
+	 * do a write to the rwsem cacheline when it is really necessary
+	 * to minimize cacheline contention.
+	 */
+	if (!(val & RWSEM_READER_OWNED))
+		WRITE_ONCE(sem->owner, (struct task_struct *)
+			   ((unsigned long)owner | RWSEM_READER_OWNED |
+			    (val & RWSEM_NONSPINNABLE)));
+}
+
+static inline void rwsem_set_reader_owned(struct rw_semaphore *sem)
+{
+	__rwsem_set_reader_owned(sem, current);
+}
+
+/*
+ * Stop optimistic spinners until the next writer takes the lock.
+ */
+static inline void rwsem_set_nonspinnable(struct rw_semaphore *sem)
+{
+	struct task_struct *owner = READ_ONCE(sem->owner), *old;
+
+	while (!((unsigned long)owner & RWSEM_NONSPINNABLE)) {
+		old = cmpxchg(&sem->owner, owner, (struct task_struct *)
+			      ((unsigned long)owner | RWSEM_NONSPINNABLE));
+		if (old == owner)
+			break;
+		owner = old;
+	}
+}
+
+/*
+ * The task that owns the lock, without the flags. For readers, it is only
+ * a hint and the task may be gone.
+ */
+static inline struct task_struct *rwsem_owner(struct rw_semaphore *sem)
+{
+	return (struct task_struct *)
+		((unsigned long)READ_ONCE(sem->owner) & ~RWSEM_OWNER_FLAGS_MASK);
+}
+
+static inline bool is_rwsem_reader_owned(struct rw_semaphore *sem)
+{
+	return (unsigned long)READ_ONCE(sem->owner) & RWSEM_READER_OWNED;
+}
+
+enum rwsem_owner_state {
+	OWNER_NULL,
+	OWNER_WRITER,
+	OWNER_READER,
+	OWNER_NONSPINNABLE,
+};
+
+/*
+ * What an optimistic spinner may do with the lock: spin on the writer,
+ * spin for a bounded time on readers, or keep away from it. A NULL owner
+ * is spinnable.
+ */
+static inline enum rwsem_owner_state
+rwsem_owner_state(struct task_struct *owner)
+{
+	unsigned long val = (unsigned long)owner;
+
+	if (val & RWSEM_NONSPINNABLE)
+		return OWNER_NONSPINNABLE;
+	if (val & RWSEM_READER_OWNED)
+		return OWNER_READER;
+	return owner ? OWNER_WRITER : OWNER_NULL;
+}
+#else
+# define DEBUG_RWSEMS_WARN_ON(c)
+#endif
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * All writes to owner are protected by WRITE_ONCE() to make sure that
+ * store tearing can't happen as optimistic spinners may read and use
+ * the owner value concurrently without lock. Read from owner, however,
+ * may not need READ_ONCE() as long as the pointer value is only used
+ * for comparison and isn't being dereferenced.
+ */
+static inline void rwsem_set_owner(struct rw_semaphore *sem)
+{
+	WRITE_ONCE(sem->owner, current);
+}
+
 static inline void rwsem_clear_owner(struct rw_semaphore *sem)
 {
 	WRITE_ONCE(sem->owner, NULL);
@@ -81,7 +182,16 @@ static inline void rwsem_clear_owner(struct rw_semaphore *sem)
 {
 }
 
+static inline void __rwsem_set_reader_owned(struct rw_semaphore *sem,
+					    struct task_struct *owner)
+{
+}
+
 static inline void rwsem_set_reader_owned(struct rw_semaphore *sem)
 {
 }
+
+static inline void rwsem_set_nonspinnable(struct rw_semaphore *sem)
+{
+}
 #endif
@@ -62,6 +62,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/hashtable.h>
+#include <linux/stringhash.h>
 #include <linux/dynamic_debug.h>
 #include <linux/audit.h>
 #include <uapi/linux/module.h>
@@ -437,6 +439,25 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
+static const struct symsearch vmlinux_syms[] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
 /* Returns true as soon as fn returns true, otherwise false. */
 bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 				    struct module *owner,
@@ -444,28 +465,11 @@ bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 			 void *data)
 {
 	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
-#endif
-	};
 
 	module_assert_mutex_or_preempt();
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(vmlinux_syms, ARRAY_SIZE(vmlinux_syms),
+				   NULL, fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
@@ -571,6 +575,133 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * The symbols exported by modules are hashed by name, so resolving a
+ * symbol does not have to binary search every section of every loaded
+ * module in turn.  Entries are added once a module is formed, removed
+ * before it is unlinked and walked under RCU-sched like the module list.
+ */
+#define MOD_EXPORT_HASH_BITS	12
+
+static DEFINE_HASHTABLE(mod_export_hash, MOD_EXPORT_HASH_BITS);
+
+struct module_export {
+	struct hlist_node node;
+	u32 hash;
+	unsigned int symnum;
+	const struct symsearch *syms;
+	struct module *owner;
+};
+
+struct module_exports {
+#ifdef CONFIG_UNUSED_SYMBOLS
+	struct symsearch syms[5];
+#else
+	struct symsearch syms[3];
+#endif
+	unsigned int num;
+	struct module_export ents[];
+};
+
+static u32 mod_export_hashfn(const char *name)
+{
+	return full_name_hash(NULL, name, strlen(name));
+}
+
+static bool find_module_export(struct find_symbol_arg *fsa)
+{
+	u32 hash = mod_export_hashfn(fsa->name);
+	struct module_export *e;
+
+	hash_for_each_possible_rcu(mod_export_hash, e, node, hash) {
+		if (e->hash != hash ||
+		    strcmp(fsa->name, e->syms->start[e->symnum].name))
+			continue;
+		if (e->owner->state == MODULE_STATE_UNFORMED)
+			continue;
+		return check_symbol(e->syms, e->owner, e->symnum, fsa);
+	}
+
+	return false;
+}
+
+/* Called with module_mutex held, once verify_export_symbols() passed. */
+static int mod_exports_add(struct module *mod)
+{
+	const struct symsearch arr[] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
+		  NOT_GPL_ONLY, false },
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
+		  GPL_ONLY, false },
+		{ mod->gpl_future_syms,
+		  mod->gpl_future_syms + mod->num_gpl_future_syms,
+		  mod->gpl_future_crcs,
+		  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+		{ mod->unused_syms,
+		  mod->unused_syms + mod->num_unused_syms,
+		  mod->unused_crcs,
+		  NOT_GPL_ONLY, true },
+		{ mod->unused_gpl_syms,
+		  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
+		  mod->unused_gpl_crcs,
+		  GPL_ONLY, true },
+#endif
+	};
+	struct module_exports *exports;
+	unsigned int i, j, num = 0;
+
+	BUILD_BUG_ON(ARRAY_SIZE(arr) != ARRAY_SIZE(exports->syms));
+
+	for (i = 0; i < ARRAY_SIZE(arr); i++)
+		num += arr[i].stop - arr[i].start;
+	if (!num)
+		return 0;
+
+	exports = kvmalloc(sizeof(*exports) + num * sizeof(exports->ents[0]),
+			   GFP_KERNEL);
+	if (!exports)
+		return -ENOMEM;
+
+	memcpy(exports->syms, arr, sizeof(arr));
+	exports->num = 0;
+	for (i = 0; i < ARRAY_SIZE(arr); i++) {
+		const struct symsearch *syms = &exports->syms[i];
+
+		for (j = 0; j < syms->stop - syms->start; j++) {
+			struct module_export *e = &exports->ents[exports->num++];
+
+			e->hash = mod_export_hashfn(syms->start[j].name);
+			e->symnum = j;
+			e->syms = syms;
+			e->owner = mod;
+			hash_add_rcu(mod_export_hash, &e->node, e->hash);
+		}
+	}
+	mod->exports = exports;
+	return 0;
+}
+
+/* Called with module_mutex held, before waiting for RCU-sched readers. */
+static void mod_exports_del(struct module *mod)
+{
+	unsigned int i;
+
+	if (!mod->exports)
+		return;
+
+	for (i = 0; i < mod->exports->num; i++)
+		hash_del_rcu(&mod->exports->ents[i].node);
+}
+
+/* And once the readers are gone. */
+static void mod_exports_free(struct module *mod)
+{
+	kvfree(mod->exports);
+	mod->exports = NULL;
+}
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -585,7 +716,11 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	module_assert_mutex_or_preempt();
+
+	if (each_symbol_in_section(vmlinux_syms, ARRAY_SIZE(vmlinux_syms),
+				   NULL, find_symbol_in_section, &fsa) ||
+	    find_module_export(&fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -2161,11 +2296,13 @@ static void free_module(struct module *mod)
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	mod_exports_del(mod);
 	/* Remove this module from bug list, this uses list_del_rcu */
 	module_bug_cleanup(mod);
 	/* Wait for RCU-sched synchronizing before releasing mod->list and buglist. */
 	synchronize_sched();
 	mutex_unlock(&module_mutex);
+	mod_exports_free(mod);
 
 	/* This may be empty, but that's OK */
 	disable_ro_nx(&mod->init_layout);
@@ -3602,6 +3739,10 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err < 0)
 		goto out;
 
+	err = mod_exports_add(mod);
+	if (err < 0)
+		goto out;
+
 	/* This relies on module_mutex for list integrity. */
 	module_bug_finalize(info->hdr, info->sechdrs, mod);
 
@@ -3819,10 +3960,12 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
 	mod_tree_remove(mod);
+	mod_exports_del(mod);
 	wake_up_all(&module_wq);
 	/* Wait for RCU-sched synchronizing before releasing mod->list. */
 	synchronize_sched();
 	mutex_unlock(&module_mutex);
+	mod_exports_free(mod);
  free_module:
 	/* Free lock-classes; relies on the preceding sync_rcu() */
 	lockdep_free_key_range(mod->core_layout.base, mod->core_layout.size);
@@ -209,12 +209,26 @@ static struct padata_priv *padata_get_next(struct parallel_data *pd)
 	return padata;
 }
 
+/* Hand a run of reordered objects to the serial queue of @cb_cpu */
+static void padata_queue_serial(struct parallel_data *pd, int cb_cpu,
+				struct list_head *batch)
+{
+	struct padata_serial_queue *squeue = per_cpu_ptr(pd->squeue, cb_cpu);
+
+	spin_lock(&squeue->serial.lock);
+	list_splice_tail_init(batch, &squeue->serial.list);
+	spin_unlock(&squeue->serial.lock);
+
+	queue_work_on(cb_cpu, pd->pinst->wq, &squeue->work);
+}
+
 static void padata_reorder(struct parallel_data *pd)
 {
-	int cb_cpu;
+	int cb_cpu = -1, cpu;
 	struct padata_priv *padata;
-	struct padata_serial_queue *squeue;
+	struct padata_parallel_queue *next_queue;
 	struct padata_instance *pinst = pd->pinst;
+	LIST_HEAD(batch);
 
 	/*
 	 * We need to ensure that only one cpu can work on dequeueing of
@@ -235,46 +249,44 @@ static void padata_reorder(struct parallel_data *pd)
 		/*
 		 * If the next object that needs serialization is parallel
 		 * processed by another cpu and is still on it's way to the
-		 * cpu's reorder queue, nothing to do for now.
+		 * cpu's reorder queue, or if it still waits in this cpu's
+		 * parallelization queue, nothing to do for now.
 		 */
-		if (PTR_ERR(padata) == -EINPROGRESS)
+		if (IS_ERR(padata))
 			break;
 
 		/*
-		 * This cpu has to do the parallel processing of the next
-		 * object. It's waiting in the cpu's parallelization queue,
-		 * so exit immediately.
+		 * Consecutive objects for the same callback cpu go to its
+		 * serial queue in one go.
 		 */
-		if (PTR_ERR(padata) == -ENODATA) {
-			del_timer(&pd->timer);
-			spin_unlock_bh(&pd->lock);
-			return;
-		}
-
+		if (padata->cb_cpu != cb_cpu && !list_empty(&batch))
+			padata_queue_serial(pd, cb_cpu, &batch);
 		cb_cpu = padata->cb_cpu;
-		squeue = per_cpu_ptr(pd->squeue, cb_cpu);
-
-		spin_lock(&squeue->serial.lock);
-		list_add_tail(&padata->list, &squeue->serial.list);
-		spin_unlock(&squeue->serial.lock);
-
-		queue_work_on(cb_cpu, pinst->wq, &squeue->work);
+		list_add_tail(&padata->list, &batch);
 	}
 
+	if (!list_empty(&batch))
+		padata_queue_serial(pd, cb_cpu, &batch);
+
 	spin_unlock_bh(&pd->lock);
 
 	/*
 	 * The next object that needs serialization might have arrived to
-	 * the reorder queues in the meantime, we will be called again
-	 * from the timer function if no one else cares for it.
+	 * the reorder queues in the meantime, with its padata_do_serial()
+	 * failing the trylock above.  Queue the reorder work on the cpu it
+	 * arrived on in that case.
+	 *
+	 * Ensure the reorder queue is read after pd->lock is dropped so we
+	 * see new objects from another task in padata_do_serial.  Pairs
+	 * with the smp_mb in padata_do_serial.
 	 */
-	if (atomic_read(&pd->reorder_objects)
-			&& !(pinst->flags & PADATA_RESET))
-		mod_timer(&pd->timer, jiffies + HZ);
-	else
-		del_timer(&pd->timer);
+	smp_mb();
 
-	return;
+	cpu = padata_index_to_cpu(pd, READ_ONCE(pd->processed) %
+				      cpumask_weight(pd->cpumask.pcpu));
+	next_queue = per_cpu_ptr(pd->pqueue, cpu);
+	if (!list_empty(&next_queue->reorder.list))
+		queue_work_on(cpu, pinst->wq, &next_queue->reorder_work);
 }
 
 static void invoke_padata_reorder(struct work_struct *work)
@@ -289,41 +301,6 @@ static void invoke_padata_reorder(struct work_struct *work)
 	local_bh_enable();
 }
 
-static void padata_reorder_timer(struct timer_list *t)
-{
-	struct parallel_data *pd = from_timer(pd, t, timer);
-	unsigned int weight;
-	int target_cpu, cpu;
-
-	cpu = get_cpu();
-
-	/* We don't lock pd here to not interfere with parallel processing
-	 * padata_reorder() calls on other CPUs. We just need any CPU out of
-	 * the cpumask.pcpu set. It would be nice if it's the right one but
-	 * it doesn't matter if we're off to the next one by using an outdated
-	 * pd->processed value.
-	 */
-	weight = cpumask_weight(pd->cpumask.pcpu);
-	target_cpu = padata_index_to_cpu(pd, pd->processed % weight);
-
-	/* ensure to call the reorder callback on the correct CPU */
-	if (cpu != target_cpu) {
-		struct padata_parallel_queue *pqueue;
-		struct padata_instance *pinst;
-
-		/* The timer function is serialized wrt itself -- no locking
-		 * needed.
-		 */
-		pinst = pd->pinst;
-		pqueue = per_cpu_ptr(pd->pqueue, target_cpu);
-		queue_work_on(target_cpu, pinst->wq, &pqueue->reorder_work);
-	} else {
-		padata_reorder(pd);
-	}
-
-	put_cpu();
-}
-
 static void padata_serial_worker(struct work_struct *serial_work)
 {
 	struct padata_serial_queue *squeue;
@@ -387,6 +364,13 @@ void padata_do_serial(struct padata_priv *padata)
 	list_add_tail(&padata->list, &pqueue->reorder.list);
 	spin_unlock(&pqueue->reorder.lock);
 
+	/*
+	 * Ensure the addition to the reorder list is ordered before the
+	 * trylock of pd->lock in padata_reorder.  Pairs with the smp_mb in
+	 * padata_reorder.
+	 */
+	smp_mb();
+
 	put_cpu();
 
 	/* If we're running on the wrong CPU, call padata_reorder() via a
@@ -486,7 +470,6 @@ static struct parallel_data *padata_alloc_pd(struct padata_instance *pinst,
 
 	padata_init_pqueues(pd);
 	padata_init_squeues(pd);
-	timer_setup(&pd->timer, padata_reorder_timer, 0);
 	atomic_set(&pd->seq_nr, -1);
 	atomic_set(&pd->reorder_objects, 0);
 	atomic_set(&pd->refcnt, 0);
@@ -526,11 +509,14 @@ static void padata_flush_queues(struct parallel_data *pd)
 		flush_work(&pqueue->work);
 	}
 
-	del_timer_sync(&pd->timer);
-
 	if (atomic_read(&pd->reorder_objects))
 		padata_reorder(pd);
 
+	for_each_cpu(cpu, pd->cpumask.pcpu) {
+		pqueue = per_cpu_ptr(pd->pqueue, cpu);
+		flush_work(&pqueue->reorder_work);
+	}
+
 	for_each_cpu(cpu, pd->cpumask.cbcpu) {
 		squeue = per_cpu_ptr(pd->squeue, cpu);
 		flush_work(&squeue->work);
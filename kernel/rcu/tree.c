@@ -61,6 +61,10 @@
 #include <linux/trace_events.h>
 #include <linux/suspend.h>
 #include <linux/ftrace.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/shrinker.h>
+#include <linux/workqueue.h>
 
 #include "tree.h"
 #include "rcu.h"
@@ -3015,19 +3019,266 @@ void call_rcu_bh(struct rcu_head *head, rcu_callback_t func)
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
- * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * kfree_rcu() does not go through the callback lists.  Each CPU collects
+ * the pointers in page-sized blocks, and a batch is handed to a single
+ * grace period every KFREE_DRAIN_JIFFIES, after which the blocks are
+ * released with kfree_bulk() from a workqueue.  Objects for which no
+ * block can be allocated are chained through their rcu_head instead.
+ * Each CPU has KFREE_N_BATCHES batches in flight at most; a shrinker
+ * submits the pending objects early when memory is tight.
+ */
+#define KFREE_DRAIN_JIFFIES	(HZ / 50)
+#define KFREE_N_BATCHES		2
+
+struct kfree_rcu_bulk_data {
+	unsigned long nr_records;
+	struct kfree_rcu_bulk_data *next;
+	void *records[];
+};
+
+#define KFREE_BULK_MAX_ENTR \
+	((PAGE_SIZE - sizeof(struct kfree_rcu_bulk_data)) / sizeof(void *))
+
+/* A batch waiting for its grace period */
+struct kfree_rcu_cpu_work {
+	struct rcu_work rcu_work;
+	struct kfree_rcu_bulk_data *bhead_free;
+	struct rcu_head *head_free;
+	struct kfree_rcu_cpu *krcp;
+};
+
+struct kfree_rcu_cpu {
+	spinlock_t lock;
+	struct kfree_rcu_bulk_data *bhead;	/* Blocks being filled. */
+	struct kfree_rcu_bulk_data *bcached;	/* One spare block. */
+	struct rcu_head *head;			/* Objects without a block. */
+	int count;				/* Objects not yet submitted. */
+	bool monitor_todo;
+	struct delayed_work monitor_work;
+	struct kfree_rcu_cpu_work krw_arr[KFREE_N_BATCHES];
+};
+
+static DEFINE_PER_CPU(struct kfree_rcu_cpu, krc);
+
+/*
+ * Free a batch once its grace period has elapsed.
+ */
+static void kfree_rcu_work(struct work_struct *work)
+{
+	struct kfree_rcu_cpu_work *krwp = container_of(to_rcu_work(work),
+					struct kfree_rcu_cpu_work, rcu_work);
+	struct kfree_rcu_cpu *krcp = krwp->krcp;
+	struct kfree_rcu_bulk_data *bhead, *bnext;
+	struct rcu_head *head, *next;
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	bhead = krwp->bhead_free;
+	krwp->bhead_free = NULL;
+	head = krwp->head_free;
+	krwp->head_free = NULL;
+	spin_unlock_irqrestore(&krcp->lock, flags);
+
+	for (; bhead; bhead = bnext) {
+		bnext = bhead->next;
+
+		rcu_lock_acquire(&rcu_callback_map);
+		kfree_bulk(bhead->nr_records, bhead->records);
+		rcu_lock_release(&rcu_callback_map);
+
+		spin_lock_irqsave(&krcp->lock, flags);
+		if (!krcp->bcached) {
+			krcp->bcached = bhead;
+			bhead = NULL;
+		}
+		spin_unlock_irqrestore(&krcp->lock, flags);
+		if (bhead)
+			free_page((unsigned long)bhead);
+
+		cond_resched();
+	}
+
+	for (; head; head = next) {
+		next = head->next;
+		__rcu_reclaim(rcu_state_p->name, head);
+		cond_resched();
+	}
+}
+
+/*
+ * Hand the pending objects to a grace period.  Returns false if all the
+ * batches are still in flight.  Called with krcp->lock held.
+ */
+static bool kfree_rcu_queue_batch(struct kfree_rcu_cpu *krcp)
+{
+	struct kfree_rcu_cpu_work *krwp;
+	int i;
+
+	/* An empty batch could reuse a slot whose work is still pending */
+	if (!krcp->bhead && !krcp->head)
+		return true;
+
+	for (i = 0; i < KFREE_N_BATCHES; i++) {
+		krwp = &krcp->krw_arr[i];
+		if (krwp->bhead_free || krwp->head_free)
+			continue;
+
+		krwp->bhead_free = krcp->bhead;
+		krcp->bhead = NULL;
+		krwp->head_free = krcp->head;
+		krcp->head = NULL;
+		krcp->count = 0;
+
+		queue_rcu_work(system_wq, &krwp->rcu_work);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Submit the pending objects, or retry later if no batch is free.
+ */
+static void kfree_rcu_monitor(struct work_struct *work)
+{
+	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
+						  monitor_work.work);
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	if (krcp->monitor_todo) {
+		if (kfree_rcu_queue_batch(krcp))
+			krcp->monitor_todo = false;
+		else
+			schedule_delayed_work(&krcp->monitor_work,
+					      KFREE_DRAIN_JIFFIES);
+	}
+	spin_unlock_irqrestore(&krcp->lock, flags);
+}
+
+static bool kfree_rcu_bulk_add(struct kfree_rcu_cpu *krcp, void *ptr)
+{
+	struct kfree_rcu_bulk_data *bnode = krcp->bhead;
+
+	if (!bnode || bnode->nr_records == KFREE_BULK_MAX_ENTR) {
+		bnode = krcp->bcached;
+		krcp->bcached = NULL;
+		if (!bnode)
+			bnode = (struct kfree_rcu_bulk_data *)
+				__get_free_page(GFP_NOWAIT | __GFP_NOWARN);
+		if (!bnode)
+			return false;
+
+		bnode->nr_records = 0;
+		bnode->next = krcp->bhead;
+		krcp->bhead = bnode;
+	}
+
+	bnode->records[bnode->nr_records++] = ptr;
+	return true;
+}
+
+/*
+ * Queue an object for kfree() after a grace period, see the comment above
+ * KFREE_DRAIN_JIFFIES.  This function may only be called from
+ * __kfree_rcu(), @func is the offset of @head within the object.
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    rcu_callback_t func)
 {
-	__call_rcu(head, func, rcu_state_p, -1, 1);
+	struct kfree_rcu_cpu *krcp;
+	unsigned long flags;
+	void *ptr = (void *)head - (unsigned long)func;
+
+	local_irq_save(flags);
+	krcp = this_cpu_ptr(&krc);
+	spin_lock(&krcp->lock);
+
+	if (!kfree_rcu_bulk_add(krcp, ptr)) {
+		head->func = func;
+		head->next = krcp->head;
+		krcp->head = head;
+	}
+	krcp->count++;
+
+	if (!krcp->monitor_todo) {
+		krcp->monitor_todo = true;
+		schedule_delayed_work(&krcp->monitor_work,
+				      KFREE_DRAIN_JIFFIES);
+	}
+
+	spin_unlock_irqrestore(&krcp->lock, flags);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+static unsigned long
+kfree_rcu_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(&krc, cpu)->count);
+
+	return count;
+}
+
+/*
+ * The objects can't be freed before their grace period, but submitting
+ * them now rather than KFREE_DRAIN_JIFFIES later gets them back sooner.
+ */
+static unsigned long
+kfree_rcu_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct kfree_rcu_cpu *krcp;
+	unsigned long flags, freed = 0;
+	int cpu, count;
+
+	for_each_possible_cpu(cpu) {
+		krcp = per_cpu_ptr(&krc, cpu);
+
+		spin_lock_irqsave(&krcp->lock, flags);
+		count = krcp->count;
+		if (krcp->monitor_todo && kfree_rcu_queue_batch(krcp)) {
+			krcp->monitor_todo = false;
+			freed += count;
+		}
+		spin_unlock_irqrestore(&krcp->lock, flags);
+
+		if (freed >= sc->nr_to_scan)
+			break;
+	}
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker kfree_rcu_shrinker = {
+	.count_objects = kfree_rcu_shrink_count,
+	.scan_objects = kfree_rcu_shrink_scan,
+	.batch = 0,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static void __init kfree_rcu_batch_init(void)
+{
+	struct kfree_rcu_cpu *krcp;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		krcp = per_cpu_ptr(&krc, cpu);
+		spin_lock_init(&krcp->lock);
+		for (i = 0; i < KFREE_N_BATCHES; i++) {
+			INIT_RCU_WORK(&krcp->krw_arr[i].rcu_work,
+				      kfree_rcu_work);
+			krcp->krw_arr[i].krcp = krcp;
+		}
+		INIT_DELAYED_WORK(&krcp->monitor_work, kfree_rcu_monitor);
+	}
+
+	if (register_shrinker(&kfree_rcu_shrinker))
+		pr_err("Failed to register kfree_rcu() shrinker!\n");
+}
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -4104,6 +4355,8 @@ void __init rcu_init(void)
 	WARN_ON(!rcu_gp_wq);
 	rcu_par_gp_wq = alloc_workqueue("rcu_par_gp", WQ_MEM_RECLAIM, 0);
 	WARN_ON(!rcu_par_gp_wq);
+
+	kfree_rcu_batch_init();
 }
 
 #include "tree_exp.h"
@@ -2463,6 +2463,19 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			clear_bit(MMF_DISABLE_THP, &me->mm->flags);
 		up_write(&me->mm->mmap_sem);
 		break;
+	case PR_GET_EXEC_PREFAULT:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = !!test_bit(MMF_EXEC_PREFAULT, &me->mm->flags);
+		break;
+	case PR_SET_EXEC_PREFAULT:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (arg2)
+			set_bit(MMF_EXEC_PREFAULT, &me->mm->flags);
+		else
+			clear_bit(MMF_EXEC_PREFAULT, &me->mm->flags);
+		break;
 	case PR_MPX_ENABLE_MANAGEMENT:
 		if (arg2 || arg3 || arg4 || arg5)
 			return -EINVAL;
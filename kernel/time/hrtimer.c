@@ -608,6 +608,29 @@ static inline int hrtimer_hres_active(void)
 	return __hrtimer_hres_active(this_cpu_ptr(&hrtimer_bases));
 }
 
+/*
+ * The clock event device is armed for cpu_base->expires_next, which is
+ * earlier than @expires_next after the first timer was removed.  If that
+ * event falls into the slack window of the new first timer, it can expire
+ * that timer as well and the device needs no reprogramming.
+ */
+static bool hrtimer_event_coalesces(struct hrtimer_cpu_base *cpu_base,
+				    ktime_t expires_next)
+{
+	struct hrtimer *next = cpu_base->next_timer;
+	ktime_t softexpires;
+
+	if (!__hrtimer_hres_active(cpu_base) || cpu_base->hang_detected)
+		return false;
+
+	if (!next || next->is_soft || cpu_base->expires_next >= expires_next)
+		return false;
+
+	softexpires = ktime_sub(hrtimer_get_softexpires(next),
+				next->base->offset);
+	return softexpires <= cpu_base->expires_next;
+}
+
 /*
  * Reprogram the event source with checking both queues for the
  * next event
@@ -639,6 +662,17 @@ hrtimer_force_reprogram(struct hrtimer_cpu_base *cpu_base, int skip_equal)
 	if (skip_equal && expires_next == cpu_base->expires_next)
 		return;
 
+	/*
+	 * Leaving the device armed early is fine: hrtimer_interrupt()
+	 * reevaluates the queues and arms it again if needed.
+	 */
+	if (skip_equal && hrtimer_event_coalesces(cpu_base, expires_next)) {
+#ifdef CONFIG_HIGH_RES_TIMERS
+		cpu_base->nr_reprog_skipped++;
+#endif
+		return;
+	}
+
 	cpu_base->expires_next = expires_next;
 
 	/*
@@ -1457,6 +1491,11 @@ static void __hrtimer_run_queues(struct hrtimer_cpu_base *cpu_base, ktime_t now,
 			if (basenow < hrtimer_get_softexpires_tv64(timer))
 				break;
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+			if (!timer->is_soft &&
+			    basenow < hrtimer_get_expires_tv64(timer))
+				cpu_base->nr_coalesced++;
+#endif
 			__run_hrtimer(cpu_base, base, timer, &basenow, flags);
 		}
 	}
@@ -42,6 +42,8 @@
 #include <linux/sched/sysctl.h>
 #include <linux/sched/nohz.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/isolation.h>
+#include <linux/sched/topology.h>
 #include <linux/slab.h>
 #include <linux/compat.h>
 
@@ -194,9 +196,13 @@ EXPORT_SYMBOL(jiffies_64);
 # define BASE_DEF	0
 #endif
 
+/* Number of expired timers run per base->lock round trip */
+#define TIMER_BATCH		8
+
 struct timer_base {
 	raw_spinlock_t		lock;
 	struct timer_list	*running_timer;
+	struct timer_list	*batch[TIMER_BATCH];
 	unsigned long		clk;
 	unsigned long		next_expiry;
 	unsigned int		cpu;
@@ -866,13 +872,91 @@ static inline struct timer_base *get_timer_base(u32 tflags)
 	return get_timer_cpu_base(tflags, tflags & TIMER_CPUMASK);
 }
 
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+/*
+ * Timer migration groups the CPUs by node.  Each group tracks which of its
+ * CPUs have a timer base that is not idle, and a timer armed on an idle CPU
+ * goes to one of them, preferably one sharing the last level cache.  Only
+ * when the whole group is idle is the timer sent further away.  A group's
+ * mask is only written when one of its CPUs' timer base changes its idle
+ * state.
+ */
+static struct cpumask *timer_busy_cpus[MAX_NUMNODES];
+
+static void timer_set_busy(unsigned int cpu, bool busy)
+{
+	struct cpumask *mask = timer_busy_cpus[cpu_to_node(cpu)];
+
+	if (!mask)
+		return;
+	if (busy)
+		cpumask_set_cpu(cpu, mask);
+	else
+		cpumask_clear_cpu(cpu, mask);
+}
+
+/* Only called for the BASE_STD base of the local CPU */
+static void timer_base_set_idle(struct timer_base *base, bool idle)
+{
+	if (base->is_idle == idle)
+		return;
+
+	base->is_idle = idle;
+	timer_set_busy(base->cpu, !idle);
+}
+
+static int timer_migration_target(void)
+{
+	int i, cpu = smp_processor_id(), target = -1;
+	struct cpumask *mask;
+
+	if (!idle_cpu(cpu) && housekeeping_cpu(cpu, HK_FLAG_TIMER))
+		return cpu;
+
+	mask = timer_busy_cpus[cpu_to_node(cpu)];
+	if (!mask)
+		return get_nohz_timer_target();
+
+	for_each_cpu(i, mask) {
+		if (i == cpu || !cpu_online(i) ||
+		    !housekeeping_cpu(i, HK_FLAG_TIMER))
+			continue;
+		if (cpus_share_cache(cpu, i))
+			return i;
+		if (target < 0)
+			target = i;
+	}
+
+	return target >= 0 ? target : get_nohz_timer_target();
+}
+
+static void __init timer_migration_init(void)
+{
+	int node;
+
+	for_each_node(node)
+		timer_busy_cpus[node] = kzalloc_node(cpumask_size(),
+						     GFP_NOWAIT, node);
+
+	timer_set_busy(smp_processor_id(), true);
+}
+#else
+static inline void timer_set_busy(unsigned int cpu, bool busy) { }
+static inline void timer_migration_init(void) { }
+
+static inline void timer_base_set_idle(struct timer_base *base, bool idle)
+{
+	base->is_idle = idle;
+}
+#endif
+
 static inline struct timer_base *
 get_target_base(struct timer_base *base, unsigned tflags)
 {
 #if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
 	if (static_branch_likely(&timers_migration_enabled) &&
 	    !(tflags & TIMER_PINNED))
-		return get_timer_cpu_base(tflags, get_nohz_timer_target());
+		return get_timer_cpu_base(tflags, timer_migration_target());
 #endif
 	return get_timer_this_cpu_base(tflags);
 }
@@ -947,6 +1031,47 @@ static struct timer_base *lock_timer_base(struct timer_list *timer,
 #define MOD_TIMER_PENDING_ONLY		0x01
 #define MOD_TIMER_REDUCE		0x02
 
+/*
+ * expire_timers() takes batches of expired timers off the wheel and runs
+ * their callbacks without the base lock.  A timer in base->batch[] whose
+ * callback has not been started yet is cancelled by try_to_del_timer_sync()
+ * like a pending timer is detached, so that it can't wait for a callback
+ * queued behind the one calling it.  To claim a timer for running,
+ * expire_timers() first makes it the running timer and then clears its
+ * batch slot, so a timer is always found in one or the other until its
+ * callback has finished.
+ */
+static bool timer_cancel_batched(struct timer_base *base,
+				 struct timer_list *timer)
+{
+	int i;
+
+	for (i = 0; i < TIMER_BATCH; i++) {
+		if (READ_ONCE(base->batch[i]) == timer &&
+		    cmpxchg(&base->batch[i], timer, NULL) == timer)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Whether the callback of @timer is running or about to run on @base.
+ * Must be called with base->lock held.
+ */
+static bool timer_is_running(struct timer_base *base,
+			     struct timer_list *timer)
+{
+	int i;
+
+	for (i = 0; i < TIMER_BATCH; i++) {
+		if (READ_ONCE(base->batch[i]) == timer)
+			return true;
+	}
+	/* Pairs with the claim in expire_timers() */
+	smp_rmb();
+	return smp_load_acquire(&base->running_timer) == timer;
+}
+
 static inline int
 __mod_timer(struct timer_list *timer, unsigned long expires, unsigned int options)
 {
@@ -1025,7 +1150,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires, unsigned int option
 		 * handler yet has not finished. This also guarantees that the
 		 * timer is serialized wrt itself.
 		 */
-		if (likely(base->running_timer != timer)) {
+		if (likely(!timer_is_running(base, timer))) {
 			/* See the comment in lock_timer_base() */
 			timer->flags |= TIMER_MIGRATING;
 
@@ -1224,8 +1349,13 @@ int try_to_del_timer_sync(struct timer_list *timer)
 
 	base = lock_timer_base(timer, &flags);
 
-	if (base->running_timer != timer)
+	if (timer_cancel_batched(base, timer)) {
+		/* The callback may have been armed again meanwhile */
+		detach_if_pending(timer, base, true);
+		ret = 1;
+	} else if (!timer_is_running(base, timer)) {
 		ret = detach_if_pending(timer, base, true);
+	}
 
 	raw_spin_unlock_irqrestore(&base->lock, flags);
 
@@ -1346,23 +1476,50 @@ static void expire_timers(struct timer_base *base, struct hlist_head *head)
 	while (!hlist_empty(head)) {
 		struct timer_list *timer;
 		void (*fn)(struct timer_list *);
+		int i, nr = 0;
 
 		timer = hlist_entry(head->first, struct timer_list, entry);
 
-		base->running_timer = timer;
-		detach_timer(timer, true);
-
-		fn = timer->function;
-
 		if (timer->flags & TIMER_IRQSAFE) {
+			base->running_timer = timer;
+			detach_timer(timer, true);
+			fn = timer->function;
+
 			raw_spin_unlock(&base->lock);
 			call_timer_fn(timer, fn);
 			raw_spin_lock(&base->lock);
-		} else {
-			raw_spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn);
-			raw_spin_lock_irq(&base->lock);
+			continue;
+		}
+
+		/* See the comment above timer_cancel_batched() */
+		do {
+			detach_timer(timer, true);
+			WRITE_ONCE(base->batch[nr++], timer);
+			if (hlist_empty(head))
+				break;
+			timer = hlist_entry(head->first, struct timer_list,
+					    entry);
+		} while (nr < TIMER_BATCH && !(timer->flags & TIMER_IRQSAFE));
+
+		raw_spin_unlock_irq(&base->lock);
+
+		for (i = 0; i < nr; i++) {
+			timer = READ_ONCE(base->batch[i]);
+			if (!timer)
+				continue;
+
+			WRITE_ONCE(base->running_timer, timer);
+			if (cmpxchg(&base->batch[i], timer, NULL) != timer) {
+				/* Cancelled by try_to_del_timer_sync() */
+				WRITE_ONCE(base->running_timer, NULL);
+				continue;
+			}
+
+			call_timer_fn(timer, timer->function);
 		}
+
+		raw_spin_lock_irq(&base->lock);
+		base->running_timer = NULL;
 	}
 }
 
@@ -1548,7 +1705,7 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 
 	if (time_before_eq(nextevt, basej)) {
 		expires = basem;
-		base->is_idle = false;
+		timer_base_set_idle(base, false);
 	} else {
 		if (!is_max_delta)
 			expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
@@ -1561,7 +1718,7 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		 */
 		if ((expires - basem) > TICK_NSEC) {
 			base->must_forward_clk = true;
-			base->is_idle = true;
+			timer_base_set_idle(base, true);
 		}
 	}
 	raw_spin_unlock(&base->lock);
@@ -1584,7 +1741,7 @@ void timer_clear_idle(void)
 	 * sending the IPI a few instructions smaller for the cost of taking
 	 * the lock in the exit from idle path.
 	 */
-	base->is_idle = false;
+	timer_base_set_idle(base, false);
 }
 
 static int collect_expired_timers(struct timer_base *base,
@@ -1873,6 +2030,7 @@ int timers_prepare_cpu(unsigned int cpu)
 		base->is_idle = false;
 		base->must_forward_clk = true;
 	}
+	timer_set_busy(cpu, true);
 	return 0;
 }
 
@@ -1884,6 +2042,8 @@ int timers_dead_cpu(unsigned int cpu)
 
 	BUG_ON(cpu_online(cpu));
 
+	timer_set_busy(cpu, false);
+
 	for (b = 0; b < NR_BASES; b++) {
 		old_base = per_cpu_ptr(&timer_bases[b], cpu);
 		new_base = get_cpu_ptr(&timer_bases[b]);
@@ -1938,6 +2098,7 @@ static void __init init_timer_cpus(void)
 void __init init_timers(void)
 {
 	init_timer_cpus();
+	timer_migration_init();
 	open_softirq(TIMER_SOFTIRQ, run_timer_softirq);
 }
 
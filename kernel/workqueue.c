@@ -27,6 +27,7 @@
 #include <linux/export.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/sched/topology.h>
 #include <linux/init.h>
 #include <linux/signal.h>
 #include <linux/completion.h>
@@ -838,6 +839,38 @@ static void wake_up_worker(struct worker_pool *pool)
 		wake_up_process(worker->task);
 }
 
+/* how many idle workers wake_up_worker_near() looks at */
+#define WQ_NEAR_SCAN_MAX	8
+
+/**
+ * wake_up_worker_near - wake up an idle worker close to a CPU
+ * @pool: unbound worker pool to wake worker from
+ * @cpu: CPU the work item was queued on or for
+ *
+ * Wake up an idle worker of @pool which last ran within the last level
+ * cache of @cpu, so that the scheduler is likely to keep it there, or
+ * the first idle worker if there is none.
+ *
+ * CONTEXT:
+ * spin_lock_irq(pool->lock).
+ */
+static void wake_up_worker_near(struct worker_pool *pool, int cpu)
+{
+	struct worker *worker;
+	int nr = 0;
+
+	list_for_each_entry(worker, &pool->idle_list, entry) {
+		if (cpus_share_cache(task_cpu(worker->task), cpu)) {
+			wake_up_process(worker->task);
+			return;
+		}
+		if (++nr >= WQ_NEAR_SCAN_MAX)
+			break;
+	}
+
+	wake_up_worker(pool);
+}
+
 /**
  * wq_worker_waking_up - a worker is waking up
  * @task: task waking up
@@ -1283,15 +1316,18 @@ static int try_to_grab_pending(struct work_struct *work, bool is_dwork,
  * @work: work to insert
  * @head: insertion point
  * @extra_flags: extra WORK_STRUCT_* flags to set
+ * @cpu: CPU @work was queued on or for, WORK_CPU_UNBOUND if none
  *
  * Insert @work which belongs to @pwq after @head.  @extra_flags is or'd to
- * work_struct flags.
+ * work_struct flags.  @cpu selects the worker to wake on WQ_CACHE_AFFINE
+ * workqueues.
  *
  * CONTEXT:
  * spin_lock_irq(pool->lock).
  */
 static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
-			struct list_head *head, unsigned int extra_flags)
+			struct list_head *head, unsigned int extra_flags,
+			int cpu)
 {
 	struct worker_pool *pool = pwq->pool;
 
@@ -1307,7 +1343,12 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	 */
 	smp_mb();
 
-	if (__need_more_worker(pool))
+	if (!__need_more_worker(pool))
+		return;
+
+	if ((pwq->wq->flags & WQ_CACHE_AFFINE) && cpu != WORK_CPU_UNBOUND)
+		wake_up_worker_near(pool, cpu);
+	else
 		wake_up_worker(pool);
 }
 
@@ -1458,7 +1499,8 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 		worklist = &pwq->delayed_works;
 	}
 
-	insert_work(pwq, work, worklist, work_flags);
+	insert_work(pwq, work, worklist, work_flags,
+		    (wq->flags & WQ_UNBOUND) ? cpu : WORK_CPU_UNBOUND);
 
 	spin_unlock(&pwq->pool->lock);
 }
@@ -1492,6 +1534,90 @@ bool queue_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL(queue_work_on);
 
+/**
+ * workqueue_select_cpu_near - select a CPU based on NUMA node
+ * @node: NUMA node ID that we want to select a CPU from
+ *
+ * Return: the local CPU if it belongs to @node, an online CPU of @node
+ * otherwise, or WORK_CPU_UNBOUND if @node has no online CPU.
+ */
+static int workqueue_select_cpu_near(int node)
+{
+	int cpu;
+
+	/* No point in doing this if NUMA isn't enabled for workqueues */
+	if (!wq_numa_enabled)
+		return WORK_CPU_UNBOUND;
+
+	/* Delay binding to CPU if node is not valid or online */
+	if (node < 0 || node >= MAX_NUMNODES || !node_online(node))
+		return WORK_CPU_UNBOUND;
+
+	/* Use local node/cpu if we are already there */
+	cpu = raw_smp_processor_id();
+	if (node == cpu_to_node(cpu))
+		return cpu;
+
+	/* Use "random" otherwise know as "first" online CPU of node */
+	cpu = cpumask_any_and(cpumask_of_node(node), cpu_online_mask);
+
+	/* If CPU is valid return that, otherwise just defer */
+	return cpu < nr_cpu_ids ? cpu : WORK_CPU_UNBOUND;
+}
+
+/**
+ * queue_work_node - queue work on a "random" cpu for a given NUMA node
+ * @node: NUMA node that we are targeting the work for
+ * @wq: workqueue to use
+ * @work: work to queue
+ *
+ * We queue the work to a "random" CPU within a given NUMA node.  The
+ * basic idea here is to provide a way to somehow associate work with a
+ * given NUMA node, typically the one the work item's data lives on.
+ *
+ * This function will only make a best effort attempt at getting this
+ * onto the right NUMA node.  If no node is requested or the requested
+ * node is offline then we just fall back to standard queue_work
+ * behavior.
+ *
+ * Currently the "random" CPU ends up being the first available CPU in
+ * the intersection of cpu_online_mask and the cpumask of the node,
+ * unless we are running on the node.  In that case we just use the
+ * current CPU.
+ *
+ * Return: %false if @work was already on a queue, %true otherwise.
+ */
+bool queue_work_node(int node, struct workqueue_struct *wq,
+		     struct work_struct *work)
+{
+	unsigned long flags;
+	bool ret = false;
+
+	/*
+	 * This current implementation is specific to unbound workqueues.
+	 * Specifically we only return the first available CPU for a given
+	 * node instead of cycling through individual CPUs within the node.
+	 *
+	 * If this is used with a per-cpu workqueue then the logic in
+	 * workqueue_select_cpu_near would need to be updated to allow for
+	 * some round robin type logic.
+	 */
+	WARN_ON_ONCE(!(wq->flags & WQ_UNBOUND));
+
+	local_irq_save(flags);
+
+	if (!test_and_set_bit(WORK_STRUCT_PENDING_BIT, work_data_bits(work))) {
+		int cpu = workqueue_select_cpu_near(node);
+
+		__queue_work(cpu, wq, work);
+		ret = true;
+	}
+
+	local_irq_restore(flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(queue_work_node);
+
 void delayed_work_timer_fn(struct timer_list *t)
 {
 	struct delayed_work *dwork = from_timer(dwork, t, timer);
@@ -2559,7 +2685,8 @@ static void insert_wq_barrier(struct pool_workqueue *pwq,
 
 	debug_work_activate(&barr->work);
 	insert_work(pwq, &barr->work, head,
-		    work_color_to_flags(WORK_NO_COLOR) | linked);
+		    work_color_to_flags(WORK_NO_COLOR) | linked,
+		    WORK_CPU_UNBOUND);
 }
 
 /**
@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * In-kernel benchmark of the x86-64 user copy routines.
+ *
+ * The user space memcpy benchmarks of perf can't see what the kernel's
+ * copy routines cost with SMAP toggling and page faults on the user
+ * buffer.  Reading <debugfs>/copy_user_benchmark runs each routine in the
+ * context of the reading process, against a user buffer mapped into it,
+ * and reports a log2 histogram of the cycles taken per call for each
+ * size.  The sizes, the alignment, the NUMA node of the kernel buffers,
+ * the number of loops and whether the user buffer is faulted in are
+ * module parameters, so that "perf bench mem kcopy" can drive it.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <asm/cpufeature.h>
+#include <asm/msr.h>
+
+#define BENCH_MAX_SIZE		(1U << 20)
+#define BENCH_HIST_BUCKETS	32
+#define BENCH_RESULT_SIZE	(64 << 10)
+
+static unsigned int min_size = 8;
+module_param(min_size, uint, 0644);
+MODULE_PARM_DESC(min_size, "Smallest copy size in bytes (default: 8)");
+
+static unsigned int max_size = 65536;
+module_param(max_size, uint, 0644);
+MODULE_PARM_DESC(max_size, "Largest copy size in bytes, at most 1MB (default: 65536)");
+
+static unsigned int align;
+module_param(align, uint, 0644);
+MODULE_PARM_DESC(align, "Offset of the buffers into their first page (default: 0)");
+
+static int node = NUMA_NO_NODE;
+module_param(node, int, 0644);
+MODULE_PARM_DESC(node, "NUMA node of the kernel buffers (default: local)");
+
+static unsigned int loops = 10000;
+module_param(loops, uint, 0644);
+MODULE_PARM_DESC(loops, "Calls per function and size (default: 10000)");
+
+static bool cold;
+module_param(cold, bool, 0644);
+MODULE_PARM_DESC(cold, "Fault in the user buffer on every call (default: off)");
+
+enum bench_dir {
+	BENCH_TO_USER,
+	BENCH_FROM_USER,
+	BENCH_KERNEL,
+};
+
+struct bench_fn {
+	const char	*name;
+	enum bench_dir	dir;
+	unsigned long	(*fn)(void *to, const void *from, unsigned int len);
+};
+
+static unsigned long bench_nocache(void *to, const void *from,
+				   unsigned int len)
+{
+	return __copy_user_nocache(to, (const void __user *)from, len, 0);
+}
+
+static unsigned long bench_mcsafe(void *to, const void *from,
+				  unsigned int len)
+{
+	return memcpy_mcsafe(to, from, len);
+}
+
+static unsigned long bench_memcpy(void *to, const void *from,
+				  unsigned int len)
+{
+	memcpy(to, from, len);
+	return 0;
+}
+
+static const struct bench_fn bench_fns[] = {
+	{ "copy_user_enhanced_fast_string", BENCH_TO_USER,
+	  copy_user_enhanced_fast_string },
+	{ "copy_user_generic_string", BENCH_TO_USER,
+	  copy_user_generic_string },
+	{ "copy_user_generic_unrolled", BENCH_TO_USER,
+	  copy_user_generic_unrolled },
+	{ "__copy_user_nocache", BENCH_FROM_USER, bench_nocache },
+	{ "memcpy_mcsafe", BENCH_KERNEL, bench_mcsafe },
+	{ "memcpy", BENCH_KERNEL, bench_memcpy },
+};
+
+struct bench_buf {
+	char		*result;
+	size_t		len;
+};
+
+struct bench_ctx {
+	char		*ksrc;
+	char		*kdst;
+	unsigned long	uaddr;
+	size_t		ulen;
+	u64		hist[BENCH_HIST_BUCKETS];
+};
+
+static DEFINE_MUTEX(bench_mutex);
+
+static unsigned long bench_map_user(size_t len)
+{
+	unsigned long addr;
+
+	addr = vm_mmap(NULL, 0, len, PROT_READ | PROT_WRITE,
+		       MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	return addr >= TASK_SIZE ? 0 : addr;
+}
+
+/* Returns the total time in ns, or a negative error */
+static s64 bench_one(struct bench_ctx *ctx, const struct bench_fn *bf,
+		     unsigned int size)
+{
+	void *to, *from;
+	unsigned int i;
+	ktime_t start;
+	s64 total = 0;
+
+	memset(ctx->hist, 0, sizeof(ctx->hist));
+
+	for (i = 0; i < loops; i++) {
+		u64 t0, t1;
+
+		if (cold && bf->dir != BENCH_KERNEL) {
+			vm_munmap(ctx->uaddr, ctx->ulen);
+			ctx->uaddr = bench_map_user(ctx->ulen);
+			if (!ctx->uaddr)
+				return -ENOMEM;
+		}
+
+		switch (bf->dir) {
+		case BENCH_TO_USER:
+			to = (void *)(ctx->uaddr + align);
+			from = ctx->ksrc + align;
+			break;
+		case BENCH_FROM_USER:
+			to = ctx->kdst + align;
+			from = (void *)(ctx->uaddr + align);
+			break;
+		default:
+			to = ctx->kdst + align;
+			from = ctx->ksrc + align;
+			break;
+		}
+
+		start = ktime_get();
+		t0 = rdtsc_ordered();
+		if (bf->fn(to, from, size))
+			return -EFAULT;
+		t1 = rdtsc_ordered();
+		total += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		ctx->hist[min_t(unsigned int, ilog2((t1 - t0) | 1),
+				BENCH_HIST_BUCKETS - 1)]++;
+
+		if (!(i & 1023))
+			cond_resched();
+	}
+
+	return total;
+}
+
+static size_t bench_report(char *buf, size_t len, struct bench_ctx *ctx,
+			   const struct bench_fn *bf, unsigned int size,
+			   s64 total)
+{
+	size_t n;
+	int b;
+
+	n = scnprintf(buf, len, "%s %u %llu", bf->name, size,
+		      div_u64(total, loops));
+	for (b = 0; b < BENCH_HIST_BUCKETS; b++) {
+		if (ctx->hist[b])
+			n += scnprintf(buf + n, len - n, " %d:%llu", b,
+				       ctx->hist[b]);
+	}
+	n += scnprintf(buf + n, len - n, "\n");
+
+	return n;
+}
+
+static int bench_run(struct bench_buf *bb)
+{
+	unsigned int order, size, f;
+	struct page *src, *dst;
+	struct bench_ctx *ctx;
+	size_t n = 0;
+	int ret = 0;
+
+	if (!min_size || min_size > max_size || max_size > BENCH_MAX_SIZE ||
+	    align >= PAGE_SIZE || !loops)
+		return -EINVAL;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	order = get_order(max_size + align);
+	src = alloc_pages_node(node, GFP_KERNEL, order);
+	dst = alloc_pages_node(node, GFP_KERNEL, order);
+	ctx->ulen = PAGE_SIZE << order;
+	ctx->uaddr = bench_map_user(ctx->ulen);
+	if (!src || !dst || !ctx->uaddr) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	ctx->ksrc = page_address(src);
+	ctx->kdst = page_address(dst);
+	memset(ctx->ksrc, 0x5a, ctx->ulen);
+
+	/* Fault the user buffer in unless the faults are to be measured */
+	if (!cold && copy_to_user((void __user *)ctx->uaddr, ctx->ksrc,
+				  ctx->ulen)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	n += scnprintf(bb->result + n, BENCH_RESULT_SIZE - n,
+		       "# cpu %d node %d align %u loops %u cold %d erms %d rep_good %d\n",
+		       raw_smp_processor_id(), node, align, loops, cold,
+		       boot_cpu_has(X86_FEATURE_ERMS),
+		       boot_cpu_has(X86_FEATURE_REP_GOOD));
+	n += scnprintf(bb->result + n, BENCH_RESULT_SIZE - n,
+		       "# function size avg_ns log2_cycles:calls...\n");
+
+	for (f = 0; f < ARRAY_SIZE(bench_fns); f++) {
+		for (size = min_size; size <= max_size; size <<= 1) {
+			s64 total = bench_one(ctx, &bench_fns[f], size);
+
+			if (total < 0) {
+				ret = total;
+				goto out;
+			}
+			n += bench_report(bb->result + n,
+					  BENCH_RESULT_SIZE - n, ctx,
+					  &bench_fns[f], size, total);
+			if (fatal_signal_pending(current)) {
+				ret = -EINTR;
+				goto out;
+			}
+		}
+	}
+	bb->len = n;
+out:
+	if (ctx->uaddr)
+		vm_munmap(ctx->uaddr, ctx->ulen);
+	if (dst)
+		__free_pages(dst, order);
+	if (src)
+		__free_pages(src, order);
+	kfree(ctx);
+	return ret;
+}
+
+static int bench_open(struct inode *inode, struct file *file)
+{
+	struct bench_buf *bb;
+	int ret;
+
+	bb = kzalloc(sizeof(*bb), GFP_KERNEL);
+	if (!bb)
+		return -ENOMEM;
+	bb->result = kvmalloc(BENCH_RESULT_SIZE, GFP_KERNEL);
+	if (!bb->result) {
+		kfree(bb);
+		return -ENOMEM;
+	}
+
+	mutex_lock(&bench_mutex);
+	ret = bench_run(bb);
+	mutex_unlock(&bench_mutex);
+	if (ret) {
+		kvfree(bb->result);
+		kfree(bb);
+		return ret;
+	}
+
+	file->private_data = bb;
+	return 0;
+}
+
+static ssize_t bench_read(struct file *file, char __user *ubuf,
+			  size_t count, loff_t *ppos)
+{
+	struct bench_buf *bb = file->private_data;
+
+	return simple_read_from_buffer(ubuf, count, ppos, bb->result, bb->len);
+}
+
+static int bench_release(struct inode *inode, struct file *file)
+{
+	struct bench_buf *bb = file->private_data;
+
+	kvfree(bb->result);
+	kfree(bb);
+	return 0;
+}
+
+static const struct file_operations bench_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bench_open,
+	.read		= bench_read,
+	.release	= bench_release,
+	.llseek		= default_llseek,
+};
+
+static struct dentry *bench_dentry;
+
+static int __init copy_user_benchmark_init(void)
+{
+	bench_dentry = debugfs_create_file("copy_user_benchmark", 0400, NULL,
+					   NULL, &bench_fops);
+	if (!bench_dentry)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void __exit copy_user_benchmark_exit(void)
+{
+	debugfs_remove(bench_dentry);
+}
+
+module_init(copy_user_benchmark_init);
+module_exit(copy_user_benchmark_exit);
+
+MODULE_LICENSE("GPL v2");
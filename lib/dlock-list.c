@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Distributed and locked lists, see include/linux/dlock-list.h.
+ */
+#include <linux/dlock-list.h>
+#include <linux/export.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+
+/**
+ * __alloc_dlock_list_heads - allocate and initialize the lists of a dlock list
+ * @dlist: the dlock list to set up
+ * @key:   lock class for the list locks
+ *
+ * Returns 0 or -ENOMEM.
+ */
+int __alloc_dlock_list_heads(struct dlock_list_heads *dlist,
+			     struct lock_class_key *key)
+{
+	int idx;
+
+	dlist->heads = kcalloc(nr_cpu_ids, sizeof(struct dlock_list_head),
+			       GFP_KERNEL);
+	if (!dlist->heads)
+		return -ENOMEM;
+
+	for (idx = 0; idx < nr_cpu_ids; idx++) {
+		struct dlock_list_head *head = &dlist->heads[idx];
+
+		INIT_LIST_HEAD(&head->list);
+		spin_lock_init(&head->lock);
+		lockdep_set_class(&head->lock, key);
+	}
+	return 0;
+}
+EXPORT_SYMBOL(__alloc_dlock_list_heads);
+
+void free_dlock_list_heads(struct dlock_list_heads *dlist)
+{
+	kfree(dlist->heads);
+	dlist->heads = NULL;
+}
+EXPORT_SYMBOL(free_dlock_list_heads);
+
+/*
+ * Check if all the lists are empty, without taking the locks: the answer
+ * is only stable if nobody can add entries anymore.
+ */
+bool dlock_lists_empty(struct dlock_list_heads *dlist)
+{
+	int idx;
+
+	for (idx = 0; idx < nr_cpu_ids; idx++)
+		if (!list_empty(&dlist->heads[idx].list))
+			return false;
+	return true;
+}
+EXPORT_SYMBOL(dlock_lists_empty);
+
+/* Add @node to the list of the current CPU */
+void dlock_lists_add(struct dlock_list_node *node,
+		     struct dlock_list_heads *dlist)
+{
+	struct dlock_list_head *head = &dlist->heads[raw_smp_processor_id()];
+
+	spin_lock(&head->lock);
+	node->head = head;
+	list_add(&node->list, &head->list);
+	spin_unlock(&head->lock);
+}
+EXPORT_SYMBOL(dlock_lists_add);
+
+/*
+ * Delete @node from the list it was added to.  The caller serializes
+ * adding and deleting a given node.
+ */
+void dlock_lists_del(struct dlock_list_node *node)
+{
+	struct dlock_list_head *head = node->head;
+
+	if (WARN_ON_ONCE(!head))
+		return;
+
+	spin_lock(&head->lock);
+	list_del_init(&node->list);
+	node->head = NULL;
+	spin_unlock(&head->lock);
+}
+EXPORT_SYMBOL(dlock_lists_del);
+
+/*
+ * Drop the lock of the current list and lock the next one that has
+ * entries, returning its first entry.  Returns NULL when all the lists
+ * have been walked.
+ */
+struct dlock_list_node *__dlock_list_next_list(struct dlock_list_iter *iter)
+{
+	struct dlock_list_head *head;
+
+	if (iter->entry) {
+		spin_unlock(&iter->entry->lock);
+		iter->entry = NULL;
+	}
+
+	while (++iter->index < nr_cpu_ids) {
+		head = &iter->head[iter->index];
+
+		/* Peek first to skip the empty lists without their locks */
+		if (list_empty(&head->list))
+			continue;
+
+		spin_lock(&head->lock);
+		if (list_empty(&head->list)) {
+			spin_unlock(&head->lock);
+			continue;
+		}
+		iter->entry = head;
+		return list_first_entry(&head->list, struct dlock_list_node,
+					list);
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(__dlock_list_next_list);
@@ -555,6 +555,48 @@ static size_t copy_pipe_to_iter(const void *addr, size_t bytes,
 	return bytes;
 }
 
+/*
+ * Small copies, such as network headers, mostly fit into the current
+ * segment of a user iovec or bvec.  Those are done without the generic
+ * segment walk of iterate_and_advance(); the helpers below tell whether a
+ * copy qualifies and advance the iterator after it, the same way
+ * iterate_and_advance() would.
+ */
+static __always_inline bool iov_iter_in_seg(const struct iov_iter *i,
+					    size_t bytes)
+{
+	size_t len;
+
+	if (unlikely(bytes > i->count || !bytes))
+		return false;
+
+	if (iter_is_iovec(i))
+		len = i->iov->iov_len;
+	else if (i->type & ITER_BVEC)
+		len = i->bvec->bv_len;
+	else
+		return false;
+
+	return bytes <= len - i->iov_offset;
+}
+
+static __always_inline void iov_iter_advance_in_seg(struct iov_iter *i,
+						    size_t bytes)
+{
+	size_t len = iter_is_iovec(i) ? i->iov->iov_len : i->bvec->bv_len;
+
+	i->count -= bytes;
+	i->iov_offset += bytes;
+	if (i->iov_offset == len) {
+		if (iter_is_iovec(i))
+			i->iov++;
+		else
+			i->bvec++;
+		i->nr_segs--;
+		i->iov_offset = 0;
+	}
+}
+
 size_t _copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
 {
 	const char *from = addr;
@@ -562,6 +604,17 @@ size_t _copy_to_iter(const void *addr, size_t bytes, struct iov_iter *i)
 		return copy_pipe_to_iter(addr, bytes, i);
 	if (iter_is_iovec(i))
 		might_fault();
+	if (iov_iter_in_seg(i, bytes)) {
+		size_t off = i->iov_offset;
+
+		if (iter_is_iovec(i))
+			bytes -= copyout(i->iov->iov_base + off, addr, bytes);
+		else
+			memcpy_to_page(i->bvec->bv_page,
+				       i->bvec->bv_offset + off, addr, bytes);
+		iov_iter_advance_in_seg(i, bytes);
+		return bytes;
+	}
 	iterate_and_advance(i, bytes, v,
 		copyout(v.iov_base, (from += v.iov_len) - v.iov_len, v.iov_len),
 		memcpy_to_page(v.bv_page, v.bv_offset,
@@ -643,6 +696,17 @@ size_t _copy_from_iter(void *addr, size_t bytes, struct iov_iter *i)
 	}
 	if (iter_is_iovec(i))
 		might_fault();
+	if (iov_iter_in_seg(i, bytes)) {
+		size_t off = i->iov_offset;
+
+		if (iter_is_iovec(i))
+			bytes -= copyin(addr, i->iov->iov_base + off, bytes);
+		else
+			memcpy_from_page(addr, i->bvec->bv_page,
+					 i->bvec->bv_offset + off, bytes);
+		iov_iter_advance_in_seg(i, bytes);
+		return bytes;
+	}
 	iterate_and_advance(i, bytes, v,
 		copyin((to += v.iov_len) - v.iov_len, v.iov_base, v.iov_len),
 		memcpy_from_page((to += v.bv_len) - v.bv_len, v.bv_page,
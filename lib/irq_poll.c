@@ -22,7 +22,8 @@ static DEFINE_PER_CPU(struct list_head, blk_cpu_iopoll);
  *
  * Description:
  *     Add this irq_poll structure to the pending poll list and trigger the
- *     raise of the blk iopoll softirq.
+ *     raise of the blk iopoll softirq. If @iop was set up with
+ *     irq_poll_init_irq(), its interrupt is disabled until polling ends.
  **/
 void irq_poll_sched(struct irq_poll *iop)
 {
@@ -33,6 +34,13 @@ void irq_poll_sched(struct irq_poll *iop)
 	if (test_and_set_bit(IRQ_POLL_F_SCHED, &iop->state))
 		return;
 
+	/*
+	 * The disable is lazy, an interrupt raised while polling is only
+	 * masked then and replayed by enable_irq(), so nothing is lost.
+	 */
+	if (test_bit(IRQ_POLL_F_IRQ, &iop->state))
+		disable_irq_nosync(iop->irq);
+
 	local_irq_save(flags);
 	list_add_tail(&iop->list, this_cpu_ptr(&blk_cpu_iopoll));
 	__raise_softirq_irqoff(IRQ_POLL_SOFTIRQ);
@@ -53,6 +61,10 @@ static void __irq_poll_complete(struct irq_poll *iop)
 	list_del(&iop->list);
 	smp_mb__before_atomic();
 	clear_bit_unlock(IRQ_POLL_F_SCHED, &iop->state);
+
+	/* Only now, an interrupt must be able to schedule us again */
+	if (test_bit(IRQ_POLL_F_IRQ, &iop->state))
+		enable_irq(iop->irq);
 }
 
 /**
@@ -185,6 +197,42 @@ void irq_poll_init(struct irq_poll *iop, int weight, irq_poll_fn *poll_fn)
 }
 EXPORT_SYMBOL(irq_poll_init);
 
+/**
+ * irq_poll_init_irq - Initialize this @iop for interrupt driven polling
+ * @iop:      The parent iopoll structure
+ * @weight:   The default weight (or command completion budget)
+ * @poll_fn:  The handler to invoke
+ * @irq:      The interrupt which schedules @iop
+ *
+ * Description:
+ *     Like irq_poll_init(), but @irq is disabled from irq_poll_sched() until
+ *     irq_poll_complete(), so that the hard interrupt handler only has to
+ *     schedule @iop and all completions are processed by @poll_fn within
+ *     its budget, like NAPI does for network devices. Passing
+ *     irq_poll_irq_handler() and @iop to request_irq() is enough for
+ *     devices whose interrupt is not shared.
+ **/
+void irq_poll_init_irq(struct irq_poll *iop, int weight,
+		       irq_poll_fn *poll_fn, unsigned int irq)
+{
+	irq_poll_init(iop, weight, poll_fn);
+	iop->irq = irq;
+	set_bit(IRQ_POLL_F_IRQ, &iop->state);
+}
+EXPORT_SYMBOL(irq_poll_init_irq);
+
+/**
+ * irq_poll_irq_handler - Hard interrupt handler for interrupt driven polling
+ * @irq:      The interrupt number
+ * @data:     The irq_poll structure set up with irq_poll_init_irq()
+ **/
+irqreturn_t irq_poll_irq_handler(int irq, void *data)
+{
+	irq_poll_sched(data);
+	return IRQ_HANDLED;
+}
+EXPORT_SYMBOL(irq_poll_irq_handler);
+
 static int irq_poll_cpu_dead(unsigned int cpu)
 {
 	/*
@@ -1459,6 +1459,83 @@ void radix_tree_iter_tag_set(struct radix_tree_root *root,
 	node_tag_set(root, iter->node, tag, iter_offset(iter));
 }
 
+/**
+ * radix_tree_range_tag_if_tagged - for each item in given range set given
+ *				    tag if item has another tag set
+ * @root:		radix tree root
+ * @first_indexp:	pointer to a starting index of a range to scan
+ * @last_index:		last index of a range to scan
+ * @nr_to_tag:		maximum number items to tag
+ * @iftag:		tag index to test
+ * @settag:		tag index to set if tested tag is set
+ *
+ * This function scans range of radix tree from first_index to last_index
+ * (inclusive).  For each item in the range if iftag is set, the function sets
+ * also settag.  The function stops either after tagging nr_to_tag items or
+ * after reaching last_index.
+ *
+ * The tagged items are found a chunk of slots at a time, and the tag is
+ * propagated towards the root once per chunk rather than once per item.
+ *
+ * The function returns the number of items tagged and updates
+ * *first_indexp to the index following the last scanned one.  The caller
+ * must hold the lock of the tree.
+ */
+unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
+		unsigned long *first_indexp, unsigned long last_index,
+		unsigned long nr_to_tag, unsigned int iftag,
+		unsigned int settag)
+{
+	unsigned long tagged = 0, index, next = last_index + 1;
+	struct radix_tree_iter iter;
+	void __rcu **slot;
+
+	if (!nr_to_tag)
+		return 0;
+
+	radix_tree_iter_init(&iter, *first_indexp);
+	while ((slot = radix_tree_next_chunk(root, &iter,
+				RADIX_TREE_ITER_TAGGED | iftag))) {
+		struct radix_tree_node *node = iter.node;
+		unsigned int offset = iter_offset(&iter);
+		unsigned int shift = iter_shift(&iter);
+		unsigned long tags = iter.tags;
+		bool propagated = false;
+
+		while (tags) {
+			unsigned int bit = __ffs(tags);
+
+			index = iter.index + ((unsigned long)bit << shift);
+			if (index > last_index) {
+				next = last_index + 1;
+				goto out;
+			}
+
+			if (propagated) {
+				tag_set(node, settag, offset + bit);
+			} else {
+				node_tag_set(root, node, settag, offset + bit);
+				propagated = true;
+			}
+
+			next = index + (1UL << shift);
+			if (++tagged >= nr_to_tag)
+				goto out;
+			tags &= tags - 1;
+		}
+
+		next = iter.next_index;
+		if (!next || next > last_index) {
+			next = last_index + 1;
+			break;
+		}
+	}
+out:
+	*first_indexp = next;
+	return tagged;
+}
+EXPORT_SYMBOL(radix_tree_range_tag_if_tagged);
+
 static void node_tag_clear(struct radix_tree_root *root,
 				struct radix_tree_node *node,
 				unsigned int tag, unsigned int offset)
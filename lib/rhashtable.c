@@ -339,6 +339,13 @@ static int rhashtable_rehash_table(struct rhashtable *ht)
 	/* Publish the new table pointer. */
 	rcu_assign_pointer(ht->tbl, new_tbl);
 
+	if (new_tbl->size > old_tbl->size)
+		ht->nr_grows++;
+	else if (new_tbl->size < old_tbl->size)
+		ht->nr_shrinks++;
+	else
+		ht->nr_rehashes++;
+
 	spin_lock(&ht->lock);
 	list_for_each_entry(walker, &old_tbl->walkers, list)
 		walker->tbl = NULL;
@@ -425,9 +432,12 @@ static void rht_deferred_worker(struct work_struct *work)
 		err = rhashtable_rehash_alloc(ht, tbl, tbl->size * 2);
 	else if (ht->p.automatic_shrinking && rht_shrink_below_30(ht, tbl))
 		err = rhashtable_shrink(ht);
-	else if (tbl->nest)
+	else if (tbl->nest || READ_ONCE(ht->rehash_pending))
 		err = rhashtable_rehash_alloc(ht, tbl, tbl->size);
 
+	if (!err)
+		WRITE_ONCE(ht->rehash_pending, false);
+
 	if (!err)
 		err = rhashtable_rehash_table(ht);
 
@@ -552,8 +562,22 @@ static struct bucket_table *rhashtable_insert_one(struct rhashtable *ht,
 	if (new_tbl)
 		return new_tbl;
 
-	if (PTR_ERR(data) != -ENOENT)
-		return ERR_CAST(data);
+	if (PTR_ERR(data) != -ENOENT) {
+		/*
+		 * The chain is too long, but @tbl is still being filled by a
+		 * rehash and rhashtable_insert_rehash() would have to fail
+		 * with -EBUSY.  Take the insert and have the worker rehash
+		 * @tbl again once the current rehash is done.
+		 */
+		if (tbl == rht_dereference_rcu(ht->tbl, ht) ||
+		    rht_grow_above_75(ht, tbl))
+			return ERR_CAST(data);
+
+		if (!READ_ONCE(ht->rehash_pending)) {
+			WRITE_ONCE(ht->rehash_pending, true);
+			schedule_work(&ht->run_work);
+		}
+	}
 
 	if (unlikely(rht_grow_above_max(ht, tbl)))
 		return ERR_PTR(-E2BIG);
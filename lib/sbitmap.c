@@ -64,11 +64,31 @@ int sbitmap_init_node(struct sbitmap *sb, unsigned int depth, int shift,
 }
 EXPORT_SYMBOL_GPL(sbitmap_init_node);
 
+/*
+ * Move the bits freed into @map->cleared over to @map->word.  Returns
+ * whether there were any.
+ */
+static bool sbitmap_deferred_clear(struct sbitmap_word *map)
+{
+	unsigned long mask;
+
+	if (!READ_ONCE(map->cleared))
+		return false;
+
+	mask = xchg(&map->cleared, 0);
+	BUILD_BUG_ON(sizeof(atomic_long_t) != sizeof(map->word));
+	atomic_long_andnot(mask, (atomic_long_t *)&map->word);
+	return true;
+}
+
 void sbitmap_resize(struct sbitmap *sb, unsigned int depth)
 {
 	unsigned int bits_per_word = 1U << sb->shift;
 	unsigned int i;
 
+	for (i = 0; i < sb->map_nr; i++)
+		sbitmap_deferred_clear(&sb->map[i]);
+
 	sb->depth = depth;
 	sb->map_nr = DIV_ROUND_UP(sb->depth, bits_per_word);
 
@@ -111,6 +131,26 @@ static int __sbitmap_get_word(unsigned long *word, unsigned long depth,
 	return nr;
 }
 
+/*
+ * Allocate a bit from the word at @index, taking back the bits freed into
+ * its cleared mask if the word is full.
+ */
+static int sbitmap_find_bit_in_index(struct sbitmap *sb, int index,
+				     unsigned int depth,
+				     unsigned int alloc_hint, bool wrap)
+{
+	struct sbitmap_word *map = &sb->map[index];
+	int nr;
+
+	do {
+		nr = __sbitmap_get_word(&map->word, depth, alloc_hint, wrap);
+		if (nr != -1)
+			break;
+	} while (sbitmap_deferred_clear(map));
+
+	return nr;
+}
+
 int sbitmap_get(struct sbitmap *sb, unsigned int alloc_hint, bool round_robin)
 {
 	unsigned int i, index;
@@ -119,10 +159,9 @@ int sbitmap_get(struct sbitmap *sb, unsigned int alloc_hint, bool round_robin)
 	index = SB_NR_TO_INDEX(sb, alloc_hint);
 
 	for (i = 0; i < sb->map_nr; i++) {
-		nr = __sbitmap_get_word(&sb->map[index].word,
-					sb->map[index].depth,
-					SB_NR_TO_BIT(sb, alloc_hint),
-					!round_robin);
+		nr = sbitmap_find_bit_in_index(sb, index, sb->map[index].depth,
+					       SB_NR_TO_BIT(sb, alloc_hint),
+					       !round_robin);
 		if (nr != -1) {
 			nr += index << sb->shift;
 			break;
@@ -151,9 +190,9 @@ int sbitmap_get_shallow(struct sbitmap *sb, unsigned int alloc_hint,
 	index = SB_NR_TO_INDEX(sb, alloc_hint);
 
 	for (i = 0; i < sb->map_nr; i++) {
-		nr = __sbitmap_get_word(&sb->map[index].word,
-					min(sb->map[index].depth, shallow_depth),
-					SB_NR_TO_BIT(sb, alloc_hint), true);
+		nr = sbitmap_find_bit_in_index(sb, index,
+				min(sb->map[index].depth, shallow_depth),
+				SB_NR_TO_BIT(sb, alloc_hint), true);
 		if (nr != -1) {
 			nr += index << sb->shift;
 			break;
@@ -178,7 +217,7 @@ bool sbitmap_any_bit_set(const struct sbitmap *sb)
 	unsigned int i;
 
 	for (i = 0; i < sb->map_nr; i++) {
-		if (sb->map[i].word)
+		if (sb->map[i].word & ~sb->map[i].cleared)
 			return true;
 	}
 	return false;
@@ -191,9 +230,10 @@ bool sbitmap_any_bit_clear(const struct sbitmap *sb)
 
 	for (i = 0; i < sb->map_nr; i++) {
 		const struct sbitmap_word *word = &sb->map[i];
+		unsigned long val = word->word & ~word->cleared;
 		unsigned long ret;
 
-		ret = find_first_zero_bit(&word->word, word->depth);
+		ret = find_first_zero_bit(&val, word->depth);
 		if (ret < word->depth)
 			return true;
 	}
@@ -207,8 +247,9 @@ unsigned int sbitmap_weight(const struct sbitmap *sb)
 
 	for (i = 0; i < sb->map_nr; i++) {
 		const struct sbitmap_word *word = &sb->map[i];
+		unsigned long val = word->word & ~word->cleared;
 
-		weight += bitmap_weight(&word->word, word->depth);
+		weight += bitmap_weight(&val, word->depth);
 	}
 	return weight;
 }
@@ -243,7 +284,8 @@ void sbitmap_bitmap_show(struct sbitmap *sb, struct seq_file *m)
 	int i;
 
 	for (i = 0; i < sb->map_nr; i++) {
-		unsigned long word = READ_ONCE(sb->map[i].word);
+		unsigned long word = READ_ONCE(sb->map[i].word) &
+				     ~READ_ONCE(sb->map[i].cleared);
 		unsigned int word_bits = READ_ONCE(sb->map[i].depth);
 
 		while (word_bits > 0) {
@@ -427,6 +469,59 @@ int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get_shallow);
 
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth, index;
+	int i;
+
+	if (unlikely(sbq->round_robin))
+		return 0;
+
+	depth = READ_ONCE(sb->depth);
+	hint = this_cpu_read(*sbq->alloc_hint);
+	if (unlikely(hint >= depth))
+		hint = 0;
+	index = SB_NR_TO_INDEX(sb, hint);
+
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long mask, val, old;
+		unsigned int nr;
+
+		nr = find_first_zero_bit(&map->word, map->depth);
+		if (nr + nr_tags > map->depth && sbitmap_deferred_clear(map))
+			nr = find_first_zero_bit(&map->word, map->depth);
+		if (nr + nr_tags <= map->depth) {
+			mask = GENMASK(nr + nr_tags - 1, nr);
+			val = READ_ONCE(map->word);
+			do {
+				old = val;
+				val = cmpxchg(&map->word, old, old | mask);
+			} while (val != old);
+
+			/* Whatever was set meanwhile belongs to someone else */
+			mask &= ~old;
+			if (mask) {
+				*offset = index << sb->shift;
+				hint = *offset + __fls(mask) + 1;
+				if (hint >= depth - 1)
+					hint = 0;
+				this_cpu_write(*sbq->alloc_hint, hint);
+				return mask;
+			}
+		}
+
+		/* Jump to next index. */
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 				     unsigned int min_shallow_depth)
 {
@@ -457,7 +552,12 @@ static struct sbq_wait_state *sbq_wake_ptr(struct sbitmap_queue *sbq)
 	return NULL;
 }
 
-static bool __sbq_wake_up(struct sbitmap_queue *sbq)
+/*
+ * Account @nr freed bits against the wait queues.  Every wake_batch bits
+ * wake up a batch of waiters on the next active queue; what is left over
+ * of @nr after that is carried over to the following queue.
+ */
+static bool __sbq_wake_up(struct sbitmap_queue *sbq, unsigned int *nr)
 {
 	struct sbq_wait_state *ws;
 	unsigned int wake_batch;
@@ -465,10 +565,10 @@ static bool __sbq_wake_up(struct sbitmap_queue *sbq)
 
 	/*
 	 * Pairs with the memory barrier in set_current_state() to ensure the
-	 * proper ordering of clear_bit()/waitqueue_active() in the waker and
-	 * test_and_set_bit_lock()/prepare_to_wait()/finish_wait() in the
+	 * proper ordering of freeing the bit/waitqueue_active() in the waker
+	 * and test_and_set_bit_lock()/prepare_to_wait()/finish_wait() in the
 	 * waiter. See the comment on waitqueue_active(). This is __after_atomic
-	 * because we just did clear_bit_unlock() in the caller.
+	 * because the caller just freed the bit with an atomic operation.
 	 */
 	smp_mb__after_atomic();
 
@@ -476,7 +576,7 @@ static bool __sbq_wake_up(struct sbitmap_queue *sbq)
 	if (!ws)
 		return false;
 
-	wait_cnt = atomic_dec_return(&ws->wait_cnt);
+	wait_cnt = atomic_sub_return(*nr, &ws->wait_cnt);
 	if (wait_cnt <= 0) {
 		int ret;
 
@@ -498,7 +598,8 @@ static bool __sbq_wake_up(struct sbitmap_queue *sbq)
 		if (ret == wait_cnt) {
 			sbq_index_atomic_inc(&sbq->wake_index);
 			wake_up_nr(&ws->wait, wake_batch);
-			return false;
+			*nr = -wait_cnt;
+			return *nr != 0;
 		}
 
 		return true;
@@ -507,22 +608,45 @@ static bool __sbq_wake_up(struct sbitmap_queue *sbq)
 	return false;
 }
 
-static void sbq_wake_up(struct sbitmap_queue *sbq)
+static void sbq_wake_up(struct sbitmap_queue *sbq, unsigned int nr)
 {
-	while (__sbq_wake_up(sbq))
+	while (__sbq_wake_up(sbq, &nr))
 		;
 }
 
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu)
 {
-	sbitmap_clear_bit_unlock(&sbq->sb, nr);
-	sbq_wake_up(sbq);
+	/*
+	 * Order the accesses to whatever the bit protects before the bit
+	 * can be allocated again, like the release in clear_bit_unlock().
+	 */
+	smp_mb__before_atomic();
+	sbitmap_deferred_clear_bit(&sbq->sb, nr);
+	sbq_wake_up(sbq, 1);
 	if (likely(!sbq->round_robin && nr < sbq->sb.depth))
 		*per_cpu_ptr(sbq->alloc_hint, cpu) = nr;
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, unsigned int offset,
+			       unsigned long mask, unsigned int cpu)
+{
+	struct sbitmap_word *map = &sbq->sb.map[SB_NR_TO_INDEX(&sbq->sb,
+								offset)];
+
+	if (!mask)
+		return;
+
+	/* See sbitmap_queue_clear() */
+	smp_mb__before_atomic();
+	atomic_long_or(mask, (atomic_long_t *)&map->cleared);
+	sbq_wake_up(sbq, hweight_long(mask));
+	if (likely(!sbq->round_robin && offset < sbq->sb.depth))
+		*per_cpu_ptr(sbq->alloc_hint, cpu) = offset + __ffs(mask);
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
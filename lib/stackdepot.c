@@ -70,6 +70,7 @@ struct stack_record {
 	u32 hash;			/* Hash in the hastable */
 	u32 size;			/* Number of frames in the stack */
 	union handle_parts handle;
+	atomic_long_t count;		/* See depot_stack_count_add() */
 	unsigned long entries[1];	/* Variable-sized array of entries. */
 };
 
@@ -140,6 +141,7 @@ static struct stack_record *depot_alloc_stack(unsigned long *entries, int size,
 	stack->handle.slabindex = depot_index;
 	stack->handle.offset = depot_offset >> STACK_ALLOC_ALIGN;
 	stack->handle.valid = 1;
+	atomic_long_set(&stack->count, 0);
 	memcpy(stack->entries, entries, size * sizeof(unsigned long));
 	depot_offset += required_size;
 
@@ -155,6 +157,16 @@ static struct stack_record *stack_table[STACK_HASH_SIZE] = {
 	[0 ...	STACK_HASH_SIZE - 1] = NULL
 };
 
+/*
+ * The stacks last looked up on each CPU, so that saving one of the stacks
+ * an allocator keeps coming back to doesn't miss the cache on the huge
+ * stack_table.  Only a hint: records are never freed or changed, so it
+ * doesn't matter when a preempted or interrupted lookup updates the slot
+ * of another CPU, or another stack's.
+ */
+#define STACK_CACHE_SIZE 64
+static DEFINE_PER_CPU(struct stack_record *, stack_cache[STACK_CACHE_SIZE]);
+
 /* Calculate hash for a stack */
 static inline u32 hash_stack(unsigned long *entries, unsigned int size)
 {
@@ -194,12 +206,18 @@ static inline struct stack_record *find_stack(struct stack_record *bucket,
 	return NULL;
 }
 
-void depot_fetch_stack(depot_stack_handle_t handle, struct stack_trace *trace)
+static struct stack_record *depot_lookup(depot_stack_handle_t handle)
 {
 	union handle_parts parts = { .handle = handle };
 	void *slab = stack_slabs[parts.slabindex];
 	size_t offset = parts.offset << STACK_ALLOC_ALIGN;
-	struct stack_record *stack = slab + offset;
+
+	return slab + offset;
+}
+
+void depot_fetch_stack(depot_stack_handle_t handle, struct stack_trace *trace)
+{
+	struct stack_record *stack = depot_lookup(handle);
 
 	trace->nr_entries = trace->max_entries = stack->size;
 	trace->entries = stack->entries;
@@ -207,6 +225,54 @@ void depot_fetch_stack(depot_stack_handle_t handle, struct stack_trace *trace)
 }
 EXPORT_SYMBOL_GPL(depot_fetch_stack);
 
+/**
+ * depot_stack_count_add - add to the count kept with a stack
+ * @handle - the stack, as returned by depot_save_stack().
+ * @nr - the amount to add, negative to subtract.
+ *
+ * Each stack carries a count for the user of the depot to keep track of
+ * what it attributes to the stack, e.g. how many pages were allocated
+ * from there and are still in use.
+ */
+void depot_stack_count_add(depot_stack_handle_t handle, long nr)
+{
+	if (handle)
+		atomic_long_add(nr, &depot_lookup(handle)->count);
+}
+EXPORT_SYMBOL_GPL(depot_stack_count_add);
+
+/**
+ * depot_next_stack - step through all the stacks in the depot
+ * @pos - the cursor, 0 to start from the beginning.
+ * @count - where to return the count of the stack.
+ *
+ * Returns the handle of the next stack and advances @pos past it, or 0
+ * once all of them have been seen.  Stacks saved while walking the depot
+ * may be missed, and may cause the walk to return a stack twice.
+ */
+depot_stack_handle_t depot_next_stack(loff_t *pos, long *count)
+{
+	unsigned long idx = *pos >> 16, nr = *pos & 0xffff;
+	struct stack_record *found;
+	unsigned long i;
+
+	for (; idx < STACK_HASH_SIZE; idx++, nr = 0) {
+		found = smp_load_acquire(&stack_table[idx]);
+		for (i = 0; found && i < nr; i++)
+			found = found->next;
+
+		if (found && nr < 0xffff) {
+			*pos = (loff_t)idx << 16 | (nr + 1);
+			*count = atomic_long_read(&found->count);
+			return found->handle.handle;
+		}
+	}
+
+	*pos = (loff_t)idx << 16;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(depot_next_stack);
+
 /**
  * depot_save_stack - save stack in a stack depot.
  * @trace - the stacktrace to save.
@@ -219,7 +285,7 @@ depot_stack_handle_t depot_save_stack(struct stack_trace *trace,
 {
 	u32 hash;
 	depot_stack_handle_t retval = 0;
-	struct stack_record *found = NULL, **bucket;
+	struct stack_record *found = NULL, **bucket, **cache;
 	unsigned long flags;
 	struct page *page = NULL;
 	void *prealloc = NULL;
@@ -229,6 +295,14 @@ depot_stack_handle_t depot_save_stack(struct stack_trace *trace,
 
 	hash = hash_stack(trace->entries, trace->nr_entries);
 	bucket = &stack_table[hash & STACK_HASH_MASK];
+	cache = raw_cpu_ptr(&stack_cache[hash % STACK_CACHE_SIZE]);
+
+	/* Fastest path: this CPU saved the same stack a short while ago */
+	found = READ_ONCE(*cache);
+	if (found && found->hash == hash &&
+	    found->size == trace->nr_entries &&
+	    !stackdepot_memcmp(trace->entries, found->entries, found->size))
+		goto exit;
 
 	/*
 	 * Fast path: look the stack trace up without locking.
@@ -238,7 +312,7 @@ depot_stack_handle_t depot_save_stack(struct stack_trace *trace,
 	found = find_stack(smp_load_acquire(bucket), trace->entries,
 			   trace->nr_entries, hash);
 	if (found)
-		goto exit;
+		goto exit_cache;
 
 	/*
 	 * Check if the current or the next stack slab need to be initialized.
@@ -287,11 +361,14 @@ depot_stack_handle_t depot_save_stack(struct stack_trace *trace,
 	}
 
 	spin_unlock_irqrestore(&depot_lock, flags);
-exit:
 	if (prealloc) {
 		/* Nobody used this memory, ok to free it. */
 		free_pages((unsigned long)prealloc, STACK_ALLOC_ORDER);
 	}
+exit_cache:
+	if (found)
+		WRITE_ONCE(*cache, found);
+exit:
 	if (found)
 		retval = found->handle.handle;
 fast_exit:
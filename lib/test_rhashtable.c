@@ -77,6 +77,7 @@ struct thread_data {
 	int id;
 	struct task_struct *task;
 	struct test_obj *objs;
+	u64 insert_ns;
 };
 
 static u32 my_hashfn(const void *data, u32 len, u32 seed)
@@ -631,11 +632,13 @@ static int threadfunc(void *data)
 {
 	int i, step, err = 0, insert_retries = 0;
 	struct thread_data *tdata = data;
+	u64 start;
 
 	up(&prestart_sem);
 	if (down_interruptible(&startup_sem))
 		pr_err("  thread[%d]: down_interruptible failed\n", tdata->id);
 
+	start = ktime_get_ns();
 	for (i = 0; i < tdata->entries; i++) {
 		tdata->objs[i].value.id = i;
 		tdata->objs[i].value.tid = tdata->id;
@@ -648,6 +651,7 @@ static int threadfunc(void *data)
 			goto out;
 		}
 	}
+	tdata->insert_ns = ktime_get_ns() - start;
 	if (insert_retries)
 		pr_info("  thread[%d]: %u insertions retried due to memory pressure\n",
 			tdata->id, insert_retries);
@@ -689,6 +693,27 @@ static int threadfunc(void *data)
 	return err;
 }
 
+/*
+ * All threads insert concurrently, so the slowest one bounds the time it
+ * took to fill the table.
+ */
+static void test_rht_report_scaling(struct thread_data *tdata,
+				    unsigned int entries)
+{
+	u64 total = (u64)tcount * entries, ns = 0;
+	int i;
+
+	for (i = 0; i < tcount; i++) {
+		if (!IS_ERR(tdata[i].task))
+			ns = max(ns, tdata[i].insert_ns);
+	}
+
+	pr_info("  %llu concurrent insertions in %llu ns, %llu per second\n",
+		total, ns, ns ? div64_u64(total * NSEC_PER_SEC, ns) : 0);
+	pr_info("  table grown %u times, shrunk %u times, rehashed %u times\n",
+		ht.nr_grows, ht.nr_shrinks, ht.nr_rehashes);
+}
+
 static int __init test_rht_init(void)
 {
 	unsigned int entries;
@@ -796,6 +821,7 @@ static int __init test_rht_init(void)
 			failed_threads++;
 		}
 	}
+	test_rht_report_scaling(tdata, entries);
 	rhashtable_destroy(&ht);
 	vfree(tdata);
 	vfree(objs);
@@ -285,7 +285,8 @@ static int __init default_bdi_init(void)
 	int err;
 
 	bdi_wq = alloc_workqueue("writeback", WQ_MEM_RECLAIM | WQ_FREEZABLE |
-					      WQ_UNBOUND | WQ_SYSFS, 0);
+					      WQ_UNBOUND | WQ_CACHE_AFFINE |
+					      WQ_SYSFS, 0);
 	if (!bdi_wq)
 		return -ENOMEM;
 
@@ -36,6 +36,7 @@
 #include <linux/cleancache.h>
 #include <linux/shmem_fs.h>
 #include <linux/rmap.h>
+#include <linux/syscalls.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -233,8 +234,9 @@ static void unaccount_page_cache_page(struct address_space *mapping,
 		__mod_node_page_state(page_pgdat(page), NR_SHMEM, -nr);
 		if (PageTransHuge(page))
 			__dec_node_page_state(page, NR_SHMEM_THPS);
-	} else {
-		VM_BUG_ON_PAGE(PageTransHuge(page), page);
+	} else if (PageTransHuge(page)) {
+		__dec_node_page_state(page, NR_FILE_THPS);
+		filemap_nr_thps_dec(mapping);
 	}
 
 	/*
@@ -895,7 +897,11 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
-int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
+/*
+ * Like add_to_page_cache_lru(), but leaves putting the page on the LRU to
+ * the caller, which batches it with others through lru_cache_add_list().
+ */
+int add_to_page_cache_nolru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
 	void *shadow = NULL;
@@ -921,10 +927,21 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 			workingset_activation(page);
 		} else
 			ClearPageActive(page);
-		lru_cache_add(page);
 	}
 	return ret;
 }
+EXPORT_SYMBOL_GPL(add_to_page_cache_nolru);
+
+int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
+				pgoff_t offset, gfp_t gfp_mask)
+{
+	int ret;
+
+	ret = add_to_page_cache_nolru(page, mapping, offset, gfp_mask);
+	if (!ret)
+		lru_cache_add(page);
+	return ret;
+}
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
 #ifdef CONFIG_NUMA
@@ -977,35 +994,16 @@ void __init pagecache_init(void)
 	page_writeback_init();
 }
 
-/* This has the same layout as wait_bit_key - see fs/cachefiles/rdwr.c */
-struct wait_page_key {
-	struct page *page;
-	int bit_nr;
-	int page_match;
-};
-
-struct wait_page_queue {
-	struct page *page;
-	int bit_nr;
-	wait_queue_entry_t wait;
-};
-
 static int wake_page_function(wait_queue_entry_t *wait, unsigned mode, int sync, void *arg)
 {
 	struct wait_page_key *key = arg;
 	struct wait_page_queue *wait_page
 		= container_of(wait, struct wait_page_queue, wait);
+	int ret;
 
-	if (wait_page->page != key->page)
-	       return 0;
-	key->page_match = 1;
-
-	if (wait_page->bit_nr != key->bit_nr)
-		return 0;
-
-	/* Stop walking if it's locked */
-	if (test_bit(key->bit_nr, &key->page->flags))
-		return -1;
+	ret = wake_page_match(wait_page, key);
+	if (ret != 1)
+		return ret;
 
 	return autoremove_wake_function(wait, mode, sync, key);
 }
@@ -1282,6 +1280,55 @@ int __lock_page_killable(struct page *__page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/*
+ * Queue @wait on the page's waitqueue instead of sleeping.  @wait->wait
+ * must have its func and private set up by the caller; the func is called
+ * from the unlocking context and should use wake_page_match() to filter
+ * out wakeups of other pages hashed to the same queue.
+ */
+static int __wait_on_page_locked_async(struct page *page,
+				       struct wait_page_queue *wait, bool set)
+{
+	struct wait_queue_head *q = page_waitqueue(page);
+	int ret = 0;
+
+	wait->page = page;
+	wait->bit_nr = PG_locked;
+
+	spin_lock_irq(&q->lock);
+	__add_wait_queue_entry_tail(q, &wait->wait);
+	SetPageWaiters(page);
+	if (set)
+		ret = !trylock_page(page);
+	else
+		ret = PageLocked(page);
+	/*
+	 * If we were successful now, we know we're still on the
+	 * waitqueue as we're still under the lock. This means it's
+	 * safe to remove and return success, we know the callback
+	 * isn't going to trigger.
+	 */
+	if (!ret)
+		__remove_wait_queue(q, &wait->wait);
+	else
+		ret = -EIOCBQUEUED;
+	spin_unlock_irq(&q->lock);
+	return ret;
+}
+
+int __lock_page_async(struct page *page, struct wait_page_queue *wait)
+{
+	return __wait_on_page_locked_async(compound_head(page), wait, true);
+}
+
+int wait_on_page_locked_async(struct page *page, struct wait_page_queue *wait)
+{
+	if (!PageLocked(page))
+		return 0;
+	return __wait_on_page_locked_async(compound_head(page), wait, false);
+}
+EXPORT_SYMBOL_GPL(wait_on_page_locked_async);
+
 /*
  * Return values:
  * 1 - page is locked; mmap_sem is still held.
@@ -1555,12 +1602,12 @@ struct page *pagecache_get_page(struct address_space *mapping, pgoff_t offset,
 		}
 
 		/* Has the page been truncated? */
-		if (unlikely(page->mapping != mapping)) {
+		if (unlikely(compound_head(page)->mapping != mapping)) {
 			unlock_page(page);
 			put_page(page);
 			goto repeat;
 		}
-		VM_BUG_ON_PAGE(page->index != offset, page);
+		VM_BUG_ON_PAGE(page_to_pgoff(page) != offset, page);
 	}
 
 	if (page && (fgp_flags & FGP_ACCESSED))
@@ -2044,6 +2091,10 @@ static void shrink_readahead_size_eio(struct file *filp,
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
  *
+ * With IOCB_WAITQ set, instead of sleeping on a locked page this queues
+ * iocb->ki_waitq on it and returns -EIOCBQUEUED (or the bytes copied so
+ * far); the caller retries the read from the wait callback.
+ *
  * This is really ugly. But the goto's actually try to clarify some
  * of the logic when it comes to error handling etc.
  */
@@ -2112,7 +2163,16 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			 * wait_on_page_locked is used to avoid unnecessarily
 			 * serialisations and why it's safe.
 			 */
-			error = wait_on_page_locked_killable(page);
+			if (iocb->ki_flags & IOCB_WAITQ) {
+				if (written) {
+					put_page(page);
+					goto out;
+				}
+				error = wait_on_page_locked_async(page,
+								iocb->ki_waitq);
+			} else {
+				error = wait_on_page_locked_killable(page);
+			}
 			if (unlikely(error))
 				goto readpage_error;
 			if (PageUptodate(page))
@@ -2200,7 +2260,15 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		if (iocb->ki_flags & IOCB_WAITQ) {
+			if (written) {
+				put_page(page);
+				goto out;
+			}
+			error = lock_page_async(page, iocb->ki_waitq);
+		} else {
+			error = lock_page_killable(page);
+		}
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -2238,7 +2306,15 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			if (iocb->ki_flags & IOCB_WAITQ) {
+				if (written) {
+					put_page(page);
+					goto out;
+				}
+				error = lock_page_async(page, iocb->ki_waitq);
+			} else {
+				error = lock_page_killable(page);
+			}
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -2415,6 +2491,22 @@ static void do_sync_mmap_readahead(struct vm_area_struct *vma,
 	/* If we don't want any read-ahead, don't bother */
 	if (vma->vm_flags & VM_RAND_READ)
 		return;
+
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	/*
+	 * Read the whole huge page sized and aligned chunk of the file
+	 * around the fault for MADV_HUGEPAGE mappings, even if readahead
+	 * is disabled, so that the range can be mapped by a huge page.
+	 */
+	if ((vma->vm_flags & VM_HUGEPAGE) && !(vma->vm_flags & VM_WRITE)) {
+		ra->start = round_down(offset, HPAGE_PMD_NR);
+		ra->size = HPAGE_PMD_NR;
+		ra->async_size = ra->ra_pages ? HPAGE_PMD_NR / 4 : 0;
+		ra_submit(ra, mapping, file);
+		return;
+	}
+#endif
+
 	if (!ra->ra_pages)
 		return;
 
@@ -2533,12 +2625,12 @@ vm_fault_t filemap_fault(struct vm_fault *vmf)
 	}
 
 	/* Did it get truncated? */
-	if (unlikely(page->mapping != mapping)) {
+	if (unlikely(compound_head(page)->mapping != mapping)) {
 		unlock_page(page);
 		put_page(page);
 		goto retry_find;
 	}
-	VM_BUG_ON_PAGE(page->index != offset, page);
+	VM_BUG_ON_PAGE(page_to_pgoff(page) != offset, page);
 
 	/*
 	 * We have a locked page in the page cache, now we need to check
@@ -2660,11 +2752,12 @@ void filemap_map_pages(struct vm_fault *vmf,
 		if (!trylock_page(page))
 			goto skip;
 
-		if (page->mapping != mapping || !PageUptodate(page))
+		if (compound_head(page)->mapping != mapping ||
+		    !PageUptodate(page))
 			goto unlock;
 
 		max_idx = DIV_ROUND_UP(i_size_read(mapping->host), PAGE_SIZE);
-		if (page->index >= max_idx)
+		if (page_to_pgoff(page) >= max_idx)
 			goto unlock;
 
 		if (file->f_ra.mmap_miss > 0)
@@ -3329,3 +3422,213 @@ int try_to_release_page(struct page *page, gfp_t gfp_mask)
 }
 
 EXPORT_SYMBOL(try_to_release_page);
+
+static unsigned long filemap_count_tagged(struct address_space *mapping,
+		pgoff_t first, pgoff_t last, int tag)
+{
+	struct radix_tree_iter iter;
+	unsigned long nr = 0;
+	void **slot;
+
+	radix_tree_for_each_tagged(slot, &mapping->i_pages, &iter, first, tag) {
+		if (iter.index > last)
+			break;
+		nr++;
+
+		if (need_resched()) {
+			slot = radix_tree_iter_resume(slot, &iter);
+			cond_resched_rcu();
+		}
+	}
+
+	return nr;
+}
+
+/*
+ * Count the cached, dirty, under writeback and recently referenced pages
+ * of @mapping in [@first, @last], plus the evicted ones the page cache
+ * still keeps a shadow (or, for shmem, a swap) entry for.
+ *
+ * The walk is lockless and takes no page references: the counts are a
+ * snapshot that can be stale by the time they reach userspace.  For a
+ * whole file, nrpages and the dirty and writeback tags give everything
+ * but the referenced and evicted counts without visiting each page.
+ */
+static void filemap_cachestat(struct address_space *mapping, pgoff_t first,
+		pgoff_t last, unsigned int flags, struct cachestat *cs)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+
+	memset(cs, 0, sizeof(*cs));
+
+	rcu_read_lock();
+	if (first == 0 && last == ULONG_MAX && !(flags & CACHESTAT_PAGES)) {
+		cs->nr_cache = READ_ONCE(mapping->nrpages);
+		goto tagged;
+	}
+
+	radix_tree_for_each_slot(slot, &mapping->i_pages, &iter, first) {
+		struct page *page;
+
+		if (iter.index > last)
+			break;
+
+		page = radix_tree_deref_slot(slot);
+		if (unlikely(!page))
+			continue;
+
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page)) {
+				slot = radix_tree_iter_retry(&iter);
+				continue;
+			}
+			cs->nr_evicted++;
+			continue;
+		}
+
+		cs->nr_cache++;
+		if (PageReferenced(page) || PageActive(page))
+			cs->nr_referenced++;
+
+		if (need_resched()) {
+			slot = radix_tree_iter_resume(slot, &iter);
+			cond_resched_rcu();
+		}
+	}
+
+tagged:
+	cs->nr_dirty = filemap_count_tagged(mapping, first, last,
+					    PAGECACHE_TAG_DIRTY);
+	cs->nr_writeback = filemap_count_tagged(mapping, first, last,
+						PAGECACHE_TAG_WRITEBACK);
+	rcu_read_unlock();
+}
+
+/*
+ * The cachestat() system call: page cache statistics of a range of an
+ * open file, without mmap()ing it for mincore().
+ */
+SYSCALL_DEFINE4(cachestat, unsigned int, fd,
+		struct cachestat_range __user *, urange,
+		struct cachestat __user *, cstat, unsigned int, flags)
+{
+	struct cachestat_range range;
+	struct cachestat cs;
+	pgoff_t first, last;
+	struct fd f;
+	int ret = 0;
+
+	if (flags & ~CACHESTAT_PAGES)
+		return -EINVAL;
+
+	if (copy_from_user(&range, urange, sizeof(range)))
+		return -EFAULT;
+
+	if (range.len && range.off + range.len - 1 < range.off)
+		return -EINVAL;
+	if (range.off >> PAGE_SHIFT > ULONG_MAX)
+		return -EOVERFLOW;
+
+	first = range.off >> PAGE_SHIFT;
+	last = ULONG_MAX;
+	if (range.len && (range.off + range.len - 1) >> PAGE_SHIFT < ULONG_MAX)
+		last = (range.off + range.len - 1) >> PAGE_SHIFT;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	/* hugetlbfs keeps huge pages, which this does not know to count */
+	if (is_file_hugepages(f.file)) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
+	filemap_cachestat(f.file->f_mapping, first, last, flags, &cs);
+	if (copy_to_user(cstat, &cs, sizeof(cs)))
+		ret = -EFAULT;
+out:
+	fdput(f);
+	return ret;
+}
+
+/*
+ * The cachestat_sb() system call: the page cache statistics of every
+ * cached inode of the filesystem @fd lives on.
+ *
+ * Up to @count entries are returned per call.  *@pos is the position on
+ * the superblock's inode list to resume from, 0 on the first call, and
+ * is advanced past the inodes looked at; 0 entries means the end of the
+ * list.  Inodes created or freed between calls shift the positions, so
+ * a few inodes may be missed or reported twice.
+ */
+SYSCALL_DEFINE5(cachestat_sb, unsigned int, fd, __u64 __user *, upos,
+		struct cachestat_inode __user *, buf, unsigned int, count,
+		unsigned int, flags)
+{
+	struct inode *inode, *toput_inode = NULL;
+	struct dlock_list_iter iter;
+	struct cachestat_inode ci;
+	u64 pos, idx = 0;
+	unsigned int nr = 0;
+	struct fd f;
+	int ret = 0;
+
+	if (flags & ~CACHESTAT_PAGES)
+		return -EINVAL;
+
+	/* The inode list shows what everyone on the filesystem caches */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (get_user(pos, upos))
+		return -EFAULT;
+
+	if (!count)
+		return 0;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	init_dlock_list_iter(&iter, &file_inode(f.file)->i_sb->s_inodes);
+	dlist_for_each_entry(inode, &iter, i_sb_list) {
+		if (idx++ < pos)
+			continue;
+
+		spin_lock(&inode->i_lock);
+		if ((inode->i_state & (I_FREEING|I_WILL_FREE|I_NEW)) ||
+		    !inode->i_mapping->nrpages) {
+			spin_unlock(&inode->i_lock);
+			continue;
+		}
+		__iget(inode);
+		spin_unlock(&inode->i_lock);
+		dlock_list_unlock(&iter);
+
+		ci.ino = inode->i_ino;
+		filemap_cachestat(inode->i_mapping, 0, ULONG_MAX, flags, &ci.cs);
+		iput(toput_inode);
+		toput_inode = inode;
+
+		if (copy_to_user(&buf[nr], &ci, sizeof(ci))) {
+			ret = -EFAULT;
+			goto out;
+		}
+		if (++nr == count)
+			goto out;
+
+		dlock_list_relock(&iter);
+	}
+	/* Ran off the end of the list; the next call returns nothing */
+out:
+	iput(toput_inode);
+	fdput(f);
+	if (ret)
+		return ret;
+
+	if (put_user(idx, upos))
+		return -EFAULT;
+	return nr;
+}
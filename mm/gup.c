@@ -1878,3 +1878,66 @@ int get_user_pages_fast(unsigned long start, int nr_pages, int write,
 }
 
 #endif /* CONFIG_HAVE_GENERIC_GUP */
+
+/**
+ * pin_user_pages_fast() - pin user pages in memory for DMA
+ * @start:	starting user address
+ * @nr_pages:	number of pages from start to pin
+ * @gup_flags:	flags modifying pin behaviour, only FOLL_WRITE for now
+ * @pages:	array that receives pointers to the pages pinned.
+ *		Should be at least nr_pages long.
+ *
+ * Like get_user_pages_fast(), but the pages are accounted as pinned, see
+ * page_maybe_dma_pinned(), and must be released with unpin_user_page()
+ * or unpin_user_pages() rather than put_page().  Use it for pages whose
+ * contents are accessed by a device, e.g. RDMA or O_DIRECT buffers.
+ *
+ * Returns number of pages pinned, as get_user_pages_fast().
+ */
+int pin_user_pages_fast(unsigned long start, int nr_pages,
+			unsigned int gup_flags, struct page **pages)
+{
+	int i, ret;
+
+	if (WARN_ON_ONCE(gup_flags & ~FOLL_WRITE))
+		return -EINVAL;
+
+	ret = get_user_pages_fast(start, nr_pages, gup_flags & FOLL_WRITE,
+				  pages);
+
+	/* The reference we hold makes it safe to raise it to a pin */
+	for (i = 0; i < ret; i++)
+		page_ref_add(compound_head(pages[i]),
+			     GUP_PIN_COUNTING_BIAS - 1);
+	if (ret > 0)
+		count_vm_events(FOLL_PIN_ACQUIRED, ret);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(pin_user_pages_fast);
+
+/**
+ * unpin_user_page() - release a page pinned by pin_user_pages_fast()
+ * @page:	pointer to page to be released
+ */
+void unpin_user_page(struct page *page)
+{
+	page_ref_sub(compound_head(page), GUP_PIN_COUNTING_BIAS - 1);
+	put_page(page);
+	count_vm_event(FOLL_PIN_RELEASED);
+}
+EXPORT_SYMBOL(unpin_user_page);
+
+/**
+ * unpin_user_pages() - release an array of pinned pages
+ * @pages:	array of pages to be unpinned
+ * @npages:	number of pages in the @pages array
+ */
+void unpin_user_pages(struct page **pages, unsigned long npages)
+{
+	unsigned long i;
+
+	for (i = 0; i < npages; i++)
+		unpin_user_page(pages[i]);
+}
+EXPORT_SYMBOL(unpin_user_pages);
@@ -6,6 +6,7 @@
 #include <linux/debugfs.h>
 
 #define GUP_FAST_BENCHMARK	_IOWR('g', 1, struct gup_benchmark)
+#define PIN_FAST_BENCHMARK	_IOWR('g', 2, struct gup_benchmark)
 
 struct gup_benchmark {
 	__u64 delta_usec;
@@ -40,7 +41,20 @@ static int __gup_benchmark_ioctl(unsigned int cmd,
 			nr = (next - addr) / PAGE_SIZE;
 		}
 
-		nr = get_user_pages_fast(addr, nr, gup->flags & 1, pages + i);
+		switch (cmd) {
+		case GUP_FAST_BENCHMARK:
+			nr = get_user_pages_fast(addr, nr, gup->flags & 1,
+						 pages + i);
+			break;
+		case PIN_FAST_BENCHMARK:
+			nr = pin_user_pages_fast(addr, nr,
+					(gup->flags & 1) ? FOLL_WRITE : 0,
+					pages + i);
+			break;
+		default:
+			kvfree(pages);
+			return -EINVAL;
+		}
 		if (nr <= 0)
 			break;
 		i += nr;
@@ -53,7 +67,10 @@ static int __gup_benchmark_ioctl(unsigned int cmd,
 	for (i = 0; i < nr_pages; i++) {
 		if (!pages[i])
 			break;
-		put_page(pages[i]);
+		if (cmd == PIN_FAST_BENCHMARK)
+			unpin_user_page(pages[i]);
+		else
+			put_page(pages[i]);
 	}
 
 	kvfree(pages);
@@ -66,7 +83,7 @@ static long gup_benchmark_ioctl(struct file *filep, unsigned int cmd,
 	struct gup_benchmark gup;
 	int ret;
 
-	if (cmd != GUP_FAST_BENCHMARK)
+	if (cmd != GUP_FAST_BENCHMARK && cmd != PIN_FAST_BENCHMARK)
 		return -EINVAL;
 
 	if (copy_from_user(&gup, (void __user *)arg, sizeof(gup)))
@@ -529,8 +529,12 @@ unsigned long thp_get_unmapped_area(struct file *filp, unsigned long addr,
 
 	if (addr)
 		goto out;
-	if (!IS_DAX(filp->f_mapping->host) || !IS_ENABLED(CONFIG_FS_DAX_PMD))
+	if (IS_DAX(filp->f_mapping->host)) {
+		if (!IS_ENABLED(CONFIG_FS_DAX_PMD))
+			goto out;
+	} else if (!IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS)) {
 		goto out;
+	}
 
 	addr = __thp_get_unmapped_area(filp, len, off, flags, PMD_SIZE);
 	if (addr)
@@ -2676,8 +2680,14 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 			pgdata->split_queue_len--;
 			list_del(page_deferred_list(head));
 		}
-		if (mapping)
-			__dec_node_page_state(page, NR_SHMEM_THPS);
+		if (mapping) {
+			if (PageSwapBacked(head)) {
+				__dec_node_page_state(head, NR_SHMEM_THPS);
+			} else {
+				__dec_node_page_state(head, NR_FILE_THPS);
+				filemap_nr_thps_dec(mapping);
+			}
+		}
 		spin_unlock(&pgdata->split_queue_lock);
 		__split_huge_page(page, list, flags);
 		if (PageSwapCache(head)) {
@@ -207,6 +207,7 @@ struct compact_control {
 	bool whole_zone;		/* Whole zone should/has been scanned */
 	bool contended;			/* Signal lock or sched contention */
 	bool finishing_block;		/* Finishing current pageblock */
+	bool proactive_compaction;	/* kcompactd proactive compaction */
 };
 
 unsigned long
@@ -525,6 +526,32 @@ static inline void flush_tlb_batched_pending(struct mm_struct *mm)
 }
 #endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
 
+/*
+ * Deferred TLB invalidation for a sequence of page table updates in one
+ * mm, e.g. NUMA hinting faults being armed across many VMAs. While the
+ * batch is open the mm has a TLB flush pending, so pte_accessible() and
+ * mm_tlb_flush_pending() users stay conservative until the single flush
+ * in tlb_flush_batch_finish().
+ */
+struct tlb_flush_batch {
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;	/* VMA of the range if only one */
+	unsigned long start;
+	unsigned long end;
+	unsigned int nr_ranges;
+};
+
+void tlb_flush_batch_init(struct tlb_flush_batch *batch,
+			  struct mm_struct *mm);
+void tlb_flush_batch_add(struct tlb_flush_batch *batch,
+			 struct vm_area_struct *vma,
+			 unsigned long start, unsigned long end);
+void tlb_flush_batch_finish(struct tlb_flush_batch *batch);
+unsigned long change_protection_batched(struct vm_area_struct *vma,
+		unsigned long start, unsigned long end, pgprot_t newprot,
+		int dirty_accountable, int prot_numa,
+		struct tlb_flush_batch *batch);
+
 extern const struct trace_print_flags pageflag_names[];
 extern const struct trace_print_flags vmaflag_names[];
 extern const struct trace_print_flags gfpflag_names[];
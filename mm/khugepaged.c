@@ -48,6 +48,7 @@ enum scan_result {
 	SCAN_CGROUP_CHARGE_FAIL,
 	SCAN_EXCEED_SWAP_PTE,
 	SCAN_TRUNCATED,
+	SCAN_PAGE_HAS_PRIVATE,
 };
 
 #define CREATE_TRACE_POINTS
@@ -430,10 +431,34 @@ int __khugepaged_enter(struct mm_struct *mm)
 	return 0;
 }
 
+/*
+ * Executable mappings of regular files that are denied for writing, i.e.
+ * program text, can be collapsed into read-only huge pages in the page
+ * cache.
+ */
+static bool file_thp_vma(struct vm_area_struct *vma, unsigned long vm_flags)
+{
+	struct file *file = vma->vm_file;
+
+	if (!IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) || !file ||
+	    shmem_file(file))
+		return false;
+	if ((vm_flags & (VM_DENYWRITE | VM_EXEC | VM_WRITE)) !=
+	    (VM_DENYWRITE | VM_EXEC))
+		return false;
+	return S_ISREG(file_inode(file)->i_mode);
+}
+
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 			       unsigned long vm_flags)
 {
 	unsigned long hstart, hend;
+
+	if (file_thp_vma(vma, vm_flags)) {
+		if (vm_flags & VM_NO_KHUGEPAGED)
+			return 0;
+		goto check_range;
+	}
 	if (!vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
@@ -443,6 +468,7 @@ int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 	if (vma->vm_ops || (vm_flags & VM_NO_KHUGEPAGED))
 		/* khugepaged not yet working on file or special mappings */
 		return 0;
+check_range:
 	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 	hend = vma->vm_end & HPAGE_PMD_MASK;
 	if (hstart < hend)
@@ -831,6 +857,12 @@ static bool hugepage_vma_check(struct vm_area_struct *vma)
 		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
 				HPAGE_PMD_NR);
 	}
+	if (file_thp_vma(vma, vma->vm_flags)) {
+		if (vma->vm_flags & VM_NO_KHUGEPAGED)
+			return false;
+		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
+				HPAGE_PMD_NR);
+	}
 	if (!vma->anon_vma || vma->vm_ops)
 		return false;
 	if (is_vma_temporary_stack(vma))
@@ -1283,7 +1315,7 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
 }
 
 /**
- * collapse_shmem - collapse small tmpfs/shmem pages into huge one.
+ * collapse_file - collapse small tmpfs/shmem or file pages into huge one.
  *
  * Basic scheme is simple, details are more complex:
  *  - allocate and freeze a new huge page;
@@ -1291,6 +1323,8 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
  *    + swap in pages if necessary;
  *    + fill in gaps;
  *    + keep old pages around in case if rollback is required;
+ *  - for regular files, only clean, up-to-date and fully cached ranges
+ *    are collapsed, and nobody may have the file open for write;
  *  - if replacing succeed:
  *    + copy data over;
  *    + free old pages;
@@ -1300,10 +1334,12 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
  *    + restore gaps in the radix-tree;
  *    + free huge page;
  */
-static void collapse_shmem(struct mm_struct *mm,
-		struct address_space *mapping, pgoff_t start,
+static void collapse_file(struct mm_struct *mm,
+		struct file *file, pgoff_t start,
 		struct page **hpage, int node)
 {
+	struct address_space *mapping = file->f_mapping;
+	bool is_shmem = shmem_file(file);
 	gfp_t gfp;
 	struct page *page, *new_page, *tmp;
 	struct mem_cgroup *memcg;
@@ -1331,7 +1367,8 @@ static void collapse_shmem(struct mm_struct *mm,
 
 	new_page->index = start;
 	new_page->mapping = mapping;
-	__SetPageSwapBacked(new_page);
+	if (is_shmem)
+		__SetPageSwapBacked(new_page);
 	__SetPageLocked(new_page);
 	BUG_ON(!page_ref_freeze(new_page, 1));
 
@@ -1351,7 +1388,12 @@ static void collapse_shmem(struct mm_struct *mm,
 		/*
 		 * Handle holes in the radix tree: charge it from shmem and
 		 * insert relevant subpage of new_page into the radix-tree.
+		 * Regular files have nothing to fill holes with.
 		 */
+		if (n && !is_shmem) {
+			result = SCAN_FAIL;
+			break;
+		}
 		if (n && !shmem_charge(mapping->host, n)) {
 			result = SCAN_FAIL;
 			break;
@@ -1369,6 +1411,10 @@ static void collapse_shmem(struct mm_struct *mm,
 		page = radix_tree_deref_slot_protected(slot,
 				&mapping->i_pages.xa_lock);
 		if (radix_tree_exceptional_entry(page) || !PageUptodate(page)) {
+			if (!is_shmem) {
+				result = SCAN_FAIL;
+				break;
+			}
 			xa_unlock_irq(&mapping->i_pages);
 			/* swap in or instantiate fallocated page */
 			if (shmem_getpage(mapping->host, index, &page,
@@ -1396,8 +1442,23 @@ static void collapse_shmem(struct mm_struct *mm,
 			result = SCAN_TRUNCATED;
 			goto out_unlock;
 		}
+
+		/*
+		 * The file is not open for write, so its pages should have
+		 * been written back long ago.
+		 */
+		if (!is_shmem && (PageDirty(page) || PageWriteback(page))) {
+			result = SCAN_FAIL;
+			goto out_unlock;
+		}
 		xa_unlock_irq(&mapping->i_pages);
 
+		if (page_has_private(page) &&
+		    !try_to_release_page(page, GFP_KERNEL)) {
+			result = SCAN_PAGE_HAS_PRIVATE;
+			goto out_isolate_failed;
+		}
+
 		if (isolate_lru_page(page)) {
 			result = SCAN_DEL_PAGE_LRU;
 			goto out_isolate_failed;
@@ -1458,7 +1519,7 @@ static void collapse_shmem(struct mm_struct *mm,
 	if (result == SCAN_SUCCEED && index < end) {
 		int n = end - index;
 
-		if (!shmem_charge(mapping->host, n)) {
+		if (!is_shmem || !shmem_charge(mapping->host, n)) {
 			result = SCAN_FAIL;
 			goto tree_locked;
 		}
@@ -1470,6 +1531,20 @@ static void collapse_shmem(struct mm_struct *mm,
 		nr_none += n;
 	}
 
+	if (result == SCAN_SUCCEED && !is_shmem) {
+		/*
+		 * Paired with smp_mb() in do_dentry_open(): either the opener
+		 * sees nr_thps and drops the page cache, or we see the new
+		 * i_writecount and back off.
+		 */
+		filemap_nr_thps_inc(mapping);
+		smp_mb();
+		if (inode_is_open_for_write(mapping->host)) {
+			result = SCAN_FAIL;
+			filemap_nr_thps_dec(mapping);
+		}
+	}
+
 tree_locked:
 	xa_unlock_irq(&mapping->i_pages);
 tree_unlocked:
@@ -1495,7 +1570,10 @@ static void collapse_shmem(struct mm_struct *mm,
 		}
 
 		local_irq_save(flags);
-		__inc_node_page_state(new_page, NR_SHMEM_THPS);
+		if (is_shmem)
+			__inc_node_page_state(new_page, NR_SHMEM_THPS);
+		else
+			__inc_node_page_state(new_page, NR_FILE_THPS);
 		if (nr_none) {
 			__mod_node_page_state(zone->zone_pgdat, NR_FILE_PAGES, nr_none);
 			__mod_node_page_state(zone->zone_pgdat, NR_SHMEM, nr_none);
@@ -1509,17 +1587,22 @@ static void collapse_shmem(struct mm_struct *mm,
 		retract_page_tables(mapping, start);
 
 		/* Everything is ready, let's unfreeze the new_page */
-		set_page_dirty(new_page);
+		if (is_shmem)
+			set_page_dirty(new_page);
 		SetPageUptodate(new_page);
 		page_ref_unfreeze(new_page, HPAGE_PMD_NR);
 		mem_cgroup_commit_charge(new_page, memcg, false, true);
-		lru_cache_add_anon(new_page);
+		if (is_shmem)
+			lru_cache_add_anon(new_page);
+		else
+			lru_cache_add_file(new_page);
 		unlock_page(new_page);
 
 		*hpage = NULL;
 	} else {
 		/* Something went wrong: rollback changes to the radix-tree */
-		shmem_uncharge(mapping->host, nr_none);
+		if (is_shmem)
+			shmem_uncharge(mapping->host, nr_none);
 		xa_lock_irq(&mapping->i_pages);
 		radix_tree_for_each_slot(slot, &mapping->i_pages, &iter, start) {
 			if (iter.index >= end)
@@ -1561,10 +1644,11 @@ static void collapse_shmem(struct mm_struct *mm,
 	/* TODO: tracepoints */
 }
 
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
-		pgoff_t start, struct page **hpage)
+static void khugepaged_scan_file(struct mm_struct *mm,
+		struct file *file, pgoff_t start, struct page **hpage)
 {
+	struct address_space *mapping = file->f_mapping;
+	bool is_shmem = shmem_file(file);
 	struct page *page = NULL;
 	struct radix_tree_iter iter;
 	void **slot;
@@ -1587,6 +1671,11 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 		}
 
 		if (radix_tree_exception(page)) {
+			/* Shadow entries of regular files are holes */
+			if (!is_shmem) {
+				result = SCAN_EXCEED_NONE_PTE;
+				break;
+			}
 			if (++swap > khugepaged_max_ptes_swap) {
 				result = SCAN_EXCEED_SWAP_PTE;
 				break;
@@ -1611,7 +1700,8 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 			break;
 		}
 
-		if (page_count(page) != 1 + page_mapcount(page)) {
+		if (page_count(page) !=
+		    1 + page_mapcount(page) + page_has_private(page)) {
 			result = SCAN_PAGE_COUNT;
 			break;
 		}
@@ -1632,20 +1722,20 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 	rcu_read_unlock();
 
 	if (result == SCAN_SUCCEED) {
-		if (present < HPAGE_PMD_NR - khugepaged_max_ptes_none) {
+		if (present < HPAGE_PMD_NR -
+			      (is_shmem ? khugepaged_max_ptes_none : 0)) {
 			result = SCAN_EXCEED_NONE_PTE;
 		} else {
 			node = khugepaged_find_target_node();
-			collapse_shmem(mm, mapping, start, hpage, node);
+			collapse_file(mm, file, start, hpage, node);
 		}
 	}
 
 	/* TODO: tracepoints */
 }
 #else
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
-		pgoff_t start, struct page **hpage)
+static void khugepaged_scan_file(struct mm_struct *mm,
+		struct file *file, pgoff_t start, struct page **hpage)
 {
 	BUILD_BUG();
 }
@@ -1718,17 +1808,20 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			if (shmem_file(vma->vm_file)) {
+			if (IS_ENABLED(CONFIG_SHMEM) &&
+			    IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE) &&
+			    vma->vm_file && (shmem_file(vma->vm_file) ||
+			     file_thp_vma(vma, vma->vm_flags))) {
 				struct file *file;
 				pgoff_t pgoff = linear_page_index(vma,
 						khugepaged_scan.address);
-				if (!shmem_huge_enabled(vma))
+				if (shmem_file(vma->vm_file) &&
+				    !shmem_huge_enabled(vma))
 					goto skip;
 				file = get_file(vma->vm_file);
 				up_read(&mm->mmap_sem);
 				ret = 1;
-				khugepaged_scan_shmem(mm, file->f_mapping,
-						pgoff, hpage);
+				khugepaged_scan_file(mm, file, pgoff, hpage);
 				fput(file);
 			} else {
 				ret = khugepaged_scan_pmd(mm, vma,
@@ -937,10 +937,41 @@ struct page *vm_normal_page_pmd(struct vm_area_struct *vma, unsigned long addr,
  * covered by this vma.
  */
 
+/*
+ * Runs of ptes mapping a pte-mapped compound page all pin the same head
+ * page, so fork takes those references in one go rather than with one
+ * atomic per pte.  The batch must be flushed before the page table locks
+ * are dropped, while the parent's ptes still keep the pages alive.
+ */
+struct copy_ref_batch {
+	struct page *head;
+	int nr;
+};
+
+static inline void copy_ref_flush(struct copy_ref_batch *batch)
+{
+	if (batch->nr) {
+		VM_BUG_ON_PAGE(page_ref_count(batch->head) <= 0, batch->head);
+		page_ref_add(batch->head, batch->nr);
+	}
+	batch->nr = 0;
+}
+
+static inline void copy_ref_get(struct copy_ref_batch *batch,
+				struct page *page)
+{
+	struct page *head = compound_head(page);
+
+	if (batch->nr && batch->head != head)
+		copy_ref_flush(batch);
+	batch->head = head;
+	batch->nr++;
+}
+
 static inline unsigned long
 copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pte_t *dst_pte, pte_t *src_pte, struct vm_area_struct *vma,
-		unsigned long addr, int *rss)
+		unsigned long addr, int *rss, struct copy_ref_batch *batch)
 {
 	unsigned long vm_flags = vma->vm_flags;
 	pte_t pte = *src_pte;
@@ -1015,9 +1046,10 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 
 	/*
 	 * If it's a COW mapping, write protect it both
-	 * in the parent and the child
+	 * in the parent and the child.  Ptes left read-only by an earlier
+	 * fork, as with repeated snapshotting, don't need the atomic update.
 	 */
-	if (is_cow_mapping(vm_flags)) {
+	if (is_cow_mapping(vm_flags) && pte_write(pte)) {
 		ptep_set_wrprotect(src_mm, addr, src_pte);
 		pte = pte_wrprotect(pte);
 	}
@@ -1032,7 +1064,7 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 
 	page = vm_normal_page(vma, addr, pte);
 	if (page) {
-		get_page(page);
+		copy_ref_get(batch, page);
 		page_dup_rmap(page, false);
 		rss[mm_counter(page)]++;
 	} else if (pte_devmap(pte)) {
@@ -1065,9 +1097,11 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	int progress = 0;
 	int rss[NR_MM_COUNTERS];
 	swp_entry_t entry = (swp_entry_t){0};
+	struct copy_ref_batch batch;
 
 again:
 	init_rss_vec(rss);
+	batch.nr = 0;
 
 	dst_pte = pte_alloc_map_lock(dst_mm, dst_pmd, addr, &dst_ptl);
 	if (!dst_pte)
@@ -1095,12 +1129,13 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 			continue;
 		}
 		entry.val = copy_one_pte(dst_mm, src_mm, dst_pte, src_pte,
-							vma, addr, rss);
+						vma, addr, rss, &batch);
 		if (entry.val)
 			break;
 		progress += 8;
 	} while (dst_pte++, src_pte++, addr += PAGE_SIZE, addr != end);
 
+	copy_ref_flush(&batch);
 	arch_leave_lazy_mmu_mode();
 	spin_unlock(src_ptl);
 	pte_unmap(orig_src_pte);
@@ -3568,6 +3603,18 @@ late_initcall(fault_around_debugfs);
  * (and therefore to page order).  This way it's easier to guarantee
  * that we don't cross page table boundaries.
  */
+static unsigned long vma_fault_around_bytes(struct vm_area_struct *vma)
+{
+	/*
+	 * Processes that asked for their executables to be prefaulted,
+	 * see PR_SET_EXEC_PREFAULT, map a whole page table of whatever
+	 * is cached at once.
+	 */
+	if (test_bit(MMF_EXEC_PREFAULT, &vma->vm_mm->flags))
+		return PTRS_PER_PTE * PAGE_SIZE;
+	return READ_ONCE(fault_around_bytes);
+}
+
 static int do_fault_around(struct vm_fault *vmf)
 {
 	unsigned long address = vmf->address, nr_pages, mask;
@@ -3575,7 +3622,7 @@ static int do_fault_around(struct vm_fault *vmf)
 	pgoff_t end_pgoff;
 	int off, ret = 0;
 
-	nr_pages = READ_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+	nr_pages = vma_fault_around_bytes(vmf->vma) >> PAGE_SHIFT;
 	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
 
 	vmf->address = max(address & mask, vmf->vma->vm_start);
@@ -3633,7 +3680,8 @@ static int do_read_fault(struct vm_fault *vmf)
 	 * if page by the offset is not ready to be mapped (cold cache or
 	 * something).
 	 */
-	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1) {
+	if (vma->vm_ops->map_pages &&
+	    vma_fault_around_bytes(vma) >> PAGE_SHIFT > 1) {
 		ret = do_fault_around(vmf);
 		if (ret)
 			return ret;
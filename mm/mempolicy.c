@@ -411,6 +411,7 @@ struct queue_pages {
 	unsigned long flags;
 	nodemask_t *nmask;
 	struct vm_area_struct *prev;
+	struct tlb_flush_batch *tlb;
 };
 
 /*
@@ -549,20 +550,29 @@ static int queue_pages_hugetlb(pte_t *pte, unsigned long hmask,
  * an architecture makes a different choice, it will need further
  * changes to the core.
  */
-unsigned long change_prot_numa(struct vm_area_struct *vma,
-			unsigned long addr, unsigned long end)
+static unsigned long change_prot_numa_batched(struct vm_area_struct *vma,
+			unsigned long addr, unsigned long end,
+			struct tlb_flush_batch *batch)
 {
 	int nr_updated;
 
-	nr_updated = change_protection(vma, addr, end, PAGE_NONE, 0, 1);
+	nr_updated = change_protection_batched(vma, addr, end, PAGE_NONE, 0, 1,
+					       batch);
 	if (nr_updated)
 		count_vm_numa_events(NUMA_PTE_UPDATES, nr_updated);
 
 	return nr_updated;
 }
-#else
-static unsigned long change_prot_numa(struct vm_area_struct *vma,
+
+unsigned long change_prot_numa(struct vm_area_struct *vma,
 			unsigned long addr, unsigned long end)
+{
+	return change_prot_numa_batched(vma, addr, end, NULL);
+}
+#else
+static unsigned long change_prot_numa_batched(struct vm_area_struct *vma,
+			unsigned long addr, unsigned long end,
+			struct tlb_flush_batch *batch)
 {
 	return 0;
 }
@@ -598,7 +608,7 @@ static int queue_pages_test_walk(unsigned long start, unsigned long end,
 		if (!is_vm_hugetlb_page(vma) &&
 			(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE)) &&
 			!(vma->vm_flags & VM_MIXEDMAP))
-			change_prot_numa(vma, start, endvma);
+			change_prot_numa_batched(vma, start, endvma, qp->tlb);
 		return 1;
 	}
 
@@ -620,6 +630,7 @@ queue_pages_range(struct mm_struct *mm, unsigned long start, unsigned long end,
 		nodemask_t *nodes, unsigned long flags,
 		struct list_head *pagelist)
 {
+	struct tlb_flush_batch tlb;
 	struct queue_pages qp = {
 		.pagelist = pagelist,
 		.flags = flags,
@@ -633,8 +644,20 @@ queue_pages_range(struct mm_struct *mm, unsigned long start, unsigned long end,
 		.mm = mm,
 		.private = &qp,
 	};
+	int err;
+
+	/* Arm NUMA hinting faults in all VMAs with a single TLB flush */
+	if (flags & MPOL_MF_LAZY) {
+		tlb_flush_batch_init(&tlb, mm);
+		qp.tlb = &tlb;
+	}
 
-	return walk_page_range(start, end, &queue_pages_walk);
+	err = walk_page_range(start, end, &queue_pages_walk);
+
+	if (qp.tlb)
+		tlb_flush_batch_finish(qp.tlb);
+
+	return err;
 }
 
 /*
@@ -1091,8 +1091,14 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		/* Establish migration ptes */
 		VM_BUG_ON_PAGE(PageAnon(page) && !PageKsm(page) && !anon_vma,
 				page);
-		try_to_unmap(page,
-			TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS);
+		try_to_unmap(page, TTU_MIGRATION|TTU_IGNORE_MLOCK|
+				   TTU_IGNORE_ACCESS|TTU_BATCH_FLUSH);
+		/*
+		 * A page mapped by several mms is invalidated in one IPI
+		 * round. The flush must complete before the contents are
+		 * copied so no write through a stale TLB entry is lost.
+		 */
+		try_to_unmap_flush();
 		page_was_mapped = 1;
 	}
 
@@ -1458,6 +1464,57 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 
 #ifdef CONFIG_NUMA
 
+/*
+ * node_demotion[] maps a node to the slower node that reclaim migrates its
+ * cold pages to, NUMA_NO_NODE if they are reclaimed as usual.  The targets
+ * are set by the admin through /sys/devices/system/node/nodeN/demotion_target
+ * and always form chains, never cycles, so pages only ever move down.
+ */
+static int node_demotion[MAX_NUMNODES] __read_mostly = {
+	[0 ... MAX_NUMNODES - 1] = NUMA_NO_NODE,
+};
+static nodemask_t demotion_targets __read_mostly;
+static DEFINE_MUTEX(node_demotion_lock);
+
+int next_demotion_node(int node)
+{
+	return READ_ONCE(node_demotion[node]);
+}
+
+bool node_is_demotion_target(int node)
+{
+	return node_isset(node, demotion_targets);
+}
+
+int set_demotion_target(int node, int target)
+{
+	nodemask_t targets = NODE_MASK_NONE;
+	int nid, ret = 0;
+
+	if (target != NUMA_NO_NODE &&
+	    (target < 0 || target >= nr_node_ids || target == node ||
+	     !node_state(target, N_MEMORY)))
+		return -EINVAL;
+
+	mutex_lock(&node_demotion_lock);
+	for (nid = target; nid != NUMA_NO_NODE; nid = node_demotion[nid]) {
+		if (nid == node) {
+			ret = -EINVAL;
+			goto unlock;
+		}
+	}
+
+	WRITE_ONCE(node_demotion[node], target);
+	for_each_node(nid) {
+		if (node_demotion[nid] != NUMA_NO_NODE)
+			node_set(node_demotion[nid], targets);
+	}
+	demotion_targets = targets;
+unlock:
+	mutex_unlock(&node_demotion_lock);
+	return ret;
+}
+
 static int store_status(int __user *status, int start, int value, int nr)
 {
 	while (nr-- > 0) {
@@ -1841,6 +1898,20 @@ static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
 	return false;
 }
 
+static void wakeup_kswapd_promotion(struct pglist_data *pgdat)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (populated_zone(zone)) {
+			wakeup_kswapd(zone, 0, 0, z);
+			return;
+		}
+	}
+}
+
 static struct page *alloc_misplaced_dst_page(struct page *page,
 					   unsigned long data)
 {
@@ -1903,8 +1974,15 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	VM_BUG_ON_PAGE(compound_order(page) && !PageTransHuge(page), page);
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page)))
+	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page))) {
+		/*
+		 * A page on a slower node only comes back once the faster
+		 * node has room, so have its kswapd demote cold pages.
+		 */
+		if (node_is_demotion_target(page_to_nid(page)))
+			wakeup_kswapd_promotion(pgdat);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -1944,11 +2022,13 @@ bool pmd_trans_migrating(pmd_t pmd)
  * Attempt to migrate a misplaced page to the specified destination
  * node. Caller is expected to have an elevated reference count on
  * the page that will be dropped by this function before returning.
+ * @vma may be NULL when the access was not observed through a fault.
  */
 int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			   int node)
 {
 	pg_data_t *pgdat = NODE_DATA(node);
+	int page_nid = page_to_nid(page);
 	int isolated;
 	int nr_remaining;
 	LIST_HEAD(migratepages);
@@ -1958,7 +2038,7 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 	 * with execute permissions as they are probably shared libraries.
 	 */
 	if (page_mapcount(page) != 1 && page_is_file_cache(page) &&
-	    (vma->vm_flags & VM_EXEC))
+	    (!vma || (vma->vm_flags & VM_EXEC)))
 		goto out;
 
 	/*
@@ -1992,8 +2072,11 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_event(NUMA_PAGE_MIGRATE);
+		if (node_is_demotion_target(page_nid))
+			count_vm_event(PGPROMOTE);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2569,7 +2652,8 @@ static void migrate_vma_prepare(struct migrate_vma *migrate)
  */
 static void migrate_vma_unmap(struct migrate_vma *migrate)
 {
-	int flags = TTU_MIGRATION | TTU_IGNORE_MLOCK | TTU_IGNORE_ACCESS;
+	int flags = TTU_MIGRATION | TTU_IGNORE_MLOCK | TTU_IGNORE_ACCESS |
+		    TTU_BATCH_FLUSH;
 	const unsigned long npages = migrate->npages;
 	const unsigned long start = migrate->start;
 	unsigned long addr, i, restore = 0;
@@ -2595,6 +2679,12 @@ static void migrate_vma_unmap(struct migrate_vma *migrate)
 		restore++;
 	}
 
+	/*
+	 * One TLB flush for the whole range, before the driver copies the
+	 * pages or the failed ones get their mappings restored.
+	 */
+	try_to_unmap_flush();
+
 	for (addr = start, i = 0; i < npages && restore; addr += PAGE_SIZE, i++) {
 		struct page *page = migrate_pfn_to_page(migrate->src[i]);
 
@@ -264,7 +264,8 @@ static inline unsigned long change_p4d_range(struct vm_area_struct *vma,
 
 static unsigned long change_protection_range(struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end, pgprot_t newprot,
-		int dirty_accountable, int prot_numa)
+		int dirty_accountable, int prot_numa,
+		struct tlb_flush_batch *batch)
 {
 	struct mm_struct *mm = vma->vm_mm;
 	pgd_t *pgd;
@@ -285,27 +286,85 @@ static unsigned long change_protection_range(struct vm_area_struct *vma,
 	} while (pgd++, addr = next, addr != end);
 
 	/* Only flush the TLB if we actually modified any entries: */
-	if (pages)
-		flush_tlb_range(vma, start, end);
+	if (pages) {
+		if (batch)
+			tlb_flush_batch_add(batch, vma, start, end);
+		else
+			flush_tlb_range(vma, start, end);
+	}
 	dec_tlb_flush_pending(mm);
 
 	return pages;
 }
 
-unsigned long change_protection(struct vm_area_struct *vma, unsigned long start,
-		       unsigned long end, pgprot_t newprot,
-		       int dirty_accountable, int prot_numa)
+unsigned long change_protection_batched(struct vm_area_struct *vma,
+		unsigned long start, unsigned long end, pgprot_t newprot,
+		int dirty_accountable, int prot_numa,
+		struct tlb_flush_batch *batch)
 {
 	unsigned long pages;
 
 	if (is_vm_hugetlb_page(vma))
 		pages = hugetlb_change_protection(vma, start, end, newprot);
 	else
-		pages = change_protection_range(vma, start, end, newprot, dirty_accountable, prot_numa);
+		pages = change_protection_range(vma, start, end, newprot,
+						dirty_accountable, prot_numa,
+						batch);
 
 	return pages;
 }
 
+unsigned long change_protection(struct vm_area_struct *vma, unsigned long start,
+		       unsigned long end, pgprot_t newprot,
+		       int dirty_accountable, int prot_numa)
+{
+	return change_protection_batched(vma, start, end, newprot,
+					 dirty_accountable, prot_numa, NULL);
+}
+
+void tlb_flush_batch_init(struct tlb_flush_batch *batch,
+			  struct mm_struct *mm)
+{
+	batch->mm = mm;
+	batch->vma = NULL;
+	batch->start = ULONG_MAX;
+	batch->end = 0;
+	batch->nr_ranges = 0;
+	inc_tlb_flush_pending(mm);
+}
+
+/*
+ * Record a range whose ptes were changed without flushing the TLB. The
+ * caller must hold the batch open, i.e. not have called
+ * tlb_flush_batch_finish() yet, so the mm's flush pending count covers it.
+ */
+void tlb_flush_batch_add(struct tlb_flush_batch *batch,
+			 struct vm_area_struct *vma,
+			 unsigned long start, unsigned long end)
+{
+	VM_BUG_ON_VMA(vma->vm_mm != batch->mm, vma);
+
+	batch->vma = vma;
+	batch->start = min(batch->start, start);
+	batch->end = max(batch->end, end);
+	batch->nr_ranges++;
+}
+
+/*
+ * Issue one invalidation for all recorded ranges. A single range keeps the
+ * precise flush_tlb_range(); several ranges, possibly from VMAs with
+ * different page sizes, fall back to one full flush of the mm, which is a
+ * single IPI round instead of one per range.
+ */
+void tlb_flush_batch_finish(struct tlb_flush_batch *batch)
+{
+	if (batch->nr_ranges == 1)
+		flush_tlb_range(batch->vma, batch->start, batch->end);
+	else if (batch->nr_ranges)
+		flush_tlb_mm(batch->mm);
+	dec_tlb_flush_pending(batch->mm);
+}
+
 int
 mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 	unsigned long start, unsigned long end, unsigned long newflags)
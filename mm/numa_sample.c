@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NUMA balancing driven by sampled memory accesses.
+ *
+ * NUMA hinting faults find misplaced pages by making ranges PROT_NONE and
+ * taking a fault per page touched.  Where the PMU can report the data
+ * address of sampled loads and stores (e.g. PEBS load latency events), the
+ * samples themselves say which pages a CPU accesses: here each CPU runs a
+ * kernel perf counter, and sampled user pages that live on a node other
+ * than the accessing CPU's are handed to migrate_misplaced_page().
+ *
+ * The overflow handler runs in NMI context, so it only pins the page with
+ * __get_user_pages_fast() and queues it on a small per-cpu ring; the
+ * migration decisions are made from a per-cpu work item.
+ */
+#include <linux/init.h>
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/irq_work.h>
+#include <linux/kobject.h>
+#include <linux/migrate.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+#include <linux/sysfs.h>
+#include <linux/vmstat.h>
+#include <linux/workqueue.h>
+
+#define NUMA_SAMPLE_BUF		64	/* must be a power of 2 */
+
+struct numa_sample_cpu {
+	struct perf_event *event;
+	struct irq_work irq_work;
+	struct work_struct work;
+	int cpu;
+	/* head is advanced from NMI context, tail from the work item */
+	unsigned int head;
+	unsigned int tail;
+	struct page *pages[NUMA_SAMPLE_BUF];
+};
+
+static DEFINE_PER_CPU(struct numa_sample_cpu, numa_sample_cpus);
+
+/* Protects the tunables below and starting/stopping the counters */
+static DEFINE_MUTEX(numa_sample_mutex);
+static enum cpuhp_state numa_sample_hp_state;
+static bool numa_sample_enabled;
+
+/* The sampling event, left to the admin as it is PMU specific */
+static u32 numa_sample_type = PERF_TYPE_RAW;
+static u64 numa_sample_config;
+static u64 numa_sample_config1;
+static u64 numa_sample_period = 10007;
+static unsigned int numa_sample_precise = 2;
+
+static void numa_sample_overflow(struct perf_event *event,
+				 struct perf_sample_data *data,
+				 struct pt_regs *regs)
+{
+	struct numa_sample_cpu *ns = this_cpu_ptr(&numa_sample_cpus);
+	unsigned int head = ns->head;
+	struct page *page;
+
+	if (!data->addr || data->addr >= TASK_SIZE || !current->mm)
+		return;
+
+	/* The ring is full; we can't drop a page reference from NMI */
+	if (head - READ_ONCE(ns->tail) >= NUMA_SAMPLE_BUF)
+		return;
+
+	if (__get_user_pages_fast(data->addr & PAGE_MASK, 1, 0, &page) != 1)
+		return;
+
+	ns->pages[head & (NUMA_SAMPLE_BUF - 1)] = page;
+	/* Publish the page before the new head */
+	smp_wmb();
+	WRITE_ONCE(ns->head, head + 1);
+	irq_work_queue(&ns->irq_work);
+}
+
+static void numa_sample_irq_work(struct irq_work *irq_work)
+{
+	struct numa_sample_cpu *ns = container_of(irq_work,
+					struct numa_sample_cpu, irq_work);
+
+	schedule_work_on(ns->cpu, &ns->work);
+}
+
+/*
+ * Consume queued samples.  With @migrate false the pages are just
+ * released, as when the counters are being torn down.
+ */
+static void numa_sample_drain(struct numa_sample_cpu *ns, bool migrate)
+{
+	int nid = cpu_to_node(ns->cpu);
+	unsigned int tail = ns->tail;
+
+	while (tail != READ_ONCE(ns->head)) {
+		struct page *page;
+
+		/* Pairs with smp_wmb() in numa_sample_overflow() */
+		smp_rmb();
+		page = ns->pages[tail & (NUMA_SAMPLE_BUF - 1)];
+		WRITE_ONCE(ns->tail, ++tail);
+
+		if (!migrate) {
+			put_page(page);
+			continue;
+		}
+
+		count_vm_numa_event(NUMA_SAMPLES);
+		if (page_to_nid(page) == nid || !node_state(nid, N_MEMORY) ||
+		    PageCompound(page) || !PageLRU(page)) {
+			put_page(page);
+			continue;
+		}
+
+		count_vm_numa_event(NUMA_SAMPLES_REMOTE);
+		/* drops our reference */
+		migrate_misplaced_page(page, NULL, nid);
+		cond_resched();
+	}
+}
+
+static void numa_sample_workfn(struct work_struct *work)
+{
+	struct numa_sample_cpu *ns = container_of(work,
+					struct numa_sample_cpu, work);
+
+	numa_sample_drain(ns, true);
+}
+
+static int numa_sample_cpu_online(unsigned int cpu)
+{
+	struct numa_sample_cpu *ns = per_cpu_ptr(&numa_sample_cpus, cpu);
+	struct perf_event_attr attr = {
+		.type		= numa_sample_type,
+		.size		= sizeof(attr),
+		.config		= numa_sample_config,
+		.config1	= numa_sample_config1,
+		.sample_period	= numa_sample_period,
+		.sample_type	= PERF_SAMPLE_ADDR,
+		.precise_ip	= numa_sample_precise,
+		.exclude_kernel	= 1,
+		.exclude_hv	= 1,
+	};
+	struct perf_event *event;
+
+	ns->cpu = cpu;
+	init_irq_work(&ns->irq_work, numa_sample_irq_work);
+	INIT_WORK(&ns->work, numa_sample_workfn);
+
+	event = perf_event_create_kernel_counter(&attr, cpu, NULL,
+						 numa_sample_overflow, NULL);
+	if (IS_ERR(event)) {
+		pr_err("numa_sample: can't create counter on cpu %u: %ld\n",
+		       cpu, PTR_ERR(event));
+		return PTR_ERR(event);
+	}
+
+	ns->event = event;
+	return 0;
+}
+
+static int numa_sample_cpu_offline(unsigned int cpu)
+{
+	struct numa_sample_cpu *ns = per_cpu_ptr(&numa_sample_cpus, cpu);
+
+	if (!ns->event)
+		return 0;
+
+	perf_event_release_kernel(ns->event);
+	ns->event = NULL;
+
+	irq_work_sync(&ns->irq_work);
+	cancel_work_sync(&ns->work);
+	numa_sample_drain(ns, false);
+	return 0;
+}
+
+static int numa_sample_start(void)
+{
+	int ret;
+
+	lockdep_assert_held(&numa_sample_mutex);
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "mm/numa_sample:online",
+				numa_sample_cpu_online,
+				numa_sample_cpu_offline);
+	if (ret < 0)
+		return ret;
+
+	numa_sample_hp_state = ret;
+	numa_sample_enabled = true;
+	return 0;
+}
+
+static void numa_sample_stop(void)
+{
+	lockdep_assert_held(&numa_sample_mutex);
+
+	cpuhp_remove_state(numa_sample_hp_state);
+	numa_sample_enabled = false;
+}
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", numa_sample_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	bool enable;
+	int err = 0;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	mutex_lock(&numa_sample_mutex);
+	if (enable && !numa_sample_enabled) {
+		if (!numa_sample_config && numa_sample_type == PERF_TYPE_RAW)
+			err = -EINVAL;
+		else
+			err = numa_sample_start();
+	} else if (!enable && numa_sample_enabled) {
+		numa_sample_stop();
+	}
+	mutex_unlock(&numa_sample_mutex);
+
+	return err ? err : count;
+}
+static struct kobj_attribute enabled_attr = __ATTR_RW(enabled);
+
+/*
+ * The event can only be changed while sampling is off, the counters are
+ * created from it when sampling is turned on.
+ */
+#define NUMA_SAMPLE_ATTR(_name, _var, _type)				\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%llu\n", (unsigned long long)_var);	\
+}									\
+static ssize_t _name##_store(struct kobject *kobj,			\
+			     struct kobj_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	_type val;							\
+	int err;							\
+									\
+	err = kstrto##_type(buf, 0, &val);				\
+	if (err)							\
+		return err;						\
+									\
+	mutex_lock(&numa_sample_mutex);					\
+	if (numa_sample_enabled)					\
+		err = -EBUSY;						\
+	else								\
+		_var = val;						\
+	mutex_unlock(&numa_sample_mutex);				\
+									\
+	return err ? err : count;					\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RW(_name)
+
+NUMA_SAMPLE_ATTR(event_type, numa_sample_type, u32);
+NUMA_SAMPLE_ATTR(event_config, numa_sample_config, u64);
+NUMA_SAMPLE_ATTR(event_config1, numa_sample_config1, u64);
+NUMA_SAMPLE_ATTR(sample_period, numa_sample_period, u64);
+NUMA_SAMPLE_ATTR(precise_ip, numa_sample_precise, uint);
+
+static struct attribute *numa_sample_attrs[] = {
+	&enabled_attr.attr,
+	&event_type_attr.attr,
+	&event_config_attr.attr,
+	&event_config1_attr.attr,
+	&sample_period_attr.attr,
+	&precise_ip_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group numa_sample_attr_group = {
+	.attrs = numa_sample_attrs,
+	.name = "numa_sample",
+};
+
+static int __init numa_sample_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &numa_sample_attr_group);
+	if (err) {
+		pr_err("numa_sample: register sysfs failed\n");
+		return err;
+	}
+	return 0;
+}
+subsys_initcall(numa_sample_init);
@@ -2100,32 +2100,24 @@ void __init page_writeback_init(void)
  */
 /*
  * We tag pages in batches of WRITEBACK_TAG_BATCH to reduce the i_pages lock
- * latency.
+ * latency.  The tags are set a tree node at a time, so a batch holds the
+ * lock for far less than WRITEBACK_TAG_BATCH tag walks.
  */
 void tag_pages_for_writeback(struct address_space *mapping,
 			     pgoff_t start, pgoff_t end)
 {
 #define WRITEBACK_TAG_BATCH 4096
-	unsigned long tagged = 0;
-	struct radix_tree_iter iter;
-	void **slot;
-
-	xa_lock_irq(&mapping->i_pages);
-	radix_tree_for_each_tagged(slot, &mapping->i_pages, &iter, start,
-							PAGECACHE_TAG_DIRTY) {
-		if (iter.index > end)
-			break;
-		radix_tree_iter_tag_set(&mapping->i_pages, &iter,
-							PAGECACHE_TAG_TOWRITE);
-		tagged++;
-		if ((tagged % WRITEBACK_TAG_BATCH) != 0)
-			continue;
-		slot = radix_tree_iter_resume(slot, &iter);
+	unsigned long tagged;
+
+	do {
+		xa_lock_irq(&mapping->i_pages);
+		tagged = radix_tree_range_tag_if_tagged(&mapping->i_pages,
+				&start, end, WRITEBACK_TAG_BATCH,
+				PAGECACHE_TAG_DIRTY, PAGECACHE_TAG_TOWRITE);
 		xa_unlock_irq(&mapping->i_pages);
 		cond_resched();
-		xa_lock_irq(&mapping->i_pages);
-	}
-	xa_unlock_irq(&mapping->i_pages);
+		/* We check 'start' to handle wrapping when end == ~0UL */
+	} while (tagged >= WRITEBACK_TAG_BATCH && start);
 }
 EXPORT_SYMBOL(tag_pages_for_writeback);
 
@@ -2232,6 +2224,15 @@ int write_cache_pages(struct address_space *mapping,
 					goto continue_unlock;
 			}
 
+			/*
+			 * A device may still be writing to a page pinned for
+			 * DMA, writing it back now would race with that.
+			 * Leave it to data integrity writeback.
+			 */
+			if (wbc->sync_mode == WB_SYNC_NONE &&
+			    page_maybe_dma_pinned(page))
+				goto continue_unlock;
+
 			BUG_ON(PageWriteback(page));
 			if (!clear_page_dirty_for_io(page))
 				goto continue_unlock;
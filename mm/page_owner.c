@@ -29,6 +29,15 @@ struct page_owner {
 static bool page_owner_disabled = true;
 DEFINE_STATIC_KEY_FALSE(page_owner_inited);
 
+/*
+ * Only record one in page_owner_sample allocations on each CPU: saving
+ * the stack is what makes page_owner expensive.  The pages counted
+ * against each stack in page_owner_stacks are then 1/page_owner_sample
+ * of what was really allocated from there.
+ */
+static unsigned int page_owner_sample = 1;
+static DEFINE_PER_CPU(unsigned int, page_owner_nr_allocs);
+
 static depot_stack_handle_t dummy_handle;
 static depot_stack_handle_t failure_handle;
 static depot_stack_handle_t early_handle;
@@ -47,6 +56,15 @@ static int __init early_page_owner_param(char *buf)
 }
 early_param("page_owner", early_page_owner_param);
 
+static int __init early_page_owner_sample_param(char *buf)
+{
+	if (!buf)
+		return -EINVAL;
+
+	return kstrtouint(buf, 0, &page_owner_sample);
+}
+early_param("page_owner_sample", early_page_owner_sample_param);
+
 static bool need_page_owner(void)
 {
 	if (page_owner_disabled)
@@ -111,12 +129,19 @@ void __reset_page_owner(struct page *page, unsigned int order)
 {
 	int i;
 	struct page_ext *page_ext;
+	struct page_owner *page_owner;
 
 	for (i = 0; i < (1 << order); i++) {
 		page_ext = lookup_page_ext(page + i);
 		if (unlikely(!page_ext))
 			continue;
-		__clear_bit(PAGE_EXT_OWNER, &page_ext->flags);
+		if (!__test_and_clear_bit(PAGE_EXT_OWNER, &page_ext->flags))
+			continue;
+
+		/* The head, or each page of a split one, accounts for itself */
+		page_owner = get_page_owner(page_ext);
+		depot_stack_count_add(page_owner->handle,
+				      -(1L << page_owner->order));
 	}
 }
 
@@ -187,13 +212,19 @@ noinline void __set_page_owner(struct page *page, unsigned int order,
 					gfp_t gfp_mask)
 {
 	struct page_ext *page_ext = lookup_page_ext(page);
+	unsigned int sample = READ_ONCE(page_owner_sample);
 	depot_stack_handle_t handle;
 
 	if (unlikely(!page_ext))
 		return;
 
+	/* The page stays without an owner, as a free page would be */
+	if (sample > 1 && this_cpu_inc_return(page_owner_nr_allocs) % sample)
+		return;
+
 	handle = save_stack(gfp_mask);
 	__set_page_owner_handle(page_ext, handle, order, gfp_mask);
+	depot_stack_count_add(handle, 1L << order);
 }
 
 void __set_page_owner_migrate_reason(struct page *page, int reason)
@@ -208,37 +239,64 @@ void __set_page_owner_migrate_reason(struct page *page, int reason)
 	page_owner->last_migrate_reason = reason;
 }
 
+static void copy_page_owner(struct page_ext *old_ext,
+			    struct page_ext *new_ext)
+{
+	struct page_owner *old_page_owner, *new_page_owner;
+
+	old_page_owner = get_page_owner(old_ext);
+	new_page_owner = get_page_owner(new_ext);
+	new_page_owner->order = old_page_owner->order;
+	new_page_owner->gfp_mask = old_page_owner->gfp_mask;
+	new_page_owner->last_migrate_reason =
+		old_page_owner->last_migrate_reason;
+	new_page_owner->handle = old_page_owner->handle;
+	__set_bit(PAGE_EXT_OWNER, &new_ext->flags);
+}
+
 void __split_page_owner(struct page *page, unsigned int order)
 {
 	int i;
 	struct page_ext *page_ext = lookup_page_ext(page);
+	struct page_ext *tail_ext;
 	struct page_owner *page_owner;
 
 	if (unlikely(!page_ext))
 		return;
 
+	/* Not sampled, the pieces have no owner either */
+	if (!test_bit(PAGE_EXT_OWNER, &page_ext->flags))
+		return;
+
+	/* Still the same number of pages against the stack */
 	page_owner = get_page_owner(page_ext);
 	page_owner->order = 0;
-	for (i = 1; i < (1 << order); i++)
-		__copy_page_owner(page, page + i);
+	for (i = 1; i < (1 << order); i++) {
+		tail_ext = lookup_page_ext(page + i);
+		if (likely(tail_ext))
+			copy_page_owner(page_ext, tail_ext);
+	}
 }
 
 void __copy_page_owner(struct page *oldpage, struct page *newpage)
 {
 	struct page_ext *old_ext = lookup_page_ext(oldpage);
 	struct page_ext *new_ext = lookup_page_ext(newpage);
-	struct page_owner *old_page_owner, *new_page_owner;
+	struct page_owner *new_page_owner;
 
 	if (unlikely(!old_ext || !new_ext))
 		return;
 
-	old_page_owner = get_page_owner(old_ext);
+	if (!test_bit(PAGE_EXT_OWNER, &old_ext->flags))
+		return;
+
+	/* The new page takes over from its own allocation */
 	new_page_owner = get_page_owner(new_ext);
-	new_page_owner->order = old_page_owner->order;
-	new_page_owner->gfp_mask = old_page_owner->gfp_mask;
-	new_page_owner->last_migrate_reason =
-		old_page_owner->last_migrate_reason;
-	new_page_owner->handle = old_page_owner->handle;
+	if (test_bit(PAGE_EXT_OWNER, &new_ext->flags))
+		depot_stack_count_add(new_page_owner->handle,
+				      -(1L << new_page_owner->order));
+
+	copy_page_owner(old_ext, new_ext);
 
 	/*
 	 * We don't clear the bit on the oldpage as it's going to be freed
@@ -248,8 +306,12 @@ void __copy_page_owner(struct page *oldpage, struct page *newpage)
 	 * migration and then we want the oldpage to retain the info. But
 	 * in that case we also don't need to explicitly clear the info from
 	 * the new page, which will be freed.
+	 *
+	 * Both pages are counted against the stack until then, as both
+	 * are going to be uncounted when freed.
 	 */
-	__set_bit(PAGE_EXT_OWNER, &new_ext->flags);
+	depot_stack_count_add(new_page_owner->handle,
+			      1L << new_page_owner->order);
 }
 
 void pagetypeinfo_showmixedcount_print(struct seq_file *m,
@@ -526,6 +588,62 @@ read_page_owner(struct file *file, char __user *buf, size_t count, loff_t *ppos)
 	return 0;
 }
 
+/*
+ * page_owner_stacks: each allocation stack with the number of (sampled)
+ * pages allocated from there and not freed yet, one stack per read() as
+ * for page_owner.  Cheap enough to poll, unlike a walk of all the pages.
+ */
+static ssize_t read_page_owner_stacks(struct file *file, char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	unsigned long entries[PAGE_OWNER_STACK_DEPTH];
+	struct stack_trace trace = {
+		.nr_entries = 0,
+		.entries = entries,
+		.max_entries = PAGE_OWNER_STACK_DEPTH,
+		.skip = 0
+	};
+	depot_stack_handle_t handle;
+	long nr_pages;
+	char *kbuf;
+	int ret;
+
+	if (!static_branch_unlikely(&page_owner_inited))
+		return -EINVAL;
+
+	/* Stacks whose pages have all been freed aren't interesting */
+	do {
+		handle = depot_next_stack(ppos, &nr_pages);
+	} while (handle && nr_pages <= 0);
+
+	if (!handle)
+		return 0;
+
+	kbuf = kmalloc(count, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	depot_fetch_stack(handle, &trace);
+	ret = snprint_stack_trace(kbuf, count, &trace, 0);
+	if (ret >= count)
+		goto err;
+
+	ret += snprintf(kbuf + ret, count - ret, "nr_pages: %ld\n\n",
+			nr_pages);
+	if (ret >= count)
+		goto err;
+
+	if (copy_to_user(buf, kbuf, ret))
+		ret = -EFAULT;
+
+	kfree(kbuf);
+	return ret;
+
+err:
+	kfree(kbuf);
+	return -ENOMEM;
+}
+
 static void init_pages_in_zone(pg_data_t *pgdat, struct zone *zone)
 {
 	unsigned long pfn = zone->zone_start_pfn;
@@ -592,6 +710,7 @@ static void init_pages_in_zone(pg_data_t *pgdat, struct zone *zone)
 		}
 		cond_resched();
 	}
+	depot_stack_count_add(early_handle, count);
 
 	pr_info("Node %d, zone %8s: page owner found early allocated %lu pages\n",
 		pgdat->node_id, zone->name, count);
@@ -622,6 +741,10 @@ static const struct file_operations proc_page_owner_operations = {
 	.read		= read_page_owner,
 };
 
+static const struct file_operations proc_page_owner_stacks_operations = {
+	.read		= read_page_owner_stacks,
+};
+
 static int __init pageowner_init(void)
 {
 	struct dentry *dentry;
@@ -633,6 +756,16 @@ static int __init pageowner_init(void)
 
 	dentry = debugfs_create_file("page_owner", S_IRUSR, NULL,
 			NULL, &proc_page_owner_operations);
+	if (IS_ERR(dentry))
+		return PTR_ERR(dentry);
+
+	dentry = debugfs_create_file("page_owner_stacks", S_IRUSR, NULL,
+			NULL, &proc_page_owner_stacks_operations);
+	if (IS_ERR(dentry))
+		return PTR_ERR(dentry);
+
+	dentry = debugfs_create_u32("page_owner_sample", S_IRUSR | S_IWUSR,
+			NULL, &page_owner_sample);
 
 	return PTR_ERR_OR_ZERO(dentry);
 }
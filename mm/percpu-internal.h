@@ -112,6 +112,9 @@ struct percpu_stats {
 	u32 nr_max_chunks;	/* max # of live chunks */
 	size_t min_alloc_size;	/* min allocaiton size */
 	size_t max_alloc_size;	/* max allocation size */
+	u64 nr_chunk_scans;	/* # of chunks searched by allocations */
+	u32 max_chunk_scans;	/* max # of chunks searched by one allocation */
+	u64 nr_pop_ahead;	/* # of pages populated ahead of allocations */
 };
 
 extern struct percpu_stats pcpu_stats;
@@ -170,6 +173,35 @@ static inline void pcpu_stats_area_dealloc(struct pcpu_chunk *chunk)
 	chunk->nr_alloc--;
 }
 
+/*
+ * pcpu_stats_chunk_scan - record how many chunks an allocation searched
+ * @nr: number of chunks looked at before the area was found
+ *
+ * CONTEXT:
+ * pcpu_lock.
+ */
+static inline void pcpu_stats_chunk_scan(int nr)
+{
+	lockdep_assert_held(&pcpu_lock);
+
+	pcpu_stats.nr_chunk_scans += nr;
+	pcpu_stats.max_chunk_scans = max_t(u32, pcpu_stats.max_chunk_scans, nr);
+}
+
+/*
+ * pcpu_stats_populate_ahead - count pages populated ahead of allocations
+ * @nr: number of pages
+ *
+ * CONTEXT:
+ * pcpu_lock.
+ */
+static inline void pcpu_stats_populate_ahead(int nr)
+{
+	lockdep_assert_held(&pcpu_lock);
+
+	pcpu_stats.nr_pop_ahead += nr;
+}
+
 /*
  * pcpu_stats_chunk_alloc - increment chunk stats
  */
@@ -212,6 +244,14 @@ static inline void pcpu_stats_area_dealloc(struct pcpu_chunk *chunk)
 {
 }
 
+static inline void pcpu_stats_chunk_scan(int nr)
+{
+}
+
+static inline void pcpu_stats_populate_ahead(int nr)
+{
+}
+
 static inline void pcpu_stats_chunk_alloc(void)
 {
 }
@@ -188,6 +188,9 @@ static int percpu_stats_show(struct seq_file *m, void *v)
 	PU(nr_max_chunks);
 	PU(min_alloc_size);
 	PU(max_alloc_size);
+	PU(nr_chunk_scans);
+	PU(max_chunk_scans);
+	PU(nr_pop_ahead);
 	P("empty_pop_pages", pcpu_nr_empty_pop_pages);
 	seq_putc(m, '\n');
 
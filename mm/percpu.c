@@ -92,7 +92,10 @@
 
 #include "percpu-internal.h"
 
-/* the slots are sorted by free bytes left, 1-31 bytes share the same slot */
+/*
+ * the slots are sorted by the largest contiguous free area, 1-31 bytes share
+ * the same slot
+ */
 #define PCPU_SLOT_BASE_SHIFT		5
 
 #define PCPU_EMPTY_POP_PAGES_LOW	2
@@ -221,12 +224,17 @@ static int pcpu_size_to_slot(int size)
 	return __pcpu_size_to_slot(size);
 }
 
+/*
+ * Chunks are slotted by their contig hint rather than by free bytes so that
+ * a fragmented chunk with plenty of small holes isn't visited, and scanned,
+ * by allocations it can't possibly serve.
+ */
 static int pcpu_chunk_slot(const struct pcpu_chunk *chunk)
 {
 	if (chunk->free_bytes < PCPU_MIN_ALLOC_SIZE || chunk->contig_bits == 0)
 		return 0;
 
-	return pcpu_size_to_slot(chunk->free_bytes);
+	return pcpu_size_to_slot(chunk->contig_bits * PCPU_MIN_ALLOC_SIZE);
 }
 
 /* set the pointer to a chunk in a page struct */
@@ -1323,6 +1331,50 @@ static struct pcpu_chunk *pcpu_chunk_addr_search(void *addr)
 	return pcpu_get_page_chunk(pcpu_addr_to_page(addr));
 }
 
+/**
+ * pcpu_populate_ahead - populate pages following a fresh allocation
+ * @chunk: chunk the allocation was served from
+ * @page_start: first page after the allocation
+ *
+ * Every population maps the new pages into the chunk and flushes, so a
+ * burst of small allocations pays that once per page while the balance
+ * work lags behind.  Since we are holding pcpu_alloc_mutex and touching
+ * this chunk anyway, top up the empty populated pages right here with the
+ * pages following the allocation, in one batch.  This is best effort; a
+ * failure leaves the rest to pcpu_balance_workfn().
+ *
+ * CONTEXT:
+ * pcpu_alloc_mutex, does GFP_KERNEL allocation.
+ */
+static void pcpu_populate_ahead(struct pcpu_chunk *chunk, int page_start)
+{
+	const gfp_t gfp = GFP_KERNEL | __GFP_NORETRY | __GFP_NOWARN;
+	int nr_to_pop, page_end, rs, re, ret;
+
+	lockdep_assert_held(&pcpu_alloc_mutex);
+
+	if (chunk->immutable)
+		return;
+
+	/* racy, but the balance work tolerates the same imprecision */
+	nr_to_pop = PCPU_EMPTY_POP_PAGES_HIGH - pcpu_nr_empty_pop_pages;
+	if (nr_to_pop <= 0)
+		return;
+
+	page_end = min(page_start + nr_to_pop, chunk->nr_pages);
+	pcpu_for_each_unpop_region(chunk->populated, rs, re, page_start,
+				   page_end) {
+		ret = pcpu_populate_chunk(chunk, rs, re, gfp);
+		if (ret)
+			break;
+
+		spin_lock_irq(&pcpu_lock);
+		pcpu_chunk_populated(chunk, rs, re, false);
+		pcpu_stats_populate_ahead(re - rs);
+		spin_unlock_irq(&pcpu_lock);
+	}
+}
+
 /**
  * pcpu_alloc - the percpu allocator
  * @size: size of area to allocate in bytes
@@ -1348,7 +1400,7 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	static int warn_limit = 10;
 	struct pcpu_chunk *chunk;
 	const char *err;
-	int slot, off, cpu, ret;
+	int slot, off, cpu, ret, nr_scanned = 0;
 	unsigned long flags;
 	void __percpu *ptr;
 	size_t bits, bit_align;
@@ -1409,6 +1461,7 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	/* search through normal chunks */
 	for (slot = pcpu_size_to_slot(size); slot < pcpu_nr_slots; slot++) {
 		list_for_each_entry(chunk, &pcpu_slot[slot], list) {
+			nr_scanned++;
 			off = pcpu_find_block_fit(chunk, bits, bit_align,
 						  is_atomic);
 			if (off < 0)
@@ -1450,6 +1503,7 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 
 area_found:
 	pcpu_stats_area_alloc(chunk, size);
+	pcpu_stats_chunk_scan(nr_scanned);
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 
 	/* populate if not all pages are already there */
@@ -1475,6 +1529,7 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 			spin_unlock_irqrestore(&pcpu_lock, flags);
 		}
 
+		pcpu_populate_ahead(chunk, page_end);
 		mutex_unlock(&pcpu_alloc_mutex);
 	}
 
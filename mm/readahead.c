@@ -113,6 +113,7 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 {
 	struct blk_plug plug;
 	unsigned page_idx;
+	LIST_HEAD(lru_pages);
 	int ret;
 
 	blk_start_plug(&plug);
@@ -127,10 +128,15 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = lru_to_page(pages);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping, page->index, gfp))
-			mapping->a_ops->readpage(filp, page);
-		put_page(page);
+		if (add_to_page_cache_nolru(page, mapping, page->index, gfp)) {
+			put_page(page);
+			continue;
+		}
+		/* Our reference keeps it on lru_pages until the LRU add */
+		list_add_tail(&page->lru, &lru_pages);
+		mapping->a_ops->readpage(filp, page);
 	}
+	lru_cache_add_list(&lru_pages);
 	ret = 0;
 
 out:
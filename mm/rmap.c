@@ -746,6 +746,54 @@ struct page_referenced_arg {
 	unsigned long vm_flags;
 	struct mem_cgroup *memcg;
 };
+
+/*
+ * When set, a young pte found during an rmap walk makes us look at the
+ * neighbouring ptes of the same page table. Pages mapped by young
+ * neighbours are activated in bulk, saving the rmap walks reclaim would
+ * otherwise spend on each of them while they sit on the inactive list.
+ */
+int sysctl_lru_look_around __read_mostly;
+
+/* Number of ptes examined on either side of a young pte */
+#define LRU_LOOK_AROUND_PTES	(BITS_PER_LONG / 2)
+
+static void page_referenced_look_around(struct page_vma_mapped_walk *pvmw)
+{
+	struct vm_area_struct *vma = pvmw->vma;
+	struct page *head = compound_head(pvmw->page);
+	unsigned long start, end, addr;
+	pte_t *pte;
+
+	start = max3(vma->vm_start, pvmw->address & PMD_MASK,
+		     pvmw->address - LRU_LOOK_AROUND_PTES * PAGE_SIZE);
+	end = min3(vma->vm_end, (pvmw->address & PMD_MASK) + PMD_SIZE,
+		   pvmw->address + (LRU_LOOK_AROUND_PTES + 1) * PAGE_SIZE);
+
+	/* pvmw->pte maps pvmw->address and we hold its page table lock */
+	pte = pvmw->pte - ((pvmw->address - start) >> PAGE_SHIFT);
+	for (addr = start; addr < end; addr += PAGE_SIZE, pte++) {
+		pte_t entry = *pte;
+		struct page *page;
+
+		if (!pte_present(entry) || !pte_young(entry))
+			continue;
+
+		page = vm_normal_page(vma, addr, entry);
+		if (!page || compound_head(page) == head)
+			continue;
+
+		if (PageActive(page) || PageUnevictable(page) || !PageLRU(page))
+			continue;
+
+		/*
+		 * The young bit is left alone: the page still gets a full
+		 * reference check once it ages off the active list.
+		 */
+		activate_page(page);
+	}
+}
+
 /*
  * arg: page_referenced_arg will be passed
  */
@@ -780,8 +828,11 @@ static bool page_referenced_one(struct page *page, struct vm_area_struct *vma,
 				 * already gone, the unmap path will have set
 				 * PG_referenced or activated the page.
 				 */
-				if (likely(!(vma->vm_flags & VM_SEQ_READ)))
+				if (likely(!(vma->vm_flags & VM_SEQ_READ))) {
 					referenced++;
+					if (READ_ONCE(sysctl_lru_look_around))
+						page_referenced_look_around(&pvmw);
+				}
 			}
 		} else if (IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE)) {
 			if (pmdp_clear_flush_young_notify(vma, address,
@@ -1188,8 +1239,10 @@ void page_add_file_rmap(struct page *page, bool compound)
 		}
 		if (!atomic_inc_and_test(compound_mapcount_ptr(page)))
 			goto out;
-		VM_BUG_ON_PAGE(!PageSwapBacked(page), page);
-		__inc_node_page_state(page, NR_SHMEM_PMDMAPPED);
+		if (PageSwapBacked(page))
+			__inc_node_page_state(page, NR_SHMEM_PMDMAPPED);
+		else
+			__inc_node_page_state(page, NR_FILE_PMDMAPPED);
 	} else {
 		if (PageTransCompound(page) && page_mapping(page)) {
 			VM_WARN_ON_ONCE(!PageLocked(page));
@@ -1228,8 +1281,10 @@ static void page_remove_file_rmap(struct page *page, bool compound)
 		}
 		if (!atomic_add_negative(-1, compound_mapcount_ptr(page)))
 			goto out;
-		VM_BUG_ON_PAGE(!PageSwapBacked(page), page);
-		__dec_node_page_state(page, NR_SHMEM_PMDMAPPED);
+		if (PageSwapBacked(page))
+			__dec_node_page_state(page, NR_SHMEM_PMDMAPPED);
+		else
+			__dec_node_page_state(page, NR_FILE_PMDMAPPED);
 	} else {
 		if (!atomic_add_negative(-1, &page->_mapcount))
 			goto out;
@@ -2260,6 +2260,21 @@ static void put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 #endif
 }
 
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+static void flush_remote_frees(struct kmem_cache *s, struct kmem_cache_cpu *c);
+static bool queue_remote_free(struct kmem_cache *s, void *object);
+#else
+static inline void flush_remote_frees(struct kmem_cache *s,
+				      struct kmem_cache_cpu *c)
+{
+}
+
+static inline bool queue_remote_free(struct kmem_cache *s, void *object)
+{
+	return false;
+}
+#endif
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -2278,6 +2293,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
 	if (likely(c)) {
+		if (slub_percpu_remote(c))
+			flush_remote_frees(s, c);
+
 		if (c->page)
 			flush_slab(s, c);
 
@@ -2297,7 +2315,7 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->page || slub_percpu_partial(c);
+	return c->page || slub_percpu_partial(c) || slub_percpu_remote(c);
 }
 
 static void flush_all(struct kmem_cache *s)
@@ -2939,7 +2957,7 @@ static __always_inline void do_slab_free(struct kmem_cache *s,
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
-	} else
+	} else if (tail || !queue_remote_free(s, head))
 		__slab_free(s, page, head, tail_obj, cnt, addr);
 
 }
@@ -3064,6 +3082,75 @@ int build_detached_freelist(struct kmem_cache *s, size_t size,
 	return first_skipped_index;
 }
 
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+/*
+ * Frees that miss the cpu slab mostly hit slabs that another cpu is
+ * allocating from, and each of them has to update the slab freelist with
+ * cmpxchg_double and may take the node list_lock.  If the cache has a
+ * remote_batch, such objects are queued per cpu instead and handed back
+ * like kmem_cache_free_bulk() does: one update per slab.
+ *
+ * The objects have already been through slab_free_freelist_hook().
+ */
+static void free_remote_objects(struct kmem_cache *s, void **p,
+				unsigned int nr)
+{
+	do {
+		struct detached_freelist df;
+
+		nr = build_detached_freelist(s, nr, p, &df);
+		if (!df.page)
+			continue;
+
+		stat(s, FREE_REMOTE_SLAB);
+		__slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			    _RET_IP_);
+	} while (likely(nr));
+}
+
+/* Called with interrupts disabled */
+static void flush_remote_frees(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	void *p[SLUB_REMOTE_BATCH_MAX];
+	unsigned int nr = c->nr_remote;
+
+	memcpy(p, c->remote, nr * sizeof(void *));
+	c->nr_remote = 0;
+	stat(s, FREE_REMOTE_FLUSH);
+	free_remote_objects(s, p, nr);
+}
+
+static bool queue_remote_free(struct kmem_cache *s, void *object)
+{
+	unsigned int batch = READ_ONCE(s->remote_batch);
+	void *p[SLUB_REMOTE_BATCH_MAX];
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	unsigned int nr;
+
+	if (!batch || kmem_cache_debug(s))
+		return false;
+
+	local_irq_save(flags);
+	c = this_cpu_ptr(s->cpu_slab);
+	c->remote[c->nr_remote++] = object;
+	stat(s, FREE_REMOTE_BATCH);
+	if (c->nr_remote < batch) {
+		local_irq_restore(flags);
+		return true;
+	}
+
+	nr = c->nr_remote;
+	memcpy(p, c->remote, nr * sizeof(void *));
+	c->nr_remote = 0;
+	stat(s, FREE_REMOTE_FLUSH);
+	local_irq_restore(flags);
+
+	free_remote_objects(s, p, nr);
+	return true;
+}
+#endif
+
 /* Note that interrupts must be enabled when calling this function. */
 void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 {
@@ -4960,6 +5047,31 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+static ssize_t remote_free_batch_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->remote_batch);
+}
+
+static ssize_t remote_free_batch_store(struct kmem_cache *s, const char *buf,
+				       size_t length)
+{
+	unsigned int objects;
+	int err;
+
+	err = kstrtouint(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects > SLUB_REMOTE_BATCH_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(s->remote_batch, objects);
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(remote_free_batch);
+#endif
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5366,6 +5478,9 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(FREE_REMOTE_BATCH, free_remote_batch);
+STAT_ATTR(FREE_REMOTE_FLUSH, free_remote_flush);
+STAT_ATTR(FREE_REMOTE_SLAB, free_remote_slab);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5375,6 +5490,9 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+#ifdef CONFIG_SLUB_REMOTE_FREE_BATCH
+	&remote_free_batch_attr.attr,
+#endif
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5432,6 +5550,9 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&free_remote_batch_attr.attr,
+	&free_remote_flush_attr.attr,
+	&free_remote_slab_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
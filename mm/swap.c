@@ -44,7 +44,22 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec, lru_add_pvec);
+/*
+ * Pages added by lru_cache_add() are queued per cpu and put on the LRU
+ * lists with one lru_lock section per batch.  Streaming page cache fills
+ * the batch fast and the lock is shared by all cpus of the node, so the
+ * batch is larger than a pagevec and grows with the number of cpus: see
+ * swap_setup().
+ */
+#define LRU_ADD_BATCH_MAX	63
+
+struct lru_add_vec {
+	unsigned int nr;
+	struct page *pages[LRU_ADD_BATCH_MAX];
+};
+
+static unsigned int lru_add_batch __read_mostly = PAGEVEC_SIZE;
+static DEFINE_PER_CPU(struct lru_add_vec, lru_add_vec);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_file_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
@@ -186,7 +201,7 @@ int get_kernel_page(unsigned long start, int write, struct page **pages)
 }
 EXPORT_SYMBOL_GPL(get_kernel_page);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
+static void pages_lru_move_fn(struct page **pages, int nr,
 	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
 	void *arg)
 {
@@ -195,8 +210,8 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 	struct lruvec *lruvec;
 	unsigned long flags = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
 		struct pglist_data *pagepgdat = page_pgdat(page);
 
 		if (pagepgdat != pgdat) {
@@ -211,7 +226,14 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 	}
 	if (pgdat)
 		spin_unlock_irqrestore(&pgdat->lru_lock, flags);
-	release_pages(pvec->pages, pvec->nr);
+	release_pages(pages, nr);
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
+	void *arg)
+{
+	pages_lru_move_fn(pvec->pages, pvec->nr, move_fn, arg);
 	pagevec_reinit(pvec);
 }
 
@@ -339,7 +361,7 @@ void activate_page(struct page *page)
 
 static void __lru_cache_activate_page(struct page *page)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvec);
+	struct lru_add_vec *lvec = &get_cpu_var(lru_add_vec);
 	int i;
 
 	/*
@@ -352,8 +374,8 @@ static void __lru_cache_activate_page(struct page *page)
 	 * a page is marked PageActive just after it is added to the inactive
 	 * list causing accounting errors and BUG_ON checks to trigger.
 	 */
-	for (i = pagevec_count(pvec) - 1; i >= 0; i--) {
-		struct page *pagevec_page = pvec->pages[i];
+	for (i = lvec->nr - 1; i >= 0; i--) {
+		struct page *pagevec_page = lvec->pages[i];
 
 		if (pagevec_page == page) {
 			SetPageActive(page);
@@ -361,7 +383,7 @@ static void __lru_cache_activate_page(struct page *page)
 		}
 	}
 
-	put_cpu_var(lru_add_pvec);
+	put_cpu_var(lru_add_vec);
 }
 
 /*
@@ -401,14 +423,25 @@ void mark_page_accessed(struct page *page)
 }
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void __pagevec_lru_add_fn(struct page *page, struct lruvec *lruvec,
+				 void *arg);
+
+static void lru_add_vec_drain(struct lru_add_vec *lvec)
+{
+	pages_lru_move_fn(lvec->pages, lvec->nr, __pagevec_lru_add_fn, NULL);
+	__count_vm_event(PGLRUADD_DRAIN);
+	lvec->nr = 0;
+}
+
 static void __lru_cache_add(struct page *page)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvec);
+	struct lru_add_vec *lvec = &get_cpu_var(lru_add_vec);
 
 	get_page(page);
-	if (!pagevec_add(pvec, page) || PageCompound(page))
-		__pagevec_lru_add(pvec);
-	put_cpu_var(lru_add_pvec);
+	lvec->pages[lvec->nr++] = page;
+	if (lvec->nr >= lru_add_batch || PageCompound(page))
+		lru_add_vec_drain(lvec);
+	put_cpu_var(lru_add_vec);
 }
 
 /**
@@ -576,10 +609,11 @@ static void lru_lazyfree_fn(struct page *page, struct lruvec *lruvec,
  */
 void lru_add_drain_cpu(int cpu)
 {
-	struct pagevec *pvec = &per_cpu(lru_add_pvec, cpu);
+	struct lru_add_vec *lvec = &per_cpu(lru_add_vec, cpu);
+	struct pagevec *pvec;
 
-	if (pagevec_count(pvec))
-		__pagevec_lru_add(pvec);
+	if (lvec->nr)
+		lru_add_vec_drain(lvec);
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
 	if (pagevec_count(pvec)) {
@@ -687,7 +721,7 @@ void lru_add_drain_all(void)
 	for_each_online_cpu(cpu) {
 		struct work_struct *work = &per_cpu(lru_add_drain_work, cpu);
 
-		if (pagevec_count(&per_cpu(lru_add_pvec, cpu)) ||
+		if (per_cpu(lru_add_vec, cpu).nr ||
 		    pagevec_count(&per_cpu(lru_rotate_pvecs, cpu)) ||
 		    pagevec_count(&per_cpu(lru_deactivate_file_pvecs, cpu)) ||
 		    pagevec_count(&per_cpu(lru_lazyfree_pvecs, cpu)) ||
@@ -920,6 +954,70 @@ void __pagevec_lru_add(struct pagevec *pvec)
 }
 EXPORT_SYMBOL(__pagevec_lru_add);
 
+/**
+ * lru_cache_add_list - add a list of pages to the LRU
+ * @pages: order-0 pages, linked through page->lru
+ *
+ * For callers that have a batch of pages at hand, like readahead of a
+ * large file: instead of trickling them through the per-cpu batch of
+ * lru_cache_add(), take the lru_lock once per node for up to
+ * LRU_ADD_BATCH_MAX pages.  The caller's reference on each page is
+ * dropped, @pages is left empty.
+ */
+void lru_cache_add_list(struct list_head *pages)
+{
+	LIST_HEAD(pages_to_free);
+	struct pglist_data *locked_pgdat = NULL;
+	struct lruvec *lruvec;
+	struct page *page, *next;
+	unsigned long uninitialized_var(flags);
+	unsigned int uninitialized_var(lock_batch);
+	unsigned int nr = 0;
+
+	list_for_each_entry_safe(page, next, pages, lru) {
+		struct pglist_data *pgdat = page_pgdat(page);
+
+		VM_BUG_ON_PAGE(PageCompound(page), page);
+
+		/* Same bound on the IRQ-safe lock hold time as for lru_add_vec */
+		if (locked_pgdat && ++lock_batch == LRU_ADD_BATCH_MAX) {
+			spin_unlock_irqrestore(&locked_pgdat->lru_lock, flags);
+			locked_pgdat = NULL;
+		}
+
+		if (pgdat != locked_pgdat) {
+			if (locked_pgdat)
+				spin_unlock_irqrestore(&locked_pgdat->lru_lock,
+						       flags);
+			lock_batch = 0;
+			locked_pgdat = pgdat;
+			spin_lock_irqsave(&locked_pgdat->lru_lock, flags);
+		}
+
+		list_del(&page->lru);
+		lruvec = mem_cgroup_page_lruvec(page, locked_pgdat);
+		__pagevec_lru_add_fn(page, lruvec, NULL);
+		nr++;
+
+		/*
+		 * The page was truncated while we held the last reference:
+		 * free it like release_pages() does.
+		 */
+		if (unlikely(put_page_testzero(page))) {
+			__ClearPageLRU(page);
+			del_page_from_lru_list(page, lruvec, page_off_lru(page));
+			__ClearPageWaiters(page);
+			list_add(&page->lru, &pages_to_free);
+		}
+	}
+	if (locked_pgdat)
+		spin_unlock_irqrestore(&locked_pgdat->lru_lock, flags);
+
+	count_vm_events(PGLRUADD_LIST, nr);
+	mem_cgroup_uncharge_list(&pages_to_free);
+	free_unref_page_list(&pages_to_free);
+}
+
 /**
  * pagevec_lookup_entries - gang pagecache lookup
  * @pvec:	Where the resulting entries are placed
@@ -1026,6 +1124,13 @@ void __init swap_setup(void)
 {
 	unsigned long megs = totalram_pages >> (20 - PAGE_SHIFT);
 
+	/*
+	 * Every doubling of cpus sharing an lru_lock makes it hotter;
+	 * grow the lru_add batch by half a pagevec per doubling.
+	 */
+	lru_add_batch = min_t(unsigned int, LRU_ADD_BATCH_MAX,
+			PAGEVEC_SIZE + PAGEVEC_SIZE * ilog2(num_possible_cpus()) / 2);
+
 	/* Use a smaller cluster for small-memory machines */
 	if (megs < 16)
 		page_cluster = 2;
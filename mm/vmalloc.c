@@ -22,7 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/notifier.h>
-#include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -329,17 +329,59 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 static DEFINE_SPINLOCK(vmap_area_lock);
 /* Export for kexec only */
 LIST_HEAD(vmap_area_list);
-static LLIST_HEAD(vmap_purge_list);
+static DEFINE_PER_CPU(struct llist_head, vmap_purge_lists);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * The busy area rbtree is augmented the same way the vma tree of an mm is:
+ * every vmap_area records the largest hole found in front of any area in
+ * its subtree, the hole in front of an area being the space between it and
+ * its predecessor in vmap_area_list.  That lets alloc_vmap_area() skip
+ * subtrees which can't possibly hold the request instead of walking the
+ * list of busy areas.
+ */
+static unsigned long va_prev_end(struct vmap_area *va)
+{
+	if (va->list.prev == &vmap_area_list)
+		return 0;
+
+	return list_prev_entry(va, list)->va_end;
+}
+
+static unsigned long va_compute_subtree_gap(struct vmap_area *va)
+{
+	unsigned long max, subtree_gap;
+
+	max = va->va_start - va_prev_end(va);
+	if (va->rb_node.rb_left) {
+		subtree_gap = rb_entry(va->rb_node.rb_left,
+				struct vmap_area, rb_node)->subtree_gap;
+		if (subtree_gap > max)
+			max = subtree_gap;
+	}
+	if (va->rb_node.rb_right) {
+		subtree_gap = rb_entry(va->rb_node.rb_right,
+				struct vmap_area, rb_node)->subtree_gap;
+		if (subtree_gap > max)
+			max = subtree_gap;
+	}
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, va_gap_callbacks, struct vmap_area, rb_node,
+		     unsigned long, subtree_gap, va_compute_subtree_gap)
+
+/*
+ * Update augmented subtree_gap values after the hole in front of @va
+ * changed size.
+ */
+static void va_gap_update(struct vmap_area *va)
+{
+	va_gap_callbacks_propagate(&va->rb_node, NULL);
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -379,7 +421,6 @@ static void __insert_vmap_area(struct vmap_area *va)
 	}
 
 	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
 
 	/* address-sort this list */
 	tmp = rb_prev(&va->rb_node);
@@ -389,6 +430,111 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	/* The hole in front of the following area just shrank */
+	va->subtree_gap = 0;
+	if (!list_is_last(&va->list, &vmap_area_list))
+		va_gap_update(list_next_entry(va, list));
+	va_gap_update(va);
+	rb_insert_augmented(&va->rb_node, &vmap_area_root, &va_gap_callbacks);
+}
+
+/*
+ * Check whether [gap_start, gap_end) holds @size bytes aligned to @align
+ * within [vstart, vend), and return the lowest such address in @addr.
+ */
+static bool vmap_hole_fits(unsigned long gap_start, unsigned long gap_end,
+			unsigned long size, unsigned long align,
+			unsigned long vstart, unsigned long vend,
+			unsigned long *addr)
+{
+	unsigned long start = max(gap_start, vstart);
+	unsigned long end = min(gap_end, vend);
+
+	*addr = ALIGN(start, align);
+	if (*addr < start || *addr + size < *addr)
+		return false;
+
+	return *addr + size <= end;
+}
+
+/*
+ * Find the lowest hole of @size bytes aligned to @align within
+ * [vstart, vend).  The subtree gaps only prune the search, alignment and
+ * range are checked exactly on each candidate hole, so a subtree may be
+ * entered and left again without a match.
+ */
+static bool __find_vmap_hole(unsigned long size, unsigned long align,
+			unsigned long vstart, unsigned long vend,
+			unsigned long *addr)
+{
+	struct vmap_area *va;
+	unsigned long gap_start, gap_end;
+
+	if (RB_EMPTY_ROOT(&vmap_area_root))
+		goto check_highest;
+
+	va = rb_entry(vmap_area_root.rb_node, struct vmap_area, rb_node);
+	if (va->subtree_gap < size)
+		goto check_highest;
+
+	while (true) {
+		/* Visit left subtree if it looks promising */
+		gap_end = va->va_start;
+		if (gap_end > vstart && va->rb_node.rb_left) {
+			struct vmap_area *left =
+				rb_entry(va->rb_node.rb_left,
+					 struct vmap_area, rb_node);
+			if (left->subtree_gap >= size) {
+				va = left;
+				continue;
+			}
+		}
+
+		gap_start = va_prev_end(va);
+check_current:
+		/* Holes are visited in address order */
+		if (gap_start >= vend)
+			return false;
+		if (vmap_hole_fits(gap_start, gap_end, size, align,
+				   vstart, vend, addr))
+			return true;
+
+		/* Visit right subtree if it looks promising */
+		if (va->rb_node.rb_right) {
+			struct vmap_area *right =
+				rb_entry(va->rb_node.rb_right,
+					 struct vmap_area, rb_node);
+			if (right->subtree_gap >= size) {
+				va = right;
+				continue;
+			}
+		}
+
+		/* Go back up the rbtree to find next candidate node */
+		while (true) {
+			struct rb_node *prev = &va->rb_node;
+
+			if (!rb_parent(prev))
+				goto check_highest;
+			va = rb_entry(rb_parent(prev),
+				      struct vmap_area, rb_node);
+			if (prev == va->rb_node.rb_left) {
+				gap_start = va_prev_end(va);
+				gap_end = va->va_start;
+				goto check_current;
+			}
+		}
+	}
+
+check_highest:
+	gap_start = 0;
+	if (!list_empty(&vmap_area_list))
+		gap_start = list_last_entry(&vmap_area_list,
+					struct vmap_area, list)->va_end;
+
+	return vmap_hole_fits(gap_start, vend, size, align,
+			      vstart, vend, addr);
 }
 
 static void purge_vmap_area_lazy(void);
@@ -405,10 +551,8 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
@@ -429,83 +573,13 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_next_entry(first, list);
-	}
-
-found:
-	if (addr + size > vend)
+	if (!__find_vmap_hole(size, align, vstart, vend, &addr))
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
@@ -552,26 +626,23 @@ EXPORT_SYMBOL_GPL(unregister_vmap_purge_notifier);
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_area *next = NULL;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
+	if (!list_is_last(&va->list, &vmap_area_list))
+		next = list_next_entry(va, list);
+
+	/*
+	 * The gap callbacks look at va's list neighbours, so unlink it from
+	 * the list only once it is out of the tree, then account the hole it
+	 * leaves in front of the next area.
+	 */
+	rb_erase_augmented(&va->rb_node, &vmap_area_root, &va_gap_callbacks);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
+	if (next)
+		va_gap_update(next);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -654,23 +725,33 @@ void set_iounmap_nonlazy(void)
  */
 static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 {
-	struct llist_node *valist;
+	struct llist_node *valist = NULL;
 	struct vmap_area *va;
 	struct vmap_area *n_va;
-	bool do_free = false;
+	int cpu;
 
 	lockdep_assert_held(&vmap_purge_lock);
 
-	valist = llist_del_all(&vmap_purge_list);
-	llist_for_each_entry(va, valist, purge_list) {
-		if (va->va_start < start)
-			start = va->va_start;
-		if (va->va_end > end)
-			end = va->va_end;
-		do_free = true;
+	/* Gather every CPU's lazy list into one chain */
+	for_each_possible_cpu(cpu) {
+		struct llist_node *first, *last = NULL;
+
+		first = llist_del_all(per_cpu_ptr(&vmap_purge_lists, cpu));
+		llist_for_each_entry(va, first, purge_list) {
+			if (va->va_start < start)
+				start = va->va_start;
+			if (va->va_end > end)
+				end = va->va_end;
+			last = &va->purge_list;
+		}
+
+		if (last) {
+			last->next = valist;
+			valist = first;
+		}
 	}
 
-	if (!do_free)
+	if (!valist)
 		return false;
 
 	flush_tlb_kernel_range(start, end);
@@ -722,8 +803,11 @@ static void free_vmap_area_noflush(struct vmap_area *va)
 	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
 				    &vmap_lazy_nr);
 
-	/* After this point, we may free va at any time */
-	llist_add(&va->purge_list, &vmap_purge_list);
+	/*
+	 * After this point, we may free va at any time.  The purge drains
+	 * all CPUs' lists, so it doesn't matter if we migrate meanwhile.
+	 */
+	llist_add(&va->purge_list, raw_cpu_ptr(&vmap_purge_lists));
 
 	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
@@ -55,6 +55,8 @@
 
 #include <linux/swapops.h>
 #include <linux/balloon_compaction.h>
+#include <linux/migrate.h>
+#include <linux/psi.h>
 
 #include "internal.h"
 
@@ -111,6 +113,15 @@ struct scan_control {
 	/* One of the zones is ready for compaction */
 	unsigned int compaction_ready:1;
 
+	/* Don't migrate cold pages to a slower node instead of reclaiming */
+	unsigned int no_demotion:1;
+
+	/*
+	 * Swappiness requested by proactive reclaim through memory.reclaim,
+	 * overriding the memcg's own setting. NULL if not proactive.
+	 */
+	int *proactive_swappiness;
+
 	/* Incremented by the number of inactive pages that were scanned */
 	unsigned long nr_scanned;
 
@@ -247,6 +258,34 @@ static inline bool memcg_congested(struct pglist_data *pgdat,
 }
 #endif
 
+/*
+ * Demotion keeps the memcg charge, so it does nothing for a cgroup that
+ * hit its limit; only global reclaim demotes.
+ */
+static bool can_demote(int nid, struct scan_control *sc)
+{
+	if (sc && (sc->no_demotion || !global_reclaim(sc)))
+		return false;
+	return next_demotion_node(nid) != NUMA_NO_NODE;
+}
+
+/*
+ * Anonymous pages can be reclaimed if there is swap space for them, or
+ * if the node demotes its cold pages to a slower node.
+ */
+static bool can_reclaim_anon_pages(struct mem_cgroup *memcg, int nid,
+				   struct scan_control *sc)
+{
+	if (memcg == NULL) {
+		if (get_nr_swap_pages() > 0)
+			return true;
+	} else {
+		if (mem_cgroup_get_nr_swap_pages(memcg) > 0)
+			return true;
+	}
+	return can_demote(nid, sc);
+}
+
 /*
  * This misses isolated pages which are not accounted for to save counters.
  * As the data only determines if reclaim or compaction continues, it is
@@ -258,7 +297,7 @@ unsigned long zone_reclaimable_pages(struct zone *zone)
 
 	nr = zone_page_state_snapshot(zone, NR_ZONE_INACTIVE_FILE) +
 		zone_page_state_snapshot(zone, NR_ZONE_ACTIVE_FILE);
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, zone_to_nid(zone), NULL))
 		nr += zone_page_state_snapshot(zone, NR_ZONE_INACTIVE_ANON) +
 			zone_page_state_snapshot(zone, NR_ZONE_ACTIVE_ANON);
 
@@ -921,6 +960,100 @@ static void page_check_dirty_writeback(struct page *page,
 		mapping->a_ops->is_dirty_writeback(page, dirty, writeback);
 }
 
+#ifdef CONFIG_MIGRATION
+struct demote_control {
+	int nid;
+	unsigned int nr_alloc;
+	unsigned int nr_free;
+};
+
+static struct page *alloc_demote_page(struct page *page, unsigned long data)
+{
+	struct demote_control *dc = (struct demote_control *)data;
+	/*
+	 * Don't reclaim on the target node on behalf of this one, only
+	 * wake its kswapd: it in turn demotes further or swaps.
+	 */
+	gfp_t gfp_mask = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+			 __GFP_THISNODE | __GFP_NOWARN | __GFP_NOMEMALLOC |
+			 __GFP_KSWAPD_RECLAIM;
+	struct page *newpage;
+
+	if (PageTransHuge(page)) {
+		newpage = alloc_pages_node(dc->nid,
+				GFP_TRANSHUGE_LIGHT | __GFP_THISNODE |
+				__GFP_KSWAPD_RECLAIM, HPAGE_PMD_ORDER);
+		if (newpage)
+			prep_transhuge_page(newpage);
+	} else {
+		newpage = __alloc_pages_node(dc->nid, gfp_mask, 0);
+	}
+
+	if (newpage)
+		dc->nr_alloc++;
+	return newpage;
+}
+
+static void free_demote_page(struct page *page, unsigned long data)
+{
+	struct demote_control *dc = (struct demote_control *)data;
+
+	dc->nr_free++;
+	put_page(page);
+}
+
+/*
+ * Migrate the isolated pages on @demote_pages to the demotion target of
+ * @pgdat.  Pages that were demoted or that failed for good are gone from
+ * the list; those left over could not get a page on the target node and
+ * should be reclaimed normally.  Returns the number of demoted pages.
+ */
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	struct demote_control dc = {
+		.nid = next_demotion_node(pgdat->node_id),
+	};
+	unsigned long nr_isolated[2] = { 0, };
+	unsigned int nr_demoted;
+	struct page *page;
+
+	if (list_empty(demote_pages))
+		return 0;
+	if (dc.nid == NUMA_NO_NODE || !node_state(dc.nid, N_MEMORY))
+		return 0;
+
+	/*
+	 * migrate_pages() drops NR_ISOLATED_* for every page it is done
+	 * with, but shrink_inactive_list() drops it for everything it took.
+	 */
+	list_for_each_entry(page, demote_pages, lru)
+		nr_isolated[page_is_file_cache(page)] += hpage_nr_pages(page);
+
+	migrate_pages(demote_pages, alloc_demote_page, free_demote_page,
+		      (unsigned long)&dc, MIGRATE_ASYNC, MR_DEMOTION);
+
+	list_for_each_entry(page, demote_pages, lru)
+		nr_isolated[page_is_file_cache(page)] -= hpage_nr_pages(page);
+	mod_node_page_state(pgdat, NR_ISOLATED_ANON, nr_isolated[0]);
+	mod_node_page_state(pgdat, NR_ISOLATED_FILE, nr_isolated[1]);
+
+	nr_demoted = dc.nr_alloc - dc.nr_free;
+	if (current_is_kswapd())
+		count_vm_events(PGDEMOTE_KSWAPD, nr_demoted);
+	else
+		count_vm_events(PGDEMOTE_DIRECT, nr_demoted);
+
+	return nr_demoted;
+}
+#else
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	return 0;
+}
+#endif
+
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
@@ -933,6 +1066,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(demote_pages);
+	bool do_demote_pass = can_demote(pgdat->node_id, sc);
 	int pgactivate = 0;
 	unsigned nr_unqueued_dirty = 0;
 	unsigned nr_dirty = 0;
@@ -945,6 +1080,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 	cond_resched();
 
+retry:
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
 		struct page *page;
@@ -1095,6 +1231,24 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * A page pinned for DMA can be neither freed nor moved,
+		 * unmapping it or writing it to swap would be wasted work.
+		 */
+		if (page_maybe_dma_pinned(page))
+			goto activate_locked;
+
+		/*
+		 * Before reclaiming the page, try to move it to a slower
+		 * node; demote_page_list() hands back what doesn't fit.
+		 */
+		if (do_demote_pass &&
+		    (thp_migration_supported() || !PageTransHuge(page))) {
+			list_add(&page->lru, &demote_pages);
+			unlock_page(page);
+			continue;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -1317,6 +1471,14 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		VM_BUG_ON_PAGE(PageLRU(page) || PageUnevictable(page), page);
 	}
 
+	/* Migrate the pages selected for demotion, reclaim the rest */
+	nr_reclaimed += demote_page_list(&demote_pages, pgdat);
+	if (!list_empty(&demote_pages)) {
+		list_splice_init(&demote_pages, page_list);
+		do_demote_pass = false;
+		goto retry;
+	}
+
 	mem_cgroup_uncharge_list(&free_pages);
 	try_to_unmap_flush();
 	free_unref_page_list(&free_pages);
@@ -1344,6 +1506,7 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 		.gfp_mask = GFP_KERNEL,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
+		.no_demotion = 1,
 	};
 	unsigned long ret;
 	struct page *page, *next;
@@ -2043,17 +2206,17 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 	unsigned long gb;
 
 	/*
-	 * If we don't have swap space, anonymous page deactivation
-	 * is pointless.
+	 * If we don't have swap space or a node to demote to, anonymous
+	 * page deactivation is pointless.
 	 */
-	if (!file && !total_swap_pages)
+	if (!file && !total_swap_pages && !can_demote(pgdat->node_id, sc))
 		return false;
 
 	inactive = lruvec_lru_size(lruvec, inactive_lru, sc->reclaim_idx);
 	active = lruvec_lru_size(lruvec, active_lru, sc->reclaim_idx);
 
 	if (memcg)
-		refaults = memcg_page_state(memcg, WORKINGSET_ACTIVATE);
+		refaults = memcg_page_state_local(memcg, WORKINGSET_ACTIVATE);
 	else
 		refaults = node_page_state(pgdat, WORKINGSET_ACTIVATE);
 
@@ -2115,7 +2278,8 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 			   struct scan_control *sc, unsigned long *nr,
 			   unsigned long *lru_pages)
 {
-	int swappiness = mem_cgroup_swappiness(memcg);
+	int swappiness = sc->proactive_swappiness ?
+		*sc->proactive_swappiness : mem_cgroup_swappiness(memcg);
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
 	u64 fraction[2];
 	u64 denominator = 0;	/* gcc */
@@ -2126,8 +2290,15 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	unsigned long ap, fp;
 	enum lru_list lru;
 
+	/* Proactive reclaim asked for anonymous memory only */
+	if (swappiness == SWAPPINESS_ANON_ONLY) {
+		scan_balance = SCAN_ANON;
+		goto out;
+	}
+
 	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	if (!sc->may_swap ||
+	    !can_reclaim_anon_pages(memcg, pgdat->node_id, sc)) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
@@ -2488,7 +2659,7 @@ static inline bool should_continue_reclaim(struct pglist_data *pgdat,
 	 */
 	pages_for_compaction = compact_gap(sc->order);
 	inactive_lru_pages = node_page_state(pgdat, NR_INACTIVE_FILE);
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, pgdat->node_id, sc))
 		inactive_lru_pages += node_page_state(pgdat, NR_INACTIVE_ANON);
 	if (sc->nr_reclaimed < pages_for_compaction &&
 			inactive_lru_pages > pages_for_compaction)
@@ -2524,6 +2695,9 @@ static bool shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 	unsigned long nr_reclaimed, nr_scanned;
 	bool reclaimable = false;
 
+	/* The refault detection below compares memcg stat snapshots */
+	mem_cgroup_flush_stats();
+
 	do {
 		struct mem_cgroup *root = sc->target_mem_cgroup;
 		struct mem_cgroup_reclaim_cookie reclaim = {
@@ -2827,7 +3001,8 @@ static void snapshot_refaults(struct mem_cgroup *root_memcg, pg_data_t *pgdat)
 		struct lruvec *lruvec;
 
 		if (memcg)
-			refaults = memcg_page_state(memcg, WORKINGSET_ACTIVATE);
+			refaults = memcg_page_state_local(memcg,
+							WORKINGSET_ACTIVATE);
 		else
 			refaults = node_page_state(pgdat, WORKINGSET_ACTIVATE);
 
@@ -3126,11 +3301,13 @@ unsigned long mem_cgroup_shrink_node(struct mem_cgroup *memcg,
 unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					   unsigned long nr_pages,
 					   gfp_t gfp_mask,
-					   bool may_swap)
+					   bool may_swap,
+					   int *swappiness)
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
 	int nid;
+	unsigned long pflags;
 	unsigned int noreclaim_flag;
 	struct scan_control sc = {
 		.nr_to_reclaim = max(nr_pages, SWAP_CLUSTER_MAX),
@@ -3142,6 +3319,7 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 		.may_writepage = !laptop_mode,
 		.may_unmap = 1,
 		.may_swap = may_swap,
+		.proactive_swappiness = swappiness,
 	};
 
 	/*
@@ -3158,9 +3336,13 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					    sc.gfp_mask,
 					    sc.reclaim_idx);
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
+
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
@@ -3173,7 +3355,7 @@ static void age_active_anon(struct pglist_data *pgdat,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	if (!total_swap_pages && !can_demote(pgdat->node_id, sc))
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
@@ -3325,6 +3507,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 	int i;
 	unsigned long nr_soft_reclaimed;
 	unsigned long nr_soft_scanned;
+	unsigned long pflags;
 	struct zone *zone;
 	struct scan_control sc = {
 		.gfp_mask = GFP_KERNEL,
@@ -3335,6 +3518,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		.may_swap = 1,
 	};
 
+	psi_memstall_enter(&pflags);
 	__fs_reclaim_acquire();
 
 	count_vm_event(PAGEOUTRUN);
@@ -3436,6 +3620,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 out:
 	snapshot_refaults(NULL, pgdat);
 	__fs_reclaim_release();
+	psi_memstall_leave(&pflags);
 	/*
 	 * Return the order kswapd stopped reclaiming at as
 	 * prepare_kswapd_sleep() takes it into account. If another caller
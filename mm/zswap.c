@@ -61,7 +61,7 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /* Pool limit was hit (see zswap_max_pool_percent) */
 static u64 zswap_pool_limit_hit;
-/* Pages written back when pool limit was reached */
+/* Pages written back when pool limit was reached or by the shrinker */
 static u64 zswap_written_back_pages;
 /* Store failed due to a reclaim failure after pool limit was reached */
 static u64 zswap_reject_reclaim_fail;
@@ -123,6 +123,13 @@ static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
 		   bool, 0644);
 
+/*
+ * Enable/disable writing back the coldest entries under memory pressure
+ * (disabled by default)
+ */
+static bool zswap_shrinker_enabled;
+module_param_named(shrinker_enabled, zswap_shrinker_enabled, bool, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -135,6 +142,8 @@ struct zswap_pool {
 	struct work_struct work;
 	struct hlist_node node;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
+	struct list_head lru;	/* compressed entries, coldest at the tail */
+	spinlock_t lru_lock;
 };
 
 /*
@@ -144,6 +153,8 @@ struct zswap_pool {
  * page within zswap.
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
+ * lru - links a compressed entry into the LRU of its pool
+ * type - the swap type of the entry
  * offset - the swap offset for the entry.  Index into the red-black tree.
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
@@ -159,6 +170,8 @@ struct zswap_pool {
  */
 struct zswap_entry {
 	struct rb_node rbnode;
+	struct list_head lru;
+	unsigned int type;
 	pgoff_t offset;
 	int refcount;
 	unsigned int length;
@@ -177,13 +190,23 @@ struct zswap_header {
  * The tree lock in the zswap_tree struct protects a few things:
  * - the rbtree
  * - the refcount field of each entry in the tree
+ *
+ * It nests outside of the pool lru_lock.
  */
 struct zswap_tree {
 	struct rb_root rbroot;
 	spinlock_t lock;
-};
+} ____cacheline_aligned_in_smp;
+
+/*
+ * Each swap type has nr_zswap_trees trees, and a swap offset picks one by
+ * its swap cluster.  Swap slots are handed out per cpu in clusters, so
+ * cpus storing pages concurrently mostly work on different trees.
+ */
+#define ZSWAP_TREE_SHIFT	8
 
 static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+static unsigned int nr_zswap_trees __read_mostly;
 
 /* RCU-protected iteration */
 static LIST_HEAD(zswap_pools);
@@ -209,12 +232,12 @@ static bool zswap_has_pool;
 	pr_debug("%s pool %s/%s\n", msg, (p)->tfm_name,		\
 		 zpool_get_type((p)->zpool))
 
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
+static int zswap_zpool_evict(struct zpool *pool, unsigned long handle);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
 
 static const struct zpool_ops zswap_zpool_ops = {
-	.evict = zswap_writeback_entry
+	.evict = zswap_zpool_evict
 };
 
 static bool zswap_is_full(void)
@@ -238,6 +261,15 @@ static void zswap_update_total_size(void)
 	zswap_pool_total_size = total;
 }
 
+static struct zswap_tree *swap_zswap_tree(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *trees = zswap_trees[type];
+
+	if (!trees)
+		return NULL;
+	return &trees[(offset >> ZSWAP_TREE_SHIFT) & (nr_zswap_trees - 1)];
+}
+
 /*********************************
 * zswap entry functions
 **********************************/
@@ -262,6 +294,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 		return NULL;
 	entry->refcount = 1;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -334,6 +367,9 @@ static void zswap_free_entry(struct zswap_entry *entry)
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
+		spin_lock(&entry->pool->lru_lock);
+		list_del(&entry->lru);
+		spin_unlock(&entry->pool->lru_lock);
 		zpool_free(entry->pool->zpool, entry->handle);
 		zswap_pool_put(entry->pool);
 	}
@@ -363,6 +399,19 @@ static void zswap_entry_put(struct zswap_tree *tree,
 	}
 }
 
+/*
+ * caller must hold the tree lock
+ * make a compressed entry the most recently used one of its pool
+ */
+static void zswap_lru_add(struct zswap_entry *entry)
+{
+	if (!entry->length)
+		return;
+	spin_lock(&entry->pool->lru_lock);
+	list_move(&entry->lru, &entry->pool->lru);
+	spin_unlock(&entry->pool->lru_lock);
+}
+
 /* caller must hold the tree lock */
 static struct zswap_entry *zswap_entry_find_get(struct rb_root *root,
 				pgoff_t offset)
@@ -560,6 +609,8 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	 */
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
+	INIT_LIST_HEAD(&pool->lru);
+	spin_lock_init(&pool->lru_lock);
 
 	zswap_pool_debug("created", pool);
 
@@ -845,14 +896,14 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds a reference on the entry, which is dropped here.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_entry(struct zswap_tree *tree,
+				 struct zswap_entry *entry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
-	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
+	swp_entry_t swpentry = swp_entry(entry->type, entry->offset);
+	pgoff_t offset = entry->offset;
 	struct page *page;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
@@ -862,24 +913,6 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	zpool_unmap_handle(pool, handle);
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
-
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
 	case ZSWAP_SWAPCACHE_FAIL: /* no memory or invalidate happened */
@@ -895,8 +928,10 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
 		/* decompress */
 		dlen = PAGE_SIZE;
-		src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
-				ZPOOL_MM_RO) + sizeof(struct zswap_header);
+		src = zpool_map_handle(entry->pool->zpool, entry->handle,
+				ZPOOL_MM_RO);
+		if (zpool_evictable(entry->pool->zpool))
+			src += sizeof(struct zswap_header);
 		dst = kmap_atomic(page);
 		tfm = *get_cpu_ptr(entry->pool->tfm);
 		ret = crypto_comp_decompress(tfm, src, entry->length,
@@ -945,6 +980,9 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	*/
 fail:
 	spin_lock(&tree->lock);
+	/* still valid: give it another round on the LRU */
+	if (entry == zswap_rb_search(&tree->rbroot, offset))
+		zswap_lru_add(entry);
 	zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
@@ -952,6 +990,76 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	return ret;
 }
 
+/* zpool evict callback: the swap entry is stored in the zswap header */
+static int zswap_zpool_evict(struct zpool *pool, unsigned long handle)
+{
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
+	struct zswap_tree *tree;
+	struct zswap_entry *entry;
+	pgoff_t offset;
+
+	/* extract swpentry from data */
+	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
+	swpentry = zhdr->swpentry; /* here */
+	zpool_unmap_handle(pool, handle);
+	offset = swp_offset(swpentry);
+	tree = swap_zswap_tree(swp_type(swpentry), offset);
+
+	/* find and ref zswap entry */
+	spin_lock(&tree->lock);
+	entry = zswap_entry_find_get(&tree->rbroot, offset);
+	if (!entry) {
+		/* entry was invalidated */
+		spin_unlock(&tree->lock);
+		return 0;
+	}
+	spin_unlock(&tree->lock);
+	BUG_ON(offset != entry->offset);
+
+	return zswap_writeback_entry(tree, entry);
+}
+
+/*
+ * Write back the least recently stored or loaded entry of the pool.
+ * Entries are taken off the LRU before the tree lock is taken, so only
+ * the swap entry may be read once the lru_lock is dropped; the tree
+ * lookup then tells whether the entry is still alive.
+ */
+static int zswap_reclaim_entry(struct zswap_pool *pool)
+{
+	struct zswap_entry *entry;
+	struct zswap_tree *tree;
+	unsigned int type;
+	pgoff_t offset;
+
+	spin_lock(&pool->lru_lock);
+	if (list_empty(&pool->lru)) {
+		spin_unlock(&pool->lru_lock);
+		return -EINVAL;
+	}
+	entry = list_last_entry(&pool->lru, struct zswap_entry, lru);
+	list_del_init(&entry->lru);
+	type = entry->type;
+	offset = entry->offset;
+	spin_unlock(&pool->lru_lock);
+
+	tree = swap_zswap_tree(type, offset);
+	if (!tree)
+		return -EAGAIN;
+
+	spin_lock(&tree->lock);
+	if (entry != zswap_rb_search(&tree->rbroot, offset)) {
+		/* invalidated or replaced meanwhile */
+		spin_unlock(&tree->lock);
+		return -EAGAIN;
+	}
+	zswap_entry_get(entry);
+	spin_unlock(&tree->lock);
+
+	return zswap_writeback_entry(tree, entry);
+}
+
 static int zswap_shrink(void)
 {
 	struct zswap_pool *pool;
@@ -961,13 +1069,75 @@ static int zswap_shrink(void)
 	if (!pool)
 		return -ENOENT;
 
-	ret = zpool_shrink(pool->zpool, 1, NULL);
+	ret = zswap_reclaim_entry(pool);
 
 	zswap_pool_put(pool);
 
 	return ret;
 }
 
+/*********************************
+* shrinker functions
+**********************************/
+/*
+ * Writeback allocates swap cache pages with GFP_KERNEL and issues IO, so
+ * only do it from reclaim contexts that allow both.
+ */
+static bool zswap_shrinker_allowed(struct shrink_control *sc)
+{
+	return zswap_shrinker_enabled &&
+		(sc->gfp_mask & (__GFP_IO | __GFP_FS)) ==
+		(__GFP_IO | __GFP_FS);
+}
+
+static unsigned long zswap_shrinker_count(struct shrinker *shrinker,
+					  struct shrink_control *sc)
+{
+	int nr;
+
+	if (!zswap_shrinker_allowed(sc))
+		return 0;
+
+	/* same-value filled entries take no pool memory */
+	nr = atomic_read(&zswap_stored_pages) -
+		atomic_read(&zswap_same_filled_pages);
+	return max(nr, 0);
+}
+
+static unsigned long zswap_shrinker_scan(struct shrinker *shrinker,
+					 struct shrink_control *sc)
+{
+	struct zswap_pool *pool;
+	unsigned long freed = 0;
+	int ret;
+
+	if (!zswap_shrinker_allowed(sc))
+		return SHRINK_STOP;
+
+	pool = zswap_pool_last_get();
+	if (!pool)
+		return SHRINK_STOP;
+
+	while (freed < sc->nr_to_scan) {
+		ret = zswap_reclaim_entry(pool);
+		if (ret == -EINVAL || ret == -ENOMEM)
+			break;
+		if (!ret)
+			freed++;
+		cond_resched();
+	}
+
+	zswap_pool_put(pool);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker zswap_shrinker = {
+	.count_objects = zswap_shrinker_count,
+	.scan_objects = zswap_shrinker_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
 {
 	unsigned int pos;
@@ -997,7 +1167,7 @@ static void zswap_fill_page(void *ptr, unsigned long value)
 static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 				struct page *page)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *tree = swap_zswap_tree(type, offset);
 	struct zswap_entry *entry, *dupentry;
 	struct crypto_comp *tfm;
 	int ret;
@@ -1040,6 +1210,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		src = kmap_atomic(page);
 		if (zswap_is_page_same_filled(src, &value)) {
 			kunmap_atomic(src);
+			entry->type = type;
 			entry->offset = offset;
 			entry->length = 0;
 			entry->value = value;
@@ -1088,6 +1259,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	put_cpu_var(zswap_dstmem);
 
 	/* populate entry */
+	entry->type = type;
 	entry->offset = offset;
 	entry->handle = handle;
 	entry->length = dlen;
@@ -1104,6 +1276,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	zswap_lru_add(entry);
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1128,7 +1301,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 				struct page *page)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *tree = swap_zswap_tree(type, offset);
 	struct zswap_entry *entry;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
@@ -1143,6 +1316,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 		spin_unlock(&tree->lock);
 		return -1;
 	}
+	zswap_lru_add(entry);
 	spin_unlock(&tree->lock);
 
 	if (!entry->length) {
@@ -1176,7 +1350,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 /* frees an entry in zswap */
 static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *tree = swap_zswap_tree(type, offset);
 	struct zswap_entry *entry;
 
 	/* find */
@@ -1200,35 +1374,44 @@ static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 /* frees all zswap entries for the given swap type */
 static void zswap_frontswap_invalidate_area(unsigned type)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *trees = zswap_trees[type];
 	struct zswap_entry *entry, *n;
+	unsigned int i;
 
-	if (!tree)
+	if (!trees)
 		return;
 
-	/* walk the tree and free everything */
-	spin_lock(&tree->lock);
-	rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot, rbnode)
-		zswap_free_entry(entry);
-	tree->rbroot = RB_ROOT;
-	spin_unlock(&tree->lock);
-	kfree(tree);
+	/* walk the trees and free everything */
+	for (i = 0; i < nr_zswap_trees; i++) {
+		struct zswap_tree *tree = &trees[i];
+
+		spin_lock(&tree->lock);
+		rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot,
+						     rbnode)
+			zswap_free_entry(entry);
+		tree->rbroot = RB_ROOT;
+		spin_unlock(&tree->lock);
+	}
+	kfree(trees);
 	zswap_trees[type] = NULL;
 }
 
 static void zswap_frontswap_init(unsigned type)
 {
-	struct zswap_tree *tree;
+	struct zswap_tree *trees;
+	unsigned int i;
 
-	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
-	if (!tree) {
+	trees = kcalloc(nr_zswap_trees, sizeof(*trees), GFP_KERNEL);
+	if (!trees) {
 		pr_err("alloc failed, zswap disabled for swap type %d\n", type);
 		return;
 	}
 
-	tree->rbroot = RB_ROOT;
-	spin_lock_init(&tree->lock);
-	zswap_trees[type] = tree;
+	for (i = 0; i < nr_zswap_trees; i++) {
+		trees[i].rbroot = RB_ROOT;
+		spin_lock_init(&trees[i].lock);
+	}
+	zswap_trees[type] = trees;
 }
 
 static struct frontswap_ops zswap_frontswap_ops = {
@@ -1302,6 +1485,7 @@ static int __init init_zswap(void)
 	int ret;
 
 	zswap_init_started = true;
+	nr_zswap_trees = roundup_pow_of_two(num_possible_cpus());
 
 	if (zswap_entry_cache_create()) {
 		pr_err("entry cache creation failed\n");
@@ -1334,6 +1518,8 @@ static int __init init_zswap(void)
 	}
 
 	frontswap_register_ops(&zswap_frontswap_ops);
+	if (register_shrinker(&zswap_shrinker))
+		pr_warn("shrinker registration failed\n");
 	if (zswap_debugfs_init())
 		pr_warn("debugfs initialization failed\n");
 	return 0;
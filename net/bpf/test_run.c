@@ -10,6 +10,27 @@
 #include <linux/etherdevice.h>
 #include <linux/filter.h>
 #include <linux/sched/signal.h>
+#include <linux/perf_event.h>
+#include <linux/log2.h>
+#include <asm/timex.h>
+
+/* Limits the memory a benchmark run can pin for per-run cycles. */
+#define BPF_TEST_RUN_CYCLES_MAX	(1U << 20)
+
+enum {
+	BPF_TEST_PERF_INSNS,
+	BPF_TEST_PERF_CACHE_MISSES,
+	BPF_TEST_PERF_MAX,
+};
+
+struct bpf_test_bench {
+	u64 *hist;
+	u32 hist_size;
+	u64 *cycles;
+	u32 cycles_size;
+	struct perf_event *events[BPF_TEST_PERF_MAX];
+	u64 counts[BPF_TEST_PERF_MAX];
+};
 
 static __always_inline u32 bpf_test_run_one(struct bpf_prog *prog, void *ctx)
 {
@@ -24,16 +45,168 @@ static __always_inline u32 bpf_test_run_one(struct bpf_prog *prog, void *ctx)
 	return ret;
 }
 
-static u32 bpf_test_run(struct bpf_prog *prog, void *ctx, u32 repeat, u32 *time)
+static u32 bpf_test_bench_one(struct bpf_prog *prog, void *ctx,
+			      struct bpf_test_bench *bench, u32 i)
+{
+	cycles_t cycles;
+	u64 start, ns;
+	u32 ret;
+
+	preempt_disable();
+	rcu_read_lock();
+	start = ktime_get_ns();
+	cycles = get_cycles();
+	ret = BPF_PROG_RUN(prog, ctx);
+	cycles = get_cycles() - cycles;
+	ns = ktime_get_ns() - start;
+	rcu_read_unlock();
+	preempt_enable();
+
+	if (bench->hist)
+		bench->hist[min_t(u32, ns ? ilog2(ns) + 1 : 0,
+				  bench->hist_size - 1)]++;
+	if (i < bench->cycles_size)
+		bench->cycles[i] = cycles;
+
+	return ret;
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static int bpf_test_perf_init(struct bpf_test_bench *bench)
+{
+	static const u64 config[BPF_TEST_PERF_MAX] = {
+		[BPF_TEST_PERF_INSNS]		= PERF_COUNT_HW_INSTRUCTIONS,
+		[BPF_TEST_PERF_CACHE_MISSES]	= PERF_COUNT_HW_CACHE_MISSES,
+	};
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.size		= sizeof(attr),
+		.exclude_user	= 1,
+	};
+	struct perf_event *event;
+	int i;
+
+	for (i = 0; i < BPF_TEST_PERF_MAX; i++) {
+		attr.config = config[i];
+		event = perf_event_create_kernel_counter(&attr, -1, current,
+							 NULL, NULL);
+		if (IS_ERR(event))
+			return PTR_ERR(event);
+		bench->events[i] = event;
+	}
+
+	return 0;
+}
+
+static void bpf_test_perf_read(struct bpf_test_bench *bench, bool end)
+{
+	u64 enabled, running, val;
+	int i;
+
+	for (i = 0; i < BPF_TEST_PERF_MAX; i++) {
+		if (!bench->events[i])
+			continue;
+		val = perf_event_read_value(bench->events[i], &enabled,
+					    &running);
+		bench->counts[i] = end ? val - bench->counts[i] : val;
+	}
+}
+
+static void bpf_test_perf_free(struct bpf_test_bench *bench)
+{
+	int i;
+
+	for (i = 0; i < BPF_TEST_PERF_MAX; i++)
+		if (bench->events[i])
+			perf_event_release_kernel(bench->events[i]);
+}
+#else
+static int bpf_test_perf_init(struct bpf_test_bench *bench)
+{
+	return -EOPNOTSUPP;
+}
+
+static void bpf_test_perf_read(struct bpf_test_bench *bench, bool end)
+{
+}
+
+static void bpf_test_perf_free(struct bpf_test_bench *bench)
+{
+}
+#endif /* CONFIG_PERF_EVENTS */
+
+static void bpf_test_bench_free(struct bpf_test_bench *bench)
+{
+	if (!bench)
+		return;
+
+	bpf_test_perf_free(bench);
+	vfree(bench->cycles);
+	kfree(bench->hist);
+	kfree(bench);
+}
+
+/* Returns NULL if no benchmark output was asked for. */
+static struct bpf_test_bench *bpf_test_bench_init(const union bpf_attr *kattr)
+{
+	struct bpf_test_bench *bench;
+	int err;
+
+	if (!kattr->test.hist_size != !kattr->test.hist ||
+	    !kattr->test.cycles_size != !kattr->test.cycles)
+		return ERR_PTR(-EINVAL);
+	if (kattr->test.hist_size > BPF_TEST_RUN_HIST_MAX ||
+	    kattr->test.cycles_size > BPF_TEST_RUN_CYCLES_MAX)
+		return ERR_PTR(-E2BIG);
+	if (!kattr->test.hist && !kattr->test.cycles && !kattr->test.perf)
+		return NULL;
+
+	bench = kzalloc(sizeof(*bench), GFP_USER);
+	if (!bench)
+		return ERR_PTR(-ENOMEM);
+
+	err = -ENOMEM;
+	if (kattr->test.hist) {
+		bench->hist_size = kattr->test.hist_size;
+		bench->hist = kcalloc(bench->hist_size, sizeof(u64),
+				      GFP_USER);
+		if (!bench->hist)
+			goto err;
+	}
+	if (kattr->test.cycles) {
+		bench->cycles_size = kattr->test.cycles_size;
+		bench->cycles = vzalloc(bench->cycles_size * sizeof(u64));
+		if (!bench->cycles)
+			goto err;
+	}
+	if (kattr->test.perf) {
+		err = bpf_test_perf_init(bench);
+		if (err)
+			goto err;
+	}
+
+	return bench;
+err:
+	bpf_test_bench_free(bench);
+	return ERR_PTR(err);
+}
+
+static u32 bpf_test_run(struct bpf_prog *prog, void *ctx, u32 repeat,
+			struct bpf_test_bench *bench, u32 *time)
 {
 	u64 time_start, time_spent = 0;
 	u32 ret = 0, i;
 
 	if (!repeat)
 		repeat = 1;
+	if (bench)
+		bpf_test_perf_read(bench, false);
 	time_start = ktime_get_ns();
 	for (i = 0; i < repeat; i++) {
-		ret = bpf_test_run_one(prog, ctx);
+		if (bench)
+			ret = bpf_test_bench_one(prog, ctx, bench, i);
+		else
+			ret = bpf_test_run_one(prog, ctx);
 		if (need_resched()) {
 			if (signal_pending(current))
 				break;
@@ -43,15 +216,41 @@ static u32 bpf_test_run(struct bpf_prog *prog, void *ctx, u32 repeat, u32 *time)
 		}
 	}
 	time_spent += ktime_get_ns() - time_start;
+	if (bench)
+		bpf_test_perf_read(bench, true);
 	do_div(time_spent, repeat);
 	*time = time_spent > U32_MAX ? U32_MAX : (u32)time_spent;
 
 	return ret;
 }
 
+static int bpf_test_bench_finish(const union bpf_attr *kattr,
+				 const struct bpf_test_bench *bench)
+{
+	void __user *hist = u64_to_user_ptr(kattr->test.hist);
+	void __user *cycles = u64_to_user_ptr(kattr->test.cycles);
+	void __user *perf = u64_to_user_ptr(kattr->test.perf);
+	struct bpf_test_run_perf counts = {
+		.instructions	= bench->counts[BPF_TEST_PERF_INSNS],
+		.cache_misses	= bench->counts[BPF_TEST_PERF_CACHE_MISSES],
+	};
+
+	if (hist && copy_to_user(hist, bench->hist,
+				 bench->hist_size * sizeof(u64)))
+		return -EFAULT;
+	if (cycles && copy_to_user(cycles, bench->cycles,
+				   bench->cycles_size * sizeof(u64)))
+		return -EFAULT;
+	if (perf && copy_to_user(perf, &counts, sizeof(counts)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static int bpf_test_finish(const union bpf_attr *kattr,
 			   union bpf_attr __user *uattr, const void *data,
-			   u32 size, u32 retval, u32 duration)
+			   u32 size, u32 retval, u32 duration,
+			   const struct bpf_test_bench *bench)
 {
 	void __user *data_out = u64_to_user_ptr(kattr->test.data_out);
 	int err = -EFAULT;
@@ -64,7 +263,7 @@ static int bpf_test_finish(const union bpf_attr *kattr,
 		goto out;
 	if (copy_to_user(&uattr->test.duration, &duration, sizeof(duration)))
 		goto out;
-	err = 0;
+	err = bench ? bpf_test_bench_finish(kattr, bench) : 0;
 out:
 	return err;
 }
@@ -95,15 +294,22 @@ int bpf_prog_test_run_skb(struct bpf_prog *prog, const union bpf_attr *kattr,
 	bool is_l2 = false, is_direct_pkt_access = false;
 	u32 size = kattr->test.data_size_in;
 	u32 repeat = kattr->test.repeat;
+	struct bpf_test_bench *bench;
 	u32 retval, duration;
 	struct sk_buff *skb;
 	void *data;
 	int ret;
 
+	bench = bpf_test_bench_init(kattr);
+	if (IS_ERR(bench))
+		return PTR_ERR(bench);
+
 	data = bpf_test_init(kattr, size, NET_SKB_PAD + NET_IP_ALIGN,
 			     SKB_DATA_ALIGN(sizeof(struct skb_shared_info)));
-	if (IS_ERR(data))
+	if (IS_ERR(data)) {
+		bpf_test_bench_free(bench);
 		return PTR_ERR(data);
+	}
 
 	switch (prog->type) {
 	case BPF_PROG_TYPE_SCHED_CLS:
@@ -122,6 +328,7 @@ int bpf_prog_test_run_skb(struct bpf_prog *prog, const union bpf_attr *kattr,
 	skb = build_skb(data, 0);
 	if (!skb) {
 		kfree(data);
+		bpf_test_bench_free(bench);
 		return -ENOMEM;
 	}
 
@@ -134,15 +341,17 @@ int bpf_prog_test_run_skb(struct bpf_prog *prog, const union bpf_attr *kattr,
 		__skb_push(skb, ETH_HLEN);
 	if (is_direct_pkt_access)
 		bpf_compute_data_pointers(skb);
-	retval = bpf_test_run(prog, skb, repeat, &duration);
+	retval = bpf_test_run(prog, skb, repeat, bench, &duration);
 	if (!is_l2)
 		__skb_push(skb, ETH_HLEN);
 	size = skb->len;
 	/* bpf program can never convert linear skb to non-linear */
 	if (WARN_ON_ONCE(skb_is_nonlinear(skb)))
 		size = skb_headlen(skb);
-	ret = bpf_test_finish(kattr, uattr, skb->data, size, retval, duration);
+	ret = bpf_test_finish(kattr, uattr, skb->data, size, retval, duration,
+			      bench);
 	kfree_skb(skb);
+	bpf_test_bench_free(bench);
 	return ret;
 }
 
@@ -152,14 +361,21 @@ int bpf_prog_test_run_xdp(struct bpf_prog *prog, const union bpf_attr *kattr,
 	u32 size = kattr->test.data_size_in;
 	u32 repeat = kattr->test.repeat;
 	struct netdev_rx_queue *rxqueue;
+	struct bpf_test_bench *bench;
 	struct xdp_buff xdp = {};
 	u32 retval, duration;
 	void *data;
 	int ret;
 
+	bench = bpf_test_bench_init(kattr);
+	if (IS_ERR(bench))
+		return PTR_ERR(bench);
+
 	data = bpf_test_init(kattr, size, XDP_PACKET_HEADROOM + NET_IP_ALIGN, 0);
-	if (IS_ERR(data))
+	if (IS_ERR(data)) {
+		bpf_test_bench_free(bench);
 		return PTR_ERR(data);
+	}
 
 	xdp.data_hard_start = data;
 	xdp.data = data + XDP_PACKET_HEADROOM + NET_IP_ALIGN;
@@ -169,11 +385,13 @@ int bpf_prog_test_run_xdp(struct bpf_prog *prog, const union bpf_attr *kattr,
 	rxqueue = __netif_get_rx_queue(current->nsproxy->net_ns->loopback_dev, 0);
 	xdp.rxq = &rxqueue->xdp_rxq;
 
-	retval = bpf_test_run(prog, &xdp, repeat, &duration);
+	retval = bpf_test_run(prog, &xdp, repeat, bench, &duration);
 	if (xdp.data != data + XDP_PACKET_HEADROOM + NET_IP_ALIGN ||
 	    xdp.data_end != xdp.data + size)
 		size = xdp.data_end - xdp.data;
-	ret = bpf_test_finish(kattr, uattr, xdp.data, size, retval, duration);
+	ret = bpf_test_finish(kattr, uattr, xdp.data, size, retval, duration,
+			      bench);
 	kfree(data);
+	bpf_test_bench_free(bench);
 	return ret;
 }
@@ -92,6 +92,7 @@ static void __br_forward(const struct net_bridge_port *to,
 			return;
 		}
 		br_hook = NF_BR_FORWARD;
+		skb->tstamp = 0;
 		skb_forward_csum(skb);
 		net = dev_net(indev);
 	} else {
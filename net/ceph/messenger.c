@@ -533,19 +533,13 @@ static int ceph_tcp_recvmsg(struct socket *sock, void *buf, size_t len)
 	return r;
 }
 
-static int ceph_tcp_recvpage(struct socket *sock, struct page *page,
-		     int page_offset, size_t length)
-{
-	struct bio_vec bvec = {
-		.bv_page = page,
-		.bv_offset = page_offset,
-		.bv_len = length
-	};
+static int ceph_tcp_recvbvecs(struct socket *sock, struct bio_vec *bvecs,
+			      int nr_bvecs, size_t length)
+{
 	struct msghdr msg = { .msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL };
 	int r;
 
-	BUG_ON(page_offset + length > PAGE_SIZE);
-	iov_iter_bvec(&msg.msg_iter, READ | ITER_BVEC, &bvec, 1, length);
+	iov_iter_bvec(&msg.msg_iter, READ | ITER_BVEC, bvecs, nr_bvecs, length);
 	r = sock_recvmsg(sock, &msg, msg.msg_flags);
 	if (r == -EAGAIN)
 		r = 0;
@@ -2313,16 +2307,24 @@ static int read_partial_message_section(struct ceph_connection *con,
 	return 1;
 }
 
+/* Pieces of the data items received with a single recvmsg */
+#define CEPH_MSG_RECV_BVECS	16
+
 static int read_partial_msg_data(struct ceph_connection *con)
 {
 	struct ceph_msg *msg = con->in_msg;
 	struct ceph_msg_data_cursor *cursor = &msg->cursor;
 	bool do_datacrc = !ceph_test_opt(from_msgr(con->msgr), NOCRC);
+	struct bio_vec bvecs[CEPH_MSG_RECV_BVECS];
+	struct ceph_msg_data_cursor next;
 	struct page *page;
 	size_t page_offset;
 	size_t length;
+	size_t total;
 	u32 crc = 0;
+	int nr_bvecs;
 	int ret;
+	int i;
 
 	BUG_ON(!msg);
 	if (list_empty(&msg->data))
@@ -2331,13 +2333,30 @@ static int read_partial_msg_data(struct ceph_connection *con)
 	if (do_datacrc)
 		crc = con->in_data_crc;
 	while (cursor->total_resid) {
-		if (!cursor->resid) {
-			ceph_msg_data_advance(cursor, 0);
-			continue;
+		/*
+		 * Walk a copy of the cursor to gather the pages the next
+		 * pieces go to, and receive straight into all of them.
+		 */
+		next = *cursor;
+		nr_bvecs = 0;
+		total = 0;
+		while (next.total_resid && nr_bvecs < CEPH_MSG_RECV_BVECS) {
+			if (!next.resid) {
+				ceph_msg_data_advance(&next, 0);
+				continue;
+			}
+
+			page = ceph_msg_data_next(&next, &page_offset, &length,
+						  NULL);
+			bvecs[nr_bvecs].bv_page = page;
+			bvecs[nr_bvecs].bv_offset = page_offset;
+			bvecs[nr_bvecs].bv_len = length;
+			nr_bvecs++;
+			total += length;
+			ceph_msg_data_advance(&next, length);
 		}
 
-		page = ceph_msg_data_next(cursor, &page_offset, &length, NULL);
-		ret = ceph_tcp_recvpage(con->sock, page, page_offset, length);
+		ret = ceph_tcp_recvbvecs(con->sock, bvecs, nr_bvecs, total);
 		if (ret <= 0) {
 			if (do_datacrc)
 				con->in_data_crc = crc;
@@ -2345,9 +2364,19 @@ static int read_partial_msg_data(struct ceph_connection *con)
 			return ret;
 		}
 
-		if (do_datacrc)
-			crc = ceph_crc32c_page(crc, page, page_offset, ret);
-		ceph_msg_data_advance(cursor, (size_t)ret);
+		/* Move the real cursor over what was received */
+		for (i = 0; i < nr_bvecs && ret; i++) {
+			while (!cursor->resid)
+				ceph_msg_data_advance(cursor, 0);
+
+			length = min_t(size_t, ret, bvecs[i].bv_len);
+			if (do_datacrc)
+				crc = ceph_crc32c_page(crc, bvecs[i].bv_page,
+						       bvecs[i].bv_offset,
+						       length);
+			ceph_msg_data_advance(cursor, length);
+			ret -= length;
+		}
 	}
 	if (do_datacrc)
 		con->in_data_crc = crc;
@@ -4343,6 +4343,30 @@ int ceph_osdc_start_request(struct ceph_osd_client *osdc,
 }
 EXPORT_SYMBOL(ceph_osdc_start_request);
 
+/*
+ * Register and send several requests under one hold of osdc->lock:
+ * bracket ceph_osdc_batch_submit() calls with ceph_osdc_batch_begin()
+ * and ceph_osdc_batch_end().  Nothing that could take osdc->lock for
+ * write, such as waiting on a request, may be done in between.
+ */
+void ceph_osdc_batch_begin(struct ceph_osd_client *osdc)
+{
+	down_read(&osdc->lock);
+}
+EXPORT_SYMBOL(ceph_osdc_batch_begin);
+
+void ceph_osdc_batch_submit(struct ceph_osd_request *req)
+{
+	submit_request(req, false);
+}
+EXPORT_SYMBOL(ceph_osdc_batch_submit);
+
+void ceph_osdc_batch_end(struct ceph_osd_client *osdc)
+{
+	up_read(&osdc->lock);
+}
+EXPORT_SYMBOL(ceph_osdc_batch_end);
+
 /*
  * Unregister a registered request.  The request is not completed:
  * ->r_result isn't set and __complete_request() isn't called.
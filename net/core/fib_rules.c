@@ -303,7 +303,7 @@ int fib_rules_lookup(struct fib_rules_ops *ops, struct flowi *fl,
 		else
 			err = ops->action(rule, fl, flags, arg);
 
-		if (!err && ops->suppress && ops->suppress(rule, arg))
+		if (!err && ops->suppress && ops->suppress(rule, flags, arg))
 			continue;
 
 		if (err != -EAGAIN) {
@@ -64,6 +64,7 @@
 #include <net/ip_fib.h>
 #include <net/flow.h>
 #include <net/arp.h>
+#include <net/bpf_sk_storage.h>
 
 /**
  *	sk_filter_trim_cap - run a packet through a socket filter
@@ -2984,6 +2985,38 @@ static const struct bpf_func_proto bpf_xdp_adjust_head_proto = {
 	.arg2_type	= ARG_ANYTHING,
 };
 
+/* Trims @shrink bytes off the end of a multi-buffer frame, starting
+ * with the last frag.  Frags that end up empty are released.
+ */
+static int bpf_xdp_frags_shrink_tail(struct xdp_buff *xdp, int shrink)
+{
+	struct skb_shared_info *sinfo = xdp_get_shared_info_from_buff(xdp);
+	unsigned int headlen = xdp->data_end - xdp->data;
+
+	if (unlikely(shrink > (int)(xdp_get_buff_len(xdp) - ETH_HLEN)))
+		return -EINVAL;
+
+	while (shrink && sinfo->nr_frags) {
+		skb_frag_t *frag = &sinfo->frags[sinfo->nr_frags - 1];
+		int size = skb_frag_size(frag);
+
+		if (shrink < size) {
+			skb_frag_size_sub(frag, shrink);
+			return 0;
+		}
+
+		xdp_return_frag(frag, &xdp->rxq->mem);
+		sinfo->nr_frags--;
+		shrink -= size;
+	}
+
+	if (unlikely(headlen - shrink < ETH_HLEN))
+		return -EINVAL;
+
+	xdp->data_end -= shrink;
+	return 0;
+}
+
 BPF_CALL_2(bpf_xdp_adjust_tail, struct xdp_buff *, xdp, int, offset)
 {
 	void *data_end = xdp->data_end + offset;
@@ -2992,6 +3025,9 @@ BPF_CALL_2(bpf_xdp_adjust_tail, struct xdp_buff *, xdp, int, offset)
 	if (unlikely(offset >= 0))
 		return -EINVAL;
 
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		return bpf_xdp_frags_shrink_tail(xdp, -offset);
+
 	if (unlikely(data_end < xdp->data + ETH_HLEN))
 		return -EINVAL;
 
@@ -3008,6 +3044,109 @@ static const struct bpf_func_proto bpf_xdp_adjust_tail_proto = {
 	.arg2_type	= ARG_ANYTHING,
 };
 
+BPF_CALL_1(bpf_xdp_get_buff_len, struct xdp_buff *, xdp)
+{
+	return xdp_get_buff_len(xdp);
+}
+
+static const struct bpf_func_proto bpf_xdp_get_buff_len_proto = {
+	.func		= bpf_xdp_get_buff_len,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+};
+
+/* Copies between @buf and the frame, walking the head buffer first and
+ * then the frags; the range has already been checked against the frame.
+ */
+static void bpf_xdp_copy_buf(struct xdp_buff *xdp, u32 off, void *buf,
+			     u32 len, bool to_frame)
+{
+	struct skb_shared_info *sinfo;
+	u32 headlen = xdp->data_end - xdp->data;
+	u32 copy;
+	int i;
+
+	if (off < headlen) {
+		copy = min(len, headlen - off);
+		if (to_frame)
+			memcpy(xdp->data + off, buf, copy);
+		else
+			memcpy(buf, xdp->data + off, copy);
+		buf += copy;
+		len -= copy;
+		off = 0;
+	} else {
+		off -= headlen;
+	}
+
+	sinfo = xdp_get_shared_info_from_buff(xdp);
+	for (i = 0; len && i < sinfo->nr_frags; i++) {
+		skb_frag_t *frag = &sinfo->frags[i];
+		u32 size = skb_frag_size(frag);
+		void *addr;
+
+		if (off >= size) {
+			off -= size;
+			continue;
+		}
+
+		copy = min(len, size - off);
+		addr = skb_frag_address(frag) + off;
+		if (to_frame)
+			memcpy(addr, buf, copy);
+		else
+			memcpy(buf, addr, copy);
+		buf += copy;
+		len -= copy;
+		off = 0;
+	}
+}
+
+BPF_CALL_4(bpf_xdp_load_bytes, struct xdp_buff *, xdp, u32, offset,
+	   void *, buf, u32, len)
+{
+	if (unlikely(len > xdp_get_buff_len(xdp) ||
+		     offset > xdp_get_buff_len(xdp) - len)) {
+		memset(buf, 0, len);
+		return -EFAULT;
+	}
+
+	bpf_xdp_copy_buf(xdp, offset, buf, len, false);
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_xdp_load_bytes_proto = {
+	.func		= bpf_xdp_load_bytes,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_UNINIT_MEM,
+	.arg4_type	= ARG_CONST_SIZE,
+};
+
+BPF_CALL_4(bpf_xdp_store_bytes, struct xdp_buff *, xdp, u32, offset,
+	   void *, buf, u32, len)
+{
+	if (unlikely(len > xdp_get_buff_len(xdp) ||
+		     offset > xdp_get_buff_len(xdp) - len))
+		return -EFAULT;
+
+	bpf_xdp_copy_buf(xdp, offset, buf, len, true);
+	return 0;
+}
+
+static const struct bpf_func_proto bpf_xdp_store_bytes_proto = {
+	.func		= bpf_xdp_store_bytes,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_ANYTHING,
+	.arg3_type	= ARG_PTR_TO_MEM,
+	.arg4_type	= ARG_CONST_SIZE,
+};
+
 BPF_CALL_2(bpf_xdp_adjust_meta, struct xdp_buff *, xdp, int, offset)
 {
 	void *xdp_frame_end = xdp->data_hard_start + sizeof(struct xdp_frame);
@@ -3042,19 +3181,23 @@ static int __bpf_tx_xdp(struct net_device *dev,
 			u32 index)
 {
 	struct xdp_frame *xdpf;
-	int err;
+	int sent;
 
 	if (!dev->netdev_ops->ndo_xdp_xmit) {
 		return -EOPNOTSUPP;
 	}
 
+	if (unlikely(xdp_buff_has_frags(xdp) &&
+		     !(dev->priv_flags & IFF_XDP_FRAGS_TX)))
+		return -EOPNOTSUPP;
+
 	xdpf = convert_to_xdp_frame(xdp);
 	if (unlikely(!xdpf))
 		return -EOVERFLOW;
 
-	err = dev->netdev_ops->ndo_xdp_xmit(dev, xdpf);
-	if (err)
-		return err;
+	sent = dev->netdev_ops->ndo_xdp_xmit(dev, 1, &xdpf);
+	if (sent <= 0)
+		return sent;
 	dev->netdev_ops->ndo_xdp_flush(dev);
 	return 0;
 }
@@ -3068,20 +3211,7 @@ static int __bpf_tx_xdp_map(struct net_device *dev_rx, void *fwd,
 
 	switch (map->map_type) {
 	case BPF_MAP_TYPE_DEVMAP: {
-		struct net_device *dev = fwd;
-		struct xdp_frame *xdpf;
-
-		if (!dev->netdev_ops->ndo_xdp_xmit)
-			return -EOPNOTSUPP;
-
-		xdpf = convert_to_xdp_frame(xdp);
-		if (unlikely(!xdpf))
-			return -EOVERFLOW;
-
-		/* TODO: move to inside map code instead, for bulk support
-		 * err = dev_map_enqueue(dev, xdp);
-		 */
-		err = dev->netdev_ops->ndo_xdp_xmit(dev, xdpf);
+		err = dev_map_enqueue(map, index, xdp, dev_rx);
 		if (err)
 			return err;
 		__dev_map_insert_ctx(map, index);
@@ -4387,6 +4517,10 @@ bpf_base_func_proto(enum bpf_func_id func_id)
 		return &bpf_tail_call_proto;
 	case BPF_FUNC_ktime_get_ns:
 		return &bpf_ktime_get_ns_proto;
+	case BPF_FUNC_ringbuf_output:
+		return &bpf_ringbuf_output_proto;
+	case BPF_FUNC_ringbuf_query:
+		return &bpf_ringbuf_query_proto;
 	case BPF_FUNC_trace_printk:
 		if (capable(CAP_SYS_ADMIN))
 			return bpf_get_trace_printk_proto();
@@ -4448,6 +4582,19 @@ sk_filter_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 	}
 }
 
+static const struct bpf_func_proto *
+cg_skb_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	switch (func_id) {
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sk_storage_get_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sk_storage_delete_proto;
+	default:
+		return sk_filter_func_proto(func_id, prog);
+	}
+}
+
 static const struct bpf_func_proto *
 tc_cls_act_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 {
@@ -4518,6 +4665,10 @@ tc_cls_act_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 #endif
 	case BPF_FUNC_fib_lookup:
 		return &bpf_skb_fib_lookup_proto;
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sk_storage_get_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sk_storage_delete_proto;
 	default:
 		return bpf_base_func_proto(func_id);
 	}
@@ -4545,6 +4696,12 @@ xdp_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_xdp_adjust_tail_proto;
 	case BPF_FUNC_fib_lookup:
 		return &bpf_xdp_fib_lookup_proto;
+	case BPF_FUNC_xdp_get_buff_len:
+		return &bpf_xdp_get_buff_len_proto;
+	case BPF_FUNC_xdp_load_bytes:
+		return &bpf_xdp_load_bytes_proto;
+	case BPF_FUNC_xdp_store_bytes:
+		return &bpf_xdp_store_bytes_proto;
 	default:
 		return bpf_base_func_proto(func_id);
 	}
@@ -4591,6 +4748,10 @@ sock_ops_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_sock_map_update_proto;
 	case BPF_FUNC_sock_hash_update:
 		return &bpf_sock_hash_update_proto;
+	case BPF_FUNC_sk_storage_get:
+		return &bpf_sock_ops_sk_storage_get_proto;
+	case BPF_FUNC_sk_storage_delete:
+		return &bpf_sock_ops_sk_storage_delete_proto;
 	default:
 		return bpf_base_func_proto(func_id);
 	}
@@ -6346,7 +6507,7 @@ const struct bpf_prog_ops xdp_prog_ops = {
 };
 
 const struct bpf_verifier_ops cg_skb_verifier_ops = {
-	.get_func_proto		= sk_filter_func_proto,
+	.get_func_proto		= cg_skb_func_proto,
 	.is_valid_access	= sk_filter_is_valid_access,
 	.convert_ctx_access	= bpf_convert_ctx_access,
 };
@@ -106,49 +106,94 @@ static struct page *__page_pool_get_cached(struct page_pool *pool)
 	return page;
 }
 
-/* slow path */
-noinline
-static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
-						 gfp_t _gfp)
+static bool page_pool_dma_map(struct page_pool *pool, struct page *page)
 {
-	struct page *page;
-	gfp_t gfp = _gfp;
 	dma_addr_t dma;
 
+	/* Setup DMA mapping: use page->private for DMA-addr
+	 * This mapping is kept for lifetime of page, until leaving pool.
+	 */
+	dma = dma_map_page(pool->p.dev, page, 0,
+			   (PAGE_SIZE << pool->p.order),
+			   pool->p.dma_dir);
+	if (dma_mapping_error(pool->p.dev, dma))
+		return false;
+
+	set_page_private(page, dma); /* page->private = dma; */
+	return true;
+}
+
+static struct page *__page_pool_alloc_page_order(struct page_pool *pool,
+						 gfp_t gfp)
+{
+	struct page *page;
+
 	/* We could always set __GFP_COMP, and avoid this branch, as
 	 * prep_new_page() can handle order-0 with __GFP_COMP.
 	 */
 	if (pool->p.order)
 		gfp |= __GFP_COMP;
 
-	/* FUTURE development:
-	 *
-	 * Current slow-path essentially falls back to single page
-	 * allocations, which doesn't improve performance.  This code
-	 * need bulk allocation support from the page allocator code.
-	 */
-
-	/* Cache was empty, do real allocation */
 	page = alloc_pages_node(pool->p.nid, gfp, pool->p.order);
 	if (!page)
 		return NULL;
 
-	if (!(pool->p.flags & PP_FLAG_DMA_MAP))
-		goto skip_dma_map;
+	if ((pool->p.flags & PP_FLAG_DMA_MAP) &&
+	    unlikely(!page_pool_dma_map(pool, page))) {
+		put_page(page);
+		return NULL;
+	}
 
-	/* Setup DMA mapping: use page->private for DMA-addr
-	 * This mapping is kept for lifetime of page, until leaving pool.
+	/* When page just alloc'ed is should/must have refcnt 1. */
+	return page;
+}
+
+/* slow path */
+noinline
+static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
+						 gfp_t gfp)
+{
+	const int bulk = PP_ALLOC_CACHE_REFILL;
+	struct page **pages = (struct page **)pool->alloc.cache;
+	struct page *page;
+	int i, nr_pages;
+
+	/* Bulk refill is only possible for order-0 pages, and only from
+	 * the softirq/NAPI context that protects the alloc cache.
 	 */
-	dma = dma_map_page(pool->p.dev, page, 0,
-			   (PAGE_SIZE << pool->p.order),
-			   pool->p.dma_dir);
-	if (dma_mapping_error(pool->p.dev, dma)) {
-		put_page(page);
+	if (unlikely(pool->p.order) || !in_serving_softirq())
+		return __page_pool_alloc_page_order(pool, gfp);
+
+	/* Unnecessary as alloc cache is empty, but guarantees zero count */
+	if (unlikely(pool->alloc.count > 0))
+		return pool->alloc.cache[--pool->alloc.count];
+
+	/* Mark empty alloc.cache slots "empty" for alloc_pages_bulk_array */
+	memset(pages, 0, sizeof(void *) * bulk);
+
+	nr_pages = alloc_pages_bulk_array(gfp, pool->p.nid, bulk, pages);
+	if (unlikely(!nr_pages))
 		return NULL;
+
+	/* Pages have been filled into alloc.cache array, but count is zero
+	 * and page elements have not been (possibly) DMA mapped.
+	 */
+	for (i = 0; i < nr_pages; i++) {
+		page = pages[i];
+		if ((pool->p.flags & PP_FLAG_DMA_MAP) &&
+		    unlikely(!page_pool_dma_map(pool, page))) {
+			put_page(page);
+			continue;
+		}
+		pages[pool->alloc.count++] = page;
 	}
-	set_page_private(page, dma); /* page->private = dma; */
 
-skip_dma_map:
+	/* Return last page */
+	if (likely(pool->alloc.count > 0))
+		page = pool->alloc.cache[--pool->alloc.count];
+	else
+		page = NULL;
+
 	/* When page just alloc'ed is should/must have refcnt 1. */
 	return page;
 }
@@ -195,6 +240,27 @@ static void __page_pool_return_page(struct page_pool *pool, struct page *page)
 	 */
 }
 
+/* Return an array of pages to the page allocator in one go */
+static void __page_pool_return_pages(struct page_pool *pool,
+				     struct page **pages, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		__page_pool_clean_page(pool, pages[i]);
+
+	/* Pages owned by the pool are never part of page-cache, thus
+	 * order-0 pages can go straight back onto the pcp lists.
+	 */
+	if (!pool->p.order) {
+		free_pages_bulk(pages, nr);
+		return;
+	}
+
+	for (i = 0; i < nr; i++)
+		put_page(pages[i]);
+}
+
 static bool __page_pool_recycle_into_ring(struct page_pool *pool,
 				   struct page *page)
 {
@@ -266,7 +332,9 @@ EXPORT_SYMBOL(__page_pool_put_page);
 
 static void __page_pool_empty_ring(struct page_pool *pool)
 {
+	struct page *pages[PP_ALLOC_CACHE_REFILL];
 	struct page *page;
+	int nr = 0;
 
 	/* Empty recycle ring */
 	while ((page = ptr_ring_consume(&pool->ring))) {
@@ -275,8 +343,13 @@ static void __page_pool_empty_ring(struct page_pool *pool)
 			pr_crit("%s() page_pool refcnt %d violation\n",
 				__func__, page_ref_count(page));
 
-		__page_pool_return_page(pool, page);
+		pages[nr++] = page;
+		if (nr == PP_ALLOC_CACHE_REFILL) {
+			__page_pool_return_pages(pool, pages, nr);
+			nr = 0;
+		}
 	}
+	__page_pool_return_pages(pool, pages, nr);
 }
 
 static void __page_pool_destroy_rcu(struct rcu_head *rcu)
@@ -295,16 +368,13 @@ static void __page_pool_destroy_rcu(struct rcu_head *rcu)
 /* Cleanup and release resources */
 void page_pool_destroy(struct page_pool *pool)
 {
-	struct page *page;
-
 	/* Empty alloc cache, assume caller made sure this is
 	 * no-longer in use, and page_pool_alloc_pages() cannot be
 	 * call concurrently.
 	 */
-	while (pool->alloc.count) {
-		page = pool->alloc.cache[--pool->alloc.count];
-		__page_pool_return_page(pool, page);
-	}
+	__page_pool_return_pages(pool, (struct page **)pool->alloc.cache,
+				 pool->alloc.count);
+	pool->alloc.count = 0;
 
 	/* No more consumers should exist, but producers could still
 	 * be in-flight.
@@ -12,6 +12,7 @@
  */
 
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/random.h>
 #include <linux/slab.h>
 #include <linux/string.h>
@@ -47,6 +48,78 @@ void reqsk_queue_alloc(struct request_sock_queue *queue)
 	queue->rskq_accept_head = NULL;
 }
 
+int reqsk_queue_alloc_shards(struct request_sock_queue *queue)
+{
+	int cpu;
+
+	if (queue->rskq_shards)
+		return 0;
+
+	queue->rskq_shards = alloc_percpu(struct request_sock_shard);
+	if (!queue->rskq_shards)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(queue->rskq_shards, cpu)->lock);
+	atomic_set(&queue->rskq_shard_qlen, 0);
+	return 0;
+}
+
+void reqsk_queue_free_shards(struct request_sock_queue *queue)
+{
+	free_percpu(queue->rskq_shards);
+	queue->rskq_shards = NULL;
+}
+
+static struct request_sock *reqsk_shard_pop(struct request_sock_shard *shard)
+{
+	struct request_sock *req;
+
+	if (!READ_ONCE(shard->head))
+		return NULL;
+
+	spin_lock_bh(&shard->lock);
+	req = shard->head;
+	if (req) {
+		WRITE_ONCE(shard->head, req->dl_next);
+		if (!shard->head)
+			shard->tail = NULL;
+	}
+	spin_unlock_bh(&shard->lock);
+	return req;
+}
+
+/*
+ * Dequeue a child from the per-cpu accept queues. The queue of the cpu the
+ * acceptor runs on is tried first, so threads bound to the cpus servicing
+ * the NIC queues mostly take connections that were set up locally. The
+ * other queues are then scanned round robin, starting after our own.
+ */
+struct request_sock *reqsk_queue_remove_shard(struct request_sock_queue *queue,
+					      struct sock *parent)
+{
+	struct request_sock_shard __percpu *shards = queue->rskq_shards;
+	struct request_sock *req;
+	int this_cpu, cpu;
+
+	if (!atomic_read(&queue->rskq_shard_qlen))
+		return NULL;
+
+	this_cpu = raw_smp_processor_id();
+	req = reqsk_shard_pop(per_cpu_ptr(shards, this_cpu));
+	for (cpu = this_cpu; !req;) {
+		cpu = cpumask_next(cpu, cpu_possible_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_possible_mask);
+		if (cpu == this_cpu)
+			return NULL;
+		req = reqsk_shard_pop(per_cpu_ptr(shards, cpu));
+	}
+
+	reqsk_shard_acceptq_update(queue, parent, -1);
+	return req;
+}
+
 /*
  * This function is called to set a Fast Open socket's "fastopen_rsk" field
  * to NULL when a TFO socket no longer needs to access the request_sock.
@@ -120,6 +120,7 @@
 #include <linux/prefetch.h>
 
 #include <linux/uaccess.h>
+#include <asm/unaligned.h>
 
 #include <linux/netdevice.h>
 #include <net/protocol.h>
@@ -136,6 +137,7 @@
 
 #include <linux/filter.h>
 #include <net/sock_reuseport.h>
+#include <net/bpf_sk_storage.h>
 
 #include <trace/events/sock.h>
 
@@ -698,6 +700,7 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 		    char __user *optval, unsigned int optlen)
 {
 	struct sock *sk = sock->sk;
+	struct sock_txtime sk_txtime;
 	int val;
 	int valbool;
 	struct linger ling;
@@ -1047,7 +1050,7 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 		break;
 
 	case SO_INCOMING_CPU:
-		sk->sk_incoming_cpu = val;
+		reuseport_update_incoming_cpu(sk, val);
 		break;
 
 	case SO_CNX_ADVICE:
@@ -1070,6 +1073,22 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 		}
 		break;
 
+	case SO_TXTIME:
+		if (optlen != sizeof(struct sock_txtime)) {
+			ret = -EINVAL;
+		} else if (copy_from_user(&sk_txtime, optval,
+			   sizeof(struct sock_txtime))) {
+			ret = -EFAULT;
+		} else if (sk_txtime.flags & ~SOF_TXTIME_FLAGS_MASK) {
+			ret = -EINVAL;
+		} else {
+			sock_valbool_flag(sk, SOCK_TXTIME, true);
+			sk->sk_clockid = sk_txtime.clockid;
+			sk->sk_txtime_deadline_mode =
+				!!(sk_txtime.flags & SOF_TXTIME_DEADLINE_MODE);
+		}
+		break;
+
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -1115,6 +1134,7 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		u64 val64;
 		struct linger ling;
 		struct timeval tm;
+		struct sock_txtime txtime;
 	} v;
 
 	int lv = sizeof(int);
@@ -1403,6 +1423,13 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = sock_flag(sk, SOCK_ZEROCOPY);
 		break;
 
+	case SO_TXTIME:
+		lv = sizeof(v.txtime);
+		v.txtime.clockid = sk->sk_clockid;
+		v.txtime.flags |= sk->sk_txtime_deadline_mode ?
+				  SOF_TXTIME_DEADLINE_MODE : 0;
+		break;
+
 	default:
 		/* We implement the SO_SNDLOWAT etc to not be settable
 		 * (1003.1g 7).
@@ -1581,16 +1608,17 @@ static void __sk_destruct(struct rcu_head *head)
 	if (rcu_access_pointer(sk->sk_reuseport_cb))
 		reuseport_detach_sock(sk);
 
+#ifdef CONFIG_BPF_SYSCALL
+	bpf_sk_storage_free(sk);
+#endif
+
 	sock_disable_timestamp(sk, SK_FLAGS_TIMESTAMP);
 
 	if (atomic_read(&sk->sk_omem_alloc))
 		pr_debug("%s: optmem leakage (%d bytes) detected\n",
 			 __func__, atomic_read(&sk->sk_omem_alloc));
 
-	if (sk->sk_frag.page) {
-		put_page(sk->sk_frag.page);
-		sk->sk_frag.page = NULL;
-	}
+	skb_page_frag_release(&sk->sk_frag);
 
 	if (sk->sk_peer_cred)
 		put_cred(sk->sk_peer_cred);
@@ -1725,6 +1753,9 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 			goto out;
 		}
 		RCU_INIT_POINTER(newsk->sk_reuseport_cb, NULL);
+#ifdef CONFIG_BPF_SYSCALL
+		RCU_INIT_POINTER(newsk->sk_bpf_storage, NULL);
+#endif
 
 		newsk->sk_err	   = 0;
 		newsk->sk_err_soft = 0;
@@ -2137,6 +2168,13 @@ int __sock_cmsg_send(struct sock *sk, struct msghdr *msg, struct cmsghdr *cmsg,
 		sockc->tsflags &= ~SOF_TIMESTAMPING_TX_RECORD_MASK;
 		sockc->tsflags |= tsflags;
 		break;
+	case SCM_TXTIME:
+		if (!sock_flag(sk, SOCK_TXTIME))
+			return -EINVAL;
+		if (cmsg->cmsg_len != CMSG_LEN(sizeof(u64)))
+			return -EINVAL;
+		sockc->transmit_time = get_unaligned((u64 *)CMSG_DATA(cmsg));
+		break;
 	/* SCM_RIGHTS and SCM_CREDENTIALS are semantically in SOL_UNIX. */
 	case SCM_RIGHTS:
 	case SCM_CREDENTIALS:
@@ -2190,6 +2228,78 @@ static void sk_leave_memory_pressure(struct sock *sk)
 /* On 32bit arches, an skb frag is limited to 2^15 */
 #define SKB_FRAG_PAGE_ORDER	get_order(32768)
 
+/* Small per-cpu stash of high order pages released by sockets, so that
+ * the next sk_frag refill does not depend on the buddy allocator finding
+ * an order-3 block once memory gets fragmented.
+ */
+#define SKB_FRAG_CACHE_MAX	8
+
+struct skb_frag_cache {
+	unsigned int	count;
+	struct page	*pages[SKB_FRAG_CACHE_MAX];
+};
+
+static DEFINE_PER_CPU(struct skb_frag_cache, skb_frag_cache);
+
+static struct page *skb_frag_cache_get(void)
+{
+	struct skb_frag_cache *fc;
+	struct page *page = NULL;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	fc = this_cpu_ptr(&skb_frag_cache);
+	if (fc->count)
+		page = fc->pages[--fc->count];
+	local_irq_restore(flags);
+	return page;
+}
+
+/**
+ * skb_page_frag_release - release the page held by a page_frag
+ * @pfrag: pointer to page_frag
+ *
+ * High order pages we hold the last reference to are kept in a per-cpu
+ * cache for reuse by skb_page_frag_refill(), other pages are freed.
+ */
+void skb_page_frag_release(struct page_frag *pfrag)
+{
+	struct page *page = pfrag->page;
+	struct skb_frag_cache *fc;
+	unsigned long flags;
+
+	if (!page)
+		return;
+	pfrag->page = NULL;
+
+	if (!SKB_FRAG_PAGE_ORDER ||
+	    pfrag->size != (PAGE_SIZE << SKB_FRAG_PAGE_ORDER) ||
+	    page_ref_count(page) != 1 || page_is_pfmemalloc(page) ||
+	    page_to_nid(page) != numa_mem_id())
+		goto free;
+
+	local_irq_save(flags);
+	fc = this_cpu_ptr(&skb_frag_cache);
+	if (fc->count < SKB_FRAG_CACHE_MAX) {
+		fc->pages[fc->count++] = page;
+		page = NULL;
+	}
+	local_irq_restore(flags);
+free:
+	if (page)
+		put_page(page);
+}
+EXPORT_SYMBOL(skb_page_frag_release);
+
+/* Called from dev_cpu_dead() once @cpu is offline. */
+void skb_page_frag_cache_drain(unsigned int cpu)
+{
+	struct skb_frag_cache *fc = &per_cpu(skb_frag_cache, cpu);
+
+	while (fc->count)
+		put_page(fc->pages[--fc->count]);
+}
+
 /**
  * skb_page_frag_refill - check that a page_frag contains enough room
  * @sz: minimum size of the fragment we want to get
@@ -2214,6 +2324,11 @@ bool skb_page_frag_refill(unsigned int sz, struct page_frag *pfrag, gfp_t gfp)
 
 	pfrag->offset = 0;
 	if (SKB_FRAG_PAGE_ORDER) {
+		pfrag->page = skb_frag_cache_get();
+		if (pfrag->page) {
+			pfrag->size = PAGE_SIZE << SKB_FRAG_PAGE_ORDER;
+			return true;
+		}
 		/* Avoid direct reclaim but allow kswapd to wake */
 		pfrag->page = alloc_pages((gfp & ~__GFP_DIRECT_RECLAIM) |
 					  __GFP_COMP | __GFP_NOWARN |
@@ -7,6 +7,7 @@
  */
 
 #include <net/sock_reuseport.h>
+#include <net/tcp_states.h>
 #include <linux/bpf.h>
 #include <linux/rcupdate.h>
 
@@ -14,6 +15,21 @@
 
 static DEFINE_SPINLOCK(reuseport_lock);
 
+static void reuseport_get_incoming_cpu(struct sock *sk,
+				       struct sock_reuseport *reuse)
+{
+	/* paired with READ_ONCE() in reuseport_select_sock_by_hash() */
+	if (sk->sk_incoming_cpu >= 0)
+		WRITE_ONCE(reuse->incoming_cpu, reuse->incoming_cpu + 1);
+}
+
+static void reuseport_put_incoming_cpu(struct sock *sk,
+				       struct sock_reuseport *reuse)
+{
+	if (sk->sk_incoming_cpu >= 0 && reuse->incoming_cpu)
+		WRITE_ONCE(reuse->incoming_cpu, reuse->incoming_cpu - 1);
+}
+
 static struct sock_reuseport *__reuseport_alloc(unsigned int max_socks)
 {
 	unsigned int size = sizeof(struct sock_reuseport) +
@@ -53,6 +69,7 @@ int reuseport_alloc(struct sock *sk)
 
 	reuse->socks[0] = sk;
 	reuse->num_socks = 1;
+	reuseport_get_incoming_cpu(sk, reuse);
 	rcu_assign_pointer(sk->sk_reuseport_cb, reuse);
 
 out:
@@ -77,6 +94,7 @@ static struct sock_reuseport *reuseport_grow(struct sock_reuseport *reuse)
 
 	more_reuse->max_socks = more_socks_size;
 	more_reuse->num_socks = reuse->num_socks;
+	more_reuse->incoming_cpu = reuse->incoming_cpu;
 	more_reuse->prog = reuse->prog;
 
 	memcpy(more_reuse->socks, reuse->socks,
@@ -143,6 +161,7 @@ int reuseport_add_sock(struct sock *sk, struct sock *sk2)
 	/* paired with smp_rmb() in reuseport_select_sock() */
 	smp_wmb();
 	reuse->num_socks++;
+	reuseport_get_incoming_cpu(sk, reuse);
 	rcu_assign_pointer(sk->sk_reuseport_cb, reuse);
 
 	spin_unlock_bh(&reuseport_lock);
@@ -166,6 +185,7 @@ void reuseport_detach_sock(struct sock *sk)
 		if (reuse->socks[i] == sk) {
 			reuse->socks[i] = reuse->socks[reuse->num_socks - 1];
 			reuse->num_socks--;
+			reuseport_put_incoming_cpu(sk, reuse);
 			if (reuse->num_socks == 0)
 				call_rcu(&reuse->rcu, reuseport_free_rcu);
 			break;
@@ -175,6 +195,32 @@ void reuseport_detach_sock(struct sock *sk)
 }
 EXPORT_SYMBOL(reuseport_detach_sock);
 
+/**
+ *  reuseport_update_incoming_cpu - SO_INCOMING_CPU on a group member.
+ *  @sk:  Socket the option is set on.
+ *  @val: New owner cpu, or -1 to clear it.
+ */
+void reuseport_update_incoming_cpu(struct sock *sk, int val)
+{
+	struct sock_reuseport *reuse;
+
+	if (!rcu_access_pointer(sk->sk_reuseport_cb)) {
+		WRITE_ONCE(sk->sk_incoming_cpu, val);
+		return;
+	}
+
+	spin_lock_bh(&reuseport_lock);
+	reuse = rcu_dereference_protected(sk->sk_reuseport_cb,
+					  lockdep_is_held(&reuseport_lock));
+	if (reuse)
+		reuseport_put_incoming_cpu(sk, reuse);
+	/* paired with READ_ONCE() in reuseport_select_sock_by_hash() */
+	WRITE_ONCE(sk->sk_incoming_cpu, val);
+	if (reuse)
+		reuseport_get_incoming_cpu(sk, reuse);
+	spin_unlock_bh(&reuseport_lock);
+}
+
 static struct sock *run_bpf(struct sock_reuseport *reuse, u16 socks,
 			    struct bpf_prog *prog, struct sk_buff *skb,
 			    int hdr_len)
@@ -205,6 +251,35 @@ static struct sock *run_bpf(struct sock_reuseport *reuse, u16 socks,
 	return reuse->socks[index];
 }
 
+/* Pick the hashed socket, unless some members declared an owner cpu with
+ * SO_INCOMING_CPU: the first of those owned by the cpu we are receiving on
+ * wins then, so a flow stays on the cpu its NIC queue is serviced by.
+ * Connected members are skipped as they only take their own flow.
+ */
+static struct sock *reuseport_select_sock_by_hash(struct sock_reuseport *reuse,
+						  u32 hash, u16 num_socks)
+{
+	int cpu = raw_smp_processor_id();
+	int i, j;
+
+	i = j = reciprocal_scale(hash, num_socks);
+	if (!READ_ONCE(reuse->incoming_cpu))
+		return reuse->socks[i];
+
+	do {
+		struct sock *sk = reuse->socks[i];
+
+		if (sk->sk_state != TCP_ESTABLISHED &&
+		    READ_ONCE(sk->sk_incoming_cpu) == cpu)
+			return sk;
+
+		if (++i >= num_socks)
+			i = 0;
+	} while (i != j);
+
+	return reuse->socks[j];
+}
+
 /**
  *  reuseport_select_sock - Select a socket from an SO_REUSEPORT group.
  *  @sk: First socket in the group.
@@ -243,7 +318,7 @@ struct sock *reuseport_select_sock(struct sock *sk,
 
 		/* no bpf or invalid bpf result: fall back to hash usage */
 		if (!sk2)
-			sk2 = reuse->socks[reciprocal_scale(hash, socks)];
+			sk2 = reuseport_select_sock_by_hash(reuse, hash, socks);
 	}
 
 out:
@@ -252,6 +327,47 @@ struct sock *reuseport_select_sock(struct sock *sk,
 }
 EXPORT_SYMBOL(reuseport_select_sock);
 
+/**
+ *  reuseport_migrate_sock - Select a sibling to take over a closing socket.
+ *  @sk: Listener about to leave its SO_REUSEPORT group.
+ *  Prefers a listener owned by the same cpu as @sk. Returns a referenced
+ *  listening socket, or NULL if the group has none left.
+ */
+struct sock *reuseport_migrate_sock(struct sock *sk)
+{
+	struct sock_reuseport *reuse;
+	struct sock *nsk = NULL;
+	int cpu = READ_ONCE(sk->sk_incoming_cpu);
+	u16 socks;
+	int i;
+
+	rcu_read_lock();
+	reuse = rcu_dereference(sk->sk_reuseport_cb);
+	if (!reuse)
+		goto out;
+
+	socks = READ_ONCE(reuse->num_socks);
+	/* paired with smp_wmb() in reuseport_add_sock() */
+	smp_rmb();
+	for (i = 0; i < socks; i++) {
+		struct sock *sk2 = reuse->socks[i];
+
+		if (sk2 == sk || sk2->sk_state != TCP_LISTEN)
+			continue;
+		if (!nsk || READ_ONCE(sk2->sk_incoming_cpu) == cpu) {
+			nsk = sk2;
+			if (cpu < 0 || READ_ONCE(sk2->sk_incoming_cpu) == cpu)
+				break;
+		}
+	}
+	if (nsk && !refcount_inc_not_zero(&nsk->sk_refcnt))
+		nsk = NULL;
+out:
+	rcu_read_unlock();
+	return nsk;
+}
+EXPORT_SYMBOL(reuseport_migrate_sock);
+
 struct bpf_prog *
 reuseport_attach_prog(struct sock *sk, struct bpf_prog *prog)
 {
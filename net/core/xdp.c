@@ -31,6 +31,7 @@ struct xdp_mem_allocator {
 	union {
 		void *allocator;
 		struct page_pool *page_pool;
+		struct zero_copy_allocator *zc_alloc;
 	};
 	struct rhash_head node;
 	struct rcu_head rcu;
@@ -180,6 +181,21 @@ bool xdp_rxq_info_is_reg(struct xdp_rxq_info *xdp_rxq)
 }
 EXPORT_SYMBOL_GPL(xdp_rxq_info_is_reg);
 
+/* Driver builds multi-buffer frames out of @frag_size sized buffers,
+ * zero turns this back off.  See "XDP multi-buffer frames" in xdp.h.
+ */
+int xdp_rxq_info_set_frag_size(struct xdp_rxq_info *xdp_rxq, u32 frag_size)
+{
+	if (frag_size &&
+	    (xdp_rxq->mem.type == MEM_TYPE_ZERO_COPY ||
+	     frag_size < SKB_DATA_ALIGN(sizeof(struct skb_shared_info))))
+		return -EINVAL;
+
+	xdp_rxq->frag_size = frag_size;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xdp_rxq_info_set_frag_size);
+
 static int __mem_id_init_hash_table(void)
 {
 	struct rhashtable *rht;
@@ -261,7 +277,7 @@ int xdp_rxq_info_reg_mem_model(struct xdp_rxq_info *xdp_rxq,
 	xdp_rxq->mem.type = type;
 
 	if (!allocator) {
-		if (type == MEM_TYPE_PAGE_POOL)
+		if (type == MEM_TYPE_PAGE_POOL || type == MEM_TYPE_ZERO_COPY)
 			return -EINVAL; /* Setup time check page_pool req */
 		return 0;
 	}
@@ -308,7 +324,8 @@ int xdp_rxq_info_reg_mem_model(struct xdp_rxq_info *xdp_rxq,
 }
 EXPORT_SYMBOL_GPL(xdp_rxq_info_reg_mem_model);
 
-static void xdp_return(void *data, struct xdp_mem_info *mem)
+static void xdp_return(void *data, struct xdp_mem_info *mem,
+		       unsigned long handle)
 {
 	struct xdp_mem_allocator *xa;
 	struct page *page;
@@ -332,20 +349,54 @@ static void xdp_return(void *data, struct xdp_mem_info *mem)
 		page = virt_to_page(data); /* Assumes order0 page*/
 		put_page(page);
 		break;
+	case MEM_TYPE_ZERO_COPY:
+		/* NB! Only valid from an xdp_buff! */
+		rcu_read_lock();
+		/* mem->id is valid, checked in xdp_rxq_info_reg_mem_model() */
+		xa = rhashtable_lookup(mem_id_ht, &mem->id, mem_id_rht_params);
+		xa->zc_alloc->free(xa->zc_alloc, handle);
+		rcu_read_unlock();
+		break;
 	default:
 		/* Not possible, checked in xdp_rxq_info_reg_mem_model() */
 		break;
 	}
 }
 
+/* Frags share the memory model of the head buffer, and must be
+ * released before it as the frag list lives in the head's tailroom.
+ */
+void xdp_return_frag(skb_frag_t *frag, struct xdp_mem_info *mem)
+{
+	xdp_return(skb_frag_address(frag), mem, 0);
+}
+EXPORT_SYMBOL_GPL(xdp_return_frag);
+
+static void xdp_return_frags(struct skb_shared_info *sinfo,
+			     struct xdp_mem_info *mem)
+{
+	int i;
+
+	for (i = 0; i < sinfo->nr_frags; i++)
+		xdp_return_frag(&sinfo->frags[i], mem);
+}
+
 void xdp_return_frame(struct xdp_frame *xdpf)
 {
-	xdp_return(xdpf->data, &xdpf->mem);
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		xdp_return_frags(xdp_get_shared_info_from_frame(xdpf),
+				 &xdpf->mem);
+
+	xdp_return(xdpf->data, &xdpf->mem, 0);
 }
 EXPORT_SYMBOL_GPL(xdp_return_frame);
 
 void xdp_return_buff(struct xdp_buff *xdp)
 {
-	xdp_return(xdp->data, &xdp->rxq->mem);
+	if (unlikely(xdp_buff_has_frags(xdp)))
+		xdp_return_frags(xdp_get_shared_info_from_buff(xdp),
+				 &xdp->rxq->mem);
+
+	xdp_return(xdp->data, &xdp->rxq->mem, xdp->handle);
 }
 EXPORT_SYMBOL_GPL(xdp_return_buff);
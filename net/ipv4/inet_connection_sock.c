@@ -419,6 +419,32 @@ static int inet_csk_wait_for_connect(struct sock *sk, long timeo)
 	return err;
 }
 
+static struct sock *inet_csk_accept_child(struct sock *sk,
+					  struct request_sock *req)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct sock *newsk = req->sk;
+
+	if (sk->sk_protocol == IPPROTO_TCP &&
+	    tcp_rsk(req)->tfo_listener) {
+		spin_lock_bh(&queue->fastopenq.lock);
+		if (tcp_rsk(req)->tfo_listener) {
+			/* We are still waiting for the final ACK from 3WHS
+			 * so can't free req now. Instead, we set req->sk to
+			 * NULL to signify that the child socket is taken
+			 * so reqsk_fastopen_remove() will free the req
+			 * when 3WHS finishes (or is aborted).
+			 */
+			req->sk = NULL;
+			req = NULL;
+		}
+		spin_unlock_bh(&queue->fastopenq.lock);
+	}
+	if (req)
+		reqsk_put(req);
+	return newsk;
+}
+
 /*
  * This will accept the next outstanding connection.
  */
@@ -427,9 +453,18 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err, bool kern)
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
 	struct request_sock *req;
-	struct sock *newsk;
+	long timeo;
 	int error;
 
+	/* Per-cpu accept queues are drained without the listener lock,
+	 * which is then only needed to sleep waiting for a connection.
+	 */
+	if (queue->rskq_shards && inet_sk_state_load(sk) == TCP_LISTEN) {
+		req = reqsk_queue_remove(queue, sk);
+		if (req)
+			return inet_csk_accept_child(sk, req);
+	}
+
 	lock_sock(sk);
 
 	/* We need to make sure that this socket is listening,
@@ -439,47 +474,32 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err, bool kern)
 	if (sk->sk_state != TCP_LISTEN)
 		goto out_err;
 
-	/* Find already established connection */
-	if (reqsk_queue_empty(queue)) {
-		long timeo = sock_rcvtimeo(sk, flags & O_NONBLOCK);
+	timeo = sock_rcvtimeo(sk, flags & O_NONBLOCK);
+	for (;;) {
+		/* Find already established connection */
+		req = reqsk_queue_remove(queue, sk);
+		if (req)
+			break;
 
 		/* If this is a non blocking socket don't sleep */
 		error = -EAGAIN;
 		if (!timeo)
 			goto out_err;
 
+		/* Lockless acceptors may have raced us to the child we were
+		 * woken up for, in which case we simply wait again.
+		 */
 		error = inet_csk_wait_for_connect(sk, timeo);
 		if (error)
 			goto out_err;
 	}
-	req = reqsk_queue_remove(queue, sk);
-	newsk = req->sk;
-
-	if (sk->sk_protocol == IPPROTO_TCP &&
-	    tcp_rsk(req)->tfo_listener) {
-		spin_lock_bh(&queue->fastopenq.lock);
-		if (tcp_rsk(req)->tfo_listener) {
-			/* We are still waiting for the final ACK from 3WHS
-			 * so can't free req now. Instead, we set req->sk to
-			 * NULL to signify that the child socket is taken
-			 * so reqsk_fastopen_remove() will free the req
-			 * when 3WHS finishes (or is aborted).
-			 */
-			req->sk = NULL;
-			req = NULL;
-		}
-		spin_unlock_bh(&queue->fastopenq.lock);
-	}
-out:
 	release_sock(sk);
-	if (req)
-		reqsk_put(req);
-	return newsk;
+	return inet_csk_accept_child(sk, req);
+
 out_err:
-	newsk = NULL;
-	req = NULL;
+	release_sock(sk);
 	*err = error;
-	goto out;
+	return NULL;
 }
 EXPORT_SYMBOL(inet_csk_accept);
 
@@ -825,6 +845,7 @@ void inet_csk_destroy_sock(struct sock *sk)
 
 	sk->sk_prot->destroy(sk);
 
+	reqsk_queue_free_shards(&inet_csk(sk)->icsk_accept_queue);
 	sk_stream_kill_queues(sk);
 
 	xfrm_sk_free_policy(sk);
@@ -858,9 +879,14 @@ int inet_csk_listen_start(struct sock *sk, int backlog)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	struct inet_sock *inet = inet_sk(sk);
-	int err = -EADDRINUSE;
+	int err;
 
 	reqsk_queue_alloc(&icsk->icsk_accept_queue);
+	if (icsk->icsk_accept_queue.rskq_percpu) {
+		err = reqsk_queue_alloc_shards(&icsk->icsk_accept_queue);
+		if (err)
+			return err;
+	}
 
 	sk->sk_max_ack_backlog = backlog;
 	sk->sk_ack_backlog = 0;
@@ -872,6 +898,7 @@ int inet_csk_listen_start(struct sock *sk, int backlog)
 	 * after validation is complete.
 	 */
 	inet_sk_state_store(sk, TCP_LISTEN);
+	err = -EADDRINUSE;
 	if (!sk->sk_prot->get_port(sk, inet->inet_num)) {
 		inet->inet_sport = htons(inet->inet_num);
 
@@ -911,12 +938,40 @@ static void inet_child_forget(struct sock *sk, struct request_sock *req,
 	inet_csk_destroy_sock(child);
 }
 
+static struct sock *inet_csk_reqsk_shard_add(struct sock *sk,
+					     struct request_sock *req,
+					     struct sock *child)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	struct request_sock_shard *shard = raw_cpu_ptr(queue->rskq_shards);
+
+	spin_lock(&shard->lock);
+	if (unlikely(sk->sk_state != TCP_LISTEN)) {
+		inet_child_forget(sk, req, child);
+		child = NULL;
+	} else {
+		req->sk = child;
+		req->dl_next = NULL;
+		if (shard->head == NULL)
+			WRITE_ONCE(shard->head, req);
+		else
+			shard->tail->dl_next = req;
+		shard->tail = req;
+		reqsk_shard_acceptq_update(queue, sk, 1);
+	}
+	spin_unlock(&shard->lock);
+	return child;
+}
+
 struct sock *inet_csk_reqsk_queue_add(struct sock *sk,
 				      struct request_sock *req,
 				      struct sock *child)
 {
 	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
 
+	if (queue->rskq_shards)
+		return inet_csk_reqsk_shard_add(sk, req, child);
+
 	spin_lock(&queue->rskq_lock);
 	if (unlikely(sk->sk_state != TCP_LISTEN)) {
 		inet_child_forget(sk, req, child);
@@ -954,13 +1009,17 @@ EXPORT_SYMBOL(inet_csk_complete_hashdance);
 
 /*
  *	This routine closes sockets which have been at least partially
- *	opened, but not yet accepted.
+ *	opened, but not yet accepted. If @nsk is set, the established
+ *	children are handed over to that listener instead, which is how
+ *	a SO_REUSEPORT group member can close without resetting them.
+ *	Fast Open children still tied to their request are not moved.
  */
-void inet_csk_listen_stop(struct sock *sk)
+void inet_csk_listen_stop_migrate(struct sock *sk, struct sock *nsk)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
 	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
 	struct request_sock *next, *req;
+	bool migrated = false;
 
 	/* Following specs, it would be better either to send FIN
 	 * (and enter FIN-WAIT-1, it is normal close)
@@ -978,14 +1037,25 @@ void inet_csk_listen_stop(struct sock *sk)
 		WARN_ON(sock_owned_by_user(child));
 		sock_hold(child);
 
-		inet_child_forget(sk, req, child);
-		reqsk_put(req);
+		if (nsk && !(sk->sk_protocol == IPPROTO_TCP &&
+			     tcp_rsk(req)->tfo_listener)) {
+			/* On failure the child was forgotten by nsk */
+			if (inet_csk_reqsk_queue_add(nsk, req, child))
+				migrated = true;
+			else
+				reqsk_put(req);
+		} else {
+			inet_child_forget(sk, req, child);
+			reqsk_put(req);
+		}
 		bh_unlock_sock(child);
 		local_bh_enable();
 		sock_put(child);
 
 		cond_resched();
 	}
+	if (migrated)
+		nsk->sk_data_ready(nsk);
 	if (queue->fastopenq.rskq_rst_head) {
 		/* Free all the reqs queued in rskq_rst_head. */
 		spin_lock_bh(&queue->fastopenq.lock);
@@ -998,8 +1068,19 @@ void inet_csk_listen_stop(struct sock *sk)
 			req = next;
 		}
 	}
+	if (queue->rskq_shards) {
+		/* Lockless acceptors may leave a stale mirror behind */
+		WARN_ON_ONCE(atomic_read(&queue->rskq_shard_qlen));
+		sk->sk_ack_backlog = 0;
+	}
 	WARN_ON_ONCE(sk->sk_ack_backlog);
 }
+EXPORT_SYMBOL_GPL(inet_csk_listen_stop_migrate);
+
+void inet_csk_listen_stop(struct sock *sk)
+{
+	inet_csk_listen_stop_migrate(sk, NULL);
+}
 EXPORT_SYMBOL_GPL(inet_csk_listen_stop);
 
 void inet_csk_addr2sockaddr(struct sock *sk, struct sockaddr *uaddr)
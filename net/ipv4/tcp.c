@@ -282,6 +282,7 @@
 #include <linux/uaccess.h>
 #include <asm/ioctls.h>
 #include <net/busy_poll.h>
+#include <net/sock_reuseport.h>
 
 struct percpu_counter tcp_orphan_count;
 EXPORT_SYMBOL_GPL(tcp_orphan_count);
@@ -1746,17 +1747,66 @@ int tcp_mmap(struct file *file, struct socket *sock,
 }
 EXPORT_SYMBOL(tcp_mmap);
 
+/* Copy the part of the current skb that could not be mapped (a sub-page
+ * tail, or payload sitting in the linear area) into the user supplied
+ * copybuf, so that a single call consumes it without a recvmsg().
+ */
+static u32 tcp_zc_handle_leftover(struct tcp_zerocopy_receive *zc,
+				  struct sock *sk, struct sk_buff *skb,
+				  u32 *seq, s32 copybuf_len)
+{
+	unsigned long copy_address = (unsigned long)zc->copybuf_address;
+	u32 offset, copylen = min_t(u32, copybuf_len, zc->recv_skip_hint);
+	struct msghdr msg = {};
+	struct iovec iov;
+	int err;
+
+	if (!copylen)
+		return 0;
+	if (copy_address != zc->copybuf_address) {
+		zc->copybuf_len = -EINVAL;
+		return 0;
+	}
+
+	/* skb is NULL when less than a page was readable */
+	if (skb)
+		offset = *seq - TCP_SKB_CB(skb)->seq;
+	else
+		skb = tcp_recv_skb(sk, *seq, &offset);
+	if (!skb)
+		return 0;
+	copylen = min_t(u32, copylen, skb->len - offset);
+
+	err = import_single_range(READ, (void __user *)copy_address,
+				  copylen, &iov, &msg.msg_iter);
+	if (!err)
+		err = skb_copy_datagram_msg(skb, offset, &msg, copylen);
+	if (err) {
+		zc->copybuf_len = err;
+		return 0;
+	}
+
+	zc->copybuf_len = copylen;
+	zc->recv_skip_hint -= copylen;
+	*seq += copylen;
+	return copylen;
+}
+
 static int tcp_zerocopy_receive(struct sock *sk,
 				struct tcp_zerocopy_receive *zc)
 {
 	unsigned long address = (unsigned long)zc->address;
+	s32 copybuf_len = zc->copybuf_len;
 	const skb_frag_t *frags = NULL;
-	u32 length = 0, seq, offset;
+	u32 length = 0, copylen = 0;
+	u32 seq, offset, inq;
 	struct vm_area_struct *vma;
 	struct sk_buff *skb = NULL;
 	struct tcp_sock *tp;
 	int ret;
 
+	zc->copybuf_len = 0;
+
 	if (address & (PAGE_SIZE - 1) || address != zc->address)
 		return -EINVAL;
 
@@ -1775,12 +1825,16 @@ static int tcp_zerocopy_receive(struct sock *sk,
 
 	tp = tcp_sk(sk);
 	seq = tp->copied_seq;
-	zc->length = min_t(u32, zc->length, tcp_inq(sk));
+	inq = tcp_inq(sk);
+	zc->length = min_t(u32, zc->length, inq);
 	zc->length &= ~(PAGE_SIZE - 1);
 
-	zap_page_range(vma, address, zc->length);
-
-	zc->recv_skip_hint = 0;
+	if (zc->length) {
+		zap_page_range(vma, address, zc->length);
+		zc->recv_skip_hint = 0;
+	} else {
+		zc->recv_skip_hint = inq;
+	}
 	ret = 0;
 	while (length + PAGE_SIZE <= zc->length) {
 		if (zc->recv_skip_hint < PAGE_SIZE) {
@@ -1816,15 +1870,20 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	}
 out:
 	up_read(&current->mm->mmap_sem);
-	if (length) {
+
+	/* Try to copy straggler data. */
+	if (!ret && copybuf_len > 0)
+		copylen = tcp_zc_handle_leftover(zc, sk, skb, &seq,
+						 copybuf_len);
+	if (length + copylen) {
 		tp->copied_seq = seq;
 		tcp_rcv_space_adjust(sk);
 
 		/* Clean up data we have read: This will do ACK frames. */
 		tcp_recv_skb(sk, seq, &offset);
-		tcp_cleanup_rbuf(sk, length);
+		tcp_cleanup_rbuf(sk, length + copylen);
 		ret = 0;
-		if (length == zc->length)
+		if (zc->length && length == zc->length)
 			zc->recv_skip_hint = 0;
 	} else {
 		if (!zc->recv_skip_hint && sock_flag(sk, SOCK_DONE))
@@ -2313,6 +2372,18 @@ bool tcp_check_oom(struct sock *sk, int shift)
 	return too_many_orphans || out_of_socket_memory;
 }
 
+/* With net.ipv4.tcp_migrate_req, a closing SO_REUSEPORT listener hands its
+ * accept queue over to a sibling instead of resetting it. The sibling must
+ * be picked before the listener leaves the group on TCP_CLOSE.
+ */
+static struct sock *tcp_listen_migrate_target(struct sock *sk)
+{
+	if (!sock_net(sk)->ipv4.sysctl_tcp_migrate_req ||
+	    !rcu_access_pointer(sk->sk_reuseport_cb))
+		return NULL;
+	return reuseport_migrate_sock(sk);
+}
+
 void tcp_close(struct sock *sk, long timeout)
 {
 	struct sk_buff *skb;
@@ -2323,10 +2394,14 @@ void tcp_close(struct sock *sk, long timeout)
 	sk->sk_shutdown = SHUTDOWN_MASK;
 
 	if (sk->sk_state == TCP_LISTEN) {
+		struct sock *nsk = tcp_listen_migrate_target(sk);
+
 		tcp_set_state(sk, TCP_CLOSE);
 
 		/* Special case. */
-		inet_csk_listen_stop(sk);
+		inet_csk_listen_stop_migrate(sk, nsk);
+		if (nsk)
+			sock_put(nsk);
 
 		goto adjudge_to_death;
 	}
@@ -2538,13 +2613,18 @@ int tcp_disconnect(struct sock *sk, int flags)
 	struct tcp_sock *tp = tcp_sk(sk);
 	int err = 0;
 	int old_state = sk->sk_state;
+	struct sock *nsk = NULL;
 
+	if (old_state == TCP_LISTEN)
+		nsk = tcp_listen_migrate_target(sk);
 	if (old_state != TCP_CLOSE)
 		tcp_set_state(sk, TCP_CLOSE);
 
 	/* ABORT function of RFC793 */
 	if (old_state == TCP_LISTEN) {
-		inet_csk_listen_stop(sk);
+		inet_csk_listen_stop_migrate(sk, nsk);
+		if (nsk)
+			sock_put(nsk);
 	} else if (unlikely(tp->repair)) {
 		sk->sk_err = ECONNABORTED;
 	} else if (tcp_need_reset(old_state) ||
@@ -2596,6 +2676,7 @@ int tcp_disconnect(struct sock *sk, int flags)
 	sk->sk_rx_dst = NULL;
 	tcp_saved_syn_free(tp);
 	tp->compressed_ack = 0;
+	tp->dup_ack_counter = 0;
 
 	/* Clean up fastopen related fields */
 	tcp_free_fastopen_req(tp);
@@ -2603,11 +2684,8 @@ int tcp_disconnect(struct sock *sk, int flags)
 
 	WARN_ON(inet->inet_num && !icsk->icsk_bind_hash);
 
-	if (sk->sk_frag.page) {
-		put_page(sk->sk_frag.page);
-		sk->sk_frag.page = NULL;
-		sk->sk_frag.offset = 0;
-	}
+	skb_page_frag_release(&sk->sk_frag);
+	sk->sk_frag.offset = 0;
 
 	sk->sk_error_report(sk);
 	return err;
@@ -2944,6 +3022,18 @@ static int do_tcp_setsockopt(struct sock *sk, int level,
 					TCP_RTO_MAX / HZ);
 		break;
 
+	case TCP_ACCEPT_PERCPU:
+		/* The queues are set up by listen() and live as long as
+		 * the socket, they can't be turned off once allocated.
+		 */
+		if (sk->sk_state != TCP_CLOSE)
+			err = -EINVAL;
+		else if (!val && icsk->icsk_accept_queue.rskq_shards)
+			err = -EBUSY;
+		else
+			icsk->icsk_accept_queue.rskq_percpu = !!val;
+		break;
+
 	case TCP_WINDOW_CLAMP:
 		if (!val) {
 			if (sk->sk_state != TCP_CLOSE) {
@@ -3304,6 +3394,9 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 		val = retrans_to_secs(icsk->icsk_accept_queue.rskq_defer_accept,
 				      TCP_TIMEOUT_INIT / HZ, TCP_RTO_MAX / HZ);
 		break;
+	case TCP_ACCEPT_PERCPU:
+		val = icsk->icsk_accept_queue.rskq_percpu;
+		break;
 	case TCP_WINDOW_CLAMP:
 		val = tp->window_clamp;
 		break;
@@ -3506,17 +3599,28 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 	}
 #ifdef CONFIG_MMU
 	case TCP_ZEROCOPY_RECEIVE: {
-		struct tcp_zerocopy_receive zc;
+		struct tcp_zerocopy_receive zc = {};
 		int err;
 
 		if (get_user(len, optlen))
 			return -EFAULT;
-		if (len != sizeof(zc))
+		/* Older binaries pass the structure without the trailing
+		 * out fields and the copybuf, accept any known prefix.
+		 */
+		if (len != offsetofend(struct tcp_zerocopy_receive,
+				       recv_skip_hint) &&
+		    len != offsetofend(struct tcp_zerocopy_receive, err) &&
+		    len != sizeof(zc))
 			return -EINVAL;
 		if (copy_from_user(&zc, optval, len))
 			return -EFAULT;
 		lock_sock(sk);
 		err = tcp_zerocopy_receive(sk, &zc);
+		if (len >= offsetofend(struct tcp_zerocopy_receive, err)) {
+			if (!err)
+				zc.err = sock_error(sk);
+			zc.inq = tcp_inq_hint(sk);
+		}
 		release_sock(sk);
 		if (!err && copy_to_user(optval, &zc, len))
 			err = -EFAULT;
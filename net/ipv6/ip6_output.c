@@ -380,6 +380,8 @@ static inline int ip6_forward_finish(struct net *net, struct sock *sk,
 	__IP6_INC_STATS(net, ip6_dst_idev(dst), IPSTATS_MIB_OUTFORWDATAGRAMS);
 	__IP6_ADD_STATS(net, ip6_dst_idev(dst), IPSTATS_MIB_OUTOCTETS, skb->len);
 
+	/* the rx timestamp must not be taken for a departure time */
+	skb->tstamp = 0;
 	return dst_output(net, sk, skb);
 }
 
@@ -1576,6 +1578,7 @@ int ip6_append_data(struct sock *sk,
 				     ipc6, rt, fl6);
 		if (err)
 			return err;
+		inet->cork.base.transmit_time = sockc->transmit_time;
 
 		exthdrlen = (ipc6->opt ? ipc6->opt->opt_flen : 0);
 		length += exthdrlen;
@@ -1670,6 +1673,7 @@ struct sk_buff *__ip6_make_skb(struct sock *sk,
 
 	skb->priority = sk->sk_priority;
 	skb->mark = sk->sk_mark;
+	skb->tstamp = cork->base.transmit_time;
 
 	skb_dst_set(skb, dst_clone(&rt->dst));
 	IP6_UPD_PO_STATS(net, rt->rt6i_idev, IPSTATS_MIB_OUT, skb->len);
@@ -1768,6 +1772,7 @@ struct sk_buff *ip6_make_skb(struct sock *sk,
 		ip6_cork_release(cork, &v6_cork);
 		return ERR_PTR(err);
 	}
+	cork->base.transmit_time = sockc->transmit_time;
 	if (ipc6->dontfrag < 0)
 		ipc6->dontfrag = inet6_sk(sk)->dontfrag;
 
@@ -67,6 +67,20 @@ EXPORT_SYMBOL_GPL(nf_conntrack_expect_lock);
 struct hlist_nulls_head *nf_conntrack_hash __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 
+/* While nf_conntrack_hash_resize() runs, new entries go to the new
+ * nf_conntrack_hash and the old table is drained one bucket at a time.
+ * Table sizes are powers of two no smaller than CONNTRACK_LOCKS and the
+ * bucket is taken from the low bits of the hash, so an entry maps to
+ * the same lock in both tables and a single bucket lock serializes all
+ * changes to it. Lockless lookups that miss in the new table also look
+ * in the old one, and nf_conntrack_drain_seq tells them to retry when
+ * an entry was moved meanwhile.
+ */
+static struct hlist_nulls_head *nf_conntrack_hash_old __read_mostly;
+static unsigned int nf_conntrack_htable_size_old __read_mostly;
+static seqcount_t nf_conntrack_drain_seq;
+static DEFINE_MUTEX(nf_conntrack_hash_mutex);
+
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
 	u32			last_bucket;
@@ -204,16 +218,21 @@ static u32 hash_conntrack_raw(const struct nf_conntrack_tuple *tuple,
 		      tuple->dst.protonum));
 }
 
+static u32 nf_ct_bucket(u32 hash, unsigned int size)
+{
+	return hash & (size - 1);
+}
+
 static u32 scale_hash(u32 hash)
 {
-	return reciprocal_scale(hash, nf_conntrack_htable_size);
+	return nf_ct_bucket(hash, nf_conntrack_htable_size);
 }
 
 static u32 __hash_conntrack(const struct net *net,
 			    const struct nf_conntrack_tuple *tuple,
 			    unsigned int size)
 {
-	return reciprocal_scale(hash_conntrack_raw(tuple, net), size);
+	return nf_ct_bucket(hash_conntrack_raw(tuple, net), size);
 }
 
 static u32 hash_conntrack(const struct net *net,
@@ -519,18 +538,34 @@ static void nf_ct_gc_expired(struct nf_conn *ct)
  * - Caller must take a reference on returned object
  *   and recheck nf_ct_tuple_equal(tuple, &h->tuple)
  */
+/* must be called with rcu read lock held, returns false unless a
+ * resize is draining the old table
+ */
+static bool
+nf_conntrack_get_ht_old(struct hlist_nulls_head **hash, unsigned int *hsize)
+{
+	struct hlist_nulls_head *hptr;
+	unsigned int sequence, hsz;
+
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hsz = nf_conntrack_htable_size_old;
+		hptr = nf_conntrack_hash_old;
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+	*hash = hptr;
+	*hsize = hsz;
+	return hptr != NULL;
+}
+
 static struct nf_conntrack_tuple_hash *
-____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
-		      const struct nf_conntrack_tuple *tuple, u32 hash)
+nf_ct_find_bucket(struct net *net, const struct nf_conntrack_zone *zone,
+		  const struct nf_conntrack_tuple *tuple,
+		  struct hlist_nulls_head *ct_hash, unsigned int bucket,
+		  bool *restart)
 {
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_head *ct_hash;
 	struct hlist_nulls_node *n;
-	unsigned int bucket, hsize;
-
-begin:
-	nf_conntrack_get_ht(&ct_hash, &hsize);
-	bucket = reciprocal_scale(hash, hsize);
 
 	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[bucket], hnnode) {
 		struct nf_conn *ct;
@@ -552,12 +587,46 @@ ____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
 	 * not the expected one, we must restart lookup.
 	 * We probably met an item that was moved to another chain.
 	 */
-	if (get_nulls_value(n) != bucket) {
-		NF_CT_STAT_INC_ATOMIC(net, search_restart);
-		goto begin;
+	*restart = get_nulls_value(n) != bucket;
+
+	return NULL;
+}
+
+static struct nf_conntrack_tuple_hash *
+____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
+		      const struct nf_conntrack_tuple *tuple, u32 hash)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_head *ct_hash;
+	unsigned int hsize, drain;
+	bool restart;
+
+begin:
+	drain = raw_read_seqcount(&nf_conntrack_drain_seq);
+	nf_conntrack_get_ht(&ct_hash, &hsize);
+
+	h = nf_ct_find_bucket(net, zone, tuple, ct_hash,
+			      nf_ct_bucket(hash, hsize), &restart);
+	if (h)
+		return h;
+	if (restart)
+		goto restart;
+
+	if (unlikely(nf_conntrack_get_ht_old(&ct_hash, &hsize))) {
+		h = nf_ct_find_bucket(net, zone, tuple, ct_hash,
+				      nf_ct_bucket(hash, hsize), &restart);
+		if (h)
+			return h;
+		if (restart || (drain & 1) ||
+		    read_seqcount_retry(&nf_conntrack_drain_seq, drain))
+			goto restart;
 	}
 
 	return NULL;
+
+restart:
+	NF_CT_STAT_INC_ATOMIC(net, search_restart);
+	goto begin;
 }
 
 /* Find a connection corresponding to a tuple. */
@@ -597,6 +666,28 @@ nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_find_get);
 
+/* Must be called with the bucket locks of the tuple held, they also
+ * cover its bucket in a table being drained by a resize.
+ */
+static struct nf_conntrack_tuple_hash *
+nf_ct_find_old_locked(struct net *net, const struct nf_conntrack_zone *zone,
+		      const struct nf_conntrack_tuple *tuple)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	unsigned int bucket;
+
+	if (likely(!nf_conntrack_hash_old))
+		return NULL;
+
+	bucket = __hash_conntrack(net, tuple, nf_conntrack_htable_size_old);
+	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash_old[bucket], hnnode)
+		if (nf_ct_key_equal(h, tuple, zone, net))
+			return h;
+
+	return NULL;
+}
+
 static void __nf_conntrack_hash_insert(struct nf_conn *ct,
 				       unsigned int hash,
 				       unsigned int reply_hash)
@@ -639,6 +730,14 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 				    zone, net))
 			goto out;
 
+	h = nf_ct_find_old_locked(net, zone,
+				  &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+	if (!h)
+		h = nf_ct_find_old_locked(net, zone,
+					  &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	if (h)
+		goto out;
+
 	smp_wmb();
 	/* The caller holds a reference to this object */
 	atomic_set(&ct->ct_general.use, 2);
@@ -787,6 +886,14 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 				    zone, net))
 			goto out;
 
+	h = nf_ct_find_old_locked(net, zone,
+				  &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+	if (!h)
+		h = nf_ct_find_old_locked(net, zone,
+					  &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	if (h)
+		goto out;
+
 	/* Timer relative to confirmation time, not original
 	   setting time, otherwise we'd get timer wrap in
 	   weird delay cases. */
@@ -840,15 +947,19 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 	const struct nf_conntrack_zone *zone;
 	struct nf_conntrack_tuple_hash *h;
 	struct hlist_nulls_head *ct_hash;
-	unsigned int hash, hsize;
+	unsigned int hash, hsize, drain;
 	struct hlist_nulls_node *n;
 	struct nf_conn *ct;
+	bool old;
 
 	zone = nf_ct_zone(ignored_conntrack);
 
 	rcu_read_lock();
  begin:
+	drain = raw_read_seqcount(&nf_conntrack_drain_seq);
 	nf_conntrack_get_ht(&ct_hash, &hsize);
+	old = false;
+ walk:
 	hash = __hash_conntrack(net, tuple, hsize);
 
 	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[hash], hnnode) {
@@ -874,6 +985,17 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 		goto begin;
 	}
 
+	/* Entries not moved yet by an ongoing resize */
+	if (!old && unlikely(nf_conntrack_get_ht_old(&ct_hash, &hsize))) {
+		old = true;
+		goto walk;
+	}
+	if (old && ((drain & 1) ||
+		    read_seqcount_retry(&nf_conntrack_drain_seq, drain))) {
+		NF_CT_STAT_INC_ATOMIC(net, search_restart);
+		goto begin;
+	}
+
 	rcu_read_unlock();
 
 	return 0;
@@ -939,7 +1061,7 @@ static noinline int early_drop(struct net *net, unsigned int _hash)
 
 		rcu_read_lock();
 		nf_conntrack_get_ht(&ct_hash, &hsize);
-		hash = reciprocal_scale(_hash++, hsize);
+		hash = nf_ct_bucket(_hash++, hsize);
 
 		drops = early_drop_list(net, &ct_hash[hash]);
 		rcu_read_unlock();
@@ -1727,6 +1849,10 @@ static void nf_ct_iterate_cleanup(int (*iter)(struct nf_conn *i, void *data),
 
 	might_sleep();
 
+	/* get_next_corpse() only walks nf_conntrack_hash, let a resize
+	 * finish moving entries out of the old table first.
+	 */
+	mutex_lock(&nf_conntrack_hash_mutex);
 	for (;;) {
 		sequence = read_seqcount_begin(&nf_conntrack_generation);
 
@@ -1742,6 +1868,7 @@ static void nf_ct_iterate_cleanup(int (*iter)(struct nf_conn *i, void *data),
 			break;
 		bucket = 0;
 	}
+	mutex_unlock(&nf_conntrack_hash_mutex);
 }
 
 struct iter_data {
@@ -1977,51 +2104,80 @@ void *nf_ct_alloc_hashtable(unsigned int *sizep, int nulls)
 }
 EXPORT_SYMBOL_GPL(nf_ct_alloc_hashtable);
 
-int nf_conntrack_hash_resize(unsigned int hashsize)
+/* Move the entries of the old table to the new one, one bucket at a
+ * time, so that inserts and deletes only ever wait for a single bucket
+ * and lookups never stall behind the whole rehash.
+ */
+static void nf_conntrack_drain_old(struct hlist_nulls_head *old_hash,
+				   unsigned int old_size)
 {
-	int i, bucket;
-	unsigned int old_size;
-	struct hlist_nulls_head *hash, *old_hash;
 	struct nf_conntrack_tuple_hash *h;
+	unsigned int i, bucket;
+	spinlock_t *lockp;
 	struct nf_conn *ct;
 
-	if (!hashsize)
+	for (i = 0; i < old_size; i++) {
+		/* Same lock as the destination buckets, see above */
+		lockp = &nf_conntrack_locks[i % CONNTRACK_LOCKS];
+
+		local_bh_disable();
+		nf_conntrack_lock(lockp);
+		write_seqcount_begin(&nf_conntrack_drain_seq);
+		while (!hlist_nulls_empty(&old_hash[i])) {
+			h = hlist_nulls_entry(old_hash[i].first,
+					      struct nf_conntrack_tuple_hash, hnnode);
+			ct = nf_ct_tuplehash_to_ctrack(h);
+			hlist_nulls_del_rcu(&h->hnnode);
+			bucket = __hash_conntrack(nf_ct_net(ct), &h->tuple,
+						  nf_conntrack_htable_size);
+			hlist_nulls_add_head_rcu(&h->hnnode,
+						 &nf_conntrack_hash[bucket]);
+		}
+		write_seqcount_end(&nf_conntrack_drain_seq);
+		spin_unlock(lockp);
+		local_bh_enable();
+
+		cond_resched();
+	}
+}
+
+static unsigned int nf_conntrack_hash_size(unsigned int hashsize)
+{
+	return roundup_pow_of_two(max_t(unsigned int, hashsize,
+					CONNTRACK_LOCKS));
+}
+
+int nf_conntrack_hash_resize(unsigned int hashsize)
+{
+	struct hlist_nulls_head *hash, *old_hash;
+	unsigned int old_size;
+
+	if (!hashsize || hashsize > (UINT_MAX >> 1) + 1)
 		return -EINVAL;
 
+	hashsize = nf_conntrack_hash_size(hashsize);
 	hash = nf_ct_alloc_hashtable(&hashsize, 1);
 	if (!hash)
 		return -ENOMEM;
 
+	mutex_lock(&nf_conntrack_hash_mutex);
 	old_size = nf_conntrack_htable_size;
 	if (old_size == hashsize) {
+		mutex_unlock(&nf_conntrack_hash_mutex);
 		nf_ct_free_hashtable(hash, hashsize);
 		return 0;
 	}
 
+	/* Switch inserts over to the new table; lookups search both
+	 * until the old one is empty.
+	 */
 	local_bh_disable();
 	nf_conntrack_all_lock();
 	write_seqcount_begin(&nf_conntrack_generation);
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the locks.
-	 */
-
-	for (i = 0; i < nf_conntrack_htable_size; i++) {
-		while (!hlist_nulls_empty(&nf_conntrack_hash[i])) {
-			h = hlist_nulls_entry(nf_conntrack_hash[i].first,
-					      struct nf_conntrack_tuple_hash, hnnode);
-			ct = nf_ct_tuplehash_to_ctrack(h);
-			hlist_nulls_del_rcu(&h->hnnode);
-			bucket = __hash_conntrack(nf_ct_net(ct),
-						  &h->tuple, hashsize);
-			hlist_nulls_add_head_rcu(&h->hnnode, &hash[bucket]);
-		}
-	}
-	old_size = nf_conntrack_htable_size;
 	old_hash = nf_conntrack_hash;
-
+	nf_conntrack_hash_old = old_hash;
+	nf_conntrack_htable_size_old = old_size;
 	nf_conntrack_hash = hash;
 	nf_conntrack_htable_size = hashsize;
 
@@ -2029,6 +2185,18 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	nf_conntrack_all_unlock();
 	local_bh_enable();
 
+	nf_conntrack_drain_old(old_hash, old_size);
+
+	local_bh_disable();
+	nf_conntrack_all_lock();
+	write_seqcount_begin(&nf_conntrack_generation);
+	nf_conntrack_hash_old = NULL;
+	nf_conntrack_htable_size_old = 0;
+	write_seqcount_end(&nf_conntrack_generation);
+	nf_conntrack_all_unlock();
+	local_bh_enable();
+	mutex_unlock(&nf_conntrack_hash_mutex);
+
 	synchronize_net();
 	nf_ct_free_hashtable(old_hash, old_size);
 	return 0;
@@ -2114,8 +2282,6 @@ int nf_conntrack_init_start(void)
 			nf_conntrack_htable_size = 65536;
 		else if (totalram_pages > (1024 * 1024 * 1024 / PAGE_SIZE))
 			nf_conntrack_htable_size = 16384;
-		if (nf_conntrack_htable_size < 32)
-			nf_conntrack_htable_size = 32;
 
 		/* Use a max. factor of four by default to get the same max as
 		 * with the old struct list_heads. When a table size is given
@@ -2124,6 +2290,8 @@ int nf_conntrack_init_start(void)
 		max_factor = 4;
 	}
 
+	seqcount_init(&nf_conntrack_drain_seq);
+	nf_conntrack_htable_size = nf_conntrack_hash_size(nf_conntrack_htable_size);
 	nf_conntrack_hash = nf_ct_alloc_hashtable(&nf_conntrack_htable_size, 1);
 	if (!nf_conntrack_hash)
 		return -ENOMEM;
@@ -4,6 +4,7 @@
 #include <linux/netfilter.h>
 #include <linux/rhashtable.h>
 #include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
 #include <net/ip.h>
 #include <net/ip6_route.h>
 #include <net/netfilter/nf_tables.h>
@@ -16,6 +17,10 @@ struct flow_offload_entry {
 	struct flow_offload	flow;
 	struct nf_conn		*ct;
 	struct rcu_head		rcu_head;
+	/* hardware offload state, see nf_flow_offload_hw_work() */
+	struct list_head	hw_node;	/* on hw_pending */
+	struct list_head	hw_list;	/* on hw_flows once installed */
+	enum nf_flow_offload_hw_command hw_cmd;
 };
 
 static DEFINE_MUTEX(flowtable_lock);
@@ -70,6 +75,8 @@ flow_offload_alloc(struct nf_conn *ct, struct nf_flow_route *route)
 		goto err_ct_refcnt;
 
 	flow = &entry->flow;
+	INIT_LIST_HEAD(&entry->hw_node);
+	INIT_LIST_HEAD(&entry->hw_list);
 
 	if (!dst_hold_safe(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst))
 		goto err_dst_cache_original;
@@ -185,6 +192,23 @@ static const struct rhashtable_params nf_flow_offload_rhash_params = {
 	.automatic_shrinking	= true,
 };
 
+static void nf_flow_offload_hw_queue(struct nf_flowtable *flow_table,
+				     struct flow_offload *flow,
+				     enum nf_flow_offload_hw_command cmd)
+{
+	struct flow_offload_entry *e;
+
+	e = container_of(flow, struct flow_offload_entry, flow);
+
+	spin_lock_bh(&flow_table->hw_lock);
+	e->hw_cmd = cmd;
+	if (list_empty(&e->hw_node))
+		list_add_tail(&e->hw_node, &flow_table->hw_pending);
+	spin_unlock_bh(&flow_table->hw_lock);
+
+	schedule_work(&flow_table->hw_work);
+}
+
 int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 {
 	flow->timeout = (u32)jiffies;
@@ -195,6 +219,10 @@ int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 	rhashtable_insert_fast(&flow_table->rhashtable,
 			       &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
 			       nf_flow_offload_rhash_params);
+
+	if (flow_table->flags & NF_FLOWTABLE_F_HW)
+		nf_flow_offload_hw_queue(flow_table, flow, FLOW_OFFLOAD_HW_ADD);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(flow_offload_add);
@@ -214,7 +242,11 @@ static void flow_offload_del(struct nf_flowtable *flow_table,
 	e = container_of(flow, struct flow_offload_entry, flow);
 	clear_bit(IPS_OFFLOAD_BIT, &e->ct->status);
 
-	flow_offload_free(flow);
+	/* The hardware entry, if any, goes away before the flow is freed */
+	if (flow_table->flags & NF_FLOWTABLE_F_HW)
+		nf_flow_offload_hw_queue(flow_table, flow, FLOW_OFFLOAD_HW_DEL);
+	else
+		flow_offload_free(flow);
 }
 
 void flow_offload_teardown(struct flow_offload *flow)
@@ -337,9 +369,140 @@ static void nf_flow_offload_work_gc(struct work_struct *work)
 
 	flow_table = container_of(work, struct nf_flowtable, gc_work.work);
 	nf_flow_offload_gc_step(flow_table);
+	if (flow_table->flags & NF_FLOWTABLE_F_HW) {
+		WRITE_ONCE(flow_table->hw_stats, true);
+		schedule_work(&flow_table->hw_work);
+	}
 	queue_delayed_work(system_power_efficient_wq, &flow_table->gc_work, HZ);
 }
 
+static int nf_flow_offload_hw_cmd(struct flow_offload_entry *e,
+				  enum nf_flow_offload_hw_command cmd,
+				  enum flow_offload_tuple_dir dir,
+				  unsigned long *lastused)
+{
+	struct nf_flow_offload_hw hw = {
+		.command	= cmd,
+		.flow		= &e->flow,
+		.dir		= dir,
+	};
+	struct net_device *dev;
+	int err;
+
+	dev = __dev_get_by_index(nf_ct_net(e->ct),
+				 e->flow.tuplehash[dir].tuple.iifidx);
+	if (!dev || !(dev->features & NETIF_F_HW_TC) ||
+	    !dev->netdev_ops->ndo_setup_tc)
+		return -EOPNOTSUPP;
+
+	err = dev->netdev_ops->ndo_setup_tc(dev, TC_SETUP_FT, &hw);
+	if (!err && lastused)
+		*lastused = hw.lastused;
+
+	return err;
+}
+
+static void nf_flow_offload_hw_add(struct nf_flowtable *flow_table,
+				   struct flow_offload_entry *e)
+{
+	if (e->flow.flags & (FLOW_OFFLOAD_DYING | FLOW_OFFLOAD_TEARDOWN))
+		return;
+
+	/* Both directions or none, the flow stays in software otherwise */
+	if (nf_flow_offload_hw_cmd(e, FLOW_OFFLOAD_HW_ADD,
+				   FLOW_OFFLOAD_DIR_ORIGINAL, NULL))
+		return;
+	if (nf_flow_offload_hw_cmd(e, FLOW_OFFLOAD_HW_ADD,
+				   FLOW_OFFLOAD_DIR_REPLY, NULL)) {
+		nf_flow_offload_hw_cmd(e, FLOW_OFFLOAD_HW_DEL,
+				       FLOW_OFFLOAD_DIR_ORIGINAL, NULL);
+		return;
+	}
+
+	list_add_tail(&e->hw_list, &flow_table->hw_flows);
+}
+
+static void nf_flow_offload_hw_del(struct flow_offload_entry *e)
+{
+	if (list_empty(&e->hw_list))
+		return;
+
+	nf_flow_offload_hw_cmd(e, FLOW_OFFLOAD_HW_DEL,
+			       FLOW_OFFLOAD_DIR_ORIGINAL, NULL);
+	nf_flow_offload_hw_cmd(e, FLOW_OFFLOAD_HW_DEL,
+			       FLOW_OFFLOAD_DIR_REPLY, NULL);
+	list_del_init(&e->hw_list);
+}
+
+/* Packets of offloaded flows no longer refresh the timeout from the
+ * software path, pull it from the hardware instead.
+ */
+static void nf_flow_offload_hw_stats(struct flow_offload_entry *e)
+{
+	struct flow_offload *flow = &e->flow;
+	unsigned long lastused;
+	u32 timeout;
+	int dir;
+
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++) {
+		if (nf_flow_offload_hw_cmd(e, FLOW_OFFLOAD_HW_STATS, dir,
+					   &lastused))
+			continue;
+
+		timeout = (u32)lastused + NF_FLOW_TIMEOUT;
+		if ((__s32)(timeout - flow->timeout) > 0)
+			flow->timeout = timeout;
+	}
+}
+
+/* ndo_setup_tc() may sleep and wants RTNL, while flows are added from
+ * the packet path and removed from the garbage collector under RCU.
+ * Both queue their request here; flows owned by a hardware capable
+ * flowtable are only freed once their hardware entries are gone.
+ */
+static void nf_flow_offload_hw_work(struct work_struct *work)
+{
+	struct nf_flowtable *flow_table;
+	struct flow_offload_entry *e;
+	enum nf_flow_offload_hw_command cmd;
+
+	flow_table = container_of(work, struct nf_flowtable, hw_work);
+
+	rtnl_lock();
+	for (;;) {
+		spin_lock_bh(&flow_table->hw_lock);
+		e = list_first_entry_or_null(&flow_table->hw_pending,
+					     struct flow_offload_entry,
+					     hw_node);
+		if (e) {
+			list_del_init(&e->hw_node);
+			cmd = e->hw_cmd;
+		}
+		spin_unlock_bh(&flow_table->hw_lock);
+		if (!e)
+			break;
+
+		switch (cmd) {
+		case FLOW_OFFLOAD_HW_ADD:
+			nf_flow_offload_hw_add(flow_table, e);
+			break;
+		case FLOW_OFFLOAD_HW_DEL:
+			nf_flow_offload_hw_del(e);
+			flow_offload_free(&e->flow);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (READ_ONCE(flow_table->hw_stats)) {
+		WRITE_ONCE(flow_table->hw_stats, false);
+		list_for_each_entry(e, &flow_table->hw_flows, hw_list)
+			nf_flow_offload_hw_stats(e);
+	}
+	rtnl_unlock();
+}
+
 static int nf_flow_nat_port_tcp(struct sk_buff *skb, unsigned int thoff,
 				__be16 port, __be16 new_port)
 {
@@ -461,6 +624,10 @@ int nf_flow_table_init(struct nf_flowtable *flowtable)
 	int err;
 
 	INIT_DEFERRABLE_WORK(&flowtable->gc_work, nf_flow_offload_work_gc);
+	INIT_WORK(&flowtable->hw_work, nf_flow_offload_hw_work);
+	spin_lock_init(&flowtable->hw_lock);
+	INIT_LIST_HEAD(&flowtable->hw_pending);
+	INIT_LIST_HEAD(&flowtable->hw_flows);
 
 	err = rhashtable_init(&flowtable->rhashtable,
 			      &nf_flow_offload_rhash_params);
@@ -518,6 +685,7 @@ void nf_flow_table_free(struct nf_flowtable *flow_table)
 	cancel_delayed_work_sync(&flow_table->gc_work);
 	nf_flow_table_iterate(flow_table, nf_flow_table_do_cleanup, NULL);
 	WARN_ON(!nf_flow_offload_gc_step(flow_table));
+	flush_work(&flow_table->hw_work);
 	rhashtable_destroy(&flow_table->rhashtable);
 }
 EXPORT_SYMBOL_GPL(nf_flow_table_free);
@@ -4962,6 +4962,7 @@ static const struct nla_policy nft_flowtable_policy[NFTA_FLOWTABLE_MAX + 1] = {
 					    .len = NFT_NAME_MAXLEN - 1 },
 	[NFTA_FLOWTABLE_HOOK]		= { .type = NLA_NESTED },
 	[NFTA_FLOWTABLE_HANDLE]		= { .type = NLA_U64 },
+	[NFTA_FLOWTABLE_FLAGS]		= { .type = NLA_U32 },
 };
 
 struct nft_flowtable *nft_flowtable_lookup(const struct nft_table *table,
@@ -5186,6 +5187,17 @@ static int nf_tables_newflowtable(struct net *net, struct sock *nlsk,
 	flowtable->table = table;
 	flowtable->handle = nf_tables_alloc_handle(table);
 
+	if (nla[NFTA_FLOWTABLE_FLAGS]) {
+		u32 flags = ntohl(nla_get_be32(nla[NFTA_FLOWTABLE_FLAGS]));
+
+		if (flags & ~NFT_FLOWTABLE_MASK) {
+			err = -EOPNOTSUPP;
+			goto err1;
+		}
+		if (flags & NFT_FLOWTABLE_HW_OFFLOAD)
+			flowtable->data.flags |= NF_FLOWTABLE_F_HW;
+	}
+
 	flowtable->name = nla_strdup(nla[NFTA_FLOWTABLE_NAME], GFP_KERNEL);
 	if (!flowtable->name) {
 		err = -ENOMEM;
@@ -5333,6 +5345,11 @@ static int nf_tables_fill_flowtable_info(struct sk_buff *skb, struct net *net,
 			 NFTA_FLOWTABLE_PAD))
 		goto nla_put_failure;
 
+	if ((flowtable->data.flags & NF_FLOWTABLE_F_HW) &&
+	    nla_put_be32(skb, NFTA_FLOWTABLE_FLAGS,
+			 htonl(NFT_FLOWTABLE_HW_OFFLOAD)))
+		goto nla_put_failure;
+
 	nest = nla_nest_start(skb, NFTA_FLOWTABLE_HOOK);
 	if (nla_put_be32(skb, NFTA_FLOWTABLE_HOOK_NUM, htonl(flowtable->hooknum)) ||
 	    nla_put_be32(skb, NFTA_FLOWTABLE_HOOK_PRIORITY, htonl(flowtable->priority)))
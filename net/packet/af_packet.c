@@ -1952,6 +1952,7 @@ static int packet_sendmsg_spkt(struct socket *sock, struct msghdr *msg,
 	}
 
 	sockc.tsflags = sk->sk_tsflags;
+	sockc.transmit_time = 0;
 	if (msg->msg_controllen) {
 		err = sock_cmsg_send(sk, msg, &sockc);
 		if (unlikely(err))
@@ -1962,6 +1963,7 @@ static int packet_sendmsg_spkt(struct socket *sock, struct msghdr *msg,
 	skb->dev = dev;
 	skb->priority = sk->sk_priority;
 	skb->mark = sk->sk_mark;
+	skb->tstamp = sockc.transmit_time;
 
 	sock_tx_timestamp(sk, sockc.tsflags, &skb_shinfo(skb)->tx_flags);
 
@@ -2459,6 +2461,7 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	skb->dev = dev;
 	skb->priority = po->sk.sk_priority;
 	skb->mark = po->sk.sk_mark;
+	skb->tstamp = sockc->transmit_time;
 	sock_tx_timestamp(&po->sk, sockc->tsflags, &skb_shinfo(skb)->tx_flags);
 	skb_shinfo(skb)->destructor_arg = ph.raw;
 
@@ -2591,15 +2594,39 @@ static int tpacket_parse_header(struct packet_sock *po, void *frame,
 	return tp_len;
 }
 
+/*
+ * On the qdisc bypass path tpacket_snd() holds each frame back until it
+ * knows whether another one follows, so the driver can be told to defer
+ * its doorbell with xmit_more.  @ph is the ring frame of the held skb.
+ */
+static int tpacket_xmit_held(struct packet_sock *po, struct sk_buff **held,
+			     void *ph, bool more)
+{
+	struct sk_buff *skb = *held;
+	int err;
+
+	*held = NULL;
+	err = __dev_direct_xmit(skb, packet_pick_tx_queue(skb), more);
+	if (unlikely(err > 0)) {
+		err = net_xmit_errno(err);
+		if (err && __packet_get_status(po, ph) == TP_STATUS_AVAILABLE)
+			return err;
+		/* dropped but not destructed yet, like congestion */
+		err = 0;
+	}
+	return err;
+}
+
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 {
-	struct sk_buff *skb;
+	struct sk_buff *skb, *held = NULL;
+	bool batch = po->xmit == packet_direct_xmit;
 	struct net_device *dev;
 	struct virtio_net_hdr *vnet_hdr = NULL;
 	struct sockcm_cookie sockc;
 	__be16 proto;
 	int err, reserve = 0;
-	void *ph;
+	void *ph, *held_ph = NULL;
 	DECLARE_SOCKADDR(struct sockaddr_ll *, saddr, msg->msg_name);
 	bool need_wait = !(msg->msg_flags & MSG_DONTWAIT);
 	int tp_len, size_max;
@@ -2636,6 +2663,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		goto out_put;
 
 	sockc.tsflags = po->sk.sk_tsflags;
+	sockc.transmit_time = 0;
 	if (msg->msg_controllen) {
 		err = sock_cmsg_send(&po->sk, msg, &sockc);
 		if (unlikely(err))
@@ -2654,6 +2682,11 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			/* End of the batch, a failed send is reported in
+			 * the frame status.
+			 */
+			if (held)
+				tpacket_xmit_held(po, &held, held_ph, false);
 			if (need_wait && need_resched())
 				schedule();
 			continue;
@@ -2720,12 +2753,25 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 			goto tpacket_error;
 		}
 
+		/* Another frame follows the held one */
+		if (held) {
+			err = tpacket_xmit_held(po, &held, held_ph, true);
+			if (unlikely(err))
+				goto out_status;
+		}
+
 		skb->destructor = tpacket_destruct_skb;
 		__packet_set_status(po, ph, TP_STATUS_SENDING);
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
-		err = po->xmit(skb);
+		if (batch) {
+			held = skb;
+			held_ph = ph;
+			err = 0;
+		} else {
+			err = po->xmit(skb);
+		}
 		if (unlikely(err > 0)) {
 			err = net_xmit_errno(err);
 			if (err && __packet_get_status(po, ph) ==
@@ -2751,10 +2797,14 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		 */
 		 (need_wait && packet_read_pending(&po->tx_ring))));
 
+	if (held)
+		tpacket_xmit_held(po, &held, held_ph, false);
 	err = len_sum;
 	goto out_put;
 
 out_status:
+	if (held)
+		tpacket_xmit_held(po, &held, held_ph, false);
 	__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
@@ -2833,6 +2883,7 @@ static int packet_snd(struct socket *sock, struct msghdr *msg, size_t len)
 
 	sockc.tsflags = sk->sk_tsflags;
 	sockc.mark = sk->sk_mark;
+	sockc.transmit_time = 0;
 	if (msg->msg_controllen) {
 		err = sock_cmsg_send(sk, msg, &sockc);
 		if (unlikely(err))
@@ -2905,6 +2956,7 @@ static int packet_snd(struct socket *sock, struct msghdr *msg, size_t len)
 	skb->dev = dev;
 	skb->priority = sk->sk_priority;
 	skb->mark = sockc.mark;
+	skb->tstamp = sockc.transmit_time;
 
 	if (has_vnet_hdr) {
 		err = virtio_net_hdr_to_skb(skb, &vnet_hdr, vio_le());
@@ -14,6 +14,8 @@
 #include <linux/module.h>
 #include <linux/rhashtable.h>
 #include <linux/workqueue.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
 
 #include <linux/if_ether.h>
 #include <linux/in6.h>
@@ -70,9 +72,38 @@ struct fl_flow_mask {
 	struct list_head list;
 };
 
+/* Flow cache used when a classifier has several masks. Established
+ * flows are dissected once with the union of all the masks and looked
+ * up in a small per-CPU direct mapped table, instead of dissecting and
+ * probing every mask in turn. The cached result, including a miss, is
+ * only valid for the generation it was computed in; any filter or mask
+ * change publishes a new generation.
+ */
+#define FL_CACHE_MIN_MASKS	2
+#define FL_CACHE_SIZE		64
+
+struct fl_flow_cache {
+	struct fl_flow_key mask;	/* union of all masks */
+	struct fl_flow_mask_range range;
+	struct flow_dissector dissector;
+	u32 gen;
+	struct rcu_head rcu;
+};
+
+struct fl_flow_cache_entry {
+	u32 gen;
+	u32 hash;
+	struct cls_fl_filter *f;
+	struct fl_flow_key mkey;
+};
+
 struct cls_fl_head {
 	struct rhashtable ht;
 	struct list_head masks;
+	struct fl_flow_cache __rcu *cache;
+	struct fl_flow_cache_entry __percpu *cache_entries;
+	u32 cache_gen;
+	bool cache_off;
 	union {
 		struct work_struct work;
 		struct rcu_head	rcu;
@@ -109,10 +140,11 @@ static unsigned short int fl_mask_range(const struct fl_flow_mask *mask)
 	return mask->range.end - mask->range.start;
 }
 
-static void fl_mask_update_range(struct fl_flow_mask *mask)
+static void fl_key_update_range(const struct fl_flow_key *key,
+				struct fl_flow_mask_range *range)
 {
-	const u8 *bytes = (const u8 *) &mask->key;
-	size_t size = sizeof(mask->key);
+	const u8 *bytes = (const u8 *) key;
+	size_t size = sizeof(*key);
 	size_t i, first = 0, last;
 
 	for (i = 0; i < size; i++) {
@@ -128,8 +160,13 @@ static void fl_mask_update_range(struct fl_flow_mask *mask)
 			break;
 		}
 	}
-	mask->range.start = rounddown(first, sizeof(long));
-	mask->range.end = roundup(last + 1, sizeof(long));
+	range->start = rounddown(first, sizeof(long));
+	range->end = roundup(last + 1, sizeof(long));
+}
+
+static void fl_mask_update_range(struct fl_flow_mask *mask)
+{
+	fl_key_update_range(&mask->key, &mask->range);
 }
 
 static void *fl_key_get_start(struct fl_flow_key *key,
@@ -163,35 +200,108 @@ static struct cls_fl_filter *fl_lookup(struct fl_flow_mask *mask,
 				      mask->filter_ht_params);
 }
 
+static void fl_dissect(struct sk_buff *skb, struct flow_dissector *dissector,
+		       struct fl_flow_key *skb_key)
+{
+	skb_key->indev_ifindex = skb->skb_iif;
+	/* skb_flow_dissect() does not set n_proto in case an unknown
+	 * protocol, so do it rather here.
+	 */
+	skb_key->basic.n_proto = skb->protocol;
+	skb_flow_dissect_tunnel_info(skb, dissector, skb_key);
+	skb_flow_dissect(skb, dissector, skb_key, 0);
+}
+
+/* Returns the cache slot for this packet, loaded with its key masked
+ * by the union of all masks, and whether it already holds its result.
+ */
+static struct fl_flow_cache_entry *
+fl_cache_lookup(struct cls_fl_head *head, struct fl_flow_cache *cache,
+		struct sk_buff *skb, struct fl_flow_key *skb_key, bool *hit)
+{
+	unsigned int len = cache->range.end - cache->range.start;
+	struct fl_flow_cache_entry *e;
+	const long *lmask;
+	long *lkey, *lmkey;
+	long diff = 0;
+	u32 hash;
+	int i;
+
+	memset((u8 *)skb_key + cache->range.start, 0, len);
+	fl_dissect(skb, &cache->dissector, skb_key);
+
+	lkey = (long *)((u8 *)skb_key + cache->range.start);
+	lmask = (const long *)((u8 *)&cache->mask + cache->range.start);
+	for (i = 0; i < len / sizeof(long); i++)
+		lkey[i] &= lmask[i];
+	hash = jhash2((u32 *)lkey, len / sizeof(u32), cache->gen);
+
+	e = this_cpu_ptr(head->cache_entries) + (hash & (FL_CACHE_SIZE - 1));
+	lmkey = (long *)((u8 *)&e->mkey + cache->range.start);
+	for (i = 0; i < len / sizeof(long); i++) {
+		diff |= lmkey[i] ^ lkey[i];
+		lmkey[i] = lkey[i];
+	}
+
+	*hit = !diff && e->gen == cache->gen && e->hash == hash;
+	if (!*hit) {
+		e->gen = ~cache->gen;
+		e->hash = hash;
+		e->f = NULL;
+	}
+	return e;
+}
+
 static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 		       struct tcf_result *res)
 {
 	struct cls_fl_head *head = rcu_dereference_bh(tp->root);
+	struct fl_flow_cache_entry *e = NULL;
+	struct fl_flow_cache *cache;
 	struct cls_fl_filter *f;
 	struct fl_flow_mask *mask;
 	struct fl_flow_key skb_key;
 	struct fl_flow_key skb_mkey;
+	bool hit;
+
+	cache = rcu_dereference_bh(head->cache);
+	if (cache) {
+		e = fl_cache_lookup(head, cache, skb, &skb_key, &hit);
+		if (hit) {
+			f = e->f;
+			goto out;
+		}
+		/* Pairs with rcu_assign_pointer() in fl_cache_update(): the
+		 * masks and filters walked below are at least as recent as
+		 * the generation we are about to record.
+		 */
+		smp_rmb();
+	}
 
+	f = NULL;
 	list_for_each_entry_rcu(mask, &head->masks, list) {
 		fl_clear_masked_range(&skb_key, mask);
-
-		skb_key.indev_ifindex = skb->skb_iif;
-		/* skb_flow_dissect() does not set n_proto in case an unknown
-		 * protocol, so do it rather here.
-		 */
-		skb_key.basic.n_proto = skb->protocol;
-		skb_flow_dissect_tunnel_info(skb, &mask->dissector, &skb_key);
-		skb_flow_dissect(skb, &mask->dissector, &skb_key, 0);
-
+		fl_dissect(skb, &mask->dissector, &skb_key);
 		fl_set_masked_key(&skb_mkey, &skb_key, mask);
 
 		f = fl_lookup(mask, &skb_mkey);
-		if (f && !tc_skip_sw(f->flags)) {
-			*res = f->res;
-			return tcf_exts_exec(skb, &f->exts, res);
-		}
+		if (f && !tc_skip_sw(f->flags))
+			break;
+		f = NULL;
 	}
-	return -1;
+
+	/* Record the result before running the actions, which may
+	 * classify again on this CPU.
+	 */
+	if (e) {
+		e->f = f;
+		e->gen = cache->gen;
+	}
+out:
+	if (!f)
+		return -1;
+	*res = f->res;
+	return tcf_exts_exec(skb, &f->exts, res);
 }
 
 static int fl_init(struct tcf_proto *tp)
@@ -313,6 +423,8 @@ static void fl_hw_update_stats(struct tcf_proto *tp, struct cls_fl_filter *f)
 			 &cls_flower, false);
 }
 
+static void fl_cache_update(struct cls_fl_head *head);
+
 static bool __fl_delete(struct tcf_proto *tp, struct cls_fl_filter *f,
 			struct netlink_ext_ack *extack)
 {
@@ -323,6 +435,7 @@ static bool __fl_delete(struct tcf_proto *tp, struct cls_fl_filter *f,
 	idr_remove(&head->handle_idr, f->handle);
 	list_del_rcu(&f->list);
 	last = fl_mask_put(head, f->mask, async);
+	fl_cache_update(head);
 	if (!tc_skip_hw(f->flags))
 		fl_hw_destroy_filter(tp, f, extack);
 	tcf_unbind_filter(tp, &f->res);
@@ -338,6 +451,7 @@ static void fl_destroy_sleepable(struct work_struct *work)
 {
 	struct cls_fl_head *head = container_of(work, struct cls_fl_head,
 						work);
+	free_percpu(head->cache_entries);
 	kfree(head);
 	module_put(THIS_MODULE);
 }
@@ -356,6 +470,9 @@ static void fl_destroy(struct tcf_proto *tp, struct netlink_ext_ack *extack)
 	struct fl_flow_mask *mask, *next_mask;
 	struct cls_fl_filter *f, *next;
 
+	head->cache_off = true;
+	fl_cache_update(head);
+
 	list_for_each_entry_safe(mask, next_mask, &head->masks, list) {
 		list_for_each_entry_safe(f, next, &mask->filters, list) {
 			if (__fl_delete(tp, f, extack))
@@ -798,47 +915,111 @@ static int fl_init_mask_hashtable(struct fl_flow_mask *mask)
 			FL_KEY_SET(keys, cnt, id, member);			\
 	} while(0);
 
-static void fl_init_dissector(struct fl_flow_mask *mask)
+static void fl_init_dissector(struct flow_dissector *dissector,
+			      struct fl_flow_key *mask)
 {
 	struct flow_dissector_key keys[FLOW_DISSECTOR_KEY_MAX];
 	size_t cnt = 0;
 
 	FL_KEY_SET(keys, cnt, FLOW_DISSECTOR_KEY_CONTROL, control);
 	FL_KEY_SET(keys, cnt, FLOW_DISSECTOR_KEY_BASIC, basic);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ETH_ADDRS, eth);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_IPV4_ADDRS, ipv4);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_IPV6_ADDRS, ipv6);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_PORTS, tp);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_IP, ip);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_TCP, tcp);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ICMP, icmp);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ARP, arp);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_MPLS, mpls);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_VLAN, vlan);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ENC_KEYID, enc_key_id);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ENC_IPV4_ADDRS, enc_ipv4);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ENC_IPV6_ADDRS, enc_ipv6);
-	if (FL_KEY_IS_MASKED(&mask->key, enc_ipv4) ||
-	    FL_KEY_IS_MASKED(&mask->key, enc_ipv6))
+	if (FL_KEY_IS_MASKED(mask, enc_ipv4) ||
+	    FL_KEY_IS_MASKED(mask, enc_ipv6))
 		FL_KEY_SET(keys, cnt, FLOW_DISSECTOR_KEY_ENC_CONTROL,
 			   enc_control);
-	FL_KEY_SET_IF_MASKED(&mask->key, keys, cnt,
+	FL_KEY_SET_IF_MASKED(mask, keys, cnt,
 			     FLOW_DISSECTOR_KEY_ENC_PORTS, enc_tp);
 
-	skb_flow_dissector_init(&mask->dissector, keys, cnt);
+	skb_flow_dissector_init(dissector, keys, cnt);
+}
+
+/* Publish a new cache generation, or disable the cache. Must run after
+ * the masks and filters have been updated and before any removed filter
+ * is handed to call_rcu(), so that no reader can keep using a result
+ * that refers to it.
+ */
+static void fl_cache_update(struct cls_fl_head *head)
+{
+	struct fl_flow_cache *old = rtnl_dereference(head->cache);
+	struct fl_flow_cache_entry *cache_entries;
+	struct fl_flow_cache *cache = NULL;
+	struct fl_flow_mask *mask;
+	unsigned int nr_masks = 0;
+	long *lmask;
+	int i, cpu;
+
+	if (head->cache_off)
+		goto publish;
+	list_for_each_entry(mask, &head->masks, list)
+		nr_masks++;
+	if (nr_masks < FL_CACHE_MIN_MASKS)
+		goto publish;
+
+	if (!head->cache_entries) {
+		head->cache_entries =
+			__alloc_percpu(sizeof(*cache_entries) * FL_CACHE_SIZE,
+				       __alignof__(*cache_entries));
+		if (!head->cache_entries)
+			goto publish;
+	}
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		goto publish;
+
+	list_for_each_entry(mask, &head->masks, list) {
+		const long *lkey = fl_key_get_start(&mask->key, mask);
+
+		lmask = fl_key_get_start(&cache->mask, mask);
+		for (i = 0; i < fl_mask_range(mask); i += sizeof(long))
+			*lmask++ |= *lkey++;
+	}
+	fl_key_update_range(&cache->mask, &cache->range);
+	fl_init_dissector(&cache->dissector, &cache->mask);
+
+	/* Entries are tagged with the generation only; start from a clean
+	 * table when the counter wraps.
+	 */
+	cache->gen = ++head->cache_gen;
+	if (!cache->gen) {
+		for_each_possible_cpu(cpu) {
+			cache_entries = per_cpu_ptr(head->cache_entries, cpu);
+			memset(cache_entries, 0,
+			       sizeof(*cache_entries) * FL_CACHE_SIZE);
+		}
+		cache->gen = ++head->cache_gen;
+	}
+
+publish:
+	rcu_assign_pointer(head->cache, cache);
+	if (old)
+		kfree_rcu(old, rcu);
 }
 
 static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
@@ -857,7 +1038,7 @@ static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
 	if (err)
 		goto errout_free;
 
-	fl_init_dissector(newmask);
+	fl_init_dissector(&newmask->dissector, &newmask->key);
 
 	INIT_LIST_HEAD_RCU(&newmask->filters);
 
@@ -1034,11 +1215,13 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 	if (fold) {
 		idr_replace(&head->handle_idr, fnew, fnew->handle);
 		list_replace_rcu(&fold->list, &fnew->list);
+		fl_cache_update(head);
 		tcf_unbind_filter(tp, &fold->res);
 		tcf_exts_get_net(&fold->exts);
 		call_rcu(&fold->rcu, fl_destroy_filter);
 	} else {
 		list_add_tail_rcu(&fnew->list, &fnew->mask->filters);
+		fl_cache_update(head);
 	}
 
 	kfree(tb);
@@ -1046,6 +1229,7 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 
 errout_mask:
 	fl_mask_put(head, fnew->mask, false);
+	fl_cache_update(head);
 
 errout_idr:
 	if (fnew->handle)
@@ -21,6 +21,8 @@
 #include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/bitops.h>
+#include <linux/rtnetlink.h>
 #include <net/netlink.h>
 #include <net/pkt_sched.h>
 #include <net/pkt_cls.h>
@@ -42,8 +44,31 @@
  * head drops only.
  * ECN capability is on by default.
  * Low memory footprint (64 bytes per flow)
+ *
+ * Flows with a backlog are also indexed by fls(backlog), so that the
+ * overlimit path finds a flow at least half as fat as the fattest one
+ * in O(1) instead of scanning the whole table.
+ *
+ * fq_codel siblings under the same parent (typically the children of
+ * mq) share a memory pool: a child may exceed its own memory_limit as
+ * long as the sum of their usage stays under the sum of their limits.
  */
 
+#define FQ_CODEL_BKT_CNT	33	/* fls() of a u32 backlog: 0..32 */
+#define FQ_CODEL_POOL_BATCH	(64 << 10)
+
+struct fq_codel_mem_pool {
+	struct list_head	list;
+	struct net_device	*dev;
+	u32			parent;	/* major handle of the parent */
+	int			users;
+	atomic_long_t		usage;
+	atomic_long_t		limit;
+};
+
+/* Protected by RTNL */
+static LIST_HEAD(fq_codel_pools);
+
 struct fq_codel_flow {
 	struct sk_buff	  *head;
 	struct sk_buff	  *tail;
@@ -58,6 +83,11 @@ struct fq_codel_sched_data {
 	struct tcf_block *block;
 	struct fq_codel_flow *flows;	/* Flows table [flows_cnt] */
 	u32		*backlogs;	/* backlog table [flows_cnt] */
+	struct list_head *bkt_nodes;	/* backlog index nodes [flows_cnt] */
+	struct list_head bkt_heads[FQ_CODEL_BKT_CNT];
+	u64		bkt_mask;	/* non empty bkt_heads[] */
+	struct fq_codel_mem_pool *pool;
+	u32		pool_charged;	/* our share of pool->usage */
 	u32		flows_cnt;	/* number of flows */
 	u32		quantum;	/* psched_mtu(qdisc_dev(sch)); */
 	u32		drop_batch_size;
@@ -140,29 +170,135 @@ static inline void flow_queue_add(struct fq_codel_flow *flow,
 	skb->next = NULL;
 }
 
+/* Move flow idx to the backlog bucket matching its new backlog */
+static void fq_codel_backlog_update(struct fq_codel_sched_data *q,
+				    unsigned int idx, u32 old)
+{
+	unsigned int ob = fls(old), nb = fls(q->backlogs[idx]);
+	struct list_head *node = &q->bkt_nodes[idx];
+
+	if (ob == nb)
+		return;
+
+	if (ob) {
+		list_del(node);
+		if (list_empty(&q->bkt_heads[ob]))
+			q->bkt_mask &= ~(1ULL << ob);
+	}
+	if (nb) {
+		list_add(node, &q->bkt_heads[nb]);
+		q->bkt_mask |= 1ULL << nb;
+	}
+}
+
+static void fq_codel_backlog_reset(struct fq_codel_sched_data *q)
+{
+	int i;
+
+	for (i = 0; i < FQ_CODEL_BKT_CNT; i++)
+		INIT_LIST_HEAD(&q->bkt_heads[i]);
+	for (i = 0; i < q->flows_cnt; i++)
+		INIT_LIST_HEAD(&q->bkt_nodes[i]);
+	q->bkt_mask = 0;
+}
+
+/* Settle our share of the sibling pool in FQ_CODEL_POOL_BATCH units,
+ * so that the shared counter is not touched for every packet.
+ */
+static void fq_codel_pool_sync(struct fq_codel_sched_data *q)
+{
+	u32 target;
+
+	if (!q->pool)
+		return;
+
+	target = round_up(q->memory_usage, FQ_CODEL_POOL_BATCH);
+	if (target > q->pool_charged ||
+	    target + FQ_CODEL_POOL_BATCH < q->pool_charged) {
+		atomic_long_add((long)target - (long)q->pool_charged,
+				&q->pool->usage);
+		q->pool_charged = target;
+	}
+}
+
+static bool fq_codel_over_memory(const struct fq_codel_sched_data *q)
+{
+	if (q->memory_usage <= q->memory_limit)
+		return false;
+	if (!q->pool)
+		return true;
+
+	return atomic_long_read(&q->pool->usage) >
+	       atomic_long_read(&q->pool->limit);
+}
+
+static void fq_codel_pool_attach(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	u32 parent = TC_H_MAJ(sch->parent);
+	struct fq_codel_mem_pool *pool;
+
+	ASSERT_RTNL();
+
+	if (sch->parent == TC_H_ROOT || sch->parent == TC_H_UNSPEC)
+		return;
+
+	list_for_each_entry(pool, &fq_codel_pools, list) {
+		if (pool->dev == dev && pool->parent == parent)
+			goto found;
+	}
+
+	/* Not fatal, this child just keeps a private budget */
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return;
+	pool->dev = dev;
+	pool->parent = parent;
+	list_add(&pool->list, &fq_codel_pools);
+found:
+	pool->users++;
+	atomic_long_add(q->memory_limit, &pool->limit);
+	q->pool = pool;
+}
+
+static void fq_codel_pool_detach(struct fq_codel_sched_data *q)
+{
+	struct fq_codel_mem_pool *pool = q->pool;
+
+	ASSERT_RTNL();
+
+	if (!pool)
+		return;
+
+	atomic_long_sub(q->pool_charged, &pool->usage);
+	atomic_long_sub(q->memory_limit, &pool->limit);
+	q->pool_charged = 0;
+	q->pool = NULL;
+	if (--pool->users == 0) {
+		list_del(&pool->list);
+		kfree(pool);
+	}
+}
+
 static unsigned int fq_codel_drop(struct Qdisc *sch, unsigned int max_packets,
 				  struct sk_buff **to_free)
 {
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
 	struct sk_buff *skb;
-	unsigned int maxbacklog = 0, idx = 0, i, len;
+	unsigned int maxbacklog, idx, i, len;
 	struct fq_codel_flow *flow;
 	unsigned int threshold;
 	unsigned int mem = 0;
 
-	/* Queue is full! Find the fat flow and drop packet(s) from it.
-	 * This might sound expensive, but with 1024 flows, we scan
-	 * 4KB of memory, and we dont need to handle a complex tree
-	 * in fast path (packet queue/enqueue) with many cache misses.
-	 * In stress mode, we'll try to drop 64 packets from the flow,
-	 * amortizing this linear lookup to one cache line per drop.
+	/* Queue is full! Take a fat flow from the highest non empty
+	 * backlog bucket: its backlog is at least half of the fattest
+	 * one. In stress mode, we'll try to drop 64 packets from it.
 	 */
-	for (i = 0; i < q->flows_cnt; i++) {
-		if (q->backlogs[i] > maxbacklog) {
-			maxbacklog = q->backlogs[i];
-			idx = i;
-		}
-	}
+	i = fls64(q->bkt_mask) - 1;
+	idx = list_first_entry(&q->bkt_heads[i], struct list_head, next) -
+	      q->bkt_nodes;
+	maxbacklog = q->backlogs[idx];
 
 	/* Our goal is to drop half of this fat flow backlog */
 	threshold = maxbacklog >> 1;
@@ -179,7 +315,9 @@ static unsigned int fq_codel_drop(struct Qdisc *sch, unsigned int max_packets,
 
 	flow->dropped += i;
 	q->backlogs[idx] -= len;
+	fq_codel_backlog_update(q, idx, maxbacklog);
 	q->memory_usage -= mem;
+	fq_codel_pool_sync(q);
 	sch->qstats.drops += i;
 	sch->qstats.backlog -= len;
 	sch->q.qlen -= i;
@@ -208,7 +346,9 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	codel_set_enqueue_time(skb);
 	flow = &q->flows[idx];
 	flow_queue_add(flow, skb);
+	prev_backlog = q->backlogs[idx];
 	q->backlogs[idx] += qdisc_pkt_len(skb);
+	fq_codel_backlog_update(q, idx, prev_backlog);
 	qdisc_qstats_backlog_inc(sch, skb);
 
 	if (list_empty(&flow->flowchain)) {
@@ -219,7 +359,8 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	}
 	get_codel_cb(skb)->mem_usage = skb->truesize;
 	q->memory_usage += get_codel_cb(skb)->mem_usage;
-	memory_limited = q->memory_usage > q->memory_limit;
+	fq_codel_pool_sync(q);
+	memory_limited = fq_codel_over_memory(q);
 	if (++sch->q.qlen <= sch->limit && !memory_limited)
 		return NET_XMIT_SUCCESS;
 
@@ -228,10 +369,9 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 
 	/* save this packet length as it might be dropped by fq_codel_drop() */
 	pkt_len = qdisc_pkt_len(skb);
-	/* fq_codel_drop() is quite expensive, as it performs a linear search
-	 * in q->backlogs[] to find a fat flow.
-	 * So instead of dropping a single packet, drop half of its backlog
-	 * with a 64 packets limit to not add a too big cpu spike here.
+	/* Instead of dropping a single packet, drop half of the fat flow
+	 * backlog with a 64 packets limit, so that we do not come back
+	 * here for every packet while overloaded.
 	 */
 	ret = fq_codel_drop(sch, q->drop_batch_size, to_free);
 
@@ -267,9 +407,14 @@ static struct sk_buff *dequeue_func(struct codel_vars *vars, void *ctx)
 
 	flow = container_of(vars, struct fq_codel_flow, cvars);
 	if (flow->head) {
+		unsigned int idx = flow - q->flows;
+		u32 old = q->backlogs[idx];
+
 		skb = dequeue_head(flow);
-		q->backlogs[flow - q->flows] -= qdisc_pkt_len(skb);
+		q->backlogs[idx] -= qdisc_pkt_len(skb);
+		fq_codel_backlog_update(q, idx, old);
 		q->memory_usage -= get_codel_cb(skb)->mem_usage;
+		fq_codel_pool_sync(q);
 		sch->q.qlen--;
 		sch->qstats.backlog -= qdisc_pkt_len(skb);
 	}
@@ -360,9 +505,11 @@ static void fq_codel_reset(struct Qdisc *sch)
 		codel_vars_init(&flow->cvars);
 	}
 	memset(q->backlogs, 0, q->flows_cnt * sizeof(u32));
+	fq_codel_backlog_reset(q);
 	sch->q.qlen = 0;
 	sch->qstats.backlog = 0;
 	q->memory_usage = 0;
+	fq_codel_pool_sync(q);
 }
 
 static const struct nla_policy fq_codel_policy[TCA_FQ_CODEL_MAX + 1] = {
@@ -429,13 +576,19 @@ static int fq_codel_change(struct Qdisc *sch, struct nlattr *opt,
 		q->quantum = max(256U, nla_get_u32(tb[TCA_FQ_CODEL_QUANTUM]));
 
 	if (tb[TCA_FQ_CODEL_DROP_BATCH_SIZE])
-		q->drop_batch_size = min(1U, nla_get_u32(tb[TCA_FQ_CODEL_DROP_BATCH_SIZE]));
+		q->drop_batch_size = max(1U, nla_get_u32(tb[TCA_FQ_CODEL_DROP_BATCH_SIZE]));
 
-	if (tb[TCA_FQ_CODEL_MEMORY_LIMIT])
-		q->memory_limit = min(1U << 31, nla_get_u32(tb[TCA_FQ_CODEL_MEMORY_LIMIT]));
+	if (tb[TCA_FQ_CODEL_MEMORY_LIMIT]) {
+		u32 limit = min(1U << 31, nla_get_u32(tb[TCA_FQ_CODEL_MEMORY_LIMIT]));
+
+		if (q->pool)
+			atomic_long_add((long)limit - (long)q->memory_limit,
+					&q->pool->limit);
+		q->memory_limit = limit;
+	}
 
 	while (sch->q.qlen > sch->limit ||
-	       q->memory_usage > q->memory_limit) {
+	       fq_codel_over_memory(q)) {
 		struct sk_buff *skb = fq_codel_dequeue(sch);
 
 		q->cstats.drop_len += qdisc_pkt_len(skb);
@@ -455,6 +608,8 @@ static void fq_codel_destroy(struct Qdisc *sch)
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
 
 	tcf_block_put(q->block);
+	fq_codel_pool_detach(q);
+	kvfree(q->bkt_nodes);
 	kvfree(q->backlogs);
 	kvfree(q->flows);
 }
@@ -496,12 +651,19 @@ static int fq_codel_init(struct Qdisc *sch, struct nlattr *opt,
 		q->backlogs = kvzalloc(q->flows_cnt * sizeof(u32), GFP_KERNEL);
 		if (!q->backlogs)
 			return -ENOMEM;
+		q->bkt_nodes = kvmalloc_array(q->flows_cnt,
+					      sizeof(struct list_head),
+					      GFP_KERNEL);
+		if (!q->bkt_nodes)
+			return -ENOMEM;
+		fq_codel_backlog_reset(q);
 		for (i = 0; i < q->flows_cnt; i++) {
 			struct fq_codel_flow *flow = q->flows + i;
 
 			INIT_LIST_HEAD(&flow->flowchain);
 			codel_vars_init(&flow->cvars);
 		}
+		fq_codel_pool_attach(sch);
 	}
 	if (sch->limit >= 1)
 		sch->flags |= TCQ_F_CAN_BYPASS;
@@ -698,6 +860,7 @@ static struct Qdisc_ops fq_codel_qdisc_ops __read_mostly = {
 	.cl_ops		=	&fq_codel_class_ops,
 	.id		=	"fq_codel",
 	.priv_size	=	sizeof(struct fq_codel_sched_data),
+	.static_flags	=	TCQ_F_DEFER,
 	.enqueue	=	fq_codel_enqueue,
 	.dequeue	=	fq_codel_dequeue,
 	.peek		=	qdisc_peek_dequeued,
@@ -267,6 +267,12 @@ static struct sk_buff *dequeue_skb(struct Qdisc *q, bool *validate,
 validate:
 	*validate = true;
 
+	/* Pull staged skbs in even when the txq is frozen, so that
+	 * qdisc_run_end() does not keep rescheduling us for them.
+	 */
+	if (q->flags & TCQ_F_DEFER)
+		qdisc_defer_drain(q);
+
 	if ((q->flags & TCQ_F_ONETXQUEUE) &&
 	    netif_xmit_frozen_or_stopped(txq))
 		return skb;
@@ -854,6 +860,22 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 		}
 	}
 
+	if (ops->static_flags & TCQ_F_DEFER) {
+		int cpu;
+
+		sch->defer_q = alloc_percpu(struct qdisc_defer_queue);
+		if (!sch->defer_q)
+			goto errout2;
+
+		for_each_possible_cpu(cpu) {
+			struct qdisc_defer_queue *dq;
+
+			dq = per_cpu_ptr(sch->defer_q, cpu);
+			init_llist_head(&dq->head);
+			atomic_set(&dq->len, 0);
+		}
+	}
+
 	spin_lock_init(&sch->busylock);
 	lockdep_set_class(&sch->busylock,
 			  dev->qdisc_tx_busylock ?: &qdisc_tx_busylock);
@@ -876,6 +898,9 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 	refcount_set(&sch->refcnt, 1);
 
 	return sch;
+errout2:
+	free_percpu(sch->cpu_bstats);
+	free_percpu(sch->cpu_qstats);
 errout1:
 	kfree(p);
 errout:
@@ -911,6 +936,87 @@ EXPORT_SYMBOL(qdisc_create_dflt);
 
 /* Under qdisc_lock(qdisc) and BH! */
 
+/* Stage an skb for a TCQ_F_DEFER qdisc instead of waiting on its root
+ * lock.  Called by __dev_xmit_skb() when the qdisc is already running,
+ * returns false if this cpu's staging queue is full.
+ */
+bool qdisc_defer_enqueue(struct sk_buff *skb, struct Qdisc *q)
+{
+	struct qdisc_defer_queue *dq = this_cpu_ptr(q->defer_q);
+
+	if (atomic_read(&dq->len) >= QDISC_DEFER_LIMIT)
+		return false;
+
+	atomic_inc(&dq->len);
+	llist_add(&skb->ll_node, &dq->head);
+
+	/* Pairs with the barrier in qdisc_run_end() */
+	set_bit(__QDISC_STATE_DEFERRED, &q->state);
+	smp_mb__after_atomic();
+	if (!qdisc_is_running(q))
+		__netif_schedule(q);
+
+	return true;
+}
+EXPORT_SYMBOL(qdisc_defer_enqueue);
+
+/* Move staged skbs into the qdisc proper, oldest first per cpu.
+ * Called with the root lock held.
+ */
+void qdisc_defer_drain(struct Qdisc *q)
+{
+	struct sk_buff *to_free = NULL;
+	int cpu;
+
+	/* test_and_clear_bit() orders the flag against the lists below */
+	if (!test_and_clear_bit(__QDISC_STATE_DEFERRED, &q->state))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct qdisc_defer_queue *dq = per_cpu_ptr(q->defer_q, cpu);
+		struct sk_buff *skb, *next;
+		struct llist_node *head;
+		int n = 0;
+
+		if (llist_empty(&dq->head))
+			continue;
+
+		head = llist_reverse_order(llist_del_all(&dq->head));
+		llist_for_each_entry_safe(skb, next, head, ll_node) {
+			skb->next = NULL;
+			q->enqueue(skb, q, &to_free);
+			n++;
+		}
+		atomic_sub(n, &dq->len);
+	}
+
+	if (unlikely(to_free))
+		kfree_skb_list(to_free);
+}
+EXPORT_SYMBOL(qdisc_defer_drain);
+
+static void qdisc_defer_purge(struct Qdisc *q)
+{
+	int cpu;
+
+	if (!q->defer_q)
+		return;
+
+	clear_bit(__QDISC_STATE_DEFERRED, &q->state);
+	for_each_possible_cpu(cpu) {
+		struct qdisc_defer_queue *dq = per_cpu_ptr(q->defer_q, cpu);
+		struct sk_buff *skb, *next;
+		struct llist_node *head;
+
+		head = llist_del_all(&dq->head);
+		llist_for_each_entry_safe(skb, next, head, ll_node) {
+			skb->next = NULL;
+			kfree_skb(skb);
+		}
+		atomic_set(&dq->len, 0);
+	}
+}
+
 void qdisc_reset(struct Qdisc *qdisc)
 {
 	const struct Qdisc_ops *ops = qdisc->ops;
@@ -929,6 +1035,8 @@ void qdisc_reset(struct Qdisc *qdisc)
 		kfree_skb_list(skb);
 	}
 
+	qdisc_defer_purge(qdisc);
+
 	qdisc->q.qlen = 0;
 	qdisc->qstats.backlog = 0;
 }
@@ -940,6 +1048,7 @@ void qdisc_free(struct Qdisc *qdisc)
 		free_percpu(qdisc->cpu_bstats);
 		free_percpu(qdisc->cpu_qstats);
 	}
+	free_percpu(qdisc->defer_q);
 
 	kfree((char *) qdisc - qdisc->padded);
 }
@@ -977,6 +1086,7 @@ void qdisc_destroy(struct Qdisc *qdisc)
 		kfree_skb_list(skb);
 	}
 
+	qdisc_defer_purge(qdisc);
 	qdisc_free(qdisc);
 }
 EXPORT_SYMBOL(qdisc_destroy);
@@ -406,7 +406,13 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 	/* find a thread for this xprt */
 	rcu_read_lock();
 	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
+		/*
+		 * Most threads are busy under load: look before trying to
+		 * grab one, so that the walk only reads their flags rather
+		 * than dirtying a cacheline per thread.
+		 */
+		if (test_bit(RQ_BUSY, &rqstp->rq_flags) ||
+		    test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
 			continue;
 		atomic_long_inc(&pool->sp_stats.threads_woken);
 		rqstp->rq_qtime = ktime_get();
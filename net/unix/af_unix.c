@@ -1819,6 +1819,68 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/* Small sends get a head this big so later ones can be appended to it */
+#define UNIX_SKB_COALESCE_SZ SKB_WITH_OVERHEAD(1024)
+
+/*
+ * Append a small send to the tailroom of the last skb in the peer's
+ * receive queue instead of queueing an skb of its own.  Like
+ * unix_stream_sendpage(), this relies on the peer's iolock to keep
+ * readers away from skb->len, but it only trylocks it so a busy reader
+ * never delays the sender.
+ *
+ * Returns the number of bytes appended, which is either 0 or @size.
+ */
+static int unix_stream_coalesce(struct sock *sk, struct sock *other,
+				struct msghdr *msg, struct scm_cookie *scm,
+				int size)
+{
+	struct unix_sock *u = unix_sk(other);
+	struct sk_buff *skb;
+	int ret = 0;
+
+	if (scm->fp)
+		return 0;
+
+	if (!mutex_trylock(&u->iolock))
+		return 0;
+
+	unix_state_lock(other);
+	skb = skb_peek_tail(&other->sk_receive_queue);
+	if (sock_flag(other, SOCK_DEAD) ||
+	    (other->sk_shutdown & RCV_SHUTDOWN) ||
+	    !skb || skb->sk != sk || UNIXCB(skb).fp ||
+	    skb_is_nonlinear(skb) || skb_tailroom(skb) < size ||
+	    !unix_skb_scm_eq(skb, scm)) {
+		unix_state_unlock(other);
+		goto out;
+	}
+	/* A dying peer purges its queue without taking the iolock */
+	skb_get(skb);
+	unix_state_unlock(other);
+
+	if (!copy_from_iter_full(skb_tail_pointer(skb), size, &msg->msg_iter))
+		goto out_put;
+
+	unix_state_lock(other);
+	if (sock_flag(other, SOCK_DEAD)) {
+		unix_state_unlock(other);
+		iov_iter_revert(&msg->msg_iter, size);
+		goto out_put;
+	}
+	skb_put(skb, size);
+	unix_state_unlock(other);
+	ret = size;
+
+out_put:
+	consume_skb(skb);
+out:
+	mutex_unlock(&u->iolock);
+	if (ret)
+		other->sk_data_ready(other);
+	return ret;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
@@ -1829,7 +1891,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	int sent = 0;
 	struct scm_cookie scm;
 	bool fds_sent = false;
-	int data_len;
+	int data_len, head;
 
 	wait_for_unix_gc();
 	err = scm_send(sock, msg, &scm, false);
@@ -1853,6 +1915,12 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if (len && len < UNIX_SKB_COALESCE_SZ / 2 &&
+	    unix_stream_coalesce(sk, other, msg, &scm, len) == len) {
+		scm_destroy(&scm);
+		return len;
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
@@ -1866,7 +1934,12 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 
 		data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
 
-		skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
+		/* Leave room for small sends that follow to be appended */
+		head = size - data_len;
+		if (size < UNIX_SKB_COALESCE_SZ / 2)
+			head = UNIX_SKB_COALESCE_SZ;
+
+		skb = sock_alloc_send_pskb(sk, head, data_len,
 					   msg->msg_flags & MSG_DONTWAIT, &err,
 					   get_order(UNIX_SKB_FRAGS_SZ));
 		if (!skb)
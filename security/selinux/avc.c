@@ -37,6 +37,7 @@
 #define AVC_CACHE_SLOTS			512
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_SLOTS			64
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
@@ -73,9 +74,30 @@ struct avc_cache {
 	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
+	atomic_t		gen;		/* bumped on decision changes */
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * Small per-cpu, direct mapped front end to the AVC.  It holds copies of
+ * recent decisions rather than pointers to nodes, and an entry is only
+ * valid while its gen matches avc_cache.gen, so nodes can still be freed
+ * and replaced without visiting every cpu.
+ */
+struct avc_pcpu_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	u32			gen;
+	struct av_decision	avd;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	slots[AVC_PCPU_SLOTS];
+};
+
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+
 struct avc_callback_node {
 	int (*callback) (u32 event);
 	u32 events;
@@ -104,6 +126,8 @@ void selinux_avc_init(struct selinux_avc **avc)
 	}
 	atomic_set(&selinux_avc.avc_cache.active_nodes, 0);
 	atomic_set(&selinux_avc.avc_cache.lru_hint, 0);
+	/* Never match the zeroed per-cpu entries */
+	atomic_set(&selinux_avc.avc_cache.gen, 1);
 	*avc = &selinux_avc;
 }
 
@@ -129,6 +153,13 @@ static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
 }
 
+/* Called after a cached decision changed, makes it visible to readers */
+static inline void avc_pcpu_invalidate(struct selinux_avc *avc)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&avc->avc_cache.gen);
+}
+
 /**
  * avc_dump_av - Display an access vector in human-readable form.
  * @tclass: target security class
@@ -528,6 +559,7 @@ static void avc_node_replace(struct selinux_avc *avc,
 	hlist_replace_rcu(&old->list, &new->list);
 	call_rcu(&old->rhead, avc_node_free);
 	atomic_dec(&avc->avc_cache.active_nodes);
+	avc_pcpu_invalidate(avc);
 }
 
 static inline int avc_reclaim_node(struct selinux_avc *avc)
@@ -613,6 +645,60 @@ static inline struct avc_node *avc_search_node(struct selinux_avc *avc,
 	return ret;
 }
 
+/*
+ * The per-cpu entries are only touched from task context with preemption
+ * disabled, so softirq users of the AVC can never see a torn entry.
+ */
+static inline struct avc_pcpu_entry *avc_pcpu_slot(u32 ssid, u32 tsid,
+						   u16 tclass)
+{
+	int hvalue = avc_hash(ssid, tsid, tclass) & (AVC_PCPU_SLOTS - 1);
+
+	return &this_cpu_ptr(&avc_pcpu_cache)->slots[hvalue];
+}
+
+static bool avc_pcpu_lookup(struct selinux_avc *avc, u32 ssid, u32 tsid,
+			    u16 tclass, struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	bool hit = false;
+
+	if (!in_task())
+		return false;
+
+	preempt_disable();
+	e = avc_pcpu_slot(ssid, tsid, tclass);
+	if (e->gen == atomic_read_acquire(&avc->avc_cache.gen) &&
+	    e->ssid == ssid && e->tsid == tsid && e->tclass == tclass) {
+		memcpy(avd, &e->avd, sizeof(*avd));
+		hit = true;
+	}
+	preempt_enable();
+
+	if (hit)
+		avc_cache_stats_incr(lookups);
+	return hit;
+}
+
+/* @gen must have been sampled before the decision was looked up */
+static void avc_pcpu_fill(u32 gen, u32 ssid, u32 tsid, u16 tclass,
+			  struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+
+	if (!in_task())
+		return;
+
+	preempt_disable();
+	e = avc_pcpu_slot(ssid, tsid, tclass);
+	e->ssid = ssid;
+	e->tsid = tsid;
+	e->tclass = tclass;
+	memcpy(&e->avd, avd, sizeof(e->avd));
+	e->gen = gen;
+	preempt_enable();
+}
+
 /**
  * avc_lookup - Look up an AVC entry.
  * @ssid: source security identifier
@@ -959,6 +1045,7 @@ static void avc_flush(struct selinux_avc *avc)
 		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	avc_pcpu_invalidate(avc);
 }
 
 /**
@@ -1138,17 +1225,22 @@ inline int avc_has_perm_noaudit(struct selinux_state *state,
 	struct avc_node *node;
 	struct avc_xperms_node xp_node;
 	int rc = 0;
-	u32 denied;
+	u32 denied, gen;
 
 	BUG_ON(!requested);
 
 	rcu_read_lock();
 
-	node = avc_lookup(state->avc, ssid, tsid, tclass);
-	if (unlikely(!node))
-		node = avc_compute_av(state, ssid, tsid, tclass, avd, &xp_node);
-	else
-		memcpy(avd, &node->ae.avd, sizeof(*avd));
+	if (!avc_pcpu_lookup(state->avc, ssid, tsid, tclass, avd)) {
+		gen = atomic_read_acquire(&state->avc->avc_cache.gen);
+		node = avc_lookup(state->avc, ssid, tsid, tclass);
+		if (unlikely(!node))
+			node = avc_compute_av(state, ssid, tsid, tclass, avd,
+					      &xp_node);
+		else
+			memcpy(avd, &node->ae.avd, sizeof(*avd));
+		avc_pcpu_fill(gen, ssid, tsid, tclass, avd);
+	}
 
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
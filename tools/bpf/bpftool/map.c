@@ -67,6 +67,8 @@ static const char * const map_type_name[] = {
 	[BPF_MAP_TYPE_SOCKMAP]		= "sockmap",
 	[BPF_MAP_TYPE_CPUMAP]		= "cpumap",
 	[BPF_MAP_TYPE_SOCKHASH]		= "sockhash",
+	[BPF_MAP_TYPE_RINGBUF]		= "ringbuf",
+	[BPF_MAP_TYPE_SK_STORAGE]	= "sk_storage",
 };
 
 static bool map_is_per_cpu(__u32 type)
@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * block-aio.c
+ *
+ * aio: latency of O_DIRECT reads or writes to a block device, kept in
+ * flight with the native AIO interface.  Run against null_blk
+ * (modprobe null_blk) it measures the cost of the block layer submission
+ * and completion paths without any device in the way.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include <subcmd/parse-options.h>
+#include "../builtin.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+
+static const char	*device		= "/dev/nullb0";
+static unsigned int	bs		= 4096;
+static unsigned int	depth		= 32;
+static unsigned int	nr_ios		= 1000000;
+static bool		do_write;
+static bool		sequential;
+
+static const struct option options[] = {
+	OPT_STRING('d', "device", &device, "path",
+		   "Block device to use (default: /dev/nullb0)"),
+	OPT_UINTEGER('b', "bs", &bs, "I/O size in bytes (default: 4096)"),
+	OPT_UINTEGER('q', "depth", &depth, "I/Os kept in flight (default: 32)"),
+	OPT_UINTEGER('n', "ios", &nr_ios, "Number of I/Os (default: 1000000)"),
+	OPT_BOOLEAN('w', "write", &do_write,
+		    "Write instead of read, destroys the contents of the device"),
+	OPT_BOOLEAN('S', "sequential", &sequential,
+		    "Sequential instead of random offsets"),
+	OPT_END()
+};
+
+static const char * const bench_block_aio_usage[] = {
+	"perf bench block aio <options>",
+	NULL
+};
+
+static inline int io_setup(unsigned int nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbs)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbs);
+}
+
+static inline int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			       struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+
+struct aio_slot {
+	struct iocb	iocb;
+	u64		start;
+};
+
+static u64 next_offset(u64 nr_blocks, u64 *seq, unsigned int *seed)
+{
+	u64 block;
+
+	if (sequential)
+		block = (*seq)++ % nr_blocks;
+	else
+		block = ((u64)rand_r(seed) << 31 | rand_r(seed)) % nr_blocks;
+
+	return block * bs;
+}
+
+static int run_aio(int fd, u64 nr_blocks, struct bench_lat *lat)
+{
+	struct aio_slot *slots;
+	struct iocb **queue;
+	struct io_event *events;
+	aio_context_t ctx = 0;
+	unsigned int i, seed = getpid(), queued, submitted = 0, done = 0;
+	u64 seq = 0;
+	int ret = 0, n;
+	void *buf;
+
+	slots = calloc(depth, sizeof(*slots));
+	queue = calloc(depth, sizeof(*queue));
+	events = calloc(depth, sizeof(*events));
+	if (!slots || !queue || !events ||
+	    posix_memalign(&buf, 4096, (size_t)depth * bs)) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	memset(buf, 0x5a, (size_t)depth * bs);
+
+	if (io_setup(depth, &ctx)) {
+		ret = -errno;
+		goto out_buf;
+	}
+
+	for (i = 0; i < depth; i++) {
+		struct iocb *iocb = &slots[i].iocb;
+
+		iocb->aio_data = i;
+		iocb->aio_fildes = fd;
+		iocb->aio_lio_opcode = do_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+		iocb->aio_buf = (unsigned long)buf + (size_t)i * bs;
+		iocb->aio_nbytes = bs;
+		queue[i] = iocb;
+	}
+	queued = min(depth, nr_ios);
+
+	while (done < nr_ios) {
+		for (i = 0; i < queued; i++) {
+			struct aio_slot *slot = &slots[queue[i]->aio_data];
+
+			queue[i]->aio_offset = next_offset(nr_blocks, &seq, &seed);
+			slot->start = bench_lat__now();
+		}
+
+		if (queued) {
+			n = io_submit(ctx, queued, queue);
+			if (n != (int)queued) {
+				ret = n < 0 ? -errno : -EAGAIN;
+				break;
+			}
+			submitted += queued;
+		}
+
+		n = io_getevents(ctx, 1, depth, events);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+
+		queued = 0;
+		for (i = 0; i < (unsigned int)n; i++) {
+			struct aio_slot *slot = &slots[events[i].data];
+
+			if (events[i].res != bs) {
+				ret = (long)events[i].res < 0 ?
+				      (long)events[i].res : -EIO;
+				goto out_destroy;
+			}
+
+			bench_lat__add(lat, bench_lat__now() - slot->start);
+			done++;
+
+			if (submitted + queued < nr_ios)
+				queue[queued++] = &slot->iocb;
+		}
+	}
+
+out_destroy:
+	/* Reap what is still in flight before the buffers go away */
+	while (ret && submitted > done) {
+		n = io_getevents(ctx, 1, depth, events);
+		if (n <= 0 && errno != EINTR)
+			break;
+		if (n > 0)
+			done += n;
+	}
+	io_destroy(ctx);
+out_buf:
+	free(buf);
+out_free:
+	free(events);
+	free(queue);
+	free(slots);
+	return ret;
+}
+
+int bench_block_aio(int argc, const char **argv)
+{
+	struct rusage ru_start, ru_end;
+	struct timeval start, stop, diff;
+	struct bench_lat lat = { .count = 0, };
+	u64 dev_size;
+	int fd, err;
+
+	argc = parse_options(argc, argv, options, bench_block_aio_usage, 0);
+	if (argc)
+		usage_with_options(bench_block_aio_usage, options);
+
+	if (!bs || bs % 512 || !depth || !nr_ios) {
+		fprintf(stderr, "Invalid I/O size, depth or number of I/Os\n");
+		return 1;
+	}
+
+	fd = open(device, (do_write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s%s\n", device,
+			strerror(errno),
+			errno == ENOENT ? " (is null_blk loaded?)" : "");
+		return 1;
+	}
+
+	if (ioctl(fd, BLKGETSIZE64, &dev_size) || dev_size < bs) {
+		fprintf(stderr, "%s is not a usable block device\n", device);
+		close(fd);
+		return 1;
+	}
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	gettimeofday(&start, NULL);
+
+	err = run_aio(fd, dev_size / bs, &lat);
+
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &ru_end);
+	timersub(&stop, &start, &diff);
+	close(fd);
+
+	if (err) {
+		fprintf(stderr, "I/O failed: %s\n", strerror(-err));
+		return 1;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u %s %u byte %s on %s, queue depth %u\n\n",
+		       nr_ios, sequential ? "sequential" : "random", bs,
+		       do_write ? "writes" : "reads", device, depth);
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time", diff.tv_sec,
+		       (unsigned long)(diff.tv_usec / USEC_PER_MSEC));
+		printf(" %14s: %.0f IOPS\n\n", "Throughput",
+		       lat.count / bench_tv_usecs(&start, &stop) * USEC_PER_SEC);
+		bench_print_cpu(&ru_start, &ru_end, &diff, lat.count);
+		printf("\n");
+		bench_lat__print(&lat);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", (double)lat.total / lat.count / NSEC_PER_USEC);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+	}
+
+	return 0;
+}
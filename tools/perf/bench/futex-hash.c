@@ -6,19 +6,26 @@
  *
  * This program is particularly useful for measuring the kernel's futex hash
  * table/function implementation. In order for it to make sense, use with as
- * many threads and futexes as possible.
+ * many threads and futexes as possible.  Threads can be spread over NUMA
+ * nodes, and the whole set can be run in several processes at once to see
+ * how unrelated processes contend on the hash.
  */
 
 /* For the CLR_() macros */
 #include <string.h>
 #include <pthread.h>
 
+#include <dirent.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <linux/compiler.h>
 #include <linux/kernel.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 
 #include "../util/stat.h"
 #include <subcmd/parse-options.h>
@@ -32,8 +39,12 @@ static unsigned int nthreads = 0;
 static unsigned int nsecs    = 10;
 /* amount of futexes per thread */
 static unsigned int nfutexes = 1024;
+static unsigned int nprocs   = 1;
 static bool fshared = false, done = false, silent = false;
+static bool spread_nodes = false;
 static int futex_flag = 0;
+/* CPUs to bind threads to, in order */
+static int *cpus, nr_cpus;
 
 struct timeval start, end, runtime;
 static pthread_mutex_t thread_lock;
@@ -54,6 +65,8 @@ static const struct option options[] = {
 	OPT_UINTEGER('f', "futexes", &nfutexes, "Specify amount of futexes per threads"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
+	OPT_UINTEGER('p', "processes", &nprocs, "Run the threads in each of this many processes"),
+	OPT_BOOLEAN( 'N', "spread-nodes", &spread_nodes, "Spread threads round-robin over NUMA nodes"),
 	OPT_END()
 };
 
@@ -115,44 +128,74 @@ static void print_summary(void)
 	       (int) runtime.tv_sec);
 }
 
-int bench_futex_hash(int argc, const char **argv)
+static int cpu_node(int cpu)
 {
-	int ret = 0;
-	cpu_set_t cpuset;
-	struct sigaction act;
-	unsigned int i;
-	pthread_attr_t thread_attr;
-	struct worker *worker = NULL;
-	struct cpu_map *cpu;
+	char path[PATH_MAX];
+	struct dirent *dent;
+	int node = 0;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((dent = readdir(dir)) != NULL) {
+		if (sscanf(dent->d_name, "node%d", &node) == 1)
+			break;
+	}
+	closedir(dir);
 
-	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
-	if (argc) {
-		usage_with_options(bench_futex_hash_usage, options);
-		exit(EXIT_FAILURE);
+	return node;
+}
+
+/* Order the CPUs so that consecutive threads land on different nodes */
+static int *spread_cpus(struct cpu_map *cpu)
+{
+	int *node, *order, max_node = 0, n, i, nr = 0;
+
+	node = calloc(cpu->nr, sizeof(*node));
+	order = calloc(cpu->nr, sizeof(*order));
+	if (!node || !order)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < cpu->nr; i++) {
+		node[i] = cpu_node(cpu->map[i]);
+		max_node = max(max_node, node[i]);
 	}
 
-	cpu = cpu_map__new(NULL);
-	if (!cpu)
-		goto errmem;
+	while (nr < cpu->nr) {
+		for (n = 0; n <= max_node; n++) {
+			for (i = 0; i < cpu->nr; i++) {
+				if (node[i] != n)
+					continue;
+				order[nr++] = cpu->map[i];
+				node[i] = -1;
+				break;
+			}
+		}
+	}
 
-	sigfillset(&act.sa_mask);
-	act.sa_sigaction = toggle_done;
-	sigaction(SIGINT, &act, NULL);
+	free(node);
+	return order;
+}
 
-	if (!nthreads) /* default to the number of CPUs */
-		nthreads = cpu->nr;
+/*
+ * Run one set of worker threads and store their throughput, in ops/sec, in
+ * results[proc * nthreads ...].
+ */
+static void run_threads(unsigned long *results, unsigned int proc)
+{
+	cpu_set_t cpuset;
+	unsigned int i;
+	pthread_attr_t thread_attr;
+	struct worker *worker;
+	int ret;
 
 	worker = calloc(nthreads, sizeof(*worker));
 	if (!worker)
-		goto errmem;
-
-	if (!fshared)
-		futex_flag = FUTEX_PRIVATE_FLAG;
-
-	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
-	       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
+		err(EXIT_FAILURE, "calloc");
 
-	init_stats(&throughput_stats);
 	pthread_mutex_init(&thread_lock, NULL);
 	pthread_cond_init(&thread_parent, NULL);
 	pthread_cond_init(&thread_worker, NULL);
@@ -164,10 +207,11 @@ int bench_futex_hash(int argc, const char **argv)
 		worker[i].tid = i;
 		worker[i].futex = calloc(nfutexes, sizeof(*worker[i].futex));
 		if (!worker[i].futex)
-			goto errmem;
+			err(EXIT_FAILURE, "calloc");
 
+		/* keep the processes from stacking on the same CPUs */
 		CPU_ZERO(&cpuset);
-		CPU_SET(cpu->map[i % cpu->nr], &cpuset);
+		CPU_SET(cpus[(proc * nthreads + i) % nr_cpus], &cpuset);
 
 		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset);
 		if (ret)
@@ -203,8 +247,11 @@ int bench_futex_hash(int argc, const char **argv)
 
 	for (i = 0; i < nthreads; i++) {
 		unsigned long t = worker[i].ops/runtime.tv_sec;
-		update_stats(&throughput_stats, t);
+
+		results[proc * nthreads + i] = t;
 		if (!silent) {
+			if (nprocs > 1)
+				printf("[pid %6d] ", getpid());
 			if (nfutexes == 1)
 				printf("[thread %2d] futex: %p [ %ld ops/sec ]\n",
 				       worker[i].tid, &worker[i].futex[0], t);
@@ -217,11 +264,108 @@ int bench_futex_hash(int argc, const char **argv)
 		free(worker[i].futex);
 	}
 
+	free(worker);
+}
+
+int bench_futex_hash(int argc, const char **argv)
+{
+	struct sigaction act;
+	unsigned long *results, total = 0;
+	unsigned int i, p;
+	struct cpu_map *cpu;
+	size_t results_size;
+	pid_t *pids;
+	int status;
+
+	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_hash_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	cpu = cpu_map__new(NULL);
+	if (!cpu)
+		goto errmem;
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = cpu->nr;
+	if (!nprocs)
+		nprocs = 1;
+
+	nr_cpus = cpu->nr;
+	cpus = spread_nodes ? spread_cpus(cpu) : cpu->map;
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	if (nprocs > 1)
+		printf("Run summary [PID %d]: %d processes of %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
+		       getpid(), nprocs, nthreads, nfutexes,
+		       fshared ? "shared":"private", nsecs);
+	else
+		printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
+		       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
+
+	/* shared with the worker processes, which report through it */
+	results_size = nprocs * nthreads * sizeof(*results);
+	results = mmap(NULL, results_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	init_stats(&throughput_stats);
+
+	if (nprocs == 1) {
+		run_threads(results, 0);
+	} else {
+		pids = calloc(nprocs, sizeof(*pids));
+		if (!pids)
+			goto errmem;
+
+		gettimeofday(&start, NULL);
+		for (p = 0; p < nprocs; p++) {
+			pids[p] = fork();
+			if (pids[p] < 0)
+				err(EXIT_FAILURE, "fork");
+			if (!pids[p]) {
+				run_threads(results, p);
+				exit(EXIT_SUCCESS);
+			}
+		}
+
+		for (p = 0; p < nprocs; p++) {
+			while (waitpid(pids[p], &status, 0) < 0) {
+				if (errno != EINTR)
+					err(EXIT_FAILURE, "waitpid");
+			}
+			if (!WIFEXITED(status) || WEXITSTATUS(status))
+				errx(EXIT_FAILURE, "worker process %d failed",
+				     pids[p]);
+		}
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &runtime);
+		free(pids);
+	}
+
+	for (i = 0; i < nprocs * nthreads; i++) {
+		update_stats(&throughput_stats, results[i]);
+		total += results[i];
+	}
+
 	print_summary();
+	if (nprocs > 1)
+		printf("Total %lu operations/sec over %d processes\n",
+		       total, nprocs);
 
-	free(worker);
+	munmap(results, results_size);
+	if (spread_nodes)
+		free(cpus);
 	free(cpu);
-	return ret;
+	return 0;
 errmem:
 	err(EXIT_FAILURE, "calloc");
 }
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Per operation latency histograms and CPU time breakdown, shared by the
+ * block and net benchmarks.
+ */
+#ifndef _BENCH_LATENCY_H
+#define _BENCH_LATENCY_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+#include <linux/types.h>
+
+#define BENCH_LAT_BUCKETS	40
+
+struct bench_lat {
+	u64	hist[BENCH_LAT_BUCKETS];
+	u64	count;
+	u64	total;
+	u64	max;
+};
+
+static inline u64 bench_lat__now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Bucket b counts the latencies in [2^b, 2^(b+1)) nanoseconds */
+static inline void bench_lat__add(struct bench_lat *lat, u64 ns)
+{
+	int b = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	lat->hist[min(b, BENCH_LAT_BUCKETS - 1)]++;
+	lat->count++;
+	lat->total += ns;
+	if (ns > lat->max)
+		lat->max = ns;
+}
+
+static inline void bench_lat__merge(struct bench_lat *to, struct bench_lat *from)
+{
+	int b;
+
+	for (b = 0; b < BENCH_LAT_BUCKETS; b++)
+		to->hist[b] += from->hist[b];
+	to->count += from->count;
+	to->total += from->total;
+	if (from->max > to->max)
+		to->max = from->max;
+}
+
+/* Upper bound of the bucket the @pct percentile falls into */
+static inline u64 bench_lat__pct(struct bench_lat *lat, double pct)
+{
+	u64 want = lat->count * pct / 100.0, seen = 0;
+	int b;
+
+	for (b = 0; b < BENCH_LAT_BUCKETS; b++) {
+		seen += lat->hist[b];
+		if (seen > want)
+			return 2ULL << b;
+	}
+
+	return lat->max;
+}
+
+static inline void bench_lat__print(struct bench_lat *lat)
+{
+	int b;
+
+	if (!lat->count)
+		return;
+
+	printf(" %14s: %.3f usecs\n", "Average",
+	       (double)lat->total / lat->count / NSEC_PER_USEC);
+	printf(" %14s: <%.3f usecs\n", "50th",
+	       (double)bench_lat__pct(lat, 50) / NSEC_PER_USEC);
+	printf(" %14s: <%.3f usecs\n", "99th",
+	       (double)bench_lat__pct(lat, 99) / NSEC_PER_USEC);
+	printf(" %14s: <%.3f usecs\n", "99.9th",
+	       (double)bench_lat__pct(lat, 99.9) / NSEC_PER_USEC);
+	printf(" %14s: %.3f usecs\n\n", "Max",
+	       (double)lat->max / NSEC_PER_USEC);
+
+	printf(" %24s : count\n", "nsecs");
+	for (b = 0; b < BENCH_LAT_BUCKETS; b++) {
+		if (!lat->hist[b])
+			continue;
+		printf(" %11llu -> %-10llu : %llu\n", 1ULL << b,
+		       (2ULL << b) - 1, (unsigned long long)lat->hist[b]);
+	}
+	printf("\n");
+}
+
+static inline double bench_tv_usecs(struct timeval *start, struct timeval *end)
+{
+	struct timeval diff;
+
+	timersub(end, start, &diff);
+	return diff.tv_sec * (double)USEC_PER_SEC + diff.tv_usec;
+}
+
+/* Where the CPU time of the run went, per operation */
+static inline void bench_print_cpu(struct rusage *start, struct rusage *end,
+				   struct timeval *wall, u64 ops)
+{
+	double usr = bench_tv_usecs(&start->ru_utime, &end->ru_utime);
+	double sys = bench_tv_usecs(&start->ru_stime, &end->ru_stime);
+	double total = wall->tv_sec * (double)USEC_PER_SEC + wall->tv_usec;
+
+	if (!ops || !total)
+		return;
+
+	printf(" %14s: %.3f usecs/op (%.1f%%)\n", "User CPU",
+	       usr / ops, 100.0 * usr / total);
+	printf(" %14s: %.3f usecs/op (%.1f%%)\n", "System CPU",
+	       sys / ops, 100.0 * sys / total);
+	printf(" %14s: %ld voluntary, %ld involuntary\n", "Switches",
+	       end->ru_nvcsw - start->ru_nvcsw,
+	       end->ru_nivcsw - start->ru_nivcsw);
+}
+
+#endif /* _BENCH_LATENCY_H */
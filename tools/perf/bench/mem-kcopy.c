@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mem-kcopy.c
+ *
+ * Drive the in-kernel user copy benchmark (CONFIG_COPY_USER_BENCHMARK)
+ * and print its results.
+ */
+
+#include <subcmd/parse-options.h>
+#include <api/fs/fs.h>
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KCOPY_PARAMS	"module/copy_user_benchmark/parameters"
+
+static int	min_size	= 8;
+static int	max_size	= 65536;
+static int	align;
+static int	node		= -1;
+static int	nr_loops	= 10000;
+static bool	cold;
+
+static const struct option options[] = {
+	OPT_INTEGER('s', "min-size", &min_size,
+		    "Smallest copy size in bytes (default: 8)"),
+	OPT_INTEGER('S', "max-size", &max_size,
+		    "Largest copy size in bytes (default: 65536)"),
+	OPT_INTEGER('a', "align", &align,
+		    "Offset of the buffers into their first page (default: 0)"),
+	OPT_INTEGER('n', "node", &node,
+		    "NUMA node of the kernel buffers (default: local)"),
+	OPT_INTEGER('l', "nr_loops", &nr_loops,
+		    "Calls per function and size (default: 10000)"),
+	OPT_BOOLEAN('c', "cold", &cold,
+		    "Fault in the user buffer on every call"),
+	OPT_END()
+};
+
+static const char * const bench_mem_kcopy_usage[] = {
+	"perf bench mem kcopy <options>",
+	NULL
+};
+
+static int kcopy_set_param(const char *name, int value)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s/%s", sysfs__mountpoint(),
+		 KCOPY_PARAMS, name);
+	if (filename__write_int(path, value) < 0) {
+		fprintf(stderr, "Failed to write %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int bench_mem_kcopy(int argc, const char **argv)
+{
+	char path[PATH_MAX], buf[4096];
+	const char *debugfs;
+	ssize_t n;
+	int fd;
+
+	argc = parse_options(argc, argv, options, bench_mem_kcopy_usage, 0);
+	if (argc)
+		usage_with_options(bench_mem_kcopy_usage, options);
+
+	if (kcopy_set_param("min_size", min_size) ||
+	    kcopy_set_param("max_size", max_size) ||
+	    kcopy_set_param("align", align) ||
+	    kcopy_set_param("node", node) ||
+	    kcopy_set_param("loops", nr_loops) ||
+	    kcopy_set_param("cold", cold)) {
+		fprintf(stderr, "Is the copy_user_benchmark module loaded?\n");
+		return 1;
+	}
+
+	debugfs = debugfs__mountpoint();
+	if (!debugfs) {
+		fprintf(stderr, "debugfs is not mounted\n");
+		return 1;
+	}
+
+	/* The benchmark runs when the file is opened */
+	snprintf(path, sizeof(path), "%s/copy_user_benchmark", debugfs);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to run %s: %s\n", path,
+			strerror(errno));
+		return 1;
+	}
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		fwrite(buf, 1, n, stdout);
+
+	close(fd);
+	return n < 0 ? 1 : 0;
+}
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * net-loopback.c
+ *
+ * loopback: request/response latency of TCP or UDP over the loopback
+ * device, between pairs of client and server threads.  The servers can
+ * wait for their requests in epoll_wait() instead of in recv().
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include <subcmd/parse-options.h>
+#include "../builtin.h"
+#include "bench.h"
+#include "latency.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define UDP_MAX_SIZE	65507
+
+struct net_pair {
+	int			srv_fd;
+	int			cli_fd;
+	pthread_t		srv_thread;
+	pthread_t		cli_thread;
+	struct bench_lat	lat;
+	int			cli_err;
+	int			srv_err;
+};
+
+static const char	*proto_str	= "tcp";
+static unsigned int	size		= 64;
+static unsigned int	loops		= 100000;
+static unsigned int	nr_pairs	= 1;
+static bool		use_epoll;
+static bool		udp;
+
+static const struct option options[] = {
+	OPT_STRING('p', "proto", &proto_str, "tcp|udp",
+		   "Protocol to use (default: tcp)"),
+	OPT_UINTEGER('s', "size", &size, "Request and response size in bytes (default: 64)"),
+	OPT_UINTEGER('l', "loops", &loops, "Requests per pair (default: 100000)"),
+	OPT_UINTEGER('n', "pairs", &nr_pairs, "Client/server pairs (default: 1)"),
+	OPT_BOOLEAN('e', "epoll", &use_epoll, "Servers wait in epoll_wait()"),
+	OPT_END()
+};
+
+static const char * const bench_net_loopback_usage[] = {
+	"perf bench net loopback <options>",
+	NULL
+};
+
+static int xfer(int fd, void *buf, bool send_it)
+{
+	ssize_t ret;
+
+	if (send_it)
+		ret = send(fd, buf, size, 0);
+	else
+		ret = recv(fd, buf, size, MSG_WAITALL);
+
+	if (ret != (ssize_t)size)
+		return ret < 0 ? -errno : -EIO;
+	return 0;
+}
+
+static void *server_thread(void *arg)
+{
+	struct net_pair *p = arg;
+	struct epoll_event ev = { .events = EPOLLIN, };
+	void *buf = zalloc(size);
+	int epfd = -1;
+	unsigned int i;
+
+	if (!buf) {
+		p->srv_err = -ENOMEM;
+		goto out;
+	}
+
+	if (use_epoll) {
+		epfd = epoll_create1(0);
+		if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, p->srv_fd, &ev)) {
+			p->srv_err = -errno;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < loops; i++) {
+		if (epfd >= 0 && epoll_wait(epfd, &ev, 1, -1) < 0) {
+			p->srv_err = -errno;
+			break;
+		}
+		p->srv_err = xfer(p->srv_fd, buf, false) ?:
+			     xfer(p->srv_fd, buf, true);
+		if (p->srv_err)
+			break;
+	}
+
+out:
+	/* Don't leave the client waiting for a response */
+	if (p->srv_err)
+		shutdown(p->cli_fd, SHUT_RDWR);
+	if (epfd >= 0)
+		close(epfd);
+	free(buf);
+	return NULL;
+}
+
+static void *client_thread(void *arg)
+{
+	struct net_pair *p = arg;
+	void *buf = zalloc(size);
+	unsigned int i;
+	u64 start;
+	int err = 0;
+
+	if (!buf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < loops && !err; i++) {
+		start = bench_lat__now();
+		err = xfer(p->cli_fd, buf, true) ?:
+		      xfer(p->cli_fd, buf, false);
+		bench_lat__add(&p->lat, bench_lat__now() - start);
+	}
+
+out:
+	/* Nor the server waiting for a request */
+	if (err)
+		shutdown(p->srv_fd, SHUT_RDWR);
+	p->cli_err = err;
+	free(buf);
+	return NULL;
+}
+
+static int bind_loopback(int fd, struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)addr, len) ||
+	    getsockname(fd, (struct sockaddr *)addr, &len))
+		return -errno;
+	return 0;
+}
+
+static int setup_udp(struct net_pair *p)
+{
+	struct sockaddr_in srv, cli;
+
+	p->srv_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	p->cli_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (p->srv_fd < 0 || p->cli_fd < 0)
+		return -errno;
+
+	if (bind_loopback(p->srv_fd, &srv) || bind_loopback(p->cli_fd, &cli))
+		return -errno;
+
+	if (connect(p->srv_fd, (struct sockaddr *)&cli, sizeof(cli)) ||
+	    connect(p->cli_fd, (struct sockaddr *)&srv, sizeof(srv)))
+		return -errno;
+	return 0;
+}
+
+static int setup_tcp(struct net_pair *p)
+{
+	struct sockaddr_in srv;
+	int one = 1, lfd, err = 0;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		return -errno;
+
+	p->cli_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (p->cli_fd < 0 || bind_loopback(lfd, &srv) || listen(lfd, 1) ||
+	    connect(p->cli_fd, (struct sockaddr *)&srv, sizeof(srv))) {
+		err = -errno;
+		goto out;
+	}
+
+	p->srv_fd = accept(lfd, NULL, NULL);
+	if (p->srv_fd < 0 ||
+	    setsockopt(p->srv_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ||
+	    setsockopt(p->cli_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+		err = -errno;
+out:
+	close(lfd);
+	return err;
+}
+
+int bench_net_loopback(int argc, const char **argv)
+{
+	struct rusage ru_start, ru_end;
+	struct timeval start, stop, diff;
+	struct bench_lat lat = { .count = 0, };
+	struct net_pair *pairs;
+	unsigned int i;
+	int err = 0;
+
+	argc = parse_options(argc, argv, options, bench_net_loopback_usage, 0);
+	if (argc)
+		usage_with_options(bench_net_loopback_usage, options);
+
+	if (!strcmp(proto_str, "udp")) {
+		udp = true;
+	} else if (strcmp(proto_str, "tcp")) {
+		fprintf(stderr, "Unknown protocol: %s\n", proto_str);
+		return 1;
+	}
+
+	if (!size || !nr_pairs || (udp && size > UDP_MAX_SIZE)) {
+		fprintf(stderr, "Invalid size or number of pairs\n");
+		return 1;
+	}
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	if (!pairs)
+		return 1;
+
+	for (i = 0; i < nr_pairs; i++)
+		pairs[i].srv_fd = pairs[i].cli_fd = -1;
+
+	for (i = 0; i < nr_pairs; i++) {
+		err = udp ? setup_udp(&pairs[i]) : setup_tcp(&pairs[i]);
+		if (err) {
+			fprintf(stderr, "Failed to set up sockets: %s\n",
+				strerror(-err));
+			goto out;
+		}
+	}
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_pairs; i++) {
+		BUG_ON(pthread_create(&pairs[i].srv_thread, NULL,
+				      server_thread, &pairs[i]));
+		BUG_ON(pthread_create(&pairs[i].cli_thread, NULL,
+				      client_thread, &pairs[i]));
+	}
+
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_join(pairs[i].cli_thread, NULL);
+		pthread_join(pairs[i].srv_thread, NULL);
+		if (!err)
+			err = pairs[i].srv_err ?: pairs[i].cli_err;
+		bench_lat__merge(&lat, &pairs[i].lat);
+	}
+
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &ru_end);
+	timersub(&stop, &start, &diff);
+
+	if (err) {
+		fprintf(stderr, "Transfer failed: %s\n", strerror(-err));
+		goto out;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u %s pair(s), %u byte requests and responses%s\n\n",
+		       nr_pairs, udp ? "UDP" : "TCP", size,
+		       use_epoll ? ", epoll" : "");
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time", diff.tv_sec,
+		       (unsigned long)(diff.tv_usec / USEC_PER_MSEC));
+		printf(" %14s: %.0f round trips/sec\n\n", "Throughput",
+		       lat.count / bench_tv_usecs(&start, &stop) * USEC_PER_SEC);
+		bench_print_cpu(&ru_start, &ru_end, &diff, lat.count);
+		printf("\n");
+		bench_lat__print(&lat);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", (double)lat.total / lat.count / NSEC_PER_USEC);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+	}
+
+out:
+	for (i = 0; i < nr_pairs; i++) {
+		if (pairs[i].srv_fd >= 0)
+			close(pairs[i].srv_fd);
+		if (pairs[i].cli_fd >= 0)
+			close(pairs[i].cli_fd);
+	}
+	free(pairs);
+	return err ? 1 : 0;
+}
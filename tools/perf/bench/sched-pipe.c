@@ -43,9 +43,15 @@ static	int			loops = LOOPS_DEFAULT;
 /* Use processes by default: */
 static bool			threaded;
 
+/* One int per message, answered right away, by default: */
+static unsigned int		msg_size	= sizeof(int);
+static unsigned int		batch		= 1;
+
 static const struct option options[] = {
 	OPT_INTEGER('l', "loop",	&loops,		"Specify number of loops"),
 	OPT_BOOLEAN('T', "threaded",	&threaded,	"Specify threads/process based task setup"),
+	OPT_UINTEGER('s', "size",	&msg_size,	"Message size in bytes (default: 4)"),
+	OPT_UINTEGER('b', "batch",	&batch,		"Messages per reply (default: 1)"),
 	OPT_END()
 };
 
@@ -54,26 +60,50 @@ static const char * const bench_sched_pipe_usage[] = {
 	NULL
 };
 
+static void xfer(int fd, void *buf, bool do_write)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < msg_size) {
+		if (do_write)
+			ret = write(fd, buf + done, msg_size - done);
+		else
+			ret = read(fd, buf + done, msg_size - done);
+		BUG_ON(ret <= 0);
+		done += ret;
+	}
+}
+
+/*
+ * Task 1 sends @batch messages and waits for a reply, task 0 reads them
+ * and replies.  With a batch of one this is the classic ping-pong, where
+ * every message is a wakeup; larger batches stream messages into a pipe
+ * the other side is still draining.
+ */
 static void *worker_thread(void *__tdata)
 {
 	struct thread_data *td = __tdata;
-	int m = 0, i;
-	int ret;
+	unsigned int j;
+	void *m;
+	int i;
+
+	m = zalloc(msg_size);
+	BUG_ON(!m);
 
 	for (i = 0; i < loops; i++) {
 		if (!td->nr) {
-			ret = read(td->pipe_read, &m, sizeof(int));
-			BUG_ON(ret != sizeof(int));
-			ret = write(td->pipe_write, &m, sizeof(int));
-			BUG_ON(ret != sizeof(int));
+			for (j = 0; j < batch; j++)
+				xfer(td->pipe_read, m, false);
+			xfer(td->pipe_write, m, true);
 		} else {
-			ret = write(td->pipe_write, &m, sizeof(int));
-			BUG_ON(ret != sizeof(int));
-			ret = read(td->pipe_read, &m, sizeof(int));
-			BUG_ON(ret != sizeof(int));
+			for (j = 0; j < batch; j++)
+				xfer(td->pipe_write, m, true);
+			xfer(td->pipe_read, m, false);
 		}
 	}
 
+	free(m);
 	return NULL;
 }
 
@@ -96,6 +126,11 @@ int bench_sched_pipe(int argc, const char **argv)
 
 	argc = parse_options(argc, argv, options, bench_sched_pipe_usage, 0);
 
+	if (!msg_size || !batch) {
+		fprintf(stderr, "Invalid message size or batch\n");
+		return 1;
+	}
+
 	BUG_ON(pipe(pipe_1));
 	BUG_ON(pipe(pipe_2));
 
@@ -152,8 +187,10 @@ int bench_sched_pipe(int argc, const char **argv)
 
 	switch (bench_format) {
 	case BENCH_FORMAT_DEFAULT:
-		printf("# Executed %d pipe operations between two %s\n\n",
+		printf("# Executed %d pipe operations between two %s\n",
 			loops, threaded ? "threads" : "processes");
+		printf("# %u message(s) of %u bytes per operation\n\n",
+			batch, msg_size);
 
 		result_usec = diff.tv_sec * USEC_PER_SEC;
 		result_usec += diff.tv_usec;
@@ -14,6 +14,8 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  block ... Block layer submission and completion performance
+ *  net   ... Networking stack performance over loopback
  */
 #include "perf.h"
 #include "util/util.h"
@@ -52,6 +54,7 @@ static struct bench sched_benchmarks[] = {
 static struct bench mem_benchmarks[] = {
 	{ "memcpy",	"Benchmark for memcpy() functions",		bench_mem_memcpy	},
 	{ "memset",	"Benchmark for memset() functions",		bench_mem_memset	},
+	{ "kcopy",	"Benchmark for the kernel's user copy functions", bench_mem_kcopy	},
 	{ "all",	"Run all memory access benchmarks",		NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -67,6 +70,18 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench block_benchmarks[] = {
+	{ "aio",	"Benchmark for native AIO to a block device",	bench_block_aio		},
+	{ "all",	"Run all block layer benchmarks",		NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench net_benchmarks[] = {
+	{ "loopback",	"Benchmark for TCP and UDP round trips over loopback", bench_net_loopback },
+	{ "all",	"Run all networking benchmarks",		NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -80,6 +95,8 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "block",	"Block layer benchmarks",			block_benchmarks	},
+	{ "net",	"Networking benchmarks",			net_benchmarks		},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
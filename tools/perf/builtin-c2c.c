@@ -14,6 +14,7 @@
 #include <inttypes.h>
 #include <linux/compiler.h>
 #include <linux/kernel.h>
+#include <linux/rbtree.h>
 #include <linux/stringify.h>
 #include <asm/bug.h>
 #include <sys/param.h>
@@ -66,6 +67,23 @@ struct c2c_hist_entry {
 	unsigned long		 paddr_cnt;
 	bool			 paddr_zero;
 	char			*nodestr;
+
+	/* slab object the data address was in, with --slab */
+	u64			 obj_site;
+	struct symbol		*obj_sym;
+	u64			 obj_off;
+	u64			 obj_size;
+};
+
+/*
+ * A live slab object, tracked from the kmem allocation and free
+ * tracepoints recorded with 'perf c2c record --slab'.
+ */
+struct c2c_slab_obj {
+	struct rb_node		 rb_node;
+	u64			 ptr;
+	u64			 size;
+	u64			 call_site;
 };
 
 static char const *coalesce_default = "pid,iaddr";
@@ -91,6 +109,9 @@ struct perf_c2c {
 	struct c2c_stats	hitm_stats;
 	int			shared_clines;
 
+	struct rb_root		slab_objs;
+	bool			slab;
+
 	int			 display;
 
 	const char		*coalesce;
@@ -230,6 +251,125 @@ static void c2c_he__set_node(struct c2c_hist_entry *c2c_he,
 	}
 }
 
+static struct c2c_slab_obj *c2c_slab__find(u64 addr)
+{
+	struct rb_node *node = c2c.slab_objs.rb_node;
+	struct c2c_slab_obj *obj, *found = NULL;
+
+	/* the object with the highest address at or below @addr */
+	while (node) {
+		obj = rb_entry(node, struct c2c_slab_obj, rb_node);
+		if (addr < obj->ptr) {
+			node = node->rb_left;
+		} else {
+			found = obj;
+			node = node->rb_right;
+		}
+	}
+
+	if (found && addr < found->ptr + found->size)
+		return found;
+	return NULL;
+}
+
+static int c2c_slab__alloc(u64 ptr, u64 size, u64 call_site)
+{
+	struct rb_node **p = &c2c.slab_objs.rb_node;
+	struct rb_node *parent = NULL;
+	struct c2c_slab_obj *obj;
+
+	while (*p) {
+		parent = *p;
+		obj = rb_entry(parent, struct c2c_slab_obj, rb_node);
+		if (ptr < obj->ptr) {
+			p = &parent->rb_left;
+		} else if (ptr > obj->ptr) {
+			p = &parent->rb_right;
+		} else {
+			/* the free wasn't seen */
+			obj->size = size;
+			obj->call_site = call_site;
+			return 0;
+		}
+	}
+
+	obj = zalloc(sizeof(*obj));
+	if (!obj)
+		return -ENOMEM;
+
+	obj->ptr = ptr;
+	obj->size = size;
+	obj->call_site = call_site;
+	rb_link_node(&obj->rb_node, parent, p);
+	rb_insert_color(&obj->rb_node, &c2c.slab_objs);
+	return 0;
+}
+
+static void c2c_slab__free(u64 ptr)
+{
+	struct c2c_slab_obj *obj = c2c_slab__find(ptr);
+
+	if (obj && obj->ptr == ptr) {
+		rb_erase(&obj->rb_node, &c2c.slab_objs);
+		free(obj);
+	}
+}
+
+static void c2c_slab__exit(void)
+{
+	struct rb_node *node;
+
+	while ((node = rb_first(&c2c.slab_objs))) {
+		rb_erase(node, &c2c.slab_objs);
+		free(rb_entry(node, struct c2c_slab_obj, rb_node));
+	}
+}
+
+static int c2c_slab__process(struct perf_evsel *evsel,
+			     struct perf_sample *sample)
+{
+	const char *name = perf_evsel__name(evsel);
+	u64 ptr = perf_evsel__intval(evsel, sample, "ptr");
+
+	if (!strcmp(name, "kmem:kfree") ||
+	    !strcmp(name, "kmem:kmem_cache_free")) {
+		c2c_slab__free(ptr);
+		return 0;
+	}
+
+	if (!ptr)
+		return 0;
+
+	c2c.slab = true;
+	return c2c_slab__alloc(ptr,
+			       perf_evsel__intval(evsel, sample, "bytes_alloc"),
+			       perf_evsel__intval(evsel, sample, "call_site"));
+}
+
+static void c2c_he__set_obj(struct c2c_hist_entry *c2c_he,
+			    struct mem_info *mi,
+			    struct machine *machine)
+{
+	struct c2c_slab_obj *obj;
+	struct map *map;
+
+	if (RB_EMPTY_ROOT(&c2c.slab_objs))
+		return;
+
+	obj = c2c_slab__find(mi->daddr.addr);
+	if (!obj)
+		return;
+
+	if (c2c_he->obj_site != obj->call_site) {
+		c2c_he->obj_site = obj->call_site;
+		c2c_he->obj_sym = machine__find_kernel_symbol(machine,
+							      obj->call_site,
+							      &map);
+	}
+	c2c_he->obj_off = mi->daddr.addr - obj->ptr;
+	c2c_he->obj_size = obj->size;
+}
+
 static void compute_stats(struct c2c_hist_entry *c2c_he,
 			  struct c2c_stats *stats,
 			  u64 weight)
@@ -258,6 +398,9 @@ static int process_sample_event(struct perf_tool *tool __maybe_unused,
 	struct mem_info *mi, *mi_dup;
 	int ret;
 
+	if (evsel->attr.type == PERF_TYPE_TRACEPOINT)
+		return c2c_slab__process(evsel, sample);
+
 	if (machine__resolve(machine, &al, sample) < 0) {
 		pr_debug("problem processing %d event, skipping it.\n",
 			 event->header.type);
@@ -331,6 +474,7 @@ static int process_sample_event(struct perf_tool *tool __maybe_unused,
 
 		c2c_he__set_cpu(c2c_he, sample);
 		c2c_he__set_node(c2c_he, sample);
+		c2c_he__set_obj(c2c_he, mi, machine);
 
 		hists__inc_nr_samples(&c2c_hists->hists, he->filtered);
 		ret = hist_entry__append_callchain(he, sample);
@@ -1227,6 +1371,42 @@ cl_idx_empty_entry(struct perf_hpp_fmt *fmt, struct perf_hpp *hpp,
 	return scnprintf(hpp->buf, hpp->size, "%*s", width, "");
 }
 
+static int
+obj_site_entry(struct perf_hpp_fmt *fmt, struct perf_hpp *hpp,
+	       struct hist_entry *he)
+{
+	struct c2c_hist_entry *c2c_he;
+	int width = c2c_width(fmt, hpp, he->hists);
+	char buf[20];
+
+	c2c_he = container_of(he, struct c2c_hist_entry, he);
+	if (c2c_he->obj_sym)
+		return scnprintf(hpp->buf, hpp->size, "%-*.*s", width, width,
+				 c2c_he->obj_sym->name);
+	if (c2c_he->obj_site)
+		return scnprintf(hpp->buf, hpp->size, "%-*s", width,
+				 HEX_STR(buf, c2c_he->obj_site));
+
+	return scnprintf(hpp->buf, hpp->size, "%-*s", width, "-");
+}
+
+static int
+obj_off_entry(struct perf_hpp_fmt *fmt, struct perf_hpp *hpp,
+	      struct hist_entry *he)
+{
+	struct c2c_hist_entry *c2c_he;
+	int width = c2c_width(fmt, hpp, he->hists);
+	char buf[24];
+
+	c2c_he = container_of(he, struct c2c_hist_entry, he);
+	if (!c2c_he->obj_size)
+		return scnprintf(hpp->buf, hpp->size, "%*s", width, "-");
+
+	scnprintf(buf, sizeof(buf), "%#" PRIx64 "/%" PRIu64,
+		  c2c_he->obj_off, c2c_he->obj_size);
+	return scnprintf(hpp->buf, hpp->size, "%*s", width, buf);
+}
+
 #define HEADER_LOW(__h)			\
 	{				\
 		.line[1] = {		\
@@ -1621,6 +1801,22 @@ static struct c2c_dimension dim_dcacheline_num_empty = {
 	.width		= 5,
 };
 
+static struct c2c_dimension dim_obj_site = {
+	.header		= HEADER_SPAN("----------- Slab object -----------", "Allocated by", 1),
+	.name		= "obj_site",
+	.cmp		= empty_cmp,
+	.entry		= obj_site_entry,
+	.width		= 22,
+};
+
+static struct c2c_dimension dim_obj_off = {
+	.header		= HEADER_LOW("Offset/size"),
+	.name		= "obj_off",
+	.cmp		= empty_cmp,
+	.entry		= obj_off_entry,
+	.width		= 12,
+};
+
 static struct c2c_dimension *dimensions[] = {
 	&dim_dcacheline,
 	&dim_dcacheline_node,
@@ -1666,6 +1862,8 @@ static struct c2c_dimension *dimensions[] = {
 	&dim_dcacheline_idx,
 	&dim_dcacheline_num,
 	&dim_dcacheline_num_empty,
+	&dim_obj_site,
+	&dim_obj_off,
 	NULL,
 };
 
@@ -2807,6 +3005,18 @@ static int perf_c2c__report(int argc, const char **argv)
 		goto out_mem2node;
 	}
 
+	/* Recorded with --slab, show the objects the cachelines belong to */
+	if (c2c.slab) {
+		char *cl_output = c2c.cl_output;
+
+		if (asprintf(&c2c.cl_output, "%s,obj_site,obj_off",
+			     cl_output) < 0) {
+			err = -ENOMEM;
+			goto out_mem2node;
+		}
+		free(cl_output);
+	}
+
 	c2c_hists__reinit(&c2c.hists,
 			"cl_idx,"
 			"dcacheline,"
@@ -2841,6 +3051,7 @@ static int perf_c2c__report(int argc, const char **argv)
 	perf_c2c_display(session);
 
 out_mem2node:
+	c2c_slab__exit();
 	mem2node__exit(&c2c.mem2node);
 out_session:
 	perf_session__delete(session);
@@ -2866,19 +3077,30 @@ static const char * const __usage_record[] = {
 
 static const char * const *record_mem_usage = __usage_record;
 
+static const char *slab_events[] = {
+	"kmem:kmalloc",
+	"kmem:kmalloc_node",
+	"kmem:kmem_cache_alloc",
+	"kmem:kmem_cache_alloc_node",
+	"kmem:kfree",
+	"kmem:kmem_cache_free",
+};
+
 static int perf_c2c__record(int argc, const char **argv)
 {
 	int rec_argc, i = 0, j;
 	const char **rec_argv;
 	int ret;
 	bool all_user = false, all_kernel = false;
-	bool event_set = false;
+	bool event_set = false, slab = false;
 	struct option options[] = {
 	OPT_CALLBACK('e', "event", &event_set, "event",
 		     "event selector. Use 'perf mem record -e list' to list available events",
 		     parse_record_events),
 	OPT_BOOLEAN('u', "all-user", &all_user, "collect only user level data"),
 	OPT_BOOLEAN('k', "all-kernel", &all_kernel, "collect only kernel level data"),
+	OPT_BOOLEAN(0, "slab", &slab,
+		    "record slab allocations to map data addresses to kernel objects"),
 	OPT_UINTEGER('l', "ldlat", &perf_mem_events__loads_ldlat, "setup mem-loads latency"),
 	OPT_PARENT(c2c_options),
 	OPT_END()
@@ -2892,7 +3114,8 @@ static int perf_c2c__record(int argc, const char **argv)
 	argc = parse_options(argc, argv, options, record_mem_usage,
 			     PARSE_OPT_KEEP_UNKNOWN);
 
-	rec_argc = argc + 11; /* max number of arguments */
+	/* max number of arguments */
+	rec_argc = argc + 11 + 2 * ARRAY_SIZE(slab_events);
 	rec_argv = calloc(rec_argc + 1, sizeof(char *));
 	if (!rec_argv)
 		return -1;
@@ -2932,6 +3155,11 @@ static int perf_c2c__record(int argc, const char **argv)
 	if (all_kernel)
 		rec_argv[i++] = "--all-kernel";
 
+	for (j = 0; slab && j < (int)ARRAY_SIZE(slab_events); j++) {
+		rec_argv[i++] = "-e";
+		rec_argv[i++] = slab_events[j];
+	}
+
 	for (j = 0; j < argc; j++, i++)
 		rec_argv[i] = argv[j];
 
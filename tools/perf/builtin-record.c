@@ -45,8 +45,10 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <locale.h>
 #include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sched.h>
 #include <signal.h>
@@ -63,6 +65,40 @@ struct switch_output {
 	bool		 set;
 };
 
+enum record_threads_mode {
+	RECORD_THREADS_NONE,
+	RECORD_THREADS_CPU,
+	RECORD_THREADS_NODE,
+	RECORD_THREADS_NR,
+};
+
+/*
+ * With --threads the ring buffers are drained by reader threads into
+ * private buffers, which the main thread writes out one round at a time.
+ */
+struct record_thread {
+	pthread_t		 tid;
+	struct record		*rec;
+	int			 key;
+	int			*maps;
+	int			 nr_maps;
+	cpu_set_t		 cpus;
+	struct pollfd		*pollfd;
+	int			 nr_pollfd;
+	int			 nr_alive;
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 cond;
+	void			*buf;
+	size_t			 size;
+	size_t			 alloc;
+	unsigned long long	 samples;
+	unsigned long		 passes;
+	unsigned long		 passes_mark;
+	bool			 stop;
+	bool			 done;
+	int			 err;
+};
+
 struct record {
 	struct perf_tool	tool;
 	struct record_opts	opts;
@@ -81,6 +117,12 @@ struct record {
 	bool			timestamp_boundary;
 	struct switch_output	switch_output;
 	unsigned long long	samples;
+	const char		*threads_spec;
+	enum record_threads_mode threads_mode;
+	int			threads_nr;
+	struct record_thread	*threads;
+	int			nr_threads;
+	bool			threads_running;
 };
 
 static volatile int auxtrace_record__snapshot_started;
@@ -558,11 +600,320 @@ static int record__mmap_read_evlist(struct record *rec, struct perf_evlist *evli
 	return rc;
 }
 
+static int record_thread__pushfn(void *to, void *bf, size_t size)
+{
+	struct record_thread *t = to;
+
+	if (t->size + size > t->alloc) {
+		size_t alloc = max(t->alloc * 2, t->size + size);
+		void *buf = realloc(t->buf, alloc);
+
+		if (!buf)
+			return -1;
+		t->buf = buf;
+		t->alloc = alloc;
+	}
+
+	memcpy(t->buf + t->size, bf, size);
+	t->size += size;
+	t->samples++;
+	return 0;
+}
+
+static void record_thread__poll(struct record_thread *t)
+{
+	int i, alive = 0;
+
+	if (poll(t->pollfd, t->nr_pollfd, 100) < 0)
+		return;
+
+	for (i = 0; i < t->nr_pollfd; i++) {
+		if (t->pollfd[i].revents & (POLLERR | POLLHUP))
+			t->pollfd[i].fd = -1;
+		if (t->pollfd[i].fd >= 0)
+			alive++;
+	}
+
+	pthread_mutex_lock(&t->lock);
+	t->nr_alive = alive;
+	pthread_mutex_unlock(&t->lock);
+}
+
+static void *record_thread__fn(void *arg)
+{
+	struct record_thread *t = arg;
+	struct perf_mmap *maps = t->rec->evlist->mmap;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&t->lock);
+		/* The pass that sees ->stop is the last one */
+		if (t->stop)
+			t->done = true;
+		for (i = 0; i < t->nr_maps && !t->err; i++) {
+			struct perf_mmap *map = &maps[t->maps[i]];
+
+			if (map->base &&
+			    perf_mmap__push(map, t, record_thread__pushfn) != 0)
+				t->err = -1;
+		}
+		if (t->err)
+			t->done = true;
+		t->passes++;
+		pthread_cond_broadcast(&t->cond);
+		pthread_mutex_unlock(&t->lock);
+
+		if (t->done)
+			break;
+		record_thread__poll(t);
+	}
+
+	return NULL;
+}
+
+/*
+ * Write what the reader threads have drained so far as one round.
+ *
+ * Each thread is waited for until it has done a full pass over its ring
+ * buffers since it was last collected, so that everything left in them
+ * was written after the previous round went out.  That keeps the
+ * FINISHED_ROUND guarantee of the single threaded reader: events after
+ * the next marker are newer than everything before the previous one.
+ */
+static int record__threads_collect(struct record *rec)
+{
+	u64 bytes_written = rec->bytes_written;
+	int i, err = 0;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *t = &rec->threads[i];
+		void *buf;
+		size_t size;
+
+		pthread_mutex_lock(&t->lock);
+		while (!t->done && t->passes < t->passes_mark + 2)
+			pthread_cond_wait(&t->cond, &t->lock);
+		t->passes_mark = t->passes;
+		buf = t->buf;
+		size = t->size;
+		t->buf = NULL;
+		t->size = t->alloc = 0;
+		rec->samples += t->samples;
+		t->samples = 0;
+		if (t->err)
+			err = t->err;
+		pthread_mutex_unlock(&t->lock);
+
+		if (!err && size)
+			err = record__write(rec, buf, size);
+		free(buf);
+		if (err)
+			return err;
+	}
+
+	if (bytes_written != rec->bytes_written)
+		err = record__write(rec, &finished_round_event,
+				    sizeof(finished_round_event));
+	return err;
+}
+
+/* All the events of all the reader threads are gone */
+static bool record__threads_hup(struct record *rec)
+{
+	int i, alive = 0;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *t = &rec->threads[i];
+
+		pthread_mutex_lock(&t->lock);
+		alive += t->nr_alive;
+		pthread_mutex_unlock(&t->lock);
+	}
+
+	return !alive;
+}
+
+static int record__thread_key(struct record *rec, int idx)
+{
+	struct perf_evlist *evlist = rec->evlist;
+
+	switch (rec->threads_mode) {
+	case RECORD_THREADS_NODE:
+		return max(cpu__get_node(evlist->cpus->map[idx]), 0);
+	case RECORD_THREADS_NR:
+		return (u64)idx * rec->threads_nr / evlist->nr_mmaps;
+	case RECORD_THREADS_CPU:
+	default:
+		return idx;
+	}
+}
+
+static void record__threads_free(struct record *rec)
+{
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *t = &rec->threads[i];
+
+		pthread_mutex_destroy(&t->lock);
+		pthread_cond_destroy(&t->cond);
+		free(t->maps);
+		free(t->pollfd);
+		free(t->buf);
+	}
+
+	zfree(&rec->threads);
+	rec->nr_threads = 0;
+}
+
+static int record__threads_setup(struct record *rec)
+{
+	struct perf_evlist *evlist = rec->evlist;
+	struct fdarray *fda = &evlist->pollfd;
+	struct record_thread *t;
+	int i, j, *thread_of;
+
+	if (cpu_map__empty(evlist->cpus) ||
+	    evlist->cpus->nr != evlist->nr_mmaps) {
+		pr_err("--threads needs one ring buffer per cpu\n");
+		return -EINVAL;
+	}
+
+	if (rec->opts.full_auxtrace) {
+		pr_err("--threads can't be used with AUX area tracing\n");
+		return -EINVAL;
+	}
+
+	if (rec->threads_mode == RECORD_THREADS_NODE &&
+	    cpu__setup_cpunode_map() < 0)
+		return -ENOMEM;
+
+	rec->threads = calloc(evlist->nr_mmaps, sizeof(*rec->threads));
+	thread_of = calloc(evlist->nr_mmaps, sizeof(*thread_of));
+	if (!rec->threads || !thread_of)
+		goto out_enomem;
+
+	for (i = 0; i < evlist->nr_mmaps; i++) {
+		int key = record__thread_key(rec, i);
+		int cpu = evlist->cpus->map[i];
+
+		for (j = 0; j < rec->nr_threads; j++) {
+			if (rec->threads[j].key == key)
+				break;
+		}
+
+		t = &rec->threads[j];
+		if (j == rec->nr_threads) {
+			t->rec = rec;
+			t->key = key;
+			CPU_ZERO(&t->cpus);
+			pthread_mutex_init(&t->lock, NULL);
+			pthread_cond_init(&t->cond, NULL);
+			rec->nr_threads++;
+
+			t->maps = calloc(evlist->nr_mmaps, sizeof(*t->maps));
+			t->pollfd = calloc(fda->nr, sizeof(*t->pollfd));
+			if (!t->maps || !t->pollfd)
+				goto out_enomem;
+		}
+
+		t->maps[t->nr_maps++] = i;
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &t->cpus);
+		thread_of[i] = j;
+	}
+
+	/* Each thread polls the descriptors of its own ring buffers */
+	for (i = 0; i < fda->nr; i++) {
+		struct perf_mmap *map = fda->priv[i].ptr;
+
+		if (map < evlist->mmap || map >= evlist->mmap + evlist->nr_mmaps)
+			continue;
+
+		t = &rec->threads[thread_of[map - evlist->mmap]];
+		t->pollfd[t->nr_pollfd].fd = fda->entries[i].fd;
+		t->pollfd[t->nr_pollfd].events = fda->entries[i].events;
+		t->nr_pollfd++;
+		t->nr_alive++;
+	}
+
+	free(thread_of);
+	return 0;
+
+out_enomem:
+	free(thread_of);
+	record__threads_free(rec);
+	return -ENOMEM;
+}
+
+static int record__threads_start(struct record *rec)
+{
+	pthread_attr_t attr;
+	int i, err;
+
+	if (rec->threads_mode == RECORD_THREADS_NONE)
+		return 0;
+
+	err = record__threads_setup(rec);
+	if (err)
+		return err;
+
+	pthread_attr_init(&attr);
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *t = &rec->threads[i];
+
+		/* Read the ring buffers from the cpus that fill them */
+		pthread_attr_setaffinity_np(&attr, sizeof(t->cpus), &t->cpus);
+		err = pthread_create(&t->tid, &attr, record_thread__fn, t);
+		if (err) {
+			pr_err("failed to create reader thread: %s\n",
+			       strerror(err));
+			rec->nr_threads = i;
+			rec->threads_running = true;
+			err = -err;
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	if (!err) {
+		rec->threads_running = true;
+		pr_debug("reading %d ring buffers from %d threads\n",
+			 rec->evlist->nr_mmaps, rec->nr_threads);
+	}
+	return err;
+}
+
+/* Let every thread do a last pass and wait for it to exit */
+static void record__threads_stop(struct record *rec)
+{
+	int i;
+
+	if (!rec->threads_running)
+		return;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *t = &rec->threads[i];
+
+		pthread_mutex_lock(&t->lock);
+		t->stop = true;
+		pthread_mutex_unlock(&t->lock);
+	}
+
+	for (i = 0; i < rec->nr_threads; i++)
+		pthread_join(rec->threads[i].tid, NULL);
+
+	rec->threads_running = false;
+}
+
 static int record__mmap_read_all(struct record *rec)
 {
 	int err;
 
-	err = record__mmap_read_evlist(rec, rec->evlist, false);
+	if (rec->nr_threads)
+		err = record__threads_collect(rec);
+	else
+		err = record__mmap_read_evlist(rec, rec->evlist, false);
 	if (err)
 		return err;
 
@@ -1036,6 +1387,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		perf_evlist__enable(rec->evlist);
 	}
 
+	err = record__threads_start(rec);
+	if (err)
+		goto out_child;
+
 	trigger_ready(&auxtrace_snapshot_trigger);
 	trigger_ready(&switch_output_trigger);
 	perf_hooks__invoke_record_start();
@@ -1112,6 +1467,14 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		if (hits == rec->samples) {
 			if (done || draining)
 				break;
+			/*
+			 * The reader threads do the polling, collecting
+			 * already waits for them.
+			 */
+			if (rec->nr_threads) {
+				draining = record__threads_hup(rec);
+				continue;
+			}
 			err = perf_evlist__poll(rec->evlist, -1);
 			/*
 			 * Propagate error, only if there's any. Ignore positive
@@ -1139,6 +1502,13 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	trigger_off(&auxtrace_snapshot_trigger);
 	trigger_off(&switch_output_trigger);
 
+	if (rec->nr_threads) {
+		record__threads_stop(rec);
+		err = record__threads_collect(rec);
+		if (err)
+			goto out_child;
+	}
+
 	if (forks && workload_exec_errno) {
 		char msg[STRERR_BUFSIZE];
 		const char *emsg = str_error_r(workload_exec_errno, msg, sizeof(msg));
@@ -1154,6 +1524,9 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		record__synthesize_workload(rec, true);
 
 out_child:
+	record__threads_stop(rec);
+	record__threads_free(rec);
+
 	if (forks) {
 		int exit_status;
 
@@ -1435,6 +1808,34 @@ static void switch_output_size_warn(struct record *rec)
 	}
 }
 
+static int record__threads_parse(struct record *rec)
+{
+	const char *spec = rec->threads_spec;
+	char *end;
+	long nr;
+
+	if (!spec)
+		return 0;
+
+	if (!strcmp(spec, "cpu")) {
+		rec->threads_mode = RECORD_THREADS_CPU;
+		return 0;
+	}
+
+	if (!strcmp(spec, "numa")) {
+		rec->threads_mode = RECORD_THREADS_NODE;
+		return 0;
+	}
+
+	nr = strtol(spec, &end, 10);
+	if (*end || nr <= 0 || nr > INT_MAX)
+		return -1;
+
+	rec->threads_mode = RECORD_THREADS_NR;
+	rec->threads_nr = nr;
+	return 0;
+}
+
 static int switch_output_setup(struct record *rec)
 {
 	struct switch_output *s = &rec->switch_output;
@@ -1676,6 +2077,9 @@ static struct option __record_options[] = {
 			  &record.switch_output.set, "signal,size,time",
 			  "Switch output when receive SIGUSR2 or cross size,time threshold",
 			  "signal"),
+	OPT_STRING_OPTARG(0, "threads", &record.threads_spec, "cpu|numa|N",
+			  "Read the ring buffers from threads, one per cpu, per NUMA node or N in total",
+			  "cpu"),
 	OPT_BOOLEAN(0, "dry-run", &dry_run,
 		    "Parse options then exit"),
 	OPT_END()
@@ -1746,6 +2150,11 @@ int cmd_record(int argc, const char **argv)
 		return -EINVAL;
 	}
 
+	if (record__threads_parse(rec)) {
+		parse_options_usage(record_usage, record_options, "threads", 0);
+		return -EINVAL;
+	}
+
 	if (rec->switch_output.time) {
 		signal(SIGALRM, alarm_sig_handler);
 		alarm(rec->switch_output.time);
@@ -25,12 +25,20 @@
 
 #include <linux/kernel.h>
 #include <linux/log2.h>
+#include <linux/err.h>
+#include <sys/ioctl.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <inttypes.h>
 
+#ifdef HAVE_LIBBPF_SUPPORT
+#include <bpf/bpf.h>
+#include <linux/filter.h>
+#endif
+
 #include <errno.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <pthread.h>
 #include <math.h>
 #include <api/fs/fs.h>
@@ -234,6 +242,11 @@ struct perf_sched {
 	const char	*time_str;
 	struct perf_time_interval ptime;
 	struct perf_time_interval hist_time;
+
+	/* options for latency --live */
+	bool		live;
+	bool		live_cgroup;
+	unsigned int	live_interval;
 };
 
 /* per thread run time data */
@@ -3166,6 +3179,559 @@ static int perf_sched__lat(struct perf_sched *sched)
 	return 0;
 }
 
+#ifdef HAVE_LIBBPF_SUPPORT
+/*
+ * perf sched latency --live: the wakeup to run latency is measured in the
+ * kernel by BPF programs on the sched_wakeup, sched_wakeup_new and
+ * sched_switch tracepoints, which keep log2 histograms per pid in BPF
+ * maps.  Only the maps are read, so nothing is written per event.
+ */
+#define LIVE_SLOTS		64
+#define LIVE_MAX_TASKS		65536
+
+struct live_hist_key {
+	u32		pid;
+	u32		slot;
+};
+
+struct live_entry {
+	struct rb_node	node;
+	char		*name;
+	u64		hist[LIVE_SLOTS];
+	u64		count;
+	u64		sum;
+};
+
+struct sched_live {
+	int		start_fd;
+	int		hist_fd;
+	int		sum_fd;
+	int		*event_fds;
+	int		nr_event_fds;
+	struct rb_root	entries;
+};
+
+static volatile int live_done;
+
+static void live_sig_handler(int sig __maybe_unused)
+{
+	live_done = 1;
+}
+
+static int live_field_offset(struct event_format *tp, const char *name)
+{
+	struct format_field *field = pevent_find_field(tp, name);
+
+	if (!field || field->size != sizeof(u32)) {
+		pr_err("%s:%s has no usable %s field\n", tp->system, tp->name,
+		       name);
+		return -1;
+	}
+
+	return field->offset;
+}
+
+static int live_load_prog(struct bpf_insn *insns, size_t cnt)
+{
+	static char log[BPF_LOG_BUF_SIZE];
+	int fd;
+
+	fd = bpf_load_program(BPF_PROG_TYPE_TRACEPOINT, insns, cnt, "GPL", 0,
+			      log, sizeof(log));
+	if (fd < 0)
+		pr_err("failed to load BPF program: %s\n%s\n",
+		       strerror(errno), log);
+	return fd;
+}
+
+/* Stamp the wakeup time of the woken pid */
+static int live_wakeup_prog(struct sched_live *sl, int pid_off)
+{
+	struct bpf_insn insns[] = {
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_1, pid_off),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_7, -4),
+		BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns),
+		BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -16),
+		BPF_LD_MAP_FD(BPF_REG_1, sl->start_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -16),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_ANY),
+		BPF_EMIT_CALL(BPF_FUNC_map_update_elem),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+
+	return live_load_prog(insns, ARRAY_SIZE(insns));
+}
+
+/* r1 += log2(r8), for r8 > 0 */
+#define LIVE_LOG2_STEP(s)					\
+	BPF_MOV64_REG(BPF_REG_2, BPF_REG_8),			\
+	BPF_ALU64_IMM(BPF_RSH, BPF_REG_2, s),			\
+	BPF_JMP_IMM(BPF_JEQ, BPF_REG_2, 0, 2),			\
+	BPF_MOV64_REG(BPF_REG_8, BPF_REG_2),			\
+	BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, s)
+
+/*
+ * When a woken pid gets the cpu, account the time since its wakeup to
+ * its sum and to its histogram slot log2(usecs).
+ */
+static int live_switch_prog(struct sched_live *sl, int next_pid_off)
+{
+	struct bpf_insn insns[] = {
+		/* 0: look up the wakeup time of next_pid */
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_1, next_pid_off),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_7, -4),
+		BPF_LD_MAP_FD(BPF_REG_1, sl->start_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		/* 7 */
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 79),
+		BPF_LDX_MEM(BPF_DW, BPF_REG_8, BPF_REG_0, 0),
+		BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns),
+		BPF_ALU64_REG(BPF_SUB, BPF_REG_0, BPF_REG_8),
+		BPF_MOV64_REG(BPF_REG_9, BPF_REG_0),
+		BPF_LD_MAP_FD(BPF_REG_1, sl->start_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_EMIT_CALL(BPF_FUNC_map_delete_elem),
+		/* 17: sum[pid] += delta */
+		BPF_LD_MAP_FD(BPF_REG_1, sl->sum_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		/* 22 */
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 2),
+		BPF_STX_XADD(BPF_DW, BPF_REG_0, BPF_REG_9, 0),
+		BPF_JMP_A(9),
+		/* 25 */
+		BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_9, -16),
+		BPF_LD_MAP_FD(BPF_REG_1, sl->sum_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -16),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_NOEXIST),
+		BPF_EMIT_CALL(BPF_FUNC_map_update_elem),
+		/* 34: slot = log2(delta in usecs) */
+		BPF_MOV64_REG(BPF_REG_8, BPF_REG_9),
+		BPF_ALU64_IMM(BPF_DIV, BPF_REG_8, NSEC_PER_USEC),
+		BPF_MOV64_IMM(BPF_REG_1, 0),
+		LIVE_LOG2_STEP(32),
+		LIVE_LOG2_STEP(16),
+		LIVE_LOG2_STEP(8),
+		LIVE_LOG2_STEP(4),
+		LIVE_LOG2_STEP(2),
+		LIVE_LOG2_STEP(1),
+		/* 67: hist[pid, slot]++ */
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_7, -16),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, -12),
+		BPF_LD_MAP_FD(BPF_REG_1, sl->hist_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -16),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		/* 74 */
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 3),
+		BPF_MOV64_IMM(BPF_REG_1, 1),
+		BPF_STX_XADD(BPF_DW, BPF_REG_0, BPF_REG_1, 0),
+		BPF_JMP_A(9),
+		/* 78 */
+		BPF_ST_MEM(BPF_DW, BPF_REG_10, -24, 1),
+		BPF_LD_MAP_FD(BPF_REG_1, sl->hist_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -16),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -24),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_NOEXIST),
+		BPF_EMIT_CALL(BPF_FUNC_map_update_elem),
+		/* 87 */
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+
+	return live_load_prog(insns, ARRAY_SIZE(insns));
+}
+
+/* Run @prog_fd on every cpu's instance of tracepoint @tp */
+static int live_attach(struct sched_live *sl, struct cpu_map *cpus,
+		       struct event_format *tp, int prog_fd)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_TRACEPOINT,
+		.size		= sizeof(attr),
+		.config		= tp->id,
+		.sample_period	= 1,
+		.sample_type	= PERF_SAMPLE_RAW,
+	};
+	int i, fd;
+
+	for (i = 0; i < cpus->nr; i++) {
+		fd = sys_perf_event_open(&attr, -1, cpus->map[i], -1,
+					 perf_event_open_cloexec_flag());
+		if (fd < 0) {
+			pr_err("failed to open %s:%s on cpu %d: %s\n",
+			       tp->system, tp->name, cpus->map[i],
+			       strerror(errno));
+			return -1;
+		}
+		sl->event_fds[sl->nr_event_fds++] = fd;
+
+		if (ioctl(fd, PERF_EVENT_IOC_SET_BPF, prog_fd) ||
+		    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0)) {
+			pr_err("failed to attach BPF to %s:%s: %s\n",
+			       tp->system, tp->name, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int live_setup(struct sched_live *sl, struct cpu_map *cpus)
+{
+	static const char * const wakeups[] = { "sched_wakeup",
+						"sched_wakeup_new" };
+	struct event_format *tp;
+	int i, off, prog_fd;
+
+	sl->start_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(u32),
+				      sizeof(u64), LIVE_MAX_TASKS, 0);
+	sl->sum_fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(u32),
+				    sizeof(u64), LIVE_MAX_TASKS, 0);
+	sl->hist_fd = bpf_create_map(BPF_MAP_TYPE_HASH,
+				     sizeof(struct live_hist_key), sizeof(u64),
+				     LIVE_MAX_TASKS * 4, 0);
+	if (sl->start_fd < 0 || sl->sum_fd < 0 || sl->hist_fd < 0) {
+		pr_err("failed to create BPF maps: %s\n", strerror(errno));
+		return -1;
+	}
+
+	sl->event_fds = calloc(cpus->nr * 3, sizeof(int));
+	if (!sl->event_fds)
+		return -ENOMEM;
+
+	for (i = 0; i < (int)ARRAY_SIZE(wakeups); i++) {
+		tp = trace_event__tp_format("sched", wakeups[i]);
+		if (IS_ERR(tp))
+			return PTR_ERR(tp);
+
+		off = live_field_offset(tp, "pid");
+		if (off < 0)
+			return -EINVAL;
+
+		prog_fd = live_wakeup_prog(sl, off);
+		if (prog_fd < 0 || live_attach(sl, cpus, tp, prog_fd))
+			return -1;
+		/* the events hold their own reference */
+		close(prog_fd);
+	}
+
+	tp = trace_event__tp_format("sched", "sched_switch");
+	if (IS_ERR(tp))
+		return PTR_ERR(tp);
+
+	off = live_field_offset(tp, "next_pid");
+	if (off < 0)
+		return -EINVAL;
+
+	prog_fd = live_switch_prog(sl, off);
+	if (prog_fd < 0 || live_attach(sl, cpus, tp, prog_fd))
+		return -1;
+	close(prog_fd);
+
+	return 0;
+}
+
+static void live_teardown(struct sched_live *sl)
+{
+	int i;
+
+	for (i = 0; i < sl->nr_event_fds; i++)
+		close(sl->event_fds[i]);
+	zfree(&sl->event_fds);
+
+	if (sl->start_fd >= 0)
+		close(sl->start_fd);
+	if (sl->sum_fd >= 0)
+		close(sl->sum_fd);
+	if (sl->hist_fd >= 0)
+		close(sl->hist_fd);
+}
+
+/* The cgroup of @pid in the cpu controller or on the unified hierarchy */
+static char *live_cgroup_name(u32 pid)
+{
+	char path[PATH_MAX], line[PATH_MAX], *name = NULL;
+	FILE *f;
+
+	scnprintf(path, sizeof(path), "/proc/%u/cgroup", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return strdup("<exited>");
+
+	while (fgets(line, sizeof(line), f)) {
+		char *ctrl = strchr(line, ':'), *cg;
+
+		if (!ctrl)
+			continue;
+		cg = strchr(++ctrl, ':');
+		if (!cg)
+			continue;
+		*cg++ = '\0';
+		cg[strcspn(cg, "\n")] = '\0';
+
+		if (!strcmp(ctrl, "") || strstr(ctrl, "cpu")) {
+			free(name);
+			name = strdup(cg);
+			if (*ctrl)
+				break;
+		}
+	}
+	fclose(f);
+
+	return name ?: strdup("<unknown>");
+}
+
+static char *live_entry_name(struct perf_sched *sched, u32 pid)
+{
+	char path[PATH_MAX], comm[32] = "<exited>", *name;
+	char *p;
+	FILE *f;
+
+	if (sched->live_cgroup)
+		return live_cgroup_name(pid);
+
+	scnprintf(path, sizeof(path), "/proc/%u/comm", pid);
+	f = fopen(path, "r");
+	if (f) {
+		if (fgets(comm, sizeof(comm), f)) {
+			p = strchr(comm, '\n');
+			if (p)
+				*p = '\0';
+		}
+		fclose(f);
+	}
+
+	if (!sched->skip_merge)
+		return strdup(comm);
+
+	if (asprintf(&name, "%s:%u", comm, pid) < 0)
+		return NULL;
+	return name;
+}
+
+static struct live_entry *live_entry_find(struct sched_live *sl, char *name)
+{
+	struct rb_node **p = &sl->entries.rb_node, *parent = NULL;
+	struct live_entry *e;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		e = rb_entry(parent, struct live_entry, node);
+		cmp = strcmp(name, e->name);
+		if (!cmp) {
+			free(name);
+			return e;
+		}
+		p = cmp < 0 ? &parent->rb_left : &parent->rb_right;
+	}
+
+	e = zalloc(sizeof(*e));
+	if (!e) {
+		free(name);
+		return NULL;
+	}
+
+	e->name = name;
+	rb_link_node(&e->node, parent, p);
+	rb_insert_color(&e->node, &sl->entries);
+	return e;
+}
+
+/* Upper bound in usecs of the slot the @pct percentile falls into */
+static u64 live_pct(struct live_entry *e, double pct)
+{
+	u64 want = e->count * pct / 100.0, seen = 0;
+	int s;
+
+	for (s = 0; s < LIVE_SLOTS - 1; s++) {
+		seen += e->hist[s];
+		if (seen > want)
+			break;
+	}
+
+	return 2ULL << s;
+}
+
+static int live_entry_cmp(const void *a, const void *b)
+{
+	struct live_entry *l = *(struct live_entry **)a;
+	struct live_entry *r = *(struct live_entry **)b;
+	u64 lp = live_pct(l, 99), rp = live_pct(r, 99);
+
+	if (lp != rp)
+		return lp < rp ? 1 : -1;
+	return l->count < r->count ? 1 : l->count > r->count ? -1 : 0;
+}
+
+/* Read and clear the maps, then print one line per task or cgroup */
+static int live_dump(struct perf_sched *sched, struct sched_live *sl)
+{
+	struct live_hist_key key, next;
+	struct live_entry *e, **sorted, total = { .count = 0, };
+	struct rb_node *node;
+	u32 pid = 0, next_pid;
+	int i, n = 0, s;
+	bool first = true;
+	u64 val;
+
+	while (!bpf_map_get_next_key(sl->hist_fd, first ? NULL : &key,
+				     &next)) {
+		first = false;
+		key = next;
+		if (bpf_map_lookup_elem(sl->hist_fd, &key, &val) ||
+		    key.slot >= LIVE_SLOTS)
+			continue;
+
+		e = live_entry_find(sl, live_entry_name(sched, key.pid));
+		if (!e)
+			return -ENOMEM;
+		e->hist[key.slot] += val;
+		e->count += val;
+	}
+
+	first = true;
+	while (!bpf_map_get_next_key(sl->sum_fd, first ? NULL : &pid,
+				     &next_pid)) {
+		first = false;
+		pid = next_pid;
+		if (bpf_map_lookup_elem(sl->sum_fd, &pid, &val))
+			continue;
+
+		e = live_entry_find(sl, live_entry_name(sched, pid));
+		if (!e)
+			return -ENOMEM;
+		e->sum += val;
+	}
+
+	/*
+	 * Start the next interval from empty maps.  Deleting while walking
+	 * would restart the walk, so it is done after the reads.
+	 */
+	while (!bpf_map_get_next_key(sl->hist_fd, NULL, &key))
+		bpf_map_delete_elem(sl->hist_fd, &key);
+	while (!bpf_map_get_next_key(sl->sum_fd, NULL, &pid))
+		bpf_map_delete_elem(sl->sum_fd, &pid);
+
+	for (node = rb_first(&sl->entries); node; node = rb_next(node))
+		n++;
+
+	sorted = calloc(n ?: 1, sizeof(*sorted));
+	if (!sorted)
+		return -ENOMEM;
+
+	i = 0;
+	for (node = rb_first(&sl->entries); node; node = rb_next(node))
+		sorted[i++] = rb_entry(node, struct live_entry, node);
+	qsort(sorted, n, sizeof(*sorted), live_entry_cmp);
+
+	printf("\n -----------------------------------------------------------------------------------------------\n");
+	printf("  %-22s| Switches | Average delay ms | 50th delay < ms | 99th delay < ms |\n",
+	       sched->live_cgroup ? "Cgroup" : "Task");
+	printf(" -----------------------------------------------------------------------------------------------\n");
+
+	for (i = 0; i < n; i++) {
+		e = sorted[i];
+		if (!e->count)
+			continue;
+
+		printf("  %-22.*s|%9" PRIu64 " | avg:%9.3f ms | <%12.3f ms | <%12.3f ms |\n",
+		       sched->live_cgroup ? 256 : 22, e->name, e->count,
+		       (double)e->sum / e->count / NSEC_PER_MSEC,
+		       (double)live_pct(e, 50) / USEC_PER_MSEC,
+		       (double)live_pct(e, 99) / USEC_PER_MSEC);
+
+		for (s = 0; s < LIVE_SLOTS; s++)
+			total.hist[s] += e->hist[s];
+		total.count += e->count;
+		total.sum += e->sum;
+	}
+
+	printf(" -----------------------------------------------------------------------------------------------\n");
+	if (total.count)
+		printf("  %-22s|%9" PRIu64 " | avg:%9.3f ms | <%12.3f ms | <%12.3f ms |\n",
+		       "TOTAL:", total.count,
+		       (double)total.sum / total.count / NSEC_PER_MSEC,
+		       (double)live_pct(&total, 50) / USEC_PER_MSEC,
+		       (double)live_pct(&total, 99) / USEC_PER_MSEC);
+	printf("\n");
+
+	for (i = 0; i < n; i++) {
+		rb_erase(&sorted[i]->node, &sl->entries);
+		free(sorted[i]->name);
+		free(sorted[i]);
+	}
+	free(sorted);
+	fflush(stdout);
+
+	return 0;
+}
+
+static int perf_sched__lat_live(struct perf_sched *sched)
+{
+	struct sched_live sl = {
+		.start_fd	= -1,
+		.hist_fd	= -1,
+		.sum_fd		= -1,
+		.entries	= RB_ROOT,
+	};
+	struct cpu_map *cpus;
+	unsigned int elapsed = 0;
+	int err;
+
+	cpus = cpu_map__new(NULL);
+	if (!cpus)
+		return -ENOMEM;
+
+	err = live_setup(&sl, cpus);
+	if (err)
+		goto out;
+
+	signal(SIGINT, live_sig_handler);
+	signal(SIGTERM, live_sig_handler);
+
+	if (!sched->live_interval)
+		fprintf(stderr, "Measuring scheduling latency... Hit Ctrl-C to end.\n");
+
+	while (!live_done) {
+		sleep(1);
+		if (sched->live_interval && ++elapsed == sched->live_interval) {
+			elapsed = 0;
+			err = live_dump(sched, &sl);
+			if (err)
+				goto out;
+		}
+	}
+
+	if (!sched->live_interval || elapsed)
+		err = live_dump(sched, &sl);
+out:
+	live_teardown(&sl);
+	cpu_map__put(cpus);
+	return err;
+}
+#else
+static int perf_sched__lat_live(struct perf_sched *sched __maybe_unused)
+{
+	pr_err("perf sched latency --live needs perf built with libbpf\n");
+	return -ENOTSUP;
+}
+#endif
+
 static int setup_map_cpus(struct perf_sched *sched)
 {
 	struct cpu_map *map;
@@ -3376,6 +3942,12 @@ int cmd_sched(int argc, const char **argv)
 		    "CPU to profile on"),
 	OPT_BOOLEAN('p', "pids", &sched.skip_merge,
 		    "latency stats per pid instead of per comm"),
+	OPT_BOOLEAN(0, "live", &sched.live,
+		    "aggregate latency histograms in the kernel instead of reading perf.data"),
+	OPT_BOOLEAN(0, "cgroup", &sched.live_cgroup,
+		    "with --live, latency stats per cgroup"),
+	OPT_UINTEGER('I', "interval", &sched.live_interval,
+		     "with --live, print the stats every n seconds"),
 	OPT_PARENT(sched_options)
 	};
 	const struct option replay_options[] = {
@@ -3486,6 +4058,8 @@ int cmd_sched(int argc, const char **argv)
 			if (argc)
 				usage_with_options(latency_usage, latency_options);
 		}
+		if (sched.live)
+			return perf_sched__lat_live(&sched);
 		setup_sorting(&sched, latency_options, latency_usage);
 		return perf_sched__lat(&sched);
 	} else if (!strcmp(argv[0], "map")) {
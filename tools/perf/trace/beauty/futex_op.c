@@ -13,6 +13,9 @@
 #ifndef FUTEX_CMP_REQUEUE_PI
 #define FUTEX_CMP_REQUEUE_PI	 12
 #endif
+#ifndef FUTEX_WAIT_MULTIPLE
+#define FUTEX_WAIT_MULTIPLE	 13
+#endif
 #ifndef FUTEX_CLOCK_REALTIME
 #define FUTEX_CLOCK_REALTIME	256
 #endif
@@ -46,6 +49,7 @@ static size_t syscall_arg__scnprintf_futex_op(char *bf, size_t size, struct sysc
 	P_FUTEX_OP(WAIT_BITSET);    arg->mask |= SCF_UADDR2;			  break;
 	P_FUTEX_OP(WAKE_BITSET);    arg->mask |= SCF_UADDR2;			  break;
 	P_FUTEX_OP(WAIT_REQUEUE_PI);						  break;
+	P_FUTEX_OP(WAIT_MULTIPLE);  arg->mask |= SCF_VAL3|SCF_UADDR2;		  break;
 	default: printed = scnprintf(bf, size, "%#x", cmd);			  break;
 	}
 
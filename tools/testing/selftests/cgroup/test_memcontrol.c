@@ -638,6 +638,59 @@ static int test_memcg_max(const char *root)
 	return ret;
 }
 
+/*
+ * This test checks that memory.reclaim reclaims the requested
+ * amount of pagecache from a cgroup without any limit being set,
+ * and that malformed requests are rejected.
+ */
+static int test_memcg_reclaim(const char *root)
+{
+	int ret = KSFT_FAIL, fd = -1;
+	char *memcg;
+	long current;
+
+	memcg = cg_name(root, "memcg_test");
+	if (!memcg)
+		goto cleanup;
+
+	if (cg_create(memcg))
+		goto cleanup;
+
+	fd = get_temp_fd();
+	if (fd < 0)
+		goto cleanup;
+
+	if (cg_run(memcg, alloc_pagecache_50M, (void *)(long)fd))
+		goto cleanup;
+
+	current = cg_read_long(memcg, "memory.current");
+	if (current < MB(50))
+		goto cleanup;
+
+	if (!cg_write(memcg, "memory.reclaim", "30M swappiness=101"))
+		goto cleanup;
+
+	if (!cg_write(memcg, "memory.reclaim", "junk"))
+		goto cleanup;
+
+	if (cg_write(memcg, "memory.reclaim", "30M swappiness=0"))
+		goto cleanup;
+
+	current = cg_read_long(memcg, "memory.current");
+	if (!current || current > MB(25))
+		goto cleanup;
+
+	ret = KSFT_PASS;
+
+cleanup:
+	if (fd >= 0)
+		close(fd);
+	cg_destroy(memcg);
+	free(memcg);
+
+	return ret;
+}
+
 static int alloc_anon_50M_check_swap(const char *cgroup, void *arg)
 {
 	long mem_max = (long)arg;
@@ -783,6 +836,7 @@ struct memcg_test {
 	T(test_memcg_low),
 	T(test_memcg_high),
 	T(test_memcg_max),
+	T(test_memcg_reclaim),
 	T(test_memcg_oom_events),
 	T(test_memcg_swap_max),
 };
@@ -671,6 +671,11 @@ int kvm_arch_vcpu_ioctl_run(struct kvm_vcpu *vcpu, struct kvm_run *run)
 
 		check_vcpu_requests(vcpu);
 
+		if (kvm_dirty_ring_check_exit(vcpu)) {
+			ret = 0;
+			break;
+		}
+
 		/*
 		 * Preparing the interrupts to be injected also
 		 * involves poking the GIC, which must be done in a
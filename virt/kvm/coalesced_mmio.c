@@ -14,6 +14,7 @@
 #include <linux/kvm_host.h>
 #include <linux/slab.h>
 #include <linux/kvm.h>
+#include <linux/eventfd.h>
 
 #include "coalesced_mmio.h"
 
@@ -40,9 +41,10 @@ static int coalesced_mmio_in_range(struct kvm_coalesced_mmio_dev *dev,
 	return 1;
 }
 
-static int coalesced_mmio_has_room(struct kvm_coalesced_mmio_dev *dev)
+static int coalesced_mmio_has_room(struct kvm_coalesced_mmio_dev *dev,
+				   u32 first, u32 last)
 {
-	struct kvm_coalesced_mmio_ring *ring;
+	u32 max = dev->kvm->coalesced_mmio_max;
 	unsigned avail;
 
 	/* Are we able to batch it ? */
@@ -51,8 +53,7 @@ static int coalesced_mmio_has_room(struct kvm_coalesced_mmio_dev *dev)
 	 * check if we don't meet the first used entry
 	 * there is always one unused entry in the buffer
 	 */
-	ring = dev->kvm->coalesced_mmio_ring;
-	avail = (ring->first - ring->last - 1) % KVM_COALESCED_MMIO_MAX;
+	avail = (first + max - last - 1) % max;
 	if (avail == 0) {
 		/* full */
 		return 0;
@@ -67,25 +68,37 @@ static int coalesced_mmio_write(struct kvm_vcpu *vcpu,
 {
 	struct kvm_coalesced_mmio_dev *dev = to_mmio(this);
 	struct kvm_coalesced_mmio_ring *ring = dev->kvm->coalesced_mmio_ring;
+	u32 max = dev->kvm->coalesced_mmio_max;
+	u32 first, insert;
 
 	if (!coalesced_mmio_in_range(dev, addr, len))
 		return -EOPNOTSUPP;
 
 	spin_lock(&dev->kvm->ring_lock);
 
-	if (!coalesced_mmio_has_room(dev)) {
+	/* The ring is shared with userspace, don't trust its indices */
+	first = READ_ONCE(ring->first);
+	insert = READ_ONCE(ring->last);
+	if (first >= max || insert >= max ||
+	    !coalesced_mmio_has_room(dev, first, insert)) {
 		spin_unlock(&dev->kvm->ring_lock);
 		return -EOPNOTSUPP;
 	}
 
 	/* copy data in first free entry of the ring */
 
-	ring->coalesced_mmio[ring->last].phys_addr = addr;
-	ring->coalesced_mmio[ring->last].len = len;
-	memcpy(ring->coalesced_mmio[ring->last].data, val, len);
+	ring->coalesced_mmio[insert].phys_addr = addr;
+	ring->coalesced_mmio[insert].len = len;
+	ring->coalesced_mmio[insert].pio = dev->zone.pio;
+	memcpy(ring->coalesced_mmio[insert].data, val, len);
 	smp_wmb();
-	ring->last = (ring->last + 1) % KVM_COALESCED_MMIO_MAX;
+	ring->last = (insert + 1) % max;
 	spin_unlock(&dev->kvm->ring_lock);
+
+	/* Wake the consumer only when the ring stops being empty */
+	if (dev->kvm->coalesced_mmio_eventfd && first == insert)
+		eventfd_signal(dev->kvm->coalesced_mmio_eventfd, 1);
+
 	return 0;
 }
 
@@ -115,6 +128,7 @@ int kvm_coalesced_mmio_init(struct kvm *kvm)
 
 	ret = 0;
 	kvm->coalesced_mmio_ring = page_address(page);
+	kvm->coalesced_mmio_max = KVM_COALESCED_MMIO_MAX;
 
 	/*
 	 * We're using this spinlock to sync access to the coalesced ring.
@@ -131,7 +145,74 @@ int kvm_coalesced_mmio_init(struct kvm *kvm)
 void kvm_coalesced_mmio_free(struct kvm *kvm)
 {
 	if (kvm->coalesced_mmio_ring)
-		free_page((unsigned long)kvm->coalesced_mmio_ring);
+		free_pages((unsigned long)kvm->coalesced_mmio_ring,
+			   kvm->coalesced_mmio_order);
+	if (kvm->coalesced_mmio_eventfd)
+		eventfd_ctx_put(kvm->coalesced_mmio_eventfd);
+}
+
+/*
+ * Resize the ring and/or attach a doorbell eventfd.  Only allowed
+ * before vcpus exist, so that nothing can be writing to the ring or
+ * have it mapped.
+ */
+int kvm_vm_ioctl_enable_coalesced_ring(struct kvm *kvm,
+				       struct kvm_enable_cap *cap)
+{
+	struct eventfd_ctx *eventfd = NULL;
+	unsigned long pages = cap->args[0];
+	void *ring = NULL;
+	unsigned int order = 0;
+	int ret;
+
+	if (cap->flags & ~KVM_COALESCED_MMIO_RING_EVENTFD)
+		return -EINVAL;
+
+	if (pages) {
+		if (pages > KVM_COALESCED_MMIO_MAX_PAGES ||
+		    (pages & (pages - 1)))
+			return -EINVAL;
+
+		order = ilog2(pages);
+		ring = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+						order);
+		if (!ring)
+			return -ENOMEM;
+	}
+
+	if (cap->flags & KVM_COALESCED_MMIO_RING_EVENTFD) {
+		eventfd = eventfd_ctx_fdget(cap->args[1]);
+		if (IS_ERR(eventfd)) {
+			ret = PTR_ERR(eventfd);
+			goto out_free;
+		}
+	}
+
+	mutex_lock(&kvm->lock);
+	if (kvm->created_vcpus) {
+		mutex_unlock(&kvm->lock);
+		ret = -EBUSY;
+		goto out_put;
+	}
+
+	if (ring) {
+		swap(kvm->coalesced_mmio_ring, ring);
+		swap(kvm->coalesced_mmio_order, order);
+		kvm->coalesced_mmio_max = KVM_COALESCED_MMIO_RING_ENTRIES(pages);
+	}
+	if (eventfd)
+		swap(kvm->coalesced_mmio_eventfd, eventfd);
+	mutex_unlock(&kvm->lock);
+	ret = 0;
+
+	/* Release whatever was replaced */
+out_put:
+	if (eventfd)
+		eventfd_ctx_put(eventfd);
+out_free:
+	if (ring)
+		free_pages((unsigned long)ring, order);
+	return ret;
 }
 
 int kvm_vm_ioctl_register_coalesced_mmio(struct kvm *kvm,
@@ -140,6 +221,9 @@ int kvm_vm_ioctl_register_coalesced_mmio(struct kvm *kvm,
 	int ret;
 	struct kvm_coalesced_mmio_dev *dev;
 
+	if (zone->pio != 0 && zone->pio != 1)
+		return -EINVAL;
+
 	dev = kzalloc(sizeof(struct kvm_coalesced_mmio_dev), GFP_KERNEL);
 	if (!dev)
 		return -ENOMEM;
@@ -149,8 +233,9 @@ int kvm_vm_ioctl_register_coalesced_mmio(struct kvm *kvm,
 	dev->zone = *zone;
 
 	mutex_lock(&kvm->slots_lock);
-	ret = kvm_io_bus_register_dev(kvm, KVM_MMIO_BUS, zone->addr,
-				      zone->size, &dev->dev);
+	ret = kvm_io_bus_register_dev(kvm,
+				zone->pio ? KVM_PIO_BUS : KVM_MMIO_BUS,
+				zone->addr, zone->size, &dev->dev);
 	if (ret < 0)
 		goto out_free_dev;
 	list_add_tail(&dev->list, &kvm->coalesced_zones);
@@ -173,8 +258,11 @@ int kvm_vm_ioctl_unregister_coalesced_mmio(struct kvm *kvm,
 	mutex_lock(&kvm->slots_lock);
 
 	list_for_each_entry_safe(dev, tmp, &kvm->coalesced_zones, list)
-		if (coalesced_mmio_in_range(dev, zone->addr, zone->size)) {
-			kvm_io_bus_unregister_dev(kvm, KVM_MMIO_BUS, &dev->dev);
+		if (zone->pio == dev->zone.pio &&
+		    coalesced_mmio_in_range(dev, zone->addr, zone->size)) {
+			kvm_io_bus_unregister_dev(kvm,
+				zone->pio ? KVM_PIO_BUS : KVM_MMIO_BUS,
+				&dev->dev);
 			kvm_iodevice_destructor(&dev->dev);
 		}
 
@@ -28,6 +28,8 @@ int kvm_vm_ioctl_register_coalesced_mmio(struct kvm *kvm,
 					struct kvm_coalesced_mmio_zone *zone);
 int kvm_vm_ioctl_unregister_coalesced_mmio(struct kvm *kvm,
 					struct kvm_coalesced_mmio_zone *zone);
+int kvm_vm_ioctl_enable_coalesced_ring(struct kvm *kvm,
+				       struct kvm_enable_cap *cap);
 
 #else
 
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KVM dirty ring implementation
+ *
+ * Each vcpu owns a ring of dirtied guest frames which userspace maps
+ * and harvests while the guest keeps running, so the cost of a
+ * migration pass follows the dirtying rate rather than guest size.
+ */
+#include <linux/kvm_host.h>
+#include <linux/kvm.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm_dirty_ring.h>
+
+static u32 kvm_dirty_ring_used(struct kvm_dirty_ring *ring)
+{
+	return READ_ONCE(ring->dirty_index) - READ_ONCE(ring->reset_index);
+}
+
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return ring->dirty_gfns &&
+	       kvm_dirty_ring_used(ring) >= ring->soft_limit;
+}
+
+static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset,
+				unsigned long mask)
+{
+	struct kvm_memory_slot *memslot;
+	int as_id, id;
+
+	as_id = slot >> 16;
+	id = (u16)slot;
+
+	if (as_id >= KVM_ADDRESS_SPACE_NUM || id >= KVM_USER_MEM_SLOTS)
+		return;
+
+	memslot = id_to_memslot(__kvm_memslots(kvm, as_id), id);
+	if (!memslot->npages || offset + __fls(mask) >= memslot->npages)
+		return;
+
+	spin_lock(&kvm->mmu_lock);
+	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
+	spin_unlock(&kvm->mmu_lock);
+}
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size)
+{
+	ring->dirty_gfns = vzalloc(size);
+	if (!ring->dirty_gfns)
+		return -ENOMEM;
+
+	ring->size = size / sizeof(struct kvm_dirty_gfn);
+	ring->soft_limit = ring->size - KVM_DIRTY_RING_RSVD_ENTRIES;
+	ring->dirty_index = 0;
+	ring->reset_index = 0;
+	ring->index = index;
+
+	return 0;
+}
+
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+	vfree(ring->dirty_gfns);
+	ring->dirty_gfns = NULL;
+}
+
+/*
+ * Called by the vcpu that owns @ring.  Returns false if the ring is
+ * full, in which case the caller falls back to the slot's bitmap.
+ */
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
+{
+	struct kvm_dirty_gfn *entry;
+
+	if (kvm_dirty_ring_used(ring) >= ring->size)
+		return false;
+
+	entry = &ring->dirty_gfns[ring->dirty_index & (ring->size - 1)];
+	entry->slot = slot;
+	entry->offset = offset;
+	/* Make the gfn visible before userspace can see the entry dirty */
+	smp_wmb();
+	WRITE_ONCE(entry->flags, KVM_DIRTY_GFN_F_DIRTY);
+	WRITE_ONCE(ring->dirty_index, ring->dirty_index + 1);
+
+	return true;
+}
+
+/*
+ * Re-arm dirty tracking for every entry userspace has flagged as
+ * collected, in ring order, and hand those entries back to the vcpu.
+ * Adjacent gfns of the same slot are write-protected together.
+ * Called with kvm->slots_lock held.
+ */
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
+{
+	u32 cur_slot = 0, next_slot;
+	u64 cur_offset = 0, next_offset;
+	unsigned long mask = 0;
+	u32 mask_idx = ring->size - 1;
+	struct kvm_dirty_gfn *entry;
+	int count = 0;
+
+	while (ring->reset_index != READ_ONCE(ring->dirty_index)) {
+		entry = &ring->dirty_gfns[ring->reset_index & mask_idx];
+
+		if (!(READ_ONCE(entry->flags) & KVM_DIRTY_GFN_F_RESET))
+			break;
+		/* Pairs with userspace filling the entry before flagging it */
+		smp_rmb();
+
+		next_slot = READ_ONCE(entry->slot);
+		next_offset = READ_ONCE(entry->offset);
+		WRITE_ONCE(entry->flags, 0);
+		WRITE_ONCE(ring->reset_index, ring->reset_index + 1);
+		count++;
+
+		if (mask) {
+			if (next_slot == cur_slot &&
+			    next_offset >= cur_offset &&
+			    next_offset - cur_offset < BITS_PER_LONG) {
+				mask |= 1UL << (next_offset - cur_offset);
+				continue;
+			}
+			kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+		}
+
+		cur_slot = next_slot;
+		cur_offset = next_offset;
+		mask = 1;
+	}
+
+	if (mask)
+		kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+
+	return count;
+}
+
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
+{
+	return vmalloc_to_page((void *)ring->dirty_gfns + offset * PAGE_SIZE);
+}
+
+/*
+ * Architectures call this before entering the guest; KVM_RUN also
+ * checks it on entry.  Returns true if the vcpu must exit to userspace
+ * so that its ring can be harvested.
+ */
+bool kvm_dirty_ring_check_exit(struct kvm_vcpu *vcpu)
+{
+	if (!kvm_dirty_ring_soft_full(&vcpu->dirty_ring))
+		return false;
+
+	vcpu->run->exit_reason = KVM_EXIT_DIRTY_RING_FULL;
+	return true;
+}
+EXPORT_SYMBOL_GPL(kvm_dirty_ring_check_exit);
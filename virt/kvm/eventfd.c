@@ -514,6 +514,7 @@ kvm_eventfd_init(struct kvm *kvm)
 	mutex_init(&kvm->irqfds.resampler_lock);
 #endif
 	INIT_LIST_HEAD(&kvm->ioeventfds);
+	hash_init(kvm->ioeventfd_hash);
 }
 
 #ifdef CONFIG_HAVE_KVM_IRQFD
@@ -653,6 +654,7 @@ void kvm_irqfd_exit(void)
 
 struct _ioeventfd {
 	struct list_head     list;
+	struct hlist_node    hnode;
 	u64                  addr;
 	int                  length;
 	struct eventfd_ctx  *eventfd;
@@ -752,13 +754,53 @@ static const struct kvm_io_device_ops ioeventfd_ops = {
 	.destructor = ioeventfd_destructor,
 };
 
+/*
+ * ioeventfds only ever match their exact address, so they are kept in
+ * a hash keyed by address rather than in the sorted bus arrays, which
+ * are copied on every registration and binary searched on every exit.
+ * virtio-ccw notifications are dispatched by bus index cookie, so
+ * those stay on their bus as well.
+ */
+static bool ioeventfd_on_bus(enum kvm_bus bus_idx)
+{
+	return bus_idx == KVM_VIRTIO_CCW_NOTIFY_BUS;
+}
+
+/* Called under kvm->srcu */
+int kvm_ioeventfd_write(struct kvm_vcpu *vcpu, enum kvm_bus bus_idx,
+			gpa_t addr, int len, const void *val)
+{
+	struct _ioeventfd *p;
+
+	hash_for_each_possible_rcu(vcpu->kvm->ioeventfd_hash, p, hnode, addr)
+		if (p->bus_idx == bus_idx &&
+		    ioeventfd_in_range(p, addr, len, val)) {
+			eventfd_signal(p->eventfd, 1);
+			return 0;
+		}
+
+	return -EOPNOTSUPP;
+}
+
+/*
+ * Called as the VM is destroyed, after the buses have freed the
+ * ioeventfds registered on them.
+ */
+void kvm_ioeventfd_release(struct kvm *kvm)
+{
+	struct _ioeventfd *p, *tmp;
+
+	list_for_each_entry_safe(p, tmp, &kvm->ioeventfds, list)
+		ioeventfd_release(p);
+}
+
 /* assumes kvm->slots_lock held */
 static bool
 ioeventfd_check_collision(struct kvm *kvm, struct _ioeventfd *p)
 {
 	struct _ioeventfd *_p;
 
-	list_for_each_entry(_p, &kvm->ioeventfds, list)
+	hash_for_each_possible(kvm->ioeventfd_hash, _p, hnode, p->addr)
 		if (_p->bus_idx == p->bus_idx &&
 		    _p->addr == p->addr &&
 		    (!_p->length || !p->length ||
@@ -820,12 +862,16 @@ static int kvm_assign_ioeventfd_idx(struct kvm *kvm,
 
 	kvm_iodevice_init(&p->dev, &ioeventfd_ops);
 
-	ret = kvm_io_bus_register_dev(kvm, bus_idx, p->addr, p->length,
-				      &p->dev);
-	if (ret < 0)
-		goto unlock_fail;
+	if (ioeventfd_on_bus(bus_idx)) {
+		ret = kvm_io_bus_register_dev(kvm, bus_idx, p->addr,
+					      p->length, &p->dev);
+		if (ret < 0)
+			goto unlock_fail;
 
-	kvm_get_bus(kvm, bus_idx)->ioeventfd_count++;
+		kvm_get_bus(kvm, bus_idx)->ioeventfd_count++;
+	}
+
+	hash_add_rcu(kvm->ioeventfd_hash, &p->hnode, p->addr);
 	list_add_tail(&p->list, &kvm->ioeventfds);
 
 	mutex_unlock(&kvm->slots_lock);
@@ -870,10 +916,15 @@ kvm_deassign_ioeventfd_idx(struct kvm *kvm, enum kvm_bus bus_idx,
 		if (!p->wildcard && p->datamatch != args->datamatch)
 			continue;
 
-		kvm_io_bus_unregister_dev(kvm, bus_idx, &p->dev);
-		bus = kvm_get_bus(kvm, bus_idx);
-		if (bus)
-			bus->ioeventfd_count--;
+		hash_del_rcu(&p->hnode);
+		if (ioeventfd_on_bus(bus_idx)) {
+			kvm_io_bus_unregister_dev(kvm, bus_idx, &p->dev);
+			bus = kvm_get_bus(kvm, bus_idx);
+			if (bus)
+				bus->ioeventfd_count--;
+		} else {
+			synchronize_srcu_expedited(&kvm->srcu);
+		}
 		ioeventfd_release(p);
 		ret = 0;
 		break;
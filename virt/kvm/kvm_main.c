@@ -86,6 +86,24 @@ unsigned int halt_poll_ns_shrink;
 module_param(halt_poll_ns_shrink, uint, 0644);
 EXPORT_SYMBOL_GPL(halt_poll_ns_shrink);
 
+/*
+ * Fraction of halts, in percent, that the per-vcpu poll window should
+ * cover.  The window is derived from a histogram of recent halt
+ * durations instead of grow/shrink steps.  Zero keeps grow/shrink.
+ */
+unsigned int halt_poll_target_pct;
+module_param(halt_poll_target_pct, uint, 0644);
+EXPORT_SYMBOL_GPL(halt_poll_target_pct);
+
+/* Host-wide cap on halt polling, in percent of online CPU time. */
+unsigned int halt_poll_budget_pct;
+module_param(halt_poll_budget_pct, uint, 0644);
+EXPORT_SYMBOL_GPL(halt_poll_budget_pct);
+
+#define KVM_HALT_POLL_BUDGET_WINDOW	(HZ / 10)
+/* Halve the histogram once it holds this many samples. */
+#define KVM_HALT_POLL_HIST_DECAY	256
+
 /*
  * Ordering of locks:
  *
@@ -122,7 +140,8 @@ static void hardware_disable_all(void);
 
 static void kvm_io_bus_destroy(struct kvm_io_bus *bus);
 
-static void mark_page_dirty_in_slot(struct kvm_memory_slot *memslot, gfn_t gfn);
+static void mark_page_dirty_in_slot(struct kvm *kvm,
+				    struct kvm_memory_slot *memslot, gfn_t gfn);
 
 __visible bool kvm_rebooting;
 EXPORT_SYMBOL_GPL(kvm_rebooting);
@@ -148,12 +167,17 @@ bool kvm_is_reserved_pfn(kvm_pfn_t pfn)
 	return true;
 }
 
+/* The vcpu loaded on each cpu, if any; follows the vcpu across preemption */
+static DEFINE_PER_CPU(struct kvm_vcpu *, kvm_running_vcpu);
+
 /*
  * Switches to specified vcpu, until a matching vcpu_put()
  */
 void vcpu_load(struct kvm_vcpu *vcpu)
 {
 	int cpu = get_cpu();
+
+	__this_cpu_write(kvm_running_vcpu, vcpu);
 	preempt_notifier_register(&vcpu->preempt_notifier);
 	kvm_arch_vcpu_load(vcpu, cpu);
 	put_cpu();
@@ -165,10 +189,22 @@ void vcpu_put(struct kvm_vcpu *vcpu)
 	preempt_disable();
 	kvm_arch_vcpu_put(vcpu);
 	preempt_notifier_unregister(&vcpu->preempt_notifier);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 	preempt_enable();
 }
 EXPORT_SYMBOL_GPL(vcpu_put);
 
+/**
+ * kvm_get_running_vcpu - get the vcpu loaded by the current task
+ *
+ * Returns NULL if the current task has no vcpu loaded.
+ */
+struct kvm_vcpu *kvm_get_running_vcpu(void)
+{
+	return this_cpu_read(kvm_running_vcpu);
+}
+EXPORT_SYMBOL_GPL(kvm_get_running_vcpu);
+
 /* TODO: merge with kvm_arch_vcpu_should_kick */
 static bool kvm_request_needs_ipi(struct kvm_vcpu *vcpu, unsigned req)
 {
@@ -289,11 +325,20 @@ int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id)
 	kvm_vcpu_set_dy_eligible(vcpu, false);
 	vcpu->preempted = false;
 
+	if (kvm->dirty_ring_size) {
+		r = kvm_dirty_ring_alloc(&vcpu->dirty_ring, id,
+					 kvm->dirty_ring_size);
+		if (r)
+			goto fail_free_run;
+	}
+
 	r = kvm_arch_vcpu_init(vcpu);
 	if (r < 0)
-		goto fail_free_run;
+		goto fail_free_ring;
 	return 0;
 
+fail_free_ring:
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 fail_free_run:
 	free_page((unsigned long)vcpu->run);
 fail:
@@ -310,6 +355,7 @@ void kvm_vcpu_uninit(struct kvm_vcpu *vcpu)
 	 */
 	put_pid(rcu_dereference_protected(vcpu->pid, 1));
 	kvm_arch_vcpu_uninit(vcpu);
+	kvm_dirty_ring_free(&vcpu->dirty_ring);
 	free_page((unsigned long)vcpu->run);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_uninit);
@@ -720,6 +766,7 @@ static void kvm_destroy_vm(struct kvm *kvm)
 			kvm_io_bus_destroy(bus);
 		kvm->buses[i] = NULL;
 	}
+	kvm_ioeventfd_release(kvm);
 	kvm_coalesced_mmio_free(kvm);
 #if defined(CONFIG_MMU_NOTIFIER) && defined(KVM_ARCH_WANT_MMU_NOTIFIER)
 	mmu_notifier_unregister(&kvm->mmu_notifier, kvm->mm);
@@ -1816,7 +1863,8 @@ int kvm_vcpu_read_guest_atomic(struct kvm_vcpu *vcpu, gpa_t gpa,
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_read_guest_atomic);
 
-static int __kvm_write_guest_page(struct kvm_memory_slot *memslot, gfn_t gfn,
+static int __kvm_write_guest_page(struct kvm *kvm,
+				  struct kvm_memory_slot *memslot, gfn_t gfn,
 			          const void *data, int offset, int len)
 {
 	int r;
@@ -1828,7 +1876,7 @@ static int __kvm_write_guest_page(struct kvm_memory_slot *memslot, gfn_t gfn,
 	r = __copy_to_user((void __user *)addr + offset, data, len);
 	if (r)
 		return -EFAULT;
-	mark_page_dirty_in_slot(memslot, gfn);
+	mark_page_dirty_in_slot(kvm, memslot, gfn);
 	return 0;
 }
 
@@ -1837,7 +1885,7 @@ int kvm_write_guest_page(struct kvm *kvm, gfn_t gfn,
 {
 	struct kvm_memory_slot *slot = gfn_to_memslot(kvm, gfn);
 
-	return __kvm_write_guest_page(slot, gfn, data, offset, len);
+	return __kvm_write_guest_page(kvm, slot, gfn, data, offset, len);
 }
 EXPORT_SYMBOL_GPL(kvm_write_guest_page);
 
@@ -1846,7 +1894,7 @@ int kvm_vcpu_write_guest_page(struct kvm_vcpu *vcpu, gfn_t gfn,
 {
 	struct kvm_memory_slot *slot = kvm_vcpu_gfn_to_memslot(vcpu, gfn);
 
-	return __kvm_write_guest_page(slot, gfn, data, offset, len);
+	return __kvm_write_guest_page(vcpu->kvm, slot, gfn, data, offset, len);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_write_guest_page);
 
@@ -1958,7 +2006,7 @@ int kvm_write_guest_offset_cached(struct kvm *kvm, struct gfn_to_hva_cache *ghc,
 	r = __copy_to_user((void __user *)ghc->hva + offset, data, len);
 	if (r)
 		return -EFAULT;
-	mark_page_dirty_in_slot(ghc->memslot, gpa >> PAGE_SHIFT);
+	mark_page_dirty_in_slot(kvm, ghc->memslot, gpa >> PAGE_SHIFT);
 
 	return 0;
 }
@@ -2023,12 +2071,41 @@ int kvm_clear_guest(struct kvm *kvm, gpa_t gpa, unsigned long len)
 }
 EXPORT_SYMBOL_GPL(kvm_clear_guest);
 
-static void mark_page_dirty_in_slot(struct kvm_memory_slot *memslot,
+/*
+ * With dirty rings enabled, pages dirtied by a vcpu go to that vcpu's
+ * ring.  Writes made outside vcpu context, or that do not fit in the
+ * ring, are still recorded in the bitmap so that a final
+ * KVM_GET_DIRTY_LOG picks them up.
+ */
+static bool kvm_dirty_ring_mark(struct kvm *kvm,
+				struct kvm_memory_slot *memslot,
+				unsigned long rel_gfn)
+{
+	struct kvm_vcpu *vcpu = kvm_get_running_vcpu();
+	int as_id;
+
+	if (!kvm->dirty_ring_size || !vcpu || vcpu->kvm != kvm)
+		return false;
+
+	/* The slot id alone does not say which address space it is from. */
+	as_id = kvm_arch_vcpu_memslots_id(vcpu);
+	if (id_to_memslot(__kvm_memslots(kvm, as_id), memslot->id) != memslot)
+		return false;
+
+	return kvm_dirty_ring_push(&vcpu->dirty_ring,
+				   (as_id << 16) | memslot->id, rel_gfn);
+}
+
+static void mark_page_dirty_in_slot(struct kvm *kvm,
+				    struct kvm_memory_slot *memslot,
 				    gfn_t gfn)
 {
 	if (memslot && memslot->dirty_bitmap) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
 
+		if (kvm_dirty_ring_mark(kvm, memslot, rel_gfn))
+			return;
+
 		set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
 }
@@ -2038,7 +2115,7 @@ void mark_page_dirty(struct kvm *kvm, gfn_t gfn)
 	struct kvm_memory_slot *memslot;
 
 	memslot = gfn_to_memslot(kvm, gfn);
-	mark_page_dirty_in_slot(memslot, gfn);
+	mark_page_dirty_in_slot(kvm, memslot, gfn);
 }
 EXPORT_SYMBOL_GPL(mark_page_dirty);
 
@@ -2047,7 +2124,7 @@ void kvm_vcpu_mark_page_dirty(struct kvm_vcpu *vcpu, gfn_t gfn)
 	struct kvm_memory_slot *memslot;
 
 	memslot = kvm_vcpu_gfn_to_memslot(vcpu, gfn);
-	mark_page_dirty_in_slot(memslot, gfn);
+	mark_page_dirty_in_slot(vcpu->kvm, memslot, gfn);
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_mark_page_dirty);
 
@@ -2108,6 +2185,88 @@ static void shrink_halt_poll_ns(struct kvm_vcpu *vcpu)
 	trace_kvm_halt_poll_ns_shrink(vcpu->vcpu_id, val, old);
 }
 
+static atomic64_t halt_poll_budget_used;
+static unsigned long halt_poll_budget_end;
+
+static bool kvm_halt_poll_budget_allows(void)
+{
+	unsigned int pct = READ_ONCE(halt_poll_budget_pct);
+	unsigned long end = READ_ONCE(halt_poll_budget_end);
+	u64 budget;
+
+	if (!pct)
+		return true;
+
+	if (time_after_eq(jiffies, end) &&
+	    cmpxchg(&halt_poll_budget_end, end,
+		    jiffies + KVM_HALT_POLL_BUDGET_WINDOW) == end)
+		atomic64_set(&halt_poll_budget_used, 0);
+
+	budget = jiffies_to_nsecs(KVM_HALT_POLL_BUDGET_WINDOW) *
+		 num_online_cpus() * pct;
+	return atomic64_read(&halt_poll_budget_used) * 100 < budget;
+}
+
+static void kvm_halt_poll_budget_charge(u64 poll_ns)
+{
+	if (READ_ONCE(halt_poll_budget_pct))
+		atomic64_add(poll_ns, &halt_poll_budget_used);
+}
+
+static void kvm_halt_hist_record(struct kvm_vcpu *vcpu, u64 block_ns)
+{
+	struct kvm_halt_poll_hist *hist = &vcpu->halt_hist;
+	unsigned int i;
+
+	i = min_t(unsigned int, fls64(block_ns >> KVM_HALT_POLL_HIST_SHIFT),
+		  KVM_HALT_POLL_HIST_BUCKETS - 1);
+	hist->bucket[i]++;
+
+	if (++hist->total < KVM_HALT_POLL_HIST_DECAY)
+		return;
+
+	/* Age old samples so that the window follows phase changes. */
+	hist->total = 0;
+	for (i = 0; i < KVM_HALT_POLL_HIST_BUCKETS; i++) {
+		hist->bucket[i] >>= 1;
+		hist->total += hist->bucket[i];
+	}
+}
+
+/*
+ * Pick the shortest window that would have caught target_pct of the
+ * recorded halts.  If that exceeds halt_poll_ns, polling mostly burns
+ * CPU, so do not poll at all.
+ */
+static void kvm_halt_hist_update_poll_ns(struct kvm_vcpu *vcpu,
+					 unsigned int target_pct)
+{
+	struct kvm_halt_poll_hist *hist = &vcpu->halt_hist;
+	unsigned int old = vcpu->halt_poll_ns, val = 0;
+	u64 need, sum = 0, limit;
+	unsigned int i;
+
+	need = (u64)hist->total * min(target_pct, 100U);
+	for (i = 0; i < KVM_HALT_POLL_HIST_BUCKETS - 1; i++) {
+		sum += hist->bucket[i];
+		if (sum * 100 >= need)
+			break;
+	}
+
+	limit = 1ULL << (i + KVM_HALT_POLL_HIST_SHIFT);
+	if (i < KVM_HALT_POLL_HIST_BUCKETS - 1 && limit <= halt_poll_ns)
+		val = limit;
+
+	if (val == old)
+		return;
+
+	vcpu->halt_poll_ns = val;
+	if (val > old)
+		trace_kvm_halt_poll_ns_grow(vcpu->vcpu_id, val, old);
+	else
+		trace_kvm_halt_poll_ns_shrink(vcpu->vcpu_id, val, old);
+}
+
 static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
 {
 	if (kvm_arch_vcpu_runnable(vcpu)) {
@@ -2127,13 +2286,14 @@ static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
  */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
-	ktime_t start, cur;
+	ktime_t start, cur, poll_end;
 	DECLARE_SWAITQUEUE(wait);
+	unsigned int target_pct;
 	bool waited = false;
 	u64 block_ns;
 
-	start = cur = ktime_get();
-	if (vcpu->halt_poll_ns) {
+	start = cur = poll_end = ktime_get();
+	if (vcpu->halt_poll_ns && kvm_halt_poll_budget_allows()) {
 		ktime_t stop = ktime_add_ns(ktime_get(), vcpu->halt_poll_ns);
 
 		++vcpu->stat.halt_attempted_poll;
@@ -2146,10 +2306,20 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 				++vcpu->stat.halt_successful_poll;
 				if (!vcpu_valid_wakeup(vcpu))
 					++vcpu->stat.halt_poll_invalid;
+				cur = poll_end = ktime_get();
+				vcpu->halt_poll_success_ns +=
+					ktime_to_ns(cur) - ktime_to_ns(start);
+				kvm_halt_poll_budget_charge(ktime_to_ns(cur) -
+							    ktime_to_ns(start));
 				goto out;
 			}
 			cur = ktime_get();
 		} while (single_task_running() && ktime_before(cur, stop));
+
+		poll_end = cur;
+		vcpu->halt_poll_fail_ns += ktime_to_ns(cur) - ktime_to_ns(start);
+		kvm_halt_poll_budget_charge(ktime_to_ns(cur) -
+					    ktime_to_ns(start));
 	}
 
 	kvm_arch_vcpu_blocking(vcpu);
@@ -2168,12 +2338,17 @@ void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 	cur = ktime_get();
 
 	kvm_arch_vcpu_unblocking(vcpu);
+	vcpu->halt_wait_ns += ktime_to_ns(cur) - ktime_to_ns(poll_end);
 out:
 	block_ns = ktime_to_ns(cur) - ktime_to_ns(start);
+	target_pct = READ_ONCE(halt_poll_target_pct);
 
 	if (!vcpu_valid_wakeup(vcpu))
 		shrink_halt_poll_ns(vcpu);
-	else if (halt_poll_ns) {
+	else if (halt_poll_ns && target_pct) {
+		kvm_halt_hist_record(vcpu, block_ns);
+		kvm_halt_hist_update_poll_ns(vcpu, target_pct);
+	} else if (halt_poll_ns) {
 		if (block_ns <= vcpu->halt_poll_ns)
 			;
 		/* we had a long block, shrink polling */
@@ -2352,9 +2527,18 @@ static int kvm_vcpu_fault(struct vm_fault *vmf)
 		page = virt_to_page(vcpu->arch.pio_data);
 #endif
 #ifdef CONFIG_KVM_MMIO
-	else if (vmf->pgoff == KVM_COALESCED_MMIO_PAGE_OFFSET)
-		page = virt_to_page(vcpu->kvm->coalesced_mmio_ring);
+	else if (vmf->pgoff >= KVM_COALESCED_MMIO_PAGE_OFFSET &&
+		 vmf->pgoff < KVM_COALESCED_MMIO_PAGE_OFFSET +
+			      (1UL << vcpu->kvm->coalesced_mmio_order))
+		page = virt_to_page((void *)vcpu->kvm->coalesced_mmio_ring +
+			(vmf->pgoff - KVM_COALESCED_MMIO_PAGE_OFFSET) *
+			PAGE_SIZE);
 #endif
+	else if (vmf->pgoff >= KVM_DIRTY_LOG_PAGE_OFFSET &&
+		 vmf->pgoff < KVM_DIRTY_LOG_PAGE_OFFSET +
+			      vcpu->kvm->dirty_ring_size / PAGE_SIZE)
+		page = kvm_dirty_ring_get_page(&vcpu->dirty_ring,
+				vmf->pgoff - KVM_DIRTY_LOG_PAGE_OFFSET);
 	else
 		return kvm_arch_vcpu_fault(vcpu, vmf);
 	get_page(page);
@@ -2402,14 +2586,27 @@ static int create_vcpu_fd(struct kvm_vcpu *vcpu)
 	return anon_inode_getfd(name, &kvm_vcpu_fops, vcpu, O_RDWR | O_CLOEXEC);
 }
 
+static int halt_poll_hist_show(struct seq_file *m, void *v)
+{
+	struct kvm_vcpu *vcpu = m->private;
+	unsigned int i;
+
+	seq_printf(m, "poll_ns %u\n", READ_ONCE(vcpu->halt_poll_ns));
+	for (i = 0; i < KVM_HALT_POLL_HIST_BUCKETS; i++)
+		seq_printf(m, "%s%llu %u\n",
+			   i == KVM_HALT_POLL_HIST_BUCKETS - 1 ? ">=" : "<",
+			   1ULL << (i + KVM_HALT_POLL_HIST_SHIFT -
+				    (i == KVM_HALT_POLL_HIST_BUCKETS - 1)),
+			   READ_ONCE(vcpu->halt_hist.bucket[i]));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(halt_poll_hist);
+
 static int kvm_create_vcpu_debugfs(struct kvm_vcpu *vcpu)
 {
 	char dir_name[ITOA_MAX_LEN * 2];
 	int ret;
 
-	if (!kvm_arch_has_vcpu_debugfs())
-		return 0;
-
 	if (!debugfs_initialized())
 		return 0;
 
@@ -2419,6 +2616,18 @@ static int kvm_create_vcpu_debugfs(struct kvm_vcpu *vcpu)
 	if (!vcpu->debugfs_dentry)
 		return -ENOMEM;
 
+	debugfs_create_u64("halt_poll_success_ns", 0444, vcpu->debugfs_dentry,
+			   &vcpu->halt_poll_success_ns);
+	debugfs_create_u64("halt_poll_fail_ns", 0444, vcpu->debugfs_dentry,
+			   &vcpu->halt_poll_fail_ns);
+	debugfs_create_u64("halt_wait_ns", 0444, vcpu->debugfs_dentry,
+			   &vcpu->halt_wait_ns);
+	debugfs_create_file("halt_poll_hist", 0444, vcpu->debugfs_dentry,
+			    vcpu, &halt_poll_hist_fops);
+
+	if (!kvm_arch_has_vcpu_debugfs())
+		return 0;
+
 	ret = kvm_arch_create_vcpu_debugfs(vcpu);
 	if (ret < 0) {
 		debugfs_remove_recursive(vcpu->debugfs_dentry);
@@ -2557,6 +2766,10 @@ static long kvm_vcpu_ioctl(struct file *filp,
 				synchronize_rcu();
 			put_pid(oldpid);
 		}
+		if (kvm_dirty_ring_check_exit(vcpu)) {
+			r = 0;
+			break;
+		}
 		r = kvm_arch_vcpu_ioctl_run(vcpu, vcpu->run);
 		trace_kvm_userspace_exit(vcpu->run->exit_reason, r);
 		break;
@@ -2918,6 +3131,10 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #ifdef CONFIG_KVM_MMIO
 	case KVM_CAP_COALESCED_MMIO:
 		return KVM_COALESCED_MMIO_PAGE_OFFSET;
+	case KVM_CAP_COALESCED_PIO:
+		return 1;
+	case KVM_CAP_COALESCED_MMIO_RING:
+		return KVM_COALESCED_MMIO_MAX_PAGES;
 #endif
 #ifdef CONFIG_HAVE_KVM_IRQ_ROUTING
 	case KVM_CAP_IRQ_ROUTING:
@@ -2929,12 +3146,65 @@ static long kvm_vm_ioctl_check_extension_generic(struct kvm *kvm, long arg)
 #endif
 	case KVM_CAP_MAX_VCPU_ID:
 		return KVM_MAX_VCPU_ID;
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_CAP_DIRTY_LOG_RING:
+		return KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn);
+#endif
 	default:
 		break;
 	}
 	return kvm_vm_ioctl_check_extension(kvm, arg);
 }
 
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+static int kvm_vm_ioctl_enable_dirty_log_ring(struct kvm *kvm, u32 size)
+{
+	int r;
+
+	/* The size needs to be a power of two and cover whole pages */
+	if (!size || (size & (size - 1)) || size < PAGE_SIZE)
+		return -EINVAL;
+
+	if (size < 2 * KVM_DIRTY_RING_RSVD_ENTRIES *
+		   sizeof(struct kvm_dirty_gfn))
+		return -EINVAL;
+
+	if (size > KVM_DIRTY_RING_MAX_ENTRIES * sizeof(struct kvm_dirty_gfn))
+		return -E2BIG;
+
+	mutex_lock(&kvm->lock);
+	/* The rings are allocated with the vcpus */
+	if (kvm->created_vcpus || kvm->dirty_ring_size)
+		r = -EINVAL;
+	else {
+		kvm->dirty_ring_size = size;
+		r = 0;
+	}
+	mutex_unlock(&kvm->lock);
+
+	return r;
+}
+
+static int kvm_vm_ioctl_reset_dirty_pages(struct kvm *kvm)
+{
+	struct kvm_vcpu *vcpu;
+	int i, cleared = 0;
+
+	if (!kvm->dirty_ring_size)
+		return -EINVAL;
+
+	mutex_lock(&kvm->slots_lock);
+	kvm_for_each_vcpu(i, vcpu, kvm)
+		cleared += kvm_dirty_ring_reset(kvm, &vcpu->dirty_ring);
+	mutex_unlock(&kvm->slots_lock);
+
+	if (cleared)
+		kvm_flush_remote_tlbs(kvm);
+
+	return cleared;
+}
+#endif
+
 static long kvm_vm_ioctl(struct file *filp,
 			   unsigned int ioctl, unsigned long arg)
 {
@@ -3096,6 +3366,37 @@ static long kvm_vm_ioctl(struct file *filp,
 	case KVM_CHECK_EXTENSION:
 		r = kvm_vm_ioctl_check_extension_generic(kvm, arg);
 		break;
+	case KVM_ENABLE_CAP: {
+		struct kvm_enable_cap cap;
+
+		r = -EFAULT;
+		if (copy_from_user(&cap, argp, sizeof(cap)))
+			goto out;
+		switch (cap.cap) {
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+		case KVM_CAP_DIRTY_LOG_RING:
+			r = -EINVAL;
+			if (cap.flags)
+				goto out;
+			r = kvm_vm_ioctl_enable_dirty_log_ring(kvm,
+							       cap.args[0]);
+			break;
+#endif
+#ifdef CONFIG_KVM_MMIO
+		case KVM_CAP_COALESCED_MMIO_RING:
+			r = kvm_vm_ioctl_enable_coalesced_ring(kvm, &cap);
+			break;
+#endif
+		default:
+			r = kvm_arch_vm_ioctl(filp, ioctl, arg);
+		}
+		break;
+	}
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+	case KVM_RESET_DIRTY_RINGS:
+		r = kvm_vm_ioctl_reset_dirty_pages(kvm);
+		break;
+#endif
 	default:
 		r = kvm_arch_vm_ioctl(filp, ioctl, arg);
 	}
@@ -3450,6 +3751,10 @@ int kvm_io_bus_write(struct kvm_vcpu *vcpu, enum kvm_bus bus_idx, gpa_t addr,
 	struct kvm_io_range range;
 	int r;
 
+	/* Doorbell writes are the hot case; they never touch the bus. */
+	if (!kvm_ioeventfd_write(vcpu, bus_idx, addr, len, val))
+		return 0;
+
 	range = (struct kvm_io_range) {
 		.addr = addr,
 		.len = len,
@@ -3954,6 +4259,8 @@ static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 	if (vcpu->preempted)
 		vcpu->preempted = false;
 
+	__this_cpu_write(kvm_running_vcpu, vcpu);
+
 	kvm_arch_sched_in(vcpu, cpu);
 
 	kvm_arch_vcpu_load(vcpu, cpu);
@@ -3967,6 +4274,7 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 	if (current->state == TASK_RUNNING)
 		vcpu->preempted = true;
 	kvm_arch_vcpu_put(vcpu);
+	__this_cpu_write(kvm_running_vcpu, NULL);
 }
 
 int kvm_init(void *opaque, unsigned vcpu_size, unsigned vcpu_align,